@@ -389,18 +389,6 @@ OpenGL extensions.
 ================================================================================================================================
 */
 
-typedef struct {
-    bool timer_query;                       // GL_ARB_timer_query, GL_EXT_disjoint_timer_query
-    bool texture_clamp_to_border;           // GL_EXT_texture_border_clamp, GL_OES_texture_border_clamp
-    bool buffer_storage;                    // GL_ARB_buffer_storage
-    bool multi_sampled_storage;             // GL_ARB_texture_storage_multisample
-    bool multi_view;                        // GL_OVR_multiview, GL_OVR_multiview2
-    bool multi_sampled_resolve;             // GL_EXT_multisampled_render_to_texture
-    bool multi_view_multi_sampled_resolve;  // GL_OVR_multiview_multisampled_render_to_texture
-
-    int texture_clamp_to_border_id;
-} ksOpenGLExtensions;
-
 ksOpenGLExtensions glExtensions;
 
 /*
@@ -425,7 +413,7 @@ GLint glGetInteger(GLenum pname) {
     return i;
 }
 
-static bool GlCheckExtension(const char *extension) {
+bool GlCheckExtension(const char *extension) {
 #if defined(OS_WINDOWS) || defined(OS_LINUX)
     PFNGLGETSTRINGIPROC glGetStringi = (PFNGLGETSTRINGIPROC)GetExtension("glGetStringi");
 #endif
@@ -477,6 +465,7 @@ PFNGLDELETEVERTEXARRAYSPROC glDeleteVertexArrays;
 PFNGLBINDVERTEXARRAYPROC glBindVertexArray;
 PFNGLVERTEXATTRIBPOINTERPROC glVertexAttribPointer;
 PFNGLVERTEXATTRIBDIVISORPROC glVertexAttribDivisor;
+PFNGLVERTEXATTRIB4FVPROC glVertexAttrib4fv;
 PFNGLDISABLEVERTEXATTRIBARRAYPROC glDisableVertexAttribArray;
 PFNGLENABLEVERTEXATTRIBARRAYPROC glEnableVertexAttribArray;
 
@@ -511,6 +500,9 @@ PFNGLATTACHSHADERPROC glAttachShader;
 PFNGLLINKPROGRAMPROC glLinkProgram;
 PFNGLGETPROGRAMIVPROC glGetProgramiv;
 PFNGLGETPROGRAMINFOLOGPROC glGetProgramInfoLog;
+PFNGLPROGRAMPARAMETERIPROC glProgramParameteri;
+PFNGLGETPROGRAMBINARYPROC glGetProgramBinary;
+PFNGLPROGRAMBINARYPROC glProgramBinary;
 PFNGLGETATTRIBLOCATIONPROC glGetAttribLocation;
 PFNGLBINDATTRIBLOCATIONPROC glBindAttribLocation;
 PFNGLGETUNIFORMLOCATIONPROC glGetUniformLocation;
@@ -540,6 +532,7 @@ PFNGLUNIFORMMATRIX4X3FVPROC glUniformMatrix4x3fv;
 PFNGLUNIFORMMATRIX4FVPROC glUniformMatrix4fv;
 
 PFNGLDRAWELEMENTSINSTANCEDPROC glDrawElementsInstanced;
+PFNGLMULTIDRAWELEMENTSINDIRECTPROC glMultiDrawElementsIndirect;
 PFNGLDISPATCHCOMPUTEPROC glDispatchCompute;
 PFNGLMEMORYBARRIERPROC glMemoryBarrier;
 
@@ -631,6 +624,7 @@ void GlInitExtensions() {
     glBindVertexArray = (PFNGLBINDVERTEXARRAYPROC)GetExtension("glBindVertexArray");
     glVertexAttribPointer = (PFNGLVERTEXATTRIBPOINTERPROC)GetExtension("glVertexAttribPointer");
     glVertexAttribDivisor = (PFNGLVERTEXATTRIBDIVISORPROC)GetExtension("glVertexAttribDivisor");
+    glVertexAttrib4fv = (PFNGLVERTEXATTRIB4FVPROC)GetExtension("glVertexAttrib4fv");
     glDisableVertexAttribArray = (PFNGLDISABLEVERTEXATTRIBARRAYPROC)GetExtension("glDisableVertexAttribArray");
     glEnableVertexAttribArray = (PFNGLENABLEVERTEXATTRIBARRAYPROC)GetExtension("glEnableVertexAttribArray");
 
@@ -665,6 +659,9 @@ void GlInitExtensions() {
     glLinkProgram = (PFNGLLINKPROGRAMPROC)GetExtension("glLinkProgram");
     glGetProgramiv = (PFNGLGETPROGRAMIVPROC)GetExtension("glGetProgramiv");
     glGetProgramInfoLog = (PFNGLGETPROGRAMINFOLOGPROC)GetExtension("glGetProgramInfoLog");
+    glProgramParameteri = (PFNGLPROGRAMPARAMETERIPROC)GetExtension("glProgramParameteri");
+    glGetProgramBinary = (PFNGLGETPROGRAMBINARYPROC)GetExtension("glGetProgramBinary");
+    glProgramBinary = (PFNGLPROGRAMBINARYPROC)GetExtension("glProgramBinary");
     glGetAttribLocation = (PFNGLGETATTRIBLOCATIONPROC)GetExtension("glGetAttribLocation");
     glBindAttribLocation = (PFNGLBINDATTRIBLOCATIONPROC)GetExtension("glBindAttribLocation");
     glGetUniformLocation = (PFNGLGETUNIFORMLOCATIONPROC)GetExtension("glGetUniformLocation");
@@ -694,6 +691,7 @@ void GlInitExtensions() {
     glShaderStorageBlockBinding = (PFNGLSHADERSTORAGEBLOCKBINDINGPROC)GetExtension("glShaderStorageBlockBinding");
 
     glDrawElementsInstanced = (PFNGLDRAWELEMENTSINSTANCEDPROC)GetExtension("glDrawElementsInstanced");
+    glMultiDrawElementsIndirect = (PFNGLMULTIDRAWELEMENTSINDIRECTPROC)GetExtension("glMultiDrawElementsIndirect");
     glDispatchCompute = (PFNGLDISPATCHCOMPUTEPROC)GetExtension("glDispatchCompute");
     glMemoryBarrier = (PFNGLMEMORYBARRIERPROC)GetExtension("glMemoryBarrier");
 
@@ -726,12 +724,13 @@ void GlInitExtensions() {
 
     glExtensions.timer_query = GlCheckExtension("GL_EXT_timer_query");
     glExtensions.texture_clamp_to_border = true;  // always available
-    glExtensions.buffer_storage =
-        GlCheckExtension("GL_EXT_buffer_storage") || (OPENGL_VERSION_MAJOR * 10 + OPENGL_VERSION_MINOR >= 44);
+    glExtensions.buffer_storage = GlCheckExtension("GL_ARB_buffer_storage") || GlCheckExtension("GL_EXT_buffer_storage") ||
+                                  (OPENGL_VERSION_MAJOR * 10 + OPENGL_VERSION_MINOR >= 44);
     glExtensions.multi_sampled_storage =
         GlCheckExtension("GL_ARB_texture_storage_multisample") || (OPENGL_VERSION_MAJOR * 10 + OPENGL_VERSION_MINOR >= 43);
     glExtensions.multi_view = GlCheckExtension("GL_OVR_multiview2");
     glExtensions.multi_sampled_resolve = GlCheckExtension("GL_EXT_multisampled_render_to_texture");
+    glExtensions.multi_sampled_depth_resolve = GlCheckExtension("GL_EXT_multisampled_render_to_texture2");
     glExtensions.multi_view_multi_sampled_resolve = GlCheckExtension("GL_OVR_multiview_multisampled_render_to_texture");
 
     glExtensions.texture_clamp_to_border_id = GL_CLAMP_TO_BORDER;
@@ -747,12 +746,13 @@ PFNGLRENDERBUFFERSTORAGEMULTISAMPLEEXTPROC glRenderbufferStorageMultisampleEXT;
 void GlInitExtensions() {
     glExtensions.timer_query = GlCheckExtension("GL_EXT_timer_query");
     glExtensions.texture_clamp_to_border = true;  // always available
-    glExtensions.buffer_storage =
-        GlCheckExtension("GL_EXT_buffer_storage") || (OPENGL_VERSION_MAJOR * 10 + OPENGL_VERSION_MINOR >= 44);
+    glExtensions.buffer_storage = GlCheckExtension("GL_ARB_buffer_storage") || GlCheckExtension("GL_EXT_buffer_storage") ||
+                                  (OPENGL_VERSION_MAJOR * 10 + OPENGL_VERSION_MINOR >= 44);
     glExtensions.multi_sampled_storage =
         GlCheckExtension("GL_ARB_texture_storage_multisample") || (OPENGL_VERSION_MAJOR * 10 + OPENGL_VERSION_MINOR >= 43);
     glExtensions.multi_view = GlCheckExtension("GL_OVR_multiview2");
     glExtensions.multi_sampled_resolve = GlCheckExtension("GL_EXT_multisampled_render_to_texture");
+    glExtensions.multi_sampled_depth_resolve = GlCheckExtension("GL_EXT_multisampled_render_to_texture2");
     glExtensions.multi_view_multi_sampled_resolve = GlCheckExtension("GL_OVR_multiview_multisampled_render_to_texture");
 
     glExtensions.texture_clamp_to_border_id = GL_CLAMP_TO_BORDER;
@@ -878,6 +878,7 @@ void GlInitExtensions() {
     glExtensions.buffer_storage = GlCheckExtension("GL_EXT_buffer_storage");
     glExtensions.multi_view = GlCheckExtension("GL_OVR_multiview2");
     glExtensions.multi_sampled_resolve = GlCheckExtension("GL_EXT_multisampled_render_to_texture");
+    glExtensions.multi_sampled_depth_resolve = GlCheckExtension("GL_EXT_multisampled_render_to_texture2");
     glExtensions.multi_view_multi_sampled_resolve = GlCheckExtension("GL_OVR_multiview_multisampled_render_to_texture");
 
     glExtensions.texture_clamp_to_border_id =
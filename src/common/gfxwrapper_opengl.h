@@ -426,6 +426,7 @@ Common defines
 #endif
 
 void GlInitExtensions();
+bool GlCheckExtension(const char *extension);
 
 /*
 ================================================================================================================================
@@ -435,6 +436,21 @@ OpenGL extensions.
 ================================================================================================================================
 */
 
+typedef struct {
+    bool timer_query;                       // GL_ARB_timer_query, GL_EXT_disjoint_timer_query
+    bool texture_clamp_to_border;           // GL_EXT_texture_border_clamp, GL_OES_texture_border_clamp
+    bool buffer_storage;                    // GL_ARB_buffer_storage
+    bool multi_sampled_storage;             // GL_ARB_texture_storage_multisample
+    bool multi_view;                        // GL_OVR_multiview, GL_OVR_multiview2
+    bool multi_sampled_resolve;             // GL_EXT_multisampled_render_to_texture
+    bool multi_sampled_depth_resolve;       // GL_EXT_multisampled_render_to_texture2
+    bool multi_view_multi_sampled_resolve;  // GL_OVR_multiview_multisampled_render_to_texture
+
+    int texture_clamp_to_border_id;
+} ksOpenGLExtensions;
+
+extern ksOpenGLExtensions glExtensions;
+
 /*
 ================================
 Multi-view support
@@ -509,6 +525,7 @@ extern PFNGLDELETEVERTEXARRAYSPROC glDeleteVertexArrays;
 extern PFNGLBINDVERTEXARRAYPROC glBindVertexArray;
 extern PFNGLVERTEXATTRIBPOINTERPROC glVertexAttribPointer;
 extern PFNGLVERTEXATTRIBDIVISORPROC glVertexAttribDivisor;
+extern PFNGLVERTEXATTRIB4FVPROC glVertexAttrib4fv;
 extern PFNGLDISABLEVERTEXATTRIBARRAYPROC glDisableVertexAttribArray;
 extern PFNGLENABLEVERTEXATTRIBARRAYPROC glEnableVertexAttribArray;
 
@@ -543,6 +560,9 @@ extern PFNGLATTACHSHADERPROC glAttachShader;
 extern PFNGLLINKPROGRAMPROC glLinkProgram;
 extern PFNGLGETPROGRAMIVPROC glGetProgramiv;
 extern PFNGLGETPROGRAMINFOLOGPROC glGetProgramInfoLog;
+extern PFNGLPROGRAMPARAMETERIPROC glProgramParameteri;
+extern PFNGLGETPROGRAMBINARYPROC glGetProgramBinary;
+extern PFNGLPROGRAMBINARYPROC glProgramBinary;
 extern PFNGLGETATTRIBLOCATIONPROC glGetAttribLocation;
 extern PFNGLBINDATTRIBLOCATIONPROC glBindAttribLocation;
 extern PFNGLGETUNIFORMLOCATIONPROC glGetUniformLocation;
@@ -572,6 +592,7 @@ extern PFNGLUNIFORMMATRIX4X3FVPROC glUniformMatrix4x3fv;
 extern PFNGLUNIFORMMATRIX4FVPROC glUniformMatrix4fv;
 
 extern PFNGLDRAWELEMENTSINSTANCEDPROC glDrawElementsInstanced;
+extern PFNGLMULTIDRAWELEMENTSINDIRECTPROC glMultiDrawElementsIndirect;
 extern PFNGLDISPATCHCOMPUTEPROC glDispatchCompute;
 extern PFNGLMEMORYBARRIERPROC glMemoryBarrier;
 
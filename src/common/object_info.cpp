@@ -46,6 +46,15 @@ std::string XrSdkLogObjectInfo::ToString() const {
     return oss.str();
 }
 
+size_t ObjectInfoCollection::ObjectKeyHash::operator()(ObjectKey const& key) const {
+    // Handles are often aligned pointers or small counters, so mix all the bits down (the splitmix64 finalizer) rather than
+    // relying on std::hash, which is the identity for integers on some standard libraries.
+    uint64_t h = key.handle ^ (static_cast<uint64_t>(key.type) << 48);
+    h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+    return static_cast<size_t>(h ^ (h >> 31));
+}
+
 void ObjectInfoCollection::AddObjectName(uint64_t object_handle, XrObjectType object_type, const std::string& object_name) {
     // If name is empty, we should erase it
     if (object_name.empty()) {
@@ -65,28 +74,31 @@ void ObjectInfoCollection::AddObjectName(uint64_t object_handle, XrObjectType ob
 
     // It doesn't exist, so add a new info block
     new_obj.name = object_name;
-    object_info_.push_back(new_obj);
+    auto it = object_info_.insert(object_info_.end(), std::move(new_obj));
+    object_index_.emplace(ObjectKey{object_handle, object_type}, it);
 }
 
 void ObjectInfoCollection::RemoveObject(uint64_t object_handle, XrObjectType object_type) {
-    vector_remove_if_and_erase(
-        object_info_, [=](XrSdkLogObjectInfo const& info) { return info.handle == object_handle && info.type == object_type; });
+    auto index_it = object_index_.find(ObjectKey{object_handle, object_type});
+    if (index_it == object_index_.end()) {
+        return;
+    }
+    object_info_.erase(index_it->second);
+    object_index_.erase(index_it);
 }
 
 XrSdkLogObjectInfo const* ObjectInfoCollection::LookUpStoredObjectInfo(XrSdkLogObjectInfo const& info) const {
-    auto e = object_info_.end();
-    auto it = std::find_if(object_info_.begin(), e, [&](XrSdkLogObjectInfo const& stored) { return Equivalent(stored, info); });
-    if (it != e) {
-        return &(*it);
+    auto index_it = object_index_.find(ObjectKey{info.handle, info.type});
+    if (index_it != object_index_.end()) {
+        return &(*index_it->second);
     }
     return nullptr;
 }
 
 XrSdkLogObjectInfo* ObjectInfoCollection::LookUpStoredObjectInfo(XrSdkLogObjectInfo const& info) {
-    auto e = object_info_.end();
-    auto it = std::find_if(object_info_.begin(), e, [&](XrSdkLogObjectInfo const& stored) { return Equivalent(stored, info); });
-    if (it != e) {
-        return &(*it);
+    auto index_it = object_index_.find(ObjectKey{info.handle, info.type});
+    if (index_it != object_index_.end()) {
+        return &(*index_it->second);
     }
     return nullptr;
 }
@@ -31,6 +31,8 @@
 
 #include <openxr/openxr.h>
 
+#include <cstddef>
+#include <list>
 #include <memory>
 #include <string>
 #include <unordered_map>
@@ -116,6 +118,9 @@ static inline bool Equivalent(XrDebugUtilsObjectNameInfoEXT const& a, XrSdkLogOb
 static inline bool Equivalent(XrSdkLogObjectInfo const& a, XrDebugUtilsObjectNameInfoEXT const& b) { return Equivalent(b, a); }
 
 /// Object info registered with calls to xrSetDebugUtilsObjectNameEXT
+///
+/// Kept in the order the names were first set, with a hash index keyed by (type, handle) so that lookups and removals,
+/// which happen for every object of every debug utils callback, do not scan all named objects.
 class ObjectInfoCollection {
    public:
     void AddObjectName(uint64_t object_handle, XrObjectType object_type, const std::string& object_name);
@@ -148,8 +153,24 @@ class ObjectInfoCollection {
     bool Empty() const { return object_info_.empty(); }
 
    private:
-    // Object names that have been set for given objects
-    std::vector<XrSdkLogObjectInfo> object_info_;
+    struct ObjectKey {
+        uint64_t handle;
+        XrObjectType type;
+
+        bool operator==(ObjectKey const& other) const { return handle == other.handle && type == other.type; }
+    };
+
+    struct ObjectKeyHash {
+        size_t operator()(ObjectKey const& key) const;
+    };
+
+    using ObjectInfoList = std::list<XrSdkLogObjectInfo>;
+
+    // Object names that have been set for given objects, in insertion order
+    ObjectInfoList object_info_;
+
+    // Position of each entry of object_info_, which list iterators keep across insertions and removals of other entries
+    std::unordered_map<ObjectKey, ObjectInfoList::iterator, ObjectKeyHash> object_index_;
 };
 
 struct XrSdkSessionLabel;
@@ -98,6 +98,18 @@ inline static void XrMatrix4x4f_Transpose(XrMatrix4x4f* result, const XrMatrix4x
 inline static void XrMatrix4x4f_Invert(XrMatrix4x4f* result, const XrMatrix4x4f* src);
 inline static void XrMatrix4x4f_InvertRigidBody(XrMatrix4x4f* result, const XrMatrix4x4f* src);
 
+inline static void XrMatrix4x4f_MultiplyScalar(XrMatrix4x4f* result, const XrMatrix4x4f* a, const XrMatrix4x4f* b);
+inline static void XrMatrix4x4f_InvertRigidBodyScalar(XrMatrix4x4f* result, const XrMatrix4x4f* src);
+inline static void XrMatrix4x4f_CreateTranslationRotationScaleScalar(XrMatrix4x4f* result, const XrVector3f* translation,
+                                                                     const XrQuaternionf* rotation, const XrVector3f* scale);
+
+inline static void XrMatrix4x4f_CreateTranslationRotationScaleArray(XrMatrix4x4f* results, const XrPosef* poses,
+                                                                    size_t poseStride, const XrVector3f* scales,
+                                                                    size_t scaleStride, size_t count);
+inline static void XrMatrix4x4f_CreateModelViewProjectionArray(XrMatrix4x4f* results, const XrMatrix4x4f* viewProjection,
+                                                               const XrPosef* poses, size_t poseStride, const XrVector3f* scales,
+                                                               size_t scaleStride, size_t count);
+
 inline static void XrMatrix4x4f_TransformVector3f(XrVector3f* result, const XrMatrix4x4f* m, const XrVector3f* v);
 inline static void XrMatrix4x4f_TransformVector4f(XrVector4f* result, const XrMatrix4x4f* m, const XrVector4f* v);
 
@@ -111,6 +123,19 @@ inline static bool XrMatrix4x4f_CullBounds(const XrMatrix4x4f* mvp, const XrVect
 #include <assert.h>
 #include <math.h>
 #include <stdbool.h>
+#include <stddef.h>
+
+// Multiply, InvertRigidBody and the array functions use SSE or NEON when the target has it, unless XR_LINEAR_NO_SIMD is
+// defined. The *Scalar functions are the plain C reference versions.
+#if !defined(XR_LINEAR_NO_SIMD)
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define XR_LINEAR_USE_SSE
+#include <xmmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__) || defined(_M_ARM64)
+#define XR_LINEAR_USE_NEON
+#include <arm_neon.h>
+#endif
+#endif
 
 #define MATH_PI 3.14159265358979323846f
 
@@ -133,6 +158,53 @@ struct XrMatrix4x4f {
     float m[16];
 };
 
+#if defined(XR_LINEAR_USE_SSE) || defined(XR_LINEAR_USE_NEON)
+#define XR_LINEAR_USE_SIMD
+
+// Four floats in a SIMD register, with the handful of operations the matrix routines need.
+#if defined(XR_LINEAR_USE_SSE)
+typedef __m128 XrSimd4f;
+
+inline static XrSimd4f XrSimd4f_Load(const float* src) { return _mm_loadu_ps(src); }
+inline static void XrSimd4f_Store(float* dst, XrSimd4f v) { _mm_storeu_ps(dst, v); }
+inline static XrSimd4f XrSimd4f_Set(float x, float y, float z, float w) { return _mm_setr_ps(x, y, z, w); }
+inline static XrSimd4f XrSimd4f_Splat(float value) { return _mm_set1_ps(value); }
+inline static XrSimd4f XrSimd4f_Add(XrSimd4f a, XrSimd4f b) { return _mm_add_ps(a, b); }
+inline static XrSimd4f XrSimd4f_Sub(XrSimd4f a, XrSimd4f b) { return _mm_sub_ps(a, b); }
+inline static XrSimd4f XrSimd4f_Mul(XrSimd4f a, XrSimd4f b) { return _mm_mul_ps(a, b); }
+// Returns a + b * c.
+inline static XrSimd4f XrSimd4f_MulAdd(XrSimd4f a, XrSimd4f b, float c) { return _mm_add_ps(a, _mm_mul_ps(b, _mm_set1_ps(c))); }
+
+inline static void XrSimd4f_Transpose(XrSimd4f* v0, XrSimd4f* v1, XrSimd4f* v2, XrSimd4f* v3) {
+    _MM_TRANSPOSE4_PS(*v0, *v1, *v2, *v3);
+}
+#else
+typedef float32x4_t XrSimd4f;
+
+inline static XrSimd4f XrSimd4f_Load(const float* src) { return vld1q_f32(src); }
+inline static void XrSimd4f_Store(float* dst, XrSimd4f v) { vst1q_f32(dst, v); }
+inline static XrSimd4f XrSimd4f_Set(float x, float y, float z, float w) {
+    const float values[4] = {x, y, z, w};
+    return vld1q_f32(values);
+}
+inline static XrSimd4f XrSimd4f_Splat(float value) { return vdupq_n_f32(value); }
+inline static XrSimd4f XrSimd4f_Add(XrSimd4f a, XrSimd4f b) { return vaddq_f32(a, b); }
+inline static XrSimd4f XrSimd4f_Sub(XrSimd4f a, XrSimd4f b) { return vsubq_f32(a, b); }
+inline static XrSimd4f XrSimd4f_Mul(XrSimd4f a, XrSimd4f b) { return vmulq_f32(a, b); }
+// Returns a + b * c.
+inline static XrSimd4f XrSimd4f_MulAdd(XrSimd4f a, XrSimd4f b, float c) { return vmlaq_n_f32(a, b, c); }
+
+inline static void XrSimd4f_Transpose(XrSimd4f* v0, XrSimd4f* v1, XrSimd4f* v2, XrSimd4f* v3) {
+    const float32x4x2_t t01 = vtrnq_f32(*v0, *v1);
+    const float32x4x2_t t23 = vtrnq_f32(*v2, *v3);
+    *v0 = vcombine_f32(vget_low_f32(t01.val[0]), vget_low_f32(t23.val[0]));
+    *v1 = vcombine_f32(vget_low_f32(t01.val[1]), vget_low_f32(t23.val[1]));
+    *v2 = vcombine_f32(vget_high_f32(t01.val[0]), vget_high_f32(t23.val[0]));
+    *v3 = vcombine_f32(vget_high_f32(t01.val[1]), vget_high_f32(t23.val[1]));
+}
+#endif
+#endif
+
 inline static float XrRcpSqrt(const float x) {
     const float SMALLEST_NON_DENORMAL = 1.1754943508222875e-038f;  // ( 1U << 23 )
     const float rcp = (x >= SMALLEST_NON_DENORMAL) ? 1.0f / sqrtf(x) : 1.0f;
@@ -239,7 +311,7 @@ inline static void XrQuaternionf_Multiply(XrQuaternionf* result, const XrQuatern
 }
 
 // Use left-multiplication to accumulate transformations.
-inline static void XrMatrix4x4f_Multiply(XrMatrix4x4f* result, const XrMatrix4x4f* a, const XrMatrix4x4f* b) {
+inline static void XrMatrix4x4f_MultiplyScalar(XrMatrix4x4f* result, const XrMatrix4x4f* a, const XrMatrix4x4f* b) {
     result->m[0] = a->m[0] * b->m[0] + a->m[4] * b->m[1] + a->m[8] * b->m[2] + a->m[12] * b->m[3];
     result->m[1] = a->m[1] * b->m[0] + a->m[5] * b->m[1] + a->m[9] * b->m[2] + a->m[13] * b->m[3];
     result->m[2] = a->m[2] * b->m[0] + a->m[6] * b->m[1] + a->m[10] * b->m[2] + a->m[14] * b->m[3];
@@ -261,6 +333,27 @@ inline static void XrMatrix4x4f_Multiply(XrMatrix4x4f* result, const XrMatrix4x4
     result->m[15] = a->m[3] * b->m[12] + a->m[7] * b->m[13] + a->m[11] * b->m[14] + a->m[15] * b->m[15];
 }
 
+// Use left-multiplication to accumulate transformations.
+inline static void XrMatrix4x4f_Multiply(XrMatrix4x4f* result, const XrMatrix4x4f* a, const XrMatrix4x4f* b) {
+#if defined(XR_LINEAR_USE_SIMD)
+    // Each result column is the columns of a weighted by a column of b.
+    const XrSimd4f a0 = XrSimd4f_Load(&a->m[0]);
+    const XrSimd4f a1 = XrSimd4f_Load(&a->m[4]);
+    const XrSimd4f a2 = XrSimd4f_Load(&a->m[8]);
+    const XrSimd4f a3 = XrSimd4f_Load(&a->m[12]);
+    for (int column = 0; column < 4; column++) {
+        const float* bColumn = &b->m[4 * column];
+        XrSimd4f sum = XrSimd4f_Mul(a0, XrSimd4f_Splat(bColumn[0]));
+        sum = XrSimd4f_MulAdd(sum, a1, bColumn[1]);
+        sum = XrSimd4f_MulAdd(sum, a2, bColumn[2]);
+        sum = XrSimd4f_MulAdd(sum, a3, bColumn[3]);
+        XrSimd4f_Store(&result->m[4 * column], sum);
+    }
+#else
+    XrMatrix4x4f_MultiplyScalar(result, a, b);
+#endif
+}
+
 // Creates the transpose of the given matrix.
 inline static void XrMatrix4x4f_Transpose(XrMatrix4x4f* result, const XrMatrix4x4f* src) {
     result->m[0] = src->m[0];
@@ -319,7 +412,7 @@ inline static void XrMatrix4x4f_Invert(XrMatrix4x4f* result, const XrMatrix4x4f*
 }
 
 // Calculates the inverse of a rigid body transform.
-inline static void XrMatrix4x4f_InvertRigidBody(XrMatrix4x4f* result, const XrMatrix4x4f* src) {
+inline static void XrMatrix4x4f_InvertRigidBodyScalar(XrMatrix4x4f* result, const XrMatrix4x4f* src) {
     result->m[0] = src->m[0];
     result->m[1] = src->m[4];
     result->m[2] = src->m[8];
@@ -338,6 +431,29 @@ inline static void XrMatrix4x4f_InvertRigidBody(XrMatrix4x4f* result, const XrMa
     result->m[15] = 1.0f;
 }
 
+// Calculates the inverse of a rigid body transform.
+inline static void XrMatrix4x4f_InvertRigidBody(XrMatrix4x4f* result, const XrMatrix4x4f* src) {
+#if defined(XR_LINEAR_USE_SIMD)
+    // The rotation is transposed, the translation is rotated back and negated.
+    XrSimd4f c0 = XrSimd4f_Load(&src->m[0]);
+    XrSimd4f c1 = XrSimd4f_Load(&src->m[4]);
+    XrSimd4f c2 = XrSimd4f_Load(&src->m[8]);
+    XrSimd4f c3 = XrSimd4f_Splat(0.0f);
+    XrSimd4f_Transpose(&c0, &c1, &c2, &c3);
+
+    XrSimd4f rotated = XrSimd4f_Mul(c0, XrSimd4f_Splat(src->m[12]));
+    rotated = XrSimd4f_MulAdd(rotated, c1, src->m[13]);
+    rotated = XrSimd4f_MulAdd(rotated, c2, src->m[14]);
+
+    XrSimd4f_Store(&result->m[0], c0);
+    XrSimd4f_Store(&result->m[4], c1);
+    XrSimd4f_Store(&result->m[8], c2);
+    XrSimd4f_Store(&result->m[12], XrSimd4f_Sub(XrSimd4f_Set(0.0f, 0.0f, 0.0f, 1.0f), rotated));
+#else
+    XrMatrix4x4f_InvertRigidBodyScalar(result, src);
+#endif
+}
+
 // Creates an identity matrix.
 inline static void XrMatrix4x4f_CreateIdentity(XrMatrix4x4f* result) {
     result->m[0] = 1.0f;
@@ -455,8 +571,8 @@ inline static void XrMatrix4x4f_CreateFromQuaternion(XrMatrix4x4f* result, const
 }
 
 // Creates a combined translation(rotation(scale(object))) matrix.
-inline static void XrMatrix4x4f_CreateTranslationRotationScale(XrMatrix4x4f* result, const XrVector3f* translation,
-                                                               const XrQuaternionf* rotation, const XrVector3f* scale) {
+inline static void XrMatrix4x4f_CreateTranslationRotationScaleScalar(XrMatrix4x4f* result, const XrVector3f* translation,
+                                                                     const XrQuaternionf* rotation, const XrVector3f* scale) {
     XrMatrix4x4f scaleMatrix;
     XrMatrix4x4f_CreateScale(&scaleMatrix, scale->x, scale->y, scale->z);
 
@@ -467,8 +583,215 @@ inline static void XrMatrix4x4f_CreateTranslationRotationScale(XrMatrix4x4f* res
     XrMatrix4x4f_CreateTranslation(&translationMatrix, translation->x, translation->y, translation->z);
 
     XrMatrix4x4f combinedMatrix;
-    XrMatrix4x4f_Multiply(&combinedMatrix, &rotationMatrix, &scaleMatrix);
-    XrMatrix4x4f_Multiply(result, &translationMatrix, &combinedMatrix);
+    XrMatrix4x4f_MultiplyScalar(&combinedMatrix, &rotationMatrix, &scaleMatrix);
+    XrMatrix4x4f_MultiplyScalar(result, &translationMatrix, &combinedMatrix);
+}
+
+// Creates a combined translation(rotation(scale(object))) matrix.
+// Writes the scaled rotation columns and the translation directly instead of multiplying three matrices.
+inline static void XrMatrix4x4f_CreateTranslationRotationScale(XrMatrix4x4f* result, const XrVector3f* translation,
+                                                               const XrQuaternionf* rotation, const XrVector3f* scale) {
+    const float x2 = rotation->x + rotation->x;
+    const float y2 = rotation->y + rotation->y;
+    const float z2 = rotation->z + rotation->z;
+
+    const float xx2 = rotation->x * x2;
+    const float yy2 = rotation->y * y2;
+    const float zz2 = rotation->z * z2;
+
+    const float yz2 = rotation->y * z2;
+    const float wx2 = rotation->w * x2;
+    const float xy2 = rotation->x * y2;
+    const float wz2 = rotation->w * z2;
+    const float xz2 = rotation->x * z2;
+    const float wy2 = rotation->w * y2;
+
+    result->m[0] = (1.0f - yy2 - zz2) * scale->x;
+    result->m[1] = (xy2 + wz2) * scale->x;
+    result->m[2] = (xz2 - wy2) * scale->x;
+    result->m[3] = 0.0f;
+
+    result->m[4] = (xy2 - wz2) * scale->y;
+    result->m[5] = (1.0f - xx2 - zz2) * scale->y;
+    result->m[6] = (yz2 + wx2) * scale->y;
+    result->m[7] = 0.0f;
+
+    result->m[8] = (xz2 + wy2) * scale->z;
+    result->m[9] = (yz2 - wx2) * scale->z;
+    result->m[10] = (1.0f - xx2 - yy2) * scale->z;
+    result->m[11] = 0.0f;
+
+    result->m[12] = translation->x;
+    result->m[13] = translation->y;
+    result->m[14] = translation->z;
+    result->m[15] = 1.0f;
+}
+
+// Creates a translation(rotation(scale(object))) matrix for each of count poses and scales. Consecutive poses are poseStride
+// bytes apart and consecutive scales scaleStride bytes apart, so they can be read from separate arrays or straight out of
+// an array of structures.
+inline static void XrMatrix4x4f_CreateTranslationRotationScaleArray(XrMatrix4x4f* results, const XrPosef* poses,
+                                                                    size_t poseStride, const XrVector3f* scales,
+                                                                    size_t scaleStride, size_t count) {
+#define XR_LINEAR_ELEMENT(type, base, stride, index) ((const type*)((const char*)(base) + (index) * (stride)))
+    size_t i = 0;
+#if defined(XR_LINEAR_USE_SIMD)
+    // Four matrices at a time, with one lane per matrix.
+    for (; i + 4 <= count; i += 4) {
+        const XrPosef* p0 = XR_LINEAR_ELEMENT(XrPosef, poses, poseStride, i);
+        const XrPosef* p1 = XR_LINEAR_ELEMENT(XrPosef, poses, poseStride, i + 1);
+        const XrPosef* p2 = XR_LINEAR_ELEMENT(XrPosef, poses, poseStride, i + 2);
+        const XrPosef* p3 = XR_LINEAR_ELEMENT(XrPosef, poses, poseStride, i + 3);
+        const XrVector3f* s0 = XR_LINEAR_ELEMENT(XrVector3f, scales, scaleStride, i);
+        const XrVector3f* s1 = XR_LINEAR_ELEMENT(XrVector3f, scales, scaleStride, i + 1);
+        const XrVector3f* s2 = XR_LINEAR_ELEMENT(XrVector3f, scales, scaleStride, i + 2);
+        const XrVector3f* s3 = XR_LINEAR_ELEMENT(XrVector3f, scales, scaleStride, i + 3);
+
+        XrSimd4f qx = XrSimd4f_Load(&p0->orientation.x);
+        XrSimd4f qy = XrSimd4f_Load(&p1->orientation.x);
+        XrSimd4f qz = XrSimd4f_Load(&p2->orientation.x);
+        XrSimd4f qw = XrSimd4f_Load(&p3->orientation.x);
+        XrSimd4f_Transpose(&qx, &qy, &qz, &qw);
+        const XrSimd4f sx = XrSimd4f_Set(s0->x, s1->x, s2->x, s3->x);
+        const XrSimd4f sy = XrSimd4f_Set(s0->y, s1->y, s2->y, s3->y);
+        const XrSimd4f sz = XrSimd4f_Set(s0->z, s1->z, s2->z, s3->z);
+
+        const XrSimd4f x2 = XrSimd4f_Add(qx, qx);
+        const XrSimd4f y2 = XrSimd4f_Add(qy, qy);
+        const XrSimd4f z2 = XrSimd4f_Add(qz, qz);
+
+        const XrSimd4f xx2 = XrSimd4f_Mul(qx, x2);
+        const XrSimd4f yy2 = XrSimd4f_Mul(qy, y2);
+        const XrSimd4f zz2 = XrSimd4f_Mul(qz, z2);
+
+        const XrSimd4f yz2 = XrSimd4f_Mul(qy, z2);
+        const XrSimd4f wx2 = XrSimd4f_Mul(qw, x2);
+        const XrSimd4f xy2 = XrSimd4f_Mul(qx, y2);
+        const XrSimd4f wz2 = XrSimd4f_Mul(qw, z2);
+        const XrSimd4f xz2 = XrSimd4f_Mul(qx, z2);
+        const XrSimd4f wy2 = XrSimd4f_Mul(qw, y2);
+
+        const XrSimd4f one = XrSimd4f_Splat(1.0f);
+        const XrSimd4f columns[3][3] = {
+            {XrSimd4f_Mul(XrSimd4f_Sub(XrSimd4f_Sub(one, yy2), zz2), sx), XrSimd4f_Mul(XrSimd4f_Add(xy2, wz2), sx),
+             XrSimd4f_Mul(XrSimd4f_Sub(xz2, wy2), sx)},
+            {XrSimd4f_Mul(XrSimd4f_Sub(xy2, wz2), sy), XrSimd4f_Mul(XrSimd4f_Sub(XrSimd4f_Sub(one, xx2), zz2), sy),
+             XrSimd4f_Mul(XrSimd4f_Add(yz2, wx2), sy)},
+            {XrSimd4f_Mul(XrSimd4f_Add(xz2, wy2), sz), XrSimd4f_Mul(XrSimd4f_Sub(yz2, wx2), sz),
+             XrSimd4f_Mul(XrSimd4f_Sub(XrSimd4f_Sub(one, xx2), yy2), sz)},
+        };
+
+        // Transposing a column's rows gives that column of each of the four matrices.
+        for (int column = 0; column < 3; column++) {
+            XrSimd4f m0 = columns[column][0];
+            XrSimd4f m1 = columns[column][1];
+            XrSimd4f m2 = columns[column][2];
+            XrSimd4f m3 = XrSimd4f_Splat(0.0f);
+            XrSimd4f_Transpose(&m0, &m1, &m2, &m3);
+            XrSimd4f_Store(&results[i].m[4 * column], m0);
+            XrSimd4f_Store(&results[i + 1].m[4 * column], m1);
+            XrSimd4f_Store(&results[i + 2].m[4 * column], m2);
+            XrSimd4f_Store(&results[i + 3].m[4 * column], m3);
+        }
+        XrSimd4f_Store(&results[i].m[12], XrSimd4f_Set(p0->position.x, p0->position.y, p0->position.z, 1.0f));
+        XrSimd4f_Store(&results[i + 1].m[12], XrSimd4f_Set(p1->position.x, p1->position.y, p1->position.z, 1.0f));
+        XrSimd4f_Store(&results[i + 2].m[12], XrSimd4f_Set(p2->position.x, p2->position.y, p2->position.z, 1.0f));
+        XrSimd4f_Store(&results[i + 3].m[12], XrSimd4f_Set(p3->position.x, p3->position.y, p3->position.z, 1.0f));
+    }
+#endif
+    for (; i < count; i++) {
+        const XrPosef* pose = XR_LINEAR_ELEMENT(XrPosef, poses, poseStride, i);
+        XrMatrix4x4f_CreateTranslationRotationScale(&results[i], &pose->position, &pose->orientation,
+                                                    XR_LINEAR_ELEMENT(XrVector3f, scales, scaleStride, i));
+    }
+#undef XR_LINEAR_ELEMENT
+}
+
+// Creates viewProjection * translation(rotation(scale(object))) for each of count poses and scales, laid out as in
+// XrMatrix4x4f_CreateTranslationRotationScaleArray. The model matrices are never written out: each is multiplied by
+// viewProjection as it is built.
+inline static void XrMatrix4x4f_CreateModelViewProjectionArray(XrMatrix4x4f* results, const XrMatrix4x4f* viewProjection,
+                                                               const XrPosef* poses, size_t poseStride, const XrVector3f* scales,
+                                                               size_t scaleStride, size_t count) {
+#define XR_LINEAR_ELEMENT(type, base, stride, index) ((const type*)((const char*)(base) + (index) * (stride)))
+    size_t i = 0;
+#if defined(XR_LINEAR_USE_SIMD)
+    const float* vp = viewProjection->m;
+    // Four matrices at a time, with one lane per matrix.
+    for (; i + 4 <= count; i += 4) {
+        const XrPosef* p0 = XR_LINEAR_ELEMENT(XrPosef, poses, poseStride, i);
+        const XrPosef* p1 = XR_LINEAR_ELEMENT(XrPosef, poses, poseStride, i + 1);
+        const XrPosef* p2 = XR_LINEAR_ELEMENT(XrPosef, poses, poseStride, i + 2);
+        const XrPosef* p3 = XR_LINEAR_ELEMENT(XrPosef, poses, poseStride, i + 3);
+        const XrVector3f* s0 = XR_LINEAR_ELEMENT(XrVector3f, scales, scaleStride, i);
+        const XrVector3f* s1 = XR_LINEAR_ELEMENT(XrVector3f, scales, scaleStride, i + 1);
+        const XrVector3f* s2 = XR_LINEAR_ELEMENT(XrVector3f, scales, scaleStride, i + 2);
+        const XrVector3f* s3 = XR_LINEAR_ELEMENT(XrVector3f, scales, scaleStride, i + 3);
+
+        XrSimd4f qx = XrSimd4f_Load(&p0->orientation.x);
+        XrSimd4f qy = XrSimd4f_Load(&p1->orientation.x);
+        XrSimd4f qz = XrSimd4f_Load(&p2->orientation.x);
+        XrSimd4f qw = XrSimd4f_Load(&p3->orientation.x);
+        XrSimd4f_Transpose(&qx, &qy, &qz, &qw);
+        const XrSimd4f sx = XrSimd4f_Set(s0->x, s1->x, s2->x, s3->x);
+        const XrSimd4f sy = XrSimd4f_Set(s0->y, s1->y, s2->y, s3->y);
+        const XrSimd4f sz = XrSimd4f_Set(s0->z, s1->z, s2->z, s3->z);
+
+        const XrSimd4f x2 = XrSimd4f_Add(qx, qx);
+        const XrSimd4f y2 = XrSimd4f_Add(qy, qy);
+        const XrSimd4f z2 = XrSimd4f_Add(qz, qz);
+
+        const XrSimd4f xx2 = XrSimd4f_Mul(qx, x2);
+        const XrSimd4f yy2 = XrSimd4f_Mul(qy, y2);
+        const XrSimd4f zz2 = XrSimd4f_Mul(qz, z2);
+
+        const XrSimd4f yz2 = XrSimd4f_Mul(qy, z2);
+        const XrSimd4f wx2 = XrSimd4f_Mul(qw, x2);
+        const XrSimd4f xy2 = XrSimd4f_Mul(qx, y2);
+        const XrSimd4f wz2 = XrSimd4f_Mul(qw, z2);
+        const XrSimd4f xz2 = XrSimd4f_Mul(qx, z2);
+        const XrSimd4f wy2 = XrSimd4f_Mul(qw, y2);
+
+        // The upper three rows of each model column; the bottom row is 0 except in the translation column, where it is 1.
+        const XrSimd4f one = XrSimd4f_Splat(1.0f);
+        const XrSimd4f columns[4][3] = {
+            {XrSimd4f_Mul(XrSimd4f_Sub(XrSimd4f_Sub(one, yy2), zz2), sx), XrSimd4f_Mul(XrSimd4f_Add(xy2, wz2), sx),
+             XrSimd4f_Mul(XrSimd4f_Sub(xz2, wy2), sx)},
+            {XrSimd4f_Mul(XrSimd4f_Sub(xy2, wz2), sy), XrSimd4f_Mul(XrSimd4f_Sub(XrSimd4f_Sub(one, xx2), zz2), sy),
+             XrSimd4f_Mul(XrSimd4f_Add(yz2, wx2), sy)},
+            {XrSimd4f_Mul(XrSimd4f_Add(xz2, wy2), sz), XrSimd4f_Mul(XrSimd4f_Sub(yz2, wx2), sz),
+             XrSimd4f_Mul(XrSimd4f_Sub(XrSimd4f_Sub(one, xx2), yy2), sz)},
+            {XrSimd4f_Set(p0->position.x, p1->position.x, p2->position.x, p3->position.x),
+             XrSimd4f_Set(p0->position.y, p1->position.y, p2->position.y, p3->position.y),
+             XrSimd4f_Set(p0->position.z, p1->position.z, p2->position.z, p3->position.z)},
+        };
+
+        for (int column = 0; column < 4; column++) {
+            // Each row of the result column, across the four matrices, weights the model column by a row of viewProjection.
+            XrSimd4f rows[4];
+            for (int row = 0; row < 4; row++) {
+                XrSimd4f sum = column == 3 ? XrSimd4f_Splat(vp[12 + row]) : XrSimd4f_Splat(0.0f);
+                sum = XrSimd4f_MulAdd(sum, columns[column][0], vp[row]);
+                sum = XrSimd4f_MulAdd(sum, columns[column][1], vp[4 + row]);
+                rows[row] = XrSimd4f_MulAdd(sum, columns[column][2], vp[8 + row]);
+            }
+            // Transposing them gives the column of each of the four matrices.
+            XrSimd4f_Transpose(&rows[0], &rows[1], &rows[2], &rows[3]);
+            XrSimd4f_Store(&results[i].m[4 * column], rows[0]);
+            XrSimd4f_Store(&results[i + 1].m[4 * column], rows[1]);
+            XrSimd4f_Store(&results[i + 2].m[4 * column], rows[2]);
+            XrSimd4f_Store(&results[i + 3].m[4 * column], rows[3]);
+        }
+    }
+#endif
+    for (; i < count; i++) {
+        const XrPosef* pose = XR_LINEAR_ELEMENT(XrPosef, poses, poseStride, i);
+        XrMatrix4x4f model;
+        XrMatrix4x4f_CreateTranslationRotationScale(&model, &pose->position, &pose->orientation,
+                                                    XR_LINEAR_ELEMENT(XrVector3f, scales, scaleStride, i));
+        XrMatrix4x4f_Multiply(&results[i], viewProjection, &model);
+    }
+#undef XR_LINEAR_ELEMENT
 }
 
 // Creates a projection matrix based on the specified dimensions.
@@ -0,0 +1,16 @@
+// Copyright (c) 2017-2020 The Khronos Group Inc
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+// Building with HELLO_XR_COUNT_ALLOCATIONS replaces the global operator new to count every heap allocation, so the frame
+// stats can show whether the frame loop allocates.
+#if defined(HELLO_XR_COUNT_ALLOCATIONS)
+constexpr bool AllocationCountingEnabled = true;
+#else
+constexpr bool AllocationCountingEnabled = false;
+#endif
+
+// Number of operator new calls on any thread since startup. Always zero unless AllocationCountingEnabled.
+uint64_t AllocationCount();
@@ -0,0 +1,344 @@
+// Copyright (c) 2017-2020 The Khronos Group Inc.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+// Microbenchmarks of the math, logging and scene code hello_xr runs every frame, without a runtime or graphics device.
+// Results go to stdout as CSV, one line per benchmark and instance count:
+//   benchmark,instances,iterations,ns_per_op
+// Benchmarks of a function that has a SIMD version and a *Scalar reference version are run for both, the scalar ones with
+// a _scalar suffix.
+
+#include "pch.h"
+#include "common.h"
+#include <common/xr_linear.h>
+#include "scene.h"
+#include "culling.h"
+
+#include <random>
+#include <streambuf>
+
+namespace {
+// Each benchmark repeats until it has run this long and at least MinIterations times.
+constexpr std::chrono::milliseconds MinDuration{200};
+constexpr uint64_t MinIterations = 5;
+
+const size_t SceneSizes[] = {1000, 10000, 100000};
+const size_t CubeCounts[] = {100, 1000, 10000};
+
+// Inputs of the math benchmarks, enough to keep the loop overhead out of the result while staying in the L1 cache.
+constexpr size_t MathBatchSize = 256;
+
+// Messages written per call of the logging benchmarks, well below the ring's capacity so none are dropped.
+constexpr uint64_t LogBatchSize = 256;
+
+// Keeps the optimizer from dropping a result.
+volatile size_t g_sink;
+
+// Time op, which does opsPerCall operations per call, and print the time per operation.
+template <typename Op>
+void Measure(const char* benchmark, size_t instances, uint64_t opsPerCall, Op&& op) {
+    op();  // Warm up caches and allocations
+    uint64_t iterations = 0;
+    const auto start = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::duration elapsed{};
+    while (iterations < MinIterations || elapsed < MinDuration) {
+        op();
+        ++iterations;
+        elapsed = std::chrono::steady_clock::now() - start;
+    }
+    const double nanoseconds = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+    printf("%s,%zu,%llu,%.1f\n", benchmark, instances, (unsigned long long)iterations,
+           nanoseconds / (double)(iterations * opsPerCall));
+}
+
+// Cubes scattered through a box 40 m wide around the viewer, as a scene loaded with --mesh or grown by the cube benchmark
+// would spread them, with a pair of hand cubes at the end.
+void FillScene(CubeScene& scene, size_t count, std::mt19937& random) {
+    std::uniform_real_distribution<float> position(-20.0f, 20.0f);
+    std::uniform_real_distribution<float> scale(0.05f, 0.5f);
+    std::vector<Cube> cubes(count);
+    for (Cube& cube : cubes) {
+        const float size = scale(random);
+        cube.Pose = {{0, 0, 0, 1}, {position(random), position(random), position(random)}};
+        cube.Scale = {size, size, size};
+    }
+    for (size_t hand = 0; hand < 2 && hand < count; ++hand) {
+        cubes[count - 1 - hand].Pose.position = {hand == 0 ? -0.2f : 0.2f, -0.3f, -0.4f};
+        cubes[count - 1 - hand].Scale = {0.1f, 0.1f, 0.1f};
+    }
+    scene.Append(cubes);
+    scene.UpdateModels();
+}
+
+// Two views looking down -Z from eye height, about as far apart as eyes.
+std::vector<XrView> StereoViews(float yaw) {
+    std::vector<XrView> views(2, XrView{XR_TYPE_VIEW});
+    for (size_t eye = 0; eye < views.size(); ++eye) {
+        views[eye].pose.orientation = {0, std::sin(yaw / 2), 0, std::cos(yaw / 2)};
+        views[eye].pose.position = {eye == 0 ? -0.032f : 0.032f, 0, 0};
+        views[eye].fov = {-0.8f, 0.8f, 0.8f, -0.8f};
+    }
+    return views;
+}
+
+// Discards what is written to it, for the messages of the logging benchmarks.
+class NullBuffer : public std::streambuf {
+   protected:
+    int_type overflow(int_type ch) override { return traits_type::not_eof(ch); }
+    std::streamsize xsputn(const char*, std::streamsize count) override { return count; }
+};
+
+XrPosef RandomPose(std::mt19937& random) {
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+    XrVector3f axis{unit(random), unit(random), unit(random) + 2.0f};
+    XrVector3f_Normalize(&axis);
+    XrPosef pose{};
+    XrQuaternionf_CreateFromAxisAngle(&pose.orientation, &axis, unit(random) * 3.14159f);
+    pose.position = {unit(random) * 20, unit(random) * 20, unit(random) * 20};
+    return pose;
+}
+
+void BenchmarkMath() {
+    std::mt19937 random(1);
+    std::uniform_real_distribution<float> scale(0.05f, 0.5f);
+    std::vector<XrPosef> poses(MathBatchSize);
+    std::vector<XrVector3f> scales(MathBatchSize);
+    std::vector<XrMatrix4x4f> matrices(MathBatchSize);
+    for (size_t i = 0; i < MathBatchSize; ++i) {
+        poses[i] = RandomPose(random);
+        const float size = scale(random);
+        scales[i] = {size, size, size};
+        XrMatrix4x4f_CreateTranslationRotationScaleScalar(&matrices[i], &poses[i].position, &poses[i].orientation, &scales[i]);
+    }
+    std::vector<XrMatrix4x4f> results(MathBatchSize);
+
+    XrMatrix4x4f viewProjection;
+    XrMatrix4x4f_CreateProjectionFov(&viewProjection, GRAPHICS_VULKAN, StereoViews(0)[0].fov, 0.05f, 100.0f);
+
+    // Every benchmark reads one result back, so the compiler has to keep all of them.
+    const auto sink = [&] { g_sink = (size_t)results[MathBatchSize / 2].m[5]; };
+
+    Measure("matrix_multiply", 1, MathBatchSize, [&] {
+        for (size_t i = 0; i < MathBatchSize; ++i) {
+            XrMatrix4x4f_Multiply(&results[i], &viewProjection, &matrices[i]);
+        }
+        sink();
+    });
+    Measure("matrix_multiply_scalar", 1, MathBatchSize, [&] {
+        for (size_t i = 0; i < MathBatchSize; ++i) {
+            XrMatrix4x4f_MultiplyScalar(&results[i], &viewProjection, &matrices[i]);
+        }
+        sink();
+    });
+
+    Measure("create_translation_rotation_scale", 1, MathBatchSize, [&] {
+        for (size_t i = 0; i < MathBatchSize; ++i) {
+            XrMatrix4x4f_CreateTranslationRotationScale(&results[i], &poses[i].position, &poses[i].orientation, &scales[i]);
+        }
+        sink();
+    });
+    Measure("create_translation_rotation_scale_scalar", 1, MathBatchSize, [&] {
+        for (size_t i = 0; i < MathBatchSize; ++i) {
+            XrMatrix4x4f_CreateTranslationRotationScaleScalar(&results[i], &poses[i].position, &poses[i].orientation,
+                                                              &scales[i]);
+        }
+        sink();
+    });
+    Measure("create_translation_rotation_scale_array", 1, MathBatchSize, [&] {
+        XrMatrix4x4f_CreateTranslationRotationScaleArray(results.data(), poses.data(), sizeof(XrPosef), scales.data(),
+                                                         sizeof(XrVector3f), MathBatchSize);
+        sink();
+    });
+
+    Measure("invert_rigid_body", 1, MathBatchSize, [&] {
+        for (size_t i = 0; i < MathBatchSize; ++i) {
+            XrMatrix4x4f_InvertRigidBody(&results[i], &matrices[i]);
+        }
+        sink();
+    });
+    Measure("invert_rigid_body_scalar", 1, MathBatchSize, [&] {
+        for (size_t i = 0; i < MathBatchSize; ++i) {
+            XrMatrix4x4f_InvertRigidBodyScalar(&results[i], &matrices[i]);
+        }
+        sink();
+    });
+
+    // The cubes' MVPs against the cube's bounds, about half of them in front of the view.
+    const XrVector3f mins = Geometry::LBB;
+    const XrVector3f maxs = Geometry::RTF;
+    for (size_t i = 0; i < MathBatchSize; ++i) {
+        XrMatrix4x4f_Multiply(&results[i], &viewProjection, &matrices[i]);
+    }
+    Measure("cull_bounds", 1, MathBatchSize, [&] {
+        size_t culled = 0;
+        for (size_t i = 0; i < MathBatchSize; ++i) {
+            culled += XrMatrix4x4f_CullBounds(&results[i], &mins, &maxs) ? 1 : 0;
+        }
+        g_sink = culled;
+    });
+}
+
+void BenchmarkLogging() {
+    const std::string message = "Benchmark message of about the length hello_xr usually logs";
+
+    // Suppressed messages return before queueing anything, the macro before formatting the message as well.
+    Log::SetLevel(Log::Level::Info);
+    Measure("log_write_suppressed", 1, LogBatchSize, [&] {
+        for (uint64_t i = 0; i < LogBatchSize; ++i) {
+            Log::Write(Log::Level::Verbose, message);
+        }
+    });
+    uint64_t formatted = 0;
+    Measure("log_verbose_macro_suppressed", 1, LogBatchSize, [&] {
+        for (uint64_t i = 0; i < LogBatchSize; ++i) {
+            LOG_VERBOSE(Fmt("Benchmark message %llu", (unsigned long long)++formatted));
+        }
+    });
+    g_sink = (size_t)formatted;
+
+    // Active messages are queued for the logger thread, which writes them to std::cout. Point it somewhere that drops
+    // them so the CSV stays clean, and wait for every batch to be written so the ring never fills and drops some: the
+    // result is the cost of a message end to end, not just of queueing it.
+    NullBuffer nullBuffer;
+    Log::Flush();
+    std::streambuf* const coutBuffer = std::cout.rdbuf(&nullBuffer);
+    Measure("log_write_active", 1, LogBatchSize, [&] {
+        for (uint64_t i = 0; i < LogBatchSize; ++i) {
+            Log::Write(Log::Level::Info, message);
+        }
+        Log::Flush();
+    });
+    Log::Flush();
+    std::cout.rdbuf(coutBuffer);
+}
+
+// The view-projection of each view and the model-view-projection of every cube in it, as the graphics plugins'
+// RenderView build them: a model matrix per cube multiplied by the view-projection, against the fused
+// XrMatrix4x4f_CreateModelViewProjectionArray that never writes the model matrices out.
+void BenchmarkRenderViewMvps(size_t count) {
+    std::mt19937 random(1);
+    std::uniform_real_distribution<float> scale(0.05f, 0.5f);
+    std::vector<XrPosef> poses(count);
+    std::vector<XrVector3f> scales(count);
+    for (size_t i = 0; i < count; ++i) {
+        poses[i] = RandomPose(random);
+        const float size = scale(random);
+        scales[i] = {size, size, size};
+    }
+    std::vector<XrMatrix4x4f> mvps(count);
+
+    float yaw = 0;
+    const auto viewProjections = [&] {
+        std::array<XrMatrix4x4f, 2> results;
+        const std::vector<XrView> views = StereoViews(yaw);
+        yaw += 0.01f;
+        for (size_t eye = 0; eye < results.size(); ++eye) {
+            XrMatrix4x4f proj;
+            XrMatrix4x4f_CreateProjectionFov(&proj, GRAPHICS_VULKAN, views[eye].fov, 0.05f, 100.0f);
+            XrMatrix4x4f toView;
+            const XrVector3f unitScale{1.f, 1.f, 1.f};
+            XrMatrix4x4f_CreateTranslationRotationScale(&toView, &views[eye].pose.position, &views[eye].pose.orientation,
+                                                        &unitScale);
+            XrMatrix4x4f view;
+            XrMatrix4x4f_InvertRigidBody(&view, &toView);
+            XrMatrix4x4f_Multiply(&results[eye], &proj, &view);
+        }
+        return results;
+    };
+
+    Measure("render_view_mvps_stereo", count, 1, [&] {
+        for (const XrMatrix4x4f& vp : viewProjections()) {
+            for (size_t i = 0; i < count; ++i) {
+                XrMatrix4x4f model;
+                XrMatrix4x4f_CreateTranslationRotationScale(&model, &poses[i].position, &poses[i].orientation, &scales[i]);
+                XrMatrix4x4f_Multiply(&mvps[i], &vp, &model);
+            }
+        }
+        g_sink = (size_t)mvps[count / 2].m[5];
+    });
+    Measure("render_view_mvps_stereo_fused", count, 1, [&] {
+        for (const XrMatrix4x4f& vp : viewProjections()) {
+            XrMatrix4x4f_CreateModelViewProjectionArray(mvps.data(), &vp, poses.data(), sizeof(XrPosef), scales.data(),
+                                                        sizeof(XrVector3f), count);
+        }
+        g_sink = (size_t)mvps[count / 2].m[5];
+    });
+}
+
+void BenchmarkBvh(size_t count) {
+    std::mt19937 random(1);
+    CubeScene scene;
+    FillScene(scene, count, random);
+
+    const SceneBvh& sceneBvh = scene.Bvh();
+    std::vector<SceneBvh::Sphere> spheres(count);
+    for (size_t slot = 0; slot < sceneBvh.CenterX().size(); ++slot) {
+        const size_t cube = sceneBvh.SlotCube(slot);
+        if (cube < count) {
+            spheres[cube] = {{sceneBvh.CenterX()[slot], sceneBvh.CenterY()[slot], sceneBvh.CenterZ()[slot]},
+                             sceneBvh.Radius()[slot]};
+        }
+    }
+
+    SceneBvh bvh;
+    Measure("bvh_build", count, 1, [&] { bvh.Build(spheres); });
+
+    // The hand cubes jitter around where they are, as tracked objects do from frame to frame.
+    std::uniform_real_distribution<float> jitter(-0.01f, 0.01f);
+    const auto move = [&](size_t begin, size_t end) {
+        for (size_t cube = begin; cube < end; ++cube) {
+            spheres[cube].Center.x += jitter(random);
+            spheres[cube].Center.y += jitter(random);
+            spheres[cube].Center.z += jitter(random);
+        }
+        bvh.Refit(spheres, begin, end);
+    };
+    Measure("bvh_refit_hands", count, 1, [&] { move(count - 2, count); });
+    Measure("bvh_refit_1_percent", count, 1, [&] { move(count - count / 100, count); });
+
+    FrustumCuller culler;
+    std::vector<XrMatrix4x4f> visibleModels;
+    std::vector<MeshDraw> visibleDraws;
+    float yaw = 0;
+    Measure("frustum_cull_stereo", count, 1, [&] {
+        culler.SetViews(StereoViews(yaw), 0.05f, 100.0f);
+        yaw += 0.01f;
+        g_sink = culler.Cull(scene, visibleModels, visibleDraws);
+    });
+
+    // Rays from the hands in directions spread over the front hemisphere.
+    constexpr uint64_t RaysPerCall = 64;
+    std::uniform_real_distribution<float> direction(-1.0f, 1.0f);
+    std::vector<XrVector3f> directions(RaysPerCall);
+    for (XrVector3f& ray : directions) {
+        ray = {direction(random), direction(random), -1.0f};
+        XrVector3f_Normalize(&ray);
+    }
+    const XrVector3f origin{0.2f, -0.3f, -0.4f};
+    Measure("bvh_raycast", count, RaysPerCall, [&] {
+        size_t hits = 0;
+        for (const XrVector3f& ray : directions) {
+            hits += scene.Bvh().Raycast(origin, ray, 10.0f) != SceneBvh::NoCube ? 1 : 0;
+        }
+        g_sink = hits;
+    });
+}
+}  // namespace
+
+int main() {
+    try {
+        printf("benchmark,instances,iterations,ns_per_op\n");
+        BenchmarkMath();
+        BenchmarkLogging();
+        for (size_t count : CubeCounts) {
+            BenchmarkRenderViewMvps(count);
+        }
+        for (size_t count : SceneSizes) {
+            BenchmarkBvh(count);
+        }
+    } catch (const std::exception& ex) {
+        fprintf(stderr, "%s\n", ex.what());
+        return 1;
+    }
+    return 0;
+}
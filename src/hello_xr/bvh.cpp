@@ -0,0 +1,235 @@
+// Copyright (c) 2017-2020 The Khronos Group Inc.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include "pch.h"
+#include "common.h"
+#include <common/xr_linear.h>
+#include "bvh.h"
+
+#include <limits>
+
+namespace {
+// Refitting more cubes than this fraction of the tree refits every node bottom-up instead of walking up from each cube.
+constexpr size_t FullRefitDivisor = 8;
+
+float Component(const XrVector3f& v, int axis) { return axis == 0 ? v.x : (axis == 1 ? v.y : v.z); }
+}  // namespace
+
+constexpr size_t SceneBvh::LeafSize;
+constexpr size_t SceneBvh::NoCube;
+
+void SceneBvh::Build(const std::vector<Sphere>& spheres) {
+    const uint32_t count = (uint32_t)spheres.size();
+    m_nodes.clear();
+    m_parents.clear();
+    m_slotCubes.clear();
+    m_slotLeaves.clear();
+    m_centerX.clear();
+    m_centerY.clear();
+    m_centerZ.clear();
+    m_radius.clear();
+    m_cubeSlots.resize(count);
+    if (count == 0) {
+        return;
+    }
+
+    // A median split leaves at most one leaf per LeafSize / 2 cubes, and twice as many nodes.
+    const size_t leafCapacity = (count + LeafSize / 2 - 1) / (LeafSize / 2);
+    m_nodes.reserve(2 * leafCapacity);
+    m_parents.reserve(2 * leafCapacity);
+    m_slotCubes.reserve(leafCapacity * LeafSize);
+    m_slotLeaves.reserve(leafCapacity);
+    m_centerX.reserve(leafCapacity * LeafSize);
+    m_centerY.reserve(leafCapacity * LeafSize);
+    m_centerZ.reserve(leafCapacity * LeafSize);
+    m_radius.reserve(leafCapacity * LeafSize);
+
+    std::vector<BuildEntry> entries(count);
+    for (uint32_t cube = 0; cube < count; ++cube) {
+        entries[cube] = {spheres[cube].Center, cube};
+    }
+    m_nodes.emplace_back();
+    m_parents.push_back(0);
+    BuildNode(spheres, entries.data(), count, 0, 1);
+}
+
+void SceneBvh::BuildNode(const std::vector<Sphere>& spheres, BuildEntry* entries, uint32_t count, uint32_t node,
+                         size_t depth) {
+    CHECK(depth <= MaxDepth);
+
+    if (count <= LeafSize) {
+        const size_t first = m_slotCubes.size();
+        m_slotLeaves.push_back(node);
+        for (size_t i = 0; i < LeafSize; ++i) {
+            m_slotCubes.push_back(i < count ? entries[i].Cube : UINT32_MAX);
+            m_centerX.push_back(0);
+            m_centerY.push_back(0);
+            m_centerZ.push_back(0);
+            m_radius.push_back(0);
+            if (i < count) {
+                m_cubeSlots[entries[i].Cube] = (uint32_t)(first + i);
+                WriteSlot(first + i, spheres[entries[i].Cube]);
+            }
+        }
+        m_nodes[node].First = (uint32_t)first;
+        m_nodes[node].Count = count;
+        FitLeaf(m_nodes[node]);
+        return;
+    }
+
+    // Split at the median center along the axis the centers spread furthest on.
+    XrVector3f centerMin = entries[0].Center;
+    XrVector3f centerMax = centerMin;
+    for (uint32_t i = 1; i < count; ++i) {
+        XrVector3f_Min(&centerMin, &centerMin, &entries[i].Center);
+        XrVector3f_Max(&centerMax, &centerMax, &entries[i].Center);
+    }
+    const XrVector3f spread{centerMax.x - centerMin.x, centerMax.y - centerMin.y, centerMax.z - centerMin.z};
+    const int axis = spread.x >= spread.y && spread.x >= spread.z ? 0 : (spread.y >= spread.z ? 1 : 2);
+    const uint32_t half = count / 2;
+    std::nth_element(entries, entries + half, entries + count, [axis](const BuildEntry& a, const BuildEntry& b) {
+        return Component(a.Center, axis) < Component(b.Center, axis);
+    });
+
+    const uint32_t left = (uint32_t)m_nodes.size();
+    m_nodes[node].First = left;
+    m_nodes[node].Count = 0;
+    m_nodes.emplace_back();
+    m_nodes.emplace_back();
+    m_parents.push_back(node);
+    m_parents.push_back(node);
+    BuildNode(spheres, entries, half, left, depth + 1);
+    BuildNode(spheres, entries + half, count - half, left + 1, depth + 1);
+    FitInner(m_nodes[node]);
+}
+
+void SceneBvh::Refit(const std::vector<Sphere>& spheres, size_t begin, size_t end) {
+    CHECK(spheres.size() == Size() && begin <= end && end <= Size());
+    for (size_t cube = begin; cube < end; ++cube) {
+        WriteSlot(m_cubeSlots[cube], spheres[cube]);
+    }
+
+    if ((end - begin) * FullRefitDivisor > Size()) {
+        // Children come after their parent, so walking backwards fits every child before its parent.
+        for (size_t node = m_nodes.size(); node-- > 0;) {
+            if (m_nodes[node].Count > 0) {
+                FitLeaf(m_nodes[node]);
+            } else {
+                FitInner(m_nodes[node]);
+            }
+        }
+        return;
+    }
+
+    for (size_t cube = begin; cube < end; ++cube) {
+        uint32_t node = m_slotLeaves[m_cubeSlots[cube] / LeafSize];
+        FitLeaf(m_nodes[node]);
+        while (node != 0) {
+            node = m_parents[node];
+            FitInner(m_nodes[node]);
+        }
+    }
+}
+
+size_t SceneBvh::Raycast(const XrVector3f& origin, const XrVector3f& direction, float maxDistance, float* distance) const {
+    size_t nearestCube = NoCube;
+    float nearest = maxDistance;
+    if (m_nodes.empty()) {
+        return nearestCube;
+    }
+
+    // Slab test against the boxes, giving the distance the ray enters a box at. Along axes the ray is parallel to, the
+    // inverse direction is clamped to a large finite value: an infinite one would give NaN for a ray starting on a box face,
+    // which std::min and std::max order arbitrarily.
+    const auto inverseOf = [](float d) { return std::abs(d) > 1e-30f ? 1 / d : std::copysign(1e30f, d); };
+    const XrVector3f inverse{inverseOf(direction.x), inverseOf(direction.y), inverseOf(direction.z)};
+    const auto entry = [&](const Node& node) {
+        const float tx0 = (node.Min.x - origin.x) * inverse.x;
+        const float tx1 = (node.Max.x - origin.x) * inverse.x;
+        const float ty0 = (node.Min.y - origin.y) * inverse.y;
+        const float ty1 = (node.Max.y - origin.y) * inverse.y;
+        const float tz0 = (node.Min.z - origin.z) * inverse.z;
+        const float tz1 = (node.Max.z - origin.z) * inverse.z;
+        const float tEnter = std::max(std::max(std::min(tx0, tx1), std::min(ty0, ty1)), std::max(std::min(tz0, tz1), 0.0f));
+        const float tExit = std::min(std::min(std::max(tx0, tx1), std::max(ty0, ty1)), std::max(tz0, tz1));
+        return tEnter <= tExit ? tEnter : std::numeric_limits<float>::infinity();
+    };
+
+    std::array<uint32_t, MaxDepth + 1> stack;
+    size_t stackSize = 0;
+    if (entry(m_nodes[0]) <= nearest) {
+        stack[stackSize++] = 0;
+    }
+    while (stackSize > 0) {
+        const Node& node = m_nodes[stack[--stackSize]];
+        if (node.Count == 0) {
+            // Visit the nearer child first, so the farther one is likely skipped once a hit is found.
+            const float leftEntry = entry(m_nodes[node.First]);
+            const float rightEntry = entry(m_nodes[node.First + 1]);
+            const bool leftFirst = leftEntry <= rightEntry;
+            const float firstEntry = leftFirst ? leftEntry : rightEntry;
+            const float secondEntry = leftFirst ? rightEntry : leftEntry;
+            if (secondEntry <= nearest) {
+                stack[stackSize++] = leftFirst ? node.First + 1 : node.First;
+            }
+            if (firstEntry <= nearest) {
+                stack[stackSize++] = leftFirst ? node.First : node.First + 1;
+            }
+            continue;
+        }
+
+        for (size_t slot = node.First; slot < node.First + node.Count; ++slot) {
+            const XrVector3f toCenter{m_centerX[slot] - origin.x, m_centerY[slot] - origin.y, m_centerZ[slot] - origin.z};
+            const float radiusSquared = m_radius[slot] * m_radius[slot];
+            const float centerSquared = XrVector3f_Dot(&toCenter, &toCenter);
+            const float along = XrVector3f_Dot(&toCenter, &direction);
+            if (centerSquared <= radiusSquared || along < 0) {
+                continue;  // Holds the origin, or behind it
+            }
+            const float missSquared = centerSquared - along * along;
+            if (missSquared > radiusSquared) {
+                continue;
+            }
+            const float hit = along - std::sqrt(radiusSquared - missSquared);
+            if (hit < nearest) {
+                nearest = hit;
+                nearestCube = m_slotCubes[slot];
+            }
+        }
+    }
+
+    if (distance != nullptr && nearestCube != NoCube) {
+        *distance = nearest;
+    }
+    return nearestCube;
+}
+
+void SceneBvh::FitLeaf(Node& node) {
+    for (size_t slot = node.First; slot < node.First + node.Count; ++slot) {
+        const float radius = m_radius[slot];
+        const XrVector3f min{m_centerX[slot] - radius, m_centerY[slot] - radius, m_centerZ[slot] - radius};
+        const XrVector3f max{m_centerX[slot] + radius, m_centerY[slot] + radius, m_centerZ[slot] + radius};
+        if (slot == node.First) {
+            node.Min = min;
+            node.Max = max;
+        } else {
+            XrVector3f_Min(&node.Min, &node.Min, &min);
+            XrVector3f_Max(&node.Max, &node.Max, &max);
+        }
+    }
+}
+
+void SceneBvh::FitInner(Node& node) {
+    const Node& left = m_nodes[node.First];
+    const Node& right = m_nodes[node.First + 1];
+    XrVector3f_Min(&node.Min, &left.Min, &right.Min);
+    XrVector3f_Max(&node.Max, &left.Max, &right.Max);
+}
+
+void SceneBvh::WriteSlot(size_t slot, const Sphere& sphere) {
+    m_centerX[slot] = sphere.Center.x;
+    m_centerY[slot] = sphere.Center.y;
+    m_centerZ[slot] = sphere.Center.z;
+    m_radius[slot] = sphere.Radius;
+}
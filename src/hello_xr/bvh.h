@@ -0,0 +1,121 @@
+// Copyright (c) 2017-2020 The Khronos Group Inc
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include <array>
+
+// Bounding volume hierarchy over the bounding spheres of a scene's cubes, with axis-aligned boxes as nodes and up to
+// LeafSize cubes per leaf. The spheres are kept in leaf order as structure-of-arrays, every leaf padded to LeafSize slots,
+// so the cubes of a leaf can be tested together with SSE or NEON. Moving cubes only refits the boxes above them; adding or
+// removing cubes needs a rebuild.
+class SceneBvh {
+   public:
+    static constexpr size_t LeafSize = 4;
+    static constexpr size_t NoCube = SIZE_MAX;
+
+    struct Sphere {
+        XrVector3f Center;
+        float Radius;
+    };
+
+    // How a box relates to the volume of a query.
+    enum class Overlap { Outside, Intersecting, Inside };
+
+    // Number of cubes in the tree.
+    size_t Size() const { return m_cubeSlots.size(); }
+
+    // Build the tree over spheres, one per cube, splitting at the median of the longest axis.
+    void Build(const std::vector<Sphere>& spheres);
+
+    // Take the new spheres of cubes [begin, end) and fit the boxes above them again. The topology stays, so the tree gets
+    // looser the further the cubes move from where it was built.
+    void Refit(const std::vector<Sphere>& spheres, size_t begin, size_t end);
+
+    // Call visit(firstSlot, slotCount, inside) for every leaf whose box, and the boxes above it, classify(min, max) does
+    // not put Outside. inside is set once a box is put Inside, then none below it are classified as all their cubes are
+    // in the volume. Leaves are visited in tree order, not in cube order.
+    template <typename Classify, typename Visit>
+    void Query(Classify&& classify, Visit&& visit) const;
+
+    // Nearest cube whose bounding sphere the ray enters within maxDistance, or NoCube. Spheres that hold the origin are
+    // skipped, so a ray cast from a hand does not hit the hand's own cube. direction must be normalized.
+    size_t Raycast(const XrVector3f& origin, const XrVector3f& direction, float maxDistance, float* distance = nullptr) const;
+
+    // The spheres in slot order. Padding slots hold a sphere of radius 0 at the origin.
+    const std::vector<float>& CenterX() const { return m_centerX; }
+    const std::vector<float>& CenterY() const { return m_centerY; }
+    const std::vector<float>& CenterZ() const { return m_centerZ; }
+    const std::vector<float>& Radius() const { return m_radius; }
+
+    // The cube in a slot.
+    size_t SlotCube(size_t slot) const { return m_slotCubes[slot]; }
+
+   private:
+    // A cube while the tree is built, with its center at hand so splits sort without looking up its sphere.
+    struct BuildEntry {
+        XrVector3f Center;
+        uint32_t Cube;
+    };
+
+    struct Node {
+        XrVector3f Min;
+        uint32_t First;  // Leaves: first slot. Inner nodes: the left child, the right one follows it.
+        XrVector3f Max;
+        uint32_t Count;  // Leaves: number of cubes. 0 for inner nodes.
+    };
+
+    // Deepest tree Query and Raycast can walk, far more than a median split of any scene needs.
+    static constexpr size_t MaxDepth = 64;
+
+    // Fill node with the cubes of entries, splitting them between two new children while there are more than LeafSize.
+    void BuildNode(const std::vector<Sphere>& spheres, BuildEntry* entries, uint32_t count, uint32_t node, size_t depth);
+    void FitLeaf(Node& node);
+    void FitInner(Node& node);
+    void WriteSlot(size_t slot, const Sphere& sphere);
+
+    std::vector<Node> m_nodes;        // Root first, every node before its children
+    std::vector<uint32_t> m_parents;  // Of every node, the root's is its own index
+
+    std::vector<float> m_centerX;
+    std::vector<float> m_centerY;
+    std::vector<float> m_centerZ;
+    std::vector<float> m_radius;
+    std::vector<uint32_t> m_slotCubes;
+    std::vector<uint32_t> m_cubeSlots;
+    std::vector<uint32_t> m_slotLeaves;  // Leaf node of every LeafSize slots
+};
+
+template <typename Classify, typename Visit>
+void SceneBvh::Query(Classify&& classify, Visit&& visit) const {
+    if (m_nodes.empty()) {
+        return;
+    }
+
+    // Nodes still to visit, and whether an ancestor was already put Inside.
+    std::array<std::pair<uint32_t, bool>, MaxDepth + 1> stack;
+    size_t stackSize = 0;
+    stack[stackSize++] = {0, false};
+    while (stackSize > 0) {
+        const uint32_t index = stack[stackSize - 1].first;
+        bool inside = stack[stackSize - 1].second;
+        --stackSize;
+
+        const Node& node = m_nodes[index];
+        if (!inside) {
+            const Overlap overlap = classify(node.Min, node.Max);
+            if (overlap == Overlap::Outside) {
+                continue;
+            }
+            inside = overlap == Overlap::Inside;
+        }
+
+        if (node.Count > 0) {
+            visit((size_t)node.First, (size_t)node.Count, inside);
+        } else {
+            stack[stackSize++] = {node.First + 1, inside};
+            stack[stackSize++] = {node.First, inside};
+        }
+    }
+}
@@ -0,0 +1,154 @@
+// Copyright (c) 2017-2020 The Khronos Group Inc.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include "pch.h"
+#include "common.h"
+#include "cachefile.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <cerrno>
+
+#if defined(_WIN32)
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+namespace {
+constexpr const char* CacheSubdirectory = "hello_xr";
+
+FILE* OpenFile(const std::string& path, const char* mode) {
+#if defined(_MSC_VER)
+    FILE* file = nullptr;
+    return fopen_s(&file, path.c_str(), mode) == 0 ? file : nullptr;
+#else
+    return fopen(path.c_str(), mode);
+#endif
+}
+
+bool MakeDirectory(const std::string& path) {
+#if defined(_WIN32)
+    return _mkdir(path.c_str()) == 0 || errno == EEXIST;
+#else
+    return mkdir(path.c_str(), 0755) == 0 || errno == EEXIST;
+#endif
+}
+
+// Create path and any of its parents that are missing. Only the result for path itself counts: a parent that cannot be
+// created, such as a drive or share name on Windows, either exists already or makes path fail too.
+bool MakeDirectories(const std::string& path) {
+#if defined(_WIN32)
+    const char* const separators = "\\/";
+#else
+    const char* const separators = "/";
+#endif
+    for (size_t end = path.find_first_of(separators, 1); end != std::string::npos;
+         end = path.find_first_of(separators, end + 1)) {
+        (void)MakeDirectory(path.substr(0, end));
+    }
+    return MakeDirectory(path);
+}
+
+std::string CachePath(const std::string& cacheDirectory, const char* name) { return cacheDirectory + "/" + name; }
+}  // namespace
+
+std::string DefaultCacheDirectory() {
+#if defined(XR_USE_PLATFORM_ANDROID)
+    return {};  // Set from the activity's internal data path instead.
+#elif defined(_WIN32)
+    const char* localAppData = getenv("LOCALAPPDATA");
+    return localAppData != nullptr ? Fmt("%s\\%s", localAppData, CacheSubdirectory) : std::string();
+#else
+    const char* xdgCacheHome = getenv("XDG_CACHE_HOME");
+    if (xdgCacheHome != nullptr && xdgCacheHome[0] != '\0') {
+        return Fmt("%s/%s", xdgCacheHome, CacheSubdirectory);
+    }
+    const char* home = getenv("HOME");
+    return home != nullptr ? Fmt("%s/.cache/%s", home, CacheSubdirectory) : std::string();
+#endif
+}
+
+bool ReadCacheFile(const std::string& cacheDirectory, const char* name, std::vector<uint8_t>& data) {
+    data.clear();
+    if (cacheDirectory.empty()) {
+        return false;
+    }
+
+    const std::string path = CachePath(cacheDirectory, name);
+    FILE* file = OpenFile(path, "rb");
+    if (file == nullptr) {
+        LOG_VERBOSE(Fmt("No cache file '%s'", path.c_str()));
+        return false;
+    }
+
+    bool ok = fseek(file, 0, SEEK_END) == 0;
+    const long size = ok ? ftell(file) : -1;
+    ok = size >= 0 && fseek(file, 0, SEEK_SET) == 0;
+    if (ok) {
+        data.resize((size_t)size);
+        ok = fread(data.data(), 1, data.size(), file) == data.size();
+    }
+    fclose(file);
+
+    if (!ok) {
+        Log::Write(Log::Level::Warning, Fmt("Unable to read cache file '%s'", path.c_str()));
+        data.clear();
+    }
+    return ok;
+}
+
+void WriteCacheFile(const std::string& cacheDirectory, const char* name, const std::vector<uint8_t>& data) {
+    if (cacheDirectory.empty()) {
+        return;
+    }
+    if (!MakeDirectories(cacheDirectory)) {
+        // Every cache file would fail the same way, so only the first one says so.
+        static std::atomic<bool> reported{false};
+        if (!reported.exchange(true)) {
+            Log::Write(Log::Level::Warning, Fmt("Unable to create cache directory '%s'", cacheDirectory.c_str()));
+        }
+        return;
+    }
+
+    // Write a temporary file and move it over the old one, so a crash never leaves a truncated cache behind.
+    const std::string path = CachePath(cacheDirectory, name);
+    const std::string temporaryPath = path + ".tmp";
+    FILE* file = OpenFile(temporaryPath, "wb");
+    if (file == nullptr) {
+        Log::Write(Log::Level::Warning, Fmt("Unable to write cache file '%s'", temporaryPath.c_str()));
+        return;
+    }
+    const bool written = fwrite(data.data(), 1, data.size(), file) == data.size();
+    const bool closed = fclose(file) == 0;
+
+#if defined(_WIN32)
+    // rename does not replace an existing file on Windows.
+    (void)remove(path.c_str());
+#endif
+    if (!written || !closed || rename(temporaryPath.c_str(), path.c_str()) != 0) {
+        Log::Write(Log::Level::Warning, Fmt("Unable to write cache file '%s'", path.c_str()));
+        (void)remove(temporaryPath.c_str());
+        return;
+    }
+    LOG_VERBOSE(Fmt("Wrote %zu bytes to cache file '%s'", data.size(), path.c_str()));
+}
+
+CacheKey& CacheKey::Add(const void* data, size_t size) {
+    // 64-bit FNV-1a
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < size; ++i) {
+        m_hash = (m_hash ^ bytes[i]) * 1099511628211ull;
+    }
+    return *this;
+}
+
+CacheKey& CacheKey::Add(const char* text) {
+    // Include the terminator so consecutive strings cannot run into each other
+    return Add(text != nullptr ? text : "", text != nullptr ? strlen(text) + 1 : 1);
+}
+
+std::string CacheKey::FileName(const char* prefix) const {
+    return Fmt("%s_%016llx.bin", prefix, (unsigned long long)m_hash);
+}
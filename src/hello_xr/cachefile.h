@@ -0,0 +1,32 @@
+// Copyright (c) 2017-2020 The Khronos Group Inc
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+// Files kept between runs to speed up startup, such as the Vulkan pipeline cache. They are only hints: a missing, unreadable
+// or stale file means the work is redone, so every failure here is logged and otherwise ignored.
+
+// Per-user cache directory for this platform, or empty if there is none.
+std::string DefaultCacheDirectory();
+
+// Read the whole of a file in the cache directory. Returns false if the directory is empty or the file cannot be read.
+bool ReadCacheFile(const std::string& cacheDirectory, const char* name, std::vector<uint8_t>& data);
+
+// Replace a file in the cache directory, creating it and its parents if needed. Does nothing if the directory is empty.
+void WriteCacheFile(const std::string& cacheDirectory, const char* name, const std::vector<uint8_t>& data);
+
+// Names a cache file after a hash of everything that went into producing it, such as shader source, compiler options and
+// driver version. Changing any input then simply misses in the cache instead of loading a stale file.
+class CacheKey {
+   public:
+    CacheKey& Add(const void* data, size_t size);
+    CacheKey& Add(const char* text);
+    CacheKey& Add(uint64_t value) { return Add(&value, sizeof(value)); }
+
+    // "<prefix>_<hash>.bin"
+    std::string FileName(const char* prefix) const;
+
+   private:
+    uint64_t m_hash{14695981039346656037ull};  // FNV-1a offset basis
+};
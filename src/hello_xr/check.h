@@ -5,6 +5,7 @@
 #pragma once
 
 #include "common.h"
+#include "trace.h"
 
 #define CHK_STRINGIFY(x) #x
 #define TOSTRING(x) CHK_STRINGIFY(x)
@@ -48,7 +49,8 @@ inline XrResult CheckXrResult(XrResult res, const char* originator = nullptr, co
 }
 
 #define THROW_XR(xr, cmd) ThrowXrResult(xr, #cmd, FILE_AND_LINE);
-#define CHECK_XRCMD(cmd) CheckXrResult(cmd, #cmd, FILE_AND_LINE);
+// Builds with HELLO_XR_TRACING trace the calls made through the *CMD macros.
+#define CHECK_XRCMD(cmd) CheckXrResult(TRACE_CALL(cmd, #cmd), #cmd, FILE_AND_LINE);
 #define CHECK_XRRESULT(res, cmdStr) CheckXrResult(res, cmdStr, FILE_AND_LINE);
 
 #ifdef XR_USE_PLATFORM_WIN32
@@ -66,7 +68,7 @@ inline HRESULT CheckHResult(HRESULT hr, const char* originator = nullptr, const
 }
 
 #define THROW_HR(hr, cmd) ThrowHResult(hr, #cmd, FILE_AND_LINE);
-#define CHECK_HRCMD(cmd) CheckHResult(cmd, #cmd, FILE_AND_LINE);
+#define CHECK_HRCMD(cmd) CheckHResult(TRACE_CALL(cmd, #cmd), #cmd, FILE_AND_LINE);
 #define CHECK_HRESULT(res, cmdStr) CheckHResult(res, cmdStr, FILE_AND_LINE);
 
 #endif
@@ -0,0 +1,223 @@
+// Copyright (c) 2017-2020 The Khronos Group Inc.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include "pch.h"
+#include "common.h"
+#include <common/xr_linear.h>
+#include "scene.h"
+#include "culling.h"
+
+namespace {
+constexpr size_t BatchSize = SceneBvh::LeafSize;
+
+// Level of detail of a cube no frustum holds.
+constexpr uint8_t NotVisible = 0xff;
+}  // namespace
+
+void FrustumCuller::SetViews(const std::vector<XrView>& views, float nearZ, float farZ) {
+    m_frustumCount = 0;
+    if (views.size() > MaxViews) {
+        return;
+    }
+
+    for (const XrView& view : views) {
+        // Planes in view space, where the view looks down -Z.
+        const XrFovf& fov = view.fov;
+        const Frustum local = {{
+            {std::cos(fov.angleLeft), 0, std::sin(fov.angleLeft), 0},
+            {-std::cos(fov.angleRight), 0, -std::sin(fov.angleRight), 0},
+            {0, std::cos(fov.angleDown), std::sin(fov.angleDown), 0},
+            {0, -std::cos(fov.angleUp), -std::sin(fov.angleUp), 0},
+            {0, 0, -1, -nearZ},
+            {0, 0, 1, farZ},
+        }};
+
+        // Rotate the normals into the app space and move the planes to the view position.
+        XrMatrix4x4f rotation;
+        XrMatrix4x4f_CreateFromQuaternion(&rotation, &view.pose.orientation);
+        const XrVector3f& position = view.pose.position;
+        m_viewPositions[m_frustumCount] = position;
+        m_projectionScales[m_frustumCount] = 2.0f / (std::tan(fov.angleUp) - std::tan(fov.angleDown));
+        Frustum& frustum = m_frusta[m_frustumCount++];
+        for (size_t i = 0; i < frustum.size(); ++i) {
+            const Plane& plane = local[i];
+            Plane& result = frustum[i];
+            result.nx = rotation.m[0] * plane.nx + rotation.m[4] * plane.ny + rotation.m[8] * plane.nz;
+            result.ny = rotation.m[1] * plane.nx + rotation.m[5] * plane.ny + rotation.m[9] * plane.nz;
+            result.nz = rotation.m[2] * plane.nx + rotation.m[6] * plane.ny + rotation.m[10] * plane.nz;
+            result.d = plane.d - (result.nx * position.x + result.ny * position.y + result.nz * position.z);
+        }
+    }
+}
+
+void FrustumCuller::SetMesh(uint32_t mesh, const MeshData& data) {
+    if (mesh >= m_meshes.size()) {
+        m_meshes.resize(mesh + 1);
+    }
+    MeshInfo& info = m_meshes[mesh];
+    info.LodCount = std::max(data.LodCount, 1u);
+    for (uint32_t lod = 0; lod < data.LodCount; ++lod) {
+        info.MinScreenSize[lod] = data.Lods[lod].MinScreenSize;
+    }
+}
+
+size_t FrustumCuller::Cull(const CubeScene& scene, std::vector<XrMatrix4x4f>& visibleModels,
+                           std::vector<MeshDraw>& visibleDraws, std::vector<uint32_t>* visibleCubes) {
+    const std::vector<XrMatrix4x4f>& models = scene.Models();
+    if (m_frustumCount == 0) {
+        visibleModels = models;
+        visibleDraws = scene.Draws();
+        if (visibleCubes != nullptr) {
+            visibleCubes->resize(models.size());
+            std::iota(visibleCubes->begin(), visibleCubes->end(), 0u);
+        }
+        return 0;
+    }
+
+    // The tree visits cubes out of scene order, so note the level of detail of each visible one first and emit them after.
+    const size_t count = scene.Size();
+    const SceneBvh& bvh = scene.Bvh();
+    const std::vector<uint32_t>& meshes = scene.Meshes();
+    CHECK(bvh.Size() == count);
+    m_cubeLods.assign(count, NotVisible);
+    bvh.Query([this](const XrVector3f& min, const XrVector3f& max) { return Classify(min, max); },
+              [&](size_t first, size_t slotCount, bool inside) {
+                  const uint32_t mask = inside ? (1u << slotCount) - 1 : VisibleMask(bvh, first);
+                  for (size_t i = 0; i < slotCount; ++i) {
+                      if ((mask & (1u << i)) != 0) {
+                          const size_t cube = bvh.SlotCube(first + i);
+                          const MeshInfo& mesh = m_meshes[meshes[cube]];
+                          m_cubeLods[cube] = (uint8_t)(mesh.LodCount > 1 ? SelectLod(mesh, bvh, first + i) : 0);
+                      }
+                  }
+              });
+
+    visibleModels.clear();
+    visibleDraws.clear();
+    if (visibleCubes != nullptr) {
+        visibleCubes->clear();
+    }
+    for (size_t cube = 0; cube < count; ++cube) {
+        if (m_cubeLods[cube] != NotVisible) {
+            visibleModels.push_back(models[cube]);
+            if (visibleCubes != nullptr) {
+                visibleCubes->push_back((uint32_t)cube);
+            }
+            AppendMeshDraw(visibleDraws, meshes[cube], m_cubeLods[cube]);
+        }
+    }
+    return count - visibleModels.size();
+}
+
+SceneBvh::Overlap FrustumCuller::Classify(const XrVector3f& min, const XrVector3f& max) const {
+    // A box is behind a plane if even its corner furthest along the normal is, and in front if even the corner furthest
+    // against the normal is.
+    bool intersecting = false;
+    for (size_t f = 0; f < m_frustumCount; ++f) {
+        bool inside = true;
+        bool outside = false;
+        for (const Plane& plane : m_frusta[f]) {
+            const float furthest = plane.nx * (plane.nx >= 0 ? max.x : min.x) + plane.ny * (plane.ny >= 0 ? max.y : min.y) +
+                                   plane.nz * (plane.nz >= 0 ? max.z : min.z) + plane.d;
+            if (furthest < 0) {
+                outside = true;
+                break;
+            }
+            const float nearest = plane.nx * (plane.nx >= 0 ? min.x : max.x) + plane.ny * (plane.ny >= 0 ? min.y : max.y) +
+                                  plane.nz * (plane.nz >= 0 ? min.z : max.z) + plane.d;
+            inside = inside && nearest >= 0;
+        }
+        if (!outside && inside) {
+            return SceneBvh::Overlap::Inside;
+        }
+        intersecting = intersecting || !outside;
+    }
+    return intersecting ? SceneBvh::Overlap::Intersecting : SceneBvh::Overlap::Outside;
+}
+
+uint32_t FrustumCuller::SelectLod(const MeshInfo& mesh, const SceneBvh& bvh, size_t slot) const {
+    // A sphere of radius r at distance d covers about r / (d tan(fov / 2)) of the view's height.
+    const float radius = bvh.Radius()[slot];
+    float screenSize = 0;
+    for (size_t view = 0; view < m_frustumCount; ++view) {
+        const XrVector3f& position = m_viewPositions[view];
+        const XrVector3f offset{bvh.CenterX()[slot] - position.x, bvh.CenterY()[slot] - position.y,
+                                bvh.CenterZ()[slot] - position.z};
+        const float distance = XrVector3f_Length(&offset);
+        if (distance <= radius) {
+            return 0;  // The view is inside the bounds
+        }
+        screenSize = std::max(screenSize, radius * m_projectionScales[view] / distance);
+    }
+
+    uint32_t lod = 0;
+    while (lod + 1 < mesh.LodCount && screenSize < mesh.MinScreenSize[lod]) {
+        ++lod;
+    }
+    return lod;
+}
+
+uint32_t FrustumCuller::VisibleMask(const SceneBvh& bvh, size_t first) const {
+    // Leaves are padded to BatchSize slots, so a whole batch can always be loaded.
+    const float* const xs = bvh.CenterX().data();
+    const float* const ys = bvh.CenterY().data();
+    const float* const zs = bvh.CenterZ().data();
+    const float* const radii = bvh.Radius().data();
+#if defined(XR_LINEAR_USE_SSE)
+    const __m128 centerX = _mm_loadu_ps(&xs[first]);
+    const __m128 centerY = _mm_loadu_ps(&ys[first]);
+    const __m128 centerZ = _mm_loadu_ps(&zs[first]);
+    const __m128 negativeRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(&radii[first]));
+
+    __m128 anyInside = _mm_setzero_ps();
+    for (size_t f = 0; f < m_frustumCount; ++f) {
+        __m128 inside = _mm_cmpeq_ps(centerX, centerX);  // All lanes set
+        for (const Plane& plane : m_frusta[f]) {
+            const __m128 distance = _mm_add_ps(
+                _mm_add_ps(_mm_mul_ps(centerX, _mm_set1_ps(plane.nx)), _mm_mul_ps(centerY, _mm_set1_ps(plane.ny))),
+                _mm_add_ps(_mm_mul_ps(centerZ, _mm_set1_ps(plane.nz)), _mm_set1_ps(plane.d)));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, negativeRadius));
+        }
+        anyInside = _mm_or_ps(anyInside, inside);
+    }
+    return (uint32_t)_mm_movemask_ps(anyInside);
+#elif defined(XR_LINEAR_USE_NEON)
+    const float32x4_t centerX = vld1q_f32(&xs[first]);
+    const float32x4_t centerY = vld1q_f32(&ys[first]);
+    const float32x4_t centerZ = vld1q_f32(&zs[first]);
+    const float32x4_t negativeRadius = vnegq_f32(vld1q_f32(&radii[first]));
+
+    uint32x4_t anyInside = vdupq_n_u32(0);
+    for (size_t f = 0; f < m_frustumCount; ++f) {
+        uint32x4_t inside = vdupq_n_u32(~0u);
+        for (const Plane& plane : m_frusta[f]) {
+            float32x4_t distance = vdupq_n_f32(plane.d);
+            distance = vmlaq_n_f32(distance, centerX, plane.nx);
+            distance = vmlaq_n_f32(distance, centerY, plane.ny);
+            distance = vmlaq_n_f32(distance, centerZ, plane.nz);
+            inside = vandq_u32(inside, vcgeq_f32(distance, negativeRadius));
+        }
+        anyInside = vorrq_u32(anyInside, inside);
+    }
+    static const uint32_t LaneBits[BatchSize] = {1, 2, 4, 8};
+    const uint32x4_t bits = vandq_u32(anyInside, vld1q_u32(LaneBits));
+    return vgetq_lane_u32(bits, 0) | vgetq_lane_u32(bits, 1) | vgetq_lane_u32(bits, 2) | vgetq_lane_u32(bits, 3);
+#else
+    uint32_t mask = 0;
+    for (size_t i = 0; i < BatchSize; ++i) {
+        const size_t slot = first + i;
+        for (size_t f = 0; f < m_frustumCount && (mask & (1u << i)) == 0; ++f) {
+            bool inside = true;
+            for (const Plane& plane : m_frusta[f]) {
+                const float distance = plane.nx * xs[slot] + plane.ny * ys[slot] + plane.nz * zs[slot] + plane.d;
+                inside = inside && distance >= -radii[slot];
+            }
+            if (inside) {
+                mask |= 1u << i;
+            }
+        }
+    }
+    return mask;
+#endif
+}
@@ -0,0 +1,62 @@
+// Copyright (c) 2017-2020 The Khronos Group Inc
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include <array>
+
+// Culls the scene's cubes against the frusta of every view of a frame, keeping the cubes at least one view can see. The
+// scene's BVH is walked from the root, skipping every box outside all frusta and taking every box inside one whole; the
+// bounding spheres of the leaves in between are tested four at a time with SSE or NEON where available. Each visible cube
+// then gets the level of detail of its mesh that matches the size it is projected to in the nearest view.
+class FrustumCuller {
+   public:
+    // Frames with more views than this are not culled.
+    static constexpr size_t MaxViews = 4;
+
+    // Frusta of the located views, using the same near and far planes as the graphics plugins.
+    void SetViews(const std::vector<XrView>& views, float nearZ, float farZ);
+
+    // Take the level of detail thresholds of a mesh added to the graphics plugin. The cube has a single level.
+    void SetMesh(uint32_t mesh, const MeshData& data);
+
+    // Replace visibleModels with the model matrices of the cubes inside at least one view frustum, in scene order, and
+    // visibleDraws with the meshes and levels of detail to draw them with. The scene's models and BVH must be up to date.
+    // If visibleCubes is given, it is replaced with the scene index of each of visibleModels. Returns the number of cubes culled.
+    size_t Cull(const CubeScene& scene, std::vector<XrMatrix4x4f>& visibleModels, std::vector<MeshDraw>& visibleDraws,
+                std::vector<uint32_t>* visibleCubes = nullptr);
+
+   private:
+    // A plane n.x + d = 0 with n pointing into the frustum.
+    struct Plane {
+        float nx, ny, nz, d;
+    };
+    using Frustum = std::array<Plane, 6>;
+
+    // What level of detail selection needs to know about a mesh.
+    struct MeshInfo {
+        std::array<float, MaxMeshLods> MinScreenSize{};  // Of each level of detail
+        uint32_t LodCount{1};
+    };
+
+    // Whether a BVH box is outside every frustum, inside at least one, or neither.
+    SceneBvh::Overlap Classify(const XrVector3f& min, const XrVector3f& max) const;
+
+    // Bit i is set if the sphere in BVH slot first + i is inside at least one frustum.
+    uint32_t VisibleMask(const SceneBvh& bvh, size_t first) const;
+
+    // Level of detail of mesh for the cube in a BVH slot, from the largest fraction of a view's height it covers.
+    uint32_t SelectLod(const MeshInfo& mesh, const SceneBvh& bvh, size_t slot) const;
+
+    std::array<Frustum, MaxViews> m_frusta{};
+    size_t m_frustumCount{0};
+
+    // Position and 1 / tan(half the vertical field of view) of every view, for the projected size of a sphere.
+    std::array<XrVector3f, MaxViews> m_viewPositions{};
+    std::array<float, MaxViews> m_projectionScales{};
+
+    std::vector<MeshInfo> m_meshes{MeshInfo{}};  // Indexed by mesh ID
+
+    std::vector<uint8_t> m_cubeLods;  // Level of detail of every cube in scene order, 0xff if it is culled
+};
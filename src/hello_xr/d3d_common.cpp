@@ -4,6 +4,7 @@
 
 #include "pch.h"
 #include "common.h"
+#include "graphicsplugin.h"
 
 #if (defined(XR_USE_GRAPHICS_API_D3D11) || defined(XR_USE_GRAPHICS_API_D3D12)) && !defined(MISSING_DIRECTX_COLORS)
 
@@ -12,6 +13,7 @@
 #include <D3Dcompiler.h>
 
 #include "d3d_common.h"
+#include "cachefile.h"
 
 using namespace Microsoft::WRL;
 using namespace DirectX;
@@ -27,7 +29,17 @@ XMMATRIX XM_CALLCONV LoadXrMatrix(const XrMatrix4x4f& matrix) {
     return XMLoadFloat4x4(reinterpret_cast<const XMFLOAT4X4*>(&matrix));
 }
 
-ComPtr<ID3DBlob> CompileShader(const char* hlsl, const char* entrypoint, const char* shaderTarget) {
+XMMATRIX XM_CALLCONV ComputeModel(const XrMatrix4x4f& model) { return XMMatrixTranspose(LoadXrMatrix(model)); }
+
+XMMATRIX XM_CALLCONV ComputeViewProjection(const XrCompositionLayerProjectionView& layerView) {
+    const XMMATRIX spaceToView = XMMatrixInverse(nullptr, LoadXrPose(layerView.pose));
+    XrMatrix4x4f projectionMatrix;
+    XrMatrix4x4f_CreateProjectionFov(&projectionMatrix, GRAPHICS_D3D, layerView.fov, 0.05f, 100.0f);
+    return XMMatrixTranspose(spaceToView * LoadXrMatrix(projectionMatrix));
+}
+
+ComPtr<ID3DBlob> CompileShader(const char* hlsl, const char* entrypoint, const char* shaderTarget,
+                               const std::string& cacheDirectory) {
     ComPtr<ID3DBlob> compiled;
     ComPtr<ID3DBlob> errMsgs;
     DWORD flags = D3DCOMPILE_PACK_MATRIX_COLUMN_MAJOR | D3DCOMPILE_ENABLE_STRICTNESS | D3DCOMPILE_WARNINGS_ARE_ERRORS;
@@ -38,6 +50,20 @@ ComPtr<ID3DBlob> CompileShader(const char* hlsl, const char* entrypoint, const c
     flags |= D3DCOMPILE_OPTIMIZATION_LEVEL3;
 #endif
 
+    CacheKey key;
+    key.Add(hlsl).Add(entrypoint).Add(shaderTarget).Add((uint64_t)flags).Add((uint64_t)D3D_COMPILER_VERSION);
+    const std::string cacheFileName = key.FileName("dxbc");
+
+    // Every DXBC container starts with its four character code
+    std::vector<uint8_t> cached;
+    if (ReadCacheFile(cacheDirectory, cacheFileName.c_str(), cached) && cached.size() > 4 &&
+        memcmp(cached.data(), "DXBC", 4) == 0) {
+        CHECK_HRCMD(D3DCreateBlob(cached.size(), compiled.ReleaseAndGetAddressOf()));
+        memcpy(compiled->GetBufferPointer(), cached.data(), cached.size());
+        LOG_VERBOSE(Fmt("Loaded %s %s from the shader cache", shaderTarget, entrypoint));
+        return compiled;
+    }
+
     HRESULT hr = D3DCompile(hlsl, strlen(hlsl), nullptr, nullptr, nullptr, entrypoint, shaderTarget, flags, 0,
                             compiled.GetAddressOf(), errMsgs.GetAddressOf());
     if (FAILED(hr)) {
@@ -46,6 +72,9 @@ ComPtr<ID3DBlob> CompileShader(const char* hlsl, const char* entrypoint, const c
         THROW_HR(hr, "D3DCompile");
     }
 
+    const uint8_t* compiledBytes = static_cast<const uint8_t*>(compiled->GetBufferPointer());
+    WriteCacheFile(cacheDirectory, cacheFileName.c_str(),
+                   std::vector<uint8_t>(compiledBytes, compiledBytes + compiled->GetBufferSize()));
     return compiled;
 }
 
@@ -62,7 +91,7 @@ ComPtr<IDXGIAdapter1> GetAdapter(LUID adapterId) {
         DXGI_ADAPTER_DESC1 adapterDesc;
         CHECK_HRCMD(dxgiAdapter->GetDesc1(&adapterDesc));
         if (memcmp(&adapterDesc.AdapterLuid, &adapterId, sizeof(adapterId)) == 0) {
-            Log::Write(Log::Level::Verbose, Fmt("Using graphics adapter %ws", adapterDesc.Description));
+            LOG_VERBOSE(Fmt("Using graphics adapter %ws", adapterDesc.Description));
             return dxgiAdapter;
         }
     }
@@ -8,12 +8,16 @@
 
 #include <DirectXMath.h>
 
-struct ModelConstantBuffer {
+// Per-instance vertex data, stored transposed like the constant buffer matrices.
+struct InstanceData {
     DirectX::XMFLOAT4X4 Model;
 };
 struct ViewProjectionConstantBuffer {
     DirectX::XMFLOAT4X4 ViewProjection;
 };
+struct MultiviewViewProjectionConstantBuffer {
+    DirectX::XMFLOAT4X4 ViewProjection[2];
+};
 
 // Separate entrypoints for the vertex and pixel shader functions.
 constexpr char ShaderHlsl[] = R"_(
@@ -24,9 +28,7 @@ constexpr char ShaderHlsl[] = R"_(
     struct Vertex {
         float3 Pos : POSITION;
         float3 Color : COLOR0;
-    };
-    cbuffer ModelConstantBuffer : register(b0) {
-        float4x4 Model;
+        float4x4 Model : MODEL;
     };
     cbuffer ViewProjectionConstantBuffer : register(b1) {
         float4x4 ViewProjection;
@@ -34,7 +36,7 @@ constexpr char ShaderHlsl[] = R"_(
 
     PSVertex MainVS(Vertex input) {
        PSVertex output;
-       output.Pos = mul(mul(float4(input.Pos, 1), Model), ViewProjection);
+       output.Pos = mul(mul(float4(input.Pos, 1), input.Model), ViewProjection);
        output.Color = input.Color;
        return output;
     }
@@ -44,10 +46,51 @@ constexpr char ShaderHlsl[] = R"_(
     }
     )_";
 
+// Single-pass stereo: each cube is drawn with two instances, one per view, and the instance ID selects the render target
+// array slice. The per-instance data must step once per view. Requires VPAndRTArrayIndexFromAnyShaderFeedingRasterizer.
+constexpr char MultiviewShaderHlsl[] = R"_(
+    struct PSVertex {
+        float4 Pos : SV_POSITION;
+        float3 Color : COLOR0;
+        uint ViewId : SV_RenderTargetArrayIndex;
+    };
+    struct Vertex {
+        float3 Pos : POSITION;
+        float3 Color : COLOR0;
+        float4x4 Model : MODEL;
+        uint InstanceId : SV_InstanceID;
+    };
+    cbuffer ViewProjectionConstantBuffer : register(b1) {
+        float4x4 ViewProjection[2];
+    };
+
+    PSVertex MainVS(Vertex input) {
+       PSVertex output;
+       const uint viewId = input.InstanceId % 2;
+       output.Pos = mul(mul(float4(input.Pos, 1), input.Model), ViewProjection[viewId]);
+       output.Color = input.Color;
+       output.ViewId = viewId;
+       return output;
+    }
+
+    float4 MainPS(PSVertex input) : SV_TARGET {
+        return float4(input.Color, 1);
+    }
+    )_";
+
+// Vertex buffer slot of the per-instance InstanceData stream; the cube geometry is in slot 0.
+constexpr UINT InstanceDataSlot = 1;
+
 DirectX::XMMATRIX XM_CALLCONV LoadXrPose(const XrPosef& pose);
 DirectX::XMMATRIX XM_CALLCONV LoadXrMatrix(const XrMatrix4x4f& matrix);
+// Transposed model matrix of a cube, ready to be stored in InstanceData.
+DirectX::XMMATRIX XM_CALLCONV ComputeModel(const XrMatrix4x4f& model);
+// Transposed view-projection matrix for a projection view, ready to be stored in a constant buffer.
+DirectX::XMMATRIX XM_CALLCONV ComputeViewProjection(const XrCompositionLayerProjectionView& layerView);
 
-Microsoft::WRL::ComPtr<ID3DBlob> CompileShader(const char* hlsl, const char* entrypoint, const char* shaderTarget);
+// Compile HLSL, or load the bytecode a previous run saved in cacheDirectory for the same source, target and flags.
+Microsoft::WRL::ComPtr<ID3DBlob> CompileShader(const char* hlsl, const char* entrypoint, const char* shaderTarget,
+                                               const std::string& cacheDirectory);
 Microsoft::WRL::ComPtr<IDXGIAdapter1> GetAdapter(LUID adapterId);
 
 #endif
@@ -0,0 +1,85 @@
+// Copyright (c) 2017-2020 The Khronos Group Inc.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include "pch.h"
+#include "common.h"
+#include "foveation.h"
+
+namespace {
+// Distances from the view center, in half view extents, beyond which fragments grow to 2x2 and to 4x4 pixels.
+struct FoveationRings {
+    float Coarse2x2;
+    float Coarse4x4;
+};
+
+FoveationRings GetFoveationRings(FoveationLevel level) {
+    switch (level) {
+        case FoveationLevel::Low:
+            return {0.7f, 1.1f};
+        case FoveationLevel::Medium:
+            return {0.5f, 0.85f};
+        case FoveationLevel::High:
+            return {0.35f, 0.65f};
+        case FoveationLevel::Off:
+            break;
+    }
+    return {HUGE_VALF, HUGE_VALF};
+}
+}  // namespace
+
+FoveationLevel GetFoveationLevel(const std::string& foveationLevelStr) {
+    if (EqualsIgnoreCase(foveationLevelStr, "Off")) {
+        return FoveationLevel::Off;
+    }
+    if (EqualsIgnoreCase(foveationLevelStr, "Low")) {
+        return FoveationLevel::Low;
+    }
+    if (EqualsIgnoreCase(foveationLevelStr, "Medium")) {
+        return FoveationLevel::Medium;
+    }
+    if (EqualsIgnoreCase(foveationLevelStr, "High")) {
+        return FoveationLevel::High;
+    }
+    throw std::invalid_argument(Fmt("Unknown foveation level '%s'", foveationLevelStr.c_str()));
+}
+
+const char* to_string(FoveationLevel level) {
+    switch (level) {
+        case FoveationLevel::Off:
+            return "Off";
+        case FoveationLevel::Low:
+            return "Low";
+        case FoveationLevel::Medium:
+            return "Medium";
+        case FoveationLevel::High:
+            return "High";
+    }
+    return "Unknown";
+}
+
+XrRect2Di FoveationViewTiles(const XrRect2Di& rect, uint32_t tileWidth, uint32_t tileHeight) {
+    const int32_t left = rect.offset.x / (int32_t)tileWidth;
+    const int32_t top = rect.offset.y / (int32_t)tileHeight;
+    const int32_t right = (rect.offset.x + rect.extent.width + (int32_t)tileWidth - 1) / (int32_t)tileWidth;
+    const int32_t bottom = (rect.offset.y + rect.extent.height + (int32_t)tileHeight - 1) / (int32_t)tileHeight;
+    return {{left, top}, {right - left, bottom - top}};
+}
+
+std::vector<uint8_t> FoveationShadingRates(FoveationLevel level, uint32_t tilesX, uint32_t tilesY, const XrRect2Di& viewTiles,
+                                           uint32_t maxLog2Size) {
+    const FoveationRings rings = GetFoveationRings(level);
+
+    std::vector<uint8_t> rates(tilesX * tilesY);
+    for (uint32_t y = 0; y < tilesY; ++y) {
+        const float v = (y + 0.5f - viewTiles.offset.y) / viewTiles.extent.height * 2.0f - 1.0f;
+        for (uint32_t x = 0; x < tilesX; ++x) {
+            const float u = (x + 0.5f - viewTiles.offset.x) / viewTiles.extent.width * 2.0f - 1.0f;
+            const float distance = std::sqrt(u * u + v * v);
+            uint32_t log2Size = distance >= rings.Coarse4x4 ? 2 : distance >= rings.Coarse2x2 ? 1 : 0;
+            log2Size = std::min(log2Size, maxLog2Size);
+            rates[y * tilesX + x] = (uint8_t)((log2Size << 2) | log2Size);
+        }
+    }
+    return rates;
+}
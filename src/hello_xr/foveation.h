@@ -0,0 +1,23 @@
+// Copyright (c) 2017-2020 The Khronos Group Inc
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+// How far from the center of each view shading gets coarser.
+enum class FoveationLevel { Off, Low, Medium, High };
+
+FoveationLevel GetFoveationLevel(const std::string& foveationLevelStr);
+
+const char* to_string(FoveationLevel level);
+
+// The tiles of tileWidth x tileHeight pixels that the pixels of rect fall in.
+XrRect2Di FoveationViewTiles(const XrRect2Di& rect, uint32_t tileWidth, uint32_t tileHeight);
+
+// Shading rates for app-side foveation on a tilesX x tilesY grid covering an image, row by row: full rate around the center
+// of viewTiles, the tiles the view is rendered into, then 2x2 and 4x4 pixel fragments in rings further out. With dynamic
+// resolution a view only covers part of the image, and the pattern follows it. Each entry is (log2(width) << 2) |
+// log2(height) of the fragment, which is the encoding of both VK_KHR_fragment_shading_rate attachments and D3D12
+// shading-rate images. Fragments are at most 2^maxLog2Size pixels wide and high.
+std::vector<uint8_t> FoveationShadingRates(FoveationLevel level, uint32_t tilesX, uint32_t tilesY, const XrRect2Di& viewTiles,
+                                           uint32_t maxLog2Size);
@@ -0,0 +1,194 @@
+// Copyright (c) 2017-2020 The Khronos Group Inc.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include "pch.h"
+#include "common.h"
+#include "framestats.h"
+#include "allocationcounter.h"
+
+#include <utils/nanoseconds.h>
+
+namespace {
+constexpr const char* PhaseNames[] = {"actions", "wait",           "locate_spaces", "begin", "locate_views",
+                                      "cull",    "acquire_images", "render",        "end"};
+static_assert(ArraySize(PhaseNames) == FramePhaseCount, "Every frame phase needs a name");
+
+double ToMilliseconds(uint64_t nanoseconds) { return nanoseconds / 1e6; }
+}  // namespace
+
+uint64_t FrameStatsNow() { return GetTimeNanoseconds(); }
+
+const char* to_string(FramePhase phase) { return PhaseNames[static_cast<size_t>(phase)]; }
+
+FrameStats::FrameStats(const std::string& csvPath) {
+    if (csvPath.empty()) {
+        return;
+    }
+
+#if defined(_MSC_VER)
+    if (fopen_s(&m_csv, csvPath.c_str(), "w") != 0) {
+        m_csv = nullptr;
+    }
+#else
+    m_csv = fopen(csvPath.c_str(), "w");
+#endif
+    if (m_csv == nullptr) {
+        Log::Write(Log::Level::Warning, Fmt("Unable to open frame stats file '%s', CSV output disabled", csvPath.c_str()));
+        return;
+    }
+
+    fprintf(m_csv, "frame");
+    for (const char* name : PhaseNames) {
+        fprintf(m_csv, ",%s_ns", name);
+    }
+    fprintf(m_csv, ",total_ns");
+    for (size_t view = 0; view < MaxGpuViews; ++view) {
+        fprintf(m_csv, ",gpu_view%zu_ns", view);
+    }
+    fprintf(m_csv, ",visible_cubes,culled_cubes,input_calls,skipped_haptics,latch_views_ns,latch_hands_ns%s\n",
+            AllocationCountingEnabled ? ",allocations" : "");
+}
+
+FrameStats::~FrameStats() {
+    Flush();
+    if (m_csv != nullptr) {
+        fclose(m_csv);
+    }
+}
+
+void FrameStats::Commit(const FrameTimings& timings) {
+    m_frames[m_frameIndex % FrameCapacity] = {m_frameIndex, timings};
+    ++m_frameIndex;
+    if (++m_pending == FrameCapacity) {
+        Flush();
+    }
+}
+
+void FrameStats::Flush() {
+    if (m_pending == 0) {
+        return;
+    }
+
+    const uint64_t firstFrame = m_frameIndex - m_pending;
+    auto record = [&](size_t i) -> const FrameRecord& { return m_frames[(firstFrame + i) % FrameCapacity]; };
+
+    Log::Write(Log::Level::Info, Fmt("Frame CPU timings over frames %llu-%llu (ms):", (unsigned long long)firstFrame,
+                                     (unsigned long long)(m_frameIndex - 1)));
+    Log::Write(Log::Level::Info, Fmt("  %-16s %9s %9s %9s %9s", "phase", "min", "avg", "p50", "p99"));
+    for (size_t phase = 0; phase < FramePhaseCount; ++phase) {
+        uint64_t total = 0;
+        for (size_t i = 0; i < m_pending; ++i) {
+            m_scratch[i] = record(i).Timings.Phases[phase];
+            total += m_scratch[i];
+        }
+        LogRow(PhaseNames[phase], m_pending, total);
+    }
+
+    // GPU results are only present for the frames where the graphics plugin had new ones.
+    for (size_t view = 0; view < MaxGpuViews; ++view) {
+        size_t count = 0;
+        uint64_t total = 0;
+        for (size_t i = 0; i < m_pending; ++i) {
+            const FrameTimings& timings = record(i).Timings;
+            if (view < timings.GpuViewCount) {
+                m_scratch[count++] = timings.GpuViews[view];
+                total += timings.GpuViews[view];
+            }
+        }
+        if (count > 0) {
+            LogRow(Fmt("gpu_view%zu", view).c_str(), count, total);
+        }
+    }
+
+    // Late latching gains, over the frames that were late latched.
+    const std::pair<const char*, uint64_t FrameTimings::*> lateLatchRows[] = {{"latch_views", &FrameTimings::LateLatchViews},
+                                                                              {"latch_hands", &FrameTimings::LateLatchHands}};
+    for (const auto& row : lateLatchRows) {
+        size_t count = 0;
+        uint64_t total = 0;
+        for (size_t i = 0; i < m_pending; ++i) {
+            const uint64_t nanoseconds = record(i).Timings.*row.second;
+            if (nanoseconds != 0) {
+                m_scratch[count++] = nanoseconds;
+                total += nanoseconds;
+            }
+        }
+        if (count > 0) {
+            LogRow(row.first, count, total);
+        }
+    }
+
+    uint64_t visibleCubes = 0;
+    uint64_t culledCubes = 0;
+    for (size_t i = 0; i < m_pending; ++i) {
+        visibleCubes += record(i).Timings.VisibleCubes;
+        culledCubes += record(i).Timings.CulledCubes;
+    }
+    Log::Write(Log::Level::Info, Fmt("  cubes per frame: %.1f visible, %.1f culled", (double)visibleCubes / m_pending,
+                                     (double)culledCubes / m_pending));
+
+    uint64_t inputCalls = 0;
+    uint64_t skippedHaptics = 0;
+    for (size_t i = 0; i < m_pending; ++i) {
+        inputCalls += record(i).Timings.InputCalls;
+        skippedHaptics += record(i).Timings.SkippedHaptics;
+    }
+    Log::Write(Log::Level::Info, Fmt("  input runtime calls per frame: %.1f, %.1f redundant haptics skipped",
+                                     (double)inputCalls / m_pending, (double)skippedHaptics / m_pending));
+
+    if (AllocationCountingEnabled) {
+        uint64_t allocations = 0;
+        uint32_t maxAllocations = 0;
+        size_t allocatingFrames = 0;
+        for (size_t i = 0; i < m_pending; ++i) {
+            const uint32_t frameAllocations = record(i).Timings.Allocations;
+            allocations += frameAllocations;
+            maxAllocations = std::max(maxAllocations, frameAllocations);
+            allocatingFrames += frameAllocations > 0 ? 1 : 0;
+        }
+        Log::Write(Log::Level::Info, Fmt("  heap allocations per frame: %.1f avg, %u max, %zu of %zu frames allocated",
+                                         (double)allocations / m_pending, maxAllocations, allocatingFrames, m_pending));
+    }
+
+    if (m_csv != nullptr) {
+        for (size_t i = 0; i < m_pending; ++i) {
+            const FrameRecord& frame = record(i);
+            uint64_t total = 0;
+            fprintf(m_csv, "%llu", (unsigned long long)frame.FrameIndex);
+            for (uint64_t nanoseconds : frame.Timings.Phases) {
+                fprintf(m_csv, ",%llu", (unsigned long long)nanoseconds);
+                total += nanoseconds;
+            }
+            fprintf(m_csv, ",%llu", (unsigned long long)total);
+            for (size_t view = 0; view < MaxGpuViews; ++view) {
+                if (view < frame.Timings.GpuViewCount) {
+                    fprintf(m_csv, ",%llu", (unsigned long long)frame.Timings.GpuViews[view]);
+                } else {
+                    fprintf(m_csv, ",");
+                }
+            }
+            fprintf(m_csv, ",%u,%u,%u,%u,%llu,%llu", frame.Timings.VisibleCubes, frame.Timings.CulledCubes,
+                    frame.Timings.InputCalls, frame.Timings.SkippedHaptics, (unsigned long long)frame.Timings.LateLatchViews,
+                    (unsigned long long)frame.Timings.LateLatchHands);
+            if (AllocationCountingEnabled) {
+                fprintf(m_csv, ",%u", frame.Timings.Allocations);
+            }
+            fprintf(m_csv, "\n");
+        }
+        fflush(m_csv);
+    }
+
+    m_pending = 0;
+}
+
+// Log min/avg/p50/p99 of the first count values of m_scratch, which sum to total.
+void FrameStats::LogRow(const char* name, size_t count, uint64_t total) {
+    // Nearest-rank percentiles.
+    const auto begin = m_scratch.begin();
+    std::sort(begin, begin + count);
+    const uint64_t p50 = m_scratch[(count - 1) * 50 / 100];
+    const uint64_t p99 = m_scratch[(count - 1) * 99 / 100];
+    Log::Write(Log::Level::Info, Fmt("  %-16s %9.3f %9.3f %9.3f %9.3f", name, ToMilliseconds(m_scratch[0]),
+                                     ToMilliseconds(total) / count, ToMilliseconds(p50), ToMilliseconds(p99)));
+}
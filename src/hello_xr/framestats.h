@@ -0,0 +1,114 @@
+// Copyright (c) 2017-2020 The Khronos Group Inc
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include <array>
+
+// CPU phases of a frame.
+enum class FramePhase { Actions, Wait, LocateSpaces, Begin, LocateViews, Cull, AcquireImages, Render, End, Count };
+
+constexpr size_t FramePhaseCount = static_cast<size_t>(FramePhase::Count);
+
+const char* to_string(FramePhase phase);
+
+// Views whose GPU time is kept per frame.
+constexpr size_t MaxGpuViews = 4;
+
+// Current time in nanoseconds, only meaningful relative to other calls.
+uint64_t FrameStatsNow();
+
+// Durations of each phase of one frame, in nanoseconds.
+struct FrameTimings {
+    std::array<uint64_t, FramePhaseCount> Phases{};
+
+    // GPU time of each view from the newest frame the graphics plugin had results for, which lags a few frames behind.
+    std::array<uint64_t, MaxGpuViews> GpuViews{};
+    size_t GpuViewCount{0};
+
+    // Cubes passed to the graphics plugin and cubes removed by frustum culling.
+    uint32_t VisibleCubes{0};
+    uint32_t CulledCubes{0};
+
+    // Heap allocations since the previous frame, only counted in builds with HELLO_XR_COUNT_ALLOCATIONS.
+    uint32_t Allocations{0};
+
+    // Runtime calls made to sample input and drive haptics, and vibrations left out because one was still playing.
+    uint32_t InputCalls{0};
+    uint32_t SkippedHaptics{0};
+
+    // With late latching, how long after their first locate the views and the hands were located again right before
+    // submission, which is how much less the runtime had to predict. Zero when they were not late latched.
+    uint64_t LateLatchViews{0};
+    uint64_t LateLatchHands{0};
+
+    void Add(FramePhase phase, uint64_t nanoseconds) { Phases[static_cast<size_t>(phase)] += nanoseconds; }
+
+    void SetGpuViews(const std::vector<uint64_t>& viewNanoseconds) {
+        GpuViewCount = std::min(viewNanoseconds.size(), MaxGpuViews);
+        std::copy_n(viewNanoseconds.begin(), GpuViewCount, GpuViews.begin());
+    }
+
+    void Reset() {
+        Phases.fill(0);
+        GpuViewCount = 0;
+        VisibleCubes = 0;
+        CulledCubes = 0;
+        Allocations = 0;
+        InputCalls = 0;
+        SkippedHaptics = 0;
+        LateLatchViews = 0;
+        LateLatchHands = 0;
+    }
+};
+
+// Adds the time from construction to destruction to one phase, and traces it in builds with HELLO_XR_TRACING.
+class ScopedFramePhase {
+   public:
+    ScopedFramePhase(FrameTimings& timings, FramePhase phase) : m_timings(timings), m_phase(phase), m_start(FrameStatsNow()) {}
+    ~ScopedFramePhase() { m_timings.Add(m_phase, FrameStatsNow() - m_start); }
+
+    ScopedFramePhase(const ScopedFramePhase&) = delete;
+    ScopedFramePhase& operator=(const ScopedFramePhase&) = delete;
+
+   private:
+    FrameTimings& m_timings;
+    const FramePhase m_phase;
+    const uint64_t m_start;
+#if defined(HELLO_XR_TRACING)
+    const Trace::Span m_span{Trace::IsEnabled() ? to_string(m_phase) : nullptr};
+#endif
+};
+
+// Collects frame timings into a fixed-size ring without allocating. Every FrameCapacity frames, and on destruction, it logs
+// min/avg/p50/p99 per phase, per GPU view and of the late latching gains, and the average cube and input call counts, over
+// the frames since the previous report and optionally appends them to a CSV file.
+class FrameStats {
+   public:
+    static constexpr size_t FrameCapacity = 512;
+
+    explicit FrameStats(const std::string& csvPath);
+    ~FrameStats();
+
+    FrameStats(const FrameStats&) = delete;
+    FrameStats& operator=(const FrameStats&) = delete;
+
+    // Record a completed frame.
+    void Commit(const FrameTimings& timings);
+
+   private:
+    void Flush();
+    void LogRow(const char* name, size_t count, uint64_t total);
+
+    struct FrameRecord {
+        uint64_t FrameIndex;
+        FrameTimings Timings;
+    };
+
+    std::array<FrameRecord, FrameCapacity> m_frames{};
+    std::array<uint64_t, FrameCapacity> m_scratch{};
+    uint64_t m_frameIndex{0};
+    size_t m_pending{0};  // Frames recorded since the last flush, the newest at m_frames[(m_frameIndex - 1) % FrameCapacity].
+    FILE* m_csv{nullptr};
+};
@@ -0,0 +1,92 @@
+// Copyright (c) 2017-2020 The Khronos Group Inc
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include "framestats.h"
+
+#include <array>
+#include <vector>
+
+// Bookkeeping the graphics plugins share for GPU timer queries. The plugins only issue and read back the queries and keep
+// their query objects themselves.
+
+// GPU timer queries are read back this many frames after they were issued, so the result is normally ready without a stall.
+constexpr uint32_t GpuTimerFrameLatency = 4;
+
+// Views per frame that get timer queries, further views are not timed.
+constexpr uint32_t MaxGpuTimerViews = static_cast<uint32_t>(MaxGpuViews);
+
+// Views timed in one frame's worth of queries, counted while recording and cleared once they are read back.
+struct GpuTimedViews {
+    uint32_t Count{0};
+
+    // Whether the next view has queries left to time it with.
+    bool CanTime() const { return Count < MaxGpuTimerViews; }
+
+    // Call after the queries of a view were issued.
+    void Timed() {
+        if (CanTime()) {
+            ++Count;
+        }
+    }
+
+    // The views timed, leaving none for the queries to be reused.
+    uint32_t Take() {
+        const uint32_t count = Count;
+        Count = 0;
+        return count;
+    }
+};
+
+// Ring of GPU timer query sets used GpuTimerFrameLatency frames apart. Frame is a plugin's queries for one frame and needs a
+// GpuTimedViews member named TimedViews.
+template <typename Frame>
+class GpuTimerRing {
+   public:
+    std::array<Frame, GpuTimerFrameLatency>& Frames() { return m_frames; }
+
+    Frame& Current() { return m_frames[m_index]; }
+
+    // Move to the next set of queries, which still holds the views timed by the frame that last used it.
+    Frame& Advance() {
+        m_index = (m_index + 1) % GpuTimerFrameLatency;
+        return m_frames[m_index];
+    }
+
+    // Forget the views timed by every frame, for when their results are known to be unusable.
+    void DiscardAll() {
+        for (Frame& frame : m_frames) {
+            frame.TimedViews.Take();
+        }
+    }
+
+   private:
+    std::array<Frame, GpuTimerFrameLatency> m_frames{};
+    uint32_t m_index{0};
+};
+
+// The newest GPU view durations read back, handed out once through IGraphicsPlugin::TakeGpuViewTimes.
+class GpuViewTimes {
+   public:
+    // Storage for the durations of viewCount views, in nanoseconds, reported once the caller has filled it in.
+    std::vector<uint64_t>& Store(uint32_t viewCount) {
+        m_viewNanoseconds.resize(viewCount);
+        m_ready = viewCount > 0;
+        return m_viewNanoseconds;
+    }
+
+    bool Take(std::vector<uint64_t>& viewNanoseconds) {
+        if (!m_ready) {
+            return false;
+        }
+        viewNanoseconds = m_viewNanoseconds;
+        m_ready = false;
+        return true;
+    }
+
+   private:
+    std::vector<uint64_t> m_viewNanoseconds;
+    bool m_ready{false};
+};
@@ -4,9 +4,34 @@
 
 #pragma once
 
-struct Cube {
-    XrPosef Pose;
-    XrVector3f Scale;
+#include <common/xr_linear.h>
+
+#include "foveation.h"
+#include "mesh.h"
+#include "swapchainpolicy.h"
+
+// Marks a SwapchainImage without a depth swapchain image.
+constexpr uint32_t NoDepthSwapchain = UINT32_MAX;
+
+// Marks a SwapchainImage without a motion vector swapchain image.
+constexpr uint32_t NoMotionVectorSwapchain = UINT32_MAX;
+
+// One image of a swapchain whose image structures were allocated by the graphics plugin.
+struct SwapchainImage {
+    uint32_t swapchainIndex;  // Returned by AllocateSwapchainImageStructs.
+    uint32_t imageIndex;      // Returned by xrAcquireSwapchainImage.
+
+    // Depth swapchain image to render depth into, so it can be submitted with the view. Without one the plugin renders
+    // depth into a buffer of its own.
+    uint32_t depthSwapchainIndex{NoDepthSwapchain};
+    uint32_t depthImageIndex{0};
+
+    // Motion vector swapchain image, and the depth swapchain image that goes with it, to render the motion of the cubes
+    // since the previous frame into for XR_FB_space_warp. Only RenderViews renders motion vectors.
+    uint32_t motionVectorSwapchainIndex{NoMotionVectorSwapchain};
+    uint32_t motionVectorImageIndex{0};
+    uint32_t motionVectorDepthSwapchainIndex{NoDepthSwapchain};
+    uint32_t motionVectorDepthImageIndex{0};
 };
 
 // Wraps a graphics API so the main openxr program can be graphics API-independent.
@@ -16,23 +41,123 @@ struct IGraphicsPlugin {
     // OpenXR extensions required by this graphics API.
     virtual std::vector<std::string> GetInstanceExtensions() const = 0;
 
+    // Device-independent setup, such as shader compilation. Runs as a startup job while the OpenXR instance and system are
+    // created, and finishes before InitializeDevice is called. Once the device exists, the plugin runs its own startup stages,
+    // such as pipeline creation and geometry upload, as jobs that finish before whatever needs them.
+    virtual void PrepareResources() {}
+
     // Create an instance of this graphics api for the provided instance and systemId.
     virtual void InitializeDevice(XrInstance instance, XrSystemId systemId) = 0;
 
+    // Keep the device from an earlier InitializeDevice, and every resource created with it, for a new instance and system
+    // after the runtime restarted. Only possible if the new system uses the same adapter or physical device. On success the
+    // swapchain image structures and meshes of the earlier instance are released, and swapchain and mesh numbering start
+    // over. Returns false without changing anything if the device cannot be kept, in which case the plugin has to be replaced.
+    virtual bool ReuseDevice(XrInstance /*instance*/, XrSystemId /*systemId*/) { return false; }
+
     // Select the preferred swapchain format from the list of available formats.
     virtual int64_t SelectColorSwapchainFormat(const std::vector<int64_t>& runtimeFormats) const = 0;
 
-    // Get the graphics binding header for session creation.
+    // The color swapchain formats the plugin can render into, for swapchain policies other than Default to choose from. Empty
+    // if the plugin leaves the choice to SelectColorSwapchainFormat.
+    virtual std::vector<ColorFormatInfo> GetColorSwapchainFormatCandidates() const { return {}; }
+
+    // Select the depth swapchain format to render depth into from the list of available formats, or return -1 if none of
+    // them can be used.
+    virtual int64_t SelectDepthSwapchainFormat(const std::vector<int64_t>& /*runtimeFormats*/) const { return -1; }
+
+    // Select the format to render motion vectors into for XR_FB_space_warp from the list of available formats, or return -1
+    // if the plugin cannot render motion vectors. Motion vector swapchains are allocated with this format, and their depth
+    // swapchains with the one SelectDepthSwapchainFormat picks.
+    virtual int64_t SelectMotionVectorSwapchainFormat(const std::vector<int64_t>& /*runtimeFormats*/) const { return -1; }
+
+    // Called with true before the motion vector swapchains and their depth swapchains are allocated, and with false after.
+    // Their format may also be one of the color swapchain formats, so this is what tells them apart.
+    virtual void SetAllocatingMotionVectorSwapchains(bool /*motionVectors*/) {}
+
+    // Model matrices of the cubes as of the previous frame, parallel to the cubeModels of the next RenderViews call, for the
+    // motion vectors it renders. The vector must stay unchanged until that call returns.
+    virtual void SetPreviousCubeModels(const std::vector<XrMatrix4x4f>& /*previousCubeModels*/) {}
+
+    // Usage flags the plugin needs on color swapchains on top of XR_SWAPCHAIN_USAGE_SAMPLED_BIT and
+    // XR_SWAPCHAIN_USAGE_COLOR_ATTACHMENT_BIT. Only valid after InitializeDevice.
+    virtual XrSwapchainUsageFlags GetColorSwapchainUsageFlags() const { return 0; }
+
+    // Get the graphics binding header for session creation, nullptr for headless plugins.
     virtual const XrBaseInStructure* GetGraphicsBinding() const = 0;
 
-    // Allocate space for the swapchain image structures. These are different for each graphics API. The returned
-    // pointers are valid for the lifetime of the graphics plugin.
-    virtual std::vector<XrSwapchainImageBaseHeader*> AllocateSwapchainImageStructs(
-        uint32_t capacity, const XrSwapchainCreateInfo& swapchainCreateInfo) = 0;
+    // Whether the plugin renders nothing. Its session is created without a graphics binding through XR_MND_headless and
+    // has no swapchains, so the render calls get swapchain images that refer to nothing, and no layer is submitted.
+    virtual bool IsHeadless() const { return false; }
 
-    // Render to a swapchain image for a projection view.
-    virtual void RenderView(const XrCompositionLayerProjectionView& layerView, const XrSwapchainImageBaseHeader* swapchainImage,
-                            int64_t swapchainFormat, const std::vector<Cube>& cubes) = 0;
+    // Allocate space for the swapchain image structures. These are different for each graphics API. The pointers
+    // written to swapchainImages are valid for the lifetime of the graphics plugin. Returns the index that identifies the
+    // swapchain when rendering; swapchains are numbered from 0 in allocation order. Depth swapchains, which have
+    // XR_SWAPCHAIN_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT set, share the numbering with color swapchains.
+    virtual uint32_t AllocateSwapchainImageStructs(uint32_t capacity, const XrSwapchainCreateInfo& swapchainCreateInfo,
+                                                   std::vector<XrSwapchainImageBaseHeader*>& swapchainImages) = 0;
+
+    // Copy a mesh into GPU memory for the render calls to draw, straight from where mesh points, and return its ID. IDs
+    // count up from CubeMesh + 1. Only valid after InitializeDevice.
+    virtual uint32_t AddMesh(const MeshData& /*mesh*/) { THROW("Meshes are not supported by this graphics plugin"); }
+
+    // Render to a swapchain image for a projection view. Each model matrix is drawn with the mesh meshDraws gives it.
+    virtual void RenderView(const XrCompositionLayerProjectionView& layerView, const SwapchainImage& swapchainImage,
+                            int64_t swapchainFormat, const std::vector<XrMatrix4x4f>& cubeModels,
+                            const std::vector<MeshDraw>& meshDraws) = 0;
+
+    // Render every projection view into its swapchain image, swapchainImages[i] holding layerViews[i].
+    // Backends can override this to share per-frame work across views and submit once; by default each view goes to RenderView.
+    virtual void RenderViews(const std::vector<XrCompositionLayerProjectionView>& layerViews,
+                             const std::vector<SwapchainImage>& swapchainImages, int64_t swapchainFormat,
+                             const std::vector<XrMatrix4x4f>& cubeModels, const std::vector<MeshDraw>& meshDraws) {
+        CHECK(layerViews.size() == swapchainImages.size());
+        for (size_t i = 0; i < layerViews.size(); ++i) {
+            RenderView(layerViews[i], swapchainImages[i], swapchainFormat, cubeModels, meshDraws);
+        }
+    }
+
+    // Whether all views can be rendered into the layers of one array swapchain in a single pass.
+    // Only valid after InitializeDevice.
+    virtual bool SupportsMultiview() const { return false; }
+
+    // Render every projection view into its own layer (subImage.imageArrayIndex) of an array swapchain image in one pass.
+    virtual void RenderMultiview(const std::vector<XrCompositionLayerProjectionView>& /*layerViews*/,
+                                 const SwapchainImage& /*swapchainImage*/, int64_t /*swapchainFormat*/,
+                                 const std::vector<XrMatrix4x4f>& /*cubeModels*/,
+                                 const std::vector<MeshDraw>& /*meshDraws*/) {
+        THROW("Multiview rendering is not supported by this graphics plugin");
+    }
+
+    // Late latching: RenderViews and RenderMultiview call the callback once everything is recorded, right before submitting.
+    // It may update the poses of the layer views and the cube models passed to the render call, which the plugin then
+    // writes again to the memory the GPU reads them from. The callback returns the index of the first model it changed, or
+    // the model count if none changed. Returns false if the plugin bakes them into its commands, then it is never called.
+    virtual bool SetLateLatchCallback(std::function<size_t()> /*callback*/) { return false; }
+
+    // CPU time spent blocked waiting on the GPU since the previous call, for plugins that track it.
+    virtual std::chrono::nanoseconds TakeCpuWaitTime() { return {}; }
+
+    // GPU time of each view, in nanoseconds, for the newest frame whose timer queries have completed since the previous call.
+    // Plugins read their queries back a few frames late so this never stalls, and only time views when frame stats are
+    // enabled. Views rendered in a single multiview pass share one duration. Returns false if there is nothing new.
+    virtual bool TakeGpuViewTimes(std::vector<uint64_t>& /*viewNanoseconds*/) { return false; }
+
+    // Whether the runtime can foveate this plugin's swapchains through XR_FB_foveation without any change to its rendering.
+    virtual bool SupportsSwapchainFoveation() const { return false; }
+
+    // Shade away from the center of each view at a coarser rate, for swapchains allocated after this call. Returns false if
+    // the device cannot vary the shading rate. Only valid after InitializeDevice.
+    virtual bool EnableFoveatedShading(FoveationLevel /*level*/) { return false; }
+
+    // Render color swapchains with up to sampleCount samples per pixel and resolve them as each tile is written out, so the
+    // samples never reach memory and the swapchains stay single-sampled. multiview tells whether the views are rendered into
+    // one array swapchain, and depthSwapchains whether depth is rendered into depth swapchains, whose samples then have to
+    // be resolved as well. Applies to swapchains allocated after this call, and returns the sample count used, 1 if the
+    // device cannot resolve on tile. Only valid after InitializeDevice.
+    virtual uint32_t EnableOnTileMultisampling(uint32_t /*sampleCount*/, bool /*multiview*/, bool /*depthSwapchains*/) {
+        return 1;
+    }
 
     // Get recommended number of sub-data element samples in view (recommendedSwapchainSampleCount)
     // if supported by the graphics plugin. A supported value otherwise.
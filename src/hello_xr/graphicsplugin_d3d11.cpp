@@ -6,10 +6,15 @@
 #include "common.h"
 #include "geometry.h"
 #include "graphicsplugin.h"
+#include "options.h"
+#include "jobsystem.h"
+#include "gputimers.h"
+#include "startup.h"
 
 #if defined(XR_USE_GRAPHICS_API_D3D11) && !defined(MISSING_DIRECTX_COLORS)
 
 #include <common/xr_linear.h>
+#include <array>
 #include <DirectXColors.h>
 #include <D3Dcompiler.h>
 
@@ -19,6 +24,9 @@ using namespace Microsoft::WRL;
 using namespace DirectX;
 
 namespace {
+// Views that can be recorded on deferred contexts at once.
+constexpr uint32_t MaxDeferredViews = 4;
+
 void InitializeD3D11DeviceForAdapter(IDXGIAdapter1* adapter, const std::vector<D3D_FEATURE_LEVEL>& featureLevels,
                                      ID3D11Device** device, ID3D11DeviceContext** deviceContext) {
     UINT creationFlags = D3D11_CREATE_DEVICE_BGRA_SUPPORT;
@@ -49,8 +57,24 @@ TryAgain:
     }
 }
 
-struct D3D11GraphicsPlugin : public IGraphicsPlugin {
-    D3D11GraphicsPlugin(const std::shared_ptr<Options>&, std::shared_ptr<IPlatformPlugin>){};
+// The images of one swapchain and the views and depth buffers that go with them.
+struct SwapchainImageContext {
+    // A packed array of XrSwapchainImageD3D11KHR's for xrEnumerateSwapchainImages.
+    std::vector<XrSwapchainImageD3D11KHR> images;
+    DXGI_FORMAT format{DXGI_FORMAT_UNKNOWN};  // The textures are typeless, views are created with this format
+    uint32_t arraySize{1};
+    // Render target view over every array slice of each color image, created on first use.
+    std::vector<ComPtr<ID3D11RenderTargetView>> renderTargetViews;
+    // Depth-stencil view for each image, created on first use. For a depth swapchain these are views of its own images.
+    std::vector<ComPtr<ID3D11DepthStencilView>> depthStencilViews;
+};
+
+struct D3D11GraphicsPlugin final : public IGraphicsPlugin {
+    D3D11GraphicsPlugin(const std::shared_ptr<Options>& options, std::shared_ptr<IPlatformPlugin>)
+        : m_cacheDirectory(options->CacheDirectory),
+          m_instancing(options->Instancing),
+          m_parallelViews(options->ParallelViews && GetJobSystem().WorkerCount() > 0),
+          m_gpuTimers(options->FrameStats || options->DynamicResolution){};
 
     std::vector<std::string> GetInstanceExtensions() const override { return {XR_KHR_D3D11_ENABLE_EXTENSION_NAME}; }
 
@@ -63,6 +87,7 @@ struct D3D11GraphicsPlugin : public IGraphicsPlugin {
         XrGraphicsRequirementsD3D11KHR graphicsRequirements{XR_TYPE_GRAPHICS_REQUIREMENTS_D3D11_KHR};
         CHECK_XRCMD(pfnGetD3D11GraphicsRequirementsKHR(instance, systemId, &graphicsRequirements));
         const ComPtr<IDXGIAdapter1> adapter = GetAdapter(graphicsRequirements.adapterLuid);
+        m_adapterLuid = graphicsRequirements.adapterLuid;
 
         // Create a list of feature levels which are both supported by the OpenXR runtime and this application.
         std::vector<D3D_FEATURE_LEVEL> featureLevels = {D3D_FEATURE_LEVEL_12_1, D3D_FEATURE_LEVEL_12_0, D3D_FEATURE_LEVEL_11_1,
@@ -80,37 +105,187 @@ struct D3D11GraphicsPlugin : public IGraphicsPlugin {
         m_graphicsBinding.device = m_device.Get();
     }
 
+    // Compile the HLSL, which needs no device. The multiview shaders are always built since support is only known once the
+    // device exists.
+    void PrepareResources() override {
+        m_vertexShaderBytes = CompileShader(ShaderHlsl, "MainVS", "vs_5_0", m_cacheDirectory);
+        m_pixelShaderBytes = CompileShader(ShaderHlsl, "MainPS", "ps_5_0", m_cacheDirectory);
+        m_multiviewVertexShaderBytes = CompileShader(MultiviewShaderHlsl, "MainVS", "vs_5_0", m_cacheDirectory);
+        m_multiviewPixelShaderBytes = CompileShader(MultiviewShaderHlsl, "MainPS", "ps_5_0", m_cacheDirectory);
+    }
+
     void InitializeResources() {
-        const ComPtr<ID3DBlob> vertexShaderBytes = CompileShader(ShaderHlsl, "MainVS", "vs_5_0");
-        CHECK_HRCMD(m_device->CreateVertexShader(vertexShaderBytes->GetBufferPointer(), vertexShaderBytes->GetBufferSize(), nullptr,
-                                                 m_vertexShader.ReleaseAndGetAddressOf()));
+        const CD3D11_BUFFER_DESC viewProjectionConstantBufferDesc(sizeof(ViewProjectionConstantBuffer), D3D11_BIND_CONSTANT_BUFFER);
+        CHECK_HRCMD(
+            m_device->CreateBuffer(&viewProjectionConstantBufferDesc, nullptr, m_viewProjectionCBuffer.ReleaseAndGetAddressOf()));
 
-        const ComPtr<ID3DBlob> pixelShaderBytes = CompileShader(ShaderHlsl, "MainPS", "ps_5_0");
-        CHECK_HRCMD(m_device->CreatePixelShader(pixelShaderBytes->GetBufferPointer(), pixelShaderBytes->GetBufferSize(), nullptr,
-                                                m_pixelShader.ReleaseAndGetAddressOf()));
+        // Single-pass stereo needs SV_RenderTargetArrayIndex from the vertex shader.
+        D3D11_FEATURE_DATA_D3D11_OPTIONS3 options3{};
+        m_multiviewSupported =
+            SUCCEEDED(m_device->CheckFeatureSupport(D3D11_FEATURE_D3D11_OPTIONS3, &options3, sizeof(options3))) &&
+            options3.VPAndRTArrayIndexFromAnyShaderFeedingRasterizer;
+        if (m_multiviewSupported) {
+            const CD3D11_BUFFER_DESC multiviewViewProjectionConstantBufferDesc(sizeof(MultiviewViewProjectionConstantBuffer),
+                                                                               D3D11_BIND_CONSTANT_BUFFER);
+            CHECK_HRCMD(m_device->CreateBuffer(&multiviewViewProjectionConstantBufferDesc, nullptr,
+                                               m_multiviewViewProjectionCBuffer.ReleaseAndGetAddressOf()));
+        }
+
+        // The device is free-threaded, so the shaders and the cube are created by startup jobs while the session and its
+        // swapchains are, and the first frame waits for them.
+        AddStartupStage(m_startupJobs, "create shaders", [this]() { CreateShaders(); });
+        m_meshes.clear();
+        AddStartupStage(m_startupJobs, "upload cube geometry", [this]() { CreateMesh(CubeMeshData()); });
+
+        if (m_parallelViews) {
+            // The runtime emulates command lists for drivers without them, so deferred contexts work either way.
+            D3D11_FEATURE_DATA_THREADING threading{};
+            CHECK_HRCMD(m_device->CheckFeatureSupport(D3D11_FEATURE_THREADING, &threading, sizeof(threading)));
+            LOG_VERBOSE(Fmt("Recording views on deferred contexts, driver command lists %s",
+                            threading.DriverCommandLists ? "supported" : "emulated"));
+        }
 
-        const D3D11_INPUT_ELEMENT_DESC vertexDesc[] = {
+        if (m_gpuTimers) {
+            const CD3D11_QUERY_DESC disjointDesc(D3D11_QUERY_TIMESTAMP_DISJOINT);
+            const CD3D11_QUERY_DESC timestampDesc(D3D11_QUERY_TIMESTAMP);
+            for (GpuTimerFrame& timerFrame : m_gpuTimerFrames.Frames()) {
+                CHECK_HRCMD(m_device->CreateQuery(&disjointDesc, timerFrame.disjoint.ReleaseAndGetAddressOf()));
+                for (ComPtr<ID3D11Query>& timestamp : timerFrame.timestamps) {
+                    CHECK_HRCMD(m_device->CreateQuery(&timestampDesc, timestamp.ReleaseAndGetAddressOf()));
+                }
+            }
+        }
+    }
+
+    // The vertex and pixel shaders and their input layouts, from the bytecode PrepareResources compiled.
+    void CreateShaders() {
+        // The model matrix is streamed per instance, one row per register. The multiview layout steps it once per view pair.
+        D3D11_INPUT_ELEMENT_DESC vertexDesc[] = {
             {"POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0},
             {"COLOR", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0},
+            {"MODEL", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, InstanceDataSlot, 0, D3D11_INPUT_PER_INSTANCE_DATA, 1},
+            {"MODEL", 1, DXGI_FORMAT_R32G32B32A32_FLOAT, InstanceDataSlot, 16, D3D11_INPUT_PER_INSTANCE_DATA, 1},
+            {"MODEL", 2, DXGI_FORMAT_R32G32B32A32_FLOAT, InstanceDataSlot, 32, D3D11_INPUT_PER_INSTANCE_DATA, 1},
+            {"MODEL", 3, DXGI_FORMAT_R32G32B32A32_FLOAT, InstanceDataSlot, 48, D3D11_INPUT_PER_INSTANCE_DATA, 1},
         };
 
+        const ComPtr<ID3DBlob>& vertexShaderBytes = m_vertexShaderBytes;
+        CHECK_HRCMD(m_device->CreateVertexShader(vertexShaderBytes->GetBufferPointer(), vertexShaderBytes->GetBufferSize(), nullptr,
+                                                 m_vertexShader.ReleaseAndGetAddressOf()));
+
+        const ComPtr<ID3DBlob>& pixelShaderBytes = m_pixelShaderBytes;
+        CHECK_HRCMD(m_device->CreatePixelShader(pixelShaderBytes->GetBufferPointer(), pixelShaderBytes->GetBufferSize(), nullptr,
+                                                m_pixelShader.ReleaseAndGetAddressOf()));
+
         CHECK_HRCMD(m_device->CreateInputLayout(vertexDesc, (UINT)ArraySize(vertexDesc), vertexShaderBytes->GetBufferPointer(),
                                                 vertexShaderBytes->GetBufferSize(), &m_inputLayout));
 
-        const CD3D11_BUFFER_DESC modelConstantBufferDesc(sizeof(ModelConstantBuffer), D3D11_BIND_CONSTANT_BUFFER);
-        CHECK_HRCMD(m_device->CreateBuffer(&modelConstantBufferDesc, nullptr, m_modelCBuffer.ReleaseAndGetAddressOf()));
+        if (m_multiviewSupported) {
+            const ComPtr<ID3DBlob>& multiviewVertexShaderBytes = m_multiviewVertexShaderBytes;
+            CHECK_HRCMD(m_device->CreateVertexShader(multiviewVertexShaderBytes->GetBufferPointer(),
+                                                     multiviewVertexShaderBytes->GetBufferSize(), nullptr,
+                                                     m_multiviewVertexShader.ReleaseAndGetAddressOf()));
+
+            const ComPtr<ID3DBlob>& multiviewPixelShaderBytes = m_multiviewPixelShaderBytes;
+            CHECK_HRCMD(m_device->CreatePixelShader(multiviewPixelShaderBytes->GetBufferPointer(),
+                                                    multiviewPixelShaderBytes->GetBufferSize(), nullptr,
+                                                    m_multiviewPixelShader.ReleaseAndGetAddressOf()));
+
+            for (D3D11_INPUT_ELEMENT_DESC& element : vertexDesc) {
+                if (element.InputSlotClass == D3D11_INPUT_PER_INSTANCE_DATA) {
+                    element.InstanceDataStepRate = 2;
+                }
+            }
+            CHECK_HRCMD(m_device->CreateInputLayout(vertexDesc, (UINT)ArraySize(vertexDesc),
+                                                    multiviewVertexShaderBytes->GetBufferPointer(),
+                                                    multiviewVertexShaderBytes->GetBufferSize(), &m_multiviewInputLayout));
+        }
+    }
 
-        const CD3D11_BUFFER_DESC viewProjectionConstantBufferDesc(sizeof(ViewProjectionConstantBuffer), D3D11_BIND_CONSTANT_BUFFER);
-        CHECK_HRCMD(
-            m_device->CreateBuffer(&viewProjectionConstantBufferDesc, nullptr, m_viewProjectionCBuffer.ReleaseAndGetAddressOf()));
+    // Move to the next set of timer queries, first reading back the frame that last used it if its results are in. Results
+    // that are not available yet are dropped rather than waited on.
+    void BeginGpuTimerFrame() {
+        if (!m_gpuTimers) {
+            return;
+        }
+
+        GpuTimerFrame& timerFrame = m_gpuTimerFrames.Advance();
+        const uint32_t viewCount = timerFrame.TimedViews.Take();
+        if (viewCount > 0) {
+            D3D11_QUERY_DATA_TIMESTAMP_DISJOINT disjoint{};
+            const HRESULT disjointResult =
+                m_deviceContext->GetData(timerFrame.disjoint.Get(), &disjoint, sizeof(disjoint), D3D11_ASYNC_GETDATA_DONOTFLUSH);
+            if (disjointResult == S_OK && !disjoint.Disjoint) {
+                std::array<UINT64, 2 * MaxGpuTimerViews> ticks{};
+                bool available = true;
+                for (uint32_t query = 0; query < 2 * viewCount && available; ++query) {
+                    available = m_deviceContext->GetData(timerFrame.timestamps[query].Get(), &ticks[query], sizeof(UINT64),
+                                                         D3D11_ASYNC_GETDATA_DONOTFLUSH) == S_OK;
+                }
+                if (available) {
+                    std::vector<uint64_t>& viewNanoseconds = m_gpuViewTimes.Store(viewCount);
+                    for (uint32_t view = 0; view < viewCount; ++view) {
+                        viewNanoseconds[view] = (uint64_t)((ticks[2 * view + 1] - ticks[2 * view]) * 1e9 / disjoint.Frequency);
+                    }
+                }
+            }
+        }
+
+        m_deviceContext->Begin(timerFrame.disjoint.Get());
+        timerFrame.disjointActive = true;
+    }
+
+    void EndGpuTimerFrame() {
+        GpuTimerFrame& timerFrame = m_gpuTimerFrames.Current();
+        if (timerFrame.disjointActive) {
+            m_deviceContext->End(timerFrame.disjoint.Get());
+            timerFrame.disjointActive = false;
+        }
+    }
+
+    void BeginGpuViewTimer() {
+        GpuTimerFrame& timerFrame = m_gpuTimerFrames.Current();
+        if (m_gpuTimers && timerFrame.TimedViews.CanTime()) {
+            m_deviceContext->End(timerFrame.timestamps[2 * timerFrame.TimedViews.Count].Get());
+        }
+    }
+
+    void EndGpuViewTimer() {
+        GpuTimerFrame& timerFrame = m_gpuTimerFrames.Current();
+        if (m_gpuTimers && timerFrame.TimedViews.CanTime()) {
+            m_deviceContext->End(timerFrame.timestamps[2 * timerFrame.TimedViews.Count + 1].Get());
+            timerFrame.TimedViews.Timed();
+        }
+    }
 
-        const D3D11_SUBRESOURCE_DATA vertexBufferData{Geometry::c_cubeVertices};
-        const CD3D11_BUFFER_DESC vertexBufferDesc(sizeof(Geometry::c_cubeVertices), D3D11_BIND_VERTEX_BUFFER);
-        CHECK_HRCMD(m_device->CreateBuffer(&vertexBufferDesc, &vertexBufferData, m_cubeVertexBuffer.ReleaseAndGetAddressOf()));
+    bool TakeGpuViewTimes(std::vector<uint64_t>& viewNanoseconds) override { return m_gpuViewTimes.Take(viewNanoseconds); }
 
-        const D3D11_SUBRESOURCE_DATA indexBufferData{Geometry::c_cubeIndices};
-        const CD3D11_BUFFER_DESC indexBufferDesc(sizeof(Geometry::c_cubeIndices), D3D11_BIND_INDEX_BUFFER);
-        CHECK_HRCMD(m_device->CreateBuffer(&indexBufferDesc, &indexBufferData, m_cubeIndexBuffer.ReleaseAndGetAddressOf()));
+    bool ReuseDevice(XrInstance instance, XrSystemId systemId) override {
+        if (m_device == nullptr) {
+            return false;
+        }
+
+        PFN_xrGetD3D11GraphicsRequirementsKHR pfnGetD3D11GraphicsRequirementsKHR = nullptr;
+        CHECK_XRCMD(xrGetInstanceProcAddr(instance, "xrGetD3D11GraphicsRequirementsKHR",
+                                          reinterpret_cast<PFN_xrVoidFunction*>(&pfnGetD3D11GraphicsRequirementsKHR)));
+        XrGraphicsRequirementsD3D11KHR graphicsRequirements{XR_TYPE_GRAPHICS_REQUIREMENTS_D3D11_KHR};
+        CHECK_XRCMD(pfnGetD3D11GraphicsRequirementsKHR(instance, systemId, &graphicsRequirements));
+        if (memcmp(&graphicsRequirements.adapterLuid, &m_adapterLuid, sizeof(m_adapterLuid)) != 0 ||
+            m_device->GetFeatureLevel() < graphicsRequirements.minFeatureLevel) {
+            return false;
+        }
+
+        m_startupJobs.Wait();
+
+        // Drop every view of the old swapchain images before the contexts holding them.
+        for (ComPtr<ID3D11DeviceContext>& deferredContext : m_deferredContexts) {
+            deferredContext->ClearState();
+        }
+        m_deviceContext->ClearState();
+        m_deviceContext->Flush();
+        m_swapchainImageContexts.clear();
+        m_meshes.resize(CubeMesh + 1);
+        return true;
     }
 
     int64_t SelectColorSwapchainFormat(const std::vector<int64_t>& runtimeFormats) const override {
@@ -132,136 +307,386 @@ struct D3D11GraphicsPlugin : public IGraphicsPlugin {
         return *swapchainFormatIt;
     }
 
+    std::vector<ColorFormatInfo> GetColorSwapchainFormatCandidates() const override {
+        return {{DXGI_FORMAT_R8G8B8A8_UNORM, "DXGI_FORMAT_R8G8B8A8_UNORM", 4, 8, 8, false, true},
+                {DXGI_FORMAT_B8G8R8A8_UNORM, "DXGI_FORMAT_B8G8R8A8_UNORM", 4, 8, 8, false, true},
+                {DXGI_FORMAT_R8G8B8A8_UNORM_SRGB, "DXGI_FORMAT_R8G8B8A8_UNORM_SRGB", 4, 8, 8, true, true},
+                {DXGI_FORMAT_B8G8R8A8_UNORM_SRGB, "DXGI_FORMAT_B8G8R8A8_UNORM_SRGB", 4, 8, 8, true, true},
+                {DXGI_FORMAT_R10G10B10A2_UNORM, "DXGI_FORMAT_R10G10B10A2_UNORM", 4, 10, 2, false, true},
+                {DXGI_FORMAT_R11G11B10_FLOAT, "DXGI_FORMAT_R11G11B10_FLOAT", 4, 10, 0, false, true},
+                {DXGI_FORMAT_R16G16B16A16_FLOAT, "DXGI_FORMAT_R16G16B16A16_FLOAT", 8, 16, 16, false, false}};
+    }
+
+    int64_t SelectDepthSwapchainFormat(const std::vector<int64_t>& runtimeFormats) const override {
+        // The format of the private depth buffers.
+        const auto swapchainFormatIt = std::find(runtimeFormats.begin(), runtimeFormats.end(), DXGI_FORMAT_D32_FLOAT);
+        return swapchainFormatIt != runtimeFormats.end() ? *swapchainFormatIt : -1;
+    }
+
     const XrBaseInStructure* GetGraphicsBinding() const override {
         return reinterpret_cast<const XrBaseInStructure*>(&m_graphicsBinding);
     }
 
-    std::vector<XrSwapchainImageBaseHeader*> AllocateSwapchainImageStructs(
-        uint32_t capacity, const XrSwapchainCreateInfo& /*swapchainCreateInfo*/) override {
+    uint32_t AllocateSwapchainImageStructs(uint32_t capacity, const XrSwapchainCreateInfo& swapchainCreateInfo,
+                                           std::vector<XrSwapchainImageBaseHeader*>& swapchainImages) override {
         // Allocate and initialize the buffer of image structs (must be sequential in memory for xrEnumerateSwapchainImages).
         // Return back an array of pointers to each swapchain image struct so the consumer doesn't need to know the type/size.
-        std::vector<XrSwapchainImageD3D11KHR> swapchainImageBuffer(capacity);
-        std::vector<XrSwapchainImageBaseHeader*> swapchainImageBase;
-        for (XrSwapchainImageD3D11KHR& image : swapchainImageBuffer) {
-            image.type = XR_TYPE_SWAPCHAIN_IMAGE_D3D11_KHR;
-            swapchainImageBase.push_back(reinterpret_cast<XrSwapchainImageBaseHeader*>(&image));
+        // Keep the buffer alive by adding it into the table of contexts, whose index identifies the swapchain.
+        const uint32_t swapchainIndex = (uint32_t)m_swapchainImageContexts.size();
+        m_swapchainImageContexts.push_back(std::make_unique<SwapchainImageContext>());
+        SwapchainImageContext& swapchainImageContext = *m_swapchainImageContexts.back();
+
+        swapchainImageContext.images.resize(capacity, {XR_TYPE_SWAPCHAIN_IMAGE_D3D11_KHR});
+        swapchainImageContext.format = (DXGI_FORMAT)swapchainCreateInfo.format;
+        swapchainImageContext.arraySize = swapchainCreateInfo.arraySize;
+        if ((swapchainCreateInfo.usageFlags & XR_SWAPCHAIN_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT) == 0) {
+            swapchainImageContext.renderTargetViews.resize(capacity);
+        }
+        swapchainImageContext.depthStencilViews.resize(capacity);
+        swapchainImages.clear();
+        for (XrSwapchainImageD3D11KHR& image : swapchainImageContext.images) {
+            swapchainImages.push_back(reinterpret_cast<XrSwapchainImageBaseHeader*>(&image));
         }
 
-        // Keep the buffer alive by moving it into the list of buffers.
-        m_swapchainImageBuffers.push_back(std::move(swapchainImageBuffer));
+        return swapchainIndex;
+    }
 
-        return swapchainImageBase;
+    ID3D11Texture2D* GetColorTexture(const SwapchainImage& swapchainImage) const {
+        return m_swapchainImageContexts[swapchainImage.swapchainIndex]->images[swapchainImage.imageIndex].texture;
     }
 
-    ComPtr<ID3D11DepthStencilView> GetDepthStencilView(ID3D11Texture2D* colorTexture) {
+    ID3D11RenderTargetView* GetRenderTargetView(const SwapchainImage& swapchainImage) {
+        SwapchainImageContext& swapchainContext = *m_swapchainImageContexts[swapchainImage.swapchainIndex];
+        ComPtr<ID3D11RenderTargetView>& cachedView = swapchainContext.renderTargetViews[swapchainImage.imageIndex];
+        if (!cachedView) {
+            const CD3D11_RENDER_TARGET_VIEW_DESC renderTargetViewDesc(
+                swapchainContext.arraySize > 1 ? D3D11_RTV_DIMENSION_TEXTURE2DARRAY : D3D11_RTV_DIMENSION_TEXTURE2D,
+                swapchainContext.format, 0, 0, swapchainContext.arraySize);
+            CHECK_HRCMD(m_device->CreateRenderTargetView(GetColorTexture(swapchainImage), &renderTargetViewDesc,
+                                                         cachedView.ReleaseAndGetAddressOf()));
+        }
+        return cachedView.Get();
+    }
+
+    ID3D11DepthStencilView* GetDepthStencilView(const SwapchainImage& swapchainImage) {
+        // Render into the depth swapchain image when there is one, otherwise into a depth buffer owned by the color image.
+        const bool depthSwapchain = swapchainImage.depthSwapchainIndex != NoDepthSwapchain;
+        SwapchainImageContext& depthContext =
+            *m_swapchainImageContexts[depthSwapchain ? swapchainImage.depthSwapchainIndex : swapchainImage.swapchainIndex];
+        const uint32_t depthImageIndex = depthSwapchain ? swapchainImage.depthImageIndex : swapchainImage.imageIndex;
+
         // If a depth-stencil view has already been created for this back-buffer, use it.
-        auto depthBufferIt = m_colorToDepthMap.find(colorTexture);
-        if (depthBufferIt != m_colorToDepthMap.end()) {
-            return depthBufferIt->second;
+        ComPtr<ID3D11DepthStencilView>& cachedView = depthContext.depthStencilViews[depthImageIndex];
+        if (cachedView) {
+            return cachedView.Get();
         }
 
-        // This back-buffer has no corresponding depth-stencil texture, so create one with matching dimensions.
+        ID3D11Texture2D* const colorTexture = GetColorTexture(swapchainImage);
         D3D11_TEXTURE2D_DESC colorDesc;
         colorTexture->GetDesc(&colorDesc);
 
-        D3D11_TEXTURE2D_DESC depthDesc{};
-        depthDesc.Width = colorDesc.Width;
-        depthDesc.Height = colorDesc.Height;
-        depthDesc.ArraySize = colorDesc.ArraySize;
-        depthDesc.MipLevels = 1;
-        depthDesc.Format = DXGI_FORMAT_R32_TYPELESS;
-        depthDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_DEPTH_STENCIL;
-        depthDesc.SampleDesc.Count = 1;
         ComPtr<ID3D11Texture2D> depthTexture;
-        CHECK_HRCMD(m_device->CreateTexture2D(&depthDesc, nullptr, depthTexture.ReleaseAndGetAddressOf()));
+        if (depthSwapchain) {
+            depthTexture = depthContext.images[depthImageIndex].texture;
+        } else {
+            // This back-buffer has no corresponding depth-stencil texture, so create one with matching dimensions.
+            D3D11_TEXTURE2D_DESC depthDesc{};
+            depthDesc.Width = colorDesc.Width;
+            depthDesc.Height = colorDesc.Height;
+            depthDesc.ArraySize = colorDesc.ArraySize;
+            depthDesc.MipLevels = 1;
+            depthDesc.Format = DXGI_FORMAT_R32_TYPELESS;
+            depthDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_DEPTH_STENCIL;
+            depthDesc.SampleDesc.Count = 1;
+            CHECK_HRCMD(m_device->CreateTexture2D(&depthDesc, nullptr, depthTexture.ReleaseAndGetAddressOf()));
+        }
 
         // Create and cache the depth stencil view.
-        ComPtr<ID3D11DepthStencilView> depthStencilView;
-        CD3D11_DEPTH_STENCIL_VIEW_DESC depthStencilViewDesc(D3D11_DSV_DIMENSION_TEXTURE2D, DXGI_FORMAT_D32_FLOAT);
-        CHECK_HRCMD(m_device->CreateDepthStencilView(depthTexture.Get(), &depthStencilViewDesc, depthStencilView.GetAddressOf()));
-        depthBufferIt = m_colorToDepthMap.insert(std::make_pair(colorTexture, depthStencilView)).first;
+        const CD3D11_DEPTH_STENCIL_VIEW_DESC depthStencilViewDesc(
+            colorDesc.ArraySize > 1 ? D3D11_DSV_DIMENSION_TEXTURE2DARRAY : D3D11_DSV_DIMENSION_TEXTURE2D, DXGI_FORMAT_D32_FLOAT, 0,
+            0, colorDesc.ArraySize);
+        CHECK_HRCMD(m_device->CreateDepthStencilView(depthTexture.Get(), &depthStencilViewDesc, cachedView.GetAddressOf()));
+        return cachedView.Get();
+    }
 
-        return depthStencilView;
+    uint32_t AddMesh(const MeshData& mesh) override {
+        // Mesh IDs follow the cube's
+        m_startupJobs.Wait();
+        return CreateMesh(mesh);
     }
 
-    void RenderView(const XrCompositionLayerProjectionView& layerView, const XrSwapchainImageBaseHeader* swapchainImage,
-                    int64_t swapchainFormat, const std::vector<Cube>& cubes) override {
-        CHECK(layerView.subImage.imageArrayIndex == 0);  // Texture arrays not supported.
+    // The device copies the data while creating the buffers, so a mapped mesh file goes straight into them.
+    uint32_t CreateMesh(const MeshData& mesh) {
+        MeshBuffers buffers;
+        const D3D11_SUBRESOURCE_DATA vertexBufferData{mesh.Vertices};
+        const CD3D11_BUFFER_DESC vertexBufferDesc((UINT)mesh.VertexBytes(), D3D11_BIND_VERTEX_BUFFER, D3D11_USAGE_IMMUTABLE);
+        CHECK_HRCMD(m_device->CreateBuffer(&vertexBufferDesc, &vertexBufferData, buffers.vertexBuffer.ReleaseAndGetAddressOf()));
+
+        const D3D11_SUBRESOURCE_DATA indexBufferData{mesh.Indices};
+        const CD3D11_BUFFER_DESC indexBufferDesc((UINT)mesh.IndexBytes(), D3D11_BIND_INDEX_BUFFER, D3D11_USAGE_IMMUTABLE);
+        CHECK_HRCMD(m_device->CreateBuffer(&indexBufferDesc, &indexBufferData, buffers.indexBuffer.ReleaseAndGetAddressOf()));
+
+        buffers.lods = mesh.Lods;
+        buffers.indexFormat = mesh.IndexSize == sizeof(uint32_t) ? DXGI_FORMAT_R32_UINT : DXGI_FORMAT_R16_UINT;
+        m_meshes.push_back(buffers);
+        return (uint32_t)m_meshes.size() - 1;
+    }
+
+    // Write the model matrix of every cube into the per-instance vertex buffer, growing it as needed, and keep the draws.
+    void UploadInstances(const std::vector<XrMatrix4x4f>& cubeModels, const std::vector<MeshDraw>& meshDraws) {
+        // Every render call starts here, so this is where the first frame waits for the shaders and the cube
+        m_startupJobs.Wait();
+        m_meshDraws = meshDraws;
+        m_instanceCount = (UINT)cubeModels.size();
+        if (m_instanceCount == 0) {
+            return;
+        }
+
+        if (m_instanceCount > m_instanceCapacity) {
+            m_instanceCapacity = std::max(m_instanceCount, m_instanceCapacity * 2);
+            const CD3D11_BUFFER_DESC instanceBufferDesc(m_instanceCapacity * sizeof(InstanceData), D3D11_BIND_VERTEX_BUFFER,
+                                                        D3D11_USAGE_DYNAMIC, D3D11_CPU_ACCESS_WRITE);
+            CHECK_HRCMD(m_device->CreateBuffer(&instanceBufferDesc, nullptr, m_instanceBuffer.ReleaseAndGetAddressOf()));
+        }
+
+        D3D11_MAPPED_SUBRESOURCE mapped;
+        CHECK_HRCMD(m_deviceContext->Map(m_instanceBuffer.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped));
+        InstanceData* const instances = reinterpret_cast<InstanceData*>(mapped.pData);
+        for (size_t i = 0; i < cubeModels.size(); ++i) {
+            XMStoreFloat4x4(&instances[i].Model, ComputeModel(cubeModels[i]));
+        }
+        m_deviceContext->Unmap(m_instanceBuffer.Get(), 0);
+    }
+
+    // Draw the uploaded cubes with their meshes, each one instancesPerCube times. Shaders and render targets must already be
+    // bound. Only reads plugin state, so it can record into deferred contexts on several threads at once.
+    void DrawCubes(ID3D11DeviceContext* context, ID3D11InputLayout* inputLayout, UINT instancesPerCube) const {
+        if (m_instanceCount == 0) {
+            return;
+        }
+
+        context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+        context->IASetInputLayout(inputLayout);
+
+        // The instance stream is pointed at the first model of each draw, which leaves SV_InstanceID starting at 0.
+        const UINT strides[] = {sizeof(Geometry::Vertex), sizeof(InstanceData)};
+        UINT offsets[] = {0, 0};
+        UINT firstInstance = 0;
+        for (const MeshDraw& draw : m_meshDraws) {
+            const MeshBuffers& mesh = m_meshes[draw.Mesh];
+            const MeshLod& lod = mesh.lods[draw.Lod];
+            offsets[InstanceDataSlot] = firstInstance * sizeof(InstanceData);
+            ID3D11Buffer* vertexBuffers[] = {mesh.vertexBuffer.Get(), m_instanceBuffer.Get()};
+            context->IASetVertexBuffers(0, (UINT)ArraySize(vertexBuffers), vertexBuffers, strides, offsets);
+            context->IASetIndexBuffer(mesh.indexBuffer.Get(), mesh.indexFormat, 0);
+
+            if (m_instancing) {
+                context->DrawIndexedInstanced(lod.IndexCount, draw.InstanceCount * instancesPerCube, lod.FirstIndex, 0, 0);
+            } else {
+                // One draw per cube, kept as a baseline to compare against. Point the instance stream at each cube in turn.
+                for (UINT i = 0; i < draw.InstanceCount; ++i) {
+                    offsets[InstanceDataSlot] = (firstInstance + i) * sizeof(InstanceData);
+                    context->IASetVertexBuffers(InstanceDataSlot, 1, &vertexBuffers[InstanceDataSlot], &strides[InstanceDataSlot],
+                                                &offsets[InstanceDataSlot]);
+                    context->DrawIndexedInstanced(lod.IndexCount, instancesPerCube, lod.FirstIndex, 0, 0);
+                }
+            }
+            firstInstance += draw.InstanceCount;
+        }
+    }
+
+    void RenderView(const XrCompositionLayerProjectionView& layerView, const SwapchainImage& swapchainImage,
+                    int64_t /*swapchainFormat*/, const std::vector<XrMatrix4x4f>& cubeModels,
+                    const std::vector<MeshDraw>& meshDraws) override {
+        UploadInstances(cubeModels, meshDraws);
+        RenderUploadedCubes(m_deviceContext.Get(), layerView, swapchainImage);
+    }
+
+    void RenderViews(const std::vector<XrCompositionLayerProjectionView>& layerViews,
+                     const std::vector<SwapchainImage>& swapchainImages, int64_t /*swapchainFormat*/,
+                     const std::vector<XrMatrix4x4f>& cubeModels, const std::vector<MeshDraw>& meshDraws) override {
+        CHECK(layerViews.size() == swapchainImages.size());
+
+        BeginGpuTimerFrame();
+
+        // The cubes are the same for every view, upload them once.
+        UploadInstances(cubeModels, meshDraws);
+        if (m_parallelViews && layerViews.size() > 1) {
+            RenderViewsDeferred(layerViews, swapchainImages);
+        } else {
+            for (size_t i = 0; i < layerViews.size(); ++i) {
+                BeginGpuViewTimer();
+                RenderUploadedCubes(m_deviceContext.Get(), layerViews[i], swapchainImages[i]);
+                EndGpuViewTimer();
+            }
+        }
+
+        EndGpuTimerFrame();
+    }
+
+    // Record each view into a deferred context of its own on the job system, then execute the command lists on the
+    // immediate context in view order. Views created on first use are looked up on this thread first.
+    void RenderViewsDeferred(const std::vector<XrCompositionLayerProjectionView>& layerViews,
+                             const std::vector<SwapchainImage>& swapchainImages) {
+        const uint32_t viewCount = (uint32_t)layerViews.size();
+        CHECK_MSG(viewCount <= MaxDeferredViews, Fmt("Up to %u views are supported, not %u", MaxDeferredViews, viewCount));
+
+        while (m_deferredContexts.size() < viewCount) {
+            m_deferredContexts.emplace_back();
+            CHECK_HRCMD(m_device->CreateDeferredContext(0, m_deferredContexts.back().ReleaseAndGetAddressOf()));
+        }
+        for (uint32_t view = 0; view < viewCount; ++view) {
+            GetRenderTargetView(swapchainImages[view]);
+            GetDepthStencilView(swapchainImages[view]);
+        }
+
+        std::array<ComPtr<ID3D11CommandList>, MaxDeferredViews> commandLists;
+        GetJobSystem().ParallelFor(viewCount, [&](uint32_t view) {
+            ID3D11DeviceContext* const deferredContext = m_deferredContexts[view].Get();
+            RenderUploadedCubes(deferredContext, layerViews[view], swapchainImages[view]);
+            CHECK_HRCMD(deferredContext->FinishCommandList(FALSE, commandLists[view].ReleaseAndGetAddressOf()));
+        });
+
+        for (uint32_t view = 0; view < viewCount; ++view) {
+            BeginGpuViewTimer();
+            m_deviceContext->ExecuteCommandList(commandLists[view].Get(), FALSE);
+            EndGpuViewTimer();
+        }
+    }
 
-        ID3D11Texture2D* const colorTexture = reinterpret_cast<const XrSwapchainImageD3D11KHR*>(swapchainImage)->texture;
+    // Record the uploaded cubes into the swapchain image of a view. Outside of RenderViewsDeferred, context is the immediate
+    // context; there the views are already created, so nothing but the deferred context is modified.
+    void RenderUploadedCubes(ID3D11DeviceContext* context, const XrCompositionLayerProjectionView& layerView,
+                             const SwapchainImage& swapchainImage) {
+        CHECK(layerView.subImage.imageArrayIndex == 0);  // Texture arrays not supported.
 
         CD3D11_VIEWPORT viewport((float)layerView.subImage.imageRect.offset.x, (float)layerView.subImage.imageRect.offset.y,
                                  (float)layerView.subImage.imageRect.extent.width,
                                  (float)layerView.subImage.imageRect.extent.height);
-        m_deviceContext->RSSetViewports(1, &viewport);
+        context->RSSetViewports(1, &viewport);
 
-        // Create RenderTargetView with original swapchain format (swapchain is typeless).
-        ComPtr<ID3D11RenderTargetView> renderTargetView;
-        const CD3D11_RENDER_TARGET_VIEW_DESC renderTargetViewDesc(D3D11_RTV_DIMENSION_TEXTURE2D, (DXGI_FORMAT)swapchainFormat);
-        CHECK_HRCMD(
-            m_device->CreateRenderTargetView(colorTexture, &renderTargetViewDesc, renderTargetView.ReleaseAndGetAddressOf()));
-
-        const ComPtr<ID3D11DepthStencilView> depthStencilView = GetDepthStencilView(colorTexture);
+        ID3D11RenderTargetView* const renderTargetView = GetRenderTargetView(swapchainImage);
+        ID3D11DepthStencilView* const depthStencilView = GetDepthStencilView(swapchainImage);
 
         // Clear swapchain and depth buffer. NOTE: This will clear the entire render target view, not just the specified view.
         // TODO: Do not clear to a color when using a pass-through view configuration.
-        m_deviceContext->ClearRenderTargetView(renderTargetView.Get(), DirectX::Colors::DarkSlateGray);
-        m_deviceContext->ClearDepthStencilView(depthStencilView.Get(), D3D11_CLEAR_DEPTH | D3D11_CLEAR_STENCIL, 1.0f, 0);
-
-        ID3D11RenderTargetView* renderTargets[] = {renderTargetView.Get()};
-        m_deviceContext->OMSetRenderTargets((UINT)ArraySize(renderTargets), renderTargets, depthStencilView.Get());
+        context->ClearRenderTargetView(renderTargetView, DirectX::Colors::DarkSlateGray);
+        context->ClearDepthStencilView(depthStencilView, D3D11_CLEAR_DEPTH | D3D11_CLEAR_STENCIL, 1.0f, 0);
 
-        const XMMATRIX spaceToView = XMMatrixInverse(nullptr, LoadXrPose(layerView.pose));
-        XrMatrix4x4f projectionMatrix;
-        XrMatrix4x4f_CreateProjectionFov(&projectionMatrix, GRAPHICS_D3D, layerView.fov, 0.05f, 100.0f);
+        ID3D11RenderTargetView* renderTargets[] = {renderTargetView};
+        context->OMSetRenderTargets((UINT)ArraySize(renderTargets), renderTargets, depthStencilView);
 
-        // Set shaders and constant buffers.
+        // Set shaders and constant buffers. Deferred contexts record the update, so each view still sees its own constants.
         ViewProjectionConstantBuffer viewProjection;
-        XMStoreFloat4x4(&viewProjection.ViewProjection, XMMatrixTranspose(spaceToView * LoadXrMatrix(projectionMatrix)));
-        m_deviceContext->UpdateSubresource(m_viewProjectionCBuffer.Get(), 0, nullptr, &viewProjection, 0, 0);
-
-        ID3D11Buffer* const constantBuffers[] = {m_modelCBuffer.Get(), m_viewProjectionCBuffer.Get()};
-        m_deviceContext->VSSetConstantBuffers(0, (UINT)ArraySize(constantBuffers), constantBuffers);
-        m_deviceContext->VSSetShader(m_vertexShader.Get(), nullptr, 0);
-        m_deviceContext->PSSetShader(m_pixelShader.Get(), nullptr, 0);
-
-        // Set cube primitive data.
-        const UINT strides[] = {sizeof(Geometry::Vertex)};
-        const UINT offsets[] = {0};
-        ID3D11Buffer* vertexBuffers[] = {m_cubeVertexBuffer.Get()};
-        m_deviceContext->IASetVertexBuffers(0, (UINT)ArraySize(vertexBuffers), vertexBuffers, strides, offsets);
-        m_deviceContext->IASetIndexBuffer(m_cubeIndexBuffer.Get(), DXGI_FORMAT_R16_UINT, 0);
-        m_deviceContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-        m_deviceContext->IASetInputLayout(m_inputLayout.Get());
-
-        // Render each cube
-        for (const Cube& cube : cubes) {
-            // Compute and update the model transform.
-            ModelConstantBuffer model;
-            XMStoreFloat4x4(&model.Model,
-                            XMMatrixTranspose(XMMatrixScaling(cube.Scale.x, cube.Scale.y, cube.Scale.z) * LoadXrPose(cube.Pose)));
-            m_deviceContext->UpdateSubresource(m_modelCBuffer.Get(), 0, nullptr, &model, 0, 0);
-
-            // Draw the cube.
-            m_deviceContext->DrawIndexed((UINT)ArraySize(Geometry::c_cubeIndices), 0, 0);
+        XMStoreFloat4x4(&viewProjection.ViewProjection, ComputeViewProjection(layerView));
+        context->UpdateSubresource(m_viewProjectionCBuffer.Get(), 0, nullptr, &viewProjection, 0, 0);
+
+        ID3D11Buffer* const constantBuffers[] = {m_viewProjectionCBuffer.Get()};
+        context->VSSetConstantBuffers(1, (UINT)ArraySize(constantBuffers), constantBuffers);
+        context->VSSetShader(m_vertexShader.Get(), nullptr, 0);
+        context->PSSetShader(m_pixelShader.Get(), nullptr, 0);
+
+        DrawCubes(context, m_inputLayout.Get(), 1);
+    }
+
+    bool SupportsMultiview() const override { return m_multiviewSupported; }
+
+    void RenderMultiview(const std::vector<XrCompositionLayerProjectionView>& layerViews,
+                         const SwapchainImage& swapchainImage, int64_t /*swapchainFormat*/,
+                         const std::vector<XrMatrix4x4f>& cubeModels, const std::vector<MeshDraw>& meshDraws) override {
+        CHECK(m_multiviewSupported);
+        CHECK(layerViews.size() == 2);  // The multiview shader holds one view-projection per eye.
+
+        // Both views are drawn together, so they share one timer.
+        BeginGpuTimerFrame();
+        BeginGpuViewTimer();
+
+        // All views share the same image rect, only the array slice differs.
+        const XrRect2Di& imageRect = layerViews[0].subImage.imageRect;
+        CD3D11_VIEWPORT viewport((float)imageRect.offset.x, (float)imageRect.offset.y, (float)imageRect.extent.width,
+                                 (float)imageRect.extent.height);
+        m_deviceContext->RSSetViewports(1, &viewport);
+
+        // The render target view covers every array slice.
+        ID3D11RenderTargetView* const renderTargetView = GetRenderTargetView(swapchainImage);
+        ID3D11DepthStencilView* const depthStencilView = GetDepthStencilView(swapchainImage);
+
+        // Clear swapchain and depth buffer, this clears every view.
+        m_deviceContext->ClearRenderTargetView(renderTargetView, DirectX::Colors::DarkSlateGray);
+        m_deviceContext->ClearDepthStencilView(depthStencilView, D3D11_CLEAR_DEPTH | D3D11_CLEAR_STENCIL, 1.0f, 0);
+
+        ID3D11RenderTargetView* renderTargets[] = {renderTargetView};
+        m_deviceContext->OMSetRenderTargets((UINT)ArraySize(renderTargets), renderTargets, depthStencilView);
+
+        MultiviewViewProjectionConstantBuffer viewProjection;
+        for (size_t view = 0; view < ArraySize(viewProjection.ViewProjection); ++view) {
+            CHECK(layerViews[view].subImage.imageArrayIndex == view);
+            XMStoreFloat4x4(&viewProjection.ViewProjection[view], ComputeViewProjection(layerViews[view]));
         }
+        m_deviceContext->UpdateSubresource(m_multiviewViewProjectionCBuffer.Get(), 0, nullptr, &viewProjection, 0, 0);
+
+        ID3D11Buffer* const constantBuffers[] = {m_multiviewViewProjectionCBuffer.Get()};
+        m_deviceContext->VSSetConstantBuffers(1, (UINT)ArraySize(constantBuffers), constantBuffers);
+        m_deviceContext->VSSetShader(m_multiviewVertexShader.Get(), nullptr, 0);
+        m_deviceContext->PSSetShader(m_multiviewPixelShader.Get(), nullptr, 0);
+
+        // Every cube is drawn once per view.
+        UploadInstances(cubeModels, meshDraws);
+        DrawCubes(m_deviceContext.Get(), m_multiviewInputLayout.Get(), (UINT)layerViews.size());
+
+        EndGpuViewTimer();
+        EndGpuTimerFrame();
     }
 
    private:
     ComPtr<ID3D11Device> m_device;
+    LUID m_adapterLuid{};  // Adapter the device was created for
     ComPtr<ID3D11DeviceContext> m_deviceContext;
     XrGraphicsBindingD3D11KHR m_graphicsBinding{XR_TYPE_GRAPHICS_BINDING_D3D11_KHR};
-    std::list<std::vector<XrSwapchainImageD3D11KHR>> m_swapchainImageBuffers;
+    std::vector<std::unique_ptr<SwapchainImageContext>> m_swapchainImageContexts;  // Indexed by SwapchainImage::swapchainIndex.
+    ComPtr<ID3DBlob> m_vertexShaderBytes;  // Set by PrepareResources
+    ComPtr<ID3DBlob> m_pixelShaderBytes;
+    ComPtr<ID3DBlob> m_multiviewVertexShaderBytes;
+    ComPtr<ID3DBlob> m_multiviewPixelShaderBytes;
     ComPtr<ID3D11VertexShader> m_vertexShader;
     ComPtr<ID3D11PixelShader> m_pixelShader;
     ComPtr<ID3D11InputLayout> m_inputLayout;
-    ComPtr<ID3D11Buffer> m_modelCBuffer;
+    ComPtr<ID3D11Buffer> m_instanceBuffer;
+    UINT m_instanceCapacity{0};
+    UINT m_instanceCount{0};
     ComPtr<ID3D11Buffer> m_viewProjectionCBuffer;
-    ComPtr<ID3D11Buffer> m_cubeVertexBuffer;
-    ComPtr<ID3D11Buffer> m_cubeIndexBuffer;
 
-    // Map color buffer to associated depth buffer. This map is populated on demand.
-    std::map<ID3D11Texture2D*, ComPtr<ID3D11DepthStencilView>> m_colorToDepthMap;
+    // GPU copy of a mesh added with AddMesh.
+    struct MeshBuffers {
+        ComPtr<ID3D11Buffer> vertexBuffer;
+        ComPtr<ID3D11Buffer> indexBuffer;
+        std::array<MeshLod, MaxMeshLods> lods{};  // Index ranges
+        DXGI_FORMAT indexFormat{DXGI_FORMAT_R16_UINT};
+    };
+    std::vector<MeshBuffers> m_meshes;  // Indexed by mesh ID
+    std::vector<MeshDraw> m_meshDraws;  // Set by UploadInstances for the current render call
+    bool m_multiviewSupported{false};
+    ComPtr<ID3D11VertexShader> m_multiviewVertexShader;
+    ComPtr<ID3D11PixelShader> m_multiviewPixelShader;
+    ComPtr<ID3D11Buffer> m_multiviewViewProjectionCBuffer;
+    ComPtr<ID3D11InputLayout> m_multiviewInputLayout;
+    const std::string m_cacheDirectory;
+    const bool m_instancing;
+    const bool m_parallelViews;                                  // Record the views of RenderViews on deferred contexts
+    std::vector<ComPtr<ID3D11DeviceContext>> m_deferredContexts;  // One per view, made on first use
+
+    // Timestamps bracketing each view, inside a disjoint query that supplies the tick frequency.
+    struct GpuTimerFrame {
+        ComPtr<ID3D11Query> disjoint;
+        std::array<ComPtr<ID3D11Query>, 2 * MaxGpuTimerViews> timestamps;
+        GpuTimedViews TimedViews;
+        bool disjointActive{false};
+    };
+    const bool m_gpuTimers;
+    GpuTimerRing<GpuTimerFrame> m_gpuTimerFrames;
+    GpuViewTimes m_gpuViewTimes;
+
+    JobGraph m_startupJobs;  // Declared last, so it is cancelled before anything its jobs use is destroyed
 };
 }  // namespace
 
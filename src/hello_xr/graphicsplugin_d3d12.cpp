@@ -6,10 +6,16 @@
 #include "common.h"
 #include "geometry.h"
 #include "graphicsplugin.h"
+#include "options.h"
+#include "jobsystem.h"
+#include "gputimers.h"
+#include "startup.h"
 
 #if defined(XR_USE_GRAPHICS_API_D3D12) && !defined(MISSING_DIRECTX_COLORS)
 
 #include <common/xr_linear.h>
+#include <array>
+#include <tuple>
 #include <DirectXColors.h>
 #include <D3Dcompiler.h>
 
@@ -41,6 +47,8 @@ ComPtr<ID3D12Resource> CreateBuffer(ID3D12Device* d3d12Device, uint32_t size, D3
     if (heapType == D3D12_HEAP_TYPE_UPLOAD) {
         d3d12ResourceState = D3D12_RESOURCE_STATE_GENERIC_READ;
         size = AlignTo<D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT>(size);
+    } else if (heapType == D3D12_HEAP_TYPE_READBACK) {
+        d3d12ResourceState = D3D12_RESOURCE_STATE_COPY_DEST;
     } else {
         d3d12ResourceState = D3D12_RESOURCE_STATE_COMMON;
     }
@@ -70,10 +78,97 @@ ComPtr<ID3D12Resource> CreateBuffer(ID3D12Device* d3d12Device, uint32_t size, D3
     return buffer;
 }
 
+// A persistently mapped upload heap that is handed out linearly and wraps around. Allocations made for a submission are
+// tagged with the fence value signaled after it, and their space is reused once the GPU has passed that value.
+class UploadRing {
+   public:
+    struct Allocation {
+        uint8_t* CpuAddress;
+        D3D12_GPU_VIRTUAL_ADDRESS GpuAddress;
+    };
+
+    // (Re)create the ring. A buffer that may still be read by submitted work is kept alive until pendingFenceValue passes.
+    void Create(ID3D12Device* d3d12Device, uint32_t size, uint64_t pendingFenceValue) {
+        if (m_buffer) {
+            m_retiredBuffers.emplace_back(pendingFenceValue, std::move(m_buffer));
+        }
+
+        m_buffer = CreateBuffer(d3d12Device, size, D3D12_HEAP_TYPE_UPLOAD);
+        m_size = m_buffer->GetDesc().Width;
+        const D3D12_RANGE readRange{0, 0};
+        CHECK_HRCMD(m_buffer->Map(0, &readRange, reinterpret_cast<void**>(&m_cpuBase)));
+        m_gpuBase = m_buffer->GetGPUVirtualAddress();
+        m_head = 0;
+        m_tail = 0;
+        m_frames.clear();
+    }
+
+    uint64_t Size() const { return m_size; }
+
+    // Free the space of every submission the GPU has finished with.
+    void Retire(uint64_t completedFenceValue) {
+        while (!m_frames.empty() && m_frames.front().FenceValue <= completedFenceValue) {
+            m_tail = m_frames.front().End;
+            m_frames.pop_front();
+        }
+        while (!m_retiredBuffers.empty() && m_retiredBuffers.front().first <= completedFenceValue) {
+            m_retiredBuffers.pop_front();
+        }
+    }
+
+    // Offsets grow monotonically; only their value modulo the ring size is an address.
+    bool TryAllocate(uint64_t size, uint64_t alignment, Allocation& allocation) {
+        uint64_t head = (m_head + alignment - 1) & ~(alignment - 1);
+        if ((head % m_size) + size > m_size) {
+            head += m_size - (head % m_size);  // Does not fit before the end of the buffer, skip to the start.
+        }
+        if (head + size - m_tail > m_size) {
+            return false;
+        }
+
+        const uint64_t offset = head % m_size;
+        allocation = {m_cpuBase + offset, m_gpuBase + offset};
+        m_head = head + size;
+        return true;
+    }
+
+    // Tag everything allocated since the previous submission with the fence value that signals its completion.
+    void EndFrame(uint64_t fenceValue) {
+        const uint64_t frameBegin = m_frames.empty() ? m_tail : m_frames.back().End;
+        if (m_head != frameBegin) {
+            m_frames.push_back({fenceValue, m_head});
+        }
+    }
+
+    // The fence value that frees the oldest submission, or 0 when nothing is in flight.
+    uint64_t OldestFenceValue() const { return m_frames.empty() ? 0 : m_frames.front().FenceValue; }
+
+   private:
+    struct Frame {
+        uint64_t FenceValue;
+        uint64_t End;
+    };
+
+    ComPtr<ID3D12Resource> m_buffer;
+    uint8_t* m_cpuBase{nullptr};
+    D3D12_GPU_VIRTUAL_ADDRESS m_gpuBase{0};
+    uint64_t m_size{0};
+    uint64_t m_head{0};
+    uint64_t m_tail{0};
+    std::deque<Frame> m_frames;
+    std::deque<std::pair<uint64_t, ComPtr<ID3D12Resource>>> m_retiredBuffers;
+};
+
+// The images of one swapchain, with a descriptor for each of them that is written the first time the image is rendered, as
+// the textures are only known once the runtime enumerated them. Color swapchains hold a render target view per image and a
+// depth stencil view of their private depth texture, depth swapchains a depth stencil view per image.
 class SwapchainImageContext {
    public:
-    std::vector<XrSwapchainImageBaseHeader*> Create(ID3D12Device* d3d12Device, uint32_t capacity) {
+    std::vector<XrSwapchainImageBaseHeader*> Create(ID3D12Device* d3d12Device, uint32_t capacity,
+                                                    const XrSwapchainCreateInfo& swapchainCreateInfo, FoveationLevel foveation) {
         m_d3d12Device = d3d12Device;
+        m_foveation = foveation;
+        m_format = (DXGI_FORMAT)swapchainCreateInfo.format;
 
         m_swapchainImages.resize(capacity);
         std::vector<XrSwapchainImageBaseHeader*> bases(capacity);
@@ -82,17 +177,71 @@ class SwapchainImageContext {
             bases[i] = reinterpret_cast<XrSwapchainImageBaseHeader*>(&m_swapchainImages[i]);
         }
 
-        CHECK_HRCMD(m_d3d12Device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT, __uuidof(ID3D12CommandAllocator),
-                                                          reinterpret_cast<void**>(m_commandAllocator.ReleaseAndGetAddressOf())));
-
-        m_viewProjectionCBuffer = CreateBuffer(m_d3d12Device, sizeof(ViewProjectionConstantBuffer), D3D12_HEAP_TYPE_UPLOAD);
+        const bool depth = (swapchainCreateInfo.usageFlags & XR_SWAPCHAIN_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT) != 0;
+        if (!depth) {
+            m_rtvHeap = CreateDescriptorHeap(D3D12_DESCRIPTOR_HEAP_TYPE_RTV, capacity);
+            m_rtvDescriptorSize = m_d3d12Device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_RTV);
+        }
+        m_dsvHeap = CreateDescriptorHeap(D3D12_DESCRIPTOR_HEAP_TYPE_DSV, depth ? capacity : 1);
+        m_dsvDescriptorSize = m_d3d12Device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_DSV);
+        m_descriptorWritten.resize(capacity, false);
 
         return bases;
     }
 
-    uint32_t ImageIndex(const XrSwapchainImageBaseHeader* swapchainImageHeader) {
-        auto p = reinterpret_cast<const XrSwapchainImageD3D12KHR*>(swapchainImageHeader);
-        return (uint32_t)(p - &m_swapchainImages[0]);
+    // The color or, for a depth swapchain, depth texture of an image.
+    ID3D12Resource* Texture(uint32_t imageIndex) const { return m_swapchainImages[imageIndex].texture; }
+
+    FoveationLevel Foveation() const { return m_foveation; }
+
+    // Render target view of a color swapchain image, in the swapchain's format since the textures are typeless.
+    D3D12_CPU_DESCRIPTOR_HANDLE RenderTargetView(uint32_t imageIndex) {
+        D3D12_CPU_DESCRIPTOR_HANDLE handle = m_rtvHeap->GetCPUDescriptorHandleForHeapStart();
+        handle.ptr += imageIndex * m_rtvDescriptorSize;
+        if (!m_descriptorWritten[imageIndex]) {
+            ID3D12Resource* const colorTexture = Texture(imageIndex);
+            const D3D12_RESOURCE_DESC colorTextureDesc = colorTexture->GetDesc();
+            D3D12_RENDER_TARGET_VIEW_DESC renderTargetViewDesc{};
+            renderTargetViewDesc.Format = m_format;
+            if (colorTextureDesc.DepthOrArraySize > 1) {
+                if (colorTextureDesc.SampleDesc.Count > 1) {
+                    renderTargetViewDesc.ViewDimension = D3D12_RTV_DIMENSION_TEXTURE2DMSARRAY;
+                    renderTargetViewDesc.Texture2DMSArray.ArraySize = colorTextureDesc.DepthOrArraySize;
+                } else {
+                    renderTargetViewDesc.ViewDimension = D3D12_RTV_DIMENSION_TEXTURE2DARRAY;
+                    renderTargetViewDesc.Texture2DArray.ArraySize = colorTextureDesc.DepthOrArraySize;
+                }
+            } else {
+                if (colorTextureDesc.SampleDesc.Count > 1) {
+                    renderTargetViewDesc.ViewDimension = D3D12_RTV_DIMENSION_TEXTURE2DMS;
+                } else {
+                    renderTargetViewDesc.ViewDimension = D3D12_RTV_DIMENSION_TEXTURE2D;
+                }
+            }
+            m_d3d12Device->CreateRenderTargetView(colorTexture, &renderTargetViewDesc, handle);
+            m_descriptorWritten[imageIndex] = true;
+        }
+        return handle;
+    }
+
+    // Depth stencil view of a depth swapchain image.
+    D3D12_CPU_DESCRIPTOR_HANDLE DepthStencilView(uint32_t imageIndex) {
+        D3D12_CPU_DESCRIPTOR_HANDLE handle = m_dsvHeap->GetCPUDescriptorHandleForHeapStart();
+        handle.ptr += imageIndex * m_dsvDescriptorSize;
+        if (!m_descriptorWritten[imageIndex]) {
+            WriteDepthStencilView(Texture(imageIndex), handle);
+            m_descriptorWritten[imageIndex] = true;
+        }
+        return handle;
+    }
+
+    // Depth stencil view of the depth texture that every image of a color swapchain shares, created to match colorTexture.
+    D3D12_CPU_DESCRIPTOR_HANDLE PrivateDepthStencilView(ID3D12Resource* colorTexture) {
+        const D3D12_CPU_DESCRIPTOR_HANDLE handle = m_dsvHeap->GetCPUDescriptorHandleForHeapStart();
+        if (!m_depthStencilTexture) {
+            WriteDepthStencilView(GetDepthStencilTexture(colorTexture), handle);
+        }
+        return handle;
     }
 
     ID3D12Resource* GetDepthStencilTexture(ID3D12Resource* colorTexture) {
@@ -130,39 +279,109 @@ class SwapchainImageContext {
         return m_depthStencilTexture.Get();
     }
 
-    ID3D12CommandAllocator* GetCommandAllocator() const { return m_commandAllocator.Get(); }
-
-    uint64_t GetFrameFenceValue() const { return m_fenceValue; }
-    void SetFrameFenceValue(uint64_t fenceValue) { m_fenceValue = fenceValue; }
-
-    void ResetCommandAllocator() { CHECK_HRCMD(m_commandAllocator->Reset()); }
+   private:
+    ComPtr<ID3D12DescriptorHeap> CreateDescriptorHeap(D3D12_DESCRIPTOR_HEAP_TYPE type, uint32_t count) const {
+        D3D12_DESCRIPTOR_HEAP_DESC heapDesc{};
+        heapDesc.NumDescriptors = count;
+        heapDesc.Type = type;
+        heapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_NONE;
+        ComPtr<ID3D12DescriptorHeap> heap;
+        CHECK_HRCMD(m_d3d12Device->CreateDescriptorHeap(&heapDesc, __uuidof(ID3D12DescriptorHeap),
+                                                        reinterpret_cast<void**>(heap.ReleaseAndGetAddressOf())));
+        return heap;
+    }
 
-    void RequestModelCBuffer(uint32_t requiredSize) {
-        if (!m_modelCBuffer || (requiredSize > m_modelCBuffer->GetDesc().Width)) {
-            m_modelCBuffer = CreateBuffer(m_d3d12Device, requiredSize, D3D12_HEAP_TYPE_UPLOAD);
+    void WriteDepthStencilView(ID3D12Resource* depthStencilTexture, D3D12_CPU_DESCRIPTOR_HANDLE handle) const {
+        const D3D12_RESOURCE_DESC depthStencilTextureDesc = depthStencilTexture->GetDesc();
+        D3D12_DEPTH_STENCIL_VIEW_DESC depthStencilViewDesc{};
+        depthStencilViewDesc.Format = DXGI_FORMAT_D32_FLOAT;
+        if (depthStencilTextureDesc.DepthOrArraySize > 1) {
+            if (depthStencilTextureDesc.SampleDesc.Count > 1) {
+                depthStencilViewDesc.ViewDimension = D3D12_DSV_DIMENSION_TEXTURE2DMSARRAY;
+                depthStencilViewDesc.Texture2DMSArray.ArraySize = depthStencilTextureDesc.DepthOrArraySize;
+            } else {
+                depthStencilViewDesc.ViewDimension = D3D12_DSV_DIMENSION_TEXTURE2DARRAY;
+                depthStencilViewDesc.Texture2DArray.ArraySize = depthStencilTextureDesc.DepthOrArraySize;
+            }
+        } else {
+            if (depthStencilTextureDesc.SampleDesc.Count > 1) {
+                depthStencilViewDesc.ViewDimension = D3D12_DSV_DIMENSION_TEXTURE2DMS;
+            } else {
+                depthStencilViewDesc.ViewDimension = D3D12_DSV_DIMENSION_TEXTURE2D;
+            }
         }
+        m_d3d12Device->CreateDepthStencilView(depthStencilTexture, &depthStencilViewDesc, handle);
     }
 
-    ID3D12Resource* GetModelCBuffer() const { return m_modelCBuffer.Get(); }
-    ID3D12Resource* GetViewProjectionCBuffer() const { return m_viewProjectionCBuffer.Get(); }
-
-   private:
     ID3D12Device* m_d3d12Device{nullptr};
+    FoveationLevel m_foveation{FoveationLevel::Off};  // Rendered with a shading-rate image unless off
+    DXGI_FORMAT m_format{DXGI_FORMAT_UNKNOWN};
 
     std::vector<XrSwapchainImageD3D12KHR> m_swapchainImages;
-    ComPtr<ID3D12CommandAllocator> m_commandAllocator;
     ComPtr<ID3D12Resource> m_depthStencilTexture;
-    ComPtr<ID3D12Resource> m_modelCBuffer;
-    ComPtr<ID3D12Resource> m_viewProjectionCBuffer;
-    uint64_t m_fenceValue = 0;
+    ComPtr<ID3D12DescriptorHeap> m_rtvHeap;  // One per image, color swapchains only
+    ComPtr<ID3D12DescriptorHeap> m_dsvHeap;  // One per image for depth swapchains, one for the private depth texture otherwise
+    UINT m_rtvDescriptorSize{0};
+    UINT m_dsvDescriptorSize{0};
+    std::vector<bool> m_descriptorWritten;  // Per image
+};
+
+// Number of submissions that can be queued on the GPU before recording blocks on the oldest one.
+constexpr uint32_t FramesInFlight = 3;
+
+// Each GPU timed view is bracketed by a pair of timestamp queries.
+constexpr uint32_t TimestampsPerFrame = 2 * MaxGpuTimerViews;
+
+// Views rendered in one submission.
+constexpr uint32_t MaxViews = 4;
+
+// A command allocator and the command list recorded from it.
+struct CommandListContext {
+    ComPtr<ID3D12CommandAllocator> CommandAllocator;
+    ComPtr<ID3D12GraphicsCommandList> CommandList;
+#if defined(__ID3D12GraphicsCommandList5_INTERFACE_DEFINED__)
+    ComPtr<ID3D12GraphicsCommandList5> CommandList5;  // The same list, only queried when the device has tier 2 VRS
+#endif
 };
 
-struct D3D12GraphicsPlugin : public IGraphicsPlugin {
-    D3D12GraphicsPlugin(const std::shared_ptr<Options>&, std::shared_ptr<IPlatformPlugin>)
-        : m_vertexShaderBytes(CompileShader(ShaderHlsl, "MainVS", "vs_5_1")),
-          m_pixelShaderBytes(CompileShader(ShaderHlsl, "MainPS", "ps_5_1")) {}
+// The command lists of one submission, all reused once the GPU has passed FenceValue.
+struct FrameContext : CommandListContext {
+    std::vector<CommandListContext> ViewCommandLists;  // One per view when views are recorded in parallel, made on first use
+    uint64_t FenceValue{0};
+    GpuTimedViews TimedViews;  // Views timed in the last recording, their timestamps are resolved to the readback buffer
+};
+
+// What RecordView needs that is created or allocated on first use. It is looked up before recording, on the thread that owns
+// the plugin, so that the recording itself can run on any thread.
+struct ViewTargets {
+    ID3D12PipelineState* PipelineState{nullptr};
+    D3D12_CPU_DESCRIPTOR_HANDLE RenderTargetView{};
+    D3D12_CPU_DESCRIPTOR_HANDLE DepthStencilView{};
+    ID3D12Resource* ShadingRateImage{nullptr};  // Null without foveation
+    D3D12_GPU_VIRTUAL_ADDRESS ViewProjection{0};
+    uint8_t* ViewProjectionData{nullptr};  // The same constants in mapped upload memory, rewritten when late latching
+};
 
-    ~D3D12GraphicsPlugin() override { CloseHandle(m_fenceEvent); }
+struct D3D12GraphicsPlugin final : public IGraphicsPlugin {
+    D3D12GraphicsPlugin(const std::shared_ptr<Options>& options, std::shared_ptr<IPlatformPlugin>)
+        : m_cacheDirectory(options->CacheDirectory),
+          m_instancing(options->Instancing),
+          m_parallelViews(options->ParallelViews && GetJobSystem().WorkerCount() > 0),
+          m_gpuTimers(options->FrameStats || options->DynamicResolution) {}
+
+    ~D3D12GraphicsPlugin() override {
+        m_startupJobs.Cancel();
+        CloseHandle(m_fenceEvent);
+    }
+
+    // Compile the HLSL, which needs no device. The multiview shaders are always built since support is only known once the
+    // device exists.
+    void PrepareResources() override {
+        m_vertexShaderBytes = CompileShader(ShaderHlsl, "MainVS", "vs_5_1", m_cacheDirectory);
+        m_pixelShaderBytes = CompileShader(ShaderHlsl, "MainPS", "ps_5_1", m_cacheDirectory);
+        m_multiviewVertexShaderBytes = CompileShader(MultiviewShaderHlsl, "MainVS", "vs_5_1", m_cacheDirectory);
+        m_multiviewPixelShaderBytes = CompileShader(MultiviewShaderHlsl, "MainPS", "ps_5_1", m_cacheDirectory);
+    }
 
     std::vector<std::string> GetInstanceExtensions() const override { return {XR_KHR_D3D12_ENABLE_EXTENSION_NAME}; }
 
@@ -175,6 +394,7 @@ struct D3D12GraphicsPlugin : public IGraphicsPlugin {
         XrGraphicsRequirementsD3D12KHR graphicsRequirements{XR_TYPE_GRAPHICS_REQUIREMENTS_D3D12_KHR};
         CHECK_XRCMD(pfnGetD3D12GraphicsRequirementsKHR(instance, systemId, &graphicsRequirements));
         const ComPtr<IDXGIAdapter1> adapter = GetAdapter(graphicsRequirements.adapterLuid);
+        m_adapterLuid = graphicsRequirements.adapterLuid;
 
         // Create a list of feature levels which are both supported by the OpenXR runtime and this application.
         InitializeD3D12DeviceForAdapter(adapter.Get(), graphicsRequirements.minFeatureLevel, m_device.ReleaseAndGetAddressOf());
@@ -185,39 +405,53 @@ struct D3D12GraphicsPlugin : public IGraphicsPlugin {
         CHECK_HRCMD(m_device->CreateCommandQueue(&queueDesc, __uuidof(ID3D12CommandQueue),
                                                  reinterpret_cast<void**>(m_cmdQueue.ReleaseAndGetAddressOf())));
 
+        // Single-pass stereo needs SV_RenderTargetArrayIndex from the vertex shader without geometry shader emulation.
+        D3D12_FEATURE_DATA_D3D12_OPTIONS options{};
+        m_multiviewSupported =
+            SUCCEEDED(m_device->CheckFeatureSupport(D3D12_FEATURE_D3D12_OPTIONS, &options, sizeof(options))) &&
+            options.VPAndRTArrayIndexFromAnyShaderFeedingRasterizerSupportedWithoutGSEmulation;
+
+#if defined(__ID3D12GraphicsCommandList5_INTERFACE_DEFINED__)
+        // Foveated shading needs tier 2 variable-rate shading for screen-space shading-rate images.
+        D3D12_FEATURE_DATA_D3D12_OPTIONS6 options6{};
+        if (SUCCEEDED(m_device->CheckFeatureSupport(D3D12_FEATURE_D3D12_OPTIONS6, &options6, sizeof(options6))) &&
+            options6.VariableShadingRateTier >= D3D12_VARIABLE_SHADING_RATE_TIER_2) {
+            m_shadingRateTileSize = options6.ShadingRateImageTileSize;
+            m_maxShadingRateLog2Size = options6.AdditionalShadingRatesSupported ? 2 : 1;
+        }
+        LOG_VERBOSE(Fmt("D3D12 tier 2 variable-rate shading %s", m_shadingRateTileSize != 0 ? "supported" : "not supported"));
+#endif
+
         InitializeResources();
 
         m_graphicsBinding.device = m_device.Get();
         m_graphicsBinding.queue = m_cmdQueue.Get();
     }
 
-    void InitializeResources() {
-        {
-            D3D12_DESCRIPTOR_HEAP_DESC heapDesc{};
-            heapDesc.NumDescriptors = 1;
-            heapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_RTV;
-            heapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_NONE;
-            CHECK_HRCMD(m_device->CreateDescriptorHeap(&heapDesc, __uuidof(ID3D12DescriptorHeap),
-                                                       reinterpret_cast<void**>(m_rtvHeap.ReleaseAndGetAddressOf())));
-        }
-        {
-            D3D12_DESCRIPTOR_HEAP_DESC heapDesc{};
-            heapDesc.NumDescriptors = 1;
-            heapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_DSV;
-            heapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_NONE;
-            CHECK_HRCMD(m_device->CreateDescriptorHeap(&heapDesc, __uuidof(ID3D12DescriptorHeap),
-                                                       reinterpret_cast<void**>(m_dsvHeap.ReleaseAndGetAddressOf())));
+    // Create a command allocator and a closed command list recorded from it.
+    void CreateCommandListContext(CommandListContext& commandList) {
+        CHECK_HRCMD(m_device->CreateCommandAllocator(
+            D3D12_COMMAND_LIST_TYPE_DIRECT, __uuidof(ID3D12CommandAllocator),
+            reinterpret_cast<void**>(commandList.CommandAllocator.ReleaseAndGetAddressOf())));
+        CHECK_HRCMD(m_device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT, commandList.CommandAllocator.Get(), nullptr,
+                                                __uuidof(ID3D12GraphicsCommandList),
+                                                reinterpret_cast<void**>(commandList.CommandList.ReleaseAndGetAddressOf())));
+        CHECK_HRCMD(commandList.CommandList->Close());
+#if defined(__ID3D12GraphicsCommandList5_INTERFACE_DEFINED__)
+        if (m_shadingRateTileSize != 0) {
+            CHECK_HRCMD(commandList.CommandList->QueryInterface(
+                __uuidof(ID3D12GraphicsCommandList5), reinterpret_cast<void**>(commandList.CommandList5.ReleaseAndGetAddressOf())));
         }
+#endif
+    }
 
-        D3D12_ROOT_PARAMETER rootParams[2];
+    void InitializeResources() {
+        // The model transforms come from the instance vertex stream, only the view-projection is a root CBV.
+        D3D12_ROOT_PARAMETER rootParams[1];
         rootParams[0].ParameterType = D3D12_ROOT_PARAMETER_TYPE_CBV;
-        rootParams[0].Descriptor.ShaderRegister = 0;
+        rootParams[0].Descriptor.ShaderRegister = 1;
         rootParams[0].Descriptor.RegisterSpace = 0;
         rootParams[0].ShaderVisibility = D3D12_SHADER_VISIBILITY_VERTEX;
-        rootParams[1].ParameterType = D3D12_ROOT_PARAMETER_TYPE_CBV;
-        rootParams[1].Descriptor.ShaderRegister = 1;
-        rootParams[1].Descriptor.RegisterSpace = 0;
-        rootParams[1].ShaderVisibility = D3D12_SHADER_VISIBILITY_VERTEX;
 
         D3D12_ROOT_SIGNATURE_DESC rootSignatureDesc{};
         rootSignatureDesc.NumParameters = (UINT)ArraySize(rootParams);
@@ -233,53 +467,117 @@ struct D3D12GraphicsPlugin : public IGraphicsPlugin {
                                                   __uuidof(ID3D12RootSignature),
                                                   reinterpret_cast<void**>(m_rootSignature.ReleaseAndGetAddressOf())));
 
-        SwapchainImageContext initializeContext;
-        std::vector<XrSwapchainImageBaseHeader*> _ = initializeContext.Create(m_device.Get(), 1);
+        m_frameContexts.resize(FramesInFlight);
+        for (FrameContext& frameContext : m_frameContexts) {
+            CreateCommandListContext(frameContext);
+        }
 
-        ComPtr<ID3D12GraphicsCommandList> cmdList;
-        CHECK_HRCMD(m_device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT, initializeContext.GetCommandAllocator(), nullptr,
-                                                __uuidof(ID3D12GraphicsCommandList),
-                                                reinterpret_cast<void**>(cmdList.ReleaseAndGetAddressOf())));
+        if (m_gpuTimers) {
+            // Each frame slot owns TimestampsPerFrame queries and the matching range of the readback buffer.
+            D3D12_QUERY_HEAP_DESC queryHeapDesc{};
+            queryHeapDesc.Type = D3D12_QUERY_HEAP_TYPE_TIMESTAMP;
+            queryHeapDesc.Count = FramesInFlight * TimestampsPerFrame;
+            CHECK_HRCMD(m_device->CreateQueryHeap(&queryHeapDesc, __uuidof(ID3D12QueryHeap),
+                                                  reinterpret_cast<void**>(m_timestampQueryHeap.ReleaseAndGetAddressOf())));
+            m_timestampReadback = CreateBuffer(m_device.Get(), queryHeapDesc.Count * sizeof(uint64_t), D3D12_HEAP_TYPE_READBACK);
+            CHECK_HRCMD(m_cmdQueue->GetTimestampFrequency(&m_timestampFrequency));
+        }
 
-        ComPtr<ID3D12Resource> cubeVertexBufferUpload;
-        m_cubeVertexBuffer = CreateBuffer(m_device.Get(), sizeof(Geometry::c_cubeVertices), D3D12_HEAP_TYPE_DEFAULT);
-        {
-            cubeVertexBufferUpload = CreateBuffer(m_device.Get(), sizeof(Geometry::c_cubeVertices), D3D12_HEAP_TYPE_UPLOAD);
+        CHECK_HRCMD(m_device->CreateFence(m_fenceValue, D3D12_FENCE_FLAG_NONE, __uuidof(ID3D12Fence),
+                                          reinterpret_cast<void**>(m_fence.ReleaseAndGetAddressOf())));
+        m_fenceEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+        CHECK(m_fenceEvent != nullptr);
+
+        m_uploadRing.Create(m_device.Get(), InitialUploadRingSize, m_fenceValue);
+
+        // The cube upload is recorded with the first frame's allocator by a startup job, while the session and swapchains,
+        // whose pipeline states are jobs too, are created. It is submitted on the thread that makes the OpenXR calls, in
+        // order with everything else on the queue. The first frame slot's allocator is not reused, and the upload buffers are
+        // not released, until the GPU has finished it.
+        m_meshes.clear();
+        const JobGraph::JobId cubeCopies = AddStartupStage(m_startupJobs, "upload cube geometry", [this]() {
+            ID3D12GraphicsCommandList* const cmdList = m_frameContexts[0].CommandList.Get();
+            CHECK_HRCMD(cmdList->Reset(m_frameContexts[0].CommandAllocator.Get(), nullptr));
+            RecordMeshUpload(cmdList, CubeMeshData());
+            CHECK_HRCMD(cmdList->Close());
+        });
+        AddStartupStage(
+            m_startupJobs, "submit cube geometry",
+            [this]() {
+                ID3D12CommandList* cmdLists[] = {m_frameContexts[0].CommandList.Get()};
+                m_cmdQueue->ExecuteCommandLists((UINT)ArraySize(cmdLists), cmdLists);
+                SignalFence();
+                m_frameContexts[0].FenceValue = m_fenceValue;
+                m_geometryUploadFenceValue = m_fenceValue;
+            },
+            {cubeCopies}, JobGraph::Thread::Waiting);
+    }
+
+    // Copy the mesh into upload buffers and record their copy into default heap buffers. The upload buffers are released
+    // once m_geometryUploadFenceValue passes, which the caller sets after submitting cmdList.
+    void RecordMeshUpload(ID3D12GraphicsCommandList* cmdList, const MeshData& mesh) {
+        MeshBuffers buffers;
+        const std::pair<const void*, size_t> sources[] = {{mesh.Vertices, mesh.VertexBytes()}, {mesh.Indices, mesh.IndexBytes()}};
+        ComPtr<ID3D12Resource>* const destinations[] = {&buffers.VertexBuffer, &buffers.IndexBuffer};
+        for (size_t i = 0; i < ArraySize(sources); ++i) {
+            const uint32_t size = (uint32_t)sources[i].second;
+            *destinations[i] = CreateBuffer(m_device.Get(), size, D3D12_HEAP_TYPE_DEFAULT);
+            ComPtr<ID3D12Resource> upload = CreateBuffer(m_device.Get(), size, D3D12_HEAP_TYPE_UPLOAD);
 
             void* data;
             const D3D12_RANGE readRange{0, 0};
-            CHECK_HRCMD(cubeVertexBufferUpload->Map(0, &readRange, &data));
-            memcpy(data, Geometry::c_cubeVertices, sizeof(Geometry::c_cubeVertices));
-            cubeVertexBufferUpload->Unmap(0, nullptr);
+            CHECK_HRCMD(upload->Map(0, &readRange, &data));
+            StreamCopy(data, sources[i].first, size);
+            upload->Unmap(0, nullptr);
 
-            cmdList->CopyBufferRegion(m_cubeVertexBuffer.Get(), 0, cubeVertexBufferUpload.Get(), 0,
-                                      sizeof(Geometry::c_cubeVertices));
+            cmdList->CopyBufferRegion(destinations[i]->Get(), 0, upload.Get(), 0, size);
+            m_geometryUploadBuffers.push_back(std::move(upload));
         }
 
-        ComPtr<ID3D12Resource> cubeIndexBufferUpload;
-        m_cubeIndexBuffer = CreateBuffer(m_device.Get(), sizeof(Geometry::c_cubeIndices), D3D12_HEAP_TYPE_DEFAULT);
-        {
-            cubeIndexBufferUpload = CreateBuffer(m_device.Get(), sizeof(Geometry::c_cubeIndices), D3D12_HEAP_TYPE_UPLOAD);
+        buffers.VertexBufferView = {buffers.VertexBuffer->GetGPUVirtualAddress(), (UINT)mesh.VertexBytes(),
+                                    sizeof(Geometry::Vertex)};
+        buffers.IndexBufferView = {buffers.IndexBuffer->GetGPUVirtualAddress(), (UINT)mesh.IndexBytes(),
+                                   mesh.IndexSize == sizeof(uint32_t) ? DXGI_FORMAT_R32_UINT : DXGI_FORMAT_R16_UINT};
+        buffers.Lods = mesh.Lods;
+        m_meshes.push_back(std::move(buffers));
+    }
 
-            void* data;
-            const D3D12_RANGE readRange{0, 0};
-            CHECK_HRCMD(cubeIndexBufferUpload->Map(0, &readRange, &data));
-            memcpy(data, Geometry::c_cubeIndices, sizeof(Geometry::c_cubeIndices));
-            cubeIndexBufferUpload->Unmap(0, nullptr);
+    // Submitted like a frame, the first draw from the mesh is queued behind the copy.
+    uint32_t AddMesh(const MeshData& mesh) override {
+        ID3D12GraphicsCommandList* const cmdList = BeginCommandList();
+        RecordMeshUpload(cmdList, mesh);
+        ExecuteCommandList(cmdList);
+        m_geometryUploadFenceValue = m_fenceValue;
+        return (uint32_t)m_meshes.size() - 1;
+    }
 
-            cmdList->CopyBufferRegion(m_cubeIndexBuffer.Get(), 0, cubeIndexBufferUpload.Get(), 0, sizeof(Geometry::c_cubeIndices));
+    bool ReuseDevice(XrInstance instance, XrSystemId systemId) override {
+        if (m_device == nullptr) {
+            return false;
         }
 
-        CHECK_HRCMD(cmdList->Close());
-        ID3D12CommandList* cmdLists[] = {cmdList.Get()};
-        m_cmdQueue->ExecuteCommandLists((UINT)ArraySize(cmdLists), cmdLists);
-
-        CHECK_HRCMD(m_device->CreateFence(m_fenceValue, D3D12_FENCE_FLAG_NONE, __uuidof(ID3D12Fence),
-                                          reinterpret_cast<void**>(m_fence.ReleaseAndGetAddressOf())));
-        m_fenceEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
-        CHECK(m_fenceEvent != nullptr);
+        PFN_xrGetD3D12GraphicsRequirementsKHR pfnGetD3D12GraphicsRequirementsKHR = nullptr;
+        CHECK_XRCMD(xrGetInstanceProcAddr(instance, "xrGetD3D12GraphicsRequirementsKHR",
+                                          reinterpret_cast<PFN_xrVoidFunction*>(&pfnGetD3D12GraphicsRequirementsKHR)));
+        XrGraphicsRequirementsD3D12KHR graphicsRequirements{XR_TYPE_GRAPHICS_REQUIREMENTS_D3D12_KHR};
+        CHECK_XRCMD(pfnGetD3D12GraphicsRequirementsKHR(instance, systemId, &graphicsRequirements));
+        if (memcmp(&graphicsRequirements.adapterLuid, &m_adapterLuid, sizeof(m_adapterLuid)) != 0) {
+            return false;
+        }
+        D3D12_FEATURE_DATA_FEATURE_LEVELS featureLevels{};
+        featureLevels.NumFeatureLevels = 1;
+        featureLevels.pFeatureLevelsRequested = &graphicsRequirements.minFeatureLevel;
+        if (FAILED(m_device->CheckFeatureSupport(D3D12_FEATURE_FEATURE_LEVELS, &featureLevels, sizeof(featureLevels))) ||
+            featureLevels.MaxSupportedFeatureLevel < graphicsRequirements.minFeatureLevel) {
+            return false;
+        }
 
+        // The images of the old swapchains are gone, so nothing may still be rendering into them.
+        m_startupJobs.Wait();
         WaitForGpu();
+        m_swapchainImageContexts.clear();
+        m_meshes.resize(CubeMesh + 1);
+        return true;
     }
 
     int64_t SelectColorSwapchainFormat(const std::vector<int64_t>& runtimeFormats) const override {
@@ -301,45 +599,95 @@ struct D3D12GraphicsPlugin : public IGraphicsPlugin {
         return *swapchainFormatIt;
     }
 
+    std::vector<ColorFormatInfo> GetColorSwapchainFormatCandidates() const override {
+        return {{DXGI_FORMAT_R8G8B8A8_UNORM, "DXGI_FORMAT_R8G8B8A8_UNORM", 4, 8, 8, false, true},
+                {DXGI_FORMAT_B8G8R8A8_UNORM, "DXGI_FORMAT_B8G8R8A8_UNORM", 4, 8, 8, false, true},
+                {DXGI_FORMAT_R8G8B8A8_UNORM_SRGB, "DXGI_FORMAT_R8G8B8A8_UNORM_SRGB", 4, 8, 8, true, true},
+                {DXGI_FORMAT_B8G8R8A8_UNORM_SRGB, "DXGI_FORMAT_B8G8R8A8_UNORM_SRGB", 4, 8, 8, true, true},
+                {DXGI_FORMAT_R10G10B10A2_UNORM, "DXGI_FORMAT_R10G10B10A2_UNORM", 4, 10, 2, false, true},
+                {DXGI_FORMAT_R11G11B10_FLOAT, "DXGI_FORMAT_R11G11B10_FLOAT", 4, 10, 0, false, true},
+                {DXGI_FORMAT_R16G16B16A16_FLOAT, "DXGI_FORMAT_R16G16B16A16_FLOAT", 8, 16, 16, false, false}};
+    }
+
+    int64_t SelectDepthSwapchainFormat(const std::vector<int64_t>& runtimeFormats) const override {
+        // The pipeline states are built for the format of the private depth textures.
+        const auto swapchainFormatIt = std::find(runtimeFormats.begin(), runtimeFormats.end(), DXGI_FORMAT_D32_FLOAT);
+        return swapchainFormatIt != runtimeFormats.end() ? *swapchainFormatIt : -1;
+    }
+
     const XrBaseInStructure* GetGraphicsBinding() const override {
         return reinterpret_cast<const XrBaseInStructure*>(&m_graphicsBinding);
     }
 
-    std::vector<XrSwapchainImageBaseHeader*> AllocateSwapchainImageStructs(
-        uint32_t capacity, const XrSwapchainCreateInfo& /*swapchainCreateInfo*/) override {
+    uint32_t AllocateSwapchainImageStructs(uint32_t capacity, const XrSwapchainCreateInfo& swapchainCreateInfo,
+                                           std::vector<XrSwapchainImageBaseHeader*>& swapchainImages) override {
         // Allocate and initialize the buffer of image structs (must be sequential in memory for xrEnumerateSwapchainImages).
         // Return back an array of pointers to each swapchain image struct so the consumer doesn't need to know the type/size.
-
-        m_swapchainImageContexts.emplace_back();
-        SwapchainImageContext& swapchainImageContext = m_swapchainImageContexts.back();
-
-        std::vector<XrSwapchainImageBaseHeader*> bases = swapchainImageContext.Create(m_device.Get(), capacity);
-
-        // Map every swapchainImage base pointer to this context
-        for (auto& base : bases) {
-            m_swapchainImageContextMap[base] = &swapchainImageContext;
+        // The context's index in the table identifies the swapchain.
+        const uint32_t swapchainIndex = (uint32_t)m_swapchainImageContexts.size();
+        m_swapchainImageContexts.push_back(std::make_unique<SwapchainImageContext>());
+        swapchainImages = m_swapchainImageContexts.back()->Create(m_device.Get(), capacity, swapchainCreateInfo, m_foveationLevel);
+
+        // The pipeline state a color swapchain is rendered with is compiled by a startup job, which the first frame waits for.
+        const bool multiview = swapchainCreateInfo.arraySize > 1;
+        if ((swapchainCreateInfo.usageFlags & XR_SWAPCHAIN_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT) == 0 &&
+            (!multiview || m_multiviewSupported)) {
+            const DXGI_FORMAT format = (DXGI_FORMAT)swapchainCreateInfo.format;
+            const auto inserted = m_pipelineStates.emplace(std::make_pair(format, multiview), nullptr);
+            if (inserted.second) {
+                ComPtr<ID3D12PipelineState>* const pipelineState = &inserted.first->second;
+                AddStartupStage(m_startupJobs, multiview ? "create multiview pipeline state" : "create pipeline state",
+                                [this, pipelineState, format, multiview]() {
+                                    *pipelineState = CreatePipelineState(format, multiview);
+                                });
+            }
         }
+        return swapchainIndex;
+    }
 
-        return bases;
+    bool EnableFoveatedShading(FoveationLevel level) override {
+        if (m_shadingRateTileSize == 0) {
+            return false;
+        }
+        m_foveationLevel = level;
+        return true;
     }
 
-    ID3D12PipelineState* GetOrCreatePipelineState(DXGI_FORMAT swapchainFormat) {
-        auto iter = m_pipelineStates.find(swapchainFormat);
+    ID3D12PipelineState* GetOrCreatePipelineState(DXGI_FORMAT swapchainFormat, bool multiview) {
+        const auto key = std::make_pair(swapchainFormat, multiview);
+        auto iter = m_pipelineStates.find(key);
         if (iter != m_pipelineStates.end()) {
             return iter->second.Get();
         }
+        return m_pipelineStates.emplace(key, CreatePipelineState(swapchainFormat, multiview)).first->second.Get();
+    }
 
+    // Only reads state set before swapchains are allocated, so it can run as a startup job.
+    ComPtr<ID3D12PipelineState> CreatePipelineState(DXGI_FORMAT swapchainFormat, bool multiview) const {
+        // The multiview shaders draw two instances per cube, so the model matrix steps once per view pair.
+        const UINT instanceStepRate = multiview ? 2 : 1;
         const D3D12_INPUT_ELEMENT_DESC inputElementDescs[] = {
             {"POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, D3D12_APPEND_ALIGNED_ELEMENT,
              D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0},
             {"COLOR", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, D3D12_APPEND_ALIGNED_ELEMENT, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA,
              0},
+            {"MODEL", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, InstanceDataSlot, 0, D3D12_INPUT_CLASSIFICATION_PER_INSTANCE_DATA,
+             instanceStepRate},
+            {"MODEL", 1, DXGI_FORMAT_R32G32B32A32_FLOAT, InstanceDataSlot, 16, D3D12_INPUT_CLASSIFICATION_PER_INSTANCE_DATA,
+             instanceStepRate},
+            {"MODEL", 2, DXGI_FORMAT_R32G32B32A32_FLOAT, InstanceDataSlot, 32, D3D12_INPUT_CLASSIFICATION_PER_INSTANCE_DATA,
+             instanceStepRate},
+            {"MODEL", 3, DXGI_FORMAT_R32G32B32A32_FLOAT, InstanceDataSlot, 48, D3D12_INPUT_CLASSIFICATION_PER_INSTANCE_DATA,
+             instanceStepRate},
         };
 
         D3D12_GRAPHICS_PIPELINE_STATE_DESC pipelineStateDesc{};
         pipelineStateDesc.pRootSignature = m_rootSignature.Get();
-        pipelineStateDesc.VS = {m_vertexShaderBytes->GetBufferPointer(), m_vertexShaderBytes->GetBufferSize()};
-        pipelineStateDesc.PS = {m_pixelShaderBytes->GetBufferPointer(), m_pixelShaderBytes->GetBufferSize()};
+        ID3DBlob* const vertexShaderBytes = multiview ? m_multiviewVertexShaderBytes.Get() : m_vertexShaderBytes.Get();
+        ID3DBlob* const pixelShaderBytes = multiview ? m_multiviewPixelShaderBytes.Get() : m_pixelShaderBytes.Get();
+        CHECK(vertexShaderBytes != nullptr && pixelShaderBytes != nullptr);
+        pipelineStateDesc.VS = {vertexShaderBytes->GetBufferPointer(), vertexShaderBytes->GetBufferSize()};
+        pipelineStateDesc.PS = {pixelShaderBytes->GetBufferPointer(), pixelShaderBytes->GetBufferSize()};
         {
             pipelineStateDesc.BlendState.AlphaToCoverageEnable = false;
             pipelineStateDesc.BlendState.IndependentBlendEnable = false;
@@ -400,160 +748,490 @@ struct D3D12GraphicsPlugin : public IGraphicsPlugin {
         ComPtr<ID3D12PipelineState> pipelineState;
         CHECK_HRCMD(m_device->CreateGraphicsPipelineState(&pipelineStateDesc, __uuidof(ID3D12PipelineState),
                                                           reinterpret_cast<void**>(pipelineState.ReleaseAndGetAddressOf())));
-        ID3D12PipelineState* pipelineStateRaw = pipelineState.Get();
+        return pipelineState;
+    }
+
+    void RenderView(const XrCompositionLayerProjectionView& layerView, const SwapchainImage& swapchainImage,
+                    int64_t swapchainFormat, const std::vector<XrMatrix4x4f>& cubeModels,
+                    const std::vector<MeshDraw>& meshDraws) override {
+        CHECK(layerView.subImage.imageArrayIndex == 0);  // Texture arrays not supported.
 
-        m_pipelineStates.emplace(swapchainFormat, std::move(pipelineState));
+        ViewProjectionConstantBuffer viewProjection;
+        XMStoreFloat4x4(&viewProjection.ViewProjection, ComputeViewProjection(layerView));
 
-        return pipelineStateRaw;
+        RenderCubes(layerView.subImage.imageRect, swapchainImage, (DXGI_FORMAT)swapchainFormat, cubeModels, meshDraws,
+                    &viewProjection, sizeof(viewProjection), 1, nullptr);
     }
 
-    void RenderView(const XrCompositionLayerProjectionView& layerView, const XrSwapchainImageBaseHeader* swapchainImage,
-                    int64_t swapchainFormat, const std::vector<Cube>& cubes) override {
-        CHECK(layerView.subImage.imageArrayIndex == 0);  // Texture arrays not supported.
+    bool SupportsMultiview() const override { return m_multiviewSupported; }
 
-        auto& swapchainContext = *m_swapchainImageContextMap[swapchainImage];
-        CpuWaitForFence(swapchainContext.GetFrameFenceValue());
-        swapchainContext.ResetCommandAllocator();
+    // The view-projection constants and the instances stay in mapped upload memory until submission, see LateLatch.
+    bool SetLateLatchCallback(std::function<size_t()> callback) override {
+        m_lateLatchCallback = std::move(callback);
+        return true;
+    }
 
-        ComPtr<ID3D12GraphicsCommandList> cmdList;
-        CHECK_HRCMD(m_device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT, swapchainContext.GetCommandAllocator(), nullptr,
-                                                __uuidof(ID3D12GraphicsCommandList),
-                                                reinterpret_cast<void**>(cmdList.ReleaseAndGetAddressOf())));
+    void RenderMultiview(const std::vector<XrCompositionLayerProjectionView>& layerViews,
+                         const SwapchainImage& swapchainImage, int64_t swapchainFormat,
+                         const std::vector<XrMatrix4x4f>& cubeModels, const std::vector<MeshDraw>& meshDraws) override {
+        CHECK(m_multiviewSupported);
+        CHECK(layerViews.size() == 2);  // The multiview shader holds one view-projection per eye.
 
-        ID3D12PipelineState* pipelineState = GetOrCreatePipelineState((DXGI_FORMAT)swapchainFormat);
-        cmdList->SetPipelineState(pipelineState);
-        cmdList->SetGraphicsRootSignature(m_rootSignature.Get());
+        MultiviewViewProjectionConstantBuffer viewProjection;
+        for (size_t view = 0; view < ArraySize(viewProjection.ViewProjection); ++view) {
+            CHECK(layerViews[view].subImage.imageArrayIndex == view);
+            XMStoreFloat4x4(&viewProjection.ViewProjection[view], ComputeViewProjection(layerViews[view]));
+        }
 
-        ID3D12Resource* const colorTexture = reinterpret_cast<const XrSwapchainImageD3D12KHR*>(swapchainImage)->texture;
-        const D3D12_RESOURCE_DESC colorTextureDesc = colorTexture->GetDesc();
+        // All views share the same image rect, only the array slice differs.
+        RenderCubes(layerViews[0].subImage.imageRect, swapchainImage, (DXGI_FORMAT)swapchainFormat, cubeModels, meshDraws,
+                    &viewProjection, sizeof(viewProjection), (uint32_t)layerViews.size(), &layerViews);
+    }
 
-        const D3D12_VIEWPORT viewport = {(float)layerView.subImage.imageRect.offset.x,
-                                         (float)layerView.subImage.imageRect.offset.y,
-                                         (float)layerView.subImage.imageRect.extent.width,
-                                         (float)layerView.subImage.imageRect.extent.height,
-                                         0,
-                                         1};
-        cmdList->RSSetViewports(1, &viewport);
+    void RenderViews(const std::vector<XrCompositionLayerProjectionView>& layerViews,
+                     const std::vector<SwapchainImage>& swapchainImages, int64_t swapchainFormat,
+                     const std::vector<XrMatrix4x4f>& cubeModels, const std::vector<MeshDraw>& meshDraws) override {
+        CHECK(layerViews.size() == swapchainImages.size());
+        if (layerViews.empty()) {
+            return;
+        }
 
-        const D3D12_RECT scissorRect = {layerView.subImage.imageRect.offset.x, layerView.subImage.imageRect.offset.y,
-                                        layerView.subImage.imageRect.offset.x + layerView.subImage.imageRect.extent.width,
-                                        layerView.subImage.imageRect.offset.y + layerView.subImage.imageRect.extent.height};
-        cmdList->RSSetScissorRects(1, &scissorRect);
+        // Every view is recorded into one command list and submitted once.
+        ID3D12GraphicsCommandList* const cmdList = BeginCommandList();
 
-        // Create RenderTargetView with original swapchain format (swapchain is typeless).
-        D3D12_CPU_DESCRIPTOR_HANDLE renderTargetView = m_rtvHeap->GetCPUDescriptorHandleForHeapStart();
-        D3D12_RENDER_TARGET_VIEW_DESC renderTargetViewDesc{};
-        renderTargetViewDesc.Format = (DXGI_FORMAT)swapchainFormat;
-        if (colorTextureDesc.DepthOrArraySize > 1) {
-            if (colorTextureDesc.SampleDesc.Count > 1) {
-                renderTargetViewDesc.ViewDimension = D3D12_RTV_DIMENSION_TEXTURE2DMSARRAY;
-                renderTargetViewDesc.Texture2DMSArray.ArraySize = colorTextureDesc.DepthOrArraySize;
-            } else {
-                renderTargetViewDesc.ViewDimension = D3D12_RTV_DIMENSION_TEXTURE2DARRAY;
-                renderTargetViewDesc.Texture2DArray.ArraySize = colorTextureDesc.DepthOrArraySize;
-            }
-        } else {
-            if (colorTextureDesc.SampleDesc.Count > 1) {
-                renderTargetViewDesc.ViewDimension = D3D12_RTV_DIMENSION_TEXTURE2DMS;
-            } else {
-                renderTargetViewDesc.ViewDimension = D3D12_RTV_DIMENSION_TEXTURE2D;
-            }
+        // The model transforms are the same for every view, so they are only uploaded once.
+        const D3D12_GPU_VIRTUAL_ADDRESS instanceBufferAddress = UploadInstances(cubeModels);
+
+        if (m_parallelViews && layerViews.size() > 1) {
+            RenderViewsInParallel(cmdList, layerViews, swapchainImages, (DXGI_FORMAT)swapchainFormat, cubeModels, meshDraws,
+                                  instanceBufferAddress);
+            return;
         }
-        m_device->CreateRenderTargetView(colorTexture, &renderTargetViewDesc, renderTargetView);
 
-        ID3D12Resource* depthStencilTexture = swapchainContext.GetDepthStencilTexture(colorTexture);
-        const D3D12_RESOURCE_DESC depthStencilTextureDesc = depthStencilTexture->GetDesc();
-        D3D12_CPU_DESCRIPTOR_HANDLE depthStencilView = m_dsvHeap->GetCPUDescriptorHandleForHeapStart();
-        D3D12_DEPTH_STENCIL_VIEW_DESC depthStencilViewDesc{};
-        depthStencilViewDesc.Format = DXGI_FORMAT_D32_FLOAT;
-        if (depthStencilTextureDesc.DepthOrArraySize > 1) {
-            if (depthStencilTextureDesc.SampleDesc.Count > 1) {
-                depthStencilViewDesc.ViewDimension = D3D12_DSV_DIMENSION_TEXTURE2DMSARRAY;
-                depthStencilViewDesc.Texture2DMSArray.ArraySize = colorTextureDesc.DepthOrArraySize;
+        CHECK_MSG(layerViews.size() <= MaxViews, Fmt("Up to %u views are supported, not %zu", MaxViews, layerViews.size()));
+        const CommandListContext& commandList = m_frameContexts[m_frameIndex];
+        std::array<uint8_t*, MaxViews> viewProjectionData{};
+        for (size_t i = 0; i < layerViews.size(); ++i) {
+            CHECK(layerViews[i].subImage.imageArrayIndex == 0);  // Texture arrays not supported.
+
+            ViewProjectionConstantBuffer viewProjection;
+            XMStoreFloat4x4(&viewProjection.ViewProjection, ComputeViewProjection(layerViews[i]));
+
+            BeginGpuViewTimer(cmdList);
+            const ViewTargets targets = PrepareView(cmdList, swapchainImages[i], layerViews[i].subImage.imageRect,
+                                                    (DXGI_FORMAT)swapchainFormat, &viewProjection, sizeof(viewProjection), 1);
+            RecordView(commandList, targets, layerViews[i].subImage.imageRect, cubeModels.size(), meshDraws, instanceBufferAddress,
+                       1);
+            EndGpuViewTimer(cmdList);
+            viewProjectionData[i] = targets.ViewProjectionData;
+        }
+
+        LateLatch(layerViews, cubeModels, viewProjectionData, false);
+        ExecuteCommandList(cmdList);
+    }
+
+    // Record each view into a command list of its own on the job system, and submit them after cmdList in one
+    // ExecuteCommandLists. Anything created on first use is set up on this thread first, with its uploads in cmdList.
+    void RenderViewsInParallel(ID3D12GraphicsCommandList* cmdList, const std::vector<XrCompositionLayerProjectionView>& layerViews,
+                               const std::vector<SwapchainImage>& swapchainImages, DXGI_FORMAT swapchainFormat,
+                               const std::vector<XrMatrix4x4f>& cubeModels, const std::vector<MeshDraw>& meshDraws,
+                               D3D12_GPU_VIRTUAL_ADDRESS instanceBufferAddress) {
+        const uint32_t viewCount = (uint32_t)layerViews.size();
+        CHECK_MSG(viewCount <= MaxViews, Fmt("Up to %u views are supported, not %u", MaxViews, viewCount));
+
+        FrameContext& frameContext = m_frameContexts[m_frameIndex];
+        while (frameContext.ViewCommandLists.size() < viewCount) {
+            frameContext.ViewCommandLists.emplace_back();
+            CreateCommandListContext(frameContext.ViewCommandLists.back());
+        }
+
+        std::array<ViewTargets, MaxViews> targets;
+        for (uint32_t view = 0; view < viewCount; ++view) {
+            CHECK(layerViews[view].subImage.imageArrayIndex == 0);  // Texture arrays not supported.
+
+            ViewProjectionConstantBuffer viewProjection;
+            XMStoreFloat4x4(&viewProjection.ViewProjection, ComputeViewProjection(layerViews[view]));
+            targets[view] = PrepareView(cmdList, swapchainImages[view], layerViews[view].subImage.imageRect, swapchainFormat,
+                                        &viewProjection, sizeof(viewProjection), 1);
+        }
+
+        GetJobSystem().ParallelFor(viewCount, [&](uint32_t view) {
+            CommandListContext& viewCommandList = frameContext.ViewCommandLists[view];
+            ResetCommandList(viewCommandList);
+            ID3D12GraphicsCommandList* const viewCmdList = viewCommandList.CommandList.Get();
+            WriteGpuViewTimestamp(viewCmdList, view, false);
+            RecordView(viewCommandList, targets[view], layerViews[view].subImage.imageRect, cubeModels.size(), meshDraws,
+                       instanceBufferAddress, 1);
+            WriteGpuViewTimestamp(viewCmdList, view, true);
+        });
+        if (m_gpuTimers) {
+            frameContext.TimedViews.Count = std::min(viewCount, MaxGpuTimerViews);
+        }
+
+        std::array<ID3D12GraphicsCommandList*, 1 + MaxViews> cmdLists;
+        std::array<uint8_t*, MaxViews> viewProjectionData{};
+        cmdLists[0] = cmdList;
+        for (uint32_t view = 0; view < viewCount; ++view) {
+            cmdLists[1 + view] = frameContext.ViewCommandLists[view].CommandList.Get();
+            viewProjectionData[view] = targets[view].ViewProjectionData;
+        }
+        LateLatch(layerViews, cubeModels, viewProjectionData, false);
+        ExecuteCommandLists(cmdLists.data(), 1 + viewCount);
+    }
+
+    // Record and submit the cubes into every array slice of the swapchain image. With more than one view each cube is
+    // instanced once per view and the multiview shaders route each instance to its slice. The multiview constants are late
+    // latched from lateLatchViews, if given.
+    void RenderCubes(const XrRect2Di& imageRect, const SwapchainImage& swapchainImage, DXGI_FORMAT swapchainFormat,
+                     const std::vector<XrMatrix4x4f>& cubeModels, const std::vector<MeshDraw>& meshDraws,
+                     const void* viewProjection, size_t viewProjectionSize, uint32_t viewCount,
+                     const std::vector<XrCompositionLayerProjectionView>* lateLatchViews) {
+        ID3D12GraphicsCommandList* const cmdList = BeginCommandList();
+        const D3D12_GPU_VIRTUAL_ADDRESS instanceBufferAddress = UploadInstances(cubeModels);
+        BeginGpuViewTimer(cmdList);  // Views drawn in one pass share a timer.
+        const ViewTargets targets =
+            PrepareView(cmdList, swapchainImage, imageRect, swapchainFormat, viewProjection, viewProjectionSize, viewCount);
+        RecordView(m_frameContexts[m_frameIndex], targets, imageRect, cubeModels.size(), meshDraws, instanceBufferAddress,
+                   viewCount);
+        EndGpuViewTimer(cmdList);
+        if (lateLatchViews != nullptr) {
+            LateLatch(*lateLatchViews, cubeModels, {{targets.ViewProjectionData}}, true);
+        }
+        ExecuteCommandList(cmdList);
+    }
+
+    // Give the app a last chance to update the poses before submission, then rewrite what the recorded command lists read
+    // from upload memory: the view-projection constants of each view, which all live in the first block with multiview, and
+    // the instances from the first model the app changed.
+    void LateLatch(const std::vector<XrCompositionLayerProjectionView>& layerViews, const std::vector<XrMatrix4x4f>& cubeModels,
+                   const std::array<uint8_t*, MaxViews>& viewProjectionData, bool multiview) {
+        if (!m_lateLatchCallback) {
+            return;
+        }
+        const size_t firstChangedModel = m_lateLatchCallback();
+
+        for (size_t view = 0; view < layerViews.size(); ++view) {
+            const XMMATRIX viewProjection = ComputeViewProjection(layerViews[view]);
+            if (multiview) {
+                auto* const constants = reinterpret_cast<MultiviewViewProjectionConstantBuffer*>(viewProjectionData[0]);
+                XMStoreFloat4x4(&constants->ViewProjection[view], viewProjection);
             } else {
-                depthStencilViewDesc.ViewDimension = D3D12_DSV_DIMENSION_TEXTURE2DARRAY;
-                depthStencilViewDesc.Texture2DArray.ArraySize = colorTextureDesc.DepthOrArraySize;
+                auto* const constants = reinterpret_cast<ViewProjectionConstantBuffer*>(viewProjectionData[view]);
+                XMStoreFloat4x4(&constants->ViewProjection, viewProjection);
             }
-        } else {
-            if (depthStencilTextureDesc.SampleDesc.Count > 1) {
-                depthStencilViewDesc.ViewDimension = D3D12_DSV_DIMENSION_TEXTURE2DMS;
+        }
+        for (size_t i = firstChangedModel; i < cubeModels.size(); ++i) {
+            XMStoreFloat4x4(&m_uploadedInstances[i].Model, ComputeModel(cubeModels[i]));
+        }
+    }
+
+    // Move to the next frame slot and reset its allocator and command list, once the startup jobs have prepared the cube
+    // and the pipeline states. This only blocks when all FramesInFlight slots are still queued on the GPU.
+    ID3D12GraphicsCommandList* BeginCommandList() {
+        m_startupJobs.Wait();
+        m_frameIndex = (m_frameIndex + 1) % (uint32_t)m_frameContexts.size();
+        FrameContext& frameContext = m_frameContexts[m_frameIndex];
+        CpuWaitForFence(frameContext.FenceValue);
+        ReadGpuTimers(frameContext);
+        if (!m_geometryUploadBuffers.empty() && m_fence->GetCompletedValue() >= m_geometryUploadFenceValue) {
+            m_geometryUploadBuffers.clear();
+        }
+
+        ResetCommandList(frameContext);
+        return frameContext.CommandList.Get();
+    }
+
+    // Start recording a command list whose previous recording the GPU has finished, with the root signature set. Only
+    // touches commandList, so the lists of different views can be reset on different threads.
+    void ResetCommandList(CommandListContext& commandList) const {
+        CHECK_HRCMD(commandList.CommandAllocator->Reset());
+        CHECK_HRCMD(commandList.CommandList->Reset(commandList.CommandAllocator.Get(), nullptr));
+        commandList.CommandList->SetGraphicsRootSignature(m_rootSignature.Get());
+    }
+
+    // The slot's previous submission has completed, so its resolved timestamps can be read without a stall.
+    void ReadGpuTimers(FrameContext& frameContext) {
+        const uint32_t timedViews = frameContext.TimedViews.Take();
+        if (timedViews == 0 || m_timestampFrequency == 0) {
+            return;
+        }
+
+        const SIZE_T begin = m_frameIndex * TimestampsPerFrame * sizeof(uint64_t);
+        const D3D12_RANGE readRange{begin, begin + 2 * timedViews * sizeof(uint64_t)};
+        uint8_t* data;
+        CHECK_HRCMD(m_timestampReadback->Map(0, &readRange, reinterpret_cast<void**>(&data)));
+        const uint64_t* const ticks = reinterpret_cast<const uint64_t*>(data + begin);
+        std::vector<uint64_t>& viewNanoseconds = m_gpuViewTimes.Store(timedViews);
+        for (uint32_t view = 0; view < timedViews; ++view) {
+            viewNanoseconds[view] = (uint64_t)((ticks[2 * view + 1] - ticks[2 * view]) * 1e9 / m_timestampFrequency);
+        }
+        const D3D12_RANGE writtenRange{0, 0};
+        m_timestampReadback->Unmap(0, &writtenRange);
+    }
+
+    void BeginGpuViewTimer(ID3D12GraphicsCommandList* cmdList) {
+        WriteGpuViewTimestamp(cmdList, m_frameContexts[m_frameIndex].TimedViews.Count, false);
+    }
+
+    void EndGpuViewTimer(ID3D12GraphicsCommandList* cmdList) {
+        FrameContext& frameContext = m_frameContexts[m_frameIndex];
+        WriteGpuViewTimestamp(cmdList, frameContext.TimedViews.Count, true);
+        if (m_gpuTimers) {
+            frameContext.TimedViews.Timed();
+        }
+    }
+
+    // Write the start or end timestamp of the timedView'th timed view of the current frame, if it has a pair of queries.
+    void WriteGpuViewTimestamp(ID3D12GraphicsCommandList* cmdList, uint32_t timedView, bool end) const {
+        if (m_gpuTimers && timedView < MaxGpuTimerViews) {
+            cmdList->EndQuery(m_timestampQueryHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP,
+                              m_frameIndex * TimestampsPerFrame + 2 * timedView + (end ? 1 : 0));
+        }
+    }
+
+    bool TakeGpuViewTimes(std::vector<uint64_t>& viewNanoseconds) override { return m_gpuViewTimes.Take(viewNanoseconds); }
+
+    std::chrono::nanoseconds TakeCpuWaitTime() override {
+        const std::chrono::nanoseconds cpuWaitTime = m_cpuWaitTime;
+        m_cpuWaitTime = {};
+        return cpuWaitTime;
+    }
+
+    // Sub-allocate upload memory for the command list being recorded. This only waits on the GPU when the ring is full, and
+    // grows the ring if a single frame needs more than all of it.
+    UploadRing::Allocation AllocateUpload(uint64_t size, uint64_t alignment) {
+        m_uploadRing.Retire(m_fence->GetCompletedValue());
+
+        UploadRing::Allocation allocation;
+        while (!m_uploadRing.TryAllocate(size, alignment, allocation)) {
+            const uint64_t oldestFenceValue = m_uploadRing.OldestFenceValue();
+            if (oldestFenceValue != 0) {
+                CpuWaitForFence(oldestFenceValue);
+                m_uploadRing.Retire(oldestFenceValue);
             } else {
-                depthStencilViewDesc.ViewDimension = D3D12_DSV_DIMENSION_TEXTURE2D;
+                // The command list being recorded may still reference the old buffer, so it retires with the next signal.
+                const uint64_t newSize = std::max<uint64_t>(m_uploadRing.Size() * 2, size + alignment);
+                LOG_VERBOSE(Fmt("Growing D3D12 upload ring to %llu bytes", newSize));
+                m_uploadRing.Create(m_device.Get(), static_cast<uint32_t>(newSize), m_fenceValue + 1);
             }
         }
-        m_device->CreateDepthStencilView(depthStencilTexture, &depthStencilViewDesc, depthStencilView);
-
-        // Clear swapchain and depth buffer. NOTE: This will clear the entire render target view, not just the specified view.
-        // TODO: Do not clear to a color when using a pass-through view configuration.
-        cmdList->ClearRenderTargetView(renderTargetView, DirectX::Colors::DarkSlateGray, 0, nullptr);
-        cmdList->ClearDepthStencilView(depthStencilView, D3D12_CLEAR_FLAG_DEPTH, 1.0f, 0, 0, nullptr);
+        return allocation;
+    }
 
-        D3D12_CPU_DESCRIPTOR_HANDLE renderTargets[] = {renderTargetView};
-        cmdList->OMSetRenderTargets((UINT)ArraySize(renderTargets), renderTargets, true, &depthStencilView);
+    // Write every cube's model transform into upload memory.
+    D3D12_GPU_VIRTUAL_ADDRESS UploadInstances(const std::vector<XrMatrix4x4f>& cubeModels) {
+        if (cubeModels.empty()) {
+            return 0;
+        }
 
-        const XMMATRIX spaceToView = XMMatrixInverse(nullptr, LoadXrPose(layerView.pose));
-        XrMatrix4x4f projectionMatrix;
-        XrMatrix4x4f_CreateProjectionFov(&projectionMatrix, GRAPHICS_D3D, layerView.fov, 0.05f, 100.0f);
+        const UploadRing::Allocation allocation = AllocateUpload(sizeof(InstanceData) * cubeModels.size(), alignof(InstanceData));
+        InstanceData* const instances = reinterpret_cast<InstanceData*>(allocation.CpuAddress);
+        for (size_t i = 0; i < cubeModels.size(); ++i) {
+            XMStoreFloat4x4(&instances[i].Model, ComputeModel(cubeModels[i]));
+        }
+        m_uploadedInstances = instances;
+        return allocation.GpuAddress;
+    }
 
-        // Set shaders and constant buffers.
-        ID3D12Resource* viewProjectionCBuffer = swapchainContext.GetViewProjectionCBuffer();
-        ViewProjectionConstantBuffer viewProjection;
-        XMStoreFloat4x4(&viewProjection.ViewProjection, XMMatrixTranspose(spaceToView * LoadXrMatrix(projectionMatrix)));
-        {
-            void* data;
-            const D3D12_RANGE readRange{0, 0};
-            CHECK_HRCMD(viewProjectionCBuffer->Map(0, &readRange, &data));
-            memcpy(data, &viewProjection, sizeof(viewProjection));
-            viewProjectionCBuffer->Unmap(0, nullptr);
+    // Look up or create what a view of the swapchain image is rendered with: the pipeline, the cached render target and
+    // depth stencil views of the image, the shading-rate image for imageRect, whose upload is recorded into cmdList the first
+    // time, and the view-projection constants copied to upload memory.
+    ViewTargets PrepareView(ID3D12GraphicsCommandList* cmdList, const SwapchainImage& swapchainImage, const XrRect2Di& imageRect,
+                            DXGI_FORMAT swapchainFormat, const void* viewProjection, size_t viewProjectionSize,
+                            uint32_t viewCount) {
+        ViewTargets targets;
+        targets.PipelineState = GetOrCreatePipelineState(swapchainFormat, viewCount > 1);
+
+        SwapchainImageContext& swapchainContext = *m_swapchainImageContexts[swapchainImage.swapchainIndex];
+        targets.RenderTargetView = swapchainContext.RenderTargetView(swapchainImage.imageIndex);
+
+        // Depth swapchain images are acquired in D3D12_RESOURCE_STATE_DEPTH_WRITE, like the private depth texture.
+        ID3D12Resource* const colorTexture = swapchainContext.Texture(swapchainImage.imageIndex);
+        targets.DepthStencilView =
+            swapchainImage.depthSwapchainIndex != NoDepthSwapchain
+                ? m_swapchainImageContexts[swapchainImage.depthSwapchainIndex]->DepthStencilView(swapchainImage.depthImageIndex)
+                : swapchainContext.PrivateDepthStencilView(colorTexture);
+
+#if defined(__ID3D12GraphicsCommandList5_INTERFACE_DEFINED__)
+        if (swapchainContext.Foveation() != FoveationLevel::Off) {
+            const D3D12_RESOURCE_DESC colorTextureDesc = colorTexture->GetDesc();
+            targets.ShadingRateImage = GetOrCreateShadingRateImage(
+                cmdList, (uint32_t)colorTextureDesc.Width, colorTextureDesc.Height, imageRect, swapchainContext.Foveation());
         }
+#else
+        (void)cmdList;
+#endif
+
+        const UploadRing::Allocation viewProjectionCBuffer =
+            AllocateUpload(viewProjectionSize, D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT);
+        memcpy(viewProjectionCBuffer.CpuAddress, viewProjection, viewProjectionSize);
+        targets.ViewProjection = viewProjectionCBuffer.GpuAddress;
+        targets.ViewProjectionData = viewProjectionCBuffer.CpuAddress;
+        return targets;
+    }
+
+    // Record the cubes into the targets of a view prepared by PrepareView, with the meshes of meshDraws. Only reads plugin
+    // state, so the views of a frame can be recorded into different command lists on different threads.
+    void RecordView(const CommandListContext& commandList, const ViewTargets& targets, const XrRect2Di& imageRect,
+                    size_t cubeCount, const std::vector<MeshDraw>& meshDraws, D3D12_GPU_VIRTUAL_ADDRESS instanceBufferAddress,
+                    uint32_t viewCount) const {
+        ID3D12GraphicsCommandList* const cmdList = commandList.CommandList.Get();
+        cmdList->SetPipelineState(targets.PipelineState);
 
-        cmdList->SetGraphicsRootConstantBufferView(1, viewProjectionCBuffer->GetGPUVirtualAddress());
+        const D3D12_VIEWPORT viewport = {(float)imageRect.offset.x,      (float)imageRect.offset.y, (float)imageRect.extent.width,
+                                         (float)imageRect.extent.height, 0,                         1};
+        cmdList->RSSetViewports(1, &viewport);
+
+        const D3D12_RECT scissorRect = {imageRect.offset.x, imageRect.offset.y, imageRect.offset.x + imageRect.extent.width,
+                                        imageRect.offset.y + imageRect.extent.height};
+        cmdList->RSSetScissorRects(1, &scissorRect);
+
+        // Clear swapchain and depth buffer. NOTE: This will clear the entire render target view, not just the specified view.
+        // TODO: Do not clear to a color when using a pass-through view configuration.
+        cmdList->ClearRenderTargetView(targets.RenderTargetView, DirectX::Colors::DarkSlateGray, 0, nullptr);
+        cmdList->ClearDepthStencilView(targets.DepthStencilView, D3D12_CLEAR_FLAG_DEPTH, 1.0f, 0, 0, nullptr);
+
+        D3D12_CPU_DESCRIPTOR_HANDLE renderTargets[] = {targets.RenderTargetView};
+        cmdList->OMSetRenderTargets((UINT)ArraySize(renderTargets), renderTargets, true, &targets.DepthStencilView);
+
+#if defined(__ID3D12GraphicsCommandList5_INTERFACE_DEFINED__)
+        if (targets.ShadingRateImage != nullptr) {
+            // Every array slice reads the same shading-rate image, the pattern is centered in each view alike.
+            ID3D12GraphicsCommandList5* const cmdList5 = commandList.CommandList5.Get();
+            const D3D12_SHADING_RATE_COMBINER combiners[D3D12_RS_SET_SHADING_RATE_COMBINER_COUNT] = {
+                D3D12_SHADING_RATE_COMBINER_PASSTHROUGH, D3D12_SHADING_RATE_COMBINER_OVERRIDE};
+            cmdList5->RSSetShadingRate(D3D12_SHADING_RATE_1X1, combiners);
+            cmdList5->RSSetShadingRateImage(targets.ShadingRateImage);
+        }
+#endif
 
-        // Set cube primitive data.
-        const D3D12_VERTEX_BUFFER_VIEW vertexBufferView[] = {
-            {m_cubeVertexBuffer->GetGPUVirtualAddress(), sizeof(Geometry::c_cubeVertices), sizeof(Geometry::Vertex)}};
-        cmdList->IASetVertexBuffers(0, (UINT)ArraySize(vertexBufferView), vertexBufferView);
+        // Set shaders and constant buffers.
+        cmdList->SetGraphicsRootConstantBufferView(0, targets.ViewProjection);
 
-        D3D12_INDEX_BUFFER_VIEW indexBufferView{m_cubeIndexBuffer->GetGPUVirtualAddress(), sizeof(Geometry::c_cubeIndices),
-                                                DXGI_FORMAT_R16_UINT};
-        cmdList->IASetIndexBuffer(&indexBufferView);
+        if (cubeCount == 0) {
+            return;
+        }
 
         cmdList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
 
-        constexpr uint32_t cubeCBufferSize = AlignTo<D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT>(sizeof(ModelConstantBuffer));
-        swapchainContext.RequestModelCBuffer(static_cast<uint32_t>(cubeCBufferSize * cubes.size()));
-        ID3D12Resource* modelCBuffer = swapchainContext.GetModelCBuffer();
-
-        // Render each cube
-        uint32_t offset = 0;
-        for (const Cube& cube : cubes) {
-            // Compute and update the model transform.
-            ModelConstantBuffer model;
-            XMStoreFloat4x4(&model.Model,
-                            XMMatrixTranspose(XMMatrixScaling(cube.Scale.x, cube.Scale.y, cube.Scale.z) * LoadXrPose(cube.Pose)));
-            {
-                uint8_t* data;
-                const D3D12_RANGE readRange{0, 0};
-                CHECK_HRCMD(modelCBuffer->Map(0, &readRange, reinterpret_cast<void**>(&data)));
-                memcpy(data + offset, &model, sizeof(model));
-                const D3D12_RANGE writeRange{offset, offset + cubeCBufferSize};
-                modelCBuffer->Unmap(0, &writeRange);
+        // Draw every cube once per view. The instance stream starts at the first model of each draw, or with the per-cube
+        // baseline (--noinstancing) at each cube in turn.
+        size_t firstInstance = 0;
+        for (const MeshDraw& draw : meshDraws) {
+            const MeshBuffers& mesh = m_meshes[draw.Mesh];
+            const MeshLod& lod = mesh.Lods[draw.Lod];
+            const UINT instanceCount = m_instancing ? draw.InstanceCount : 1;
+            D3D12_VERTEX_BUFFER_VIEW vertexBufferView[] = {
+                mesh.VertexBufferView, {0, (UINT)(instanceCount * sizeof(InstanceData)), sizeof(InstanceData)}};
+            cmdList->IASetIndexBuffer(&mesh.IndexBufferView);
+            for (size_t i = 0; i < draw.InstanceCount; i += instanceCount) {
+                vertexBufferView[InstanceDataSlot].BufferLocation =
+                    instanceBufferAddress + (firstInstance + i) * sizeof(InstanceData);
+                cmdList->IASetVertexBuffers(0, (UINT)ArraySize(vertexBufferView), vertexBufferView);
+                cmdList->DrawIndexedInstanced(lod.IndexCount, instanceCount * viewCount, lod.FirstIndex, 0, 0);
             }
+            firstInstance += draw.InstanceCount;
+        }
+    }
+
+#if defined(__ID3D12GraphicsCommandList5_INTERFACE_DEFINED__)
+    // Find or create the shading-rate image for a render target size, the part of it a view is rendered into and a
+    // foveation level. The pattern is centered on the tiles imageRect covers, so dynamic resolution makes one image per
+    // distinct rendered size. A new image's upload is recorded into cmdList, ahead of its first use.
+    ID3D12Resource* GetOrCreateShadingRateImage(ID3D12GraphicsCommandList* cmdList, uint32_t width, uint32_t height,
+                                                const XrRect2Di& imageRect, FoveationLevel level) {
+        const XrRect2Di viewTiles = FoveationViewTiles(imageRect, m_shadingRateTileSize, m_shadingRateTileSize);
+        const auto key = std::make_tuple(width, height, viewTiles.offset.x, viewTiles.offset.y, viewTiles.extent.width,
+                                         viewTiles.extent.height, level);
+        auto iter = m_shadingRateImages.find(key);
+        if (iter != m_shadingRateImages.end()) {
+            return iter->second.Texture.Get();
+        }
 
-            cmdList->SetGraphicsRootConstantBufferView(0, modelCBuffer->GetGPUVirtualAddress() + offset);
+        const uint32_t tilesX = (width + m_shadingRateTileSize - 1) / m_shadingRateTileSize;
+        const uint32_t tilesY = (height + m_shadingRateTileSize - 1) / m_shadingRateTileSize;
+        const std::vector<uint8_t> rates = FoveationShadingRates(level, tilesX, tilesY, viewTiles, m_maxShadingRateLog2Size);
+
+        ShadingRateImage& shadingRateImage = m_shadingRateImages[key];
+
+        D3D12_HEAP_PROPERTIES heapProp{};
+        heapProp.Type = D3D12_HEAP_TYPE_DEFAULT;
+        heapProp.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
+        heapProp.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
+
+        D3D12_RESOURCE_DESC textureDesc{};
+        textureDesc.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
+        textureDesc.Width = tilesX;
+        textureDesc.Height = tilesY;
+        textureDesc.DepthOrArraySize = 1;
+        textureDesc.MipLevels = 1;
+        textureDesc.Format = DXGI_FORMAT_R8_UINT;
+        textureDesc.SampleDesc.Count = 1;
+        textureDesc.Layout = D3D12_TEXTURE_LAYOUT_UNKNOWN;
+        CHECK_HRCMD(m_device->CreateCommittedResource(
+            &heapProp, D3D12_HEAP_FLAG_NONE, &textureDesc, D3D12_RESOURCE_STATE_COPY_DEST, nullptr, __uuidof(ID3D12Resource),
+            reinterpret_cast<void**>(shadingRateImage.Texture.ReleaseAndGetAddressOf())));
+
+        // Rows of a texture copy source are aligned to D3D12_TEXTURE_DATA_PITCH_ALIGNMENT.
+        const uint32_t rowPitch = AlignTo<D3D12_TEXTURE_DATA_PITCH_ALIGNMENT>(tilesX);
+        shadingRateImage.Upload = CreateBuffer(m_device.Get(), rowPitch * tilesY, D3D12_HEAP_TYPE_UPLOAD);
+        uint8_t* data;
+        const D3D12_RANGE readRange{0, 0};
+        CHECK_HRCMD(shadingRateImage.Upload->Map(0, &readRange, reinterpret_cast<void**>(&data)));
+        for (uint32_t y = 0; y < tilesY; ++y) {
+            memcpy(data + y * rowPitch, rates.data() + y * tilesX, tilesX);
+        }
+        shadingRateImage.Upload->Unmap(0, nullptr);
+
+        D3D12_TEXTURE_COPY_LOCATION dst{};
+        dst.pResource = shadingRateImage.Texture.Get();
+        dst.Type = D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX;
+        dst.SubresourceIndex = 0;
+        D3D12_TEXTURE_COPY_LOCATION src{};
+        src.pResource = shadingRateImage.Upload.Get();
+        src.Type = D3D12_TEXTURE_COPY_TYPE_PLACED_FOOTPRINT;
+        src.PlacedFootprint.Footprint = {DXGI_FORMAT_R8_UINT, tilesX, tilesY, 1, rowPitch};
+        cmdList->CopyTextureRegion(&dst, 0, 0, 0, &src, nullptr);
+
+        D3D12_RESOURCE_BARRIER barrier{};
+        barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
+        barrier.Transition.pResource = shadingRateImage.Texture.Get();
+        barrier.Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
+        barrier.Transition.StateBefore = D3D12_RESOURCE_STATE_COPY_DEST;
+        barrier.Transition.StateAfter = D3D12_RESOURCE_STATE_SHADING_RATE_SOURCE;
+        cmdList->ResourceBarrier(1, &barrier);
+
+        LOG_VERBOSE(Fmt("Created %ux%u D3D12 shading-rate image for %ux%u rendered at %dx%d, foveation %s", tilesX, tilesY, width,
+                        height, imageRect.extent.width, imageRect.extent.height, to_string(level)));
+        return shadingRateImage.Texture.Get();
+    }
+#endif
+
+    void ExecuteCommandList(ID3D12GraphicsCommandList* cmdList) { ExecuteCommandLists(&cmdList, 1); }
 
-            // Draw the cube.
-            cmdList->DrawIndexedInstanced((UINT)ArraySize(Geometry::c_cubeIndices), 1, 0, 0, 0);
+    // Close and submit the command lists of the current frame slot in one go. The timestamps are resolved at the end of the
+    // last one.
+    void ExecuteCommandLists(ID3D12GraphicsCommandList* const* graphicsCmdLists, uint32_t count) {
+        std::array<ID3D12CommandList*, 1 + MaxViews> cmdLists;
+        CHECK(count > 0 && count <= cmdLists.size());
 
-            offset += cubeCBufferSize;
+        const uint32_t timedViews = m_frameContexts[m_frameIndex].TimedViews.Count;
+        if (timedViews > 0) {
+            const UINT firstQuery = m_frameIndex * TimestampsPerFrame;
+            graphicsCmdLists[count - 1]->ResolveQueryData(m_timestampQueryHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, firstQuery,
+                                                          2 * timedViews, m_timestampReadback.Get(),
+                                                          firstQuery * sizeof(uint64_t));
         }
 
-        CHECK_HRCMD(cmdList->Close());
-        ID3D12CommandList* cmdLists[] = {cmdList.Get()};
-        m_cmdQueue->ExecuteCommandLists((UINT)ArraySize(cmdLists), cmdLists);
+        for (uint32_t i = 0; i < count; ++i) {
+            CHECK_HRCMD(graphicsCmdLists[i]->Close());
+            cmdLists[i] = graphicsCmdLists[i];
+        }
+        m_cmdQueue->ExecuteCommandLists(count, cmdLists.data());
 
         SignalFence();
-        swapchainContext.SetFrameFenceValue(m_fenceValue);
+        m_frameContexts[m_frameIndex].FenceValue = m_fenceValue;
+        m_uploadRing.EndFrame(m_fenceValue);
     }
 
     void SignalFence() {
@@ -563,11 +1241,14 @@ struct D3D12GraphicsPlugin : public IGraphicsPlugin {
 
     void CpuWaitForFence(uint64_t fenceValue) {
         if (m_fence->GetCompletedValue() < fenceValue) {
+            TRACE_SCOPE("CpuWaitForFence");
+            const auto waitStart = std::chrono::steady_clock::now();
             CHECK_HRCMD(m_fence->SetEventOnCompletion(fenceValue, m_fenceEvent));
             const uint32_t retVal = WaitForSingleObjectEx(m_fenceEvent, INFINITE, FALSE);
             if (retVal != WAIT_OBJECT_0) {
                 CHECK_HRCMD(E_FAIL);
             }
+            m_cpuWaitTime += std::chrono::steady_clock::now() - waitStart;
         }
     }
 
@@ -577,22 +1258,70 @@ struct D3D12GraphicsPlugin : public IGraphicsPlugin {
     }
 
    private:
-    const ComPtr<ID3DBlob> m_vertexShaderBytes;
-    const ComPtr<ID3DBlob> m_pixelShaderBytes;
+    const std::string m_cacheDirectory;
+    ComPtr<ID3DBlob> m_vertexShaderBytes;  // Set by PrepareResources
+    ComPtr<ID3DBlob> m_pixelShaderBytes;
+    bool m_multiviewSupported{false};
+    ComPtr<ID3DBlob> m_multiviewVertexShaderBytes;
+    ComPtr<ID3DBlob> m_multiviewPixelShaderBytes;
     ComPtr<ID3D12Device> m_device;
+    LUID m_adapterLuid{};  // Adapter the device was created for
     ComPtr<ID3D12CommandQueue> m_cmdQueue;
     ComPtr<ID3D12Fence> m_fence;
     uint64_t m_fenceValue = 0;
     HANDLE m_fenceEvent = INVALID_HANDLE_VALUE;
-    std::list<SwapchainImageContext> m_swapchainImageContexts;
-    std::map<const XrSwapchainImageBaseHeader*, SwapchainImageContext*> m_swapchainImageContextMap;
+    std::vector<std::unique_ptr<SwapchainImageContext>> m_swapchainImageContexts;  // Indexed by SwapchainImage::swapchainIndex.
     XrGraphicsBindingD3D12KHR m_graphicsBinding{XR_TYPE_GRAPHICS_BINDING_D3D12_KHR};
     ComPtr<ID3D12RootSignature> m_rootSignature;
-    std::map<DXGI_FORMAT, ComPtr<ID3D12PipelineState>> m_pipelineStates;
-    ComPtr<ID3D12Resource> m_cubeVertexBuffer;
-    ComPtr<ID3D12Resource> m_cubeIndexBuffer;
-    ComPtr<ID3D12DescriptorHeap> m_rtvHeap;
-    ComPtr<ID3D12DescriptorHeap> m_dsvHeap;
+    std::map<std::pair<DXGI_FORMAT, bool>, ComPtr<ID3D12PipelineState>> m_pipelineStates;
+
+    // GPU copy of a mesh added with AddMesh.
+    struct MeshBuffers {
+        ComPtr<ID3D12Resource> VertexBuffer;
+        ComPtr<ID3D12Resource> IndexBuffer;
+        D3D12_VERTEX_BUFFER_VIEW VertexBufferView{};
+        D3D12_INDEX_BUFFER_VIEW IndexBufferView{};
+        std::array<MeshLod, MaxMeshLods> Lods{};  // Index ranges
+    };
+    std::vector<MeshBuffers> m_meshes;  // Indexed by mesh ID
+    std::vector<ComPtr<ID3D12Resource>> m_geometryUploadBuffers;  // Kept until m_geometryUploadFenceValue passes
+    uint64_t m_geometryUploadFenceValue{0};
+    const bool m_instancing;
+
+    // Tier 2 variable-rate shading, a tile size of 0 when the device does not have it.
+    uint32_t m_shadingRateTileSize{0};
+    uint32_t m_maxShadingRateLog2Size{1};
+    FoveationLevel m_foveationLevel{FoveationLevel::Off};  // For swapchains allocated from now on
+#if defined(__ID3D12GraphicsCommandList5_INTERFACE_DEFINED__)
+    struct ShadingRateImage {
+        ComPtr<ID3D12Resource> Texture;
+        ComPtr<ID3D12Resource> Upload;  // Kept with the texture, it is small and only copied from once
+    };
+    // By render target width and height, the view's tiles and the foveation level
+    std::map<std::tuple<uint32_t, uint32_t, int32_t, int32_t, int32_t, int32_t, FoveationLevel>, ShadingRateImage>
+        m_shadingRateImages;
+#endif
+
+    // Command recording resources, cycled so up to FramesInFlight submissions can be queued before the CPU waits.
+    std::vector<FrameContext> m_frameContexts;
+    uint32_t m_frameIndex{0};
+    const bool m_parallelViews;  // Record the views of RenderViews on the job system
+    std::function<size_t()> m_lateLatchCallback;
+    InstanceData* m_uploadedInstances{nullptr};  // Written by the latest UploadInstances
+    std::chrono::nanoseconds m_cpuWaitTime{0};
+
+    // GPU timestamps around each view, resolved at the end of the command list and read when its frame slot comes around.
+    const bool m_gpuTimers;
+    ComPtr<ID3D12QueryHeap> m_timestampQueryHeap;
+    ComPtr<ID3D12Resource> m_timestampReadback;
+    uint64_t m_timestampFrequency{0};
+    GpuViewTimes m_gpuViewTimes;
+
+    // Upload memory for per-frame constants and instance data, shared by every frame in flight.
+    static constexpr uint32_t InitialUploadRingSize = 4 * 1024 * 1024;
+    UploadRing m_uploadRing;
+
+    JobGraph m_startupJobs;  // Cancelled before anything it uses is destroyed
 };
 }  // namespace
 
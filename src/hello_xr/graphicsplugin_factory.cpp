@@ -34,6 +34,10 @@ std::shared_ptr<IGraphicsPlugin> CreateGraphicsPlugin_D3D11(const std::shared_pt
 std::shared_ptr<IGraphicsPlugin> CreateGraphicsPlugin_D3D12(const std::shared_ptr<Options>& options,
                                                             std::shared_ptr<IPlatformPlugin> platformPlugin);
 #endif
+#if !defined(HELLO_XR_NO_NULL_GRAPHICS_PLUGIN)
+std::shared_ptr<IGraphicsPlugin> CreateGraphicsPlugin_Null(const std::shared_ptr<Options>& options,
+                                                           std::shared_ptr<IPlatformPlugin> platformPlugin);
+#endif
 
 namespace {
 using GraphicsPluginFactory = std::function<std::shared_ptr<IGraphicsPlugin>(const std::shared_ptr<Options>& options,
@@ -74,6 +78,12 @@ std::map<std::string, GraphicsPluginFactory, IgnoreCaseStringLess> graphicsPlugi
          return CreateGraphicsPlugin_D3D12(options, std::move(platformPlugin));
      }},
 #endif
+#if !defined(HELLO_XR_NO_NULL_GRAPHICS_PLUGIN)
+    {"Null",
+     [](const std::shared_ptr<Options>& options, std::shared_ptr<IPlatformPlugin> platformPlugin) {
+         return CreateGraphicsPlugin_Null(options, std::move(platformPlugin));
+     }},
+#endif
 };
 }  // namespace
 
@@ -0,0 +1,155 @@
+// Copyright (c) 2017-2020 The Khronos Group Inc.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include "pch.h"
+#include "common.h"
+#include "geometry.h"
+#include "graphicsplugin.h"
+#include "options.h"
+
+#if !defined(HELLO_XR_NO_NULL_GRAPHICS_PLUGIN)
+
+#include <common/xr_linear.h>
+
+namespace {
+// Renders nothing, but does the CPU work of a frame the other plugins do: the view-projection of every view, copying the
+// models to where the instances would be drawn from, and walking the draws. The session runs headless, so the frame loop of
+// OpenXrProgram can be measured, down to its allocations and runtime calls, on a machine without a GPU.
+struct NullGraphicsPlugin final : public IGraphicsPlugin {
+    NullGraphicsPlugin(const std::shared_ptr<Options>&, std::shared_ptr<IPlatformPlugin>) {}
+
+    ~NullGraphicsPlugin() override {
+        if (m_frameCount > 0) {
+            Log::Write(Log::Level::Info, Fmt("Null graphics plugin: %llu frames, %llu views, %llu draws of %llu instances",
+                                             (unsigned long long)m_frameCount, (unsigned long long)m_viewCount,
+                                             (unsigned long long)m_drawCount, (unsigned long long)m_instanceCount));
+        }
+    }
+
+    // OpenXrProgram enables XR_MND_headless for headless plugins.
+    std::vector<std::string> GetInstanceExtensions() const override { return {}; }
+
+    bool IsHeadless() const override { return true; }
+
+    void InitializeDevice(XrInstance /*instance*/, XrSystemId /*systemId*/) override {
+        m_meshLodCounts.clear();
+        AddMesh(CubeMeshData());
+    }
+
+    bool ReuseDevice(XrInstance /*instance*/, XrSystemId /*systemId*/) override {
+        m_meshLodCounts.resize(CubeMesh + 1);
+        return true;
+    }
+
+    int64_t SelectColorSwapchainFormat(const std::vector<int64_t>& /*runtimeFormats*/) const override {
+        THROW("The Null graphics plugin has no swapchains");
+    }
+
+    const XrBaseInStructure* GetGraphicsBinding() const override { return nullptr; }
+
+    uint32_t AllocateSwapchainImageStructs(uint32_t /*capacity*/, const XrSwapchainCreateInfo& /*swapchainCreateInfo*/,
+                                           std::vector<XrSwapchainImageBaseHeader*>& /*swapchainImages*/) override {
+        THROW("The Null graphics plugin has no swapchains");
+    }
+
+    // Only the number of levels of detail is kept, to check the draws against.
+    uint32_t AddMesh(const MeshData& mesh) override {
+        m_meshLodCounts.push_back(mesh.LodCount);
+        return static_cast<uint32_t>(m_meshLodCounts.size() - 1);
+    }
+
+    void RenderView(const XrCompositionLayerProjectionView& layerView, const SwapchainImage& /*swapchainImage*/,
+                    int64_t /*swapchainFormat*/, const std::vector<XrMatrix4x4f>& cubeModels,
+                    const std::vector<MeshDraw>& meshDraws) override {
+        m_viewProjections.resize(1);
+        m_viewProjections[0] = ComputeViewProjection(layerView);
+        CopyInstances(cubeModels, 0);
+        WalkDraws(cubeModels, meshDraws);
+        ++m_frameCount;
+        ++m_viewCount;
+    }
+
+    void RenderViews(const std::vector<XrCompositionLayerProjectionView>& layerViews,
+                     const std::vector<SwapchainImage>& swapchainImages, int64_t /*swapchainFormat*/,
+                     const std::vector<XrMatrix4x4f>& cubeModels, const std::vector<MeshDraw>& meshDraws) override {
+        CHECK(layerViews.size() == swapchainImages.size());
+        m_viewProjections.resize(layerViews.size());
+        for (size_t i = 0; i < layerViews.size(); ++i) {
+            m_viewProjections[i] = ComputeViewProjection(layerViews[i]);
+        }
+        CopyInstances(cubeModels, 0);
+        WalkDraws(cubeModels, meshDraws);
+
+        // Where the other plugins would submit, write what late latching changed again.
+        if (m_lateLatchCallback) {
+            const size_t firstChanged = m_lateLatchCallback();
+            for (size_t i = 0; i < layerViews.size(); ++i) {
+                m_viewProjections[i] = ComputeViewProjection(layerViews[i]);
+            }
+            CopyInstances(cubeModels, firstChanged);
+        }
+
+        ++m_frameCount;
+        m_viewCount += layerViews.size();
+    }
+
+    bool SetLateLatchCallback(std::function<size_t()> callback) override {
+        m_lateLatchCallback = std::move(callback);
+        return true;
+    }
+
+   private:
+    static XrMatrix4x4f ComputeViewProjection(const XrCompositionLayerProjectionView& layerView) {
+        const auto& pose = layerView.pose;
+        XrMatrix4x4f proj;
+        XrMatrix4x4f_CreateProjectionFov(&proj, GRAPHICS_VULKAN, layerView.fov, 0.05f, 100.0f);
+        XrMatrix4x4f toView;
+        XrVector3f scale{1.f, 1.f, 1.f};
+        XrMatrix4x4f_CreateTranslationRotationScale(&toView, &pose.position, &pose.orientation, &scale);
+        XrMatrix4x4f view;
+        XrMatrix4x4f_InvertRigidBody(&view, &toView);
+        XrMatrix4x4f vp;
+        XrMatrix4x4f_Multiply(&vp, &proj, &view);
+        return vp;
+    }
+
+    // Copy the models from model first on, into an instance buffer that only grows.
+    void CopyInstances(const std::vector<XrMatrix4x4f>& cubeModels, size_t first) {
+        if (m_instances.size() < cubeModels.size()) {
+            m_instances.resize(cubeModels.size());
+        }
+        if (first < cubeModels.size()) {
+            std::copy(cubeModels.begin() + first, cubeModels.end(), m_instances.begin() + first);
+        }
+    }
+
+    void WalkDraws(const std::vector<XrMatrix4x4f>& cubeModels, const std::vector<MeshDraw>& meshDraws) {
+        size_t instanceCount = 0;
+        for (const MeshDraw& draw : meshDraws) {
+            CHECK(draw.Mesh < m_meshLodCounts.size() && draw.Lod < m_meshLodCounts[draw.Mesh]);
+            instanceCount += draw.InstanceCount;
+        }
+        CHECK(instanceCount == cubeModels.size());
+        m_drawCount += meshDraws.size();
+        m_instanceCount += instanceCount;
+    }
+
+    std::vector<uint32_t> m_meshLodCounts;
+    std::vector<XrMatrix4x4f> m_viewProjections;
+    std::vector<XrMatrix4x4f> m_instances;
+    std::function<size_t()> m_lateLatchCallback;
+
+    uint64_t m_frameCount{0};
+    uint64_t m_viewCount{0};
+    uint64_t m_drawCount{0};
+    uint64_t m_instanceCount{0};
+};
+}  // namespace
+
+std::shared_ptr<IGraphicsPlugin> CreateGraphicsPlugin_Null(const std::shared_ptr<Options>& options,
+                                                           std::shared_ptr<IPlatformPlugin> platformPlugin) {
+    return std::make_shared<NullGraphicsPlugin>(options, platformPlugin);
+}
+
+#endif
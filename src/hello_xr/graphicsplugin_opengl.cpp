@@ -6,27 +6,68 @@
 #include "common.h"
 #include "geometry.h"
 #include "graphicsplugin.h"
+#include "options.h"
+#include "cachefile.h"
+#include "gputimers.h"
+#include "startup.h"
 
 #ifdef XR_USE_GRAPHICS_API_OPENGL
 
 #include <common/gfxwrapper_opengl.h>
 #include <common/xr_linear.h>
+#include <array>
 
 namespace {
 constexpr float DarkSlateGray[] = {0.184313729f, 0.309803933f, 0.309803933f, 1.0f};
 
+// The persistently mapped instance ring has this many segments, one per render call in flight. A segment is only written
+// again once the fence placed after its draws has signaled.
+constexpr uint32_t InstanceRingSegments = 3;
+constexpr GLbitfield PersistentMapFlags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+// Layout of one glMultiDrawElementsIndirect command, fixed by the GL specification.
+struct DrawElementsIndirectCommand {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLuint baseVertex;
+    GLuint baseInstance;
+};
+
 static const char* VertexShaderGlsl = R"_(
     #version 410
 
     in vec3 VertexPos;
     in vec3 VertexColor;
+    in mat4 VertexModel;
 
     out vec3 PSVertexColor;
 
-    uniform mat4 ModelViewProjection;
+    uniform mat4 ViewProjection;
 
     void main() {
-       gl_Position = ModelViewProjection * vec4(VertexPos, 1.0);
+       gl_Position = ViewProjection * VertexModel * vec4(VertexPos, 1.0);
+       PSVertexColor = VertexColor;
+    }
+    )_";
+
+// Single-pass stereo variant: one view-projection per view, selected by gl_ViewID_OVR
+static const char* MultiviewVertexShaderGlsl = R"_(
+    #version 410
+    #extension GL_OVR_multiview2 : require
+
+    layout(num_views = 2) in;
+
+    in vec3 VertexPos;
+    in vec3 VertexColor;
+    in mat4 VertexModel;
+
+    out vec3 PSVertexColor;
+
+    uniform mat4 ViewProjection[2];
+
+    void main() {
+       gl_Position = ViewProjection[gl_ViewID_OVR] * VertexModel * vec4(VertexPos, 1.0);
        PSVertexColor = VertexColor;
     }
     )_";
@@ -42,8 +83,11 @@ static const char* FragmentShaderGlsl = R"_(
     }
     )_";
 
-struct OpenGLGraphicsPlugin : public IGraphicsPlugin {
-    OpenGLGraphicsPlugin(const std::shared_ptr<Options>& /*unused*/, const std::shared_ptr<IPlatformPlugin> /*unused*/&){};
+struct OpenGLGraphicsPlugin final : public IGraphicsPlugin {
+    OpenGLGraphicsPlugin(const std::shared_ptr<Options>& options, const std::shared_ptr<IPlatformPlugin> /*unused*/&)
+        : m_cacheDirectory(options->CacheDirectory),
+          m_instancing(options->Instancing),
+          m_gpuTimersRequested(options->FrameStats || options->DynamicResolution){};
 
     OpenGLGraphicsPlugin(const OpenGLGraphicsPlugin&) = delete;
     OpenGLGraphicsPlugin& operator=(const OpenGLGraphicsPlugin&) = delete;
@@ -57,21 +101,42 @@ struct OpenGLGraphicsPlugin : public IGraphicsPlugin {
         if (m_program != 0) {
             glDeleteProgram(m_program);
         }
+        if (m_multiviewProgram != 0) {
+            glDeleteProgram(m_multiviewProgram);
+        }
         if (m_vao != 0) {
             glDeleteVertexArrays(1, &m_vao);
         }
-        if (m_cubeVertexBuffer != 0) {
-            glDeleteBuffers(1, &m_cubeVertexBuffer);
+        ReleaseMeshes(0);
+        if (m_instanceBuffer != 0) {
+            glDeleteBuffers(1, &m_instanceBuffer);
+        }
+        if (m_indirectBuffer != 0) {
+            glDeleteBuffers(1, &m_indirectBuffer);
         }
-        if (m_cubeIndexBuffer != 0) {
-            glDeleteBuffers(1, &m_cubeIndexBuffer);
+        for (GLsync& fence : m_instanceRingFences) {
+            if (fence != nullptr) {
+                glDeleteSync(fence);
+            }
+        }
+        for (GpuTimerFrame& timerFrame : m_gpuTimerFrames.Frames()) {
+            if (timerFrame.queries[0] != 0) {
+                glDeleteQueries((GLsizei)timerFrame.queries.size(), timerFrame.queries.data());
+            }
         }
 
-        for (auto& colorToDepth : m_colorToDepthMap) {
-            if (colorToDepth.second != 0) {
-                glDeleteTextures(1, &colorToDepth.second);
+        ReleaseSwapchainImageContexts();
+    }
+
+    void ReleaseSwapchainImageContexts() {
+        for (const std::unique_ptr<SwapchainImageContext>& swapchainImageContext : m_swapchainImageContexts) {
+            for (uint32_t depthTexture : swapchainImageContext->depthTextures) {
+                if (depthTexture != 0) {
+                    glDeleteTextures(1, &depthTexture);
+                }
             }
         }
+        m_swapchainImageContexts.clear();
     }
 
     std::vector<std::string> GetInstanceExtensions() const override { return {XR_KHR_OPENGL_ENABLE_EXTENSION_NAME}; }
@@ -152,47 +217,257 @@ struct OpenGLGraphicsPlugin : public IGraphicsPlugin {
     void InitializeResources() {
         glGenFramebuffers(1, &m_swapchainFramebuffer);
 
-        GLuint vertexShader = glCreateShader(GL_VERTEX_SHADER);
-        glShaderSource(vertexShader, 1, &VertexShaderGlsl, nullptr);
-        glCompileShader(vertexShader);
-        CheckShader(vertexShader);
+        // Program binaries are only worth saving if the driver can produce them
+        GLint programBinaryFormats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &programBinaryFormats);
+        m_programBinaryCache = programBinaryFormats > 0 && !m_cacheDirectory.empty() && glProgramBinary != nullptr;
+
+        // Single-pass stereo needs GL_OVR_multiview2 for gl_ViewID_OVR in the vertex shader
+        m_multiviewSupported = glExtensions.multi_view && glFramebufferTextureMultiviewOVR != nullptr;
+        LOG_VERBOSE(Fmt("GL_OVR_multiview2 %s", m_multiviewSupported ? "supported" : "not supported"));
+
+        // The program binaries are read from the cache by a startup job while the cube is uploaded, then the programs are
+        // linked from them. Only the file reads leave this thread, every GL call stays where the context is current.
+        const std::vector<std::pair<GLint, const char*>> attribLocations{
+            {m_vertexAttribCoords, "VertexPos"}, {m_vertexAttribColor, "VertexColor"}, {m_vertexAttribModel, "VertexModel"}};
+        const std::string cacheFileName = ProgramCacheFileName(VertexShaderGlsl, FragmentShaderGlsl, attribLocations);
+        const std::string multiviewCacheFileName =
+            m_multiviewSupported ? ProgramCacheFileName(MultiviewVertexShaderGlsl, FragmentShaderGlsl, attribLocations) : "";
+        std::vector<uint8_t> binary;
+        std::vector<uint8_t> multiviewBinary;
+
+        JobGraph startupJobs;
+        const JobGraph::JobId readBinaries = AddStartupStage(startupJobs, "read program binaries", [&]() {
+            ReadProgramBinary(cacheFileName, binary);
+            ReadProgramBinary(multiviewCacheFileName, multiviewBinary);
+        });
+        AddStartupStage(
+            startupJobs, "upload cube geometry", [this]() { InitializeCubeGeometry(); }, {}, JobGraph::Thread::Waiting);
+        AddStartupStage(
+            startupJobs, "create programs",
+            [&]() {
+                m_program = CreateProgram("cube", VertexShaderGlsl, FragmentShaderGlsl, attribLocations, cacheFileName, binary);
+                m_viewProjectionUniformLocation = glGetUniformLocation(m_program, "ViewProjection");
+                if (m_multiviewSupported) {
+                    m_multiviewProgram = CreateProgram("multiview cube", MultiviewVertexShaderGlsl, FragmentShaderGlsl,
+                                                       attribLocations, multiviewCacheFileName, multiviewBinary);
+                    m_multiviewViewProjectionUniformLocation = glGetUniformLocation(m_multiviewProgram, "ViewProjection");
+                }
+            },
+            {readBinaries}, JobGraph::Thread::Waiting);
+        startupJobs.Wait();
+
+        // Timer queries are core since OpenGL 3.3
+        m_gpuTimers = m_gpuTimersRequested;
+        LOG_VERBOSE(Fmt("GPU timers %s", m_gpuTimers ? "enabled" : "disabled"));
+        if (m_gpuTimers) {
+            for (GpuTimerFrame& timerFrame : m_gpuTimerFrames.Frames()) {
+                glGenQueries((GLsizei)timerFrame.queries.size(), timerFrame.queries.data());
+            }
+        }
+    }
 
-        GLuint fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-        glShaderSource(fragmentShader, 1, &FragmentShaderGlsl, nullptr);
-        glCompileShader(fragmentShader);
-        CheckShader(fragmentShader);
+    // Upload the cube and set up the VAO and instance stream around it.
+    void InitializeCubeGeometry() {
+        AddMesh(CubeMeshData());
 
-        m_program = glCreateProgram();
-        glAttachShader(m_program, vertexShader);
-        glAttachShader(m_program, fragmentShader);
-        glLinkProgram(m_program);
-        CheckProgram(m_program);
+        // The vertex stream is pointed at the mesh of each draw in turn, see BindMesh.
+        glGenVertexArrays(1, &m_vao);
+        glBindVertexArray(m_vao);
+        glEnableVertexAttribArray(m_vertexAttribCoords);
+        glEnableVertexAttribArray(m_vertexAttribColor);
+        BindMesh(m_meshes[CubeMesh]);
 
-        glDeleteShader(vertexShader);
-        glDeleteShader(fragmentShader);
+        // Contexts with immutable buffer storage and indirect draws stream the instances through a persistently mapped ring
+        // and draw the cubes of each mesh with a single glMultiDrawElementsIndirect. The indirect command's baseInstance
+        // selects the ring segment and the mesh's first cube, so the instance attribute pointers never change. The per-cube
+        // path then issues one command per cube.
+        GLint major = 0;
+        GLint minor = 0;
+        glGetIntegerv(GL_MAJOR_VERSION, &major);
+        glGetIntegerv(GL_MINOR_VERSION, &minor);
+        const GLint version = major * 10 + minor;
+        const bool bufferStorage = version >= 44 || glExtensions.buffer_storage;
+        const bool multiDrawIndirect =
+            version >= 43 || (GlCheckExtension("GL_ARB_multi_draw_indirect") && GlCheckExtension("GL_ARB_base_instance"));
+        m_persistentInstances = bufferStorage && multiDrawIndirect && glBufferStorage != nullptr &&
+                                glMultiDrawElementsIndirect != nullptr && glFenceSync != nullptr;
+        LOG_VERBOSE(Fmt("Cubes are drawn with %s", m_persistentInstances ? "a persistently mapped ring and multi-draw-indirect"
+                                                                         : "a streamed instance buffer"));
+
+        // Per-instance model matrix, one column per attribute location. Without the ring the per-cube path leaves these
+        // arrays disabled and sets the columns as constant attribute values before each draw instead.
+        if (m_persistentInstances) {
+            GrowInstanceRing(1);
+        } else {
+            glGenBuffers(1, &m_instanceBuffer);
+            BindInstanceAttributes(m_instancing);
+        }
 
-        m_modelViewProjectionUniformLocation = glGetUniformLocation(m_program, "ModelViewProjection");
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
 
-        m_vertexAttribCoords = glGetAttribLocation(m_program, "VertexPos");
-        m_vertexAttribColor = glGetAttribLocation(m_program, "VertexColor");
+    // Point the model matrix attributes of the VAO at m_instanceBuffer, from model firstInstance on. Leaves the VAO bound.
+    void BindInstanceAttributes(bool enable, size_t firstInstance = 0) {
+        glBindVertexArray(m_vao);
+        glBindBuffer(GL_ARRAY_BUFFER, m_instanceBuffer);
+        for (GLuint column = 0; column < 4; ++column) {
+            const GLuint location = static_cast<GLuint>(m_vertexAttribModel) + column;
+            glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, sizeof(XrMatrix4x4f),
+                                  reinterpret_cast<const void*>(firstInstance * sizeof(XrMatrix4x4f) + column * 4 * sizeof(float)));
+            glVertexAttribDivisor(location, 1);
+            if (enable) {
+                glEnableVertexAttribArray(location);
+            }
+        }
+    }
 
-        glGenBuffers(1, &m_cubeVertexBuffer);
-        glBindBuffer(GL_ARRAY_BUFFER, m_cubeVertexBuffer);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(Geometry::c_cubeVertices), Geometry::c_cubeVertices, GL_STATIC_DRAW);
+    // Block until the GPU has finished the draws that read a ring segment.
+    void WaitForInstanceRingSegment(uint32_t segment) {
+        GLsync& fence = m_instanceRingFences[segment];
+        if (fence == nullptr) {
+            return;
+        }
 
-        glGenBuffers(1, &m_cubeIndexBuffer);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_cubeIndexBuffer);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(Geometry::c_cubeIndices), Geometry::c_cubeIndices, GL_STATIC_DRAW);
+        const auto waitStart = std::chrono::steady_clock::now();
+        GLenum result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+        if (result == GL_TIMEOUT_EXPIRED) {
+            do {
+                result = glClientWaitSync(fence, 0, 1000000);  // 1 ms
+            } while (result == GL_TIMEOUT_EXPIRED);
+            m_cpuWaitTime += std::chrono::steady_clock::now() - waitStart;
+        }
+        CHECK_MSG(result != GL_WAIT_FAILED, "glClientWaitSync failed");
+        glDeleteSync(fence);
+        fence = nullptr;
+    }
 
-        glGenVertexArrays(1, &m_vao);
-        glBindVertexArray(m_vao);
-        glEnableVertexAttribArray(m_vertexAttribCoords);
-        glEnableVertexAttribArray(m_vertexAttribColor);
-        glBindBuffer(GL_ARRAY_BUFFER, m_cubeVertexBuffer);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_cubeIndexBuffer);
-        glVertexAttribPointer(m_vertexAttribCoords, 3, GL_FLOAT, GL_FALSE, sizeof(Geometry::Vertex), nullptr);
-        glVertexAttribPointer(m_vertexAttribColor, 3, GL_FLOAT, GL_FALSE, sizeof(Geometry::Vertex),
-                              reinterpret_cast<const void*>(sizeof(XrVector3f)));
+    // Give every ring segment room for at least instanceCount cubes. Immutable storage cannot be respecified, so the ring
+    // buffers are replaced once nothing reads them anymore. Growth is geometric to keep this rare.
+    void GrowInstanceRing(size_t instanceCount) {
+        if (instanceCount <= m_instanceRingCapacity) {
+            return;
+        }
+        for (uint32_t segment = 0; segment < InstanceRingSegments; ++segment) {
+            WaitForInstanceRingSegment(segment);
+        }
+        m_instanceRingCapacity = std::max<size_t>({instanceCount, m_instanceRingCapacity * 2, 64});
+
+        if (m_instanceBuffer != 0) {
+            glDeleteBuffers(1, &m_instanceBuffer);
+        }
+        glGenBuffers(1, &m_instanceBuffer);
+        glBindBuffer(GL_ARRAY_BUFFER, m_instanceBuffer);
+        const GLsizeiptr instanceRingSize =
+            static_cast<GLsizeiptr>(InstanceRingSegments * m_instanceRingCapacity * sizeof(XrMatrix4x4f));
+        glBufferStorage(GL_ARRAY_BUFFER, instanceRingSize, nullptr, PersistentMapFlags);
+        m_instanceRing =
+            reinterpret_cast<XrMatrix4x4f*>(glMapBufferRange(GL_ARRAY_BUFFER, 0, instanceRingSize, PersistentMapFlags));
+        CHECK_MSG(m_instanceRing != nullptr, "Unable to map the instance ring");
+
+        // Room for one command per cube, which the per-cube path needs
+        if (m_indirectBuffer != 0) {
+            glDeleteBuffers(1, &m_indirectBuffer);
+        }
+        glGenBuffers(1, &m_indirectBuffer);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_indirectBuffer);
+        const GLsizeiptr indirectRingSize =
+            static_cast<GLsizeiptr>(InstanceRingSegments * m_instanceRingCapacity * sizeof(DrawElementsIndirectCommand));
+        glBufferStorage(GL_DRAW_INDIRECT_BUFFER, indirectRingSize, nullptr, PersistentMapFlags);
+        m_indirectRing = reinterpret_cast<DrawElementsIndirectCommand*>(
+            glMapBufferRange(GL_DRAW_INDIRECT_BUFFER, 0, indirectRingSize, PersistentMapFlags));
+        CHECK_MSG(m_indirectRing != nullptr, "Unable to map the indirect command ring");
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+        // Every cube reads its matrix from the stream, the per-cube path included.
+        BindInstanceAttributes(true);
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    GLuint CompileShader(GLenum type, const char* source) {
+        GLuint shader = glCreateShader(type);
+        glShaderSource(shader, 1, &source, nullptr);
+        glCompileShader(shader);
+        CheckShader(shader);
+        return shader;
+    }
+
+    // Name of the cache file for the binary of a program linked from these sources and attribute locations by this driver.
+    std::string ProgramCacheFileName(const char* vertexSource, const char* fragmentSource,
+                                     const std::vector<std::pair<GLint, const char*>>& attribLocations) const {
+        CacheKey key;
+        key.Add(vertexSource).Add(fragmentSource);
+        for (const auto& attribLocation : attribLocations) {
+            key.Add((uint64_t)attribLocation.first).Add(attribLocation.second);
+        }
+        key.Add(reinterpret_cast<const char*>(glGetString(GL_VENDOR)))
+            .Add(reinterpret_cast<const char*>(glGetString(GL_RENDERER)))
+            .Add(reinterpret_cast<const char*>(glGetString(GL_VERSION)));
+        return key.FileName("gl_program");
+    }
+
+    // Read a cache file for CreateProgram, leaving binary empty if there is none. Makes no GL calls, so it runs on any
+    // thread.
+    void ReadProgramBinary(const std::string& cacheFileName, std::vector<uint8_t>& binary) const {
+        if (!m_programBinaryCache || cacheFileName.empty() || !ReadCacheFile(m_cacheDirectory, cacheFileName.c_str(), binary)) {
+            binary.clear();
+        }
+    }
+
+    // Link a program from GLSL source, or load binary, the contents of the cache file a previous run saved for the same
+    // sources, attribute locations and driver, which ReadProgramBinary read. A binary the driver rejects, for example after a
+    // driver update, is rebuilt and replaced.
+    GLuint CreateProgram(const char* name, const char* vertexSource, const char* fragmentSource,
+                         const std::vector<std::pair<GLint, const char*>>& attribLocations, const std::string& cacheFileName,
+                         std::vector<uint8_t>& binary) {
+        // Cache files hold the binary format followed by the binary
+        if (binary.size() > sizeof(GLenum)) {
+            GLenum binaryFormat = 0;
+            memcpy(&binaryFormat, binary.data(), sizeof(binaryFormat));
+            GLuint program = glCreateProgram();
+            glProgramBinary(program, binaryFormat, binary.data() + sizeof(binaryFormat),
+                            (GLsizei)(binary.size() - sizeof(binaryFormat)));
+            GLint linked = GL_FALSE;
+            glGetProgramiv(program, GL_LINK_STATUS, &linked);
+            if (linked == GL_TRUE) {
+                LOG_VERBOSE(Fmt("Loaded %s program from the shader cache", name));
+                return program;
+            }
+            Log::Write(Log::Level::Info, Fmt("Driver rejected the cached %s program, rebuilding it", name));
+            glDeleteProgram(program);
+        }
+
+        const GLuint vertexShader = CompileShader(GL_VERTEX_SHADER, vertexSource);
+        const GLuint fragmentShader = CompileShader(GL_FRAGMENT_SHADER, fragmentSource);
+        GLuint program = glCreateProgram();
+        glAttachShader(program, vertexShader);
+        glAttachShader(program, fragmentShader);
+        for (const auto& attribLocation : attribLocations) {
+            glBindAttribLocation(program, attribLocation.first, attribLocation.second);
+        }
+        if (m_programBinaryCache) {
+            glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        }
+        glLinkProgram(program);
+        CheckProgram(program);
+        glDeleteShader(vertexShader);
+        glDeleteShader(fragmentShader);
+
+        if (m_programBinaryCache) {
+            GLint binaryLength = 0;
+            glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &binaryLength);
+            if (binaryLength > 0) {
+                GLenum binaryFormat = 0;
+                binary.resize(sizeof(binaryFormat) + binaryLength);
+                glGetProgramBinary(program, binaryLength, &binaryLength, &binaryFormat, binary.data() + sizeof(binaryFormat));
+                memcpy(binary.data(), &binaryFormat, sizeof(binaryFormat));
+                binary.resize(sizeof(binaryFormat) + binaryLength);
+                WriteCacheFile(m_cacheDirectory, cacheFileName.c_str(), binary);
+            }
+        }
+        return program;
     }
 
     void CheckShader(GLuint shader) {
@@ -217,6 +492,74 @@ struct OpenGLGraphicsPlugin : public IGraphicsPlugin {
         }
     }
 
+    // A GL context is not tied to an adapter the runtime names, so it is kept whenever its version is still supported.
+    bool ReuseDevice(XrInstance instance, XrSystemId systemId) override {
+        if (m_swapchainFramebuffer == 0) {
+            return false;
+        }
+
+        PFN_xrGetOpenGLGraphicsRequirementsKHR pfnGetOpenGLGraphicsRequirementsKHR = nullptr;
+        CHECK_XRCMD(xrGetInstanceProcAddr(instance, "xrGetOpenGLGraphicsRequirementsKHR",
+                                          reinterpret_cast<PFN_xrVoidFunction*>(&pfnGetOpenGLGraphicsRequirementsKHR)));
+        XrGraphicsRequirementsOpenGLKHR graphicsRequirements{XR_TYPE_GRAPHICS_REQUIREMENTS_OPENGL_KHR};
+        CHECK_XRCMD(pfnGetOpenGLGraphicsRequirementsKHR(instance, systemId, &graphicsRequirements));
+
+        GLint major = 0;
+        GLint minor = 0;
+        glGetIntegerv(GL_MAJOR_VERSION, &major);
+        glGetIntegerv(GL_MINOR_VERSION, &minor);
+        if (graphicsRequirements.minApiVersionSupported > XR_MAKE_VERSION(major, minor, 0)) {
+            return false;
+        }
+
+        // The images of the old swapchains are gone, so nothing may still be rendering into them.
+        glFinish();
+        ReleaseSwapchainImageContexts();
+        ReleaseMeshes(CubeMesh + 1);
+        return true;
+    }
+
+    // The driver copies the data during glBufferData, so a mapped mesh file goes straight into the buffers.
+    uint32_t AddMesh(const MeshData& mesh) override {
+        // The element array binding belongs to the VAO, keep the upload from changing it.
+        glBindVertexArray(0);
+
+        MeshBuffers buffers;
+        glGenBuffers(1, &buffers.vertexBuffer);
+        glBindBuffer(GL_ARRAY_BUFFER, buffers.vertexBuffer);
+        glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizeiptr>(mesh.VertexBytes()), mesh.Vertices, GL_STATIC_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        glGenBuffers(1, &buffers.indexBuffer);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers.indexBuffer);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, static_cast<GLsizeiptr>(mesh.IndexBytes()), mesh.Indices, GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+        buffers.lods = mesh.Lods;
+        buffers.indexType = mesh.IndexSize == sizeof(uint32_t) ? GL_UNSIGNED_INT : GL_UNSIGNED_SHORT;
+        m_meshes.push_back(buffers);
+        return static_cast<uint32_t>(m_meshes.size() - 1);
+    }
+
+    // Delete the meshes from mesh ID first on.
+    void ReleaseMeshes(size_t first) {
+        for (size_t mesh = first; mesh < m_meshes.size(); ++mesh) {
+            glDeleteBuffers(1, &m_meshes[mesh].vertexBuffer);
+            glDeleteBuffers(1, &m_meshes[mesh].indexBuffer);
+        }
+        m_meshes.resize(std::min(first, m_meshes.size()));
+    }
+
+    // Point the vertex attributes and element array of the bound VAO at a mesh.
+    void BindMesh(const MeshBuffers& mesh) {
+        glBindBuffer(GL_ARRAY_BUFFER, mesh.vertexBuffer);
+        glVertexAttribPointer(m_vertexAttribCoords, 3, GL_FLOAT, GL_FALSE, sizeof(Geometry::Vertex), nullptr);
+        glVertexAttribPointer(m_vertexAttribColor, 3, GL_FLOAT, GL_FALSE, sizeof(Geometry::Vertex),
+                              reinterpret_cast<const void*>(sizeof(XrVector3f)));
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.indexBuffer);
+    }
+
     int64_t SelectColorSwapchainFormat(const std::vector<int64_t>& runtimeFormats) const override {
         // List of supported color swapchain formats.
         constexpr int64_t SupportedColorSwapchainFormats[] = {
@@ -238,64 +581,269 @@ struct OpenGLGraphicsPlugin : public IGraphicsPlugin {
         return *swapchainFormatIt;
     }
 
+    std::vector<ColorFormatInfo> GetColorSwapchainFormatCandidates() const override {
+        return {{GL_SRGB8_ALPHA8, "GL_SRGB8_ALPHA8", 4, 8, 8, true, true},
+                {GL_RGBA8, "GL_RGBA8", 4, 8, 8, false, true},
+                {GL_RGBA8_SNORM, "GL_RGBA8_SNORM", 4, 7, 7, false, false},
+                {GL_RGB10_A2, "GL_RGB10_A2", 4, 10, 2, false, true},
+                {GL_R11F_G11F_B10F, "GL_R11F_G11F_B10F", 4, 10, 0, false, true},
+                {GL_RGBA16F, "GL_RGBA16F", 8, 16, 16, false, false}};
+    }
+
+    int64_t SelectDepthSwapchainFormat(const std::vector<int64_t>& runtimeFormats) const override {
+        // Depth-only formats, so the swapchain can be attached as GL_DEPTH_ATTACHMENT like the private depth textures.
+        constexpr int64_t SupportedDepthSwapchainFormats[] = {GL_DEPTH_COMPONENT32F, GL_DEPTH_COMPONENT32, GL_DEPTH_COMPONENT24,
+                                                              GL_DEPTH_COMPONENT16};
+
+        auto swapchainFormatIt =
+            std::find_first_of(runtimeFormats.begin(), runtimeFormats.end(), std::begin(SupportedDepthSwapchainFormats),
+                               std::end(SupportedDepthSwapchainFormats));
+        return swapchainFormatIt != runtimeFormats.end() ? *swapchainFormatIt : -1;
+    }
+
     const XrBaseInStructure* GetGraphicsBinding() const override {
         return reinterpret_cast<const XrBaseInStructure*>(&m_graphicsBinding);
     }
 
-    std::vector<XrSwapchainImageBaseHeader*> AllocateSwapchainImageStructs(
-        uint32_t capacity, const XrSwapchainCreateInfo& /*swapchainCreateInfo*/) override {
+    uint32_t AllocateSwapchainImageStructs(uint32_t capacity, const XrSwapchainCreateInfo& swapchainCreateInfo,
+                                           std::vector<XrSwapchainImageBaseHeader*>& swapchainImages) override {
         // Allocate and initialize the buffer of image structs (must be sequential in memory for xrEnumerateSwapchainImages).
         // Return back an array of pointers to each swapchain image struct so the consumer doesn't need to know the type/size.
-        std::vector<XrSwapchainImageOpenGLKHR> swapchainImageBuffer(capacity);
-        std::vector<XrSwapchainImageBaseHeader*> swapchainImageBase;
-        for (XrSwapchainImageOpenGLKHR& image : swapchainImageBuffer) {
-            image.type = XR_TYPE_SWAPCHAIN_IMAGE_OPENGL_KHR;
-            swapchainImageBase.push_back(reinterpret_cast<XrSwapchainImageBaseHeader*>(&image));
+        // Keep the buffer alive by adding it into the table of contexts, whose index identifies the swapchain.
+        const uint32_t swapchainIndex = (uint32_t)m_swapchainImageContexts.size();
+        m_swapchainImageContexts.push_back(std::make_unique<SwapchainImageContext>());
+        SwapchainImageContext& swapchainImageContext = *m_swapchainImageContexts.back();
+
+        swapchainImageContext.images.resize(capacity, {XR_TYPE_SWAPCHAIN_IMAGE_OPENGL_KHR});
+        // Depth swapchains are rendered into directly and need no depth textures of their own.
+        if ((swapchainCreateInfo.usageFlags & XR_SWAPCHAIN_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT) == 0) {
+            swapchainImageContext.depthTextures.resize(capacity, 0);
+        }
+        swapchainImages.clear();
+        for (XrSwapchainImageOpenGLKHR& image : swapchainImageContext.images) {
+            swapchainImages.push_back(reinterpret_cast<XrSwapchainImageBaseHeader*>(&image));
         }
 
-        // Keep the buffer alive by moving it into the list of buffers.
-        m_swapchainImageBuffers.push_back(std::move(swapchainImageBuffer));
+        return swapchainIndex;
+    }
 
-        return swapchainImageBase;
+    uint32_t GetColorTexture(const SwapchainImage& swapchainImage) const {
+        return m_swapchainImageContexts[swapchainImage.swapchainIndex]->images[swapchainImage.imageIndex].image;
     }
 
-    uint32_t GetDepthTexture(uint32_t colorTexture) {
+    // arraySize > 1 means the color texture is a GL_TEXTURE_2D_ARRAY and gets a depth array with matching layer count.
+    uint32_t GetDepthTexture(const SwapchainImage& swapchainImage, GLsizei arraySize = 1) {
+        if (swapchainImage.depthSwapchainIndex != NoDepthSwapchain) {
+            return m_swapchainImageContexts[swapchainImage.depthSwapchainIndex]->images[swapchainImage.depthImageIndex].image;
+        }
+
         // If a depth-stencil view has already been created for this back-buffer, use it.
-        auto depthBufferIt = m_colorToDepthMap.find(colorTexture);
-        if (depthBufferIt != m_colorToDepthMap.end()) {
-            return depthBufferIt->second;
+        uint32_t& depthTexture = m_swapchainImageContexts[swapchainImage.swapchainIndex]->depthTextures[swapchainImage.imageIndex];
+        if (depthTexture != 0) {
+            return depthTexture;
         }
 
         // This back-buffer has no corresponding depth-stencil texture, so create one with matching dimensions.
+        const uint32_t colorTexture = GetColorTexture(swapchainImage);
+        const GLenum target = arraySize > 1 ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_2D;
 
         GLint width;
         GLint height;
-        glBindTexture(GL_TEXTURE_2D, colorTexture);
-        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width);
-        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &height);
+        glBindTexture(target, colorTexture);
+        glGetTexLevelParameteriv(target, 0, GL_TEXTURE_WIDTH, &width);
+        glGetTexLevelParameteriv(target, 0, GL_TEXTURE_HEIGHT, &height);
 
-        uint32_t depthTexture;
         glGenTextures(1, &depthTexture);
-        glBindTexture(GL_TEXTURE_2D, depthTexture);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT32, width, height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
-
-        m_colorToDepthMap.insert(std::make_pair(colorTexture, depthTexture));
+        glBindTexture(target, depthTexture);
+        glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        if (arraySize > 1) {
+            glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT32, width, height, arraySize, 0, GL_DEPTH_COMPONENT, GL_FLOAT,
+                         nullptr);
+        } else {
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT32, width, height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+        }
 
         return depthTexture;
     }
 
-    void RenderView(const XrCompositionLayerProjectionView& layerView, const XrSwapchainImageBaseHeader* swapchainImage,
-                    int64_t swapchainFormat, const std::vector<Cube>& cubes) override {
+    static XrMatrix4x4f ComputeViewProjection(const XrCompositionLayerProjectionView& layerView) {
+        const auto& pose = layerView.pose;
+        XrMatrix4x4f proj;
+        XrMatrix4x4f_CreateProjectionFov(&proj, GRAPHICS_OPENGL, layerView.fov, 0.05f, 100.0f);
+        XrMatrix4x4f toView;
+        XrVector3f scale{1.f, 1.f, 1.f};
+        XrMatrix4x4f_CreateTranslationRotationScale(&toView, &pose.position, &pose.orientation, &scale);
+        XrMatrix4x4f view;
+        XrMatrix4x4f_InvertRigidBody(&view, &toView);
+        XrMatrix4x4f vp;
+        XrMatrix4x4f_Multiply(&vp, &proj, &view);
+        return vp;
+    }
+
+    // Keep the frame's model transforms and mesh draws for DrawCubes. The instanced path also streams the transforms into
+    // the instance buffer. With the persistent ring they, and the indirect commands that draw them, go into the next free
+    // segment instead: one command per draw, or per cube with the per-cube path.
+    void UploadInstances(const std::vector<XrMatrix4x4f>& cubeModels, const std::vector<MeshDraw>& meshDraws) {
+        m_instanceModels = &cubeModels;
+        m_meshDraws = meshDraws;
+
+        if (m_persistentInstances) {
+            // Every draw from the current segment has been issued, fence it before moving on
+            m_instanceRingFences[m_instanceRingSegment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            m_instanceRingSegment = (m_instanceRingSegment + 1) % InstanceRingSegments;
+            GrowInstanceRing(cubeModels.size());
+            WaitForInstanceRingSegment(m_instanceRingSegment);
+
+            const size_t first = m_instanceRingSegment * m_instanceRingCapacity;
+            if (!cubeModels.empty()) {
+                memcpy(m_instanceRing + first, cubeModels.data(), cubeModels.size() * sizeof(XrMatrix4x4f));
+            }
+
+            DrawElementsIndirectCommand* commands = m_indirectRing + first;
+            GLuint baseInstance = static_cast<GLuint>(first);
+            for (const MeshDraw& draw : meshDraws) {
+                const MeshLod& lod = m_meshes[draw.Mesh].lods[draw.Lod];
+                if (m_instancing) {
+                    *commands++ = {lod.IndexCount, draw.InstanceCount, lod.FirstIndex, 0, baseInstance};
+                } else {
+                    for (uint32_t i = 0; i < draw.InstanceCount; ++i) {
+                        *commands++ = {lod.IndexCount, 1, lod.FirstIndex, 0, baseInstance + i};
+                    }
+                }
+                baseInstance += draw.InstanceCount;
+            }
+            return;
+        }
+
+        if (m_instancing) {
+            // Respecifying the whole store lets the driver orphan the previous contents instead of stalling on them
+            glBindBuffer(GL_ARRAY_BUFFER, m_instanceBuffer);
+            glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizeiptr>(cubeModels.size() * sizeof(XrMatrix4x4f)), cubeModels.data(),
+                         GL_STREAM_DRAW);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+        }
+    }
+
+    // Draw every uploaded cube with its mesh and the bound program and VAO, as one instanced draw per mesh or as one draw
+    // per cube.
+    void DrawCubes() {
+        size_t firstInstance = 0;
+        size_t firstCommand = m_instanceRingSegment * m_instanceRingCapacity;
+        for (const MeshDraw& draw : m_meshDraws) {
+            const MeshBuffers& mesh = m_meshes[draw.Mesh];
+            const MeshLod& lod = mesh.lods[draw.Lod];
+            BindMesh(mesh);
+
+            if (m_persistentInstances) {
+                const GLsizei commandCount = m_instancing ? 1 : static_cast<GLsizei>(draw.InstanceCount);
+                glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_indirectBuffer);
+                glMultiDrawElementsIndirect(GL_TRIANGLES, mesh.indexType,
+                                            reinterpret_cast<const void*>(firstCommand * sizeof(DrawElementsIndirectCommand)),
+                                            commandCount, 0);
+                glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+                firstCommand += commandCount;
+            } else if (m_instancing) {
+                // Without base instances the attribute pointers move to the mesh's first cube instead.
+                BindInstanceAttributes(true, firstInstance);
+                glDrawElementsInstanced(GL_TRIANGLES, static_cast<GLsizei>(lod.IndexCount), mesh.indexType, mesh.FirstIndex(lod),
+                                        static_cast<GLsizei>(draw.InstanceCount));
+            } else {
+                for (uint32_t i = 0; i < draw.InstanceCount; ++i) {
+                    const XrMatrix4x4f& model = (*m_instanceModels)[firstInstance + i];
+                    for (GLuint column = 0; column < 4; ++column) {
+                        glVertexAttrib4fv(static_cast<GLuint>(m_vertexAttribModel) + column, &model.m[column * 4]);
+                    }
+                    glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(lod.IndexCount), mesh.indexType, mesh.FirstIndex(lod));
+                }
+            }
+            firstInstance += draw.InstanceCount;
+        }
+    }
+
+    // Move to the next set of timer queries, first reading back the frame that last used it if its results are in. Results
+    // that are not available yet are dropped rather than waited on.
+    void BeginGpuTimerFrame() {
+        if (!m_gpuTimers) {
+            return;
+        }
+
+        GpuTimerFrame& timerFrame = m_gpuTimerFrames.Advance();
+        const uint32_t viewCount = timerFrame.TimedViews.Take();
+        if (viewCount == 0) {
+            return;
+        }
+
+        GLuint available = GL_FALSE;
+        glGetQueryObjectuiv(timerFrame.queries[viewCount - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (available == GL_FALSE) {
+            return;
+        }
+
+        std::vector<uint64_t>& viewNanoseconds = m_gpuViewTimes.Store(viewCount);
+        for (uint32_t view = 0; view < viewCount; ++view) {
+            GLuint64 elapsed = 0;
+            glGetQueryObjectui64v(timerFrame.queries[view], GL_QUERY_RESULT, &elapsed);
+            viewNanoseconds[view] = elapsed;
+        }
+    }
+
+    void BeginGpuViewTimer() {
+        GpuTimerFrame& timerFrame = m_gpuTimerFrames.Current();
+        if (m_gpuTimers && timerFrame.TimedViews.CanTime()) {
+            glBeginQuery(GL_TIME_ELAPSED, timerFrame.queries[timerFrame.TimedViews.Count]);
+        }
+    }
+
+    void EndGpuViewTimer() {
+        GpuTimerFrame& timerFrame = m_gpuTimerFrames.Current();
+        if (m_gpuTimers && timerFrame.TimedViews.CanTime()) {
+            glEndQuery(GL_TIME_ELAPSED);
+            timerFrame.TimedViews.Timed();
+        }
+    }
+
+    std::chrono::nanoseconds TakeCpuWaitTime() override {
+        const std::chrono::nanoseconds cpuWaitTime = m_cpuWaitTime;
+        m_cpuWaitTime = {};
+        return cpuWaitTime;
+    }
+
+    bool TakeGpuViewTimes(std::vector<uint64_t>& viewNanoseconds) override { return m_gpuViewTimes.Take(viewNanoseconds); }
+
+    void RenderView(const XrCompositionLayerProjectionView& layerView, const SwapchainImage& swapchainImage,
+                    int64_t swapchainFormat, const std::vector<XrMatrix4x4f>& cubeModels,
+                    const std::vector<MeshDraw>& meshDraws) override {
+        UploadInstances(cubeModels, meshDraws);
+        RenderUploadedCubes(layerView, swapchainImage, swapchainFormat);
+    }
+
+    void RenderViews(const std::vector<XrCompositionLayerProjectionView>& layerViews,
+                     const std::vector<SwapchainImage>& swapchainImages, int64_t swapchainFormat,
+                     const std::vector<XrMatrix4x4f>& cubeModels, const std::vector<MeshDraw>& meshDraws) override {
+        CHECK(layerViews.size() == swapchainImages.size());
+
+        BeginGpuTimerFrame();
+
+        // The model transforms are shared by every view, so they are only uploaded once.
+        UploadInstances(cubeModels, meshDraws);
+        for (size_t i = 0; i < layerViews.size(); ++i) {
+            BeginGpuViewTimer();
+            RenderUploadedCubes(layerViews[i], swapchainImages[i], swapchainFormat);
+            EndGpuViewTimer();
+        }
+    }
+
+    void RenderUploadedCubes(const XrCompositionLayerProjectionView& layerView, const SwapchainImage& swapchainImage,
+                             int64_t swapchainFormat) {
         CHECK(layerView.subImage.imageArrayIndex == 0);  // Texture arrays not supported.
         UNUSED_PARM(swapchainFormat);                    // Not used in this function for now.
 
         glBindFramebuffer(GL_FRAMEBUFFER, m_swapchainFramebuffer);
 
-        const uint32_t colorTexture = reinterpret_cast<const XrSwapchainImageOpenGLKHR*>(swapchainImage)->image;
+        const uint32_t colorTexture = GetColorTexture(swapchainImage);
 
         glViewport(static_cast<GLint>(layerView.subImage.imageRect.offset.x),
                    static_cast<GLint>(layerView.subImage.imageRect.offset.y),
@@ -307,7 +855,7 @@ struct OpenGLGraphicsPlugin : public IGraphicsPlugin {
         glEnable(GL_CULL_FACE);
         glEnable(GL_DEPTH_TEST);
 
-        const uint32_t depthTexture = GetDepthTexture(colorTexture);
+        const uint32_t depthTexture = GetDepthTexture(swapchainImage);
 
         glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, colorTexture, 0);
         glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
@@ -320,32 +868,12 @@ struct OpenGLGraphicsPlugin : public IGraphicsPlugin {
         // Set shaders and uniform variables.
         glUseProgram(m_program);
 
-        const auto& pose = layerView.pose;
-        XrMatrix4x4f proj;
-        XrMatrix4x4f_CreateProjectionFov(&proj, GRAPHICS_OPENGL, layerView.fov, 0.05f, 100.0f);
-        XrMatrix4x4f toView;
-        XrVector3f scale{1.f, 1.f, 1.f};
-        XrMatrix4x4f_CreateTranslationRotationScale(&toView, &pose.position, &pose.orientation, &scale);
-        XrMatrix4x4f view;
-        XrMatrix4x4f_InvertRigidBody(&view, &toView);
-        XrMatrix4x4f vp;
-        XrMatrix4x4f_Multiply(&vp, &proj, &view);
+        const XrMatrix4x4f vp = ComputeViewProjection(layerView);
+        glUniformMatrix4fv(m_viewProjectionUniformLocation, 1, GL_FALSE, reinterpret_cast<const GLfloat*>(&vp));
 
-        // Set cube primitive data.
+        // Set cube primitive data and draw the cubes.
         glBindVertexArray(m_vao);
-
-        // Render each cube
-        for (const Cube& cube : cubes) {
-            // Compute the model-view-projection transform and set it..
-            XrMatrix4x4f model;
-            XrMatrix4x4f_CreateTranslationRotationScale(&model, &cube.Pose.position, &cube.Pose.orientation, &cube.Scale);
-            XrMatrix4x4f mvp;
-            XrMatrix4x4f_Multiply(&mvp, &vp, &model);
-            glUniformMatrix4fv(m_modelViewProjectionUniformLocation, 1, GL_FALSE, reinterpret_cast<const GLfloat*>(&mvp));
-
-            // Draw the cube.
-            glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(ArraySize(Geometry::c_cubeIndices)), GL_UNSIGNED_SHORT, nullptr);
-        }
+        DrawCubes();
 
         glBindVertexArray(0);
         glUseProgram(0);
@@ -358,6 +886,74 @@ struct OpenGLGraphicsPlugin : public IGraphicsPlugin {
         }
     }
 
+    bool SupportsMultiview() const override { return m_multiviewSupported; }
+
+    // The runtime foveates GL textures itself, the rendering does not change.
+    bool SupportsSwapchainFoveation() const override { return true; }
+
+    void RenderMultiview(const std::vector<XrCompositionLayerProjectionView>& layerViews,
+                         const SwapchainImage& swapchainImage, int64_t swapchainFormat,
+                         const std::vector<XrMatrix4x4f>& cubeModels, const std::vector<MeshDraw>& meshDraws) override {
+        CHECK(m_multiviewSupported);
+        CHECK(layerViews.size() == 2);  // The multiview shader holds one view-projection per eye.
+        UNUSED_PARM(swapchainFormat);    // Not used in this function for now.
+
+        const GLsizei numViews = static_cast<GLsizei>(layerViews.size());
+
+        // Both views are drawn together, so they share one timer.
+        BeginGpuTimerFrame();
+        BeginGpuViewTimer();
+
+        glBindFramebuffer(GL_FRAMEBUFFER, m_swapchainFramebuffer);
+
+        const uint32_t colorTexture = GetColorTexture(swapchainImage);
+
+        // All views share the same image rect, only the array layer differs.
+        const XrRect2Di& imageRect = layerViews[0].subImage.imageRect;
+        glViewport(static_cast<GLint>(imageRect.offset.x), static_cast<GLint>(imageRect.offset.y),
+                   static_cast<GLsizei>(imageRect.extent.width), static_cast<GLsizei>(imageRect.extent.height));
+
+        glFrontFace(GL_CW);
+        glCullFace(GL_BACK);
+        glEnable(GL_CULL_FACE);
+        glEnable(GL_DEPTH_TEST);
+
+        const uint32_t depthTexture = GetDepthTexture(swapchainImage, numViews);
+
+        glFramebufferTextureMultiviewOVR(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, colorTexture, 0, 0, numViews);
+        glFramebufferTextureMultiviewOVR(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depthTexture, 0, 0, numViews);
+
+        // Clear swapchain and depth buffer, this clears every view.
+        glClearColor(DarkSlateGray[0], DarkSlateGray[1], DarkSlateGray[2], DarkSlateGray[3]);
+        glClearDepth(1.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+
+        UploadInstances(cubeModels, meshDraws);
+
+        glUseProgram(m_multiviewProgram);
+
+        std::array<XrMatrix4x4f, 2> vp;
+        for (size_t view = 0; view < vp.size(); ++view) {
+            CHECK(layerViews[view].subImage.imageArrayIndex == view);
+            vp[view] = ComputeViewProjection(layerViews[view]);
+        }
+        glUniformMatrix4fv(m_multiviewViewProjectionUniformLocation, numViews, GL_FALSE,
+                           reinterpret_cast<const GLfloat*>(vp.data()));
+
+        // Each cube is drawn once for both views, gl_ViewID_OVR selects the view-projection
+        glBindVertexArray(m_vao);
+        DrawCubes();
+
+        glBindVertexArray(0);
+        glUseProgram(0);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        EndGpuViewTimer();
+
+        // Both eyes are done, swap our window for RenderDoc
+        ksGpuWindow_SwapBuffers(&window);
+    }
+
    private:
 #ifdef XR_USE_PLATFORM_WIN32
     XrGraphicsBindingOpenGLWin32KHR m_graphicsBinding{XR_TYPE_GRAPHICS_BINDING_OPENGL_WIN32_KHR};
@@ -369,18 +965,63 @@ struct OpenGLGraphicsPlugin : public IGraphicsPlugin {
     XrGraphicsBindingOpenGLWaylandKHR m_graphicsBinding{XR_TYPE_GRAPHICS_BINDING_OPENGL_WAYLAND_KHR};
 #endif
 
-    std::list<std::vector<XrSwapchainImageOpenGLKHR>> m_swapchainImageBuffers;
+    // The images of one swapchain and the depth textures that go with them, which are created on first use unless a depth
+    // swapchain is rendered into instead.
+    struct SwapchainImageContext {
+        std::vector<XrSwapchainImageOpenGLKHR> images;  // Packed for xrEnumerateSwapchainImages.
+        std::vector<uint32_t> depthTextures;
+    };
+    std::vector<std::unique_ptr<SwapchainImageContext>> m_swapchainImageContexts;  // Indexed by SwapchainImage::swapchainIndex.
     GLuint m_swapchainFramebuffer{0};
     GLuint m_program{0};
-    GLint m_modelViewProjectionUniformLocation{0};
-    GLint m_vertexAttribCoords{0};
-    GLint m_vertexAttribColor{0};
+    GLint m_viewProjectionUniformLocation{0};
+    bool m_multiviewSupported{false};
+    GLuint m_multiviewProgram{0};
+    GLint m_multiviewViewProjectionUniformLocation{0};
+    // Bound in every program rather than queried, so the programs share the VAO and their cache files are known before any
+    // of them is linked.
+    const GLint m_vertexAttribCoords{0};
+    const GLint m_vertexAttribColor{1};
+    const GLint m_vertexAttribModel{2};  // First of four consecutive locations, one per matrix column
     GLuint m_vao{0};
-    GLuint m_cubeVertexBuffer{0};
-    GLuint m_cubeIndexBuffer{0};
 
-    // Map color buffer to associated depth buffer. This map is populated on demand.
-    std::map<uint32_t, uint32_t> m_colorToDepthMap;
+    // GPU copy of a mesh added with AddMesh.
+    struct MeshBuffers {
+        GLuint vertexBuffer{0};
+        GLuint indexBuffer{0};
+        std::array<MeshLod, MaxMeshLods> lods{};  // Index ranges
+        GLenum indexType{GL_UNSIGNED_SHORT};
+
+        // Offset of a level of detail's first index into the element array.
+        const void* FirstIndex(const MeshLod& lod) const {
+            const size_t indexSize = indexType == GL_UNSIGNED_INT ? sizeof(GLuint) : sizeof(GLushort);
+            return reinterpret_cast<const void*>(lod.FirstIndex * indexSize);
+        }
+    };
+    std::vector<MeshBuffers> m_meshes;  // Indexed by mesh ID
+    GLuint m_instanceBuffer{0};
+    const std::vector<XrMatrix4x4f>* m_instanceModels{nullptr};  // Set by UploadInstances for the current render call.
+    std::vector<MeshDraw> m_meshDraws;                           // Same
+    bool m_persistentInstances{false};
+    XrMatrix4x4f* m_instanceRing{nullptr};  // Persistently mapped m_instanceBuffer, InstanceRingSegments segments
+    GLuint m_indirectBuffer{0};
+    DrawElementsIndirectCommand* m_indirectRing{nullptr};  // Persistently mapped m_indirectBuffer, same segments
+    size_t m_instanceRingCapacity{0};                      // Cubes per segment
+    uint32_t m_instanceRingSegment{0};                     // Segment of the current render call
+    std::array<GLsync, InstanceRingSegments> m_instanceRingFences{};
+    std::chrono::nanoseconds m_cpuWaitTime{0};
+    const std::string m_cacheDirectory;
+    bool m_programBinaryCache{false};
+    const bool m_instancing;
+
+    struct GpuTimerFrame {
+        std::array<GLuint, MaxGpuTimerViews> queries{};
+        GpuTimedViews TimedViews;
+    };
+    const bool m_gpuTimersRequested;
+    bool m_gpuTimers{false};
+    GpuTimerRing<GpuTimerFrame> m_gpuTimerFrames;
+    GpuViewTimes m_gpuViewTimes;
 };
 }  // namespace
 
@@ -6,11 +6,16 @@
 #include "common.h"
 #include "geometry.h"
 #include "graphicsplugin.h"
+#include "options.h"
+#include "cachefile.h"
+#include "gputimers.h"
+#include "startup.h"
 
 #ifdef XR_USE_GRAPHICS_API_OPENGL_ES
 
 #include "common/gfxwrapper_opengl.h"
 #include <common/xr_linear.h>
+#include <array>
 
 namespace {
 constexpr float DarkSlateGray[] = {0.184313729f, 0.309803933f, 0.309803933f, 1.0f};
@@ -20,13 +25,35 @@ static const char* VertexShaderGlsl = R"_(
 
     in vec3 VertexPos;
     in vec3 VertexColor;
+    in mat4 VertexModel;
 
     out vec3 PSVertexColor;
 
-    uniform mat4 ModelViewProjection;
+    uniform mat4 ViewProjection;
 
     void main() {
-       gl_Position = ModelViewProjection * vec4(VertexPos, 1.0);
+       gl_Position = ViewProjection * VertexModel * vec4(VertexPos, 1.0);
+       PSVertexColor = VertexColor;
+    }
+    )_";
+
+// Single-pass stereo variant: one view-projection per view, selected by gl_ViewID_OVR
+static const char* MultiviewVertexShaderGlsl = R"_(
+    #version 320 es
+    #extension GL_OVR_multiview2 : require
+
+    layout(num_views = 2) in;
+
+    in vec3 VertexPos;
+    in vec3 VertexColor;
+    in mat4 VertexModel;
+
+    out vec3 PSVertexColor;
+
+    uniform mat4 ViewProjection[2];
+
+    void main() {
+       gl_Position = ViewProjection[gl_ViewID_OVR] * VertexModel * vec4(VertexPos, 1.0);
        PSVertexColor = VertexColor;
     }
     )_";
@@ -42,8 +69,44 @@ static const char* FragmentShaderGlsl = R"_(
     }
     )_";
 
-struct OpenGLESGraphicsPlugin : public IGraphicsPlugin {
-    OpenGLESGraphicsPlugin(const std::shared_ptr<Options>& /*unused*/, const std::shared_ptr<IPlatformPlugin> /*unused*/&){};
+// Motion vectors for XR_FB_space_warp: each vertex both where its cube is now and where it was the previous frame
+static const char* MotionVectorVertexShaderGlsl = R"_(
+    #version 320 es
+
+    in vec3 VertexPos;
+    in mat4 VertexModel;
+    in mat4 VertexPreviousModel;
+
+    out vec4 PSCurrentPos;
+    out vec4 PSPreviousPos;
+
+    uniform mat4 ViewProjection;
+
+    void main() {
+       PSCurrentPos = ViewProjection * VertexModel * vec4(VertexPos, 1.0);
+       PSPreviousPos = ViewProjection * VertexPreviousModel * vec4(VertexPos, 1.0);
+       gl_Position = PSCurrentPos;
+    }
+    )_";
+
+static const char* MotionVectorFragmentShaderGlsl = R"_(
+    #version 320 es
+
+    in highp vec4 PSCurrentPos;
+    in highp vec4 PSPreviousPos;
+    out highp vec4 FragMotionVector;
+
+    void main() {
+       // How far the surface moved in normalized device coordinates since the previous frame
+       FragMotionVector = vec4(PSCurrentPos.xyz / PSCurrentPos.w - PSPreviousPos.xyz / PSPreviousPos.w, 0);
+    }
+    )_";
+
+struct OpenGLESGraphicsPlugin final : public IGraphicsPlugin {
+    OpenGLESGraphicsPlugin(const std::shared_ptr<Options>& options, const std::shared_ptr<IPlatformPlugin> /*unused*/&)
+        : m_cacheDirectory(options->CacheDirectory),
+          m_instancing(options->Instancing),
+          m_gpuTimersRequested(options->FrameStats || options->DynamicResolution){};
 
     OpenGLESGraphicsPlugin(const OpenGLESGraphicsPlugin&) = delete;
     OpenGLESGraphicsPlugin& operator=(const OpenGLESGraphicsPlugin&) = delete;
@@ -57,21 +120,40 @@ struct OpenGLESGraphicsPlugin : public IGraphicsPlugin {
         if (m_program != 0) {
             glDeleteProgram(m_program);
         }
+        if (m_multiviewProgram != 0) {
+            glDeleteProgram(m_multiviewProgram);
+        }
+        if (m_motionVectorProgram != 0) {
+            glDeleteProgram(m_motionVectorProgram);
+        }
         if (m_vao != 0) {
             glDeleteVertexArrays(1, &m_vao);
         }
-        if (m_cubeVertexBuffer != 0) {
-            glDeleteBuffers(1, &m_cubeVertexBuffer);
+        ReleaseMeshes(0);
+        if (m_instanceBuffer != 0) {
+            glDeleteBuffers(1, &m_instanceBuffer);
         }
-        if (m_cubeIndexBuffer != 0) {
-            glDeleteBuffers(1, &m_cubeIndexBuffer);
+        if (m_previousInstanceBuffer != 0) {
+            glDeleteBuffers(1, &m_previousInstanceBuffer);
+        }
+        for (GpuTimerFrame& timerFrame : m_gpuTimerFrames.Frames()) {
+            if (timerFrame.queries[0] != 0) {
+                glDeleteQueries((GLsizei)timerFrame.queries.size(), timerFrame.queries.data());
+            }
         }
 
-        for (auto& colorToDepth : m_colorToDepthMap) {
-            if (colorToDepth.second != 0) {
-                glDeleteTextures(1, &colorToDepth.second);
+        ReleaseSwapchainImageContexts();
+    }
+
+    void ReleaseSwapchainImageContexts() {
+        for (const std::unique_ptr<SwapchainImageContext>& swapchainImageContext : m_swapchainImageContexts) {
+            for (uint32_t depthTexture : swapchainImageContext->depthTextures) {
+                if (depthTexture != 0) {
+                    glDeleteTextures(1, &depthTexture);
+                }
             }
         }
+        m_swapchainImageContexts.clear();
     }
 
     std::vector<std::string> GetInstanceExtensions() const override { return {XR_KHR_OPENGL_ES_ENABLE_EXTENSION_NAME}; }
@@ -135,47 +217,224 @@ struct OpenGLESGraphicsPlugin : public IGraphicsPlugin {
     void InitializeResources() {
         glGenFramebuffers(1, &m_swapchainFramebuffer);
 
-        GLuint vertexShader = glCreateShader(GL_VERTEX_SHADER);
-        glShaderSource(vertexShader, 1, &VertexShaderGlsl, nullptr);
-        glCompileShader(vertexShader);
-        CheckShader(vertexShader);
-
-        GLuint fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-        glShaderSource(fragmentShader, 1, &FragmentShaderGlsl, nullptr);
-        glCompileShader(fragmentShader);
-        CheckShader(fragmentShader);
-
-        m_program = glCreateProgram();
-        glAttachShader(m_program, vertexShader);
-        glAttachShader(m_program, fragmentShader);
-        glLinkProgram(m_program);
-        CheckProgram(m_program);
+        // Program binaries are only worth saving if the driver can produce them
+        GLint programBinaryFormats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &programBinaryFormats);
+        m_programBinaryCache = programBinaryFormats > 0 && !m_cacheDirectory.empty();
 
-        glDeleteShader(vertexShader);
-        glDeleteShader(fragmentShader);
-
-        m_modelViewProjectionUniformLocation = glGetUniformLocation(m_program, "ModelViewProjection");
-
-        m_vertexAttribCoords = glGetAttribLocation(m_program, "VertexPos");
-        m_vertexAttribColor = glGetAttribLocation(m_program, "VertexColor");
+        // Single-pass stereo needs GL_OVR_multiview2 for gl_ViewID_OVR in the vertex shader
+        m_multiviewSupported = glExtensions.multi_view && glFramebufferTextureMultiviewOVR != nullptr;
+        LOG_VERBOSE(Fmt("GL_OVR_multiview2 %s", m_multiviewSupported ? "supported" : "not supported"));
 
-        glGenBuffers(1, &m_cubeVertexBuffer);
-        glBindBuffer(GL_ARRAY_BUFFER, m_cubeVertexBuffer);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(Geometry::c_cubeVertices), Geometry::c_cubeVertices, GL_STATIC_DRAW);
+        // Multisampling on tile attaches the depth textures too, which GL_EXT_multisampled_render_to_texture2 allows, and
+        // multiview needs GL_OVR_multiview_multisampled_render_to_texture.
+        GLint maxOnTileSampleCount = 1;
+        if (glExtensions.multi_sampled_resolve) {
+            glGetIntegerv(GL_MAX_SAMPLES_EXT, &maxOnTileSampleCount);
+        }
+        const bool onTileDepth = glExtensions.multi_sampled_depth_resolve && glFramebufferTexture2DMultisampleEXT != nullptr;
+        const bool onTileMultiview = m_multiviewSupported && glExtensions.multi_view_multi_sampled_resolve &&
+                                     glFramebufferTextureMultisampleMultiviewOVR != nullptr;
+        m_maxOnTileSampleCount = onTileDepth ? maxOnTileSampleCount : 1;
+        m_maxMultiviewOnTileSampleCount = onTileMultiview ? maxOnTileSampleCount : 1;
+        LOG_VERBOSE(Fmt("On-tile multisampling up to %dx, %dx with multiview", m_maxOnTileSampleCount,
+                        m_maxMultiviewOnTileSampleCount));
+
+        // The program binaries are read from the cache by a startup job while the cube is uploaded, then the programs are
+        // linked from them. Only the file reads leave this thread, every GL call stays where the context is current.
+        const std::vector<std::pair<GLint, const char*>> attribLocations{
+            {m_vertexAttribCoords, "VertexPos"}, {m_vertexAttribColor, "VertexColor"}, {m_vertexAttribModel, "VertexModel"}};
+        const std::vector<std::pair<GLint, const char*>> motionVectorAttribLocations{
+            {m_vertexAttribCoords, "VertexPos"},
+            {m_vertexAttribModel, "VertexModel"},
+            {m_vertexAttribPreviousModel, "VertexPreviousModel"}};
+        const std::string cacheFileName = ProgramCacheFileName(VertexShaderGlsl, FragmentShaderGlsl, attribLocations);
+        const std::string multiviewCacheFileName =
+            m_multiviewSupported ? ProgramCacheFileName(MultiviewVertexShaderGlsl, FragmentShaderGlsl, attribLocations) : "";
+        const std::string motionVectorCacheFileName =
+            ProgramCacheFileName(MotionVectorVertexShaderGlsl, MotionVectorFragmentShaderGlsl, motionVectorAttribLocations);
+        std::vector<uint8_t> binary;
+        std::vector<uint8_t> multiviewBinary;
+        std::vector<uint8_t> motionVectorBinary;
+
+        JobGraph startupJobs;
+        const JobGraph::JobId readBinaries = AddStartupStage(startupJobs, "read program binaries", [&]() {
+            ReadProgramBinary(cacheFileName, binary);
+            ReadProgramBinary(multiviewCacheFileName, multiviewBinary);
+            ReadProgramBinary(motionVectorCacheFileName, motionVectorBinary);
+        });
+        AddStartupStage(
+            startupJobs, "upload cube geometry", [this]() { InitializeCubeGeometry(); }, {}, JobGraph::Thread::Waiting);
+        AddStartupStage(
+            startupJobs, "create programs",
+            [&]() {
+                m_program = CreateProgram("cube", VertexShaderGlsl, FragmentShaderGlsl, attribLocations, cacheFileName, binary);
+                m_viewProjectionUniformLocation = glGetUniformLocation(m_program, "ViewProjection");
+                if (m_multiviewSupported) {
+                    m_multiviewProgram = CreateProgram("multiview cube", MultiviewVertexShaderGlsl, FragmentShaderGlsl,
+                                                       attribLocations, multiviewCacheFileName, multiviewBinary);
+                    m_multiviewViewProjectionUniformLocation = glGetUniformLocation(m_multiviewProgram, "ViewProjection");
+                }
+                m_motionVectorProgram =
+                    CreateProgram("motion vector", MotionVectorVertexShaderGlsl, MotionVectorFragmentShaderGlsl,
+                                  motionVectorAttribLocations, motionVectorCacheFileName, motionVectorBinary);
+                m_motionVectorViewProjectionUniformLocation = glGetUniformLocation(m_motionVectorProgram, "ViewProjection");
+            },
+            {readBinaries}, JobGraph::Thread::Waiting);
+        startupJobs.Wait();
+
+        // GL_TIME_ELAPSED queries come from GL_EXT_disjoint_timer_query on OpenGL ES
+        m_gpuTimers = m_gpuTimersRequested && glExtensions.timer_query && glGetQueryObjectui64v != nullptr;
+        LOG_VERBOSE(Fmt("GPU timers %s", m_gpuTimers ? "enabled" : "disabled"));
+        if (m_gpuTimers) {
+            for (GpuTimerFrame& timerFrame : m_gpuTimerFrames.Frames()) {
+                glGenQueries((GLsizei)timerFrame.queries.size(), timerFrame.queries.data());
+            }
+        }
+    }
 
-        glGenBuffers(1, &m_cubeIndexBuffer);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_cubeIndexBuffer);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(Geometry::c_cubeIndices), Geometry::c_cubeIndices, GL_STATIC_DRAW);
+    // Upload the cube and set up the VAO and instance streams around it.
+    void InitializeCubeGeometry() {
+        AddMesh(CubeMeshData());
 
+        // The vertex stream is pointed at the mesh of each draw in turn, see BindMesh.
         glGenVertexArrays(1, &m_vao);
         glBindVertexArray(m_vao);
         glEnableVertexAttribArray(m_vertexAttribCoords);
         glEnableVertexAttribArray(m_vertexAttribColor);
-        glBindBuffer(GL_ARRAY_BUFFER, m_cubeVertexBuffer);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_cubeIndexBuffer);
+        BindMesh(m_meshes[CubeMesh]);
+
+        // Per-instance model matrix, one column per attribute location. The per-cube path leaves these arrays disabled and
+        // sets the columns as constant attribute values before each draw instead. The previous model matrix arrays are only
+        // enabled while motion vectors are drawn.
+        glGenBuffers(1, &m_instanceBuffer);
+        glGenBuffers(1, &m_previousInstanceBuffer);
+        for (GLuint column = 0; column < 4; ++column) {
+            const GLuint location = static_cast<GLuint>(m_vertexAttribModel) + column;
+            glVertexAttribDivisor(location, 1);
+            if (m_instancing) {
+                glEnableVertexAttribArray(location);
+            }
+            glVertexAttribDivisor(static_cast<GLuint>(m_vertexAttribPreviousModel) + column, 1);
+        }
+        BindInstanceAttributes(0);
+
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    // Point the model matrix attributes of the bound VAO at m_instanceBuffer, from model firstInstance on, and with
+    // previousModels the previous model matrix attributes at m_previousInstanceBuffer. OpenGL ES has no base instance, so
+    // this is how an instanced draw starts at a later model.
+    void BindInstanceAttributes(size_t firstInstance, bool previousModels = false) {
+        const void* offset = reinterpret_cast<const void*>(firstInstance * sizeof(XrMatrix4x4f));
+        PointMatrixAttributes(m_instanceBuffer, m_vertexAttribModel, offset);
+        if (previousModels) {
+            PointMatrixAttributes(m_previousInstanceBuffer, m_vertexAttribPreviousModel, offset);
+        }
+    }
+
+    static void PointMatrixAttributes(GLuint buffer, GLint firstLocation, const void* offset) {
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        for (GLuint column = 0; column < 4; ++column) {
+            glVertexAttribPointer(static_cast<GLuint>(firstLocation) + column, 4, GL_FLOAT, GL_FALSE, sizeof(XrMatrix4x4f),
+                                  static_cast<const char*>(offset) + column * 4 * sizeof(float));
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    // Point the vertex attributes and element array of the bound VAO at a mesh.
+    void BindMesh(const MeshBuffers& mesh) {
+        glBindBuffer(GL_ARRAY_BUFFER, mesh.vertexBuffer);
         glVertexAttribPointer(m_vertexAttribCoords, 3, GL_FLOAT, GL_FALSE, sizeof(Geometry::Vertex), nullptr);
         glVertexAttribPointer(m_vertexAttribColor, 3, GL_FLOAT, GL_FALSE, sizeof(Geometry::Vertex),
                               reinterpret_cast<const void*>(sizeof(XrVector3f)));
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.indexBuffer);
+    }
+
+    GLuint CompileShader(GLenum type, const char* source) {
+        GLuint shader = glCreateShader(type);
+        glShaderSource(shader, 1, &source, nullptr);
+        glCompileShader(shader);
+        CheckShader(shader);
+        return shader;
+    }
+
+    // Name of the cache file for the binary of a program linked from these sources and attribute locations by this driver.
+    std::string ProgramCacheFileName(const char* vertexSource, const char* fragmentSource,
+                                     const std::vector<std::pair<GLint, const char*>>& attribLocations) const {
+        CacheKey key;
+        key.Add(vertexSource).Add(fragmentSource);
+        for (const auto& attribLocation : attribLocations) {
+            key.Add((uint64_t)attribLocation.first).Add(attribLocation.second);
+        }
+        key.Add(reinterpret_cast<const char*>(glGetString(GL_VENDOR)))
+            .Add(reinterpret_cast<const char*>(glGetString(GL_RENDERER)))
+            .Add(reinterpret_cast<const char*>(glGetString(GL_VERSION)));
+        return key.FileName("gles_program");
+    }
+
+    // Read a cache file for CreateProgram, leaving binary empty if there is none. Makes no GL calls, so it runs on any
+    // thread.
+    void ReadProgramBinary(const std::string& cacheFileName, std::vector<uint8_t>& binary) const {
+        if (!m_programBinaryCache || cacheFileName.empty() || !ReadCacheFile(m_cacheDirectory, cacheFileName.c_str(), binary)) {
+            binary.clear();
+        }
+    }
+
+    // Link a program from GLSL source, or load binary, the contents of the cache file a previous run saved for the same
+    // sources, attribute locations and driver, which ReadProgramBinary read. A binary the driver rejects, for example after a
+    // driver update, is rebuilt and replaced.
+    GLuint CreateProgram(const char* name, const char* vertexSource, const char* fragmentSource,
+                         const std::vector<std::pair<GLint, const char*>>& attribLocations, const std::string& cacheFileName,
+                         std::vector<uint8_t>& binary) {
+        // Cache files hold the binary format followed by the binary
+        if (binary.size() > sizeof(GLenum)) {
+            GLenum binaryFormat = 0;
+            memcpy(&binaryFormat, binary.data(), sizeof(binaryFormat));
+            GLuint program = glCreateProgram();
+            glProgramBinary(program, binaryFormat, binary.data() + sizeof(binaryFormat),
+                            (GLsizei)(binary.size() - sizeof(binaryFormat)));
+            GLint linked = GL_FALSE;
+            glGetProgramiv(program, GL_LINK_STATUS, &linked);
+            if (linked == GL_TRUE) {
+                LOG_VERBOSE(Fmt("Loaded %s program from the shader cache", name));
+                return program;
+            }
+            Log::Write(Log::Level::Info, Fmt("Driver rejected the cached %s program, rebuilding it", name));
+            glDeleteProgram(program);
+        }
+
+        const GLuint vertexShader = CompileShader(GL_VERTEX_SHADER, vertexSource);
+        const GLuint fragmentShader = CompileShader(GL_FRAGMENT_SHADER, fragmentSource);
+        GLuint program = glCreateProgram();
+        glAttachShader(program, vertexShader);
+        glAttachShader(program, fragmentShader);
+        for (const auto& attribLocation : attribLocations) {
+            glBindAttribLocation(program, attribLocation.first, attribLocation.second);
+        }
+        if (m_programBinaryCache) {
+            glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        }
+        glLinkProgram(program);
+        CheckProgram(program);
+        glDeleteShader(vertexShader);
+        glDeleteShader(fragmentShader);
+
+        if (m_programBinaryCache) {
+            GLint binaryLength = 0;
+            glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &binaryLength);
+            if (binaryLength > 0) {
+                GLenum binaryFormat = 0;
+                binary.resize(sizeof(binaryFormat) + binaryLength);
+                glGetProgramBinary(program, binaryLength, &binaryLength, &binaryFormat, binary.data() + sizeof(binaryFormat));
+                memcpy(binary.data(), &binaryFormat, sizeof(binaryFormat));
+                binary.resize(sizeof(binaryFormat) + binaryLength);
+                WriteCacheFile(m_cacheDirectory, cacheFileName.c_str(), binary);
+            }
+        }
+        return program;
     }
 
     void CheckShader(GLuint shader) {
@@ -200,6 +459,64 @@ struct OpenGLESGraphicsPlugin : public IGraphicsPlugin {
         }
     }
 
+    // A GL context is not tied to an adapter the runtime names, so it is kept whenever its version is still supported.
+    bool ReuseDevice(XrInstance instance, XrSystemId systemId) override {
+        if (m_swapchainFramebuffer == 0) {
+            return false;
+        }
+
+        PFN_xrGetOpenGLESGraphicsRequirementsKHR pfnGetOpenGLESGraphicsRequirementsKHR = nullptr;
+        CHECK_XRCMD(xrGetInstanceProcAddr(instance, "xrGetOpenGLESGraphicsRequirementsKHR",
+                                          reinterpret_cast<PFN_xrVoidFunction*>(&pfnGetOpenGLESGraphicsRequirementsKHR)));
+        XrGraphicsRequirementsOpenGLESKHR graphicsRequirements{XR_TYPE_GRAPHICS_REQUIREMENTS_OPENGL_ES_KHR};
+        CHECK_XRCMD(pfnGetOpenGLESGraphicsRequirementsKHR(instance, systemId, &graphicsRequirements));
+
+        GLint major = 0;
+        GLint minor = 0;
+        glGetIntegerv(GL_MAJOR_VERSION, &major);
+        glGetIntegerv(GL_MINOR_VERSION, &minor);
+        if (graphicsRequirements.minApiVersionSupported > XR_MAKE_VERSION(major, minor, 0)) {
+            return false;
+        }
+
+        // The images of the old swapchains are gone, so nothing may still be rendering into them.
+        glFinish();
+        ReleaseSwapchainImageContexts();
+        ReleaseMeshes(CubeMesh + 1);
+        return true;
+    }
+
+    // The driver copies the data during glBufferData, so a mapped mesh file goes straight into the buffers.
+    uint32_t AddMesh(const MeshData& mesh) override {
+        // The element array binding belongs to the VAO, keep the upload from changing it.
+        glBindVertexArray(0);
+
+        MeshBuffers buffers;
+        glGenBuffers(1, &buffers.vertexBuffer);
+        glBindBuffer(GL_ARRAY_BUFFER, buffers.vertexBuffer);
+        glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizeiptr>(mesh.VertexBytes()), mesh.Vertices, GL_STATIC_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        glGenBuffers(1, &buffers.indexBuffer);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers.indexBuffer);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, static_cast<GLsizeiptr>(mesh.IndexBytes()), mesh.Indices, GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+        buffers.lods = mesh.Lods;
+        buffers.indexType = mesh.IndexSize == sizeof(uint32_t) ? GL_UNSIGNED_INT : GL_UNSIGNED_SHORT;
+        m_meshes.push_back(buffers);
+        return static_cast<uint32_t>(m_meshes.size() - 1);
+    }
+
+    // Delete the meshes from mesh ID first on.
+    void ReleaseMeshes(size_t first) {
+        for (size_t mesh = first; mesh < m_meshes.size(); ++mesh) {
+            glDeleteBuffers(1, &m_meshes[mesh].vertexBuffer);
+            glDeleteBuffers(1, &m_meshes[mesh].indexBuffer);
+        }
+        m_meshes.resize(std::min(first, m_meshes.size()));
+    }
+
     int64_t SelectColorSwapchainFormat(const std::vector<int64_t>& runtimeFormats) const override {
         // List of supported color swapchain formats.
         constexpr int64_t SupportedColorSwapchainFormats[] = {
@@ -217,64 +534,316 @@ struct OpenGLESGraphicsPlugin : public IGraphicsPlugin {
         return *swapchainFormatIt;
     }
 
+    std::vector<ColorFormatInfo> GetColorSwapchainFormatCandidates() const override {
+        return {{GL_SRGB8_ALPHA8, "GL_SRGB8_ALPHA8", 4, 8, 8, true, true},
+                {GL_RGBA8, "GL_RGBA8", 4, 8, 8, false, true},
+                {GL_RGBA8_SNORM, "GL_RGBA8_SNORM", 4, 7, 7, false, false},
+                {GL_RGB10_A2, "GL_RGB10_A2", 4, 10, 2, false, true},
+                {GL_R11F_G11F_B10F, "GL_R11F_G11F_B10F", 4, 10, 0, false, true},
+                {GL_RGBA16F, "GL_RGBA16F", 8, 16, 16, false, false}};
+    }
+
+    int64_t SelectDepthSwapchainFormat(const std::vector<int64_t>& runtimeFormats) const override {
+        // Depth-only formats, so the swapchain can be attached as GL_DEPTH_ATTACHMENT like the private depth textures.
+        constexpr int64_t SupportedDepthSwapchainFormats[] = {GL_DEPTH_COMPONENT32F, GL_DEPTH_COMPONENT24, GL_DEPTH_COMPONENT16};
+
+        auto swapchainFormatIt =
+            std::find_first_of(runtimeFormats.begin(), runtimeFormats.end(), std::begin(SupportedDepthSwapchainFormats),
+                               std::end(SupportedDepthSwapchainFormats));
+        return swapchainFormatIt != runtimeFormats.end() ? *swapchainFormatIt : -1;
+    }
+
+    int64_t SelectMotionVectorSwapchainFormat(const std::vector<int64_t>& runtimeFormats) const override {
+        const auto swapchainFormatIt = std::find(runtimeFormats.begin(), runtimeFormats.end(), GL_RGBA16F);
+        return swapchainFormatIt != runtimeFormats.end() ? *swapchainFormatIt : -1;
+    }
+
+    void SetPreviousCubeModels(const std::vector<XrMatrix4x4f>& previousCubeModels) override {
+        m_previousCubeModels = &previousCubeModels;
+    }
+
     const XrBaseInStructure* GetGraphicsBinding() const override {
         return reinterpret_cast<const XrBaseInStructure*>(&m_graphicsBinding);
     }
 
-    std::vector<XrSwapchainImageBaseHeader*> AllocateSwapchainImageStructs(
-        uint32_t capacity, const XrSwapchainCreateInfo& /*swapchainCreateInfo*/) override {
+    uint32_t AllocateSwapchainImageStructs(uint32_t capacity, const XrSwapchainCreateInfo& swapchainCreateInfo,
+                                           std::vector<XrSwapchainImageBaseHeader*>& swapchainImages) override {
         // Allocate and initialize the buffer of image structs (must be sequential in memory for xrEnumerateSwapchainImages).
         // Return back an array of pointers to each swapchain image struct so the consumer doesn't need to know the type/size.
-        std::vector<XrSwapchainImageOpenGLESKHR> swapchainImageBuffer(capacity);
-        std::vector<XrSwapchainImageBaseHeader*> swapchainImageBase;
-        for (XrSwapchainImageOpenGLESKHR& image : swapchainImageBuffer) {
-            image.type = XR_TYPE_SWAPCHAIN_IMAGE_OPENGL_ES_KHR;
-            swapchainImageBase.push_back(reinterpret_cast<XrSwapchainImageBaseHeader*>(&image));
+        // Keep the buffer alive by adding it into the table of contexts, whose index identifies the swapchain.
+        const uint32_t swapchainIndex = (uint32_t)m_swapchainImageContexts.size();
+        m_swapchainImageContexts.push_back(std::make_unique<SwapchainImageContext>());
+        SwapchainImageContext& swapchainImageContext = *m_swapchainImageContexts.back();
+
+        swapchainImageContext.images.resize(capacity, {XR_TYPE_SWAPCHAIN_IMAGE_OPENGL_ES_KHR});
+        swapchainImageContext.width = static_cast<GLsizei>(swapchainCreateInfo.width);
+        swapchainImageContext.height = static_cast<GLsizei>(swapchainCreateInfo.height);
+        // Depth swapchains are rendered into directly and need no depth textures of their own.
+        if ((swapchainCreateInfo.usageFlags & XR_SWAPCHAIN_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT) == 0) {
+            swapchainImageContext.depthTextures.resize(capacity, 0);
+        }
+        swapchainImages.clear();
+        for (XrSwapchainImageOpenGLESKHR& image : swapchainImageContext.images) {
+            swapchainImages.push_back(reinterpret_cast<XrSwapchainImageBaseHeader*>(&image));
         }
 
-        // Keep the buffer alive by moving it into the list of buffers.
-        m_swapchainImageBuffers.push_back(std::move(swapchainImageBuffer));
+        return swapchainIndex;
+    }
 
-        return swapchainImageBase;
+    uint32_t GetColorTexture(const SwapchainImage& swapchainImage) const {
+        return m_swapchainImageContexts[swapchainImage.swapchainIndex]->images[swapchainImage.imageIndex].image;
     }
 
-    uint32_t GetDepthTexture(uint32_t colorTexture) {
+    // arraySize > 1 means the color texture is a GL_TEXTURE_2D_ARRAY and gets a depth array with matching layer count.
+    uint32_t GetDepthTexture(const SwapchainImage& swapchainImage, GLsizei arraySize = 1) {
+        if (swapchainImage.depthSwapchainIndex != NoDepthSwapchain) {
+            return m_swapchainImageContexts[swapchainImage.depthSwapchainIndex]->images[swapchainImage.depthImageIndex].image;
+        }
+
         // If a depth-stencil view has already been created for this back-buffer, use it.
-        auto depthBufferIt = m_colorToDepthMap.find(colorTexture);
-        if (depthBufferIt != m_colorToDepthMap.end()) {
-            return depthBufferIt->second;
+        uint32_t& depthTexture = m_swapchainImageContexts[swapchainImage.swapchainIndex]->depthTextures[swapchainImage.imageIndex];
+        if (depthTexture != 0) {
+            return depthTexture;
         }
 
         // This back-buffer has no corresponding depth-stencil texture, so create one with matching dimensions.
+        const uint32_t colorTexture = GetColorTexture(swapchainImage);
+        const GLenum target = arraySize > 1 ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_2D;
 
         GLint width;
         GLint height;
-        glBindTexture(GL_TEXTURE_2D, colorTexture);
-        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width);
-        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &height);
+        glBindTexture(target, colorTexture);
+        glGetTexLevelParameteriv(target, 0, GL_TEXTURE_WIDTH, &width);
+        glGetTexLevelParameteriv(target, 0, GL_TEXTURE_HEIGHT, &height);
 
-        uint32_t depthTexture;
         glGenTextures(1, &depthTexture);
-        glBindTexture(GL_TEXTURE_2D, depthTexture);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, width, height, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, nullptr);
-
-        m_colorToDepthMap.insert(std::make_pair(colorTexture, depthTexture));
+        glBindTexture(target, depthTexture);
+        glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        if (arraySize > 1) {
+            glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT24, width, height, arraySize, 0, GL_DEPTH_COMPONENT,
+                         GL_UNSIGNED_INT, nullptr);
+        } else {
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, width, height, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, nullptr);
+        }
 
         return depthTexture;
     }
 
-    void RenderView(const XrCompositionLayerProjectionView& layerView, const XrSwapchainImageBaseHeader* swapchainImage,
-                    int64_t swapchainFormat, const std::vector<Cube>& cubes) override {
+    static XrMatrix4x4f ComputeViewProjection(const XrCompositionLayerProjectionView& layerView) {
+        const auto& pose = layerView.pose;
+        XrMatrix4x4f proj;
+        XrMatrix4x4f_CreateProjectionFov(&proj, GRAPHICS_OPENGL_ES, layerView.fov, 0.05f, 100.0f);
+        XrMatrix4x4f toView;
+        XrVector3f scale{1.f, 1.f, 1.f};
+        XrMatrix4x4f_CreateTranslationRotationScale(&toView, &pose.position, &pose.orientation, &scale);
+        XrMatrix4x4f view;
+        XrMatrix4x4f_InvertRigidBody(&view, &toView);
+        XrMatrix4x4f vp;
+        XrMatrix4x4f_Multiply(&vp, &proj, &view);
+        return vp;
+    }
+
+    // Keep the frame's model transforms and mesh draws for DrawCubes. The instanced path also streams the transforms into
+    // the instance buffer.
+    void UploadInstances(const std::vector<XrMatrix4x4f>& cubeModels, const std::vector<MeshDraw>& meshDraws) {
+        m_instanceModels = &cubeModels;
+        m_meshDraws = meshDraws;
+
+        if (m_instancing) {
+            // Respecifying the whole store lets the driver orphan the previous contents instead of stalling on them
+            glBindBuffer(GL_ARRAY_BUFFER, m_instanceBuffer);
+            glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizeiptr>(cubeModels.size() * sizeof(XrMatrix4x4f)), cubeModels.data(),
+                         GL_STREAM_DRAW);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+        }
+    }
+
+    // Draw every uploaded cube with its mesh and the bound program and VAO, as one instanced draw per mesh or as one draw
+    // per cube. With previousModels the previous model matrices are fed to the program too.
+    void DrawCubes(bool previousModels = false) {
+        size_t firstInstance = 0;
+        for (const MeshDraw& draw : m_meshDraws) {
+            const MeshBuffers& mesh = m_meshes[draw.Mesh];
+            const MeshLod& lod = mesh.lods[draw.Lod];
+            BindMesh(mesh);
+
+            if (m_instancing) {
+                BindInstanceAttributes(firstInstance, previousModels);
+                glDrawElementsInstanced(GL_TRIANGLES, static_cast<GLsizei>(lod.IndexCount), mesh.indexType, mesh.FirstIndex(lod),
+                                        static_cast<GLsizei>(draw.InstanceCount));
+            } else {
+                for (uint32_t i = 0; i < draw.InstanceCount; ++i) {
+                    const XrMatrix4x4f& model = (*m_instanceModels)[firstInstance + i];
+                    for (GLuint column = 0; column < 4; ++column) {
+                        glVertexAttrib4fv(static_cast<GLuint>(m_vertexAttribModel) + column, &model.m[column * 4]);
+                    }
+                    if (previousModels) {
+                        const XrMatrix4x4f& previousModel = (*m_previousCubeModels)[firstInstance + i];
+                        for (GLuint column = 0; column < 4; ++column) {
+                            glVertexAttrib4fv(static_cast<GLuint>(m_vertexAttribPreviousModel) + column,
+                                              &previousModel.m[column * 4]);
+                        }
+                    }
+                    glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(lod.IndexCount), mesh.indexType, mesh.FirstIndex(lod));
+                }
+            }
+            firstInstance += draw.InstanceCount;
+        }
+    }
+
+    // Move to the next set of timer queries, first reading back the frame that last used it if its results are in. Results
+    // that are not available yet are dropped rather than waited on.
+    void BeginGpuTimerFrame() {
+        if (!m_gpuTimers) {
+            return;
+        }
+
+        GpuTimerFrame& timerFrame = m_gpuTimerFrames.Advance();
+        const uint32_t viewCount = timerFrame.TimedViews.Take();
+        if (viewCount == 0) {
+            return;
+        }
+
+        // A disjoint operation, such as a frequency change, invalidates every query in flight.
+        GLint disjoint = 0;
+        glGetIntegerv(GL_GPU_DISJOINT, &disjoint);
+        if (disjoint != 0) {
+            m_gpuTimerFrames.DiscardAll();
+            return;
+        }
+
+        GLuint available = GL_FALSE;
+        glGetQueryObjectuiv(timerFrame.queries[viewCount - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (available == GL_FALSE) {
+            return;
+        }
+
+        std::vector<uint64_t>& viewNanoseconds = m_gpuViewTimes.Store(viewCount);
+        for (uint32_t view = 0; view < viewCount; ++view) {
+            GLuint64 elapsed = 0;
+            glGetQueryObjectui64v(timerFrame.queries[view], GL_QUERY_RESULT, &elapsed);
+            viewNanoseconds[view] = elapsed;
+        }
+    }
+
+    void BeginGpuViewTimer() {
+        GpuTimerFrame& timerFrame = m_gpuTimerFrames.Current();
+        if (m_gpuTimers && timerFrame.TimedViews.CanTime()) {
+            glBeginQuery(GL_TIME_ELAPSED, timerFrame.queries[timerFrame.TimedViews.Count]);
+        }
+    }
+
+    void EndGpuViewTimer() {
+        GpuTimerFrame& timerFrame = m_gpuTimerFrames.Current();
+        if (m_gpuTimers && timerFrame.TimedViews.CanTime()) {
+            glEndQuery(GL_TIME_ELAPSED);
+            timerFrame.TimedViews.Timed();
+        }
+    }
+
+    bool TakeGpuViewTimes(std::vector<uint64_t>& viewNanoseconds) override { return m_gpuViewTimes.Take(viewNanoseconds); }
+
+    void RenderView(const XrCompositionLayerProjectionView& layerView, const SwapchainImage& swapchainImage,
+                    int64_t swapchainFormat, const std::vector<XrMatrix4x4f>& cubeModels,
+                    const std::vector<MeshDraw>& meshDraws) override {
+        UploadInstances(cubeModels, meshDraws);
+        RenderUploadedCubes(layerView, swapchainImage, swapchainFormat);
+    }
+
+    void RenderViews(const std::vector<XrCompositionLayerProjectionView>& layerViews,
+                     const std::vector<SwapchainImage>& swapchainImages, int64_t swapchainFormat,
+                     const std::vector<XrMatrix4x4f>& cubeModels, const std::vector<MeshDraw>& meshDraws) override {
+        CHECK(layerViews.size() == swapchainImages.size());
+
+        BeginGpuTimerFrame();
+
+        // The model transforms are shared by every view, so they are only uploaded once.
+        UploadInstances(cubeModels, meshDraws);
+        const bool motionVectors = swapchainImages[0].motionVectorSwapchainIndex != NoMotionVectorSwapchain;
+        if (motionVectors) {
+            UploadPreviousInstances(cubeModels.size());
+        }
+        for (size_t i = 0; i < layerViews.size(); ++i) {
+            BeginGpuViewTimer();
+            RenderUploadedCubes(layerViews[i], swapchainImages[i], swapchainFormat);
+            EndGpuViewTimer();
+            if (motionVectors) {
+                RenderMotionVectors(layerViews[i], swapchainImages[i]);
+            }
+        }
+    }
+
+    // Stream the models given to SetPreviousCubeModels into the previous instance buffer, for the instanced path.
+    void UploadPreviousInstances(size_t instanceCount) {
+        CHECK(m_previousCubeModels != nullptr && m_previousCubeModels->size() == instanceCount);
+        if (m_instancing) {
+            glBindBuffer(GL_ARRAY_BUFFER, m_previousInstanceBuffer);
+            glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizeiptr>(instanceCount * sizeof(XrMatrix4x4f)),
+                         m_previousCubeModels->data(), GL_STREAM_DRAW);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+        }
+    }
+
+    // Draw the uploaded cubes' motion vectors and their depth into the view's motion vector swapchain images, which are
+    // cleared to no motion. The view-projection of the current frame is used for the previous positions too, as the
+    // runtime takes the head motion from the view poses.
+    void RenderMotionVectors(const XrCompositionLayerProjectionView& layerView, const SwapchainImage& swapchainImage) {
+        const SwapchainImageContext& motionVectorContext = *m_swapchainImageContexts[swapchainImage.motionVectorSwapchainIndex];
+        const SwapchainImageContext& depthContext = *m_swapchainImageContexts[swapchainImage.motionVectorDepthSwapchainIndex];
+
+        glBindFramebuffer(GL_FRAMEBUFFER, m_swapchainFramebuffer);
+        glViewport(0, 0, motionVectorContext.width, motionVectorContext.height);
+
+        glFrontFace(GL_CW);
+        glCullFace(GL_BACK);
+        glEnable(GL_CULL_FACE);
+        glEnable(GL_DEPTH_TEST);
+
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                               motionVectorContext.images[swapchainImage.motionVectorImageIndex].image, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D,
+                               depthContext.images[swapchainImage.motionVectorDepthImageIndex].image, 0);
+
+        glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+        glClearDepthf(1.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+
+        glUseProgram(m_motionVectorProgram);
+
+        const XrMatrix4x4f vp = ComputeViewProjection(layerView);
+        glUniformMatrix4fv(m_motionVectorViewProjectionUniformLocation, 1, GL_FALSE, reinterpret_cast<const GLfloat*>(&vp));
+
+        glBindVertexArray(m_vao);
+        SetPreviousModelArraysEnabled(m_instancing);
+        DrawCubes(true);
+        SetPreviousModelArraysEnabled(false);
+        glBindVertexArray(0);
+        glUseProgram(0);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    void SetPreviousModelArraysEnabled(bool enabled) {
+        for (GLuint column = 0; column < 4; ++column) {
+            const GLuint location = static_cast<GLuint>(m_vertexAttribPreviousModel) + column;
+            if (enabled) {
+                glEnableVertexAttribArray(location);
+            } else {
+                glDisableVertexAttribArray(location);
+            }
+        }
+    }
+
+    void RenderUploadedCubes(const XrCompositionLayerProjectionView& layerView, const SwapchainImage& swapchainImage,
+                             int64_t swapchainFormat) {
         CHECK(layerView.subImage.imageArrayIndex == 0);  // Texture arrays not supported.
         UNUSED_PARM(swapchainFormat);                    // Not used in this function for now.
 
         glBindFramebuffer(GL_FRAMEBUFFER, m_swapchainFramebuffer);
 
-        const uint32_t colorTexture = reinterpret_cast<const XrSwapchainImageOpenGLESKHR*>(swapchainImage)->image;
+        const uint32_t colorTexture = GetColorTexture(swapchainImage);
 
         glViewport(static_cast<GLint>(layerView.subImage.imageRect.offset.x),
                    static_cast<GLint>(layerView.subImage.imageRect.offset.y),
@@ -286,10 +855,17 @@ struct OpenGLESGraphicsPlugin : public IGraphicsPlugin {
         glEnable(GL_CULL_FACE);
         glEnable(GL_DEPTH_TEST);
 
-        const uint32_t depthTexture = GetDepthTexture(colorTexture);
+        const uint32_t depthTexture = GetDepthTexture(swapchainImage);
 
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, colorTexture, 0);
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
+        if (m_onTileSampleCount > 1) {
+            glFramebufferTexture2DMultisampleEXT(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, colorTexture, 0,
+                                                 m_onTileSampleCount);
+            glFramebufferTexture2DMultisampleEXT(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0,
+                                                 m_onTileSampleCount);
+        } else {
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, colorTexture, 0);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
+        }
 
         // Clear swapchain and depth buffer.
         glClearColor(DarkSlateGray[0], DarkSlateGray[1], DarkSlateGray[2], DarkSlateGray[3]);
@@ -299,33 +875,14 @@ struct OpenGLESGraphicsPlugin : public IGraphicsPlugin {
         // Set shaders and uniform variables.
         glUseProgram(m_program);
 
-        const auto& pose = layerView.pose;
-        XrMatrix4x4f proj;
-        XrMatrix4x4f_CreateProjectionFov(&proj, GRAPHICS_OPENGL_ES, layerView.fov, 0.05f, 100.0f);
-        XrMatrix4x4f toView;
-        XrVector3f scale{1.f, 1.f, 1.f};
-        XrMatrix4x4f_CreateTranslationRotationScale(&toView, &pose.position, &pose.orientation, &scale);
-        XrMatrix4x4f view;
-        XrMatrix4x4f_InvertRigidBody(&view, &toView);
-        XrMatrix4x4f vp;
-        XrMatrix4x4f_Multiply(&vp, &proj, &view);
+        const XrMatrix4x4f vp = ComputeViewProjection(layerView);
+        glUniformMatrix4fv(m_viewProjectionUniformLocation, 1, GL_FALSE, reinterpret_cast<const GLfloat*>(&vp));
 
-        // Set cube primitive data.
+        // Set cube primitive data and draw the cubes.
         glBindVertexArray(m_vao);
+        DrawCubes();
 
-        // Render each cube
-        for (const Cube& cube : cubes) {
-            // Compute the model-view-projection transform and set it..
-            XrMatrix4x4f model;
-            XrMatrix4x4f_CreateTranslationRotationScale(&model, &cube.Pose.position, &cube.Pose.orientation, &cube.Scale);
-            XrMatrix4x4f mvp;
-            XrMatrix4x4f_Multiply(&mvp, &vp, &model);
-            glUniformMatrix4fv(m_modelViewProjectionUniformLocation, 1, GL_FALSE, reinterpret_cast<const GLfloat*>(&mvp));
-
-            // Draw the cube.
-            glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(ArraySize(Geometry::c_cubeIndices)), GL_UNSIGNED_SHORT, nullptr);
-        }
-
+        InvalidatePrivateDepth(swapchainImage);
         glBindVertexArray(0);
         glUseProgram(0);
         glBindFramebuffer(GL_FRAMEBUFFER, 0);
@@ -337,23 +894,164 @@ struct OpenGLESGraphicsPlugin : public IGraphicsPlugin {
         }
     }
 
+    // Depth in our own textures is not needed once the views are drawn. Invalidating it lets tile-based GPUs skip writing it
+    // back to memory. Depth swapchain images are submitted to the runtime and must be kept.
+    void InvalidatePrivateDepth(const SwapchainImage& swapchainImage) {
+        if (swapchainImage.depthSwapchainIndex == NoDepthSwapchain) {
+            const GLenum depthAttachment = GL_DEPTH_ATTACHMENT;
+            glInvalidateFramebuffer(GL_FRAMEBUFFER, 1, &depthAttachment);
+        }
+    }
+
+    bool SupportsMultiview() const override { return m_multiviewSupported; }
+
+    // The motion vectors stay single-sampled, RenderMotionVectors attaches their images without samples. Depth swapchain
+    // images are resolved on tile like the color images.
+    uint32_t EnableOnTileMultisampling(uint32_t sampleCount, bool multiview, bool /*depthSwapchains*/) override {
+        const GLint maxSampleCount = multiview ? m_maxMultiviewOnTileSampleCount : m_maxOnTileSampleCount;
+        m_onTileSampleCount = std::max(1, std::min(static_cast<GLint>(sampleCount), maxSampleCount));
+        return static_cast<uint32_t>(m_onTileSampleCount);
+    }
+
+    // The runtime foveates GL textures itself, the rendering does not change.
+    bool SupportsSwapchainFoveation() const override { return true; }
+
+    void RenderMultiview(const std::vector<XrCompositionLayerProjectionView>& layerViews,
+                         const SwapchainImage& swapchainImage, int64_t swapchainFormat,
+                         const std::vector<XrMatrix4x4f>& cubeModels, const std::vector<MeshDraw>& meshDraws) override {
+        CHECK(m_multiviewSupported);
+        CHECK(layerViews.size() == 2);  // The multiview shader holds one view-projection per eye.
+        UNUSED_PARM(swapchainFormat);    // Not used in this function for now.
+
+        const GLsizei numViews = static_cast<GLsizei>(layerViews.size());
+
+        // Both views are drawn together, so they share one timer.
+        BeginGpuTimerFrame();
+        BeginGpuViewTimer();
+
+        glBindFramebuffer(GL_FRAMEBUFFER, m_swapchainFramebuffer);
+
+        const uint32_t colorTexture = GetColorTexture(swapchainImage);
+
+        // All views share the same image rect, only the array layer differs.
+        const XrRect2Di& imageRect = layerViews[0].subImage.imageRect;
+        glViewport(static_cast<GLint>(imageRect.offset.x), static_cast<GLint>(imageRect.offset.y),
+                   static_cast<GLsizei>(imageRect.extent.width), static_cast<GLsizei>(imageRect.extent.height));
+
+        glFrontFace(GL_CW);
+        glCullFace(GL_BACK);
+        glEnable(GL_CULL_FACE);
+        glEnable(GL_DEPTH_TEST);
+
+        const uint32_t depthTexture = GetDepthTexture(swapchainImage, numViews);
+
+        if (m_onTileSampleCount > 1) {
+            glFramebufferTextureMultisampleMultiviewOVR(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, colorTexture, 0,
+                                                        m_onTileSampleCount, 0, numViews);
+            glFramebufferTextureMultisampleMultiviewOVR(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depthTexture, 0,
+                                                        m_onTileSampleCount, 0, numViews);
+        } else {
+            glFramebufferTextureMultiviewOVR(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, colorTexture, 0, 0, numViews);
+            glFramebufferTextureMultiviewOVR(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depthTexture, 0, 0, numViews);
+        }
+
+        // Clear swapchain and depth buffer, this clears every view.
+        glClearColor(DarkSlateGray[0], DarkSlateGray[1], DarkSlateGray[2], DarkSlateGray[3]);
+        glClearDepthf(1.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+
+        UploadInstances(cubeModels, meshDraws);
+
+        glUseProgram(m_multiviewProgram);
+
+        std::array<XrMatrix4x4f, 2> vp;
+        for (size_t view = 0; view < vp.size(); ++view) {
+            CHECK(layerViews[view].subImage.imageArrayIndex == view);
+            vp[view] = ComputeViewProjection(layerViews[view]);
+        }
+        glUniformMatrix4fv(m_multiviewViewProjectionUniformLocation, numViews, GL_FALSE,
+                           reinterpret_cast<const GLfloat*>(vp.data()));
+
+        // Each cube is drawn once for both views, gl_ViewID_OVR selects the view-projection
+        glBindVertexArray(m_vao);
+        DrawCubes();
+
+        InvalidatePrivateDepth(swapchainImage);
+        glBindVertexArray(0);
+        glUseProgram(0);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        EndGpuViewTimer();
+
+        // Both eyes are done, swap our window for RenderDoc
+        ksGpuWindow_SwapBuffers(&window);
+    }
+
    private:
 #ifdef XR_USE_PLATFORM_ANDROID
     XrGraphicsBindingOpenGLESAndroidKHR m_graphicsBinding{XR_TYPE_GRAPHICS_BINDING_OPENGL_ES_ANDROID_KHR};
 #endif
 
-    std::list<std::vector<XrSwapchainImageOpenGLESKHR>> m_swapchainImageBuffers;
+    // The images of one swapchain and the depth textures that go with them, which are created on first use unless a depth
+    // swapchain is rendered into instead.
+    struct SwapchainImageContext {
+        std::vector<XrSwapchainImageOpenGLESKHR> images;  // Packed for xrEnumerateSwapchainImages.
+        std::vector<uint32_t> depthTextures;
+        GLsizei width{0};
+        GLsizei height{0};
+    };
+    std::vector<std::unique_ptr<SwapchainImageContext>> m_swapchainImageContexts;  // Indexed by SwapchainImage::swapchainIndex.
     GLuint m_swapchainFramebuffer{0};
     GLuint m_program{0};
-    GLint m_modelViewProjectionUniformLocation{0};
-    GLint m_vertexAttribCoords{0};
-    GLint m_vertexAttribColor{0};
+    GLint m_viewProjectionUniformLocation{0};
+    bool m_multiviewSupported{false};
+    // Samples per pixel the color swapchains are rendered with, resolved on tile. 1 renders into them directly.
+    GLint m_onTileSampleCount{1};
+    GLint m_maxOnTileSampleCount{1};
+    GLint m_maxMultiviewOnTileSampleCount{1};
+    GLuint m_multiviewProgram{0};
+    GLint m_multiviewViewProjectionUniformLocation{0};
+    // Bound in every program rather than queried, so the programs share the VAO and their cache files are known before any
+    // of them is linked.
+    const GLint m_vertexAttribCoords{0};
+    const GLint m_vertexAttribColor{1};
+    const GLint m_vertexAttribModel{2};  // First of four consecutive locations, one per matrix column
+    GLuint m_motionVectorProgram{0};
+    GLint m_motionVectorViewProjectionUniformLocation{0};
+    const GLint m_vertexAttribPreviousModel{6};  // Same, for the previous frame's model matrix of the motion vector program
     GLuint m_vao{0};
-    GLuint m_cubeVertexBuffer{0};
-    GLuint m_cubeIndexBuffer{0};
 
-    // Map color buffer to associated depth buffer. This map is populated on demand.
-    std::map<uint32_t, uint32_t> m_colorToDepthMap;
+    // GPU copy of a mesh added with AddMesh.
+    struct MeshBuffers {
+        GLuint vertexBuffer{0};
+        GLuint indexBuffer{0};
+        std::array<MeshLod, MaxMeshLods> lods{};  // Index ranges
+        GLenum indexType{GL_UNSIGNED_SHORT};
+
+        // Offset of a level of detail's first index into the element array.
+        const void* FirstIndex(const MeshLod& lod) const {
+            const size_t indexSize = indexType == GL_UNSIGNED_INT ? sizeof(GLuint) : sizeof(GLushort);
+            return reinterpret_cast<const void*>(lod.FirstIndex * indexSize);
+        }
+    };
+    std::vector<MeshBuffers> m_meshes;  // Indexed by mesh ID
+    GLuint m_instanceBuffer{0};
+    GLuint m_previousInstanceBuffer{0};
+    const std::vector<XrMatrix4x4f>* m_instanceModels{nullptr};  // Set by UploadInstances for the current render call.
+    const std::vector<XrMatrix4x4f>* m_previousCubeModels{nullptr};  // From SetPreviousCubeModels, for motion vectors
+    std::vector<MeshDraw> m_meshDraws;                           // Same
+    const std::string m_cacheDirectory;
+    bool m_programBinaryCache{false};
+    const bool m_instancing;
+
+    struct GpuTimerFrame {
+        std::array<GLuint, MaxGpuTimerViews> queries{};
+        GpuTimedViews TimedViews;
+    };
+    const bool m_gpuTimersRequested;
+    bool m_gpuTimers{false};
+    GpuTimerRing<GpuTimerFrame> m_gpuTimerFrames;
+    GpuViewTimes m_gpuViewTimes;
 };
 }  // namespace
 
@@ -6,11 +6,17 @@
 #include "common.h"
 #include "geometry.h"
 #include "graphicsplugin.h"
+#include "options.h"
+#include "cachefile.h"
+#include "jobsystem.h"
+#include "gputimers.h"
+#include "startup.h"
 
 #ifdef XR_USE_GRAPHICS_API_VULKAN
 
 #include <common/xr_linear.h>
 #include <array>
+#include <tuple>
 
 #ifdef USE_ONLINE_VULKAN_SHADERC
 #include <shaderc/shaderc.hpp>
@@ -101,22 +107,58 @@ inline VkResult CheckVkResult(VkResult res, const char* originator = nullptr, co
 
 // XXX These really shouldn't have trailing ';'s
 #define THROW_VK(res, cmd) ThrowVkResult(res, #cmd, FILE_AND_LINE);
-#define CHECK_VKCMD(cmd) CheckVkResult(cmd, #cmd, FILE_AND_LINE);
+#define CHECK_VKCMD(cmd) CheckVkResult(TRACE_CALL(cmd, #cmd), #cmd, FILE_AND_LINE);
 #define CHECK_VKRESULT(res, cmdStr) CheckVkResult(res, cmdStr, FILE_AND_LINE);
 
+// Format of the XR_FB_space_warp motion vector swapchains: the motion in normalized device coordinates, z included.
+constexpr VkFormat MotionVectorFormat = VK_FORMAT_R16G16B16A16_SFLOAT;
+
 #ifdef USE_ONLINE_VULKAN_SHADERC
 constexpr char VertexShaderGlsl[] =
     R"_(
     #version 430
     #extension GL_ARB_separate_shader_objects : enable
 
-    layout (std140, push_constant) uniform buf
+    layout (std140, set = 0, binding = 0) uniform buf
+    {
+        mat4 vp;
+    } ubuf;
+
+    layout (location = 0) in vec3 Position;
+    layout (location = 1) in vec3 Color;
+    // Per-instance model transform, occupies locations 2-5.
+    layout (location = 2) in mat4 Model;
+
+    layout (location = 0) out vec4 oColor;
+    out gl_PerVertex
+    {
+        vec4 gl_Position;
+    };
+
+    void main()
+    {
+        oColor.rgb  = Color.rgb;
+        oColor.a  = 1.0;
+        gl_Position = ubuf.vp * Model * vec4(Position, 1);
+    }
+)_";
+
+// Single-pass stereo variant: one view-projection per view, selected by gl_ViewIndex
+constexpr char MultiviewVertexShaderGlsl[] =
+    R"_(
+    #version 430
+    #extension GL_ARB_separate_shader_objects : enable
+    #extension GL_EXT_multiview : require
+
+    layout (std140, set = 0, binding = 0) uniform buf
     {
-        mat4 mvp;
+        mat4 vp[2];
     } ubuf;
 
     layout (location = 0) in vec3 Position;
     layout (location = 1) in vec3 Color;
+    // Per-instance model transform, occupies locations 2-5.
+    layout (location = 2) in mat4 Model;
 
     layout (location = 0) out vec4 oColor;
     out gl_PerVertex
@@ -126,8 +168,9 @@ constexpr char VertexShaderGlsl[] =
 
     void main()
     {
-        oColor.rgba  = Color.rgba;
-        gl_Position = ubuf.mvp * Position;
+        oColor.rgb  = Color.rgb;
+        oColor.a  = 1.0;
+        gl_Position = ubuf.vp[gl_ViewIndex] * Model * vec4(Position, 1);
     }
 )_";
 
@@ -145,37 +188,377 @@ constexpr char FragmentShaderGlsl[] =
         FragColor = oColor;
     }
 )_";
+
+// Motion vectors for XR_FB_space_warp: each vertex both where its cube is now and where it was the previous frame
+constexpr char MotionVectorVertexShaderGlsl[] =
+    R"_(
+    #version 430
+    #extension GL_ARB_separate_shader_objects : enable
+
+    layout (std140, set = 0, binding = 0) uniform buf
+    {
+        mat4 vp;
+    } ubuf;
+
+    layout (location = 0) in vec3 Position;
+    // Per-instance model transforms of this frame and the previous one, occupy locations 2-5 and 6-9.
+    layout (location = 2) in mat4 Model;
+    layout (location = 6) in mat4 PreviousModel;
+
+    layout (location = 0) out vec4 oCurrent;
+    layout (location = 1) out vec4 oPrevious;
+    out gl_PerVertex
+    {
+        vec4 gl_Position;
+    };
+
+    void main()
+    {
+        vec4 position = vec4(Position, 1);
+        oCurrent = ubuf.vp * (Model * position);
+        oPrevious = ubuf.vp * (PreviousModel * position);
+        gl_Position = oCurrent;
+    }
+)_";
+
+constexpr char MotionVectorFragmentShaderGlsl[] =
+    R"_(
+    #version 430
+    #extension GL_ARB_separate_shader_objects : enable
+
+    layout (location = 0) in vec4 oCurrent;
+    layout (location = 1) in vec4 oPrevious;
+
+    layout (location = 0) out vec4 MotionVector;
+
+    void main()
+    {
+        // How far the surface moved in normalized device coordinates since the previous frame
+        MotionVector = vec4(oCurrent.xyz / oCurrent.w - oPrevious.xyz / oPrevious.w, 0);
+    }
+)_";
 #endif  // USE_ONLINE_VULKAN_SHADERC
 
+// A range of a VkDeviceMemory block handed out by MemoryAllocator.
+struct MemoryAllocation {
+    VkDeviceMemory memory{VK_NULL_HANDLE};
+    VkDeviceSize offset{0};
+    VkDeviceSize size{0};
+    void* mapped{nullptr};  // Start of the allocation when its memory is host visible
+    uint32_t pool{0};
+    uint32_t block{0};
+
+    bool Valid() const { return memory != VK_NULL_HANDLE; }
+};
+
+// Sub-allocates buffers and images from large VkDeviceMemory blocks, one pool of blocks per memory type and resource kind,
+// so the number of vkAllocateMemory calls stays far below maxMemoryAllocationCount and freed ranges are reused when
+// swapchains are recreated. Buffers and images use separate blocks so bufferImageGranularity never has to be honoured
+// between neighbours. Host-visible blocks are mapped once for their whole lifetime. Startup jobs allocate while swapchains
+// are created, so allocating and freeing are locked.
 struct MemoryAllocator {
+    static constexpr VkDeviceSize BlockSize = 32 * 1024 * 1024;
+
+    MemoryAllocator() = default;
+
+    ~MemoryAllocator() {
+        if (m_vkDevice != nullptr) {
+            for (std::vector<Block>& pool : m_pools) {
+                for (Block& block : pool) {
+                    if (block.memory != VK_NULL_HANDLE) {
+                        vkFreeMemory(m_vkDevice, block.memory, nullptr);
+                    }
+                }
+            }
+        }
+        m_vkDevice = nullptr;
+    }
+
+    MemoryAllocator(const MemoryAllocator&) = delete;
+    MemoryAllocator& operator=(const MemoryAllocator&) = delete;
+
     void Init(VkPhysicalDevice physicalDevice, VkDevice device) {
         m_vkDevice = device;
         vkGetPhysicalDeviceMemoryProperties(physicalDevice, &m_memProps);
+        VkPhysicalDeviceProperties properties{};
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+        m_maxAllocationCount = properties.limits.maxMemoryAllocationCount;
     }
 
     static const VkFlags defaultFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
 
-    void Allocate(VkMemoryRequirements const& memReqs, VkDeviceMemory* mem, VkFlags flags = defaultFlags,
-                  const void* pNext = nullptr) const {
+    // Allocate and bind memory for a buffer.
+    MemoryAllocation AllocateBuffer(VkBuffer buffer, VkFlags flags = defaultFlags) {
+        VkMemoryRequirements memReqs{};
+        vkGetBufferMemoryRequirements(m_vkDevice, buffer, &memReqs);
+        MemoryAllocation allocation = Allocate(memReqs, flags, false);
+        CHECK_VKCMD(vkBindBufferMemory(m_vkDevice, buffer, allocation.memory, allocation.offset));
+        return allocation;
+    }
+
+    // Allocate and bind memory for an optimally tiled image.
+    MemoryAllocation AllocateImage(VkImage image, VkFlags flags) {
+        VkMemoryRequirements memReqs{};
+        vkGetImageMemoryRequirements(m_vkDevice, image, &memReqs);
+        MemoryAllocation allocation = Allocate(memReqs, flags, true);
+        CHECK_VKCMD(vkBindImageMemory(m_vkDevice, image, allocation.memory, allocation.offset));
+        return allocation;
+    }
+
+    // Whether the image can be bound to memory with all of the given properties.
+    bool SupportsImage(VkImage image, VkFlags flags) const {
+        VkMemoryRequirements memReqs{};
+        vkGetImageMemoryRequirements(m_vkDevice, image, &memReqs);
+        return FindMemoryTypeIndex(memReqs.memoryTypeBits, flags) != UINT32_MAX;
+    }
+
+    // Return an allocation's range to its block. The resource bound to it must already be destroyed.
+    void Free(MemoryAllocation& allocation) {
+        if (!allocation.Valid()) {
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(m_lock);
+        Block& block = m_pools[allocation.pool][allocation.block];
+        // Insert the range in offset order and merge it with the free ranges on either side
+        auto next = std::lower_bound(block.freeRanges.begin(), block.freeRanges.end(), allocation.offset,
+                                     [](const Range& range, VkDeviceSize offset) { return range.offset < offset; });
+        next = block.freeRanges.insert(next, {allocation.offset, allocation.size});
+        if (next + 1 != block.freeRanges.end() && next->offset + next->size == (next + 1)->offset) {
+            next->size += (next + 1)->size;
+            block.freeRanges.erase(next + 1);
+        }
+        if (next != block.freeRanges.begin() && (next - 1)->offset + (next - 1)->size == next->offset) {
+            (next - 1)->size += next->size;
+            block.freeRanges.erase(next);
+        }
+
+        // Blocks made for one oversized resource are not worth keeping around
+        if (--block.allocationCount == 0 && block.dedicated) {
+            vkFreeMemory(m_vkDevice, block.memory, nullptr);
+            block = {};
+            --m_deviceMemoryCount;
+        }
+        allocation = {};
+    }
+
+   private:
+    struct Range {
+        VkDeviceSize offset;
+        VkDeviceSize size;
+    };
+
+    struct Block {
+        VkDeviceMemory memory{VK_NULL_HANDLE};
+        void* mapped{nullptr};
+        std::vector<Range> freeRanges;  // Sorted by offset, never adjacent
+        uint32_t allocationCount{0};
+        bool dedicated{false};
+    };
+
+    static VkDeviceSize AlignUp(VkDeviceSize value, VkDeviceSize alignment) {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    // Returns UINT32_MAX if no memory type matches.
+    uint32_t FindMemoryTypeIndex(uint32_t memoryTypeBits, VkFlags flags) const {
         // Search memtypes to find first index with those properties
         for (uint32_t i = 0; i < m_memProps.memoryTypeCount; ++i) {
-            if ((memReqs.memoryTypeBits & (1 << i)) != 0u) {
+            if ((memoryTypeBits & (1 << i)) != 0u) {
                 // Type is available, does it match user properties?
                 if ((m_memProps.memoryTypes[i].propertyFlags & flags) == flags) {
-                    VkMemoryAllocateInfo memAlloc{VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO, pNext};
-                    memAlloc.allocationSize = memReqs.size;
-                    memAlloc.memoryTypeIndex = i;
-                    CHECK_VKCMD(vkAllocateMemory(m_vkDevice, &memAlloc, nullptr, mem));
-                    return;
+                    return i;
                 }
             }
         }
-        THROW("Memory format not supported");
+        return UINT32_MAX;
+    }
+
+    uint32_t FindMemoryType(uint32_t memoryTypeBits, VkFlags flags) const {
+        const uint32_t memoryType = FindMemoryTypeIndex(memoryTypeBits, flags);
+        if (memoryType == UINT32_MAX) {
+            THROW("Memory format not supported");
+        }
+        return memoryType;
+    }
+
+    // Carve the first fitting range out of a block's free list.
+    static bool TryAllocate(Block& block, const VkMemoryRequirements& memReqs, VkDeviceSize* offset) {
+        for (auto range = block.freeRanges.begin(); range != block.freeRanges.end(); ++range) {
+            const VkDeviceSize alignedOffset = AlignUp(range->offset, memReqs.alignment);
+            const VkDeviceSize rangeEnd = range->offset + range->size;
+            if (alignedOffset + memReqs.size > rangeEnd) {
+                continue;
+            }
+
+            const Range front{range->offset, alignedOffset - range->offset};
+            const Range back{alignedOffset + memReqs.size, rangeEnd - alignedOffset - memReqs.size};
+            if (front.size > 0) {
+                *range = front;
+                if (back.size > 0) {
+                    block.freeRanges.insert(range + 1, back);
+                }
+            } else if (back.size > 0) {
+                *range = back;
+            } else {
+                block.freeRanges.erase(range);
+            }
+            ++block.allocationCount;
+            *offset = alignedOffset;
+            return true;
+        }
+        return false;
+    }
+
+    MemoryAllocation Allocate(const VkMemoryRequirements& memReqs, VkFlags flags, bool image) {
+        const uint32_t memoryType = FindMemoryType(memReqs.memoryTypeBits, flags);
+        const uint32_t poolIndex = memoryType * 2 + (image ? 1 : 0);
+        std::lock_guard<std::mutex> lock(m_lock);
+        std::vector<Block>& pool = m_pools[poolIndex];
+
+        MemoryAllocation allocation{};
+        allocation.pool = poolIndex;
+        allocation.size = memReqs.size;
+
+        const bool dedicated = memReqs.size > BlockSize / 2;
+        if (!dedicated) {
+            for (uint32_t i = 0; i < pool.size(); ++i) {
+                if (pool[i].memory != VK_NULL_HANDLE && !pool[i].dedicated &&
+                    TryAllocate(pool[i], memReqs, &allocation.offset)) {
+                    allocation.block = i;
+                    return Finish(pool[i], allocation);
+                }
+            }
+        }
+
+        // Reuse the slot of a released dedicated block before growing the pool
+        uint32_t blockIndex = 0;
+        while (blockIndex < pool.size() && pool[blockIndex].memory != VK_NULL_HANDLE) {
+            ++blockIndex;
+        }
+        if (blockIndex == pool.size()) {
+            pool.emplace_back();
+        }
+
+        Block& block = pool[blockIndex];
+        const VkDeviceSize blockSize = dedicated ? memReqs.size : BlockSize;
+        CHECK_MSG(m_deviceMemoryCount < m_maxAllocationCount, "Out of Vulkan memory allocations");
+        VkMemoryAllocateInfo memAlloc{VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO};
+        memAlloc.allocationSize = blockSize;
+        memAlloc.memoryTypeIndex = memoryType;
+        CHECK_VKCMD(vkAllocateMemory(m_vkDevice, &memAlloc, nullptr, &block.memory));
+        ++m_deviceMemoryCount;
+        if ((m_memProps.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) != 0) {
+            CHECK_VKCMD(vkMapMemory(m_vkDevice, block.memory, 0, VK_WHOLE_SIZE, 0, &block.mapped));
+        }
+        block.freeRanges = {{0, blockSize}};
+        block.dedicated = dedicated;
+        LOG_VERBOSE(Fmt("Allocated %llu byte %s memory block from type %u (%u of %u device allocations)",
+                        (unsigned long long)blockSize, image ? "image" : "buffer", memoryType, m_deviceMemoryCount,
+                        m_maxAllocationCount));
+
+        CHECK(TryAllocate(block, memReqs, &allocation.offset));
+        allocation.block = blockIndex;
+        return Finish(block, allocation);
+    }
+
+    static MemoryAllocation Finish(const Block& block, MemoryAllocation& allocation) {
+        allocation.memory = block.memory;
+        if (block.mapped != nullptr) {
+            allocation.mapped = static_cast<uint8_t*>(block.mapped) + allocation.offset;
+        }
+        return allocation;
     }
 
-   private:
     VkDevice m_vkDevice{VK_NULL_HANDLE};
     VkPhysicalDeviceMemoryProperties m_memProps{};
+    std::mutex m_lock;  // Guards the pools and the allocation count
+    std::array<std::vector<Block>, VK_MAX_MEMORY_TYPES * 2> m_pools;  // Indexed by memory type * 2 + (image ? 1 : 0)
+    uint32_t m_deviceMemoryCount{0};
+    uint32_t m_maxAllocationCount{UINT32_MAX};
+};
+
+// A VK_KHR_timeline_semaphore counting the submissions of one stream of command buffers to a queue. Every submission
+// signals the next value, so waiting for one of them is waiting for the counter to reach its value, and the completed
+// value, once read, answers for every earlier submission without asking the device again. Each stream gets its own
+// timeline so values are always signaled in the order they are handed out.
+struct QueueTimeline {
+    VkSemaphore semaphore{VK_NULL_HANDLE};
+
+    QueueTimeline() = default;
+
+    QueueTimeline(const QueueTimeline&) = delete;
+    QueueTimeline& operator=(const QueueTimeline&) = delete;
+
+    ~QueueTimeline() {
+        if (semaphore != VK_NULL_HANDLE) {
+            vkDestroySemaphore(m_vkDevice, semaphore, nullptr);
+        }
+    }
+
+    // The device must have been created with the timelineSemaphore feature enabled.
+    void Init(VkDevice device) {
+#if defined(VK_KHR_timeline_semaphore)
+        m_vkDevice = device;
+        m_waitSemaphores = (PFN_vkWaitSemaphoresKHR)vkGetDeviceProcAddr(m_vkDevice, "vkWaitSemaphoresKHR");
+        m_getSemaphoreCounterValue =
+            (PFN_vkGetSemaphoreCounterValueKHR)vkGetDeviceProcAddr(m_vkDevice, "vkGetSemaphoreCounterValueKHR");
+        CHECK(m_waitSemaphores != nullptr && m_getSemaphoreCounterValue != nullptr);
+
+        VkSemaphoreTypeCreateInfoKHR typeInfo{VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO_KHR};
+        typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE_KHR;
+        typeInfo.initialValue = 0;
+        VkSemaphoreCreateInfo semInfo{VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO};
+        semInfo.pNext = &typeInfo;
+        CHECK_VKCMD(vkCreateSemaphore(m_vkDevice, &semInfo, nullptr, &semaphore));
+#else
+        (void)device;
+        THROW("Built without VK_KHR_timeline_semaphore");
+#endif
+    }
+
+    // Value for the next submission to signal.
+    uint64_t Next() { return ++m_lastValue; }
+
+    bool Reached(uint64_t value) {
+        if (value <= m_completedValue) {
+            return true;
+        }
+#if defined(VK_KHR_timeline_semaphore)
+        CHECK_VKCMD(m_getSemaphoreCounterValue(m_vkDevice, semaphore, &m_completedValue));
+#endif
+        return value <= m_completedValue;
+    }
+
+    // VK_SUCCESS once the counter reaches value, VK_TIMEOUT if it does not within timeoutNs.
+    VkResult Wait(uint64_t value, uint64_t timeoutNs) {
+        if (Reached(value)) {
+            return VK_SUCCESS;
+        }
+#if defined(VK_KHR_timeline_semaphore)
+        VkSemaphoreWaitInfoKHR waitInfo{VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO_KHR};
+        waitInfo.semaphoreCount = 1;
+        waitInfo.pSemaphores = &semaphore;
+        waitInfo.pValues = &value;
+        const VkResult res = m_waitSemaphores(m_vkDevice, &waitInfo, timeoutNs);
+        if (res == VK_SUCCESS) {
+            m_completedValue = std::max(m_completedValue, value);
+        }
+        return res;
+#else
+        (void)timeoutNs;
+        return VK_ERROR_FEATURE_NOT_PRESENT;
+#endif
+    }
+
+   private:
+    VkDevice m_vkDevice{VK_NULL_HANDLE};
+    uint64_t m_lastValue{0};
+    uint64_t m_completedValue{0};
+#if defined(VK_KHR_timeline_semaphore)
+    PFN_vkWaitSemaphoresKHR m_waitSemaphores{nullptr};
+    PFN_vkGetSemaphoreCounterValueKHR m_getSemaphoreCounterValue{nullptr};
+#endif
 };
 
 // CmdBuffer - manage VkCommandBuffer state
@@ -194,7 +577,7 @@ struct CmdBuffer {
     CmdBufferState state{CmdBufferState::Undefined};
     VkCommandPool pool{VK_NULL_HANDLE};
     VkCommandBuffer buf{VK_NULL_HANDLE};
-    VkFence execFence{VK_NULL_HANDLE};
+    VkFence execFence{VK_NULL_HANDLE};  // Only without a timeline
 
     CmdBuffer() = default;
 
@@ -242,10 +625,12 @@ struct CmdBuffer {
         }                                                                                                          \
     while (0)
 
-    bool Init(VkDevice device, uint32_t queueFamilyIndex) {
+    // With a timeline, submissions signal it instead of a fence of their own. The timeline must outlive the CmdBuffer.
+    bool Init(VkDevice device, uint32_t queueFamilyIndex, QueueTimeline* timeline = nullptr) {
         CHECK_CBSTATE(CmdBufferState::Undefined);
 
         m_vkDevice = device;
+        m_timeline = timeline;
 
         // Create a command pool to allocate our command buffer from
         VkCommandPoolCreateInfo cmdPoolInfo{VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO};
@@ -260,8 +645,10 @@ struct CmdBuffer {
         cmd.commandBufferCount = 1;
         CHECK_VKCMD(vkAllocateCommandBuffers(m_vkDevice, &cmd, &buf));
 
-        VkFenceCreateInfo fenceInfo{VK_STRUCTURE_TYPE_FENCE_CREATE_INFO};
-        CHECK_VKCMD(vkCreateFence(m_vkDevice, &fenceInfo, nullptr, &execFence));
+        if (m_timeline == nullptr) {
+            VkFenceCreateInfo fenceInfo{VK_STRUCTURE_TYPE_FENCE_CREATE_INFO};
+            CHECK_VKCMD(vkCreateFence(m_vkDevice, &fenceInfo, nullptr, &execFence));
+        }
 
         SetState(CmdBufferState::Initialized);
         return true;
@@ -282,12 +669,40 @@ struct CmdBuffer {
         return true;
     }
 
-    bool Exec(VkQueue queue) {
+    // Optionally wait for the binary waitSemaphore before waitStage, and signal the binary signalSemaphore when done.
+    bool Exec(VkQueue queue, VkSemaphore waitSemaphore = VK_NULL_HANDLE, VkPipelineStageFlags waitStage = 0,
+              VkSemaphore signalSemaphore = VK_NULL_HANDLE) {
+        TRACE_SCOPE("CmdBuffer::Exec");
         CHECK_CBSTATE(CmdBufferState::Executable);
 
         VkSubmitInfo submitInfo{VK_STRUCTURE_TYPE_SUBMIT_INFO};
         submitInfo.commandBufferCount = 1;
         submitInfo.pCommandBuffers = &buf;
+        if (waitSemaphore != VK_NULL_HANDLE) {
+            submitInfo.waitSemaphoreCount = 1;
+            submitInfo.pWaitSemaphores = &waitSemaphore;
+            submitInfo.pWaitDstStageMask = &waitStage;
+        }
+
+        std::array<VkSemaphore, 2> signalSemaphores{};
+        std::array<uint64_t, 2> signalValues{};  // Ignored for binary semaphores
+        uint32_t signalCount = 0;
+        if (signalSemaphore != VK_NULL_HANDLE) {
+            signalSemaphores[signalCount++] = signalSemaphore;
+        }
+#if defined(VK_KHR_timeline_semaphore)
+        VkTimelineSemaphoreSubmitInfoKHR timelineInfo{VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR};
+        if (m_timeline != nullptr) {
+            m_timelineValue = m_timeline->Next();
+            signalValues[signalCount] = m_timelineValue;
+            signalSemaphores[signalCount++] = m_timeline->semaphore;
+            timelineInfo.signalSemaphoreValueCount = signalCount;
+            timelineInfo.pSignalSemaphoreValues = signalValues.data();
+            submitInfo.pNext = &timelineInfo;
+        }
+#endif
+        submitInfo.signalSemaphoreCount = signalCount;
+        submitInfo.pSignalSemaphores = signalCount > 0 ? signalSemaphores.data() : nullptr;
         CHECK_VKCMD(vkQueueSubmit(queue, 1, &submitInfo, execFence));
 
         SetState(CmdBufferState::Executing);
@@ -296,31 +711,52 @@ struct CmdBuffer {
 
     bool Wait() {
         // Waiting on a not-in-flight command buffer is a no-op
-        if (state == CmdBufferState::Initialized) {
+        if (state == CmdBufferState::Initialized || state == CmdBufferState::Executable) {
             return true;
         }
 
         CHECK_CBSTATE(CmdBufferState::Executing);
+        TRACE_SCOPE("CmdBuffer::Wait");
 
         const uint32_t timeoutNs = 1 * 1000 * 1000 * 1000;
         for (int i = 0; i < 5; ++i) {
-            auto res = vkWaitForFences(m_vkDevice, 1, &execFence, VK_TRUE, timeoutNs);
+            auto res = m_timeline != nullptr ? m_timeline->Wait(m_timelineValue, timeoutNs)
+                                             : vkWaitForFences(m_vkDevice, 1, &execFence, VK_TRUE, timeoutNs);
             if (res == VK_SUCCESS) {
                 // Buffer can be executed multiple times...
                 SetState(CmdBufferState::Executable);
                 return true;
             }
-            Log::Write(Log::Level::Info, "Waiting for CmdBuffer fence timed out, retrying...");
+            if (res != VK_TIMEOUT) {
+                CHECK_VKCMD(res);
+            }
+            Log::Write(Log::Level::Info, "Waiting for CmdBuffer timed out, retrying...");
         }
 
         return false;
     }
 
+    // Non-blocking completion check, returns true if the command buffer just finished executing
+    bool Poll() {
+        if (state != CmdBufferState::Executing) {
+            return false;
+        }
+        const bool done =
+            m_timeline != nullptr ? m_timeline->Reached(m_timelineValue) : vkGetFenceStatus(m_vkDevice, execFence) == VK_SUCCESS;
+        if (!done) {
+            return false;
+        }
+        SetState(CmdBufferState::Executable);
+        return true;
+    }
+
     bool Reset() {
         if (state != CmdBufferState::Initialized) {
             CHECK_CBSTATE(CmdBufferState::Executable);
 
-            CHECK_VKCMD(vkResetFences(m_vkDevice, 1, &execFence));
+            if (execFence != VK_NULL_HANDLE) {
+                CHECK_VKCMD(vkResetFences(m_vkDevice, 1, &execFence));
+            }
             CHECK_VKCMD(vkResetCommandBuffer(buf, 0));
 
             SetState(CmdBufferState::Initialized);
@@ -331,6 +767,8 @@ struct CmdBuffer {
 
    private:
     VkDevice m_vkDevice{VK_NULL_HANDLE};
+    QueueTimeline* m_timeline{nullptr};
+    uint64_t m_timelineValue{0};  // Signaled by the latest submission
 
     void SetState(CmdBufferState newState) { state = newState; }
 
@@ -338,6 +776,61 @@ struct CmdBuffer {
 #undef LIST_CMDBUFFER_STATES
 };
 
+// Secondary command buffers for recording the render passes of one frame's views on different threads. A command pool may
+// only be used by one thread at a time, so every view gets a pool of its own.
+struct ViewCmdBuffers {
+    struct View {
+        VkCommandPool pool{VK_NULL_HANDLE};
+        VkCommandBuffer buf{VK_NULL_HANDLE};
+    };
+    std::vector<View> views;
+
+    ViewCmdBuffers() = default;
+
+    ~ViewCmdBuffers() {
+        for (const View& view : views) {
+            // Destroying the pool frees its command buffer
+            vkDestroyCommandPool(m_vkDevice, view.pool, nullptr);
+        }
+    }
+
+    ViewCmdBuffers(const ViewCmdBuffers&) = delete;
+    ViewCmdBuffers& operator=(const ViewCmdBuffers&) = delete;
+    ViewCmdBuffers(ViewCmdBuffers&&) = delete;
+    ViewCmdBuffers& operator=(ViewCmdBuffers&&) = delete;
+
+    void Init(VkDevice device, uint32_t queueFamilyIndex) {
+        m_vkDevice = device;
+        m_queueFamilyIndex = queueFamilyIndex;
+    }
+
+    // Make sure there is a command buffer for each of viewCount views and reset them. The primary command buffer that last
+    // executed them must have finished.
+    void Reset(uint32_t viewCount) {
+        while (views.size() < viewCount) {
+            View view;
+            VkCommandPoolCreateInfo cmdPoolInfo{VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO};
+            cmdPoolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+            cmdPoolInfo.queueFamilyIndex = m_queueFamilyIndex;
+            CHECK_VKCMD(vkCreateCommandPool(m_vkDevice, &cmdPoolInfo, nullptr, &view.pool));
+            views.push_back(view);
+
+            VkCommandBufferAllocateInfo cmd{VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO};
+            cmd.commandPool = view.pool;
+            cmd.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+            cmd.commandBufferCount = 1;
+            CHECK_VKCMD(vkAllocateCommandBuffers(m_vkDevice, &cmd, &views.back().buf));
+        }
+        for (uint32_t i = 0; i < viewCount; ++i) {
+            CHECK_VKCMD(vkResetCommandPool(m_vkDevice, views[i].pool, 0));
+        }
+    }
+
+   private:
+    VkDevice m_vkDevice{VK_NULL_HANDLE};
+    uint32_t m_queueFamilyIndex{0};
+};
+
 // ShaderProgram to hold a pair of vertex & fragment shaders
 struct ShaderProgram {
     std::array<VkPipelineShaderStageCreateInfo, 2> shaderInfo{
@@ -402,14 +895,132 @@ struct ShaderProgram {
     }
 };
 
+// Creates device-local buffers for data that never changes, copying it in through host-visible staging buffers. The copies
+// are batched and submitted together by Submit, on a dedicated transfer queue when the device has one, and Wait blocks
+// until they are done so other work can overlap the upload.
+struct BufferUploader {
+    BufferUploader() = default;
+
+    ~BufferUploader() { ReleaseStaging(); }
+
+    BufferUploader(const BufferUploader&) = delete;
+    BufferUploader& operator=(const BufferUploader&) = delete;
+
+    // useTimeline tracks the uploads with a timeline semaphore of their own rather than a fence.
+    void Init(VkDevice device, MemoryAllocator* memAllocator, uint32_t graphicsQueueFamilyIndex,
+              uint32_t transferQueueFamilyIndex, VkQueue transferQueue, bool useTimeline) {
+        m_vkDevice = device;
+        m_memAllocator = memAllocator;
+        m_queueFamilyIndices = {graphicsQueueFamilyIndex, transferQueueFamilyIndex};
+        m_transferQueue = transferQueue;
+        if (useTimeline) {
+            m_timeline.Init(m_vkDevice);
+        }
+        if (!m_cmdBuffer.Init(m_vkDevice, transferQueueFamilyIndex, useTimeline ? &m_timeline : nullptr)) {
+            THROW("Failed to create upload command buffer");
+        }
+    }
+
+    // Create a device-local buffer holding a copy of data. It must not be used until Wait returns.
+    VkBuffer CreateBuffer(VkBufferUsageFlags usage, const void* data, VkDeviceSize size, MemoryAllocation* memory) {
+        VkBufferCreateInfo bufInfo{VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO};
+        bufInfo.usage = usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+        bufInfo.size = size;
+        // Shared with the graphics queue rather than transferring ownership, the data is only ever read there
+        if (m_queueFamilyIndices[0] != m_queueFamilyIndices[1]) {
+            bufInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+            bufInfo.queueFamilyIndexCount = (uint32_t)m_queueFamilyIndices.size();
+            bufInfo.pQueueFamilyIndices = m_queueFamilyIndices.data();
+        }
+        VkBuffer buffer{VK_NULL_HANDLE};
+        CHECK_VKCMD(vkCreateBuffer(m_vkDevice, &bufInfo, nullptr, &buffer));
+        *memory = m_memAllocator->AllocateBuffer(buffer, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+        VkBufferCreateInfo stagingInfo{VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO};
+        stagingInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+        stagingInfo.size = size;
+        m_staging.emplace_back();
+        StagingBuffer& staging = m_staging.back();
+        CHECK_VKCMD(vkCreateBuffer(m_vkDevice, &stagingInfo, nullptr, &staging.buf));
+        staging.mem = m_memAllocator->AllocateBuffer(staging.buf);
+        // data may point into a mapped mesh file, which is read ahead in chunks as it is copied
+        StreamCopy(staging.mem.mapped, data, (size_t)size);
+
+        if (m_cmdBuffer.state == CmdBuffer::CmdBufferState::Initialized) {
+            CHECK(m_cmdBuffer.Begin());
+        }
+        VkBufferCopy region{0, 0, size};
+        vkCmdCopyBuffer(m_cmdBuffer.buf, staging.buf, buffer, 1, &region);
+        return buffer;
+    }
+
+    // Submit the copies recorded so far.
+    void Submit() {
+        if (m_cmdBuffer.state != CmdBuffer::CmdBufferState::Recording) {
+            return;
+        }
+
+        // A graphics-capable queue can make the writes visible to vertex input itself
+        if (m_queueFamilyIndices[0] == m_queueFamilyIndices[1]) {
+            VkMemoryBarrier barrier{VK_STRUCTURE_TYPE_MEMORY_BARRIER};
+            barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            barrier.dstAccessMask = VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+            vkCmdPipelineBarrier(m_cmdBuffer.buf, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0, 1,
+                                 &barrier, 0, nullptr, 0, nullptr);
+        }
+
+        VkDeviceSize uploadedBytes = 0;
+        for (const StagingBuffer& staging : m_staging) {
+            uploadedBytes += staging.mem.size;
+        }
+
+        CHECK(m_cmdBuffer.End());
+        CHECK(m_cmdBuffer.Exec(m_transferQueue));
+        LOG_VERBOSE(Fmt("Uploading %llu bytes of static geometry", (unsigned long long)uploadedBytes));
+    }
+
+    // Wait for submitted copies and release their staging buffers. Cheap once nothing is pending.
+    void Wait() {
+        if (m_cmdBuffer.state != CmdBuffer::CmdBufferState::Executing) {
+            return;
+        }
+        CHECK(m_cmdBuffer.Wait());
+        CHECK(m_cmdBuffer.Reset());
+        ReleaseStaging();
+    }
+
+   private:
+    struct StagingBuffer {
+        VkBuffer buf{VK_NULL_HANDLE};
+        MemoryAllocation mem{};
+    };
+
+    void ReleaseStaging() {
+        for (StagingBuffer& staging : m_staging) {
+            vkDestroyBuffer(m_vkDevice, staging.buf, nullptr);
+            m_memAllocator->Free(staging.mem);
+        }
+        m_staging.clear();
+    }
+
+    VkDevice m_vkDevice{VK_NULL_HANDLE};
+    MemoryAllocator* m_memAllocator{nullptr};
+    std::array<uint32_t, 2> m_queueFamilyIndices{};  // Graphics, transfer
+    VkQueue m_transferQueue{VK_NULL_HANDLE};
+    QueueTimeline m_timeline{};  // Unused without timeline semaphores
+    CmdBuffer m_cmdBuffer{};
+    std::vector<StagingBuffer> m_staging;
+};
+
 // VertexBuffer base class
 struct VertexBufferBase {
     VkBuffer idxBuf{VK_NULL_HANDLE};
-    VkDeviceMemory idxMem{VK_NULL_HANDLE};
+    MemoryAllocation idxMem{};
     VkBuffer vtxBuf{VK_NULL_HANDLE};
-    VkDeviceMemory vtxMem{VK_NULL_HANDLE};
+    MemoryAllocation vtxMem{};
     VkVertexInputBindingDescription bindDesc{};
     std::vector<VkVertexInputAttributeDescription> attrDesc{};
+    VkIndexType idxType{VK_INDEX_TYPE_UINT16};
     struct {
         uint32_t idx;
         uint32_t vtx;
@@ -422,20 +1033,14 @@ struct VertexBufferBase {
             if (idxBuf != VK_NULL_HANDLE) {
                 vkDestroyBuffer(m_vkDevice, idxBuf, nullptr);
             }
-            if (idxMem != VK_NULL_HANDLE) {
-                vkFreeMemory(m_vkDevice, idxMem, nullptr);
-            }
+            m_memAllocator->Free(idxMem);
             if (vtxBuf != VK_NULL_HANDLE) {
                 vkDestroyBuffer(m_vkDevice, vtxBuf, nullptr);
             }
-            if (vtxMem != VK_NULL_HANDLE) {
-                vkFreeMemory(m_vkDevice, vtxMem, nullptr);
-            }
+            m_memAllocator->Free(vtxMem);
         }
         idxBuf = VK_NULL_HANDLE;
-        idxMem = VK_NULL_HANDLE;
         vtxBuf = VK_NULL_HANDLE;
-        vtxMem = VK_NULL_HANDLE;
         bindDesc = {};
         attrDesc.clear();
         count = {0, 0};
@@ -446,7 +1051,7 @@ struct VertexBufferBase {
     VertexBufferBase& operator=(const VertexBufferBase&) = delete;
     VertexBufferBase(VertexBufferBase&&) = delete;
     VertexBufferBase& operator=(VertexBufferBase&&) = delete;
-    void Init(VkDevice device, const MemoryAllocator* memAllocator, const std::vector<VkVertexInputAttributeDescription>& attr) {
+    void Init(VkDevice device, MemoryAllocator* memAllocator, const std::vector<VkVertexInputAttributeDescription>& attr) {
         m_vkDevice = device;
         m_memAllocator = memAllocator;
         attrDesc = attr;
@@ -454,81 +1059,351 @@ struct VertexBufferBase {
 
    protected:
     VkDevice m_vkDevice{VK_NULL_HANDLE};
-    void AllocateBufferMemory(VkBuffer buf, VkDeviceMemory* mem) const {
-        VkMemoryRequirements memReq = {};
-        vkGetBufferMemoryRequirements(m_vkDevice, buf, &memReq);
-        m_memAllocator->Allocate(memReq, mem);
-    }
+    MemoryAllocation AllocateBufferMemory(VkBuffer buf) const { return m_memAllocator->AllocateBuffer(buf); }
 
    private:
-    const MemoryAllocator* m_memAllocator{nullptr};
+    MemoryAllocator* m_memAllocator{nullptr};
 };
 
 // VertexBuffer template to wrap the indices and vertices
 template <typename T>
 struct VertexBuffer : public VertexBufferBase {
+    // The vertex layout is set here rather than with the buffers, so pipelines can be built while the geometry uploads.
+    void Init(VkDevice device, MemoryAllocator* memAllocator, const std::vector<VkVertexInputAttributeDescription>& attr) {
+        VertexBufferBase::Init(device, memAllocator, attr);
+        bindDesc.binding = 0;
+        bindDesc.stride = sizeof(T);
+        bindDesc.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+    }
+
     bool Create(uint32_t idxCount, uint32_t vtxCount) {
         VkBufferCreateInfo bufInfo{VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO};
         bufInfo.usage = VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
         bufInfo.size = sizeof(uint16_t) * idxCount;
         CHECK_VKCMD(vkCreateBuffer(m_vkDevice, &bufInfo, nullptr, &idxBuf));
-        AllocateBufferMemory(idxBuf, &idxMem);
-        CHECK_VKCMD(vkBindBufferMemory(m_vkDevice, idxBuf, idxMem, 0));
+        idxMem = AllocateBufferMemory(idxBuf);
 
         bufInfo.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
         bufInfo.size = sizeof(T) * vtxCount;
         CHECK_VKCMD(vkCreateBuffer(m_vkDevice, &bufInfo, nullptr, &vtxBuf));
-        AllocateBufferMemory(vtxBuf, &vtxMem);
-        CHECK_VKCMD(vkBindBufferMemory(m_vkDevice, vtxBuf, vtxMem, 0));
-
-        bindDesc.binding = 0;
-        bindDesc.stride = sizeof(T);
-        bindDesc.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+        vtxMem = AllocateBufferMemory(vtxBuf);
 
         count = {idxCount, vtxCount};
-
         return true;
     }
 
+    // Create device-local buffers for geometry that never changes, with 16- or 32-bit indices (idxSize bytes each). They
+    // are filled once uploader is flushed.
+    void CreateStatic(BufferUploader& uploader, const void* indices, uint32_t idxCount, uint32_t idxSize, const T* vertices,
+                      uint32_t vtxCount) {
+        CHECK(idxSize == sizeof(uint16_t) || idxSize == sizeof(uint32_t));
+        idxBuf = uploader.CreateBuffer(VK_BUFFER_USAGE_INDEX_BUFFER_BIT, indices, (VkDeviceSize)idxSize * idxCount, &idxMem);
+        vtxBuf = uploader.CreateBuffer(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, vertices, sizeof(T) * vtxCount, &vtxMem);
+        idxType = idxSize == sizeof(uint32_t) ? VK_INDEX_TYPE_UINT32 : VK_INDEX_TYPE_UINT16;
+        count = {idxCount, vtxCount};
+    }
+
+    // Buffer memory stays mapped by the allocator, so updates are plain copies.
     void UpdateIndicies(const uint16_t* data, uint32_t elements, uint32_t offset = 0) {
-        uint16_t* map = nullptr;
-        CHECK_VKCMD(vkMapMemory(m_vkDevice, idxMem, sizeof(map[0]) * offset, sizeof(map[0]) * elements, 0, (void**)&map));
-        for (size_t i = 0; i < elements; ++i) {
-            map[i] = data[i];
-        }
-        vkUnmapMemory(m_vkDevice, idxMem);
+        memcpy(static_cast<uint16_t*>(idxMem.mapped) + offset, data, sizeof(uint16_t) * elements);
     }
 
     void UpdateVertices(const T* data, uint32_t elements, uint32_t offset = 0) {
-        T* map = nullptr;
-        CHECK_VKCMD(vkMapMemory(m_vkDevice, vtxMem, sizeof(map[0]) * offset, sizeof(map[0]) * elements, 0, (void**)&map));
-        for (size_t i = 0; i < elements; ++i) {
-            map[i] = data[i];
+        memcpy(static_cast<T*>(vtxMem.mapped) + offset, data, sizeof(T) * elements);
+    }
+};
+
+// Persistently mapped, host-visible buffer of per-instance model matrices bound at InstanceBuffer::Binding, or at
+// PreviousBinding for the models of the previous frame that motion vectors are rendered from.
+// Each ring command buffer owns one, so it is only rewritten once the GPU is done with the previous contents.
+struct InstanceBuffer {
+    static constexpr uint32_t Binding = 1;
+    static constexpr uint32_t FirstLocation = 2;  // A mat4 input takes four consecutive locations
+    static constexpr uint32_t PreviousBinding = 2;
+    static constexpr uint32_t PreviousFirstLocation = 6;
+
+    VkBuffer buf{VK_NULL_HANDLE};
+    MemoryAllocation mem{};
+    uint32_t capacity{0};
+
+    InstanceBuffer() = default;
+
+    ~InstanceBuffer() { Release(); }
+
+    InstanceBuffer(const InstanceBuffer&) = delete;
+    InstanceBuffer& operator=(const InstanceBuffer&) = delete;
+    InstanceBuffer(InstanceBuffer&&) = delete;
+    InstanceBuffer& operator=(InstanceBuffer&&) = delete;
+
+    void Init(VkDevice device, MemoryAllocator* memAllocator) {
+        m_vkDevice = device;
+        m_memAllocator = memAllocator;
+    }
+
+    static VkVertexInputBindingDescription BindingDescription(uint32_t binding = Binding) {
+        return {binding, sizeof(XrMatrix4x4f), VK_VERTEX_INPUT_RATE_INSTANCE};
+    }
+
+    static std::array<VkVertexInputAttributeDescription, 4> AttributeDescriptions(uint32_t binding = Binding,
+                                                                                  uint32_t firstLocation = FirstLocation) {
+        std::array<VkVertexInputAttributeDescription, 4> attrs{};
+        for (uint32_t column = 0; column < attrs.size(); ++column) {
+            attrs[column] = {firstLocation + column, binding, VK_FORMAT_R32G32B32A32_SFLOAT,
+                             (uint32_t)(column * 4 * sizeof(float))};
+        }
+        return attrs;
+    }
+
+    // Copy in the model matrices, growing the buffer when needed. Returns the number of instances written.
+    uint32_t Update(const std::vector<XrMatrix4x4f>& cubeModels) {
+        const uint32_t count = (uint32_t)cubeModels.size();
+        if (count == 0) {
+            return 0;
+        }
+        if (count > capacity) {
+            Release();
+            // Grow geometrically so a slowly increasing cube count does not reallocate every frame
+            capacity = std::max(count, capacity * 2);
+
+            VkBufferCreateInfo bufInfo{VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO};
+            bufInfo.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
+            bufInfo.size = sizeof(XrMatrix4x4f) * capacity;
+            CHECK_VKCMD(vkCreateBuffer(m_vkDevice, &bufInfo, nullptr, &buf));
+            mem = m_memAllocator->AllocateBuffer(buf);
+            m_mapped = static_cast<XrMatrix4x4f*>(mem.mapped);
+        }
+
+        memcpy(m_mapped, cubeModels.data(), sizeof(XrMatrix4x4f) * count);
+        return count;
+    }
+
+    // Copy the model matrices from index first on again, after they changed since Update. The count must be the same.
+    void Rewrite(const std::vector<XrMatrix4x4f>& cubeModels, size_t first) {
+        CHECK(cubeModels.size() <= capacity);
+        if (first < cubeModels.size()) {
+            memcpy(m_mapped + first, cubeModels.data() + first, sizeof(XrMatrix4x4f) * (cubeModels.size() - first));
+        }
+    }
+
+   private:
+    void Release() {
+        if (m_vkDevice != nullptr) {
+            if (buf != VK_NULL_HANDLE) {
+                vkDestroyBuffer(m_vkDevice, buf, nullptr);
+            }
+            m_memAllocator->Free(mem);
+        }
+        buf = VK_NULL_HANDLE;
+        m_mapped = nullptr;
+    }
+
+    VkDevice m_vkDevice{VK_NULL_HANDLE};
+    MemoryAllocator* m_memAllocator{nullptr};
+    XrMatrix4x4f* m_mapped{nullptr};
+};
+
+// View-projections read by the vertex shader, one entry per view recorded into a ring command buffer, bound as a dynamic
+// uniform buffer. The memory stays mapped, so an entry can still be rewritten after recording until the command buffer is
+// submitted, which is what late latching does.
+struct ViewUniforms {
+    static constexpr uint32_t MaxViews = 4;
+    static constexpr uint32_t MatricesPerEntry = 2;  // The multiview shader reads one view-projection per eye from entry 0
+
+    VkBuffer buf{VK_NULL_HANDLE};
+    MemoryAllocation mem{};
+    VkDescriptorPool pool{VK_NULL_HANDLE};
+    VkDescriptorSet set{VK_NULL_HANDLE};
+
+    ViewUniforms() = default;
+
+    ~ViewUniforms() {
+        if (m_vkDevice != nullptr) {
+            // Destroying the pool frees the set
+            if (pool != VK_NULL_HANDLE) {
+                vkDestroyDescriptorPool(m_vkDevice, pool, nullptr);
+            }
+            if (buf != VK_NULL_HANDLE) {
+                vkDestroyBuffer(m_vkDevice, buf, nullptr);
+            }
+            m_memAllocator->Free(mem);
         }
-        vkUnmapMemory(m_vkDevice, vtxMem);
+        pool = VK_NULL_HANDLE;
+        buf = VK_NULL_HANDLE;
+        m_vkDevice = nullptr;
+    }
+
+    ViewUniforms(const ViewUniforms&) = delete;
+    ViewUniforms& operator=(const ViewUniforms&) = delete;
+    ViewUniforms(ViewUniforms&&) = delete;
+    ViewUniforms& operator=(ViewUniforms&&) = delete;
+
+    static VkDeviceSize EntrySize() { return MatricesPerEntry * sizeof(XrMatrix4x4f); }
+
+    void Init(VkDevice device, MemoryAllocator* memAllocator, VkDescriptorSetLayout setLayout, VkDeviceSize offsetAlignment) {
+        m_vkDevice = device;
+        m_memAllocator = memAllocator;
+        m_stride = (EntrySize() + offsetAlignment - 1) / offsetAlignment * offsetAlignment;
+
+        VkBufferCreateInfo bufInfo{VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO};
+        bufInfo.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
+        bufInfo.size = m_stride * MaxViews;
+        CHECK_VKCMD(vkCreateBuffer(m_vkDevice, &bufInfo, nullptr, &buf));
+        mem = m_memAllocator->AllocateBuffer(buf);
+        m_mapped = static_cast<uint8_t*>(mem.mapped);
+
+        VkDescriptorPoolSize poolSize{VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1};
+        VkDescriptorPoolCreateInfo poolInfo{VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO};
+        poolInfo.maxSets = 1;
+        poolInfo.poolSizeCount = 1;
+        poolInfo.pPoolSizes = &poolSize;
+        CHECK_VKCMD(vkCreateDescriptorPool(m_vkDevice, &poolInfo, nullptr, &pool));
+
+        VkDescriptorSetAllocateInfo setInfo{VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO};
+        setInfo.descriptorPool = pool;
+        setInfo.descriptorSetCount = 1;
+        setInfo.pSetLayouts = &setLayout;
+        CHECK_VKCMD(vkAllocateDescriptorSets(m_vkDevice, &setInfo, &set));
+
+        // The dynamic offset picks the entry, the descriptor covers one
+        const VkDescriptorBufferInfo bufferInfo{buf, 0, EntrySize()};
+        VkWriteDescriptorSet write{VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET};
+        write.dstSet = set;
+        write.dstBinding = 0;
+        write.descriptorCount = 1;
+        write.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+        write.pBufferInfo = &bufferInfo;
+        vkUpdateDescriptorSets(m_vkDevice, 1, &write, 0, nullptr);
+    }
+
+    // The MatricesPerEntry view-projections of an entry.
+    XrMatrix4x4f* Entry(uint32_t entry) const {
+        CHECK(entry < MaxViews);
+        return reinterpret_cast<XrMatrix4x4f*>(m_mapped + m_stride * entry);
     }
+
+    uint32_t DynamicOffset(uint32_t entry) const { return (uint32_t)(m_stride * entry); }
+
+   private:
+    VkDevice m_vkDevice{VK_NULL_HANDLE};
+    MemoryAllocator* m_memAllocator{nullptr};
+    VkDeviceSize m_stride{0};  // Entry size rounded up to minUniformBufferOffsetAlignment
+    uint8_t* m_mapped{nullptr};
+};
+
+// Pairs of GPU timestamps bracketing each view recorded into one command buffer.
+struct TimestampQueries {
+    VkQueryPool pool{VK_NULL_HANDLE};
+    GpuTimedViews timedViews;  // By the last recording, not yet read back
+    uint64_t submission{0};    // Orders recordings so only the newest completed one is reported
+
+    TimestampQueries() = default;
+
+    ~TimestampQueries() {
+        if (m_vkDevice != nullptr && pool != VK_NULL_HANDLE) {
+            vkDestroyQueryPool(m_vkDevice, pool, nullptr);
+        }
+        pool = VK_NULL_HANDLE;
+        m_vkDevice = nullptr;
+    }
+
+    TimestampQueries(const TimestampQueries&) = delete;
+    TimestampQueries& operator=(const TimestampQueries&) = delete;
+    TimestampQueries(TimestampQueries&&) = delete;
+    TimestampQueries& operator=(TimestampQueries&&) = delete;
+
+    void Init(VkDevice device) {
+        m_vkDevice = device;
+
+        VkQueryPoolCreateInfo queryPoolInfo{VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO};
+        queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+        queryPoolInfo.queryCount = 2 * MaxGpuTimerViews;
+        CHECK_VKCMD(vkCreateQueryPool(m_vkDevice, &queryPoolInfo, nullptr, &pool));
+    }
+
+    // Must be recorded outside of a render pass, before any view is timed.
+    void Reset(VkCommandBuffer buf, uint64_t newSubmission) {
+        vkCmdResetQueryPool(buf, pool, 0, 2 * MaxGpuTimerViews);
+        timedViews.Take();
+        submission = newSubmission;
+    }
+
+    void BeginView(VkCommandBuffer buf) const {
+        if (timedViews.CanTime()) {
+            vkCmdWriteTimestamp(buf, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, pool, 2 * timedViews.Count);
+        }
+    }
+
+    void EndView(VkCommandBuffer buf) {
+        if (timedViews.CanTime()) {
+            vkCmdWriteTimestamp(buf, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, pool, 2 * timedViews.Count + 1);
+            timedViews.Timed();
+        }
+    }
+
+    // Read back the view durations of the last recording. Only call once its command buffer has finished executing.
+    // Returns false if the results were not available.
+    bool Read(float timestampPeriod, uint64_t timestampMask, GpuViewTimes& gpuViewTimes) {
+        std::array<uint64_t, 2 * MaxGpuTimerViews> ticks{};
+        const uint32_t viewCount = timedViews.Take();
+        if (viewCount == 0 || vkGetQueryPoolResults(m_vkDevice, pool, 0, 2 * viewCount, sizeof(ticks), ticks.data(),
+                                                    sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) != VK_SUCCESS) {
+            return false;
+        }
+        std::vector<uint64_t>& viewNanoseconds = gpuViewTimes.Store(viewCount);
+        for (uint32_t view = 0; view < viewCount; ++view) {
+            const uint64_t elapsed = (ticks[2 * view + 1] - ticks[2 * view]) & timestampMask;  // Handles wrap-around
+            viewNanoseconds[view] = (uint64_t)(elapsed * (double)timestampPeriod);
+        }
+        return true;
+    }
+
+   private:
+    VkDevice m_vkDevice{VK_NULL_HANDLE};
 };
 
 // RenderPass wrapper
 struct RenderPass {
     VkFormat colorFmt{};
     VkFormat depthFmt{};
+    VkExtent2D shadingRateTexelSize{};  // Non-zero when the pass has a fragment shading rate attachment after color and depth
+    VkSampleCountFlagBits samples{VK_SAMPLE_COUNT_1_BIT};
+    bool storeDepth{true};
     VkRenderPass pass{VK_NULL_HANDLE};
 
     RenderPass() = default;
 
-    bool Create(VkDevice device, VkFormat aColorFmt, VkFormat aDepthFmt) {
+    // A non-zero viewMask renders each set bit's layer of the attachments in a single pass (VK_KHR_multiview). A non-zero
+    // aShadingRateTexelSize adds an R8_UINT fragment shading rate attachment, each texel of which sets the fragment size
+    // of that many pixels (VK_KHR_fragment_shading_rate). Without aStoreDepth the depth attachment is discarded at the end
+    // of the pass, which saves tile-based GPUs writing it back to memory. Store ops do not affect render pass compatibility,
+    // so a pass that stores depth and one that does not can share pipelines and framebuffers. With more than one of
+    // aSamples, color and depth are transient multisampled attachments that are never stored, and the color samples are
+    // resolved into a single-sampled attachment after them as each tile is written out. Depth is not resolved, so those
+    // passes cannot store it.
+    bool Create(VkDevice device, VkFormat aColorFmt, VkFormat aDepthFmt, bool aStoreDepth, uint32_t viewMask = 0,
+                VkExtent2D aShadingRateTexelSize = {}, VkSampleCountFlagBits aSamples = VK_SAMPLE_COUNT_1_BIT) {
         m_vkDevice = device;
         colorFmt = aColorFmt;
         depthFmt = aDepthFmt;
+        samples = aSamples;
+        storeDepth = aStoreDepth && samples == VK_SAMPLE_COUNT_1_BIT;
+        shadingRateTexelSize = aShadingRateTexelSize;
+        const bool multisampled = samples != VK_SAMPLE_COUNT_1_BIT;
+#if defined(VK_KHR_fragment_shading_rate)
+        if (shadingRateTexelSize.width != 0) {
+            CreateWithShadingRate(viewMask);
+            return true;
+        }
+#endif
 
         VkSubpassDescription subpass = {};
         subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
 
         VkAttachmentReference colorRef = {0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL};
         VkAttachmentReference depthRef = {1, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL};
+        VkAttachmentReference resolveRef = {2, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL};
 
-        std::array<VkAttachmentDescription, 2> at = {};
+        std::array<VkAttachmentDescription, 3> at = {};
 
         VkRenderPassCreateInfo rpInfo{VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO};
         rpInfo.attachmentCount = 0;
@@ -540,12 +1415,13 @@ struct RenderPass {
             colorRef.attachment = rpInfo.attachmentCount++;
 
             at[colorRef.attachment].format = colorFmt;
-            at[colorRef.attachment].samples = VK_SAMPLE_COUNT_1_BIT;
+            at[colorRef.attachment].samples = samples;
             at[colorRef.attachment].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-            at[colorRef.attachment].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+            at[colorRef.attachment].storeOp = multisampled ? VK_ATTACHMENT_STORE_OP_DONT_CARE : VK_ATTACHMENT_STORE_OP_STORE;
             at[colorRef.attachment].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
             at[colorRef.attachment].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-            at[colorRef.attachment].initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+            at[colorRef.attachment].initialLayout =
+                multisampled ? VK_IMAGE_LAYOUT_UNDEFINED : VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
             at[colorRef.attachment].finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
             subpass.colorAttachmentCount = 1;
@@ -556,9 +1432,9 @@ struct RenderPass {
             depthRef.attachment = rpInfo.attachmentCount++;
 
             at[depthRef.attachment].format = depthFmt;
-            at[depthRef.attachment].samples = VK_SAMPLE_COUNT_1_BIT;
+            at[depthRef.attachment].samples = samples;
             at[depthRef.attachment].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-            at[depthRef.attachment].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+            at[depthRef.attachment].storeOp = storeDepth ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
             at[depthRef.attachment].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
             at[depthRef.attachment].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
             at[depthRef.attachment].initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
@@ -567,6 +1443,40 @@ struct RenderPass {
             subpass.pDepthStencilAttachment = &depthRef;
         }
 
+        if (multisampled) {
+            CHECK(colorFmt != VK_FORMAT_UNDEFINED);
+            resolveRef.attachment = rpInfo.attachmentCount++;
+
+            at[resolveRef.attachment] = at[colorRef.attachment];
+            at[resolveRef.attachment].samples = VK_SAMPLE_COUNT_1_BIT;
+            at[resolveRef.attachment].loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+            at[resolveRef.attachment].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+            at[resolveRef.attachment].initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+            subpass.pResolveAttachments = &resolveRef;
+        }
+
+        // The private depth buffer of a swapchain is shared by every frame in flight, so this frame's depth clear has to
+        // wait for the depth tests of the frames submitted before it, and likewise for the multisampled color buffer.
+        VkSubpassDependency depthDependency{};
+        if (depthFmt != VK_FORMAT_UNDEFINED || multisampled) {
+            depthDependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+            depthDependency.dstSubpass = 0;
+            AddReuseDependency(depthFmt != VK_FORMAT_UNDEFINED, multisampled, depthDependency);
+            rpInfo.dependencyCount = 1;
+            rpInfo.pDependencies = &depthDependency;
+        }
+
+        VkRenderPassMultiviewCreateInfoKHR multiviewInfo{VK_STRUCTURE_TYPE_RENDER_PASS_MULTIVIEW_CREATE_INFO_KHR};
+        if (viewMask != 0) {
+            // All views see the same geometry, so let the implementation share work between them.
+            multiviewInfo.subpassCount = 1;
+            multiviewInfo.pViewMasks = &viewMask;
+            multiviewInfo.correlationMaskCount = 1;
+            multiviewInfo.pCorrelationMasks = &viewMask;
+            rpInfo.pNext = &multiviewInfo;
+        }
+
         CHECK_VKCMD(vkCreateRenderPass(m_vkDevice, &rpInfo, nullptr, &pass));
 
         return true;
@@ -588,6 +1498,123 @@ struct RenderPass {
     RenderPass& operator=(RenderPass&&) = delete;
 
    private:
+    // Order this frame's clears of the attachments every frame in flight shares, the private depth buffer and with
+    // multisampling the color buffer, after the earlier frames' use of them. Dependency is a VkSubpassDependency or a
+    // VkSubpassDependency2KHR.
+    template <typename Dependency>
+    static void AddReuseDependency(bool depth, bool color, Dependency& dependency) {
+        if (depth) {
+            dependency.srcStageMask |= VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+            dependency.dstStageMask |= VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+            dependency.srcAccessMask |= VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+            dependency.dstAccessMask |= VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+        }
+        if (color) {
+            dependency.srcStageMask |= VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+            dependency.dstStageMask |= VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+            dependency.srcAccessMask |= VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+            dependency.dstAccessMask |= VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+        }
+    }
+
+#if defined(VK_KHR_fragment_shading_rate)
+    // Shading rate attachments can only be described with the VK_KHR_create_renderpass2 structures. The attachments are
+    // color, depth, the resolved color when multisampled, and the shading rate.
+    void CreateWithShadingRate(uint32_t viewMask) {
+        CHECK(colorFmt != VK_FORMAT_UNDEFINED && depthFmt != VK_FORMAT_UNDEFINED);
+        const bool multisampled = samples != VK_SAMPLE_COUNT_1_BIT;
+        const uint32_t resolveIndex = 2;
+        const uint32_t shadingRateIndex = multisampled ? 3 : 2;
+
+        std::array<VkAttachmentDescription2KHR, 4> at{};
+        for (VkAttachmentDescription2KHR& attachment : at) {
+            attachment.sType = VK_STRUCTURE_TYPE_ATTACHMENT_DESCRIPTION_2_KHR;
+            attachment.samples = VK_SAMPLE_COUNT_1_BIT;
+            attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+            attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        }
+
+        at[0].format = colorFmt;
+        at[0].samples = samples;
+        at[0].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+        at[0].storeOp = multisampled ? VK_ATTACHMENT_STORE_OP_DONT_CARE : VK_ATTACHMENT_STORE_OP_STORE;
+        at[0].initialLayout = multisampled ? VK_IMAGE_LAYOUT_UNDEFINED : VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+        at[0].finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+        at[1].format = depthFmt;
+        at[1].samples = samples;
+        at[1].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+        at[1].storeOp = storeDepth ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        at[1].initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+        at[1].finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+        if (multisampled) {
+            at[resolveIndex].format = colorFmt;
+            at[resolveIndex].loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+            at[resolveIndex].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+            at[resolveIndex].initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+            at[resolveIndex].finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+        }
+
+        at[shadingRateIndex].format = VK_FORMAT_R8_UINT;
+        at[shadingRateIndex].loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+        at[shadingRateIndex].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        at[shadingRateIndex].initialLayout = VK_IMAGE_LAYOUT_FRAGMENT_SHADING_RATE_ATTACHMENT_OPTIMAL_KHR;
+        at[shadingRateIndex].finalLayout = VK_IMAGE_LAYOUT_FRAGMENT_SHADING_RATE_ATTACHMENT_OPTIMAL_KHR;
+
+        VkAttachmentReference2KHR colorRef{VK_STRUCTURE_TYPE_ATTACHMENT_REFERENCE_2_KHR};
+        colorRef.attachment = 0;
+        colorRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+        colorRef.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        VkAttachmentReference2KHR depthRef{VK_STRUCTURE_TYPE_ATTACHMENT_REFERENCE_2_KHR};
+        depthRef.attachment = 1;
+        depthRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+        depthRef.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+        VkAttachmentReference2KHR resolveRef{VK_STRUCTURE_TYPE_ATTACHMENT_REFERENCE_2_KHR};
+        resolveRef.attachment = resolveIndex;
+        resolveRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+        resolveRef.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        VkAttachmentReference2KHR shadingRateRef{VK_STRUCTURE_TYPE_ATTACHMENT_REFERENCE_2_KHR};
+        shadingRateRef.attachment = shadingRateIndex;
+        shadingRateRef.layout = VK_IMAGE_LAYOUT_FRAGMENT_SHADING_RATE_ATTACHMENT_OPTIMAL_KHR;
+
+        VkFragmentShadingRateAttachmentInfoKHR shadingRateInfo{VK_STRUCTURE_TYPE_FRAGMENT_SHADING_RATE_ATTACHMENT_INFO_KHR};
+        shadingRateInfo.pFragmentShadingRateAttachment = &shadingRateRef;
+        shadingRateInfo.shadingRateAttachmentTexelSize = shadingRateTexelSize;
+
+        VkSubpassDescription2KHR subpass{VK_STRUCTURE_TYPE_SUBPASS_DESCRIPTION_2_KHR};
+        subpass.pNext = &shadingRateInfo;
+        subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+        subpass.viewMask = viewMask;
+        subpass.colorAttachmentCount = 1;
+        subpass.pColorAttachments = &colorRef;
+        subpass.pResolveAttachments = multisampled ? &resolveRef : nullptr;
+        subpass.pDepthStencilAttachment = &depthRef;
+
+        // Orders the clears of the shared attachments after the earlier frames' use of them, as in Create.
+        VkSubpassDependency2KHR depthDependency{VK_STRUCTURE_TYPE_SUBPASS_DEPENDENCY_2_KHR};
+        depthDependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+        depthDependency.dstSubpass = 0;
+        AddReuseDependency(true, multisampled, depthDependency);
+
+        VkRenderPassCreateInfo2KHR rpInfo{VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO_2_KHR};
+        rpInfo.attachmentCount = shadingRateIndex + 1;
+        rpInfo.pAttachments = at.data();
+        rpInfo.subpassCount = 1;
+        rpInfo.pSubpasses = &subpass;
+        rpInfo.dependencyCount = 1;
+        rpInfo.pDependencies = &depthDependency;
+        if (viewMask != 0) {
+            rpInfo.correlatedViewMaskCount = 1;
+            rpInfo.pCorrelatedViewMasks = &viewMask;
+        }
+
+        auto pfnCreateRenderPass2KHR = (PFN_vkCreateRenderPass2KHR)vkGetDeviceProcAddr(m_vkDevice, "vkCreateRenderPass2KHR");
+        CHECK(pfnCreateRenderPass2KHR != nullptr);
+        CHECK_VKCMD(pfnCreateRenderPass2KHR(m_vkDevice, &rpInfo, nullptr, &pass));
+    }
+#endif
+
     VkDevice m_vkDevice{VK_NULL_HANDLE};
 };
 
@@ -595,8 +1622,10 @@ struct RenderPass {
 struct RenderTarget {
     VkImage colorImage{VK_NULL_HANDLE};
     VkImage depthImage{VK_NULL_HANDLE};
+    VkImage resolveImage{VK_NULL_HANDLE};  // The swapchain image, when colorImage is multisampled
     VkImageView colorView{VK_NULL_HANDLE};
     VkImageView depthView{VK_NULL_HANDLE};
+    VkImageView resolveView{VK_NULL_HANDLE};
     VkFramebuffer fb{VK_NULL_HANDLE};
 
     RenderTarget() = default;
@@ -612,13 +1641,18 @@ struct RenderTarget {
             if (depthView != VK_NULL_HANDLE) {
                 vkDestroyImageView(m_vkDevice, depthView, nullptr);
             }
+            if (resolveView != VK_NULL_HANDLE) {
+                vkDestroyImageView(m_vkDevice, resolveView, nullptr);
+            }
         }
 
-        // Note we don't own color/depthImage, it will get destroyed when xrDestroySwapchain is called
+        // Note we don't own color/depth/resolveImage, it will get destroyed when xrDestroySwapchain is called
         colorImage = VK_NULL_HANDLE;
         depthImage = VK_NULL_HANDLE;
+        resolveImage = VK_NULL_HANDLE;
         colorView = VK_NULL_HANDLE;
         depthView = VK_NULL_HANDLE;
+        resolveView = VK_NULL_HANDLE;
         fb = VK_NULL_HANDLE;
         m_vkDevice = nullptr;
     }
@@ -627,8 +1661,10 @@ struct RenderTarget {
         using std::swap;
         swap(colorImage, other.colorImage);
         swap(depthImage, other.depthImage);
+        swap(resolveImage, other.resolveImage);
         swap(colorView, other.colorView);
         swap(depthView, other.depthView);
+        swap(resolveView, other.resolveView);
         swap(fb, other.fb);
         swap(m_vkDevice, other.m_vkDevice);
     }
@@ -641,26 +1677,33 @@ struct RenderTarget {
         using std::swap;
         swap(colorImage, other.colorImage);
         swap(depthImage, other.depthImage);
+        swap(resolveImage, other.resolveImage);
         swap(colorView, other.colorView);
         swap(depthView, other.depthView);
+        swap(resolveView, other.resolveView);
         swap(fb, other.fb);
         swap(m_vkDevice, other.m_vkDevice);
         return *this;
     }
-    void Create(VkDevice device, VkImage aColorImage, VkImage aDepthImage, VkExtent2D size, RenderPass& renderPass) {
+    // The framebuffer does not own shadingRateView, which is needed when the render pass has a shading rate attachment.
+    // aResolveImage is needed when the render pass is multisampled, and receives the resolved samples of aColorImage.
+    void Create(VkDevice device, VkImage aColorImage, VkImage aDepthImage, VkExtent2D size, const RenderPass& renderPass,
+                uint32_t layerCount = 1, VkImageView shadingRateView = VK_NULL_HANDLE, VkImage aResolveImage = VK_NULL_HANDLE) {
         m_vkDevice = device;
+        const VkImageViewType viewType = layerCount > 1 ? VK_IMAGE_VIEW_TYPE_2D_ARRAY : VK_IMAGE_VIEW_TYPE_2D;
 
         colorImage = aColorImage;
         depthImage = aDepthImage;
+        resolveImage = aResolveImage;
 
-        std::array<VkImageView, 2> attachments{};
+        std::array<VkImageView, 4> attachments{};
         uint32_t attachmentCount = 0;
 
         // Create color image view
         if (colorImage != VK_NULL_HANDLE) {
             VkImageViewCreateInfo colorViewInfo{VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO};
             colorViewInfo.image = colorImage;
-            colorViewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+            colorViewInfo.viewType = viewType;
             colorViewInfo.format = renderPass.colorFmt;
             colorViewInfo.components.r = VK_COMPONENT_SWIZZLE_R;
             colorViewInfo.components.g = VK_COMPONENT_SWIZZLE_G;
@@ -670,7 +1713,7 @@ struct RenderTarget {
             colorViewInfo.subresourceRange.baseMipLevel = 0;
             colorViewInfo.subresourceRange.levelCount = 1;
             colorViewInfo.subresourceRange.baseArrayLayer = 0;
-            colorViewInfo.subresourceRange.layerCount = 1;
+            colorViewInfo.subresourceRange.layerCount = layerCount;
             CHECK_VKCMD(vkCreateImageView(m_vkDevice, &colorViewInfo, nullptr, &colorView));
             attachments[attachmentCount++] = colorView;
         }
@@ -679,7 +1722,7 @@ struct RenderTarget {
         if (depthImage != VK_NULL_HANDLE) {
             VkImageViewCreateInfo depthViewInfo{VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO};
             depthViewInfo.image = depthImage;
-            depthViewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+            depthViewInfo.viewType = viewType;
             depthViewInfo.format = renderPass.depthFmt;
             depthViewInfo.components.r = VK_COMPONENT_SWIZZLE_R;
             depthViewInfo.components.g = VK_COMPONENT_SWIZZLE_G;
@@ -689,11 +1732,36 @@ struct RenderTarget {
             depthViewInfo.subresourceRange.baseMipLevel = 0;
             depthViewInfo.subresourceRange.levelCount = 1;
             depthViewInfo.subresourceRange.baseArrayLayer = 0;
-            depthViewInfo.subresourceRange.layerCount = 1;
+            depthViewInfo.subresourceRange.layerCount = layerCount;
             CHECK_VKCMD(vkCreateImageView(m_vkDevice, &depthViewInfo, nullptr, &depthView));
             attachments[attachmentCount++] = depthView;
         }
 
+        // Create the view of the image the color samples are resolved into
+        if (renderPass.samples != VK_SAMPLE_COUNT_1_BIT) {
+            CHECK(colorImage != VK_NULL_HANDLE && resolveImage != VK_NULL_HANDLE);
+            VkImageViewCreateInfo resolveViewInfo{VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO};
+            resolveViewInfo.image = resolveImage;
+            resolveViewInfo.viewType = viewType;
+            resolveViewInfo.format = renderPass.colorFmt;
+            resolveViewInfo.components.r = VK_COMPONENT_SWIZZLE_R;
+            resolveViewInfo.components.g = VK_COMPONENT_SWIZZLE_G;
+            resolveViewInfo.components.b = VK_COMPONENT_SWIZZLE_B;
+            resolveViewInfo.components.a = VK_COMPONENT_SWIZZLE_A;
+            resolveViewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            resolveViewInfo.subresourceRange.baseMipLevel = 0;
+            resolveViewInfo.subresourceRange.levelCount = 1;
+            resolveViewInfo.subresourceRange.baseArrayLayer = 0;
+            resolveViewInfo.subresourceRange.layerCount = layerCount;
+            CHECK_VKCMD(vkCreateImageView(m_vkDevice, &resolveViewInfo, nullptr, &resolveView));
+            attachments[attachmentCount++] = resolveView;
+        }
+
+        if (renderPass.shadingRateTexelSize.width != 0) {
+            CHECK(shadingRateView != VK_NULL_HANDLE);
+            attachments[attachmentCount++] = shadingRateView;
+        }
+
         VkFramebufferCreateInfo fbInfo{VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO};
         fbInfo.renderPass = renderPass.pass;
         fbInfo.attachmentCount = attachmentCount;
@@ -713,6 +1781,7 @@ struct RenderTarget {
 
 // Simple vertex MVP xform & color fragment shader layout
 struct PipelineLayout {
+    VkDescriptorSetLayout setLayout{VK_NULL_HANDLE};
     VkPipelineLayout layout{VK_NULL_HANDLE};
 
     PipelineLayout() = default;
@@ -722,23 +1791,32 @@ struct PipelineLayout {
             if (layout != VK_NULL_HANDLE) {
                 vkDestroyPipelineLayout(m_vkDevice, layout, nullptr);
             }
+            if (setLayout != VK_NULL_HANDLE) {
+                vkDestroyDescriptorSetLayout(m_vkDevice, setLayout, nullptr);
+            }
         }
         layout = VK_NULL_HANDLE;
+        setLayout = VK_NULL_HANDLE;
         m_vkDevice = nullptr;
     }
 
     void Create(VkDevice device) {
         m_vkDevice = device;
 
-        // MVP matrix is a push_constant
-        VkPushConstantRange pcr = {};
-        pcr.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
-        pcr.offset = 0;
-        pcr.size = 4 * 4 * sizeof(float);
+        // The view-projection(s) come from an entry of the ViewUniforms buffer, selected by a dynamic offset
+        VkDescriptorSetLayoutBinding binding{};
+        binding.binding = 0;
+        binding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+        binding.descriptorCount = 1;
+        binding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+        VkDescriptorSetLayoutCreateInfo setLayoutInfo{VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO};
+        setLayoutInfo.bindingCount = 1;
+        setLayoutInfo.pBindings = &binding;
+        CHECK_VKCMD(vkCreateDescriptorSetLayout(m_vkDevice, &setLayoutInfo, nullptr, &setLayout));
 
         VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo{VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO};
-        pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
-        pipelineLayoutCreateInfo.pPushConstantRanges = &pcr;
+        pipelineLayoutCreateInfo.setLayoutCount = 1;
+        pipelineLayoutCreateInfo.pSetLayouts = &setLayout;
         CHECK_VKCMD(vkCreatePipelineLayout(m_vkDevice, &pipelineLayoutCreateInfo, nullptr, &layout));
     }
 
@@ -761,19 +1839,34 @@ struct Pipeline {
 
     void Dynamic(VkDynamicState state) { dynamicStateEnables.emplace_back(state); }
 
-    void Create(VkDevice device, VkExtent2D size, const PipelineLayout& layout, const RenderPass& rp, const ShaderProgram& sp,
-                const VertexBufferBase& vb) {
+    // With previousModels the pipeline also reads the previous frame's model matrix of each instance, for motion vectors.
+    void Create(VkDevice device, VkPipelineCache cache, VkExtent2D size, const PipelineLayout& layout, const RenderPass& rp,
+                const ShaderProgram& sp, const VertexBufferBase& vb, bool previousModels = false) {
         m_vkDevice = device;
 
         VkPipelineDynamicStateCreateInfo dynamicState{VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO};
         dynamicState.dynamicStateCount = (uint32_t)dynamicStateEnables.size();
         dynamicState.pDynamicStates = dynamicStateEnables.data();
 
+        // Per-vertex geometry plus the per-instance model matrix
+        std::vector<VkVertexInputBindingDescription> bindings{vb.bindDesc, InstanceBuffer::BindingDescription()};
+        std::vector<VkVertexInputAttributeDescription> attributes = vb.attrDesc;
+        for (const auto& attr : InstanceBuffer::AttributeDescriptions()) {
+            attributes.push_back(attr);
+        }
+        if (previousModels) {
+            bindings.push_back(InstanceBuffer::BindingDescription(InstanceBuffer::PreviousBinding));
+            for (const auto& attr :
+                 InstanceBuffer::AttributeDescriptions(InstanceBuffer::PreviousBinding, InstanceBuffer::PreviousFirstLocation)) {
+                attributes.push_back(attr);
+            }
+        }
+
         VkPipelineVertexInputStateCreateInfo vi{VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO};
-        vi.vertexBindingDescriptionCount = 1;
-        vi.pVertexBindingDescriptions = &vb.bindDesc;
-        vi.vertexAttributeDescriptionCount = (uint32_t)vb.attrDesc.size();
-        vi.pVertexAttributeDescriptions = vb.attrDesc.data();
+        vi.vertexBindingDescriptionCount = (uint32_t)bindings.size();
+        vi.pVertexBindingDescriptions = bindings.data();
+        vi.vertexAttributeDescriptionCount = (uint32_t)attributes.size();
+        vi.pVertexAttributeDescriptions = attributes.data();
 
         VkPipelineInputAssemblyStateCreateInfo ia{VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO};
         ia.primitiveRestartEnable = VK_FALSE;
@@ -841,7 +1934,7 @@ struct Pipeline {
         ds.maxDepthBounds = 1.0f;
 
         VkPipelineMultisampleStateCreateInfo ms{VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO};
-        ms.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+        ms.rasterizationSamples = rp.samples;
 
         VkGraphicsPipelineCreateInfo pipeInfo{VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO};
         pipeInfo.stageCount = (uint32_t)sp.shaderInfo.size();
@@ -857,10 +1950,20 @@ struct Pipeline {
         if (dynamicState.dynamicStateCount > 0) {
             pipeInfo.pDynamicState = &dynamicState;
         }
+#if defined(VK_KHR_fragment_shading_rate)
+        // Full rate unless the attachment says otherwise
+        VkPipelineFragmentShadingRateStateCreateInfoKHR fsr{VK_STRUCTURE_TYPE_PIPELINE_FRAGMENT_SHADING_RATE_STATE_CREATE_INFO_KHR};
+        fsr.fragmentSize = {1, 1};
+        fsr.combinerOps[0] = VK_FRAGMENT_SHADING_RATE_COMBINER_OP_KEEP_KHR;
+        fsr.combinerOps[1] = VK_FRAGMENT_SHADING_RATE_COMBINER_OP_REPLACE_KHR;
+        if (rp.shadingRateTexelSize.width != 0) {
+            pipeInfo.pNext = &fsr;
+        }
+#endif
         pipeInfo.layout = layout.layout;
         pipeInfo.renderPass = rp.pass;
         pipeInfo.subpass = 0;
-        CHECK_VKCMD(vkCreateGraphicsPipelines(m_vkDevice, VK_NULL_HANDLE, 1, &pipeInfo, nullptr, &pipe));
+        CHECK_VKCMD(vkCreateGraphicsPipelines(m_vkDevice, cache, 1, &pipeInfo, nullptr, &pipe));
     }
 
     void Release() {
@@ -877,8 +1980,273 @@ struct Pipeline {
     VkDevice m_vkDevice{VK_NULL_HANDLE};
 };
 
+#if defined(VK_KHR_fragment_shading_rate)
+// Fragment shading rate attachment holding a fixed foveation pattern, centered on the part of the swapchain image a view is
+// rendered into. Its contents are copied in from a host-visible staging buffer by the first command buffer that renders
+// with it, and never change after that. Every layer of a multiview pass reads the single layer.
+struct ShadingRateImage {
+    VkImage image{VK_NULL_HANDLE};
+    VkImageView view{VK_NULL_HANDLE};
+
+    ShadingRateImage() = default;
+
+    ~ShadingRateImage() {
+        if (m_vkDevice != nullptr) {
+            if (view != VK_NULL_HANDLE) {
+                vkDestroyImageView(m_vkDevice, view, nullptr);
+            }
+            if (image != VK_NULL_HANDLE) {
+                vkDestroyImage(m_vkDevice, image, nullptr);
+            }
+            if (m_staging != VK_NULL_HANDLE) {
+                vkDestroyBuffer(m_vkDevice, m_staging, nullptr);
+            }
+            m_memAllocator->Free(m_imageMemory);
+            m_memAllocator->Free(m_stagingMemory);
+        }
+        image = VK_NULL_HANDLE;
+        view = VK_NULL_HANDLE;
+        m_vkDevice = nullptr;
+    }
+
+    ShadingRateImage(const ShadingRateImage&) = delete;
+    ShadingRateImage& operator=(const ShadingRateImage&) = delete;
+
+    void Create(VkDevice device, MemoryAllocator* memAllocator, VkExtent2D tiles, const std::vector<uint8_t>& rates) {
+        CHECK(rates.size() == (size_t)tiles.width * tiles.height);
+        m_vkDevice = device;
+        m_memAllocator = memAllocator;
+        m_tiles = tiles;
+
+        VkImageCreateInfo imageInfo{VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO};
+        imageInfo.imageType = VK_IMAGE_TYPE_2D;
+        imageInfo.format = VK_FORMAT_R8_UINT;
+        imageInfo.extent = {tiles.width, tiles.height, 1};
+        imageInfo.mipLevels = 1;
+        imageInfo.arrayLayers = 1;
+        imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+        imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        imageInfo.usage = VK_IMAGE_USAGE_FRAGMENT_SHADING_RATE_ATTACHMENT_BIT_KHR | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+        imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        CHECK_VKCMD(vkCreateImage(m_vkDevice, &imageInfo, nullptr, &image));
+        m_imageMemory = m_memAllocator->AllocateImage(image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+        VkImageViewCreateInfo viewInfo{VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO};
+        viewInfo.image = image;
+        viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        viewInfo.format = VK_FORMAT_R8_UINT;
+        viewInfo.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+        CHECK_VKCMD(vkCreateImageView(m_vkDevice, &viewInfo, nullptr, &view));
+
+        VkBufferCreateInfo stagingInfo{VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO};
+        stagingInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+        stagingInfo.size = rates.size();
+        CHECK_VKCMD(vkCreateBuffer(m_vkDevice, &stagingInfo, nullptr, &m_staging));
+        m_stagingMemory = m_memAllocator->AllocateBuffer(m_staging);
+        memcpy(m_stagingMemory.mapped, rates.data(), rates.size());
+    }
+
+    // Record the copy of the shading rates into the image the first time this is called. Must be outside a render pass.
+    void RecordUpload(VkCommandBuffer cmdBuffer) {
+        if (m_uploaded) {
+            return;
+        }
+        m_uploaded = true;
+
+        VkImageMemoryBarrier barrier{VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER};
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = image;
+        barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+        vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0,
+                             nullptr, 1, &barrier);
+
+        VkBufferImageCopy region{};
+        region.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+        region.imageExtent = {m_tiles.width, m_tiles.height, 1};
+        vkCmdCopyBufferToImage(cmdBuffer, m_staging, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_FRAGMENT_SHADING_RATE_ATTACHMENT_READ_BIT_KHR;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.newLayout = VK_IMAGE_LAYOUT_FRAGMENT_SHADING_RATE_ATTACHMENT_OPTIMAL_KHR;
+        vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADING_RATE_ATTACHMENT_BIT_KHR,
+                             0, 0, nullptr, 0, nullptr, 1, &barrier);
+    }
+
+   private:
+    VkDevice m_vkDevice{VK_NULL_HANDLE};
+    MemoryAllocator* m_memAllocator{nullptr};
+    MemoryAllocation m_imageMemory{};
+    VkBuffer m_staging{VK_NULL_HANDLE};
+    MemoryAllocation m_stagingMemory{};
+    VkExtent2D m_tiles{};
+    bool m_uploaded{false};
+};
+#endif
+
+// Render pass and cube pipeline for one color format, extent, layer count, foveation level and sample count, shared by
+// every swapchain that matches.
+struct PipelineState {
+    VkFormat colorFormat{VK_FORMAT_UNDEFINED};
+    VkExtent2D size{};
+    uint32_t arraySize{1};
+    FoveationLevel foveation{FoveationLevel::Off};
+    VkSampleCountFlagBits samples{VK_SAMPLE_COUNT_1_BIT};  // More than one are resolved on tile into the swapchain images
+    bool motionVectors{false};  // Renders the motion vectors of XR_FB_space_warp instead of the cubes' colors
+    RenderPass rp{};            // Discards depth, for the private depth buffer
+    RenderPass rpStoreDepth{};  // Keeps depth, for depth swapchain images that are submitted with the view
+    Pipeline pipe{};
+
+    PipelineState() = default;
+    ~PipelineState() { pipe.Release(); }
+
+    PipelineState(const PipelineState&) = delete;
+    PipelineState& operator=(const PipelineState&) = delete;
+};
+
+// VkPipelineCache that is loaded from and saved to the cache directory, so pipelines compiled by an earlier run or
+// session do not have to be compiled again. The file starts with a header identifying the device and driver that wrote it;
+// a file from any other device or driver version is ignored.
+struct PipelineCache {
+    VkPipelineCache cache{VK_NULL_HANDLE};
+
+    PipelineCache() = default;
+
+    ~PipelineCache() {
+        if (m_vkDevice != nullptr && cache != VK_NULL_HANDLE) {
+            vkDestroyPipelineCache(m_vkDevice, cache, nullptr);
+        }
+        cache = VK_NULL_HANDLE;
+        m_vkDevice = nullptr;
+    }
+
+    void Create(VkPhysicalDevice physicalDevice, VkDevice device, const std::string& cacheDirectory) {
+        m_vkDevice = device;
+        m_cacheDirectory = cacheDirectory;
+
+        VkPhysicalDeviceProperties properties{};
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+        m_header.magic = FileMagic;
+        m_header.vendorID = properties.vendorID;
+        m_header.deviceID = properties.deviceID;
+        m_header.driverVersion = properties.driverVersion;
+        memcpy(m_header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE);
+
+        std::vector<uint8_t> file;
+        const uint8_t* initialData = nullptr;
+        size_t initialDataSize = 0;
+        if (ReadCacheFile(m_cacheDirectory, FileName, file)) {
+            FileHeader header{};
+            if (file.size() >= sizeof(header)) {
+                memcpy(&header, file.data(), sizeof(header));
+            }
+            if (file.size() >= sizeof(header) && header.magic == m_header.magic && header.vendorID == m_header.vendorID &&
+                header.deviceID == m_header.deviceID && header.driverVersion == m_header.driverVersion &&
+                memcmp(header.pipelineCacheUUID, m_header.pipelineCacheUUID, VK_UUID_SIZE) == 0 &&
+                header.dataSize == file.size() - sizeof(header)) {
+                initialData = file.data() + sizeof(header);
+                initialDataSize = header.dataSize;
+            } else {
+                Log::Write(Log::Level::Info, "Ignoring Vulkan pipeline cache written by another device or driver");
+            }
+        }
+
+        VkPipelineCacheCreateInfo cacheInfo{VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO};
+        cacheInfo.initialDataSize = initialDataSize;
+        cacheInfo.pInitialData = initialData;
+        CHECK_VKCMD(vkCreatePipelineCache(m_vkDevice, &cacheInfo, nullptr, &cache));
+        m_savedSize = initialDataSize;
+        m_loaded = initialDataSize > 0;
+        LOG_VERBOSE(Fmt("Vulkan pipeline cache %s (%zu bytes)", m_loaded ? "loaded" : "empty", initialDataSize));
+    }
+
+    // Whether the cache started out with data from an earlier run.
+    bool Loaded() const { return m_loaded; }
+
+    // Write the cache to disk if pipelines were added to it since it was loaded or last saved. Pipelines are built by
+    // concurrent startup jobs, which each save.
+    void Save() {
+        if (cache == VK_NULL_HANDLE || m_cacheDirectory.empty()) {
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(m_saveLock);
+        size_t dataSize = 0;
+        CHECK_VKCMD(vkGetPipelineCacheData(m_vkDevice, cache, &dataSize, nullptr));
+        if (dataSize == m_savedSize) {
+            return;
+        }
+
+        std::vector<uint8_t> file(sizeof(FileHeader) + dataSize);
+        CHECK_VKCMD(vkGetPipelineCacheData(m_vkDevice, cache, &dataSize, file.data() + sizeof(FileHeader)));
+        file.resize(sizeof(FileHeader) + dataSize);
+        FileHeader header = m_header;
+        header.dataSize = (uint32_t)dataSize;
+        memcpy(file.data(), &header, sizeof(header));
+        WriteCacheFile(m_cacheDirectory, FileName, file);
+        m_savedSize = dataSize;
+    }
+
+    PipelineCache(const PipelineCache&) = delete;
+    PipelineCache& operator=(const PipelineCache&) = delete;
+
+   private:
+    struct FileHeader {
+        uint32_t magic;
+        uint32_t dataSize;  // Bytes of vkGetPipelineCacheData output following the header
+        uint32_t vendorID;
+        uint32_t deviceID;
+        uint32_t driverVersion;
+        uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+    };
+    static constexpr uint32_t FileMagic = 0x43505848;  // "HXPC"
+    static constexpr const char* FileName = "vulkan_pipeline_cache.bin";
+
+    VkDevice m_vkDevice{VK_NULL_HANDLE};
+    std::string m_cacheDirectory;
+    FileHeader m_header{};
+    std::mutex m_saveLock;
+    size_t m_savedSize{0};  // Guarded by m_saveLock
+    bool m_loaded{false};
+};
+
+// Create an image of a swapchain's size and layers for an attachment that never leaves the render pass, so tile-based GPUs
+// can keep it in tile memory and never back it with real memory if the device offers lazily allocated memory.
+VkImage CreateTransientAttachment(VkDevice device, MemoryAllocator* memAllocator, VkFormat format, VkImageUsageFlags usage,
+                                  VkSampleCountFlagBits samples, const XrSwapchainCreateInfo& swapchainCreateInfo,
+                                  const char* name, MemoryAllocation* memory) {
+    VkImageCreateInfo imageInfo{VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO};
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.extent.width = swapchainCreateInfo.width;
+    imageInfo.extent.height = swapchainCreateInfo.height;
+    imageInfo.extent.depth = 1;
+    imageInfo.mipLevels = 1;
+    imageInfo.arrayLayers = swapchainCreateInfo.arraySize;
+    imageInfo.format = format;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    imageInfo.usage = usage | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+    imageInfo.samples = samples;
+    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    VkImage image{VK_NULL_HANDLE};
+    CHECK_VKCMD(vkCreateImage(device, &imageInfo, nullptr, &image));
+
+    constexpr VkFlags lazyFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT;
+    const bool lazy = memAllocator->SupportsImage(image, lazyFlags);
+    *memory = memAllocator->AllocateImage(image, lazy ? lazyFlags : VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    LOG_VERBOSE(Fmt("Created %ux%u transient %s with %u samples in %s memory", swapchainCreateInfo.width,
+                    swapchainCreateInfo.height, name, (uint32_t)samples, lazy ? "lazily allocated" : "device local"));
+    return image;
+}
+
 struct DepthBuffer {
-    VkDeviceMemory depthMemory{VK_NULL_HANDLE};
+    MemoryAllocation depthMemory{};
     VkImage depthImage{VK_NULL_HANDLE};
 
     DepthBuffer() = default;
@@ -888,12 +2256,9 @@ struct DepthBuffer {
             if (depthImage != VK_NULL_HANDLE) {
                 vkDestroyImage(m_vkDevice, depthImage, nullptr);
             }
-            if (depthMemory != VK_NULL_HANDLE) {
-                vkFreeMemory(m_vkDevice, depthMemory, nullptr);
-            }
+            m_memAllocator->Free(depthMemory);
         }
         depthImage = VK_NULL_HANDLE;
-        depthMemory = VK_NULL_HANDLE;
         m_vkDevice = nullptr;
     }
 
@@ -903,6 +2268,8 @@ struct DepthBuffer {
         swap(depthImage, other.depthImage);
         swap(depthMemory, other.depthMemory);
         swap(m_vkDevice, other.m_vkDevice);
+        swap(m_memAllocator, other.m_memAllocator);
+        swap(m_arraySize, other.m_arraySize);
     }
     DepthBuffer& operator=(DepthBuffer&& other) noexcept {
         if (&other == this) {
@@ -915,35 +2282,19 @@ struct DepthBuffer {
         swap(depthImage, other.depthImage);
         swap(depthMemory, other.depthMemory);
         swap(m_vkDevice, other.m_vkDevice);
+        swap(m_memAllocator, other.m_memAllocator);
+        swap(m_arraySize, other.m_arraySize);
         return *this;
     }
 
-    void Create(VkDevice device, MemoryAllocator* memAllocator, VkFormat depthFormat,
+    // Depth never leaves the render pass, see CreateTransientAttachment.
+    void Create(VkDevice device, MemoryAllocator* memAllocator, VkFormat depthFormat, VkSampleCountFlagBits samples,
                 const XrSwapchainCreateInfo& swapchainCreateInfo) {
         m_vkDevice = device;
-
-        VkExtent2D size = {swapchainCreateInfo.width, swapchainCreateInfo.height};
-
-        // Create a D32 depthbuffer
-        VkImageCreateInfo imageInfo{VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO};
-        imageInfo.imageType = VK_IMAGE_TYPE_2D;
-        imageInfo.extent.width = size.width;
-        imageInfo.extent.height = size.height;
-        imageInfo.extent.depth = 1;
-        imageInfo.mipLevels = 1;
-        imageInfo.arrayLayers = 1;
-        imageInfo.format = depthFormat;
-        imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
-        imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-        imageInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
-        imageInfo.samples = (VkSampleCountFlagBits)swapchainCreateInfo.sampleCount;
-        imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-        CHECK_VKCMD(vkCreateImage(device, &imageInfo, nullptr, &depthImage));
-
-        VkMemoryRequirements memRequirements{};
-        vkGetImageMemoryRequirements(device, depthImage, &memRequirements);
-        memAllocator->Allocate(memRequirements, &depthMemory, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-        CHECK_VKCMD(vkBindImageMemory(device, depthImage, depthMemory, 0));
+        m_memAllocator = memAllocator;
+        m_arraySize = swapchainCreateInfo.arraySize;
+        depthImage = CreateTransientAttachment(device, memAllocator, depthFormat, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
+                                               samples, swapchainCreateInfo, "depth buffer", &depthMemory);
     }
 
     void TransitionLayout(CmdBuffer* cmdBuffer, VkImageLayout newLayout) {
@@ -957,7 +2308,7 @@ struct DepthBuffer {
         depthBarrier.oldLayout = m_vkLayout;
         depthBarrier.newLayout = newLayout;
         depthBarrier.image = depthImage;
-        depthBarrier.subresourceRange = {VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 0, 1};
+        depthBarrier.subresourceRange = {VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 0, m_arraySize};
         vkCmdPipelineBarrier(cmdBuffer->buf, VK_PIPELINE_STAGE_ALL_GRAPHICS_BIT, VK_PIPELINE_STAGE_ALL_GRAPHICS_BIT, 0, 0, nullptr,
                              0, nullptr, 1, &depthBarrier);
 
@@ -969,39 +2320,138 @@ struct DepthBuffer {
 
    private:
     VkDevice m_vkDevice{VK_NULL_HANDLE};
+    MemoryAllocator* m_memAllocator{nullptr};
     VkImageLayout m_vkLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    uint32_t m_arraySize{1};
+};
+
+// Multisampled color attachment of a swapchain whose samples are resolved on tile into its images. Like the private depth
+// buffer it is shared by every image and never leaves the render pass.
+struct MultisampledColorBuffer {
+    MemoryAllocation colorMemory{};
+    VkImage colorImage{VK_NULL_HANDLE};
+
+    MultisampledColorBuffer() = default;
+
+    ~MultisampledColorBuffer() {
+        if (m_vkDevice != nullptr) {
+            if (colorImage != VK_NULL_HANDLE) {
+                vkDestroyImage(m_vkDevice, colorImage, nullptr);
+            }
+            m_memAllocator->Free(colorMemory);
+        }
+        colorImage = VK_NULL_HANDLE;
+        m_vkDevice = nullptr;
+    }
+
+    void Create(VkDevice device, MemoryAllocator* memAllocator, VkFormat colorFormat, VkSampleCountFlagBits samples,
+                const XrSwapchainCreateInfo& swapchainCreateInfo) {
+        m_vkDevice = device;
+        m_memAllocator = memAllocator;
+        colorImage = CreateTransientAttachment(device, memAllocator, colorFormat, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, samples,
+                                               swapchainCreateInfo, "multisampled color buffer", &colorMemory);
+    }
+
+    MultisampledColorBuffer(const MultisampledColorBuffer&) = delete;
+    MultisampledColorBuffer& operator=(const MultisampledColorBuffer&) = delete;
+
+   private:
+    VkDevice m_vkDevice{VK_NULL_HANDLE};
+    MemoryAllocator* m_memAllocator{nullptr};
 };
 
 struct SwapchainImageContext {
     SwapchainImageContext(XrStructureType _swapchainImageType) : swapchainImageType(_swapchainImageType) {}
 
-    // A packed array of XrSwapchainImageVulkan2KHR's for xrEnumerateSwapchainImages
-    std::vector<XrSwapchainImageVulkan2KHR> swapchainImages;
-    std::vector<RenderTarget> renderTarget;
-    VkExtent2D size{};
-    DepthBuffer depthBuffer{};
-    RenderPass rp{};
-    Pipeline pipe{};
-    XrStructureType swapchainImageType;
+    // A packed array of XrSwapchainImageVulkan2KHR's for xrEnumerateSwapchainImages
+    std::vector<XrSwapchainImageVulkan2KHR> swapchainImages;
+    // Framebuffers for each pair of color image and depth image, indexed by colorImage * depthImageCount + depthImage, for
+    // each fragment shading rate attachment they are rendered with (VK_NULL_HANDLE without foveation)
+    std::map<VkImageView, std::vector<RenderTarget>> renderTargets;
+    VkExtent2D size{};
+    uint32_t arraySize{1};
+    bool transferSource{false};  // Created with XR_SWAPCHAIN_USAGE_TRANSFER_SRC_BIT
+    DepthBuffer depthBuffer{};  // Only created once an image is rendered without a depth swapchain image
+    MultisampledColorBuffer colorBuffer{};  // Only created for multisampled pipeline states
+    const PipelineState* pipelineState{nullptr};  // Owned by the graphics plugin, null for depth swapchains
+    XrStructureType swapchainImageType;
+
+    SwapchainImageContext() = default;
+
+    std::vector<XrSwapchainImageBaseHeader*> Create(VkDevice device, MemoryAllocator* memAllocator, uint32_t capacity,
+                                                    const XrSwapchainCreateInfo& swapchainCreateInfo,
+                                                    const PipelineState& sharedPipelineState) {
+        m_memAllocator = memAllocator;
+        pipelineState = &sharedPipelineState;
+        return CreateImages(device, capacity, swapchainCreateInfo);
+    }
+
+    // A depth swapchain only holds images, which color swapchains bind as their depth attachment.
+    std::vector<XrSwapchainImageBaseHeader*> CreateDepth(VkDevice device, uint32_t capacity,
+                                                         const XrSwapchainCreateInfo& swapchainCreateInfo) {
+        return CreateImages(device, capacity, swapchainCreateInfo);
+    }
+
+    // Transition the private depth buffer, if rendering without a depth swapchain image.
+    void PrepareDepth(CmdBuffer* cmdBuffer, const SwapchainImageContext* depthContext) {
+        if (depthContext != nullptr) {
+            return;  // The runtime hands out depth swapchain images in the attachment layout
+        }
+        if (depthBuffer.depthImage == VK_NULL_HANDLE) {
+            depthBuffer.Create(m_vkDevice, m_memAllocator, pipelineState->rp.depthFmt, pipelineState->rp.samples,
+                               m_swapchainCreateInfo);
+        }
+        depthBuffer.TransitionLayout(cmdBuffer, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
+    }
+
+    // shadingRateView is the fragment shading rate attachment of a foveated pipeline state.
+    void BindRenderTarget(uint32_t index, const SwapchainImageContext* depthContext, uint32_t depthIndex,
+                          VkImageView shadingRateView, VkRenderPassBeginInfo* renderPassBeginInfo) {
+        const size_t depthImageCount = depthContext != nullptr ? depthContext->swapchainImages.size() : 1;
+        std::vector<RenderTarget>& renderTarget = renderTargets[shadingRateView];
+        if (renderTarget.size() != swapchainImages.size() * depthImageCount) {
+            // A swapchain is always rendered either with or without depth swapchain images, so this only happens once
+            renderTarget.clear();
+            renderTarget.resize(swapchainImages.size() * depthImageCount);
+        }
 
-    SwapchainImageContext() = default;
+        RenderTarget& target = renderTarget[index * depthImageCount + (depthContext != nullptr ? depthIndex : 0)];
+        if (target.fb == VK_NULL_HANDLE) {
+            const VkImage depthImage =
+                depthContext != nullptr ? depthContext->swapchainImages[depthIndex].image : depthBuffer.depthImage;
+            if (pipelineState->rp.samples == VK_SAMPLE_COUNT_1_BIT) {
+                target.Create(m_vkDevice, swapchainImages[index].image, depthImage, size, pipelineState->rp, arraySize,
+                              shadingRateView);
+            } else {
+                // Rendered into the multisampled color buffer and resolved into the swapchain image. Depth swapchain images
+                // would need their samples resolved as well, see VulkanGraphicsPlugin::EnableOnTileMultisampling.
+                CHECK(depthContext == nullptr);
+                if (colorBuffer.colorImage == VK_NULL_HANDLE) {
+                    colorBuffer.Create(m_vkDevice, m_memAllocator, pipelineState->rp.colorFmt, pipelineState->rp.samples,
+                                       m_swapchainCreateInfo);
+                }
+                target.Create(m_vkDevice, colorBuffer.colorImage, depthImage, size, pipelineState->rp, arraySize,
+                              shadingRateView, swapchainImages[index].image);
+            }
+        }
+        renderPassBeginInfo->renderPass = depthContext != nullptr ? pipelineState->rpStoreDepth.pass : pipelineState->rp.pass;
+        renderPassBeginInfo->framebuffer = target.fb;
+        renderPassBeginInfo->renderArea.offset = {0, 0};
+        renderPassBeginInfo->renderArea.extent = size;
+    }
 
-    std::vector<XrSwapchainImageBaseHeader*> Create(VkDevice device, MemoryAllocator* memAllocator, uint32_t capacity,
-                                                    const XrSwapchainCreateInfo& swapchainCreateInfo, const PipelineLayout& layout,
-                                                    const ShaderProgram& sp, const VertexBuffer<Geometry::Vertex>& vb) {
+   private:
+    std::vector<XrSwapchainImageBaseHeader*> CreateImages(VkDevice device, uint32_t capacity,
+                                                          const XrSwapchainCreateInfo& swapchainCreateInfo) {
         m_vkDevice = device;
+        m_swapchainCreateInfo = swapchainCreateInfo;
 
         size = {swapchainCreateInfo.width, swapchainCreateInfo.height};
-        VkFormat colorFormat = (VkFormat)swapchainCreateInfo.format;
-        VkFormat depthFormat = VK_FORMAT_D32_SFLOAT;
+        arraySize = swapchainCreateInfo.arraySize;
+        transferSource = (swapchainCreateInfo.usageFlags & XR_SWAPCHAIN_USAGE_TRANSFER_SRC_BIT) != 0;
         // XXX handle swapchainCreateInfo.sampleCount
 
-        depthBuffer.Create(m_vkDevice, memAllocator, depthFormat, swapchainCreateInfo);
-        rp.Create(m_vkDevice, colorFormat, depthFormat);
-        pipe.Create(m_vkDevice, size, layout, rp, sp, vb);
-
         swapchainImages.resize(capacity);
-        renderTarget.resize(capacity);
         std::vector<XrSwapchainImageBaseHeader*> bases(capacity);
         for (uint32_t i = 0; i < capacity; ++i) {
             swapchainImages[i] = {swapchainImageType};
@@ -1011,58 +2461,48 @@ struct SwapchainImageContext {
         return bases;
     }
 
-    uint32_t ImageIndex(const XrSwapchainImageBaseHeader* swapchainImageHeader) {
-        auto p = reinterpret_cast<const XrSwapchainImageVulkan2KHR*>(swapchainImageHeader);
-        return (uint32_t)(p - &swapchainImages[0]);
-    }
-
-    void BindRenderTarget(uint32_t index, VkRenderPassBeginInfo* renderPassBeginInfo) {
-        if (renderTarget[index].fb == VK_NULL_HANDLE) {
-            renderTarget[index].Create(m_vkDevice, swapchainImages[index].image, depthBuffer.depthImage, size, rp);
-        }
-        renderPassBeginInfo->renderPass = rp.pass;
-        renderPassBeginInfo->framebuffer = renderTarget[index].fb;
-        renderPassBeginInfo->renderArea.offset = {0, 0};
-        renderPassBeginInfo->renderArea.extent = size;
-    }
-
-   private:
     VkDevice m_vkDevice{VK_NULL_HANDLE};
+    MemoryAllocator* m_memAllocator{nullptr};
+    XrSwapchainCreateInfo m_swapchainCreateInfo{XR_TYPE_SWAPCHAIN_CREATE_INFO};
 };
 
 #if defined(USE_MIRROR_WINDOW)
-// Swapchain
+// Mirror window on the desktop, showing a downscaled copy of a view. The copies are submitted on their own, after the
+// frame's work, and never block the host: an image is only acquired if the presentation engine has one free right away,
+// and a mirror frame is skipped if there is none or the copy into the image last used by the slot is still running.
 struct Swapchain {
     VkFormat format{VK_FORMAT_B8G8R8A8_SRGB};
     VkSurfaceKHR surface{VK_NULL_HANDLE};
     VkSwapchainKHR swapchain{VK_NULL_HANDLE};
-    VkFence readyFence{VK_NULL_HANDLE};
-    VkFence presentFence{VK_NULL_HANDLE};
-    static const uint32_t maxImages = 4;
+    static const uint32_t maxImages = 8;
     uint32_t swapchainCount = 0;
     uint32_t renderImageIdx = 0;
-    VkImage image[maxImages]{VK_NULL_HANDLE, VK_NULL_HANDLE, VK_NULL_HANDLE, VK_NULL_HANDLE};
+    VkImage image[maxImages]{};
 
     Swapchain() {}
     ~Swapchain() { Release(); }
 
-    void Create(VkInstance instance, VkPhysicalDevice physDevice, VkDevice device, uint32_t queueFamilyIndex);
-    void Prepare(VkCommandBuffer buf);
-    void Wait();
-    void Acquire(VkSemaphore readySemaphore = VK_NULL_HANDLE);
-    void Present(VkQueue queue, VkSemaphore drawComplete = VK_NULL_HANDLE);
+    // useTimeline tracks the copies with a timeline semaphore rather than a fence per copy.
+    void Create(VkInstance instance, VkPhysicalDevice physDevice, VkDevice device, uint32_t queueFamilyIndex, VkQueue queue,
+                bool useTimeline);
+    // Copy rect of layer of source, which is in VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL and goes back to it, into the
+    // window and present it. Returns false if the mirror frame was skipped.
+    bool Blit(VkImage source, const XrRect2Di& rect, uint32_t layer);
     void Release() {
         if (m_vkDevice) {
-            // Flush any pending Present() calls which are using the fence
-            Wait();
+            // Flush pending copies and presents, which still use the semaphores
+            if (m_queue) vkQueueWaitIdle(m_queue);
+            m_cmdBuffers.clear();
+            for (VkSemaphore semaphore : m_acquireSemaphores) vkDestroySemaphore(m_vkDevice, semaphore, nullptr);
+            for (VkSemaphore semaphore : m_presentSemaphores) vkDestroySemaphore(m_vkDevice, semaphore, nullptr);
             if (swapchain) vkDestroySwapchainKHR(m_vkDevice, swapchain, nullptr);
-            if (readyFence) vkDestroyFence(m_vkDevice, readyFence, nullptr);
         }
 
         if (m_vkInstance && surface) vkDestroySurfaceKHR(m_vkInstance, surface, nullptr);
 
-        readyFence = VK_NULL_HANDLE;
-        presentFence = VK_NULL_HANDLE;
+        m_acquireSemaphores.clear();
+        m_presentSemaphores.clear();
+        m_slot = 0;
         swapchain = VK_NULL_HANDLE;
         surface = VK_NULL_HANDLE;
         for (uint32_t i = 0; i < swapchainCount; ++i) {
@@ -1081,11 +2521,15 @@ struct Swapchain {
         m_vkDevice = nullptr;
     }
     void Recreate() {
+        const VkDevice device = m_vkDevice;
         Release();
-        Create(m_vkInstance, m_vkPhysicalDevice, m_vkDevice, m_queueFamilyIndex);
+        Create(m_vkInstance, m_vkPhysicalDevice, device, m_queueFamilyIndex, m_queue, m_useTimeline);
     }
 
    private:
+    void RecordBlit(VkCommandBuffer buf, VkImage source, const XrRect2Di& rect, uint32_t layer);
+    void Present();
+
 #if defined(VK_USE_PLATFORM_WIN32_KHR)
     HINSTANCE hInst{NULL};
     HWND hWnd{NULL};
@@ -1095,13 +2539,28 @@ struct Swapchain {
     VkPhysicalDevice m_vkPhysicalDevice{VK_NULL_HANDLE};
     VkDevice m_vkDevice{VK_NULL_HANDLE};
     uint32_t m_queueFamilyIndex = 0;
+    VkQueue m_queue{VK_NULL_HANDLE};
+    bool m_useTimeline{false};
+    QueueTimeline m_timeline{};  // Kept across Recreate, declared before m_cmdBuffers to outlive them
+    // One copy slot per swapchain image, used in turn. A slot's acquire semaphore has been waited on once its command
+    // buffer finished, while present semaphores belong to an image, which is only acquired again after its present.
+    std::vector<std::unique_ptr<CmdBuffer>> m_cmdBuffers;
+    std::vector<VkSemaphore> m_acquireSemaphores;
+    std::vector<VkSemaphore> m_presentSemaphores;  // Indexed by image
+    size_t m_slot{0};
 };
 
-void Swapchain::Create(VkInstance instance, VkPhysicalDevice physDevice, VkDevice device, uint32_t queueFamilyIndex) {
+void Swapchain::Create(VkInstance instance, VkPhysicalDevice physDevice, VkDevice device, uint32_t queueFamilyIndex, VkQueue queue,
+                       bool useTimeline) {
     m_vkInstance = instance;
     m_vkPhysicalDevice = physDevice;
     m_vkDevice = device;
     m_queueFamilyIndex = queueFamilyIndex;
+    m_queue = queue;
+    m_useTimeline = useTimeline;
+    if (m_useTimeline && m_timeline.semaphore == VK_NULL_HANDLE) {
+        m_timeline.Init(m_vkDevice);
+    }
 
 // Create a WSI surface for the window:
 #if defined(VK_USE_PLATFORM_WIN32_KHR)
@@ -1157,11 +2616,12 @@ void Swapchain::Create(VkInstance instance, VkPhysicalDevice physDevice, VkDevic
     std::vector<VkPresentModeKHR> presentModes(presentModeCount);
     CHECK_VKCMD(vkGetPhysicalDeviceSurfacePresentModesKHR(m_vkPhysicalDevice, surface, &presentModeCount, &presentModes[0]));
 
-    // Do not use VSYNC for the mirror window, but Nvidia doesn't support IMMEDIATE so fall back to MAILBOX
-    VkPresentModeKHR presentMode = VK_PRESENT_MODE_IMMEDIATE_KHR;
-    for (uint32_t i = 0; i < presentModeCount; ++i) {
-        if ((presentModes[i] == VK_PRESENT_MODE_IMMEDIATE_KHR) || (presentModes[i] == VK_PRESENT_MODE_MAILBOX_KHR)) {
-            presentMode = presentModes[i];
+    // Do not use VSYNC for the mirror window, so presents never wait for the desktop. MAILBOX does not tear, but Nvidia
+    // doesn't support it everywhere so fall back to IMMEDIATE, and to FIFO, which is always there, as a last resort.
+    VkPresentModeKHR presentMode = VK_PRESENT_MODE_FIFO_KHR;
+    for (VkPresentModeKHR mode : {VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_IMMEDIATE_KHR}) {
+        if (std::find(presentModes.begin(), presentModes.end(), mode) != presentModes.end()) {
+            presentMode = mode;
             break;
         }
     }
@@ -1173,7 +2633,11 @@ void Swapchain::Create(VkInstance instance, VkPhysicalDevice physDevice, VkDevic
     VkSwapchainCreateInfoKHR swapchainInfo{VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR};
     swapchainInfo.flags = 0;
     swapchainInfo.surface = surface;
-    swapchainInfo.minImageCount = surfCaps.minImageCount;
+    // One image more than the minimum, so one is usually free for the acquire, which does not wait
+    swapchainInfo.minImageCount = surfCaps.minImageCount + 1;
+    if (surfCaps.maxImageCount != 0) {
+        swapchainInfo.minImageCount = std::min(swapchainInfo.minImageCount, surfCaps.maxImageCount);
+    }
     swapchainInfo.imageFormat = format;
     swapchainInfo.imageColorSpace = surfFmts[foundFmt].colorSpace;
     swapchainInfo.imageExtent = size;
@@ -1189,68 +2653,131 @@ void Swapchain::Create(VkInstance instance, VkPhysicalDevice physDevice, VkDevic
     swapchainInfo.oldSwapchain = VK_NULL_HANDLE;
     CHECK_VKCMD(vkCreateSwapchainKHR(m_vkDevice, &swapchainInfo, nullptr, &swapchain));
 
-    // Fence to throttle host on Acquire
-    VkFenceCreateInfo fenceInfo{VK_STRUCTURE_TYPE_FENCE_CREATE_INFO};
-    CHECK_VKCMD(vkCreateFence(m_vkDevice, &fenceInfo, nullptr, &readyFence));
-
     swapchainCount = 0;
     CHECK_VKCMD(vkGetSwapchainImagesKHR(m_vkDevice, swapchain, &swapchainCount, nullptr));
-    assert(swapchainCount < maxImages);
+    // Any image can be acquired, so all of them have to be known
+    CHECK_MSG(swapchainCount <= maxImages, Fmt("Swapchain length %u is more than %u", swapchainCount, maxImages));
     CHECK_VKCMD(vkGetSwapchainImagesKHR(m_vkDevice, swapchain, &swapchainCount, image));
-    if (swapchainCount > maxImages) {
-        Log::Write(Log::Level::Info,
-                   "Reducing swapchain length from " + std::to_string(swapchainCount) + " to " + std::to_string(maxImages));
-        swapchainCount = maxImages;
+
+    VkSemaphoreCreateInfo semInfo{VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO};
+    for (uint32_t i = 0; i < swapchainCount; ++i) {
+        m_cmdBuffers.emplace_back(std::make_unique<CmdBuffer>());
+        if (!m_cmdBuffers.back()->Init(m_vkDevice, m_queueFamilyIndex, m_useTimeline ? &m_timeline : nullptr)) {
+            THROW("Failed to create mirror command buffer");
+        }
+        m_acquireSemaphores.push_back(VK_NULL_HANDLE);
+        CHECK_VKCMD(vkCreateSemaphore(m_vkDevice, &semInfo, nullptr, &m_acquireSemaphores.back()));
+        m_presentSemaphores.push_back(VK_NULL_HANDLE);
+        CHECK_VKCMD(vkCreateSemaphore(m_vkDevice, &semInfo, nullptr, &m_presentSemaphores.back()));
     }
 
-    Log::Write(Log::Level::Info, "Swapchain length " + std::to_string(swapchainCount));
+    Log::Write(Log::Level::Info, Fmt("Swapchain length %u, present mode %d", swapchainCount, (int)presentMode));
 }
 
-void Swapchain::Prepare(VkCommandBuffer buf) {
-    // Convert swapchain images to VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL
-    for (uint32_t i = 0; i < swapchainCount; ++i) {
-        VkImageMemoryBarrier imgBarrier{VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER};
-        imgBarrier.srcAccessMask = 0;  // XXX was VK_ACCESS_TRANSFER_READ_BIT wrong?
-        imgBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-        imgBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-        imgBarrier.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
-        imgBarrier.image = image[i];
-        imgBarrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
-        vkCmdPipelineBarrier(buf, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1,
-                             &imgBarrier);
+bool Swapchain::Blit(VkImage source, const XrRect2Di& rect, uint32_t layer) {
+    CmdBuffer& cmdBuffer = *m_cmdBuffers[m_slot];
+    cmdBuffer.Poll();
+    if (cmdBuffer.state == CmdBuffer::CmdBufferState::Executing) {
+        return false;
     }
-}
 
-void Swapchain::Wait() {
-    if (presentFence) {
-        // Wait for the fence...
-        CHECK_VKCMD(vkWaitForFences(m_vkDevice, 1, &presentFence, VK_TRUE, UINT64_MAX));
-        // ...then reset the fence for future Acquire calls
-        CHECK_VKCMD(vkResetFences(m_vkDevice, 1, &presentFence));
-        presentFence = VK_NULL_HANDLE;
+    // The GPU waits for the acquired image to be ready through the semaphore, the host only takes one if it is free now
+    const VkSemaphore acquired = m_acquireSemaphores[m_slot];
+    const VkResult res = vkAcquireNextImageKHR(m_vkDevice, swapchain, 0, acquired, VK_NULL_HANDLE, &renderImageIdx);
+    if (res == VK_NOT_READY || res == VK_TIMEOUT) {
+        return false;
+    }
+    if (res == VK_ERROR_OUT_OF_DATE_KHR) {
+        Recreate();
+        return false;
     }
+    CHECK_VKRESULT(res, "vkAcquireNextImageKHR");  // VK_SUBOPTIMAL_KHR still presents
+
+    CHECK(cmdBuffer.Reset());
+    CHECK(cmdBuffer.Begin());
+    RecordBlit(cmdBuffer.buf, source, rect, layer);
+    CHECK(cmdBuffer.End());
+    CHECK(cmdBuffer.Exec(m_queue, acquired, VK_PIPELINE_STAGE_TRANSFER_BIT, m_presentSemaphores[renderImageIdx]));
+    m_slot = (m_slot + 1) % m_cmdBuffers.size();
+
+    Present();
+    return true;
 }
 
-void Swapchain::Acquire(VkSemaphore readySemaphore) {
-    // If we're not using a semaphore to rate-limit the GPU, rate limit the host with a fence instead
-    if (readySemaphore == VK_NULL_HANDLE) {
-        Wait();
-        presentFence = readyFence;
+void Swapchain::RecordBlit(VkCommandBuffer buf, VkImage source, const XrRect2Di& rect, uint32_t layer) {
+    // Fit the view into the window keeping its aspect ratio, the rest of the window is cleared
+    const float scale = std::min((float)size.width / rect.extent.width, (float)size.height / rect.extent.height);
+    const int32_t width = std::max(1, (int32_t)(rect.extent.width * scale));
+    const int32_t height = std::max(1, (int32_t)(rect.extent.height * scale));
+    const int32_t x = ((int32_t)size.width - width) / 2;
+    const int32_t y = ((int32_t)size.height - height) / 2;
+
+    const VkImageSubresourceRange sourceRange{VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, layer, 1};
+    const VkImageSubresourceRange mirrorRange{VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+    VkImageMemoryBarrier toTransfer[2]{{VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER}, {VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER}};
+    toTransfer[0].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    toTransfer[0].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    toTransfer[0].oldLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    toTransfer[0].newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    toTransfer[0].image = source;
+    toTransfer[0].subresourceRange = sourceRange;
+    // Everything in the image is overwritten, so its old contents can go
+    toTransfer[1].srcAccessMask = 0;
+    toTransfer[1].dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    toTransfer[1].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    toTransfer[1].newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    toTransfer[1].image = image[renderImageIdx];
+    toTransfer[1].subresourceRange = mirrorRange;
+    for (VkImageMemoryBarrier& barrier : toTransfer) {
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
     }
-
-    CHECK_VKCMD(vkAcquireNextImageKHR(m_vkDevice, swapchain, UINT64_MAX, readySemaphore, presentFence, &renderImageIdx));
+    // The transfer stage is where the acquire semaphore is waited on
+    vkCmdPipelineBarrier(buf, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 2, toTransfer);
+
+    const VkClearColorValue black{};
+    vkCmdClearColorImage(buf, image[renderImageIdx], VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &black, 1, &mirrorRange);
+    VkMemoryBarrier clearDone{VK_STRUCTURE_TYPE_MEMORY_BARRIER};
+    clearDone.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    clearDone.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    vkCmdPipelineBarrier(buf, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &clearDone, 0, nullptr, 0,
+                         nullptr);
+
+    VkImageBlit region{};
+    region.srcSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, layer, 1};
+    region.srcOffsets[0] = {rect.offset.x, rect.offset.y, 0};
+    region.srcOffsets[1] = {rect.offset.x + rect.extent.width, rect.offset.y + rect.extent.height, 1};
+    region.dstSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+    region.dstOffsets[0] = {x, y, 0};
+    region.dstOffsets[1] = {x + width, y + height, 1};
+    vkCmdBlitImage(buf, source, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, image[renderImageIdx], VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                   1, &region, VK_FILTER_LINEAR);
+
+    // The runtime expects the view back in the layout it was rendered in
+    VkImageMemoryBarrier fromTransfer[2]{toTransfer[0], toTransfer[1]};
+    fromTransfer[0].srcAccessMask = 0;
+    fromTransfer[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    fromTransfer[0].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    fromTransfer[0].newLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    fromTransfer[1].srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    fromTransfer[1].dstAccessMask = 0;
+    fromTransfer[1].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    fromTransfer[1].newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    vkCmdPipelineBarrier(buf, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0,
+                         nullptr, 2, fromTransfer);
 }
 
-void Swapchain::Present(VkQueue queue, VkSemaphore drawComplete) {
+void Swapchain::Present() {
+    TRACE_SCOPE("Swapchain::Present");
     VkPresentInfoKHR presentInfo{VK_STRUCTURE_TYPE_PRESENT_INFO_KHR};
-    if (drawComplete) {
-        presentInfo.waitSemaphoreCount = 1;
-        presentInfo.pWaitSemaphores = &drawComplete;
-    }
+    presentInfo.waitSemaphoreCount = 1;
+    presentInfo.pWaitSemaphores = &m_presentSemaphores[renderImageIdx];
     presentInfo.swapchainCount = 1;
     presentInfo.pSwapchains = &swapchain;
     presentInfo.pImageIndices = &renderImageIdx;
-    auto res = vkQueuePresentKHR(queue, &presentInfo);
+    auto res = vkQueuePresentKHR(m_queue, &presentInfo);
     if (res == VK_ERROR_OUT_OF_DATE_KHR) {
         Recreate();
         return;
@@ -1259,11 +2786,24 @@ void Swapchain::Present(VkQueue queue, VkSemaphore drawComplete) {
 }
 #endif  // defined(USE_MIRROR_WINDOW)
 
+// The per-frame calls are final, so builds with only this plugin can devirtualize them despite the legacy subclass.
 struct VulkanGraphicsPlugin : public IGraphicsPlugin {
-    VulkanGraphicsPlugin(const std::shared_ptr<Options>& /*unused*/, std::shared_ptr<IPlatformPlugin> /*unused*/) {
+    VulkanGraphicsPlugin(const std::shared_ptr<Options>& options, std::shared_ptr<IPlatformPlugin> /*unused*/)
+        : m_cacheDirectory(options->CacheDirectory),
+          m_instancing(options->Instancing),
+          m_gpuTimersRequested(options->FrameStats || options->DynamicResolution),
+          m_parallelViews(options->ParallelViews && GetJobSystem().WorkerCount() > 0),
+          m_mirrorInterval(options->MirrorInterval) {
         m_graphicsBinding.type = GetGraphicsBindingType();
     };
 
+    ~VulkanGraphicsPlugin() override {
+        // Resources must not be destroyed while startup jobs or recorded work still use them
+        m_startupJobs.Cancel();
+        WaitForCmdBuffers();
+        m_geometryUploader.Wait();
+    }
+
     std::vector<std::string> GetInstanceExtensions() const override { return {XR_KHR_VULKAN_ENABLE2_EXTENSION_NAME}; }
 
     // Note: The output must not outlive the input - this modifies the input and returns a collection of views into that modified
@@ -1304,6 +2844,25 @@ struct VulkanGraphicsPlugin : public IGraphicsPlugin {
         return nullptr;
     }
 
+    bool IsInstanceExtensionAvailable(const char* name) const {
+        uint32_t extensionCount = 0;
+        CHECK_VKCMD(vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount, nullptr));
+        std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+        CHECK_VKCMD(vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount, availableExtensions.data()));
+        return std::any_of(availableExtensions.begin(), availableExtensions.end(),
+                           [&](const VkExtensionProperties& ext) { return strcmp(ext.extensionName, name) == 0; });
+    }
+
+    bool IsDeviceExtensionAvailable(const char* name) const {
+        uint32_t extensionCount = 0;
+        CHECK_VKCMD(vkEnumerateDeviceExtensionProperties(m_vkPhysicalDevice, nullptr, &extensionCount, nullptr));
+        std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+        CHECK_VKCMD(
+            vkEnumerateDeviceExtensionProperties(m_vkPhysicalDevice, nullptr, &extensionCount, availableExtensions.data()));
+        return std::any_of(availableExtensions.begin(), availableExtensions.end(),
+                           [&](const VkExtensionProperties& ext) { return strcmp(ext.extensionName, name) == 0; });
+    }
+
     void InitializeDevice(XrInstance instance, XrSystemId systemId) override {
         // Create the Vulkan device for the adapter associated with the system.
         // Extension function must be loaded by name
@@ -1325,6 +2884,12 @@ struct VulkanGraphicsPlugin : public IGraphicsPlugin {
         std::vector<const char*> extensions;
         extensions.push_back("VK_EXT_debug_report");
 
+        // VK_KHR_multiview depends on this instance extension on Vulkan 1.0
+        const bool hasPhysicalDeviceProperties2 = IsInstanceExtensionAvailable(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
+        if (hasPhysicalDeviceProperties2) {
+            extensions.push_back(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
+        }
+
         VkApplicationInfo appInfo{VK_STRUCTURE_TYPE_APPLICATION_INFO};
         appInfo.pApplicationName = "hello_xr";
         appInfo.applicationVersion = 1;
@@ -1384,6 +2949,42 @@ struct VulkanGraphicsPlugin : public IGraphicsPlugin {
             }
         }
 
+        // Uploads go to a transfer-only family when there is one, usually the copy engine of a discrete GPU
+        m_transferQueueFamilyIndex = m_queueFamilyIndex;
+        for (uint32_t i = 0; i < queueFamilyCount; ++i) {
+            const VkQueueFlags flags = queueFamilyProps[i].queueFlags;
+            if ((flags & VK_QUEUE_TRANSFER_BIT) != 0u && (flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)) == 0u) {
+                m_transferQueueFamilyIndex = i;
+                break;
+            }
+        }
+        std::vector<VkDeviceQueueCreateInfo> queueInfos{queueInfo};
+        if (m_transferQueueFamilyIndex != m_queueFamilyIndex) {
+            queueInfos.push_back(queueInfo);
+            queueInfos.back().queueFamilyIndex = m_transferQueueFamilyIndex;
+        }
+        LOG_VERBOSE(Fmt("Vulkan uploads use %s queue family %u",
+                        m_transferQueueFamilyIndex != m_queueFamilyIndex ? "transfer" : "graphics", m_transferQueueFamilyIndex));
+
+        // GPU timers need timestamp support on the draw queue; the period converts ticks to nanoseconds.
+        const uint32_t timestampValidBits = queueFamilyProps[m_queueFamilyIndex].timestampValidBits;
+        if (m_gpuTimersRequested && timestampValidBits != 0) {
+            VkPhysicalDeviceProperties deviceProperties{};
+            vkGetPhysicalDeviceProperties(m_vkPhysicalDevice, &deviceProperties);
+            m_timestampPeriod = deviceProperties.limits.timestampPeriod;
+            m_timestampMask = timestampValidBits >= 64 ? ~0ull : (1ull << timestampValidBits) - 1;
+            m_gpuTimers = true;
+        }
+        LOG_VERBOSE(Fmt("Vulkan GPU timers %s", m_gpuTimers ? "enabled" : "disabled"));
+
+        // On-tile multisampling renders color and depth with the same number of samples.
+        {
+            VkPhysicalDeviceProperties deviceProperties{};
+            vkGetPhysicalDeviceProperties(m_vkPhysicalDevice, &deviceProperties);
+            m_attachmentSampleCounts =
+                deviceProperties.limits.framebufferColorSampleCounts & deviceProperties.limits.framebufferDepthSampleCounts;
+        }
+
         std::vector<const char*> deviceExtensions;
 
         VkPhysicalDeviceFeatures features{};
@@ -1393,9 +2994,92 @@ struct VulkanGraphicsPlugin : public IGraphicsPlugin {
         deviceExtensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
 #endif
 
+        // The multiview feature is required to be supported whenever the extension is.
+        m_multiviewSupported = hasPhysicalDeviceProperties2 && IsDeviceExtensionAvailable(VK_KHR_MULTIVIEW_EXTENSION_NAME);
+        VkPhysicalDeviceMultiviewFeaturesKHR multiviewFeatures{VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MULTIVIEW_FEATURES_KHR};
+        if (m_multiviewSupported) {
+            deviceExtensions.push_back(VK_KHR_MULTIVIEW_EXTENSION_NAME);
+            multiviewFeatures.multiview = VK_TRUE;
+        }
+        LOG_VERBOSE(Fmt("Vulkan multiview %s", m_multiviewSupported ? "supported" : "not supported"));
+
         VkDeviceCreateInfo deviceInfo{VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO};
-        deviceInfo.queueCreateInfoCount = 1;
-        deviceInfo.pQueueCreateInfos = &queueInfo;
+        deviceInfo.pNext = m_multiviewSupported ? &multiviewFeatures : nullptr;
+
+#if defined(VK_KHR_fragment_shading_rate)
+        // Foveated shading needs attachment shading rates, which VK_KHR_fragment_shading_rate only describes through
+        // VK_KHR_create_renderpass2 (itself needing VK_KHR_multiview and VK_KHR_maintenance2).
+        VkPhysicalDeviceFragmentShadingRateFeaturesKHR shadingRateFeatures{
+            VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FRAGMENT_SHADING_RATE_FEATURES_KHR};
+        if (m_multiviewSupported && IsDeviceExtensionAvailable(VK_KHR_FRAGMENT_SHADING_RATE_EXTENSION_NAME) &&
+            IsDeviceExtensionAvailable(VK_KHR_CREATE_RENDERPASS_2_EXTENSION_NAME) &&
+            IsDeviceExtensionAvailable(VK_KHR_MAINTENANCE2_EXTENSION_NAME)) {
+            auto pfnGetPhysicalDeviceFeatures2KHR =
+                (PFN_vkGetPhysicalDeviceFeatures2KHR)vkGetInstanceProcAddr(m_vkInstance, "vkGetPhysicalDeviceFeatures2KHR");
+            auto pfnGetPhysicalDeviceProperties2KHR =
+                (PFN_vkGetPhysicalDeviceProperties2KHR)vkGetInstanceProcAddr(m_vkInstance, "vkGetPhysicalDeviceProperties2KHR");
+            if (pfnGetPhysicalDeviceFeatures2KHR != nullptr && pfnGetPhysicalDeviceProperties2KHR != nullptr) {
+                VkPhysicalDeviceFeatures2KHR features2{VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2_KHR};
+                features2.pNext = &shadingRateFeatures;
+                pfnGetPhysicalDeviceFeatures2KHR(m_vkPhysicalDevice, &features2);
+                shadingRateFeatures.pNext = nullptr;
+                m_shadingRateSupported = shadingRateFeatures.attachmentFragmentShadingRate == VK_TRUE;
+            }
+            if (m_shadingRateSupported) {
+                VkPhysicalDeviceFragmentShadingRatePropertiesKHR shadingRateProperties{
+                    VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FRAGMENT_SHADING_RATE_PROPERTIES_KHR};
+                VkPhysicalDeviceProperties2KHR properties2{VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2_KHR};
+                properties2.pNext = &shadingRateProperties;
+                pfnGetPhysicalDeviceProperties2KHR(m_vkPhysicalDevice, &properties2);
+
+                // 16x16 texels where allowed, the usual tile size of hardware shading rate images
+                const VkExtent2D minTexel = shadingRateProperties.minFragmentShadingRateAttachmentTexelSize;
+                const VkExtent2D maxTexel = shadingRateProperties.maxFragmentShadingRateAttachmentTexelSize;
+                m_shadingRateTexelSize = {std::min(std::max(16u, minTexel.width), maxTexel.width),
+                                          std::min(std::max(16u, minTexel.height), maxTexel.height)};
+                const VkExtent2D maxFragmentSize = shadingRateProperties.maxFragmentSize;
+                const uint32_t maxFragmentLength = std::min(maxFragmentSize.width, maxFragmentSize.height);
+                m_maxShadingRateLog2Size = maxFragmentLength >= 4 ? 2 : maxFragmentLength >= 2 ? 1 : 0;
+
+                deviceExtensions.push_back(VK_KHR_MAINTENANCE2_EXTENSION_NAME);
+                deviceExtensions.push_back(VK_KHR_CREATE_RENDERPASS_2_EXTENSION_NAME);
+                deviceExtensions.push_back(VK_KHR_FRAGMENT_SHADING_RATE_EXTENSION_NAME);
+                // Attachment rates require pipeline rates to be supported as well
+                shadingRateFeatures = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FRAGMENT_SHADING_RATE_FEATURES_KHR};
+                shadingRateFeatures.pipelineFragmentShadingRate = VK_TRUE;
+                shadingRateFeatures.attachmentFragmentShadingRate = VK_TRUE;
+                multiviewFeatures.pNext = &shadingRateFeatures;
+            }
+        }
+        LOG_VERBOSE(Fmt("Vulkan attachment fragment shading rate %s", m_shadingRateSupported ? "supported" : "not supported"));
+#endif
+
+#if defined(VK_KHR_timeline_semaphore)
+        // Command buffers are waited for by timeline value where possible, which lets a single read of the counter retire
+        // every finished ring slot instead of checking a fence per slot. Core in Vulkan 1.2, but the instance asks for 1.0.
+        VkPhysicalDeviceTimelineSemaphoreFeaturesKHR timelineFeatures{
+            VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR};
+        if (hasPhysicalDeviceProperties2 && IsDeviceExtensionAvailable(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME)) {
+            auto pfnGetPhysicalDeviceFeatures2KHR =
+                (PFN_vkGetPhysicalDeviceFeatures2KHR)vkGetInstanceProcAddr(m_vkInstance, "vkGetPhysicalDeviceFeatures2KHR");
+            if (pfnGetPhysicalDeviceFeatures2KHR != nullptr) {
+                VkPhysicalDeviceFeatures2KHR features2{VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2_KHR};
+                features2.pNext = &timelineFeatures;
+                pfnGetPhysicalDeviceFeatures2KHR(m_vkPhysicalDevice, &features2);
+                m_timelineSemaphoreSupported = timelineFeatures.timelineSemaphore == VK_TRUE;
+            }
+            if (m_timelineSemaphoreSupported) {
+                deviceExtensions.push_back(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME);
+                timelineFeatures = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR};
+                timelineFeatures.timelineSemaphore = VK_TRUE;
+                timelineFeatures.pNext = const_cast<void*>(deviceInfo.pNext);
+                deviceInfo.pNext = &timelineFeatures;
+            }
+        }
+        LOG_VERBOSE(Fmt("Vulkan timeline semaphores %s", m_timelineSemaphoreSupported ? "supported" : "not supported"));
+#endif
+        deviceInfo.queueCreateInfoCount = (uint32_t)queueInfos.size();
+        deviceInfo.pQueueCreateInfos = queueInfos.data();
         deviceInfo.enabledLayerCount = 0;
         deviceInfo.ppEnabledLayerNames = nullptr;
         deviceInfo.enabledExtensionCount = (uint32_t)deviceExtensions.size();
@@ -1412,6 +3096,7 @@ struct VulkanGraphicsPlugin : public IGraphicsPlugin {
         CHECK_VKCMD(err);
 
         vkGetDeviceQueue(m_vkDevice, queueInfo.queueFamilyIndex, 0, &m_vkQueue);
+        vkGetDeviceQueue(m_vkDevice, m_transferQueueFamilyIndex, 0, &m_vkTransferQueue);
 
         m_memAllocator.Init(m_vkPhysicalDevice, m_vkDevice);
 
@@ -1425,8 +3110,28 @@ struct VulkanGraphicsPlugin : public IGraphicsPlugin {
     }
 
 #ifdef USE_ONLINE_VULKAN_SHADERC
-    // Compile a shader to a SPIR-V binary.
+    // Compile a shader to a SPIR-V binary, or load the binary a previous run compiled from the same source and options.
     std::vector<uint32_t> CompileGlslShader(const std::string& name, shaderc_shader_kind kind, const std::string& source) {
+        constexpr uint32_t SpirvMagic = 0x07230203;
+        unsigned int spirvVersion = 0;
+        unsigned int spirvRevision = 0;
+        shaderc_get_spv_version(&spirvVersion, &spirvRevision);
+        CacheKey key;
+        key.Add(source.c_str()).Add((uint64_t)kind).Add((uint64_t)shaderc_optimization_level_size);
+        key.Add((uint64_t)spirvVersion).Add((uint64_t)spirvRevision);
+        const std::string cacheFileName = key.FileName("spirv");
+
+        std::vector<uint8_t> cached;
+        if (ReadCacheFile(m_cacheDirectory, cacheFileName.c_str(), cached) && cached.size() % sizeof(uint32_t) == 0 &&
+            cached.size() >= sizeof(uint32_t)) {
+            std::vector<uint32_t> spirv(cached.size() / sizeof(uint32_t));
+            memcpy(spirv.data(), cached.data(), cached.size());
+            if (spirv[0] == SpirvMagic) {
+                LOG_VERBOSE(Fmt("Loaded %s shader from the shader cache", name.c_str()));
+                return spirv;
+            }
+        }
+
         shaderc::Compiler compiler;
         shaderc::CompileOptions options;
 
@@ -1439,59 +3144,244 @@ struct VulkanGraphicsPlugin : public IGraphicsPlugin {
             return std::vector<uint32_t>();
         }
 
-        return {module.cbegin(), module.cend()};
+        std::vector<uint32_t> spirv{module.cbegin(), module.cend()};
+        const uint8_t* spirvBytes = reinterpret_cast<const uint8_t*>(spirv.data());
+        WriteCacheFile(m_cacheDirectory, cacheFileName.c_str(),
+                       std::vector<uint8_t>(spirvBytes, spirvBytes + spirv.size() * sizeof(uint32_t)));
+        return spirv;
     }
 #endif
 
-    void InitializeResources() {
+    // Compile (or load) the SPIR-V, which needs no device. The multiview variant is always built since multiview support
+    // is only known once the device is chosen.
+    void PrepareResources() override {
 #ifdef USE_ONLINE_VULKAN_SHADERC
-        auto vertexSPIRV = CompileGlslShader("vertex", shaderc_glsl_default_vertex_shader, VertexShaderGlsl);
-        auto fragmentSPIRV = CompileGlslShader("fragment", shaderc_glsl_default_fragment_shader, FragmentShaderGlsl);
+        m_vertexSPIRV = CompileGlslShader("vertex", shaderc_glsl_default_vertex_shader, VertexShaderGlsl);
+        m_multiviewVertexSPIRV =
+            CompileGlslShader("multiview vertex", shaderc_glsl_default_vertex_shader, MultiviewVertexShaderGlsl);
+        m_fragmentSPIRV = CompileGlslShader("fragment", shaderc_glsl_default_fragment_shader, FragmentShaderGlsl);
+        m_motionVectorVertexSPIRV =
+            CompileGlslShader("motion vector vertex", shaderc_glsl_default_vertex_shader, MotionVectorVertexShaderGlsl);
+        m_motionVectorFragmentSPIRV =
+            CompileGlslShader("motion vector fragment", shaderc_glsl_default_fragment_shader, MotionVectorFragmentShaderGlsl);
 #else
-        std::vector<uint32_t> vertexSPIRV = SPV_PREFIX
+        m_vertexSPIRV = SPV_PREFIX
 #include "vert.spv"
             SPV_SUFFIX;
-        std::vector<uint32_t> fragmentSPIRV = SPV_PREFIX
+        m_multiviewVertexSPIRV = SPV_PREFIX
+#include "multiview_vert.spv"
+            SPV_SUFFIX;
+        m_fragmentSPIRV = SPV_PREFIX
 #include "frag.spv"
             SPV_SUFFIX;
+        m_motionVectorVertexSPIRV = SPV_PREFIX
+#include "motionvector_vert.spv"
+            SPV_SUFFIX;
+        m_motionVectorFragmentSPIRV = SPV_PREFIX
+#include "motionvector_frag.spv"
+            SPV_SUFFIX;
 #endif
-        if (vertexSPIRV.empty()) THROW("Failed to compile vertex shader");
-        if (fragmentSPIRV.empty()) THROW("Failed to compile fragment shader");
+    }
 
-        m_shaderProgram.Init(m_vkDevice);
-        m_shaderProgram.LoadVertexShader(vertexSPIRV);
-        m_shaderProgram.LoadFragmentShader(fragmentSPIRV);
+    void InitializeResources() {
+        if (m_vertexSPIRV.empty()) THROW("Failed to compile vertex shader");
+        if (m_multiviewVertexSPIRV.empty()) THROW("Failed to compile multiview vertex shader");
+        if (m_fragmentSPIRV.empty()) THROW("Failed to compile fragment shader");
+        if (m_motionVectorVertexSPIRV.empty()) THROW("Failed to compile motion vector vertex shader");
+        if (m_motionVectorFragmentSPIRV.empty()) THROW("Failed to compile motion vector fragment shader");
+
+        // The shader modules, the pipeline cache and the cube upload are startup jobs, which overlap each other and the
+        // creation of the session and its swapchains. Each swapchain adds a job for its pipeline, and the first frame waits
+        // for all of them.
+        m_shaderModulesJob = AddStartupStage(m_startupJobs, "create shader modules", [this]() {
+            m_shaderProgram.Init(m_vkDevice);
+            m_shaderProgram.LoadVertexShader(m_vertexSPIRV);
+            m_shaderProgram.LoadFragmentShader(m_fragmentSPIRV);
+
+            m_motionVectorShaderProgram.Init(m_vkDevice);
+            m_motionVectorShaderProgram.LoadVertexShader(m_motionVectorVertexSPIRV);
+            m_motionVectorShaderProgram.LoadFragmentShader(m_motionVectorFragmentSPIRV);
+
+            // The multiview vertex shader uses the MultiView capability, so only create it when the device has it enabled
+            if (m_multiviewSupported) {
+                m_multiviewShaderProgram.Init(m_vkDevice);
+                m_multiviewShaderProgram.LoadVertexShader(m_multiviewVertexSPIRV);
+                m_multiviewShaderProgram.LoadFragmentShader(m_fragmentSPIRV);
+            }
+        });
+        m_pipelineCacheJob = AddStartupStage(m_startupJobs, "load pipeline cache", [this]() {
+            m_pipelineCache.Create(m_vkPhysicalDevice, m_vkDevice, m_cacheDirectory);
+        });
 
         // Semaphore to block on draw complete
         VkSemaphoreCreateInfo semInfo{VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO};
         CHECK_VKCMD(vkCreateSemaphore(m_vkDevice, &semInfo, nullptr, &m_vkDrawDone));
 
-        if (!m_cmdBuffer.Init(m_vkDevice, m_queueFamilyIndex)) THROW("Failed to create command buffer");
-
         m_pipelineLayout.Create(m_vkDevice);
+        VkPhysicalDeviceProperties deviceProperties{};
+        vkGetPhysicalDeviceProperties(m_vkPhysicalDevice, &deviceProperties);
+        m_uniformOffsetAlignment = deviceProperties.limits.minUniformBufferOffsetAlignment;
 
-        static_assert(sizeof(Geometry::Vertex) == 24, "Unexpected Vertex size");
-        m_drawBuffer.Init(m_vkDevice, &m_memAllocator,
-                          {{0, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(Geometry::Vertex, Position)},
-                           {1, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(Geometry::Vertex, Color)}});
-        uint32_t numCubeIdicies = sizeof(Geometry::c_cubeIndices) / sizeof(Geometry::c_cubeIndices[0]);
-        uint32_t numCubeVerticies = sizeof(Geometry::c_cubeVertices) / sizeof(Geometry::c_cubeVertices[0]);
-        m_drawBuffer.Create(numCubeIdicies, numCubeVerticies);
-        m_drawBuffer.UpdateIndicies(Geometry::c_cubeIndices, numCubeIdicies, 0);
-        m_drawBuffer.UpdateVertices(Geometry::c_cubeVertices, numCubeVerticies, 0);
+        if (m_timelineSemaphoreSupported) {
+            m_frameTimeline.Init(m_vkDevice);
+        }
+        // Start the ring with a single command buffer, more are added as swapchain images are allocated
+        GrowCmdBufferRing(1);
+
+        m_geometryUploader.Init(m_vkDevice, &m_memAllocator, m_queueFamilyIndex, m_transferQueueFamilyIndex,
+                                m_vkTransferQueue, m_timelineSemaphoreSupported);
+
+        // The cube's vertex layout is known right away, for the pipelines, while its buffers are created and filled by a
+        // job. The runtime may share the queue, so the copies are submitted on the thread that makes the OpenXR calls.
+        m_meshes.clear();
+        m_meshes.push_back(std::make_unique<MeshBuffers>());
+        MeshBuffers* const cube = m_meshes.back().get();
+        InitMeshGeometry(cube->geometry);
+        const JobGraph::JobId cubeCopies = AddStartupStage(m_startupJobs, "upload cube geometry", [this, cube]() {
+            const MeshData mesh = CubeMeshData();
+            CreateMeshGeometry(cube->geometry, mesh);
+            cube->lods = mesh.Lods;
+        });
+        m_cubeUploadJob = AddStartupStage(
+            m_startupJobs, "submit cube geometry", [this]() { m_geometryUploader.Submit(); }, {cubeCopies},
+            JobGraph::Thread::Waiting);
 
 #if defined(USE_MIRROR_WINDOW)
-        m_swapchain.Create(m_vkInstance, m_vkPhysicalDevice, m_vkDevice, m_graphicsBinding.queueFamilyIndex);
-
-        m_cmdBuffer.Reset();
-        m_cmdBuffer.Begin();
-        m_swapchain.Prepare(m_cmdBuffer.buf);
-        m_cmdBuffer.End();
-        m_cmdBuffer.Exec(m_vkQueue);
-        m_cmdBuffer.Wait();
+        if (m_mirrorInterval != 0) {
+            m_swapchain.Create(m_vkInstance, m_vkPhysicalDevice, m_vkDevice, m_graphicsBinding.queueFamilyIndex, m_vkQueue,
+                               m_timelineSemaphoreSupported);
+        }
 #endif
     }
 
+    void GrowCmdBufferRing(uint32_t count) {
+        for (uint32_t i = 0; i < count; ++i) {
+            m_cmdBufferRing.emplace_back(std::make_unique<CmdBuffer>());
+            QueueTimeline* timeline = m_timelineSemaphoreSupported ? &m_frameTimeline : nullptr;
+            if (!m_cmdBufferRing.back()->Init(m_vkDevice, m_queueFamilyIndex, timeline)) THROW("Failed to create command buffer");
+            m_instanceBufferRing.emplace_back(std::make_unique<InstanceBuffer>());
+            m_instanceBufferRing.back()->Init(m_vkDevice, &m_memAllocator);
+            m_previousInstanceBufferRing.emplace_back(std::make_unique<InstanceBuffer>());
+            m_previousInstanceBufferRing.back()->Init(m_vkDevice, &m_memAllocator);
+            m_timestampQueryRing.emplace_back(std::make_unique<TimestampQueries>());
+            if (m_gpuTimers) {
+                m_timestampQueryRing.back()->Init(m_vkDevice);
+            }
+            m_viewCmdBufferRing.emplace_back(std::make_unique<ViewCmdBuffers>());
+            m_viewCmdBufferRing.back()->Init(m_vkDevice, m_queueFamilyIndex);
+            m_viewUniformRing.emplace_back(std::make_unique<ViewUniforms>());
+            m_viewUniformRing.back()->Init(m_vkDevice, &m_memAllocator, m_pipelineLayout.setLayout, m_uniformOffsetAlignment);
+        }
+    }
+
+    // Pick up the GPU view times of a ring slot whose command buffer has finished, keeping only the newest frame's.
+    void CollectGpuTimes(size_t slot) {
+        TimestampQueries& queries = *m_timestampQueryRing[slot];
+        if (!m_gpuTimers || queries.timedViews.Count == 0 ||
+            m_cmdBufferRing[slot]->state == CmdBuffer::CmdBufferState::Executing) {
+            return;
+        }
+        if (queries.submission < m_gpuViewTimesSubmission) {
+            queries.timedViews.Take();
+            return;
+        }
+        if (queries.Read(m_timestampPeriod, m_timestampMask, m_gpuViewTimes)) {
+            m_gpuViewTimesSubmission = queries.submission;
+        }
+    }
+
+    // Returns the next command buffer in the ring, ready for recording. Only blocks on the GPU if the whole ring is in flight.
+    CmdBuffer& AcquireCmdBuffer() {
+        CHECK(!m_cmdBufferRing.empty());
+
+        // Retire finished submissions and count the ones the GPU is still working on
+        uint32_t inFlight = 0;
+        for (size_t slot = 0; slot < m_cmdBufferRing.size(); ++slot) {
+            m_cmdBufferRing[slot]->Poll();
+            if (m_cmdBufferRing[slot]->state == CmdBuffer::CmdBufferState::Executing) {
+                ++inFlight;
+            }
+            CollectGpuTimes(slot);
+        }
+        m_cmdBuffersInFlight = inFlight;
+        if (inFlight > m_maxCmdBuffersInFlight) {
+            m_maxCmdBuffersInFlight = inFlight;
+            LOG_VERBOSE(Fmt("Vulkan submissions in flight reached %u (ring size %u)", inFlight, (uint32_t)m_cmdBufferRing.size()));
+        }
+
+        m_currentRingSlot = m_cmdBufferRingIndex;
+        CmdBuffer& cmdBuffer = *m_cmdBufferRing[m_cmdBufferRingIndex];
+        m_cmdBufferRingIndex = (m_cmdBufferRingIndex + 1) % m_cmdBufferRing.size();
+
+        if (!cmdBuffer.Wait()) THROW("Timed out waiting for command buffer");
+        CollectGpuTimes(m_currentRingSlot);
+        cmdBuffer.Reset();
+        return cmdBuffer;
+    }
+
+    void WaitForCmdBuffers() {
+        for (auto& ringEntry : m_cmdBufferRing) {
+            ringEntry->Wait();
+        }
+        m_cmdBuffersInFlight = 0;
+    }
+
+    bool ReuseDevice(XrInstance instance, XrSystemId systemId) override {
+        if (m_vkDevice == VK_NULL_HANDLE) {
+            return false;
+        }
+
+        // The requirements must be queried before a session is created, even though the device already exists.
+        XrGraphicsRequirementsVulkan2KHR graphicsRequirements{XR_TYPE_GRAPHICS_REQUIREMENTS_VULKAN2_KHR};
+        CHECK_XRCMD(GetVulkanGraphicsRequirements2KHR(instance, systemId, &graphicsRequirements));
+
+        XrVulkanGraphicsDeviceGetInfoKHR deviceGetInfo{XR_TYPE_VULKAN_GRAPHICS_DEVICE_GET_INFO_KHR};
+        deviceGetInfo.systemId = systemId;
+        deviceGetInfo.vulkanInstance = m_vkInstance;
+        VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+        CHECK_XRCMD(GetVulkanGraphicsDevice2KHR(instance, &deviceGetInfo, &physicalDevice));
+        if (physicalDevice != m_vkPhysicalDevice) {
+            return false;
+        }
+
+        // The images of the old swapchains are gone, so nothing may still be rendering into them.
+        m_startupJobs.Wait();
+        WaitForCmdBuffers();
+        m_swapchainImageContexts.clear();
+        m_geometryUploader.Wait();
+        m_meshes.resize(CubeMesh + 1);
+        return true;
+    }
+
+    // The mesh goes through a staging buffer into device-local memory on the transfer queue. Like the cube, it is not
+    // waited for here but before the first render pass that could draw it.
+    uint32_t AddMesh(const MeshData& mesh) override {
+        // The uploader records one batch of copies at a time, so the cube's has to be submitted first
+        m_startupJobs.Wait(m_cubeUploadJob);
+        std::unique_ptr<MeshBuffers> buffers = std::make_unique<MeshBuffers>();
+        InitMeshGeometry(buffers->geometry);
+        CreateMeshGeometry(buffers->geometry, mesh);
+        m_geometryUploader.Submit();
+        buffers->lods = mesh.Lods;
+        m_meshes.push_back(std::move(buffers));
+        return (uint32_t)(m_meshes.size() - 1);
+    }
+
+    void InitMeshGeometry(VertexBuffer<Geometry::Vertex>& geometry) {
+        static_assert(sizeof(Geometry::Vertex) == 24, "Unexpected Vertex size");
+        geometry.Init(m_vkDevice, &m_memAllocator,
+                      {{0, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(Geometry::Vertex, Position)},
+                       {1, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(Geometry::Vertex, Color)}});
+    }
+
+    // Record the copies of the mesh into the uploader, to be submitted by the caller.
+    void CreateMeshGeometry(VertexBuffer<Geometry::Vertex>& geometry, const MeshData& mesh) {
+        // Copies still in flight keep the command buffer, they have to finish before more can be recorded
+        m_geometryUploader.Wait();
+        geometry.CreateStatic(m_geometryUploader, mesh.Indices, mesh.IndexCount, mesh.IndexSize, mesh.Vertices,
+                              mesh.VertexCount);
+    }
+
     int64_t SelectColorSwapchainFormat(const std::vector<int64_t>& runtimeFormats) const override {
         // List of supported color swapchain formats.
         constexpr int64_t SupportedColorSwapchainFormats[] = {VK_FORMAT_B8G8R8A8_SRGB, VK_FORMAT_R8G8B8A8_SRGB,
@@ -1507,41 +3397,206 @@ struct VulkanGraphicsPlugin : public IGraphicsPlugin {
         return *swapchainFormatIt;
     }
 
+    std::vector<ColorFormatInfo> GetColorSwapchainFormatCandidates() const override {
+        return {{VK_FORMAT_B8G8R8A8_SRGB, "VK_FORMAT_B8G8R8A8_SRGB", 4, 8, 8, true, true},
+                {VK_FORMAT_R8G8B8A8_SRGB, "VK_FORMAT_R8G8B8A8_SRGB", 4, 8, 8, true, true},
+                {VK_FORMAT_B8G8R8A8_UNORM, "VK_FORMAT_B8G8R8A8_UNORM", 4, 8, 8, false, true},
+                {VK_FORMAT_R8G8B8A8_UNORM, "VK_FORMAT_R8G8B8A8_UNORM", 4, 8, 8, false, true},
+                {VK_FORMAT_A2B10G10R10_UNORM_PACK32, "VK_FORMAT_A2B10G10R10_UNORM_PACK32", 4, 10, 2, false, true},
+                {VK_FORMAT_B10G11R11_UFLOAT_PACK32, "VK_FORMAT_B10G11R11_UFLOAT_PACK32", 4, 10, 0, false, true},
+                {VK_FORMAT_R16G16B16A16_SFLOAT, "VK_FORMAT_R16G16B16A16_SFLOAT", 8, 16, 16, false, false}};
+    }
+
+    int64_t SelectDepthSwapchainFormat(const std::vector<int64_t>& runtimeFormats) const override {
+        // The render passes are built for the format of the private depth buffers.
+        const auto swapchainFormatIt = std::find(runtimeFormats.begin(), runtimeFormats.end(), VK_FORMAT_D32_SFLOAT);
+        return swapchainFormatIt != runtimeFormats.end() ? *swapchainFormatIt : -1;
+    }
+
+    int64_t SelectMotionVectorSwapchainFormat(const std::vector<int64_t>& runtimeFormats) const override {
+        const auto swapchainFormatIt = std::find(runtimeFormats.begin(), runtimeFormats.end(), MotionVectorFormat);
+        return swapchainFormatIt != runtimeFormats.end() ? *swapchainFormatIt : -1;
+    }
+
+    void SetAllocatingMotionVectorSwapchains(bool motionVectors) override { m_allocatingMotionVectors = motionVectors; }
+
+    void SetPreviousCubeModels(const std::vector<XrMatrix4x4f>& previousCubeModels) override {
+        m_previousCubeModels = &previousCubeModels;
+    }
+
     const XrBaseInStructure* GetGraphicsBinding() const override {
         return reinterpret_cast<const XrBaseInStructure*>(&m_graphicsBinding);
     }
 
-    std::vector<XrSwapchainImageBaseHeader*> AllocateSwapchainImageStructs(
-        uint32_t capacity, const XrSwapchainCreateInfo& swapchainCreateInfo) override {
+    uint32_t AllocateSwapchainImageStructs(uint32_t capacity, const XrSwapchainCreateInfo& swapchainCreateInfo,
+                                           std::vector<XrSwapchainImageBaseHeader*>& swapchainImages) override {
         // Allocate and initialize the buffer of image structs (must be sequential in memory for xrEnumerateSwapchainImages).
         // Return back an array of pointers to each swapchain image struct so the consumer doesn't need to know the type/size.
-        // Keep the buffer alive by adding it into the list of buffers.
-        m_swapchainImageContexts.emplace_back(GetSwapchainImageType());
-        SwapchainImageContext& swapchainImageContext = m_swapchainImageContexts.back();
+        // Keep the buffer alive by adding it into the table of contexts, whose index identifies the swapchain.
+        const uint32_t swapchainIndex = (uint32_t)m_swapchainImageContexts.size();
+        m_swapchainImageContexts.push_back(std::make_unique<SwapchainImageContext>(GetSwapchainImageType()));
+        SwapchainImageContext& swapchainImageContext = *m_swapchainImageContexts.back();
+
+        if ((swapchainCreateInfo.usageFlags & XR_SWAPCHAIN_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT) != 0) {
+            swapchainImages = swapchainImageContext.CreateDepth(m_vkDevice, capacity, swapchainCreateInfo);
+            return swapchainIndex;
+        }
+
+        const PipelineState& pipelineState = GetOrCreatePipelineState(swapchainCreateInfo, m_allocatingMotionVectors);
+        swapchainImages =
+            swapchainImageContext.Create(m_vkDevice, &m_memAllocator, capacity, swapchainCreateInfo, pipelineState);
 
-        std::vector<XrSwapchainImageBaseHeader*> bases = swapchainImageContext.Create(
-            m_vkDevice, &m_memAllocator, capacity, swapchainCreateInfo, m_pipelineLayout, m_shaderProgram, m_drawBuffer);
+        // One command buffer per swapchain image so every image can have work in flight
+        GrowCmdBufferRing(capacity);
+
+        return swapchainIndex;
+    }
 
-        // Map every swapchainImage base pointer to this context
-        for (auto& base : bases) {
-            m_swapchainImageContextMap[base] = &swapchainImageContext;
+    // Find the pipeline built for the swapchain's format, extent and layer count, or build it through the pipeline cache.
+    // Motion vector swapchains get the motion vector pipeline, which is never foveated nor multisampled.
+    const PipelineState& GetOrCreatePipelineState(const XrSwapchainCreateInfo& swapchainCreateInfo, bool motionVectors) {
+        const VkFormat colorFormat = (VkFormat)swapchainCreateInfo.format;
+        const FoveationLevel foveation = motionVectors ? FoveationLevel::Off : m_foveationLevel;
+        const VkSampleCountFlagBits samples = motionVectors ? VK_SAMPLE_COUNT_1_BIT : m_onTileSamples;
+        for (const std::unique_ptr<PipelineState>& pipelineState : m_pipelineStates) {
+            if (pipelineState->colorFormat == colorFormat && pipelineState->size.width == swapchainCreateInfo.width &&
+                pipelineState->size.height == swapchainCreateInfo.height &&
+                pipelineState->arraySize == swapchainCreateInfo.arraySize && pipelineState->foveation == foveation &&
+                pipelineState->samples == samples && pipelineState->motionVectors == motionVectors) {
+                return *pipelineState;
+            }
         }
 
-        return bases;
+        CHECK_MSG(swapchainCreateInfo.arraySize == 1 || m_multiviewSupported, "Array swapchains require multiview support");
+        CHECK_MSG(swapchainCreateInfo.arraySize == 1 || !motionVectors, "Motion vectors are only rendered per view");
+        const ShaderProgram& shaderProgram = motionVectors                       ? m_motionVectorShaderProgram
+                                             : swapchainCreateInfo.arraySize > 1 ? m_multiviewShaderProgram
+                                                                                 : m_shaderProgram;
+
+        m_pipelineStates.push_back(std::make_unique<PipelineState>());
+        PipelineState& pipelineState = *m_pipelineStates.back();
+        pipelineState.colorFormat = colorFormat;
+        pipelineState.size = {swapchainCreateInfo.width, swapchainCreateInfo.height};
+        pipelineState.arraySize = swapchainCreateInfo.arraySize;
+        pipelineState.foveation = foveation;
+        pipelineState.samples = samples;
+        pipelineState.motionVectors = motionVectors;
+        // Array swapchains render every layer at once with multiview
+        const uint32_t viewMask = pipelineState.arraySize > 1 ? (1u << pipelineState.arraySize) - 1 : 0;
+        // The shading rate attachment itself depends on the rendered area, see GetOrCreateShadingRateImage.
+        const VkExtent2D shadingRateTexelSize =
+            pipelineState.foveation != FoveationLevel::Off ? m_shadingRateTexelSize : VkExtent2D{};
+        pipelineState.rp.Create(m_vkDevice, colorFormat, VK_FORMAT_D32_SFLOAT, false, viewMask, shadingRateTexelSize, samples);
+        pipelineState.rpStoreDepth.Create(m_vkDevice, colorFormat, VK_FORMAT_D32_SFLOAT, true, viewMask, shadingRateTexelSize,
+                                          samples);
+        pipelineState.pipe.Dynamic(VK_DYNAMIC_STATE_VIEWPORT);
+        pipelineState.pipe.Dynamic(VK_DYNAMIC_STATE_SCISSOR);
+
+        // Swapchain images only need the render passes, so the pipeline is compiled by a job, which the first frame that
+        // draws with it waits for.
+        PipelineState* const state = &pipelineState;
+        const VertexBufferBase* const geometry = &m_meshes[CubeMesh]->geometry;
+        AddStartupStage(
+            m_startupJobs, motionVectors ? "create motion vector pipeline" : "create cube pipeline",
+            [this, state, &shaderProgram, geometry]() {
+                const auto createStart = std::chrono::steady_clock::now();
+                state->pipe.Create(m_vkDevice, m_pipelineCache.cache, state->size, m_pipelineLayout, state->rp, shaderProgram,
+                                   *geometry, state->motionVectors);
+                const std::chrono::duration<double, std::milli> createTime = std::chrono::steady_clock::now() - createStart;
+                Log::Write(Log::Level::Info,
+                           Fmt("Created Vulkan %s pipeline for %ux%u x%u, foveation %s, %u samples, in %.2f ms (%s pipeline cache)",
+                               state->motionVectors ? "motion vector" : "cube", state->size.width, state->size.height,
+                               state->arraySize, to_string(state->foveation), (uint32_t)state->samples, createTime.count(),
+                               m_pipelineCache.Loaded() ? "warm" : "cold"));
+
+                m_pipelineCache.Save();
+            },
+            {m_shaderModulesJob, m_pipelineCacheJob});
+        return pipelineState;
     }
 
-    void RenderView(const XrCompositionLayerProjectionView& layerView, const XrSwapchainImageBaseHeader* swapchainImage,
-                    int64_t /*swapchainFormat*/, const std::vector<Cube>& cubes) override {
-        CHECK(layerView.subImage.imageArrayIndex == 0);  // Texture arrays not supported.
+#if defined(VK_KHR_fragment_shading_rate)
+    // Find or create the fragment shading rate attachment of a foveated pipeline state for a view rendered into imageRect. The
+    // pattern is centered on the tiles imageRect covers, so dynamic resolution makes one attachment per distinct rendered
+    // size, and a framebuffer for each of those.
+    ShadingRateImage& GetOrCreateShadingRateImage(const PipelineState& pipelineState, const XrRect2Di& imageRect) {
+        const VkExtent2D texel = m_shadingRateTexelSize;
+        const XrRect2Di viewTiles = FoveationViewTiles(imageRect, texel.width, texel.height);
+        const auto key = std::make_tuple(pipelineState.size.width, pipelineState.size.height, viewTiles.offset.x,
+                                         viewTiles.offset.y, viewTiles.extent.width, viewTiles.extent.height,
+                                         pipelineState.foveation);
+        std::unique_ptr<ShadingRateImage>& shadingRate = m_shadingRateImages[key];
+        if (!shadingRate) {
+            const VkExtent2D tiles = {(pipelineState.size.width + texel.width - 1) / texel.width,
+                                      (pipelineState.size.height + texel.height - 1) / texel.height};
+            shadingRate = std::make_unique<ShadingRateImage>();
+            shadingRate->Create(
+                m_vkDevice, &m_memAllocator, tiles,
+                FoveationShadingRates(pipelineState.foveation, tiles.width, tiles.height, viewTiles, m_maxShadingRateLog2Size));
+            LOG_VERBOSE(Fmt("Created %ux%u Vulkan shading rate attachment for %ux%u rendered at %dx%d, foveation %s", tiles.width,
+                            tiles.height, pipelineState.size.width, pipelineState.size.height, imageRect.extent.width,
+                            imageRect.extent.height, to_string(pipelineState.foveation)));
+        }
+        return *shadingRate;
+    }
+#endif
+
+    // Compute the view-projection transform.
+    // Note all matrixes (including OpenXR's) are column-major, right-handed.
+    static XrMatrix4x4f ComputeViewProjection(const XrCompositionLayerProjectionView& layerView) {
+        const auto& pose = layerView.pose;
+        XrMatrix4x4f proj;
+        XrMatrix4x4f_CreateProjectionFov(&proj, GRAPHICS_VULKAN, layerView.fov, 0.05f, 100.0f);
+        XrMatrix4x4f toView;
+        XrVector3f scale{1.f, 1.f, 1.f};
+        XrMatrix4x4f_CreateTranslationRotationScale(&toView, &pose.position, &pose.orientation, &scale);
+        XrMatrix4x4f view;
+        XrMatrix4x4f_InvertRigidBody(&view, &toView);
+        XrMatrix4x4f vp;
+        XrMatrix4x4f_Multiply(&vp, &proj, &view);
+        return vp;
+    }
 
-        auto swapchainContext = m_swapchainImageContextMap[swapchainImage];
-        uint32_t imageIndex = swapchainContext->ImageIndex(swapchainImage);
+    // Acquire a command buffer from the ring and start recording into it, once the pipelines and cube geometry of the
+    // startup jobs are ready.
+    CmdBuffer& BeginCmdBuffer() {
+        m_startupJobs.Wait();
+        CmdBuffer& cmdBuffer = AcquireCmdBuffer();
+        cmdBuffer.Begin();
+        if (m_gpuTimers) {
+            m_timestampQueryRing[m_currentRingSlot]->Reset(cmdBuffer.buf, ++m_submissionCount);
+        }
+        return cmdBuffer;
+    }
 
-        m_cmdBuffer.Reset();
-        m_cmdBuffer.Begin();
+    // Start the render pass for a swapchain image, with the cube pipeline and geometry bound and the viewport covering
+    // imageRect. The whole image is cleared, motion vectors to no motion. With VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS
+    // nothing is bound, the secondary command buffers executed in the pass do that through BindDrawState. Only the passes
+    // of the views themselves are timed.
+    void BeginRenderPass(CmdBuffer& cmdBuffer, const SwapchainImage& swapchainImage, const XrRect2Di& imageRect,
+                         VkSubpassContents contents = VK_SUBPASS_CONTENTS_INLINE) {
+        SwapchainImageContext* swapchainContext = m_swapchainImageContexts[swapchainImage.swapchainIndex].get();
+        const SwapchainImageContext* depthContext = swapchainImage.depthSwapchainIndex != NoDepthSwapchain
+                                                        ? m_swapchainImageContexts[swapchainImage.depthSwapchainIndex].get()
+                                                        : nullptr;
+        const bool motionVectors = swapchainContext->pipelineState->motionVectors;
+
+        m_geometryUploader.Wait();
+
+        if (m_gpuTimers && !motionVectors) {
+            m_timestampQueryRing[m_currentRingSlot]->BeginView(cmdBuffer.buf);
+        }
 
         // Ensure depth is in the right layout
-        swapchainContext->depthBuffer.TransitionLayout(&m_cmdBuffer, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
+        swapchainContext->PrepareDepth(&cmdBuffer, depthContext);
+        VkImageView shadingRateView = VK_NULL_HANDLE;
+#if defined(VK_KHR_fragment_shading_rate)
+        if (swapchainContext->pipelineState->foveation != FoveationLevel::Off) {
+            ShadingRateImage& shadingRate = GetOrCreateShadingRateImage(*swapchainContext->pipelineState, imageRect);
+            shadingRate.RecordUpload(cmdBuffer.buf);
+            shadingRateView = shadingRate.view;
+        }
+#endif
 
         // Bind and clear eye render target
         static XrColor4f darkSlateGrey = {0.184313729f, 0.309803933f, 0.309803933f, 1.0f};
@@ -1550,87 +3605,409 @@ struct VulkanGraphicsPlugin : public IGraphicsPlugin {
         clearValues[0].color.float32[1] = darkSlateGrey.g;
         clearValues[0].color.float32[2] = darkSlateGrey.b;
         clearValues[0].color.float32[3] = darkSlateGrey.a;
+        if (motionVectors) {
+            clearValues[0].color = {};
+        }
         clearValues[1].depthStencil.depth = 1.0f;
         clearValues[1].depthStencil.stencil = 0;
         VkRenderPassBeginInfo renderPassBeginInfo{VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO};
         renderPassBeginInfo.clearValueCount = (uint32_t)clearValues.size();
         renderPassBeginInfo.pClearValues = clearValues.data();
 
-        swapchainContext->BindRenderTarget(imageIndex, &renderPassBeginInfo);
+        swapchainContext->BindRenderTarget(swapchainImage.imageIndex, depthContext, swapchainImage.depthImageIndex,
+                                           shadingRateView, &renderPassBeginInfo);
 
-        vkCmdBeginRenderPass(m_cmdBuffer.buf, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+        vkCmdBeginRenderPass(cmdBuffer.buf, &renderPassBeginInfo, contents);
+        if (contents == VK_SUBPASS_CONTENTS_INLINE) {
+            BindDrawState(cmdBuffer.buf, *swapchainContext->pipelineState, imageRect);
+        }
+    }
 
-        vkCmdBindPipeline(m_cmdBuffer.buf, VK_PIPELINE_BIND_POINT_GRAPHICS, swapchainContext->pipe.pipe);
+    // Bind the cube pipeline and geometry, with the viewport covering imageRect.
+    void BindDrawState(VkCommandBuffer buf, const PipelineState& pipelineState, const XrRect2Di& imageRect) const {
+        vkCmdBindPipeline(buf, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineState.pipe.pipe);
 
-        // Bind index and vertex buffers
-        vkCmdBindIndexBuffer(m_cmdBuffer.buf, m_drawBuffer.idxBuf, 0, VK_INDEX_TYPE_UINT16);
-        VkDeviceSize offset = 0;
-        vkCmdBindVertexBuffers(m_cmdBuffer.buf, 0, 1, &m_drawBuffer.vtxBuf, &offset);
+        // The rendered area changes with dynamic resolution, so it is not baked into the pipeline
+        const float x = (float)imageRect.offset.x;
+        const float y = (float)imageRect.offset.y;
+        const float width = (float)imageRect.extent.width;
+        const float height = (float)imageRect.extent.height;
+#if defined(ORIGIN_BOTTOM_LEFT)
+        const VkViewport viewport = {x, y + height, width, -height, 0.0f, 1.0f};
+#else
+        const VkViewport viewport = {x, y, width, height, 0.0f, 1.0f};
+#endif
+        vkCmdSetViewport(buf, 0, 1, &viewport);
+        const VkRect2D scissor = {{imageRect.offset.x, imageRect.offset.y},
+                                  {(uint32_t)imageRect.extent.width, (uint32_t)imageRect.extent.height}};
+        vkCmdSetScissor(buf, 0, 1, &scissor);
+    }
 
-        // Compute the view-projection transform.
-        // Note all matrixes (including OpenXR's) are column-major, right-handed.
-        const auto& pose = layerView.pose;
-        XrMatrix4x4f proj;
-        XrMatrix4x4f_CreateProjectionFov(&proj, GRAPHICS_VULKAN, layerView.fov, 0.05f, 100.0f);
-        XrMatrix4x4f toView;
-        XrVector3f scale{1.f, 1.f, 1.f};
-        XrMatrix4x4f_CreateTranslationRotationScale(&toView, &pose.position, &pose.orientation, &scale);
-        XrMatrix4x4f view;
-        XrMatrix4x4f_InvertRigidBody(&view, &toView);
-        XrMatrix4x4f vp;
-        XrMatrix4x4f_Multiply(&vp, &proj, &view);
+    void EndRenderPass(CmdBuffer& cmdBuffer, bool timed = true) {
+        vkCmdEndRenderPass(cmdBuffer.buf);
+        if (m_gpuTimers && timed) {
+            m_timestampQueryRing[m_currentRingSlot]->EndView(cmdBuffer.buf);
+        }
+    }
+
+    // Write the model transforms into the instance buffer owned by the current ring slot. Must be called after
+    // BeginCmdBuffer, once per command buffer; every render pass recorded into it then shares the instances.
+    uint32_t UploadInstances(const std::vector<XrMatrix4x4f>& cubeModels) {
+        return m_instanceBufferRing[m_currentRingSlot]->Update(cubeModels);
+    }
+
+    // Write the view-projection of each view into its entry of the current ring slot's ViewUniforms. With multiview both
+    // views share entry 0.
+    void WriteViewProjections(const std::vector<XrCompositionLayerProjectionView>& layerViews, bool multiview) const {
+        ViewUniforms& uniforms = *m_viewUniformRing[m_currentRingSlot];
+        for (uint32_t view = 0; view < (uint32_t)layerViews.size(); ++view) {
+            if (multiview) {
+                uniforms.Entry(0)[view] = ComputeViewProjection(layerViews[view]);
+            } else {
+                uniforms.Entry(view)[0] = ComputeViewProjection(layerViews[view]);
+            }
+        }
+    }
 
-        // Render each cube
-        for (const Cube& cube : cubes) {
-            // Compute the model-view-projection transform and push it.
-            XrMatrix4x4f model;
-            XrMatrix4x4f_CreateTranslationRotationScale(&model, &cube.Pose.position, &cube.Pose.orientation, &cube.Scale);
-            XrMatrix4x4f mvp;
-            XrMatrix4x4f_Multiply(&mvp, &vp, &model);
-            vkCmdPushConstants(m_cmdBuffer.buf, m_pipelineLayout.layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(mvp.m), &mvp.m[0]);
+    // Give the app a last chance to update the poses before submission, then rewrite what the recorded commands read from
+    // them: the view-projections and the model matrices from the first one the app changed.
+    void LateLatch(const std::vector<XrCompositionLayerProjectionView>& layerViews, const std::vector<XrMatrix4x4f>& cubeModels,
+                   bool multiview) {
+        if (!m_lateLatchCallback) {
+            return;
+        }
+        const size_t firstChangedModel = m_lateLatchCallback();
+        WriteViewProjections(layerViews, multiview);
+        m_instanceBufferRing[m_currentRingSlot]->Rewrite(cubeModels, firstChangedModel);
+    }
+
+    // Record the cubes with the view-projection(s) of a ViewUniforms entry, binding each mesh of meshDraws in turn and
+    // drawing its cubes either as one instanced draw or one draw per cube. Only reads plugin state, so the views of a frame
+    // can be recorded on different threads.
+    void RecordCubes(VkCommandBuffer buf, uint32_t uniformEntry, uint32_t instanceCount,
+                     const std::vector<MeshDraw>& meshDraws) const {
+        if (instanceCount == 0) {
+            return;
+        }
+
+        const ViewUniforms& uniforms = *m_viewUniformRing[m_currentRingSlot];
+        const uint32_t dynamicOffset = uniforms.DynamicOffset(uniformEntry);
+        vkCmdBindDescriptorSets(buf, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelineLayout.layout, 0, 1, &uniforms.set, 1,
+                                &dynamicOffset);
+
+        const VkDeviceSize offset = 0;
+        vkCmdBindVertexBuffers(buf, InstanceBuffer::Binding, 1, &m_instanceBufferRing[m_currentRingSlot]->buf, &offset);
+
+        uint32_t firstInstance = 0;
+        for (const MeshDraw& draw : meshDraws) {
+            const VertexBuffer<Geometry::Vertex>& mesh = m_meshes[draw.Mesh]->geometry;
+            const MeshLod& lod = m_meshes[draw.Mesh]->lods[draw.Lod];
+            vkCmdBindIndexBuffer(buf, mesh.idxBuf, 0, mesh.idxType);
+            vkCmdBindVertexBuffers(buf, 0, 1, &mesh.vtxBuf, &offset);
+
+            if (m_instancing) {
+                vkCmdDrawIndexed(buf, lod.IndexCount, draw.InstanceCount, lod.FirstIndex, 0, firstInstance);
+            } else {
+                // Baseline path: one draw call per cube, picking its model matrix through firstInstance
+                for (uint32_t i = 0; i < draw.InstanceCount; ++i) {
+                    vkCmdDrawIndexed(buf, lod.IndexCount, 1, lod.FirstIndex, 0, firstInstance + i);
+                }
+            }
+            firstInstance += draw.InstanceCount;
+        }
+    }
+
+    // Record one view's cubes into a secondary command buffer that continues the render pass of pipelineState. Runs on a
+    // job system thread.
+    void RecordViewCmdBuffer(VkCommandBuffer buf, const PipelineState& pipelineState,
+                             const XrCompositionLayerProjectionView& layerView, uint32_t view, uint32_t instanceCount,
+                             const std::vector<MeshDraw>& meshDraws) const {
+        // The framebuffer is left out as it is not known yet; it is only a hint.
+        VkCommandBufferInheritanceInfo inheritanceInfo{VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO};
+        inheritanceInfo.renderPass = pipelineState.rp.pass;
+        inheritanceInfo.subpass = 0;
+        VkCommandBufferBeginInfo beginInfo{VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO};
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+        beginInfo.pInheritanceInfo = &inheritanceInfo;
+        CHECK_VKCMD(vkBeginCommandBuffer(buf, &beginInfo));
+
+        BindDrawState(buf, pipelineState, layerView.subImage.imageRect);
+        RecordCubes(buf, view, instanceCount, meshDraws);
+
+        CHECK_VKCMD(vkEndCommandBuffer(buf));
+    }
+
+    // Finish recording and submit. A mirrorView, with the image it was rendered into, goes to the mirror window after the
+    // submission, while the image is still held.
+    void SubmitCmdBuffer(CmdBuffer& cmdBuffer, const XrCompositionLayerProjectionView* mirrorView = nullptr,
+                         const SwapchainImage* mirrorImage = nullptr) {
+        cmdBuffer.End();
+        // No CPU wait here: the ring fence is checked when this command buffer comes around again
+        cmdBuffer.Exec(m_vkQueue);
+
+#if defined(USE_MIRROR_WINDOW)
+        if (mirrorView != nullptr && m_mirrorInterval != 0 && m_mirrorFrameCount++ % m_mirrorInterval == 0) {
+            const SwapchainImageContext& context = *m_swapchainImageContexts[mirrorImage->swapchainIndex];
+            if (context.transferSource) {
+                m_swapchain.Blit(context.swapchainImages[mirrorImage->imageIndex].image, mirrorView->subImage.imageRect,
+                                 mirrorView->subImage.imageArrayIndex);
+            }
+        }
+#else
+        (void)mirrorView;
+        (void)mirrorImage;
+#endif
+    }
+
+    void RenderView(const XrCompositionLayerProjectionView& layerView, const SwapchainImage& swapchainImage,
+                    int64_t /*swapchainFormat*/, const std::vector<XrMatrix4x4f>& cubeModels,
+                    const std::vector<MeshDraw>& meshDraws) final {
+        CHECK(layerView.subImage.imageArrayIndex == 0);  // Texture arrays not supported.
+
+        CmdBuffer& cmdBuffer = BeginCmdBuffer();
+        const uint32_t instanceCount = UploadInstances(cubeModels);
+        m_viewUniformRing[m_currentRingSlot]->Entry(0)[0] = ComputeViewProjection(layerView);
+        BeginRenderPass(cmdBuffer, swapchainImage, layerView.subImage.imageRect);
+        RecordCubes(cmdBuffer.buf, 0, instanceCount, meshDraws);
+        EndRenderPass(cmdBuffer);
+
+        // The first view goes to the mirror window, it is the only one rendered into the first swapchain
+        const bool mirror = swapchainImage.swapchainIndex == 0;
+        SubmitCmdBuffer(cmdBuffer, mirror ? &layerView : nullptr, mirror ? &swapchainImage : nullptr);
+    }
+
+    void RenderViews(const std::vector<XrCompositionLayerProjectionView>& layerViews,
+                     const std::vector<SwapchainImage>& swapchainImages, int64_t /*swapchainFormat*/,
+                     const std::vector<XrMatrix4x4f>& cubeModels, const std::vector<MeshDraw>& meshDraws) final {
+        CHECK(layerViews.size() == swapchainImages.size());
+        CHECK(layerViews.size() <= ViewUniforms::MaxViews);
+
+        // One render pass per view, all in a single command buffer and submission.
+        CmdBuffer& cmdBuffer = BeginCmdBuffer();
+        const uint32_t instanceCount = UploadInstances(cubeModels);
+        WriteViewProjections(layerViews, false);
+        if (m_parallelViews && layerViews.size() > 1) {
+            RenderViewsInParallel(cmdBuffer, layerViews, swapchainImages, instanceCount, meshDraws);
+        } else {
+            for (uint32_t view = 0; view < (uint32_t)layerViews.size(); ++view) {
+                CHECK(layerViews[view].subImage.imageArrayIndex == 0);  // Texture arrays not supported.
+                BeginRenderPass(cmdBuffer, swapchainImages[view], layerViews[view].subImage.imageRect);
+                RecordCubes(cmdBuffer.buf, view, instanceCount, meshDraws);
+                EndRenderPass(cmdBuffer);
+            }
+        }
+        RecordMotionVectors(cmdBuffer, swapchainImages, instanceCount, meshDraws);
+        LateLatch(layerViews, cubeModels, false);
+        SubmitCmdBuffer(cmdBuffer, &layerViews[0], &swapchainImages[0]);
+    }
 
-            // Draw the cube.
-            vkCmdDrawIndexed(m_cmdBuffer.buf, m_drawBuffer.count.idx, 1, 0, 0, 0);
+    // Record the motion vectors of every view that has a motion vector swapchain image, from the view-projections and
+    // instances of the color passes and the previous models given to SetPreviousCubeModels. The view-projection of the
+    // current frame is used for the previous positions too, as the runtime takes the head motion from the view poses.
+    void RecordMotionVectors(CmdBuffer& cmdBuffer, const std::vector<SwapchainImage>& swapchainImages, uint32_t instanceCount,
+                             const std::vector<MeshDraw>& meshDraws) {
+        if (swapchainImages[0].motionVectorSwapchainIndex == NoMotionVectorSwapchain) {
+            return;
+        }
+        CHECK(m_previousCubeModels != nullptr && m_previousCubeModels->size() == instanceCount);
+        InstanceBuffer& previousInstances = *m_previousInstanceBufferRing[m_currentRingSlot];
+        previousInstances.Update(*m_previousCubeModels);
+
+        for (uint32_t view = 0; view < (uint32_t)swapchainImages.size(); ++view) {
+            SwapchainImage motionVectorImage{};
+            motionVectorImage.swapchainIndex = swapchainImages[view].motionVectorSwapchainIndex;
+            motionVectorImage.imageIndex = swapchainImages[view].motionVectorImageIndex;
+            motionVectorImage.depthSwapchainIndex = swapchainImages[view].motionVectorDepthSwapchainIndex;
+            motionVectorImage.depthImageIndex = swapchainImages[view].motionVectorDepthImageIndex;
+            const VkExtent2D size = m_swapchainImageContexts[motionVectorImage.swapchainIndex]->size;
+            BeginRenderPass(cmdBuffer, motionVectorImage, {{0, 0}, {(int32_t)size.width, (int32_t)size.height}});
+            const VkDeviceSize offset = 0;
+            if (instanceCount > 0) {
+                vkCmdBindVertexBuffers(cmdBuffer.buf, InstanceBuffer::PreviousBinding, 1, &previousInstances.buf, &offset);
+            }
+            RecordCubes(cmdBuffer.buf, view, instanceCount, meshDraws);
+            EndRenderPass(cmdBuffer, false);
         }
+    }
 
-        vkCmdEndRenderPass(m_cmdBuffer.buf);
+    // Record the cubes of each view into a secondary command buffer on the job system, then execute them in the view's
+    // render pass. Everything that is not thread-safe, such as creating depth buffers and framebuffers, stays in the
+    // primary command buffer on this thread.
+    void RenderViewsInParallel(CmdBuffer& cmdBuffer, const std::vector<XrCompositionLayerProjectionView>& layerViews,
+                               const std::vector<SwapchainImage>& swapchainImages, uint32_t instanceCount,
+                               const std::vector<MeshDraw>& meshDraws) {
+        const uint32_t viewCount = (uint32_t)layerViews.size();
+        ViewCmdBuffers& viewCmdBuffers = *m_viewCmdBufferRing[m_currentRingSlot];
+        viewCmdBuffers.Reset(viewCount);
+
+        GetJobSystem().ParallelFor(viewCount, [&](uint32_t view) {
+            CHECK(layerViews[view].subImage.imageArrayIndex == 0);  // Texture arrays not supported.
+            const PipelineState& pipelineState = *m_swapchainImageContexts[swapchainImages[view].swapchainIndex]->pipelineState;
+            RecordViewCmdBuffer(viewCmdBuffers.views[view].buf, pipelineState, layerViews[view], view, instanceCount,
+                                meshDraws);
+        });
+
+        for (uint32_t view = 0; view < viewCount; ++view) {
+            BeginRenderPass(cmdBuffer, swapchainImages[view], layerViews[view].subImage.imageRect,
+                            VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+            vkCmdExecuteCommands(cmdBuffer.buf, 1, &viewCmdBuffers.views[view].buf);
+            EndRenderPass(cmdBuffer);
+        }
+    }
 
-        m_cmdBuffer.End();
-        m_cmdBuffer.Exec(m_vkQueue);
-        // XXX Should double-buffer the command buffers, for now just flush
-        m_cmdBuffer.Wait();
+    bool SupportsMultiview() const final { return m_multiviewSupported; }
 
+    // The mirror window is blitted from the first view's swapchain.
+    XrSwapchainUsageFlags GetColorSwapchainUsageFlags() const override {
 #if defined(USE_MIRROR_WINDOW)
-        // Cycle the window's swapchain on the last view rendered
-        if (swapchainContext == &m_swapchainImageContexts.back()) {
-            m_swapchain.Acquire();
-            m_swapchain.Present(m_vkQueue);
+        if (m_mirrorInterval != 0) {
+            return XR_SWAPCHAIN_USAGE_TRANSFER_SRC_BIT;
         }
 #endif
+        return 0;
+    }
+
+    // The view-projections and models live in mapped memory until submission, see LateLatch.
+    bool SetLateLatchCallback(std::function<size_t()> callback) override {
+        m_lateLatchCallback = std::move(callback);
+        return true;
+    }
+
+    bool EnableFoveatedShading(FoveationLevel level) override {
+        if (!m_shadingRateSupported) {
+            return false;
+        }
+        m_foveationLevel = level;
+        return true;
+    }
+
+    void RenderMultiview(const std::vector<XrCompositionLayerProjectionView>& layerViews,
+                         const SwapchainImage& swapchainImage, int64_t /*swapchainFormat*/,
+                         const std::vector<XrMatrix4x4f>& cubeModels, const std::vector<MeshDraw>& meshDraws) final {
+        CHECK(m_multiviewSupported);
+        CHECK(layerViews.size() == 2);  // The multiview shader holds one view-projection per eye.
+
+        SwapchainImageContext* swapchainContext = m_swapchainImageContexts[swapchainImage.swapchainIndex].get();
+        CHECK(swapchainContext->arraySize == layerViews.size());
+
+        CmdBuffer& cmdBuffer = BeginCmdBuffer();
+        const uint32_t instanceCount = UploadInstances(cubeModels);
+        // All views share the same image rect, only the array layer differs.
+        BeginRenderPass(cmdBuffer, swapchainImage, layerViews[0].subImage.imageRect);
+
+        for (size_t view = 0; view < layerViews.size(); ++view) {
+            CHECK(layerViews[view].subImage.imageArrayIndex == view);
+        }
+        WriteViewProjections(layerViews, true);
+
+        // Each cube is drawn once for both views, gl_ViewIndex selects the view-projection
+        RecordCubes(cmdBuffer.buf, 0, instanceCount, meshDraws);
+
+        EndRenderPass(cmdBuffer);
+        LateLatch(layerViews, cubeModels, true);
+        SubmitCmdBuffer(cmdBuffer, &layerViews[0], &swapchainImage);
     }
 
+    bool TakeGpuViewTimes(std::vector<uint64_t>& viewNanoseconds) final { return m_gpuViewTimes.Take(viewNanoseconds); }
+
+    // The swapchains are always rendered single-sampled, samples are only resolved on tile, see EnableOnTileMultisampling.
     uint32_t GetSupportedSwapchainSampleCount(const XrViewConfigurationView&) override { return VK_SAMPLE_COUNT_1_BIT; }
 
+    // The render passes resolve the color samples into the swapchain images, but not depth samples into depth swapchain
+    // images, so with those the swapchains stay single-sampled.
+    uint32_t EnableOnTileMultisampling(uint32_t sampleCount, bool /*multiview*/, bool depthSwapchains) override {
+        m_onTileSamples = VK_SAMPLE_COUNT_1_BIT;
+        if (!depthSwapchains) {
+            for (uint32_t samples = VK_SAMPLE_COUNT_64_BIT; samples > VK_SAMPLE_COUNT_1_BIT; samples /= 2) {
+                if (samples <= sampleCount && (m_attachmentSampleCounts & samples) != 0) {
+                    m_onTileSamples = (VkSampleCountFlagBits)samples;
+                    break;
+                }
+            }
+        }
+        return (uint32_t)m_onTileSamples;
+    }
+
    protected:
     XrGraphicsBindingVulkan2KHR m_graphicsBinding{XR_TYPE_GRAPHICS_BINDING_VULKAN2_KHR};
-    std::list<SwapchainImageContext> m_swapchainImageContexts;
-    std::map<const XrSwapchainImageBaseHeader*, SwapchainImageContext*> m_swapchainImageContextMap;
+    MemoryAllocator m_memAllocator{};  // Declared first so it outlives every resource allocated from it
+    // Indexed by SwapchainImage::swapchainIndex.
+    std::vector<std::unique_ptr<SwapchainImageContext>> m_swapchainImageContexts;
 
     VkInstance m_vkInstance{VK_NULL_HANDLE};
     VkPhysicalDevice m_vkPhysicalDevice{VK_NULL_HANDLE};
     VkDevice m_vkDevice{VK_NULL_HANDLE};
     uint32_t m_queueFamilyIndex = 0;
     VkQueue m_vkQueue{VK_NULL_HANDLE};
+    uint32_t m_transferQueueFamilyIndex = 0;  // Same as m_queueFamilyIndex when there is no transfer-only family
+    VkQueue m_vkTransferQueue{VK_NULL_HANDLE};
     VkSemaphore m_vkDrawDone{VK_NULL_HANDLE};
 
-    MemoryAllocator m_memAllocator{};
+    std::vector<uint32_t> m_vertexSPIRV;  // Set by PrepareResources
+    std::vector<uint32_t> m_multiviewVertexSPIRV;
+    std::vector<uint32_t> m_fragmentSPIRV;
+    std::vector<uint32_t> m_motionVectorVertexSPIRV;
+    std::vector<uint32_t> m_motionVectorFragmentSPIRV;
     ShaderProgram m_shaderProgram{};
-    CmdBuffer m_cmdBuffer{};
+    ShaderProgram m_multiviewShaderProgram{};
+    ShaderProgram m_motionVectorShaderProgram{};
+    bool m_multiviewSupported{false};
+    bool m_shadingRateSupported{false};
+    VkExtent2D m_shadingRateTexelSize{};
+    uint32_t m_maxShadingRateLog2Size{0};
+    FoveationLevel m_foveationLevel{FoveationLevel::Off};                // For pipelines created from now on
+    bool m_allocatingMotionVectors{false};                               // From SetAllocatingMotionVectorSwapchains
+    VkSampleCountFlags m_attachmentSampleCounts{VK_SAMPLE_COUNT_1_BIT};  // Of both color and depth attachments
+    VkSampleCountFlagBits m_onTileSamples{VK_SAMPLE_COUNT_1_BIT};        // For pipelines created from now on
+    bool m_timelineSemaphoreSupported{false};
+    QueueTimeline m_frameTimeline{};  // Signaled by the submissions of m_cmdBufferRing, declared first to outlive them
+    std::vector<std::unique_ptr<CmdBuffer>> m_cmdBufferRing;
+    std::vector<std::unique_ptr<InstanceBuffer>> m_instanceBufferRing;  // Parallel to m_cmdBufferRing
+    std::vector<std::unique_ptr<InstanceBuffer>> m_previousInstanceBufferRing;  // Parallel to m_cmdBufferRing
+    std::vector<std::unique_ptr<TimestampQueries>> m_timestampQueryRing;  // Parallel to m_cmdBufferRing
+    std::vector<std::unique_ptr<ViewCmdBuffers>> m_viewCmdBufferRing;     // Parallel to m_cmdBufferRing
+    std::vector<std::unique_ptr<ViewUniforms>> m_viewUniformRing;         // Parallel to m_cmdBufferRing
+    size_t m_cmdBufferRingIndex{0};
+    size_t m_currentRingSlot{0};  // Slot of the command buffer most recently handed out
+    uint32_t m_cmdBuffersInFlight{0};
+    uint32_t m_maxCmdBuffersInFlight{0};
     PipelineLayout m_pipelineLayout{};
-    VertexBuffer<Geometry::Vertex> m_drawBuffer{};
+    VkDeviceSize m_uniformOffsetAlignment{1};
+    PipelineCache m_pipelineCache{};
+    std::vector<std::unique_ptr<PipelineState>> m_pipelineStates;
+#if defined(VK_KHR_fragment_shading_rate)
+    // By swapchain width and height, the view's tiles and the foveation level
+    std::map<std::tuple<uint32_t, uint32_t, int32_t, int32_t, int32_t, int32_t, FoveationLevel>, std::unique_ptr<ShadingRateImage>>
+        m_shadingRateImages;
+#endif
+    BufferUploader m_geometryUploader{};
+    // GPU copy of a mesh added with AddMesh.
+    struct MeshBuffers {
+        VertexBuffer<Geometry::Vertex> geometry;
+        std::array<MeshLod, MaxMeshLods> lods{};  // Index ranges
+    };
+    std::vector<std::unique_ptr<MeshBuffers>> m_meshes;  // Indexed by mesh ID
+    JobGraph m_startupJobs;  // Cancelled before anything it uses is destroyed
+    JobGraph::JobId m_shaderModulesJob{0};
+    JobGraph::JobId m_pipelineCacheJob{0};
+    JobGraph::JobId m_cubeUploadJob{0};  // Submits the cube's copies
+    const std::string m_cacheDirectory;
+    const bool m_instancing;
+    const bool m_gpuTimersRequested;
+    const bool m_parallelViews;       // Record the views of RenderViews on the job system
+    const uint32_t m_mirrorInterval;  // Frames per mirror window update, 0 without a mirror window
+    std::function<size_t()> m_lateLatchCallback;
+    const std::vector<XrMatrix4x4f>* m_previousCubeModels{nullptr};  // From SetPreviousCubeModels, for motion vectors
+    bool m_gpuTimers{false};
+    float m_timestampPeriod{1.0f};
+    uint64_t m_timestampMask{~0ull};
+    uint64_t m_submissionCount{0};
+    uint64_t m_gpuViewTimesSubmission{0};
+    GpuViewTimes m_gpuViewTimes;
 
 #if defined(USE_MIRROR_WINDOW)
     Swapchain m_swapchain{};
+    uint64_t m_mirrorFrameCount{0};
 #endif
 
     PFN_vkCreateDebugReportCallbackEXT vkCreateDebugReportCallbackEXT{nullptr};
@@ -1775,7 +4152,7 @@ struct VulkanGraphicsPlugin : public IGraphicsPlugin {
 };
 
 // A compatibility class that implements the KHR_vulkan_enable2 functionality on top of KHR_vulkan_enable
-struct VulkanGraphicsPluginLegacy : public VulkanGraphicsPlugin {
+struct VulkanGraphicsPluginLegacy final : public VulkanGraphicsPlugin {
     VulkanGraphicsPluginLegacy(const std::shared_ptr<Options>& options, std::shared_ptr<IPlatformPlugin> platformPlugin)
         : VulkanGraphicsPlugin(options, platformPlugin) {
         m_graphicsBinding.type = GetGraphicsBindingType();
@@ -0,0 +1,96 @@
+// Copyright (c) 2017-2020 The Khronos Group Inc.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include "pch.h"
+#include "common.h"
+#include "inputstate.h"
+
+namespace {
+// Each vibration is submitted this long and renewed once less than VibrationRenewal is left, which covers a few frames at
+// any refresh rate. A new vibration replaces the one playing, so the renewal is seamless.
+constexpr std::chrono::milliseconds VibrationDuration{100};
+constexpr std::chrono::milliseconds VibrationRenewal{40};
+}  // namespace
+
+void InputSampler::Sync(XrSession session) {
+    m_snapshot = {};
+
+    const XrActiveActionSet activeActionSet{m_actions.ActionSet, XR_NULL_PATH};
+    XrActionsSyncInfo syncInfo{XR_TYPE_ACTIONS_SYNC_INFO};
+    syncInfo.countActiveActionSets = 1;
+    syncInfo.activeActionSets = &activeActionSet;
+    const XrResult syncResult = xrSyncActions(session, &syncInfo);
+    ++m_callCounts.RuntimeCalls;
+    CHECK_XRRESULT(syncResult, "xrSyncActions");
+    if (syncResult == XR_SESSION_NOT_FOCUSED) {
+        // Every action is inactive until the session gets focus again.
+        return;
+    }
+
+    for (size_t hand = 0; hand < InputSnapshot::HandCount; ++hand) {
+        XrActionStateGetInfo getInfo{XR_TYPE_ACTION_STATE_GET_INFO};
+        getInfo.action = m_actions.Grab;
+        getInfo.subactionPath = m_actions.HandSubactionPaths[hand];
+        XrActionStateFloat grabValue{XR_TYPE_ACTION_STATE_FLOAT};
+        CHECK_XRCMD(xrGetActionStateFloat(session, &getInfo, &grabValue));
+        m_snapshot.GrabActive[hand] = grabValue.isActive == XR_TRUE;
+        m_snapshot.Grab[hand] = grabValue.currentState;
+
+        getInfo.action = m_actions.Pose;
+        XrActionStatePose poseState{XR_TYPE_ACTION_STATE_POSE};
+        CHECK_XRCMD(xrGetActionStatePose(session, &getInfo, &poseState));
+        m_snapshot.PoseActive[hand] = poseState.isActive == XR_TRUE;
+        m_callCounts.RuntimeCalls += 2;
+    }
+
+    // There were no subaction paths specified for the quit action, because we don't care which hand did it.
+    XrActionStateGetInfo getInfo{XR_TYPE_ACTION_STATE_GET_INFO, nullptr, m_actions.Quit, XR_NULL_PATH};
+    XrActionStateBoolean quitValue{XR_TYPE_ACTION_STATE_BOOLEAN};
+    CHECK_XRCMD(xrGetActionStateBoolean(session, &getInfo, &quitValue));
+    ++m_callCounts.RuntimeCalls;
+    m_snapshot.QuitPressed =
+        quitValue.isActive == XR_TRUE && quitValue.changedSinceLastSync == XR_TRUE && quitValue.currentState == XR_TRUE;
+}
+
+void InputSampler::SetVibration(XrSession session, size_t hand, bool active, float amplitude) {
+    Vibration& vibration = m_vibrations[hand];
+    const auto now = std::chrono::steady_clock::now();
+    if (!active) {
+        if (vibration.Playing && now < vibration.Until) {
+            XrHapticActionInfo hapticActionInfo{XR_TYPE_HAPTIC_ACTION_INFO};
+            hapticActionInfo.action = m_actions.Vibrate;
+            hapticActionInfo.subactionPath = m_actions.HandSubactionPaths[hand];
+            CHECK_XRCMD(xrStopHapticFeedback(session, &hapticActionInfo));
+            ++m_callCounts.RuntimeCalls;
+        }
+        vibration.Playing = false;
+        return;
+    }
+
+    if (vibration.Playing && vibration.Amplitude == amplitude && now + VibrationRenewal < vibration.Until) {
+        ++m_callCounts.SkippedHaptics;
+        return;
+    }
+
+    XrHapticVibration hapticVibration{XR_TYPE_HAPTIC_VIBRATION};
+    hapticVibration.amplitude = amplitude;
+    hapticVibration.duration = std::chrono::duration_cast<std::chrono::nanoseconds>(VibrationDuration).count();
+    hapticVibration.frequency = XR_FREQUENCY_UNSPECIFIED;
+
+    XrHapticActionInfo hapticActionInfo{XR_TYPE_HAPTIC_ACTION_INFO};
+    hapticActionInfo.action = m_actions.Vibrate;
+    hapticActionInfo.subactionPath = m_actions.HandSubactionPaths[hand];
+    CHECK_XRCMD(xrApplyHapticFeedback(session, &hapticActionInfo, reinterpret_cast<XrHapticBaseHeader*>(&hapticVibration)));
+    ++m_callCounts.RuntimeCalls;
+
+    vibration.Playing = true;
+    vibration.Amplitude = amplitude;
+    vibration.Until = now + VibrationDuration;
+}
+
+InputCallCounts InputSampler::TakeCallCounts() {
+    const InputCallCounts callCounts = m_callCounts;
+    m_callCounts = {};
+    return callCounts;
+}
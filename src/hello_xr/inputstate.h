@@ -0,0 +1,64 @@
+// Copyright (c) 2017-2020 The Khronos Group Inc
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include <array>
+
+// Runtime calls the input layer made, for the frame stats. On out-of-process runtimes each one is a round trip.
+struct InputCallCounts {
+    uint32_t RuntimeCalls{0};
+    uint32_t SkippedHaptics{0};  // Vibrations not submitted because an identical one was still playing
+};
+
+// The state of every action, fetched once right after xrSyncActions so the rest of the frame reads it from here.
+struct InputSnapshot {
+    static constexpr size_t HandCount = 2;
+
+    std::array<bool, HandCount> GrabActive{};
+    std::array<float, HandCount> Grab{};  // 0 (open) to 1 (fully squeezed)
+    std::array<bool, HandCount> PoseActive{};
+    bool QuitPressed{false};  // The quit action went down since the previous sync
+};
+
+// Syncs the sample's actions and caches their states. While the session is not focused no action is active, so the
+// individual states are not fetched at all. Vibrations are given a real duration and only resubmitted shortly before they
+// run out, instead of submitting the shortest possible pulse every frame.
+class InputSampler {
+   public:
+    struct Actions {
+        XrActionSet ActionSet{XR_NULL_HANDLE};
+        XrAction Grab{XR_NULL_HANDLE};
+        XrAction Pose{XR_NULL_HANDLE};
+        XrAction Vibrate{XR_NULL_HANDLE};
+        XrAction Quit{XR_NULL_HANDLE};
+        std::array<XrPath, InputSnapshot::HandCount> HandSubactionPaths{};
+    };
+
+    void SetActions(const Actions& actions) { m_actions = actions; }
+
+    // Call xrSyncActions and fetch the state of every action into the snapshot.
+    void Sync(XrSession session);
+
+    const InputSnapshot& Snapshot() const { return m_snapshot; }
+
+    // Keep a hand vibrating at amplitude, or stop it with active false. Only calls the runtime when the vibration starts,
+    // changes, stops or is about to run out.
+    void SetVibration(XrSession session, size_t hand, bool active, float amplitude);
+
+    // Counts since the previous call.
+    InputCallCounts TakeCallCounts();
+
+   private:
+    struct Vibration {
+        bool Playing{false};
+        float Amplitude{0};
+        std::chrono::steady_clock::time_point Until{};
+    };
+
+    Actions m_actions;
+    InputSnapshot m_snapshot;
+    std::array<Vibration, InputSnapshot::HandCount> m_vibrations{};
+    InputCallCounts m_callCounts;
+};
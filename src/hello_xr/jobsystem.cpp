@@ -0,0 +1,309 @@
+// Copyright (c) 2017-2020 The Khronos Group Inc.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include "pch.h"
+#include "common.h"
+#include "jobsystem.h"
+
+namespace {
+// Per-frame jobs are few and short, so more workers than this would mostly sit idle.
+constexpr uint32_t MaxSharedWorkers = 3;
+
+ThreadScheduling g_sharedWorkerScheduling;
+}  // namespace
+
+JobSystem::JobSystem(uint32_t workerCount, const ThreadScheduling& workerScheduling) : m_workerScheduling(workerScheduling) {
+    m_workers.reserve(workerCount);
+    for (uint32_t i = 0; i < workerCount; ++i) {
+        m_workers.emplace_back(&JobSystem::WorkerLoop, this, i);
+    }
+}
+
+JobSystem::~JobSystem() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_workAvailable.notify_all();
+    for (std::thread& worker : m_workers) {
+        worker.join();
+    }
+}
+
+void JobSystem::Run(uint32_t count, JobFunction function, const void* context) {
+    if (count == 0) {
+        return;
+    }
+    if (m_workers.empty() || count == 1) {
+        for (uint32_t i = 0; i < count; ++i) {
+            function(context, i);
+        }
+        return;
+    }
+
+    std::lock_guard<std::mutex> dispatchLock(m_dispatchLock);
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_function = function;
+    m_context = context;
+    m_count = count;
+    m_next = 0;
+    m_remaining = count;
+    m_workAvailable.notify_all();
+
+    while (m_next < m_count) {
+        RunNext(lock);
+    }
+    m_workDone.wait(lock, [this] { return m_remaining == 0; });
+
+    m_function = nullptr;
+    m_context = nullptr;
+    m_count = 0;
+    m_next = 0;
+    if (m_exception) {
+        std::exception_ptr exception;
+        std::swap(exception, m_exception);
+        std::rethrow_exception(exception);
+    }
+}
+
+// Take the next job of the current batch and run it with the lock released. The lock is held on entry and on return.
+void JobSystem::RunNext(std::unique_lock<std::mutex>& lock) {
+    const uint32_t index = m_next++;
+    const JobFunction function = m_function;
+    const void* const context = m_context;
+    lock.unlock();
+
+    std::exception_ptr exception;
+    try {
+        function(context, index);
+    } catch (...) {
+        exception = std::current_exception();
+    }
+
+    lock.lock();
+    if (exception && !m_exception) {
+        m_exception = exception;
+    }
+    if (--m_remaining == 0) {
+        m_workDone.notify_one();
+    }
+}
+
+void JobSystem::WorkerLoop(uint32_t worker) {
+    ApplyThreadScheduling(Fmt("Job worker %u", worker).c_str(), m_workerScheduling);
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (;;) {
+        JobGraph* graph = nullptr;
+        size_t index = 0;
+        m_workAvailable.wait(lock, [&] { return m_stop || m_next < m_count || (graph = FindGraphJob(&index)) != nullptr; });
+        if (m_stop) {
+            return;
+        }
+        if (m_next < m_count) {
+            RunNext(lock);
+        } else {
+            graph->RunJob(lock, index);
+        }
+    }
+}
+
+JobGraph* JobSystem::FindGraphJob(size_t* index) const {
+    for (JobGraph* graph : m_graphs) {
+        if (graph->m_exception) {
+            continue;
+        }
+        for (size_t i = 0; i < graph->m_jobs.size(); ++i) {
+            const JobGraph::Job& job = graph->m_jobs[i];
+            if (job.thread == JobGraph::Thread::Any && graph->IsReady(job)) {
+                *index = i;
+                return graph;
+            }
+        }
+    }
+    return nullptr;
+}
+
+JobSystem& GetJobSystem() {
+    static JobSystem jobSystem([] {
+        const uint32_t hardwareThreads = std::thread::hardware_concurrency();
+        const uint32_t workers = hardwareThreads > 1 ? hardwareThreads - 1 : 0;
+        return workers < MaxSharedWorkers ? workers : MaxSharedWorkers;
+    }(), g_sharedWorkerScheduling);
+    return jobSystem;
+}
+
+void SetJobSystemScheduling(const ThreadScheduling& workerScheduling) { g_sharedWorkerScheduling = workerScheduling; }
+
+JobGraph::JobGraph(JobSystem& jobSystem) : m_jobSystem(jobSystem) {
+    std::lock_guard<std::mutex> lock(m_jobSystem.m_mutex);
+    m_jobSystem.m_graphs.push_back(this);
+}
+
+JobGraph::~JobGraph() {
+    Cancel();
+    std::lock_guard<std::mutex> lock(m_jobSystem.m_mutex);
+    std::vector<JobGraph*>& graphs = m_jobSystem.m_graphs;
+    graphs.erase(std::find(graphs.begin(), graphs.end(), this));
+}
+
+void JobGraph::Cancel() {
+    std::unique_lock<std::mutex> lock(m_jobSystem.m_mutex);
+    DropPendingJobs();
+    m_jobSystem.m_graphJobDone.wait(lock, [this] { return m_running == 0; });
+    m_exception = nullptr;
+    ResetIfFinished();
+}
+
+JobGraph::JobId JobGraph::Add(std::function<void()> job, const std::vector<JobId>& dependencies, Thread thread) {
+    JobId id;
+    {
+        std::lock_guard<std::mutex> lock(m_jobSystem.m_mutex);
+        id = m_firstJob + (JobId)m_jobs.size();
+        for (JobId dependency : dependencies) {
+            CHECK_MSG(dependency < id, "A job can only depend on jobs added before it");
+        }
+        m_jobs.push_back(Job{std::move(job), dependencies, thread});
+        m_settled = false;
+    }
+    m_jobSystem.m_workAvailable.notify_all();
+    m_jobSystem.m_graphJobDone.notify_all();
+    return id;
+}
+
+void JobGraph::Wait() {
+    if (!m_settled.load(std::memory_order_acquire)) {
+        Wait(0, true);
+    }
+}
+
+void JobGraph::Wait(JobId job) {
+    if (!m_settled.load(std::memory_order_acquire)) {
+        Wait(job, false);
+    }
+}
+
+bool JobGraph::IsFinished(JobId job) const { return job < m_firstJob || m_jobs[job - m_firstJob].state == State::Finished; }
+
+bool JobGraph::IsReady(const Job& job) const {
+    if (job.state != State::Pending) {
+        return false;
+    }
+    for (JobId dependency : job.dependencies) {
+        if (!IsFinished(dependency)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+size_t JobGraph::FindWaitingThreadJob(JobId target, bool all) const {
+    // Dependencies always come before the job, so one pass from the target back marks everything it needs.
+    std::vector<bool> needed;
+    if (!all) {
+        needed.assign(target - m_firstJob + 1, false);
+        needed.back() = true;
+        for (size_t i = needed.size(); i-- > 0;) {
+            if (needed[i]) {
+                for (JobId dependency : m_jobs[i].dependencies) {
+                    if (dependency >= m_firstJob) {
+                        needed[dependency - m_firstJob] = true;
+                    }
+                }
+            }
+        }
+    }
+
+    // Jobs only this thread can run come first, the workers may still take the others.
+    size_t anyThreadJob = m_jobs.size();
+    const size_t count = all ? m_jobs.size() : needed.size();
+    for (size_t i = 0; i < count; ++i) {
+        if ((all || needed[i]) && IsReady(m_jobs[i])) {
+            if (m_jobs[i].thread == Thread::Waiting) {
+                return i;
+            }
+            anyThreadJob = std::min(anyThreadJob, i);
+        }
+    }
+    return anyThreadJob;
+}
+
+void JobGraph::RunJob(std::unique_lock<std::mutex>& lock, size_t index) {
+    m_jobs[index].state = State::Running;
+    const std::function<void()> function = std::move(m_jobs[index].function);
+    ++m_running;
+    lock.unlock();
+
+    std::exception_ptr exception;
+    try {
+        function();
+    } catch (...) {
+        exception = std::current_exception();
+    }
+
+    lock.lock();
+    m_jobs[index].state = State::Finished;
+    --m_running;
+    if (exception && !m_exception) {
+        m_exception = exception;
+    }
+    m_jobSystem.m_workAvailable.notify_all();
+    m_jobSystem.m_graphJobDone.notify_all();
+}
+
+void JobGraph::Wait(JobId target, bool all) {
+    std::unique_lock<std::mutex> lock(m_jobSystem.m_mutex);
+    if (!all) {
+        CHECK_MSG(target < m_firstJob + (JobId)m_jobs.size(), "Waiting for a job that was never added");
+    }
+    for (;;) {
+        if (m_exception) {
+            if (m_running == 0) {
+                break;
+            }
+        } else if (all || !IsFinished(target)) {
+            const size_t index = FindWaitingThreadJob(target, all);
+            if (index < m_jobs.size()) {
+                RunJob(lock, index);
+                continue;
+            }
+            if (all && m_running == 0) {
+                break;
+            }
+        } else {
+            break;
+        }
+        m_jobSystem.m_graphJobDone.wait(lock);
+    }
+
+    std::exception_ptr exception;
+    std::swap(exception, m_exception);
+    if (exception) {
+        DropPendingJobs();
+    }
+    ResetIfFinished();
+    if (exception) {
+        std::rethrow_exception(exception);
+    }
+}
+
+void JobGraph::DropPendingJobs() {
+    for (Job& job : m_jobs) {
+        if (job.state == State::Pending) {
+            job.state = State::Finished;
+            job.function = nullptr;
+        }
+    }
+}
+
+// Once every job has finished, their storage is reused. Their ids stay finished.
+void JobGraph::ResetIfFinished() {
+    const bool allFinished =
+        std::all_of(m_jobs.begin(), m_jobs.end(), [](const Job& job) { return job.state == State::Finished; });
+    if (allFinished && !m_exception) {
+        m_firstJob += (JobId)m_jobs.size();
+        m_jobs.clear();
+        m_settled.store(true, std::memory_order_release);
+    }
+}
@@ -0,0 +1,132 @@
+// Copyright (c) 2017-2020 The Khronos Group Inc
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+
+#include "threadscheduling.h"
+
+class JobGraph;
+
+// A fixed set of worker threads for splitting per-frame CPU work, such as recording the commands of each view, into
+// independent jobs. The calling thread takes jobs too, so with no workers everything simply runs inline.
+class JobSystem {
+    friend class JobGraph;
+
+   public:
+    // Every worker applies workerScheduling before it takes its first job.
+    explicit JobSystem(uint32_t workerCount, const ThreadScheduling& workerScheduling = {});
+    ~JobSystem();
+
+    JobSystem(const JobSystem&) = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
+
+    uint32_t WorkerCount() const { return (uint32_t)m_workers.size(); }
+
+    // Call job(i) for every i in [0, count) on the workers and the calling thread, and return once all calls have finished.
+    // If any call throws, the first exception is rethrown here after the others are done. Does not allocate, unless a job
+    // throws. Calls from several threads are run one batch after the other.
+    template <typename Job>
+    void ParallelFor(uint32_t count, const Job& job) {
+        Run(count, [](const void* context, uint32_t index) { (*static_cast<const Job*>(context))(index); }, &job);
+    }
+
+   private:
+    using JobFunction = void (*)(const void* context, uint32_t index);
+
+    void Run(uint32_t count, JobFunction function, const void* context);
+    void RunNext(std::unique_lock<std::mutex>& lock);
+    void WorkerLoop(uint32_t worker);
+    // A graph job a worker may take next, or null, with its index in *index. Call with m_mutex held.
+    JobGraph* FindGraphJob(size_t* index) const;
+
+    std::vector<JobGraph*> m_graphs;  // Graphs alive on this job system, guarded by m_mutex
+    std::condition_variable m_graphJobDone;
+
+    std::vector<std::thread> m_workers;
+    ThreadScheduling m_workerScheduling;
+    std::mutex m_dispatchLock;  // Held by the thread whose batch is running
+
+    // The current batch, guarded by m_mutex.
+    std::mutex m_mutex;
+    std::condition_variable m_workAvailable;
+    std::condition_variable m_workDone;
+    JobFunction m_function{nullptr};
+    const void* m_context{nullptr};
+    uint32_t m_count{0};
+    uint32_t m_next{0};       // Index of the next job nobody has taken yet
+    uint32_t m_remaining{0};  // Jobs not finished yet
+    std::exception_ptr m_exception;
+    bool m_stop{false};
+};
+
+// The job system shared by everything in the process, with a worker for every hardware thread past the first, up to a
+// few. Created on first use.
+JobSystem& GetJobSystem();
+
+// Scheduling of the workers of the shared job system. Only takes effect before the first GetJobSystem call.
+void SetJobSystemScheduling(const ThreadScheduling& workerScheduling);
+
+// Jobs that depend on jobs added before them, for work such as startup that is a few long steps rather than a batch of short
+// ones. A job starts on a worker of the job system as soon as its dependencies have finished, while the thread that added it
+// carries on, and Wait runs whatever the workers have not taken yet. Workers take per-frame batches first. Jobs added for
+// the waiting thread only run in Wait, for work that needs that thread, such as one with a GL context current. A job may use
+// ParallelFor, but must not wait for a graph.
+class JobGraph {
+    friend class JobSystem;
+
+   public:
+    using JobId = uint32_t;
+    enum class Thread { Any, Waiting };
+
+    explicit JobGraph(JobSystem& jobSystem = GetJobSystem());
+    ~JobGraph();
+
+    JobGraph(const JobGraph&) = delete;
+    JobGraph& operator=(const JobGraph&) = delete;
+
+    JobId Add(std::function<void()> job, const std::vector<JobId>& dependencies = {}, Thread thread = Thread::Any);
+
+    // Run jobs on the calling thread until every job has finished, or only the given job and what it depends on. Once a job
+    // throws, jobs that have not started are dropped and the first exception is rethrown here. Cheap when there is nothing
+    // left to wait for.
+    void Wait();
+    void Wait(JobId job);
+
+    // Drop the jobs that have not started and wait for the running ones, discarding any exception. For teardown, when the
+    // jobs' results are no longer wanted but what they use is about to be destroyed.
+    void Cancel();
+
+   private:
+    enum class State { Pending, Running, Finished };
+    struct Job {
+        std::function<void()> function;
+        std::vector<JobId> dependencies;
+        Thread thread;
+        State state{State::Pending};
+    };
+
+    // All of these are called with the job system's m_mutex held.
+    bool IsFinished(JobId job) const;
+    bool IsReady(const Job& job) const;
+    // Index of a job the waiting thread may run next towards the target, or m_jobs.size().
+    size_t FindWaitingThreadJob(JobId target, bool all) const;
+    // Run the job at index with the lock released. The lock is held on entry and on return.
+    void RunJob(std::unique_lock<std::mutex>& lock, size_t index);
+    void Wait(JobId target, bool all);
+    void DropPendingJobs();
+    void ResetIfFinished();
+
+    JobSystem& m_jobSystem;
+
+    // Guarded by the job system's m_mutex. Jobs are stored from m_firstJob on; older ones have all finished.
+    std::vector<Job> m_jobs;
+    JobId m_firstJob{0};
+    uint32_t m_running{0};
+    std::exception_ptr m_exception;
+    std::atomic<bool> m_settled{true};  // Nothing left to run or rethrow
+};
@@ -5,7 +5,9 @@
 #include "pch.h"
 #include "logger.h"
 
-#include <sstream>
+#include <array>
+#include <atomic>
+#include <condition_variable>
 
 #if defined(ANDROID)
 #define ALOGE(...) __android_log_print(ANDROID_LOG_ERROR, "hello_xr", __VA_ARGS__)
@@ -13,20 +15,16 @@
 #endif
 
 namespace {
-Log::Level g_minSeverity{Log::Level::Info};
-std::mutex g_logLock;
-}  // namespace
+std::atomic<Log::Level> g_minSeverity{Log::Level::Info};
 
-namespace Log {
-void SetLevel(Level minSeverity) { g_minSeverity = minSeverity; }
+// Serializes messages output directly instead of by the logger thread, and the logger thread's last drain at shutdown.
+std::mutex g_directLock;
 
-void Write(Level severity, const std::string& msg) {
-    if (severity < g_minSeverity) {
-        return;
-    }
+constexpr const char* SeverityNames[] = {"Verbose", "Info   ", "Warning", "Error  "};
 
-    const auto now = std::chrono::system_clock::now();
-    const time_t now_time = std::chrono::system_clock::to_time_t(now);
+// Format and output one message. Only called by one thread at a time.
+void Output(Log::Level severity, std::chrono::system_clock::time_point time, const std::string& msg) {
+    const time_t now_time = std::chrono::system_clock::to_time_t(time);
     tm now_tm;
 #ifdef _WIN32
     localtime_s(&now_tm, &now_time);
@@ -34,28 +32,234 @@ void Write(Level severity, const std::string& msg) {
     localtime_r(&now_time, &now_tm);
 #endif
     // time_t only has second precision. Use the rounding error to get sub-second precision.
-    const auto secondRemainder = now - std::chrono::system_clock::from_time_t(now_time);
+    const auto secondRemainder = time - std::chrono::system_clock::from_time_t(now_time);
     const int64_t milliseconds = std::chrono::duration_cast<std::chrono::milliseconds>(secondRemainder).count();
 
-    static std::map<Level, const char*> severityName = {
-        {Level::Verbose, "Verbose"}, {Level::Info, "Info   "}, {Level::Warning, "Warning"}, {Level::Error, "Error  "}};
-
-    std::ostringstream out;
-    out.fill('0');
-    out << "[" << std::setw(2) << now_tm.tm_hour << ":" << std::setw(2) << now_tm.tm_min << ":" << std::setw(2) << now_tm.tm_sec
-        << "." << std::setw(3) << milliseconds << "]"
-        << "[" << severityName[severity] << "] " << msg << std::endl;
+    char prefix[32];
+    snprintf(prefix, sizeof(prefix), "[%02d:%02d:%02d.%03d][%s] ", now_tm.tm_hour, now_tm.tm_min, now_tm.tm_sec,
+             (int)milliseconds, SeverityNames[static_cast<int>(severity)]);
 
-    std::lock_guard<std::mutex> lock(g_logLock);  // Ensure output is serialized
-    ((severity == Level::Error) ? std::clog : std::cout) << out.str();
+    std::ostream& out = (severity == Log::Level::Error) ? std::clog : std::cout;
+    out << prefix << msg << std::endl;
 #if defined(_WIN32)
-    OutputDebugStringA(out.str().c_str());
+    OutputDebugStringA((prefix + msg + "\n").c_str());
 #endif
 #if defined(ANDROID)
-    if (severity == Level::Error)
-        ALOGE("%s", out.str().c_str());
+    if (severity == Log::Level::Error)
+        ALOGE("%s%s", prefix, msg.c_str());
     else
-        ALOGV("%s", out.str().c_str());
+        ALOGV("%s%s", prefix, msg.c_str());
 #endif
 }
+
+// Bounded multi-producer, single-consumer ring of messages (after Dmitry Vyukov's bounded MPMC queue). Each slot's sequence
+// number says whether it is free for the producer claiming that position or holds a message for the consumer. Producers
+// never wait; a message that finds the ring full is counted and dropped. Slot strings keep their capacity, so once they
+// have grown to the usual message length queueing does not allocate. Once Stop is called the ring takes no more messages;
+// the logger thread outputs those already queued and exits.
+class AsyncLog {
+   public:
+    AsyncLog() : m_steadyEpoch(std::chrono::steady_clock::now()), m_systemEpoch(std::chrono::system_clock::now()) {
+        for (size_t i = 0; i < Capacity; ++i) {
+            m_slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+        m_thread = std::thread([this]() { Run(); });
+    }
+
+    ~AsyncLog() { Stop(); }
+
+    AsyncLog(const AsyncLog&) = delete;
+    AsyncLog& operator=(const AsyncLog&) = delete;
+
+    // Returns false without queueing the message once Stop was called, for the caller to output it directly.
+    bool Push(Log::Level severity, const std::string& msg) {
+        // Counted before checking m_accepting, so Stop either sees this producer or this producer sees it stopping.
+        m_producers.fetch_add(1);
+        if (!m_accepting.load()) {
+            m_producers.fetch_sub(1);
+            return false;
+        }
+
+        // The steady clock is cheap to read; the consumer turns it into wall-clock time.
+        const auto time = std::chrono::steady_clock::now();
+
+        uint64_t position = m_head.load(std::memory_order_relaxed);
+        Slot* slot;
+        for (;;) {
+            slot = &m_slots[position % Capacity];
+            const uint64_t sequence = slot->sequence.load(std::memory_order_acquire);
+            if (sequence == position) {
+                if (m_head.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (sequence < position) {
+                m_dropped.fetch_add(1, std::memory_order_relaxed);  // Full; the consumer has not freed this slot yet
+                m_producers.fetch_sub(1, std::memory_order_release);
+                return true;
+            } else {
+                position = m_head.load(std::memory_order_relaxed);
+            }
+        }
+
+        slot->severity = severity;
+        slot->time = time;
+        slot->message.assign(msg);
+        slot->sequence.store(position + 1, std::memory_order_release);
+        m_producers.fetch_sub(1, std::memory_order_release);
+
+        if (m_consumerWaiting.load(std::memory_order_acquire)) {
+            m_wake.notify_one();
+        }
+        return true;
+    }
+
+    // Stop taking messages, and return once the logger thread has output everything queued and exited.
+    void Stop() {
+        {
+            std::lock_guard<std::mutex> lock(m_wakeLock);
+            m_accepting.store(false);
+            m_stop = true;
+        }
+        m_wake.notify_one();
+        if (m_thread.joinable()) {
+            m_thread.join();
+        }
+    }
+
+    // Wait until the consumer has output everything queued before the call.
+    void Flush() {
+        const uint64_t head = m_head.load(std::memory_order_acquire);
+        std::unique_lock<std::mutex> lock(m_wakeLock);
+        m_wake.notify_one();
+        m_flushed.wait(lock, [&]() { return m_tail.load(std::memory_order_acquire) >= head || m_stop; });
+    }
+
+   private:
+    static constexpr size_t Capacity = 1024;
+
+    struct Slot {
+        std::atomic<uint64_t> sequence{0};
+        Log::Level severity{Log::Level::Info};
+        std::chrono::steady_clock::time_point time;
+        std::string message;
+    };
+
+    void Run() {
+        for (;;) {
+            {
+                // Once stopping, rejected messages are output directly on their own threads.
+                std::lock_guard<std::mutex> directLock(g_directLock);
+                while (Pop()) {
+                }
+
+                const uint64_t dropped = m_dropped.exchange(0, std::memory_order_relaxed);
+                if (dropped > 0) {
+                    Output(Log::Level::Warning, std::chrono::system_clock::now(),
+                           "Log ring full, " + std::to_string(dropped) + " messages dropped");
+                }
+            }
+
+            std::unique_lock<std::mutex> lock(m_wakeLock);
+            m_flushed.notify_all();
+            if (m_tail.load(std::memory_order_relaxed) != m_head.load(std::memory_order_acquire)) {
+                continue;  // More arrived, or a producer is still copying its message
+            }
+            if (m_stop) {
+                if (m_producers.load() != 0) {
+                    // A producer that got in before m_accepting was cleared has yet to claim its slot.
+                    lock.unlock();
+                    std::this_thread::yield();
+                    continue;
+                }
+                return;
+            }
+            // A producer that misses the flag is picked up by the timeout.
+            m_consumerWaiting.store(true, std::memory_order_release);
+            m_wake.wait_for(lock, std::chrono::milliseconds(10));
+            m_consumerWaiting.store(false, std::memory_order_relaxed);
+        }
+    }
+
+    bool Pop() {
+        const uint64_t position = m_tail.load(std::memory_order_relaxed);
+        Slot& slot = m_slots[position % Capacity];
+        if (slot.sequence.load(std::memory_order_acquire) != position + 1) {
+            return false;  // Empty, or the producer of this slot is still copying its message
+        }
+
+        const auto time =
+            m_systemEpoch + std::chrono::duration_cast<std::chrono::system_clock::duration>(slot.time - m_steadyEpoch);
+        Output(slot.severity, time, slot.message);
+
+        slot.sequence.store(position + Capacity, std::memory_order_release);
+        m_tail.store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+    const std::chrono::steady_clock::time_point m_steadyEpoch;
+    const std::chrono::system_clock::time_point m_systemEpoch;
+    std::array<Slot, Capacity> m_slots;
+    std::atomic<uint64_t> m_head{0};  // Next position for a producer to claim
+    std::atomic<uint64_t> m_tail{0};  // Next position for the consumer to output
+    std::atomic<uint64_t> m_dropped{0};
+    std::atomic<bool> m_consumerWaiting{false};
+    std::atomic<bool> m_accepting{true};
+    std::atomic<uint32_t> m_producers{0};  // Producers between checking m_accepting and publishing their message
+
+    std::mutex m_wakeLock;
+    std::condition_variable m_wake;
+    std::condition_variable m_flushed;
+    bool m_stop{false};
+    std::thread m_thread;
+};
+
+// Messages written while static objects are destroyed, once the logger thread has drained the ring and stopped, are output
+// directly.
+std::atomic<bool> g_asyncLogAlive{false};
+
+class AsyncLogHolder {
+   public:
+    AsyncLogHolder() { g_asyncLogAlive.store(true); }
+    ~AsyncLogHolder() {
+        Log.Stop();
+        g_asyncLogAlive.store(false);
+    }
+    AsyncLog Log;
+};
+
+AsyncLog* GetAsyncLog() {
+    static AsyncLogHolder holder;
+    return g_asyncLogAlive.load() ? &holder.Log : nullptr;
+}
+}  // namespace
+
+namespace Log {
+void SetLevel(Level minSeverity) { g_minSeverity.store(minSeverity, std::memory_order_relaxed); }
+
+bool IsEnabled(Level severity) {
+    return static_cast<int>(severity) >= HELLO_XR_LOG_MIN_LEVEL && severity >= g_minSeverity.load(std::memory_order_relaxed);
+}
+
+void Write(Level severity, const std::string& msg) {
+    if (!IsEnabled(severity)) {
+        return;
+    }
+
+    AsyncLog* const asyncLog = GetAsyncLog();
+    if (asyncLog == nullptr || !asyncLog->Push(severity, msg)) {
+        std::lock_guard<std::mutex> lock(g_directLock);
+        Output(severity, std::chrono::system_clock::now(), msg);
+        return;
+    }
+
+    if (severity == Level::Error) {
+        asyncLog->Flush();
+    }
+}
+
+void Flush() {
+    if (AsyncLog* const asyncLog = GetAsyncLog()) {
+        asyncLog->Flush();
+    }
+}
 }  // namespace Log
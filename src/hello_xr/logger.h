@@ -4,9 +4,33 @@
 
 #pragma once
 
+// Messages are queued with a timestamp and written by a logger thread, so writing one only copies it into a ring buffer.
+// Errors are the exception: Write returns once every message up to and including the error has been written, since an
+// error is usually followed by the program exiting.
 namespace Log {
 enum class Level { Verbose, Info, Warning, Error };
 
 void SetLevel(Level minSeverity);
+// Whether messages of this severity are written. Lets callers skip formatting messages that would be dropped.
+bool IsEnabled(Level severity);
 void Write(Level severity, const std::string& msg);
+// Wait until every message written so far has been output.
+void Flush();
 }  // namespace Log
+
+// Least severe level compiled in: 0 keeps every level, 1 removes Verbose messages written through LOG_VERBOSE (and drops
+// any others at runtime), and so on.
+#if !defined(HELLO_XR_LOG_MIN_LEVEL)
+#define HELLO_XR_LOG_MIN_LEVEL 0
+#endif
+
+// Write a message only if its severity is enabled, without evaluating msg otherwise. Messages below HELLO_XR_LOG_MIN_LEVEL
+// are removed by the compiler.
+#define LOG_WRITE(severity, msg)                                                                         \
+    do {                                                                                                 \
+        if (static_cast<int>(severity) >= HELLO_XR_LOG_MIN_LEVEL && ::Log::IsEnabled(severity)) {       \
+            ::Log::Write(severity, msg);                                                                 \
+        }                                                                                                \
+    } while (false)
+
+#define LOG_VERBOSE(msg) LOG_WRITE(::Log::Level::Verbose, msg)
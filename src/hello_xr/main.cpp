@@ -9,11 +9,79 @@
 #include "platformplugin.h"
 #include "graphicsplugin.h"
 #include "openxr_program.h"
+#include "cachefile.h"
+#include "startup.h"
+#include "threadscheduling.h"
+#include "jobsystem.h"
+#include "trace.h"
+#include <cstdlib>
 
 namespace {
 
+// Parse a non-negative count given for the named option.
+uint32_t ParseCount(const std::string& name, const std::string& value) {
+    char* end = nullptr;
+    const unsigned long count = strtoul(value.c_str(), &end, 10);
+    if (value.empty() || *end != '\0' || value[0] == '-' || (uint32_t)count != count) {
+        throw std::invalid_argument(Fmt("Invalid count '%s' for %s", value.c_str(), name.c_str()));
+    }
+    return (uint32_t)count;
+}
+
+// Parse the cores given for the named option: "big" for the fastest cores, or a mask of up to 31 cores such as 0xf0.
+int ParseCores(const std::string& name, const std::string& value) {
+    if (EqualsIgnoreCase(value, "big")) {
+        return BigCores;
+    }
+    char* end = nullptr;
+    const unsigned long mask = strtoul(value.c_str(), &end, 0);
+    if (value.empty() || *end != '\0' || value[0] == '-' || mask == 0 || mask > (unsigned long)INT32_MAX) {
+        throw std::invalid_argument(Fmt("Invalid cores '%s' for %s", value.c_str(), name.c_str()));
+    }
+    return (int)mask;
+}
+
+// Parse a SCHED_FIFO priority given for the named option.
+uint32_t ParsePriority(const std::string& name, const std::string& value) {
+    const uint32_t priority = ParseCount(name, value);
+    if (priority > 99) {
+        throw std::invalid_argument(Fmt("Invalid real-time priority '%s' for %s", value.c_str(), name.c_str()));
+    }
+    return priority;
+}
+
+// Schedule the calling thread, which renders, and the job system's workers as the options say.
+void ApplyRenderThreadScheduling(const Options& options) {
+    SetJobSystemScheduling({options.WorkerCores, 0});
+    ApplyThreadScheduling("Render", {options.RenderCores, options.RealTimePriority});
+}
+
 #ifdef XR_USE_PLATFORM_ANDROID
-void ShowHelp() { Log::Write(Log::Level::Info, "adb shell setprop debug.xr.graphicsPlugin OpenGLES|Vulkan"); }
+void ShowHelp() {
+    Log::Write(Log::Level::Info, "adb shell setprop debug.xr.graphicsPlugin OpenGLES|Vulkan");
+    Log::Write(Log::Level::Info, "adb shell setprop debug.xr.singlePassStereo true|false");
+    Log::Write(Log::Level::Info, "adb shell setprop debug.xr.depthLayer true|false");
+    Log::Write(Log::Level::Info, "adb shell setprop debug.xr.spaceWarp true|false");
+    Log::Write(Log::Level::Info, "adb shell setprop debug.xr.foveation Off|Low|Medium|High");
+    Log::Write(Log::Level::Info, "adb shell setprop debug.xr.swapchainPolicy Default|Quality|Balanced|Bandwidth");
+    Log::Write(Log::Level::Info, "adb shell setprop debug.xr.dynamicResolution true|false");
+    Log::Write(Log::Level::Info, "adb shell setprop debug.xr.instancing true|false");
+    Log::Write(Log::Level::Info, "adb shell setprop debug.xr.cubeBenchmark true|false");
+    Log::Write(Log::Level::Info, "adb shell setprop debug.xr.pipelinedFrames true|false");
+    Log::Write(Log::Level::Info, "adb shell setprop debug.xr.frameStats true|false");
+    Log::Write(Log::Level::Info, "adb shell setprop debug.xr.frameStatsCsv <file>");
+    Log::Write(Log::Level::Info, "adb shell setprop debug.xr.cubes <count>");
+    Log::Write(Log::Level::Info, "adb shell setprop debug.xr.frames <count>");
+    Log::Write(Log::Level::Info, "adb shell setprop debug.xr.warmup <count>");
+    Log::Write(Log::Level::Info, "adb shell setprop debug.xr.frustumCulling true|false");
+    Log::Write(Log::Level::Info, "adb shell setprop debug.xr.parallelViews true|false");
+    Log::Write(Log::Level::Info, "adb shell setprop debug.xr.lateLatch true|false");
+    Log::Write(Log::Level::Info, "adb shell setprop debug.xr.cache true|false");
+    Log::Write(Log::Level::Info, "adb shell setprop debug.xr.renderCores big|<mask>");
+    Log::Write(Log::Level::Info, "adb shell setprop debug.xr.workerCores big|<mask>");
+    Log::Write(Log::Level::Info, "adb shell setprop debug.xr.realTimePriority <priority>");
+    Log::Write(Log::Level::Info, "adb shell setprop debug.xr.trace <file>");
+}
 
 bool UpdateOptionsFromSystemProperties(Options& options) {
     char value[PROP_VALUE_MAX] = {};
@@ -21,6 +89,102 @@ bool UpdateOptionsFromSystemProperties(Options& options) {
         options.GraphicsPlugin = value;
     }
 
+    if (__system_property_get("debug.xr.singlePassStereo", value) != 0) {
+        options.SinglePassStereo = (strcmp(value, "1") == 0) || EqualsIgnoreCase(value, "true");
+    }
+
+    if (__system_property_get("debug.xr.depthLayer", value) != 0) {
+        options.DepthLayer = (strcmp(value, "1") == 0) || EqualsIgnoreCase(value, "true");
+    }
+
+    if (__system_property_get("debug.xr.spaceWarp", value) != 0) {
+        options.SpaceWarp = (strcmp(value, "1") == 0) || EqualsIgnoreCase(value, "true");
+    }
+
+    if (__system_property_get("debug.xr.foveation", value) != 0 && value[0] != '\0') {
+        options.Foveation = value;
+    }
+
+    if (__system_property_get("debug.xr.swapchainPolicy", value) != 0 && value[0] != '\0') {
+        options.SwapchainPolicy = value;
+    }
+
+    if (__system_property_get("debug.xr.dynamicResolution", value) != 0) {
+        options.DynamicResolution = (strcmp(value, "1") == 0) || EqualsIgnoreCase(value, "true");
+    }
+
+    if (__system_property_get("debug.xr.instancing", value) != 0) {
+        options.Instancing = (strcmp(value, "1") == 0) || EqualsIgnoreCase(value, "true");
+    }
+
+    if (__system_property_get("debug.xr.cubeBenchmark", value) != 0) {
+        options.CubeBenchmark = (strcmp(value, "1") == 0) || EqualsIgnoreCase(value, "true");
+    }
+
+    if (__system_property_get("debug.xr.pipelinedFrames", value) != 0) {
+        options.PipelinedFrames = (strcmp(value, "1") == 0) || EqualsIgnoreCase(value, "true");
+    }
+
+    if (__system_property_get("debug.xr.frameStats", value) != 0) {
+        options.FrameStats = (strcmp(value, "1") == 0) || EqualsIgnoreCase(value, "true");
+    }
+
+    if (__system_property_get("debug.xr.frameStatsCsv", value) != 0 && value[0] != '\0') {
+        options.FrameStatsCsv = value;
+        options.FrameStats = true;
+    }
+
+    if (__system_property_get("debug.xr.cubes", value) != 0) {
+        options.ExtraCubes = ParseCount("debug.xr.cubes", value);
+    }
+
+    if (__system_property_get("debug.xr.mesh", value) != 0 && value[0] != '\0') {
+        options.Mesh = value;
+    }
+
+    if (__system_property_get("debug.xr.frames", value) != 0) {
+        options.BenchmarkFrames = ParseCount("debug.xr.frames", value);
+    }
+
+    if (__system_property_get("debug.xr.warmup", value) != 0) {
+        options.WarmupFrames = ParseCount("debug.xr.warmup", value);
+    }
+
+    if (__system_property_get("debug.xr.frustumCulling", value) != 0) {
+        options.FrustumCulling = (strcmp(value, "1") == 0) || EqualsIgnoreCase(value, "true");
+    }
+
+    if (__system_property_get("debug.xr.parallelViews", value) != 0) {
+        options.ParallelViews = (strcmp(value, "1") == 0) || EqualsIgnoreCase(value, "true");
+    }
+
+    if (__system_property_get("debug.xr.lateLatch", value) != 0) {
+        options.LateLatching = (strcmp(value, "1") == 0) || EqualsIgnoreCase(value, "true");
+    }
+
+    if (__system_property_get("debug.xr.cache", value) != 0) {
+        const bool cache = (strcmp(value, "1") == 0) || EqualsIgnoreCase(value, "true");
+        if (!cache) {
+            options.CacheDirectory.clear();
+        }
+    }
+
+    if (__system_property_get("debug.xr.renderCores", value) != 0 && value[0] != '\0') {
+        options.RenderCores = ParseCores("debug.xr.renderCores", value);
+    }
+
+    if (__system_property_get("debug.xr.workerCores", value) != 0 && value[0] != '\0') {
+        options.WorkerCores = ParseCores("debug.xr.workerCores", value);
+    }
+
+    if (__system_property_get("debug.xr.realTimePriority", value) != 0 && value[0] != '\0') {
+        options.RealTimePriority = ParsePriority("debug.xr.realTimePriority", value);
+    }
+
+    if (__system_property_get("debug.xr.trace", value) != 0 && value[0] != '\0') {
+        options.TraceFile = value;
+    }
+
     // Check for required parameters.
     if (options.GraphicsPlugin.empty()) {
         Log::Write(Log::Level::Error, "GraphicsPlugin parameter is required");
@@ -35,12 +199,21 @@ void ShowHelp() {
     // TODO: Improve/update when things are more settled.
     Log::Write(Log::Level::Info,
                "HelloXr --graphics|-g <Graphics API> [--formfactor|-ff <Form factor>] [--viewconfig|-vc <View config>] "
-               "[--blendmode|-bm <Blend mode>] [--space|-s <Space>] [--verbose|-v]");
-    Log::Write(Log::Level::Info, "Graphics APIs:            D3D11, D3D12, OpenGLES, OpenGL, Vulkan2, Vulkan");
+               "[--blendmode|-bm <Blend mode>] [--space|-s <Space>] [--singlepass|-sp] [--depthlayer|-dl] [--spacewarp|-sw] "
+               "[--foveation|-fv <Foveation level>] [--swapchainpolicy|-scp <Swapchain policy>] [--dynamicres|-dr] "
+               "[--noinstancing|-ni] [--cubebench|-cb] [--pipelined|-pl] [--stats|-st] [--statscsv|-sc <File>] "
+               "[--cubes|-c <Count>] [--mesh|-m <File>] [--frames|-f <Count>] "
+               "[--warmup|-w <Count>] [--noculling|-nc] [--fastrestart|-fr] [--parallelviews|-pv] [--latelatch|-ll] "
+               "[--cachedir|-cd <Directory>] [--nocache|-ncc] [--rendercores|-rc <Cores>] [--workercores|-wc <Cores>] "
+               "[--realtime|-rt <Priority>] [--mirror|-mr <Interval>] [--trace|-tr <File>] [--verbose|-v]");
+    Log::Write(Log::Level::Info, "Graphics APIs:            D3D11, D3D12, OpenGLES, OpenGL, Vulkan2, Vulkan, Null");
     Log::Write(Log::Level::Info, "Form factors:             Hmd, Handheld");
-    Log::Write(Log::Level::Info, "View configurations:      Mono, Stereo");
+    Log::Write(Log::Level::Info, "View configurations:      Mono, Stereo, Quad");
     Log::Write(Log::Level::Info, "Environment blend modes:  Opaque, Additive, AlphaBlend");
     Log::Write(Log::Level::Info, "Spaces:                   View, Local, Stage");
+    Log::Write(Log::Level::Info, "Foveation levels:         Off, Low, Medium, High");
+    Log::Write(Log::Level::Info, "Swapchain policies:       Default, Quality, Balanced, Bandwidth");
+    Log::Write(Log::Level::Info, "Cores:                    big, or a core mask such as 0xf0");
 }
 
 bool UpdateOptionsFromCommandLine(Options& options, int argc, char* argv[]) {
@@ -66,6 +239,59 @@ bool UpdateOptionsFromCommandLine(Options& options, int argc, char* argv[]) {
             options.EnvironmentBlendMode = getNextArg();
         } else if (EqualsIgnoreCase(arg, "--space") || EqualsIgnoreCase(arg, "-s")) {
             options.AppSpace = getNextArg();
+        } else if (EqualsIgnoreCase(arg, "--singlepass") || EqualsIgnoreCase(arg, "-sp")) {
+            options.SinglePassStereo = true;
+        } else if (EqualsIgnoreCase(arg, "--depthlayer") || EqualsIgnoreCase(arg, "-dl")) {
+            options.DepthLayer = true;
+        } else if (EqualsIgnoreCase(arg, "--spacewarp") || EqualsIgnoreCase(arg, "-sw")) {
+            options.SpaceWarp = true;
+        } else if (EqualsIgnoreCase(arg, "--foveation") || EqualsIgnoreCase(arg, "-fv")) {
+            options.Foveation = getNextArg();
+        } else if (EqualsIgnoreCase(arg, "--swapchainpolicy") || EqualsIgnoreCase(arg, "-scp")) {
+            options.SwapchainPolicy = getNextArg();
+        } else if (EqualsIgnoreCase(arg, "--dynamicres") || EqualsIgnoreCase(arg, "-dr")) {
+            options.DynamicResolution = true;
+        } else if (EqualsIgnoreCase(arg, "--noinstancing") || EqualsIgnoreCase(arg, "-ni")) {
+            options.Instancing = false;
+        } else if (EqualsIgnoreCase(arg, "--cubebench") || EqualsIgnoreCase(arg, "-cb")) {
+            options.CubeBenchmark = true;
+        } else if (EqualsIgnoreCase(arg, "--pipelined") || EqualsIgnoreCase(arg, "-pl")) {
+            options.PipelinedFrames = true;
+        } else if (EqualsIgnoreCase(arg, "--stats") || EqualsIgnoreCase(arg, "-st")) {
+            options.FrameStats = true;
+        } else if (EqualsIgnoreCase(arg, "--statscsv") || EqualsIgnoreCase(arg, "-sc")) {
+            options.FrameStatsCsv = getNextArg();
+            options.FrameStats = true;
+        } else if (EqualsIgnoreCase(arg, "--cubes") || EqualsIgnoreCase(arg, "-c")) {
+            options.ExtraCubes = ParseCount(arg, getNextArg());
+        } else if (EqualsIgnoreCase(arg, "--mesh") || EqualsIgnoreCase(arg, "-m")) {
+            options.Mesh = getNextArg();
+        } else if (EqualsIgnoreCase(arg, "--frames") || EqualsIgnoreCase(arg, "-f")) {
+            options.BenchmarkFrames = ParseCount(arg, getNextArg());
+        } else if (EqualsIgnoreCase(arg, "--warmup") || EqualsIgnoreCase(arg, "-w")) {
+            options.WarmupFrames = ParseCount(arg, getNextArg());
+        } else if (EqualsIgnoreCase(arg, "--noculling") || EqualsIgnoreCase(arg, "-nc")) {
+            options.FrustumCulling = false;
+        } else if (EqualsIgnoreCase(arg, "--fastrestart") || EqualsIgnoreCase(arg, "-fr")) {
+            options.FastRestart = true;
+        } else if (EqualsIgnoreCase(arg, "--parallelviews") || EqualsIgnoreCase(arg, "-pv")) {
+            options.ParallelViews = true;
+        } else if (EqualsIgnoreCase(arg, "--latelatch") || EqualsIgnoreCase(arg, "-ll")) {
+            options.LateLatching = true;
+        } else if (EqualsIgnoreCase(arg, "--cachedir") || EqualsIgnoreCase(arg, "-cd")) {
+            options.CacheDirectory = getNextArg();
+        } else if (EqualsIgnoreCase(arg, "--nocache") || EqualsIgnoreCase(arg, "-ncc")) {
+            options.CacheDirectory.clear();
+        } else if (EqualsIgnoreCase(arg, "--rendercores") || EqualsIgnoreCase(arg, "-rc")) {
+            options.RenderCores = ParseCores(arg, getNextArg());
+        } else if (EqualsIgnoreCase(arg, "--workercores") || EqualsIgnoreCase(arg, "-wc")) {
+            options.WorkerCores = ParseCores(arg, getNextArg());
+        } else if (EqualsIgnoreCase(arg, "--realtime") || EqualsIgnoreCase(arg, "-rt")) {
+            options.RealTimePriority = ParsePriority(arg, getNextArg());
+        } else if (EqualsIgnoreCase(arg, "--mirror") || EqualsIgnoreCase(arg, "-mr")) {
+            options.MirrorInterval = ParseCount(arg, getNextArg());
+        } else if (EqualsIgnoreCase(arg, "--trace") || EqualsIgnoreCase(arg, "-tr")) {
+            options.TraceFile = getNextArg();
         } else if (EqualsIgnoreCase(arg, "--verbose") || EqualsIgnoreCase(arg, "-v")) {
             Log::SetLevel(Log::Level::Verbose);
         } else if (EqualsIgnoreCase(arg, "--help") || EqualsIgnoreCase(arg, "-h")) {
@@ -164,9 +390,16 @@ void android_main(struct android_app* app) {
         app->onAppCmd = app_handle_cmd;
 
         std::shared_ptr<Options> options = std::make_shared<Options>();
+        if (app->activity->internalDataPath != nullptr) {
+            options->CacheDirectory = app->activity->internalDataPath;
+        }
         if (!UpdateOptionsFromSystemProperties(*options)) {
             return;
         }
+        if (!options->TraceFile.empty()) {
+            Trace::Start(options->TraceFile);
+        }
+        ApplyRenderThreadScheduling(*options);
 
         std::shared_ptr<PlatformData> data = std::make_shared<PlatformData>();
         data->applicationVM = app->activity->vm;
@@ -174,6 +407,9 @@ void android_main(struct android_app* app) {
 
         bool requestRestart = false;
         bool exitRenderLoop = false;
+        IdleBackoff idleBackoff;
+
+        BeginStartup();
 
         // Create platform-specific implementation.
         std::shared_ptr<IPlatformPlugin> platformPlugin = CreatePlatformPlugin(options, data);
@@ -208,8 +444,11 @@ void android_main(struct android_app* app) {
                 struct android_poll_source* source;
                 // If the timeout is zero, returns immediately without blocking.
                 // If the timeout is negative, waits indefinitely until an event appears.
-                const int timeoutMilliseconds =
-                    (!appState.Resumed && !program->IsSessionRunning() && app->destroyRequested == 0) ? -1 : 0;
+                // While resumed without a running session, wait a little between polls for OpenXR events instead of spinning.
+                int timeoutMilliseconds = 0;
+                if (!program->IsSessionRunning() && app->destroyRequested == 0) {
+                    timeoutMilliseconds = appState.Resumed ? (int)idleBackoff.Next().count() : -1;
+                }
                 if (ALooper_pollAll(timeoutMilliseconds, nullptr, &events, (void**)&source) < 0) {
                     break;
                 }
@@ -220,15 +459,20 @@ void android_main(struct android_app* app) {
                 }
             }
 
-            program->PollEvents(&exitRenderLoop, &requestRestart);
+            if (program->PollEvents(&exitRenderLoop, &requestRestart)) {
+                idleBackoff.Reset();
+            }
             if (!program->IsSessionRunning()) {
                 continue;
             }
 
             program->PollActions();
             program->RenderFrame();
+            Trace::WriteIfRequested();
         }
 
+        // The process may be killed without running exit handlers.
+        Trace::Write();
         app->activity->vm->DetachCurrentThread();
     } catch (const std::exception& ex) {
         Log::Write(Log::Level::Error, ex.what());
@@ -241,9 +485,14 @@ int main(int argc, char* argv[]) {
     try {
         // Parse command-line arguments into Options.
         std::shared_ptr<Options> options = std::make_shared<Options>();
+        options->CacheDirectory = DefaultCacheDirectory();
         if (!UpdateOptionsFromCommandLine(*options, argc, argv)) {
             return 1;
         }
+        if (!options->TraceFile.empty()) {
+            Trace::Start(options->TraceFile);
+        }
+        ApplyRenderThreadScheduling(*options);
 
         std::shared_ptr<PlatformData> data = std::make_shared<PlatformData>();
 
@@ -256,25 +505,50 @@ int main(int argc, char* argv[]) {
         }};
         exitPollingThread.detach();
 
+        // Kept across restarts with --fastrestart.
+        std::shared_ptr<IPlatformPlugin> platformPlugin;
+        std::shared_ptr<IGraphicsPlugin> graphicsPlugin;
+
         bool requestRestart = false;
+        BeginStartup();
         do {
-            // Create platform-specific implementation.
-            std::shared_ptr<IPlatformPlugin> platformPlugin = CreatePlatformPlugin(options, data);
+            std::shared_ptr<IOpenXrProgram> program;
+            if (graphicsPlugin) {
+                // Only the OpenXR side is recreated, unless the restarted runtime wants another graphics adapter.
+                program = CreateOpenXrProgram(options, platformPlugin, graphicsPlugin, true);
+                program->CreateInstance();
+                if (program->InitializeSystem()) {
+                    Log::Write(Log::Level::Info, "Restarting with the existing graphics device");
+                } else {
+                    Log::Write(Log::Level::Info, "The graphics device cannot be reused, recreating it");
+                    program.reset();
+                    graphicsPlugin.reset();
+                    platformPlugin.reset();
+                }
+            }
+
+            if (!program) {
+                // Create platform-specific implementation.
+                platformPlugin = CreatePlatformPlugin(options, data);
 
-            // Create graphics API implementation.
-            std::shared_ptr<IGraphicsPlugin> graphicsPlugin = CreateGraphicsPlugin(options, platformPlugin);
+                // Create graphics API implementation.
+                graphicsPlugin = CreateGraphicsPlugin(options, platformPlugin);
 
-            // Initialize the OpenXR program.
-            std::shared_ptr<IOpenXrProgram> program = CreateOpenXrProgram(options, platformPlugin, graphicsPlugin);
+                // Initialize the OpenXR program.
+                program = CreateOpenXrProgram(options, platformPlugin, graphicsPlugin);
 
-            program->CreateInstance();
-            program->InitializeSystem();
+                program->CreateInstance();
+                program->InitializeSystem();
+            }
             program->InitializeSession();
             program->CreateSwapchains();
 
+            IdleBackoff idleBackoff;
             while (!quitKeyPressed) {
                 bool exitRenderLoop = false;
-                program->PollEvents(&exitRenderLoop, &requestRestart);
+                if (program->PollEvents(&exitRenderLoop, &requestRestart)) {
+                    idleBackoff.Reset();
+                }
                 if (exitRenderLoop) {
                     break;
                 }
@@ -282,12 +556,22 @@ int main(int argc, char* argv[]) {
                 if (program->IsSessionRunning()) {
                     program->PollActions();
                     program->RenderFrame();
+                    Trace::WriteIfRequested();
                 } else {
                     // Throttle loop since xrWaitFrame won't be called.
-                    std::this_thread::sleep_for(std::chrono::milliseconds(250));
+                    std::this_thread::sleep_for(idleBackoff.Next());
                 }
             }
 
+            if (requestRestart) {
+                // Timed from here so tearing down the old instance counts towards the restart
+                BeginRestart();
+            }
+            if (!options->FastRestart) {
+                // The program holds the only remaining references, so the plugins go with it.
+                graphicsPlugin.reset();
+                platformPlugin.reset();
+            }
         } while (!quitKeyPressed && requestRestart);
 
         return 0;
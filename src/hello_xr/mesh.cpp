@@ -0,0 +1,196 @@
+// Copyright (c) 2017-2020 The Khronos Group Inc.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include "pch.h"
+#include "common.h"
+#include "mesh.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+// Read ahead this much of a mapped file while the previous chunk is copied.
+constexpr size_t StreamChunkSize = 1 << 20;
+
+// Version 1 headers end before the level of detail table.
+constexpr size_t Version1HeaderSize = offsetof(MeshFileHeader, LodCount);
+static_assert(Version1HeaderSize == 64 && sizeof(MeshFileHeader) == 152, "Unexpected mesh file header layout");
+
+bool FitsInFile(uint64_t offset, uint64_t bytes, size_t fileSize) { return offset <= fileSize && bytes <= fileSize - offset; }
+
+// The ranges must lie within the indices, whole triangles each, with decreasing thresholds that end at 0.
+bool ValidLods(const MeshFileHeader& header) {
+    if (header.LodCount == 0 || header.LodCount > MaxMeshLods || header.Lods[header.LodCount - 1].MinScreenSize != 0) {
+        return false;
+    }
+    for (uint32_t lod = 0; lod < header.LodCount; ++lod) {
+        const MeshLod& range = header.Lods[lod];
+        if (range.IndexCount == 0 || range.IndexCount % 3 != 0 || range.FirstIndex > header.IndexCount ||
+            range.IndexCount > header.IndexCount - range.FirstIndex ||
+            (lod > 0 && !(range.MinScreenSize < header.Lods[lod - 1].MinScreenSize))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool ValidMeshlets(const MeshFileHeader& header, size_t fileSize) {
+    return header.MeshletCount == 0 ||
+           (header.MeshletOffset % 4 == 0 && header.MeshletVertexOffset % 4 == 0 &&
+            FitsInFile(header.MeshletOffset, (uint64_t)header.MeshletCount * sizeof(Meshlet), fileSize) &&
+            FitsInFile(header.MeshletVertexOffset, (uint64_t)header.MeshletVertexCount * sizeof(uint32_t), fileSize) &&
+            FitsInFile(header.MeshletTriangleOffset, (uint64_t)header.MeshletTriangleCount * 3, fileSize));
+}
+}  // namespace
+
+XrVector3f MeshData::Extent() const {
+    return {std::max(std::abs(BoundsMin.x), std::abs(BoundsMax.x)), std::max(std::abs(BoundsMin.y), std::abs(BoundsMax.y)),
+            std::max(std::abs(BoundsMin.z), std::abs(BoundsMax.z))};
+}
+
+MeshData CubeMeshData() {
+    MeshData cube;
+    cube.Vertices = Geometry::c_cubeVertices;
+    cube.VertexCount = (uint32_t)(sizeof(Geometry::c_cubeVertices) / sizeof(Geometry::c_cubeVertices[0]));
+    cube.Indices = Geometry::c_cubeIndices;
+    cube.IndexCount = (uint32_t)(sizeof(Geometry::c_cubeIndices) / sizeof(Geometry::c_cubeIndices[0]));
+    cube.IndexSize = sizeof(Geometry::c_cubeIndices[0]);
+    cube.BoundsMin = Geometry::LBB;
+    cube.BoundsMax = Geometry::RTF;
+    cube.Lods[0] = {0, cube.IndexCount, 0};
+    cube.LodCount = 1;
+    return cube;
+}
+
+void StreamCopy(void* destination, const void* source, size_t size) {
+#if defined(_WIN32)
+    memcpy(destination, source, size);
+#else
+    const uintptr_t pageMask = (uintptr_t)sysconf(_SC_PAGESIZE) - 1;
+    uint8_t* to = static_cast<uint8_t*>(destination);
+    const uint8_t* from = static_cast<const uint8_t*>(source);
+    while (size > 0) {
+        const size_t chunk = std::min(size, StreamChunkSize);
+        if (size > chunk) {
+            // Only a hint, and it fails harmlessly for memory that is not file backed.
+            const uintptr_t next = (uintptr_t)(from + chunk);
+            const uintptr_t nextPage = next & ~pageMask;
+            (void)madvise(reinterpret_cast<void*>(nextPage), std::min(size - chunk, StreamChunkSize) + (next - nextPage),
+                          MADV_WILLNEED);
+        }
+        memcpy(to, from, chunk);
+        to += chunk;
+        from += chunk;
+        size -= chunk;
+    }
+#endif
+}
+
+MappedMesh::MappedMesh(const std::string& path) {
+#if defined(_WIN32)
+    m_file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    CHECK_MSG(m_file != INVALID_HANDLE_VALUE, Fmt("Unable to open mesh file '%s'", path.c_str()));
+    LARGE_INTEGER fileSize{};
+    if (!GetFileSizeEx(m_file, &fileSize) || fileSize.QuadPart == 0 || (uint64_t)fileSize.QuadPart > SIZE_MAX) {
+        Unmap();
+        THROW(Fmt("Unable to map mesh file '%s'", path.c_str()));
+    }
+    m_size = (size_t)fileSize.QuadPart;
+    m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    m_view = m_mapping != nullptr ? static_cast<const uint8_t*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0)) : nullptr;
+    if (m_view == nullptr) {
+        Unmap();
+        THROW(Fmt("Unable to map mesh file '%s'", path.c_str()));
+    }
+#else
+    const int file = open(path.c_str(), O_RDONLY);
+    CHECK_MSG(file >= 0, Fmt("Unable to open mesh file '%s'", path.c_str()));
+    struct stat fileStat {};
+    void* view = MAP_FAILED;
+    if (fstat(file, &fileStat) == 0 && fileStat.st_size > 0) {
+        m_size = (size_t)fileStat.st_size;
+        view = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, file, 0);
+    }
+    close(file);  // The mapping keeps the file open
+    CHECK_MSG(view != MAP_FAILED, Fmt("Unable to map mesh file '%s'", path.c_str()));
+    m_view = static_cast<const uint8_t*>(view);
+    (void)madvise(view, m_size, MADV_SEQUENTIAL);
+#endif
+
+    // Only the header is looked at, the data is handed to the graphics plugin as it is.
+    MeshFileHeader header{};
+    bool valid = m_size >= Version1HeaderSize;
+    if (valid) {
+        memcpy(&header, m_view, Version1HeaderSize);
+        if (header.Version == 1) {
+            header.LodCount = 1;
+            header.Lods[0] = {0, header.IndexCount, 0};
+        } else if (header.Version == MeshFileHeader::CurrentVersion && m_size >= sizeof(header)) {
+            memcpy(&header, m_view, sizeof(header));
+        } else {
+            valid = false;
+        }
+        valid = valid && header.Magic == MeshFileHeader::ExpectedMagic && header.VertexStride == sizeof(Geometry::Vertex) &&
+                (header.IndexSize == 2 || header.IndexSize == 4) && header.VertexCount > 0 && header.IndexCount > 0 &&
+                header.IndexCount % 3 == 0 && header.VertexOffset % 4 == 0 && header.IndexOffset % 4 == 0 &&
+                FitsInFile(header.VertexOffset, (uint64_t)header.VertexCount * header.VertexStride, m_size) &&
+                FitsInFile(header.IndexOffset, (uint64_t)header.IndexCount * header.IndexSize, m_size) && ValidLods(header) &&
+                ValidMeshlets(header, m_size);
+    }
+    if (!valid) {
+        Unmap();
+        THROW(Fmt("'%s' is not a version 1 to %u mesh file", path.c_str(), MeshFileHeader::CurrentVersion));
+    }
+
+    m_data.Vertices = reinterpret_cast<const Geometry::Vertex*>(m_view + header.VertexOffset);
+    m_data.VertexCount = header.VertexCount;
+    m_data.Indices = m_view + header.IndexOffset;
+    m_data.IndexCount = header.IndexCount;
+    m_data.IndexSize = header.IndexSize;
+    m_data.BoundsMin = header.BoundsMin;
+    m_data.BoundsMax = header.BoundsMax;
+    std::copy(header.Lods, header.Lods + header.LodCount, m_data.Lods.begin());
+    m_data.LodCount = header.LodCount;
+    if (header.MeshletCount > 0) {
+        m_data.Meshlets = reinterpret_cast<const Meshlet*>(m_view + header.MeshletOffset);
+        m_data.MeshletCount = header.MeshletCount;
+        m_data.MeshletVertices = reinterpret_cast<const uint32_t*>(m_view + header.MeshletVertexOffset);
+        m_data.MeshletVertexCount = header.MeshletVertexCount;
+        m_data.MeshletTriangles = m_view + header.MeshletTriangleOffset;
+        m_data.MeshletTriangleCount = header.MeshletTriangleCount;
+    }
+    LOG_VERBOSE(Fmt("Mapped mesh file '%s': %u vertices, %u %u-bit indices, %u levels of detail, %u meshlets", path.c_str(),
+                    m_data.VertexCount, m_data.IndexCount, m_data.IndexSize * 8, m_data.LodCount, m_data.MeshletCount));
+}
+
+MappedMesh::~MappedMesh() { Unmap(); }
+
+void MappedMesh::Unmap() {
+#if defined(_WIN32)
+    if (m_view != nullptr) {
+        UnmapViewOfFile(m_view);
+    }
+    if (m_mapping != nullptr) {
+        CloseHandle(m_mapping);
+    }
+    if (m_file != nullptr && m_file != INVALID_HANDLE_VALUE) {
+        CloseHandle(m_file);
+    }
+    m_mapping = nullptr;
+    m_file = nullptr;
+#else
+    if (m_view != nullptr) {
+        munmap(const_cast<uint8_t*>(m_view), m_size);
+    }
+#endif
+    m_view = nullptr;
+    m_size = 0;
+    m_data = {};
+}
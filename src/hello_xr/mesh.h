@@ -0,0 +1,153 @@
+// Copyright (c) 2017-2020 The Khronos Group Inc
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include <array>
+
+#include "geometry.h"
+
+// Mesh ID of the built-in cube, which every graphics plugin uploads when it initializes.
+constexpr uint32_t CubeMesh = 0;
+
+// Most levels of detail a mesh can have.
+constexpr uint32_t MaxMeshLods = 4;
+
+// A run of consecutive models that are all drawn with one level of detail of one mesh. The draws of a render call cover
+// its models in order.
+struct MeshDraw {
+    uint32_t Mesh{CubeMesh};
+    uint32_t InstanceCount{0};
+    uint32_t Lod{0};
+};
+
+// Extend the last draw of draws if it uses the same mesh and level of detail, otherwise start a new one, for one more
+// model.
+inline void AppendMeshDraw(std::vector<MeshDraw>& draws, uint32_t mesh, uint32_t lod = 0) {
+    if (!draws.empty() && draws.back().Mesh == mesh && draws.back().Lod == lod) {
+        ++draws.back().InstanceCount;
+    } else {
+        draws.push_back(MeshDraw{mesh, 1, lod});
+    }
+}
+
+// One level of detail: a range of the mesh's indices, drawn while the mesh covers at least MinScreenSize of the view's
+// height. Level 0 is the most detailed, and the thresholds decrease from there to 0 for the last level.
+struct MeshLod {
+    uint32_t FirstIndex;
+    uint32_t IndexCount;
+    float MinScreenSize;
+};
+
+// A cluster of at most MaxVertices vertices and MaxTriangles triangles of level of detail 0, as mesh shaders consume
+// them: VertexCount entries of the meshlet vertex list from VertexOffset on index the mesh's vertices, and TriangleCount
+// triples of the meshlet triangle list from TriangleOffset on index those entries. Level 0's indices list the same
+// triangles meshlet by meshlet, so the index draw path gets their locality too.
+struct Meshlet {
+    static constexpr uint32_t MaxVertices = 64;
+    static constexpr uint32_t MaxTriangles = 124;
+
+    uint32_t VertexOffset;
+    uint32_t TriangleOffset;
+    uint32_t VertexCount;
+    uint32_t TriangleCount;
+};
+
+// Vertices and indices of a mesh as the graphics plugins upload them, wherever they live. Triangle lists with clockwise
+// winding, like the cube. The indices of every level of detail share one buffer.
+struct MeshData {
+    const Geometry::Vertex* Vertices{nullptr};
+    uint32_t VertexCount{0};
+    const void* Indices{nullptr};  // uint16_t or uint32_t, see IndexSize
+    uint32_t IndexCount{0};
+    uint32_t IndexSize{sizeof(uint16_t)};
+    XrVector3f BoundsMin{};
+    XrVector3f BoundsMax{};
+    std::array<MeshLod, MaxMeshLods> Lods{};
+    uint32_t LodCount{0};
+
+    // Optional meshlet partition, MeshletCount is 0 without one. None of the graphics plugins draw with mesh shaders yet,
+    // so they only upload the levels of detail.
+    const Meshlet* Meshlets{nullptr};
+    uint32_t MeshletCount{0};
+    const uint32_t* MeshletVertices{nullptr};
+    uint32_t MeshletVertexCount{0};
+    const uint8_t* MeshletTriangles{nullptr};  // Three bytes per triangle
+    uint32_t MeshletTriangleCount{0};
+
+    size_t VertexBytes() const { return (size_t)VertexCount * sizeof(Geometry::Vertex); }
+    size_t IndexBytes() const { return (size_t)IndexCount * IndexSize; }
+
+    // Largest distance from the origin along each axis, so a box of this half-size around the origin holds the mesh.
+    XrVector3f Extent() const;
+};
+
+// The cube of geometry.h.
+MeshData CubeMeshData();
+
+// Copy a large block out of a mapped file a chunk at a time, asking the OS to read the next chunk ahead while the current
+// one is copied. Plain memcpy otherwise.
+void StreamCopy(void* destination, const void* source, size_t size);
+
+// Binary mesh files hold the data of a MeshData exactly as it is uploaded, so loading one is a memory map and a copy with
+// no parsing pass. All values are little-endian:
+//   MeshFileHeader
+//   VertexCount Geometry::Vertex at VertexOffset
+//   IndexCount 16- or 32-bit indices at IndexOffset, the ranges of every level of detail
+//   MeshletCount Meshlet at MeshletOffset
+//   MeshletVertexCount uint32_t at MeshletVertexOffset
+//   MeshletTriangleCount triples of uint8_t at MeshletTriangleOffset
+// The offsets are from the start of the file and multiples of 4. Indices and meshlets are not checked against the vertex
+// count; files are trusted to be well formed beyond what the header says. Version 1 files end the header at BoundsMax and
+// have a single level of detail and no meshlets.
+struct MeshFileHeader {
+    static constexpr uint32_t ExpectedMagic = 0x4853454d;  // "MESH"
+    static constexpr uint32_t CurrentVersion = 2;
+
+    uint32_t Magic;
+    uint32_t Version;
+    uint32_t VertexStride;  // sizeof(Geometry::Vertex)
+    uint32_t IndexSize;     // 2 or 4
+    uint32_t VertexCount;
+    uint32_t IndexCount;
+    uint64_t VertexOffset;
+    uint64_t IndexOffset;
+    XrVector3f BoundsMin;
+    XrVector3f BoundsMax;
+
+    // Version 2
+    uint32_t LodCount;  // 1 to MaxMeshLods
+    MeshLod Lods[MaxMeshLods];
+    uint32_t MeshletCount;
+    uint32_t MeshletVertexCount;
+    uint32_t MeshletTriangleCount;
+    uint64_t MeshletOffset;
+    uint64_t MeshletVertexOffset;
+    uint64_t MeshletTriangleOffset;
+};
+
+// A mesh file mapped read-only into memory. Data points into the mapping, so it is only valid as long as the MappedMesh.
+class MappedMesh {
+   public:
+    // Map and validate the file, throwing if it cannot be read or is not a mesh file.
+    explicit MappedMesh(const std::string& path);
+    ~MappedMesh();
+
+    MappedMesh(const MappedMesh&) = delete;
+    MappedMesh& operator=(const MappedMesh&) = delete;
+
+    const MeshData& Data() const { return m_data; }
+    size_t FileSize() const { return m_size; }
+
+   private:
+    void Unmap();
+
+    const uint8_t* m_view{nullptr};
+    size_t m_size{0};
+#if defined(_WIN32)
+    void* m_file{nullptr};
+    void* m_mapping{nullptr};
+#endif
+    MeshData m_data;
+};
@@ -9,16 +9,54 @@
 #include "platformplugin.h"
 #include "graphicsplugin.h"
 #include "openxr_program.h"
+#include "framestats.h"
+#include "allocationcounter.h"
+#include "scene.h"
+#include "culling.h"
+#include "resolutionscaler.h"
+#include "startup.h"
+#include "inputstate.h"
+#include "threadscheduling.h"
 #include <common/xr_linear.h>
 #include <array>
+#include <cassert>
+#include <cerrno>
+#include <chrono>
 #include <cmath>
 
+// The threading helpers are header-only C, most of their static functions are unused here.
+#if defined(_MSC_VER)
+#pragma warning(push)
+#pragma warning(disable : 4505)  // unreferenced local function has been removed
+#elif defined(__GNUC__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-function"
+#endif
+#include <utils/threading.h>
+#if defined(_MSC_VER)
+#pragma warning(pop)
+#elif defined(__GNUC__)
+#pragma GCC diagnostic pop
+#endif
+
 namespace {
 
 #if !defined(XR_USE_PLATFORM_WIN32)
 #define strcpy_s(dest, source) strncpy((dest), (source), sizeof(dest))
 #endif
 
+// Near and far planes of the projection every graphics plugin renders with.
+constexpr float NearZ = 0.05f;
+constexpr float FarZ = 100.0f;
+
+// Furthest a hand points at cubes from.
+constexpr float PointingDistance = 10.0f;
+
+// Range of dynamic resolution, relative to the recommended image rect size. Swapchains are allocated for the largest scale
+// the system allows up to MaxResolutionScale.
+constexpr float MinResolutionScale = 0.5f;
+constexpr float MaxResolutionScale = 1.5f;
+
 namespace Side {
 const int LEFT = 0;
 const int RIGHT = 1;
@@ -46,6 +84,11 @@ inline XrViewConfigurationType GetXrViewConfigurationType(const std::string& vie
     if (EqualsIgnoreCase(viewConfigurationStr, "Stereo")) {
         return XR_VIEW_CONFIGURATION_TYPE_PRIMARY_STEREO;
     }
+#if defined(XR_VARJO_quad_views)
+    if (EqualsIgnoreCase(viewConfigurationStr, "Quad")) {
+        return XR_VIEW_CONFIGURATION_TYPE_PRIMARY_QUAD_VARJO;
+    }
+#endif
     throw std::invalid_argument(Fmt("Unknown view configuration '%s'", viewConfigurationStr.c_str()));
 }
 
@@ -119,12 +162,190 @@ inline XrReferenceSpaceCreateInfo GetXrReferenceSpaceCreateInfo(const std::strin
     return referenceSpaceCreateInfo;
 }
 
+// Append a grid of count small cubes centered 2m in front of the app space origin, all drawn with mesh.
+void AddCubeGrid(std::vector<Cube>& cubes, uint32_t count, uint32_t mesh) {
+    constexpr float Spacing = 0.1f;
+    constexpr float Scale = 0.02f;
+    const uint32_t side = (uint32_t)std::ceil(std::cbrt((float)count));
+    const float origin = -0.5f * Spacing * (side - 1);
+    cubes.reserve(cubes.size() + count);
+    for (uint32_t i = 0; i < count; ++i) {
+        const XrVector3f position{origin + Spacing * (i % side), origin + Spacing * ((i / side) % side),
+                                  -2.f + origin + Spacing * (i / (side * side))};
+        cubes.push_back(Cube{Math::Pose::Translation(position), {Scale, Scale, Scale}, mesh});
+    }
+}
+
+// Fixed-load benchmark runs: one step of --frames frames, or with --cubebench a step per size of a growing grid of small
+// cubes, so the instanced and per-cube (--noinstancing) paths can be compared. The first --warmup frames of a step are left
+// out. Each measured frame records the time since the previous frame ended, and the CPU time spent submitting its views and,
+// in the graphics plugins that track it, waiting for the GPU. Every step logs percentiles, throughput and average submit
+// times together with the setup, so runs of different runtimes, drivers and backends can be compared.
+class FrameBenchmark {
+   public:
+    // Cube benchmark steps, and their length unless --frames sets it.
+    static constexpr uint32_t CubeStepCount = 6;
+    static constexpr uint32_t CubeStepFrames = 330;
+    static constexpr uint32_t CubeStepWarmupFrames = 30;
+
+    void Start(const Options& options) {
+        m_graphicsPlugin = options.GraphicsPlugin;
+        m_extraCubes = options.ExtraCubes;
+        m_instancing = options.Instancing;
+        m_cubeSteps = options.CubeBenchmark;
+        m_stepCount = options.CubeBenchmark ? CubeStepCount : options.BenchmarkFrames > 0 ? 1 : 0;
+        const bool defaultLength = options.CubeBenchmark && options.BenchmarkFrames == 0;
+        m_frameCount = defaultLength ? CubeStepFrames : options.BenchmarkFrames;
+        const uint32_t warmupFrames = defaultLength ? CubeStepWarmupFrames : options.WarmupFrames;
+        m_warmupFrames = std::min(warmupFrames, m_frameCount);
+        m_samples.reserve(m_frameCount - m_warmupFrames);
+    }
+
+    bool Running() const { return m_step < m_stepCount; }
+
+    // Size of the cube benchmark's grid in the current step, 0 outside the cube benchmark.
+    uint32_t CubeCount() const { return m_cubeSteps && Running() ? 16u << (2 * m_step) : 0; }
+
+    // Call as each frame starts. The first call starts the clock, so without warmup the first frame is measured too.
+    void BeginFrame() {
+        if (Running() && m_lastFrameEnd == 0) {
+            m_lastFrameEnd = FrameStatsNow();
+        }
+    }
+
+    // Add CPU time the current frame spent submitting views, and how much of it went to waiting for the GPU.
+    void AddSubmitTime(std::chrono::nanoseconds submitTime, std::chrono::nanoseconds cpuWaitTime) {
+        m_frameSubmitTime += submitTime;
+        m_frameCpuWaitTime += cpuWaitTime;
+    }
+
+    // Call once per rendered frame, after xrEndFrame. Returns true when it ended the last step.
+    bool EndFrame() {
+        if (!Running()) {
+            return false;
+        }
+
+        const uint64_t now = FrameStatsNow();
+        if (m_frame++ >= m_warmupFrames) {
+            m_samples.push_back({now - m_lastFrameEnd, m_frameSubmitTime, m_frameCpuWaitTime});
+        }
+        m_lastFrameEnd = now;
+        m_frameSubmitTime = {};
+        m_frameCpuWaitTime = {};
+
+        if (m_frame < m_frameCount) {
+            return false;
+        }
+        Report();
+        m_frame = 0;
+        ++m_step;
+        return !Running();
+    }
+
+    // Log the frames measured so far in the current step and drop them, so a run that was cut short reports what it has.
+    void Report() {
+        if (m_samples.empty()) {
+            return;
+        }
+
+        uint64_t totalFrameTime = 0;
+        std::chrono::nanoseconds totalSubmitTime{};
+        std::chrono::nanoseconds totalCpuWaitTime{};
+        std::vector<uint64_t> frameTimes;
+        frameTimes.reserve(m_samples.size());
+        for (const Sample& sample : m_samples) {
+            totalFrameTime += sample.FrameTime;
+            totalSubmitTime += sample.SubmitTime;
+            totalCpuWaitTime += sample.CpuWaitTime;
+            frameTimes.push_back(sample.FrameTime);
+        }
+        m_samples.clear();
+
+        std::sort(frameTimes.begin(), frameTimes.end());
+        auto percentileMs = [&](size_t percentile) { return frameTimes[(frameTimes.size() - 1) * percentile / 100] / 1e6; };
+        auto averageMs = [&](std::chrono::nanoseconds total) {
+            return std::chrono::duration<double, std::milli>(total).count() / frameTimes.size();
+        };
+        Log::Write(Log::Level::Info,
+                   Fmt("Benchmark: graphics=%s mode=%s cubes=%u frames=%zu p50=%.3fms p90=%.3fms p99=%.3fms max=%.3fms "
+                       "throughput=%.1f frames/s submit=%.3fms gpu-wait=%.3fms",
+                       m_graphicsPlugin.c_str(), m_instancing ? "instanced" : "per-cube", m_extraCubes + CubeCount(),
+                       frameTimes.size(), percentileMs(50), percentileMs(90), percentileMs(99), frameTimes.back() / 1e6,
+                       frameTimes.size() / (totalFrameTime / 1e9), averageMs(totalSubmitTime), averageMs(totalCpuWaitTime)));
+    }
+
+   private:
+    struct Sample {
+        uint64_t FrameTime;
+        std::chrono::nanoseconds SubmitTime;
+        std::chrono::nanoseconds CpuWaitTime;
+    };
+
+    std::string m_graphicsPlugin;
+    uint32_t m_extraCubes{0};
+    bool m_instancing{true};
+    bool m_cubeSteps{false};
+    uint32_t m_stepCount{0};
+    uint32_t m_frameCount{0};
+    uint32_t m_warmupFrames{0};
+    uint32_t m_step{0};
+    uint32_t m_frame{0};
+    uint64_t m_lastFrameEnd{0};
+    std::chrono::nanoseconds m_frameSubmitTime{};
+    std::chrono::nanoseconds m_frameCpuWaitTime{};
+    std::vector<Sample> m_samples;
+};
+
+// Marks a hand that has no cube in PendingFrame::cubes.
+constexpr size_t NoHandCube = SIZE_MAX;
+
+// The result of xrWaitFrame and the simulation for that frame, handed to the thread that submits it.
+struct PendingFrame {
+    XrFrameState frameState{XR_TYPE_FRAME_STATE};
+    std::vector<Cube> cubes;  // Located this frame, the persistent cubes are in the program's scene.
+    std::array<size_t, Side::COUNT> handCubes{};  // Index in cubes of each hand's cube, or NoHandCube
+    uint64_t locatedAt{0};                        // FrameStatsNow when the cubes were located
+    FrameTimings timings;
+};
+
+// Scratch storage for building a frame's submission. It is cleared and refilled every frame but never freed, so once the
+// vectors reach their steady-state size the frame loop does not allocate.
+struct FrameScratch {
+    std::vector<XrCompositionLayerBaseHeader*> layers;
+    std::vector<XrCompositionLayerProjectionView> projectionLayerViews;
+    std::vector<SwapchainImage> swapchainImages;
+    std::vector<XrCompositionLayerDepthInfoKHR> depthInfos;  // Chained onto projectionLayerViews when depth is submitted
+#if defined(XR_FB_space_warp)
+    std::vector<XrCompositionLayerSpaceWarpInfoFB> spaceWarpInfos;  // Chained onto projectionLayerViews with space warp
+#endif
+};
+
 struct OpenXrProgram : IOpenXrProgram {
     OpenXrProgram(const std::shared_ptr<Options>& options, const std::shared_ptr<IPlatformPlugin>& platformPlugin,
-                  const std::shared_ptr<IGraphicsPlugin>& graphicsPlugin)
-        : m_options(options), m_platformPlugin(platformPlugin), m_graphicsPlugin(graphicsPlugin) {}
+                  const std::shared_ptr<IGraphicsPlugin>& graphicsPlugin, bool reuseGraphicsDevice)
+        : m_options(options),
+          m_platformPlugin(platformPlugin),
+          m_graphicsPlugin(graphicsPlugin),
+          m_reuseGraphicsDevice(reuseGraphicsDevice) {
+        if (m_options->FrameStats) {
+            m_frameStats = std::unique_ptr<FrameStats>(new FrameStats(m_options->FrameStatsCsv));
+        }
+        m_benchmark.Start(*m_options);
+    }
 
     ~OpenXrProgram() override {
+        m_benchmark.Report();
+
+        if (m_frameThreadCreated) {
+            DrainFramePipeline(false);
+            ksThread_Destroy(&m_frameThread);
+        }
+
+        // The graphics plugin may outlive the program when the device is kept for a restart.
+        if (m_lateLatching) {
+            m_graphicsPlugin->SetLateLatchCallback(nullptr);
+        }
+
         if (m_input.actionSet != XR_NULL_HANDLE) {
             for (auto hand : {Side::LEFT, Side::RIGHT}) {
                 xrDestroySpace(m_input.handSpace[hand]);
@@ -135,6 +356,15 @@ struct OpenXrProgram : IOpenXrProgram {
         for (Swapchain swapchain : m_swapchains) {
             xrDestroySwapchain(swapchain.handle);
         }
+        for (Swapchain swapchain : m_depthSwapchains) {
+            xrDestroySwapchain(swapchain.handle);
+        }
+        for (Swapchain swapchain : m_motionVectorSwapchains) {
+            xrDestroySwapchain(swapchain.handle);
+        }
+        for (Swapchain swapchain : m_motionVectorDepthSwapchains) {
+            xrDestroySwapchain(swapchain.handle);
+        }
 
         for (XrSpace visualizedSpace : m_visualizedSpaces) {
             xrDestroySpace(visualizedSpace);
@@ -168,10 +398,10 @@ struct OpenXrProgram : IOpenXrProgram {
                                                                extensions.data()));
 
             const std::string indentStr(indent, ' ');
-            Log::Write(Log::Level::Verbose, Fmt("%sAvailable Extensions: (%d)", indentStr.c_str(), instanceExtensionCount));
+            LOG_VERBOSE(Fmt("%sAvailable Extensions: (%d)", indentStr.c_str(), instanceExtensionCount));
             for (const XrExtensionProperties& extension : extensions) {
-                Log::Write(Log::Level::Verbose, Fmt("%s  Name=%s SpecVersion=%d", indentStr.c_str(), extension.extensionName,
-                                                    extension.extensionVersion));
+                LOG_VERBOSE(Fmt("%s  Name=%s SpecVersion=%d", indentStr.c_str(), extension.extensionName,
+                                extension.extensionVersion));
             }
         };
 
@@ -192,14 +422,26 @@ struct OpenXrProgram : IOpenXrProgram {
 
             Log::Write(Log::Level::Info, Fmt("Available Layers: (%d)", layerCount));
             for (const XrApiLayerProperties& layer : layers) {
-                Log::Write(Log::Level::Verbose,
-                           Fmt("  Name=%s SpecVersion=%s LayerVersion=%d Description=%s", layer.layerName,
-                               GetXrVersionString(layer.specVersion).c_str(), layer.layerVersion, layer.description));
+                LOG_VERBOSE(Fmt("  Name=%s SpecVersion=%s LayerVersion=%d Description=%s", layer.layerName,
+                                GetXrVersionString(layer.specVersion).c_str(), layer.layerVersion, layer.description));
                 logExtensions(layer.layerName, 4);
             }
         }
     }
 
+    static bool IsInstanceExtensionSupported(const char* extensionName) {
+        uint32_t instanceExtensionCount;
+        CHECK_XRCMD(xrEnumerateInstanceExtensionProperties(nullptr, 0, &instanceExtensionCount, nullptr));
+
+        std::vector<XrExtensionProperties> extensions(instanceExtensionCount, {XR_TYPE_EXTENSION_PROPERTIES});
+        CHECK_XRCMD(xrEnumerateInstanceExtensionProperties(nullptr, (uint32_t)extensions.size(), &instanceExtensionCount,
+                                                           extensions.data()));
+
+        return std::any_of(extensions.begin(), extensions.end(), [&](const XrExtensionProperties& extension) {
+            return strcmp(extension.extensionName, extensionName) == 0;
+        });
+    }
+
     void LogInstanceInfo() {
         CHECK(m_instance != XR_NULL_HANDLE);
 
@@ -224,6 +466,83 @@ struct OpenXrProgram : IOpenXrProgram {
         std::transform(graphicsExtensions.begin(), graphicsExtensions.end(), std::back_inserter(extensions),
                        [](const std::string& ext) { return ext.c_str(); });
 
+#if defined(XR_KHR_locate_spaces)
+        // Optional: locate all the spaces of a frame with one call instead of one xrLocateSpace call per space.
+        const bool locateSpacesSupported = IsInstanceExtensionSupported(XR_KHR_LOCATE_SPACES_EXTENSION_NAME);
+        if (locateSpacesSupported) {
+            extensions.push_back(XR_KHR_LOCATE_SPACES_EXTENSION_NAME);
+        }
+#endif
+
+        // Required by headless graphics plugins, which create the session without a graphics binding.
+        m_headless = m_graphicsPlugin->IsHeadless();
+        if (m_headless) {
+#if defined(XR_MND_headless)
+            CHECK_MSG(IsInstanceExtensionSupported(XR_MND_HEADLESS_EXTENSION_NAME),
+                      "The graphics plugin needs a runtime that supports XR_MND_headless");
+            extensions.push_back(XR_MND_HEADLESS_EXTENSION_NAME);
+#else
+            THROW("The graphics plugin needs XR_MND_headless, which these OpenXR headers do not define");
+#endif
+        }
+
+        // Optional: submit depth with the projection views so the runtime can reproject with it.
+        m_depthLayerSupported =
+            m_options->DepthLayer && IsInstanceExtensionSupported(XR_KHR_COMPOSITION_LAYER_DEPTH_EXTENSION_NAME);
+        if (m_depthLayerSupported) {
+            extensions.push_back(XR_KHR_COMPOSITION_LAYER_DEPTH_EXTENSION_NAME);
+        } else if (m_options->DepthLayer) {
+            Log::Write(Log::Level::Warning, "XR_KHR_composition_layer_depth is not supported, depth is not submitted");
+        }
+
+        // Optional: submit motion vectors and depth so the runtime can synthesize frames in between the rendered ones.
+#if defined(XR_FB_space_warp)
+        m_spaceWarpSupported = m_options->SpaceWarp && IsInstanceExtensionSupported(XR_FB_SPACE_WARP_EXTENSION_NAME);
+        if (m_spaceWarpSupported) {
+            extensions.push_back(XR_FB_SPACE_WARP_EXTENSION_NAME);
+        } else if (m_options->SpaceWarp) {
+            Log::Write(Log::Level::Warning, "XR_FB_space_warp is not supported, motion vectors are not submitted");
+        }
+#else
+        if (m_options->SpaceWarp) {
+            Log::Write(Log::Level::Warning,
+                       "These OpenXR headers do not define XR_FB_space_warp, motion vectors are not submitted");
+        }
+#endif
+
+        m_swapchainPolicy = GetSwapchainPolicy(m_options->SwapchainPolicy);
+
+        // Optional: let the runtime foveate the swapchains, more coarsely eye-tracked where the system can.
+        m_foveationLevel = GetFoveationLevel(m_options->Foveation);
+#if defined(XR_FB_foveation) && defined(XR_FB_foveation_configuration) && defined(XR_FB_swapchain_update_state)
+        const bool foveationSupported = m_foveationLevel != FoveationLevel::Off &&
+                                        IsInstanceExtensionSupported(XR_FB_FOVEATION_EXTENSION_NAME) &&
+                                        IsInstanceExtensionSupported(XR_FB_FOVEATION_CONFIGURATION_EXTENSION_NAME) &&
+                                        IsInstanceExtensionSupported(XR_FB_SWAPCHAIN_UPDATE_STATE_EXTENSION_NAME);
+        if (foveationSupported) {
+            extensions.push_back(XR_FB_FOVEATION_EXTENSION_NAME);
+            extensions.push_back(XR_FB_FOVEATION_CONFIGURATION_EXTENSION_NAME);
+            extensions.push_back(XR_FB_SWAPCHAIN_UPDATE_STATE_EXTENSION_NAME);
+#if defined(XR_META_foveation_eye_tracked)
+            m_eyeTrackedFoveationSupported = IsInstanceExtensionSupported(XR_META_FOVEATION_EYE_TRACKED_EXTENSION_NAME);
+            if (m_eyeTrackedFoveationSupported) {
+                extensions.push_back(XR_META_FOVEATION_EYE_TRACKED_EXTENSION_NAME);
+            }
+#endif
+        }
+#endif
+
+#if defined(XR_VARJO_quad_views)
+        // Required for the quad view configuration, a high-resolution inset view inside each eye's view.
+        if (GetXrViewConfigurationType(m_options->ViewConfiguration) == XR_VIEW_CONFIGURATION_TYPE_PRIMARY_QUAD_VARJO) {
+            if (IsInstanceExtensionSupported(XR_VARJO_QUAD_VIEWS_EXTENSION_NAME)) {
+                extensions.push_back(XR_VARJO_QUAD_VIEWS_EXTENSION_NAME);
+            } else {
+                Log::Write(Log::Level::Warning, "XR_VARJO_quad_views is not supported, the quad view configuration is unavailable");
+            }
+        }
+#endif
+
         XrInstanceCreateInfo createInfo{XR_TYPE_INSTANCE_CREATE_INFO};
         createInfo.next = m_platformPlugin->GetInstanceCreateExtension();
         createInfo.enabledExtensionCount = (uint32_t)extensions.size();
@@ -233,9 +552,36 @@ struct OpenXrProgram : IOpenXrProgram {
         createInfo.applicationInfo.apiVersion = XR_CURRENT_API_VERSION;
 
         CHECK_XRCMD(xrCreateInstance(&createInfo, &m_instance));
+
+#if defined(XR_KHR_locate_spaces)
+        if (locateSpacesSupported) {
+            CHECK_XRCMD(xrGetInstanceProcAddr(m_instance, "xrLocateSpacesKHR",
+                                              reinterpret_cast<PFN_xrVoidFunction*>(&m_pfnLocateSpacesKHR)));
+        }
+        Log::Write(Log::Level::Info, Fmt("Space location: %s", m_pfnLocateSpacesKHR != nullptr ? "batched" : "per space"));
+#endif
+
+#if defined(XR_FB_foveation) && defined(XR_FB_foveation_configuration) && defined(XR_FB_swapchain_update_state)
+        if (foveationSupported) {
+            CHECK_XRCMD(xrGetInstanceProcAddr(m_instance, "xrCreateFoveationProfileFB",
+                                              reinterpret_cast<PFN_xrVoidFunction*>(&m_pfnCreateFoveationProfileFB)));
+            CHECK_XRCMD(xrGetInstanceProcAddr(m_instance, "xrDestroyFoveationProfileFB",
+                                              reinterpret_cast<PFN_xrVoidFunction*>(&m_pfnDestroyFoveationProfileFB)));
+            CHECK_XRCMD(xrGetInstanceProcAddr(m_instance, "xrUpdateSwapchainFB",
+                                              reinterpret_cast<PFN_xrVoidFunction*>(&m_pfnUpdateSwapchainFB)));
+        }
+#endif
     }
 
     void CreateInstance() override {
+        ScopedStartupStage stage("create instance");
+
+        // Device-independent graphics setup, such as shader compilation, runs as a job while the instance and system are
+        // created, and the graphics device waits for it. A reused device already has everything it prepared.
+        if (!m_reuseGraphicsDevice) {
+            AddStartupStage(m_startupJobs, "prepare graphics resources", [this]() { m_graphicsPlugin->PrepareResources(); });
+        }
+
         LogLayersAndExtensions();
 
         CreateInstanceInternal();
@@ -256,14 +602,13 @@ struct OpenXrProgram : IOpenXrProgram {
 
         Log::Write(Log::Level::Info, Fmt("Available View Configuration Types: (%d)", viewConfigTypeCount));
         for (XrViewConfigurationType viewConfigType : viewConfigTypes) {
-            Log::Write(Log::Level::Verbose, Fmt("  View Configuration Type: %s %s", to_string(viewConfigType),
-                                                viewConfigType == m_viewConfigType ? "(Selected)" : ""));
+            LOG_VERBOSE(Fmt("  View Configuration Type: %s %s", to_string(viewConfigType),
+                            viewConfigType == m_viewConfigType ? "(Selected)" : ""));
 
             XrViewConfigurationProperties viewConfigProperties{XR_TYPE_VIEW_CONFIGURATION_PROPERTIES};
             CHECK_XRCMD(xrGetViewConfigurationProperties(m_instance, m_systemId, viewConfigType, &viewConfigProperties));
 
-            Log::Write(Log::Level::Verbose,
-                       Fmt("  View configuration FovMutable=%s", viewConfigProperties.fovMutable == XR_TRUE ? "True" : "False"));
+            LOG_VERBOSE(Fmt("  View configuration FovMutable=%s", viewConfigProperties.fovMutable == XR_TRUE ? "True" : "False"));
 
             uint32_t viewCount;
             CHECK_XRCMD(xrEnumerateViewConfigurationViews(m_instance, m_systemId, viewConfigType, 0, &viewCount, nullptr));
@@ -275,12 +620,11 @@ struct OpenXrProgram : IOpenXrProgram {
                 for (uint32_t i = 0; i < views.size(); i++) {
                     const XrViewConfigurationView& view = views[i];
 
-                    Log::Write(Log::Level::Verbose, Fmt("    View [%d]: Recommended Width=%d Height=%d SampleCount=%d", i,
-                                                        view.recommendedImageRectWidth, view.recommendedImageRectHeight,
-                                                        view.recommendedSwapchainSampleCount));
-                    Log::Write(Log::Level::Verbose,
-                               Fmt("    View [%d]:     Maximum Width=%d Height=%d SampleCount=%d", i, view.maxImageRectWidth,
-                                   view.maxImageRectHeight, view.maxSwapchainSampleCount));
+                    LOG_VERBOSE(Fmt("    View [%d]: Recommended Width=%d Height=%d SampleCount=%d", i,
+                                    view.recommendedImageRectWidth, view.recommendedImageRectHeight,
+                                    view.recommendedSwapchainSampleCount));
+                    LOG_VERBOSE(Fmt("    View [%d]:     Maximum Width=%d Height=%d SampleCount=%d", i, view.maxImageRectWidth,
+                                    view.maxImageRectHeight, view.maxSwapchainSampleCount));
                 }
             } else {
                 Log::Write(Log::Level::Error, Fmt("Empty view configuration type"));
@@ -313,27 +657,65 @@ struct OpenXrProgram : IOpenXrProgram {
         CHECK(blendModeFound);
     }
 
-    void InitializeSystem() override {
+    bool InitializeSystem() override {
         CHECK(m_instance != XR_NULL_HANDLE);
         CHECK(m_systemId == XR_NULL_SYSTEM_ID);
 
-        m_formFactor = GetXrFormFactor(m_options->FormFactor);
-        m_viewConfigType = GetXrViewConfigurationType(m_options->ViewConfiguration);
-        m_environmentBlendMode = GetXrEnvironmentBlendMode(m_options->EnvironmentBlendMode);
+        {
+            ScopedStartupStage stage("initialize system");
+            m_formFactor = GetXrFormFactor(m_options->FormFactor);
+            m_viewConfigType = GetXrViewConfigurationType(m_options->ViewConfiguration);
+            m_environmentBlendMode = GetXrEnvironmentBlendMode(m_options->EnvironmentBlendMode);
 
-        XrSystemGetInfo systemInfo{XR_TYPE_SYSTEM_GET_INFO};
-        systemInfo.formFactor = m_formFactor;
-        CHECK_XRCMD(xrGetSystem(m_instance, &systemInfo, &m_systemId));
+            XrSystemGetInfo systemInfo{XR_TYPE_SYSTEM_GET_INFO};
+            systemInfo.formFactor = m_formFactor;
+            CHECK_XRCMD(xrGetSystem(m_instance, &systemInfo, &m_systemId));
 
-        Log::Write(Log::Level::Verbose, Fmt("Using system %d for form factor %s", m_systemId, to_string(m_formFactor)));
-        CHECK(m_instance != XR_NULL_HANDLE);
-        CHECK(m_systemId != XR_NULL_SYSTEM_ID);
+            LOG_VERBOSE(Fmt("Using system %d for form factor %s", m_systemId, to_string(m_formFactor)));
+            CHECK(m_instance != XR_NULL_HANDLE);
+            CHECK(m_systemId != XR_NULL_SYSTEM_ID);
 
-        LogViewConfigurations();
+            LogViewConfigurations();
+        }
+
+        if (!m_reuseGraphicsDevice) {
+            ScopedStartupStage waitStage("wait for graphics resources");
+            m_startupJobs.Wait();
+        }
 
-        // The graphics API can initialize the graphics device now that the systemId and instance
-        // handle are available.
-        m_graphicsPlugin->InitializeDevice(m_instance, m_systemId);
+        if (m_reuseGraphicsDevice) {
+            ScopedStartupStage deviceStage("reuse graphics device");
+            if (!m_graphicsPlugin->ReuseDevice(m_instance, m_systemId)) {
+                return false;
+            }
+        } else {
+            // The graphics API can initialize the graphics device now that the systemId and instance
+            // handle are available.
+            ScopedStartupStage deviceStage("initialize graphics device");
+            m_graphicsPlugin->InitializeDevice(m_instance, m_systemId);
+        }
+
+        InitializeCubeGrids();
+        return true;
+    }
+
+    // Upload the mesh of the extra and benchmark cube grids and add the extra cube grid to the scene. Meshes live on the
+    // graphics device, so this runs again for every instance, ReuseDevice having released the meshes of the earlier one.
+    void InitializeCubeGrids() {
+        if (!m_options->Mesh.empty()) {
+            ScopedStartupStage meshStage("load mesh");
+            // The plugin has copied the data by the time AddMesh returns, so the file is only mapped this long.
+            const MappedMesh mesh(m_options->Mesh);
+            m_gridMesh = m_graphicsPlugin->AddMesh(mesh.Data());
+            m_scene.SetMeshExtent(m_gridMesh, mesh.Data().Extent());
+            m_frustumCuller.SetMesh(m_gridMesh, mesh.Data());
+        }
+
+        if (m_options->ExtraCubes > 0) {
+            std::vector<Cube> extraCubes;
+            AddCubeGrid(extraCubes, m_options->ExtraCubes, m_gridMesh);
+            m_scene.Append(extraCubes);
+        }
     }
 
     void LogReferenceSpaces() {
@@ -346,7 +728,7 @@ struct OpenXrProgram : IOpenXrProgram {
 
         Log::Write(Log::Level::Info, Fmt("Available reference spaces: %d", spaceCount));
         for (XrReferenceSpaceType space : spaces) {
-            Log::Write(Log::Level::Verbose, Fmt("  Name: %s", to_string(space)));
+            LOG_VERBOSE(Fmt("  Name: %s", to_string(space)));
         }
     }
 
@@ -359,7 +741,6 @@ struct OpenXrProgram : IOpenXrProgram {
         std::array<XrPath, Side::COUNT> handSubactionPath;
         std::array<XrSpace, Side::COUNT> handSpace;
         std::array<float, Side::COUNT> handScale = {{1.0f, 1.0f}};
-        std::array<XrBool32, Side::COUNT> handActive;
     };
 
     void InitializeActions() {
@@ -550,6 +931,15 @@ struct OpenXrProgram : IOpenXrProgram {
         attachInfo.countActionSets = 1;
         attachInfo.actionSets = &m_input.actionSet;
         CHECK_XRCMD(xrAttachSessionActionSets(m_session, &attachInfo));
+
+        InputSampler::Actions sampledActions;
+        sampledActions.ActionSet = m_input.actionSet;
+        sampledActions.Grab = m_input.grabAction;
+        sampledActions.Pose = m_input.poseAction;
+        sampledActions.Vibrate = m_input.vibrateAction;
+        sampledActions.Quit = m_input.quitAction;
+        sampledActions.HandSubactionPaths = {m_input.handSubactionPath[Side::LEFT], m_input.handSubactionPath[Side::RIGHT]};
+        m_inputSampler.SetActions(sampledActions);
     }
 
     void CreateVisualizedSpaces() {
@@ -572,11 +962,12 @@ struct OpenXrProgram : IOpenXrProgram {
     }
 
     void InitializeSession() override {
+        ScopedStartupStage stage("initialize session");
         CHECK(m_instance != XR_NULL_HANDLE);
         CHECK(m_session == XR_NULL_HANDLE);
 
         {
-            Log::Write(Log::Level::Verbose, Fmt("Creating session..."));
+            LOG_VERBOSE(Fmt("Creating session..."));
 
             XrSessionCreateInfo createInfo{XR_TYPE_SESSION_CREATE_INFO};
             createInfo.next = m_graphicsPlugin->GetGraphicsBinding();
@@ -592,16 +983,52 @@ struct OpenXrProgram : IOpenXrProgram {
             XrReferenceSpaceCreateInfo referenceSpaceCreateInfo = GetXrReferenceSpaceCreateInfo(m_options->AppSpace);
             CHECK_XRCMD(xrCreateReferenceSpace(m_session, &referenceSpaceCreateInfo, &m_appSpace));
         }
+
+#if defined(XR_KHR_locate_spaces)
+        // Spaces located together each frame: the visualized spaces followed by the left and right hands.
+        m_locateSpaces = m_visualizedSpaces;
+        for (auto hand : {Side::LEFT, Side::RIGHT}) {
+            m_locateSpaces.push_back(m_input.handSpace[hand]);
+        }
+        m_spaceLocations.resize(m_locateSpaces.size());
+#endif
+
+        // The graphics plugin calls back into LateLatchPoses from its render calls.
+        if (m_options->LateLatching) {
+            m_lateLatching = m_graphicsPlugin->SetLateLatchCallback([this]() { return LateLatchPoses(); });
+            if (!m_lateLatching) {
+                Log::Write(Log::Level::Warning, "Late latching is not supported by this graphics plugin, poses are located once");
+            }
+        }
     }
 
     void CreateSwapchains() override {
+        ScopedStartupStage stage("create swapchains");
         CHECK(m_session != XR_NULL_HANDLE);
         CHECK(m_swapchains.empty());
         CHECK(m_configViews.empty());
 
         // Read graphics properties for preferred swapchain length and logging.
         XrSystemProperties systemProperties{XR_TYPE_SYSTEM_PROPERTIES};
+#if defined(XR_META_foveation_eye_tracked)
+        XrSystemFoveationEyeTrackedPropertiesMETA eyeTrackedFoveationProperties{
+            XR_TYPE_SYSTEM_FOVEATION_EYE_TRACKED_PROPERTIES_META};
+        if (m_eyeTrackedFoveationSupported) {
+            systemProperties.next = &eyeTrackedFoveationProperties;
+        }
+#endif
+#if defined(XR_FB_space_warp)
+        XrSystemSpaceWarpPropertiesFB spaceWarpProperties{XR_TYPE_SYSTEM_SPACE_WARP_PROPERTIES_FB};
+        if (m_spaceWarpSupported) {
+            spaceWarpProperties.next = systemProperties.next;
+            systemProperties.next = &spaceWarpProperties;
+        }
+#endif
         CHECK_XRCMD(xrGetSystemProperties(m_instance, m_systemId, &systemProperties));
+#if defined(XR_META_foveation_eye_tracked)
+        m_eyeTrackedFoveationSupported =
+            m_eyeTrackedFoveationSupported && eyeTrackedFoveationProperties.supportsFoveationEyeTracked == XR_TRUE;
+#endif
 
         // Log system properties.
         Log::Write(Log::Level::Info,
@@ -614,10 +1041,14 @@ struct OpenXrProgram : IOpenXrProgram {
                                          systemProperties.trackingProperties.orientationTracking == XR_TRUE ? "True" : "False",
                                          systemProperties.trackingProperties.positionTracking == XR_TRUE ? "True" : "False"));
 
-        // Note: No other view configurations exist at the time this code was written. If this
-        // condition is not met, the project will need to be audited to see how support should be
-        // added.
-        CHECK_MSG(m_viewConfigType == XR_VIEW_CONFIGURATION_TYPE_PRIMARY_STEREO, "Unsupported view configuration type");
+        // Every view gets its own swapchain and is rendered the same way, so any number of views works, but view
+        // configurations that need more than that, such as a secondary view, must be audited before they are added here.
+        bool viewConfigSupported = m_viewConfigType == XR_VIEW_CONFIGURATION_TYPE_PRIMARY_MONO ||
+                                   m_viewConfigType == XR_VIEW_CONFIGURATION_TYPE_PRIMARY_STEREO;
+#if defined(XR_VARJO_quad_views)
+        viewConfigSupported = viewConfigSupported || m_viewConfigType == XR_VIEW_CONFIGURATION_TYPE_PRIMARY_QUAD_VARJO;
+#endif
+        CHECK_MSG(viewConfigSupported, "Unsupported view configuration type");
 
         // Query and cache view configuration views.
         uint32_t viewCount;
@@ -629,6 +1060,11 @@ struct OpenXrProgram : IOpenXrProgram {
         // Create and cache view buffer for xrLocateViews later.
         m_views.resize(viewCount, {XR_TYPE_VIEW});
 
+        if (m_headless) {
+            Log::Write(Log::Level::Info, "Headless session, no swapchains are created");
+            return;
+        }
+
         // Create the swapchain and get the images.
         if (viewCount > 0) {
             // Select a swapchain format.
@@ -638,7 +1074,23 @@ struct OpenXrProgram : IOpenXrProgram {
             CHECK_XRCMD(xrEnumerateSwapchainFormats(m_session, (uint32_t)swapchainFormats.size(), &swapchainFormatCount,
                                                     swapchainFormats.data()));
             CHECK(swapchainFormatCount == swapchainFormats.size());
-            m_colorSwapchainFormat = m_graphicsPlugin->SelectColorSwapchainFormat(swapchainFormats);
+
+            // The swapchain policy ranks the plugin's candidates by their framebuffer traffic and precision. The Default
+            // policy, or one that finds no candidate the runtime supports, leaves the choice to the plugin.
+            const std::vector<ColorFormatInfo> colorFormatCandidates = m_graphicsPlugin->GetColorSwapchainFormatCandidates();
+            const ColorFormatInfo* colorFormat =
+                SelectColorFormat(m_swapchainPolicy, colorFormatCandidates, swapchainFormats,
+                                  m_environmentBlendMode == XR_ENVIRONMENT_BLEND_MODE_ALPHA_BLEND);
+            if (colorFormat != nullptr) {
+                m_colorSwapchainFormat = colorFormat->Format;
+            } else {
+                if (m_swapchainPolicy != SwapchainPolicy::Default) {
+                    Log::Write(Log::Level::Warning, Fmt("Swapchain policy %s: no candidate format is supported by the runtime",
+                                                        to_string(m_swapchainPolicy)));
+                }
+                m_colorSwapchainFormat = m_graphicsPlugin->SelectColorSwapchainFormat(swapchainFormats);
+                colorFormat = FindColorFormat(colorFormatCandidates, m_colorSwapchainFormat);
+            }
 
             // Print swapchain formats and the selected one.
             {
@@ -654,43 +1106,243 @@ struct OpenXrProgram : IOpenXrProgram {
                         swapchainFormatsString += "]";
                     }
                 }
-                Log::Write(Log::Level::Verbose, Fmt("Swapchain Formats: %s", swapchainFormatsString.c_str()));
+                LOG_VERBOSE(Fmt("Swapchain Formats: %s", swapchainFormatsString.c_str()));
+            }
+
+            // Render all views into the layers of a single array swapchain when single-pass stereo was requested, the
+            // graphics plugin supports it and every view has the same recommended size. Otherwise use a swapchain per view.
+            // The multiview shaders hold exactly two view-projections.
+            const XrViewConfigurationView& firstView = m_configViews[0];
+            m_singlePassStereo =
+                m_options->SinglePassStereo && viewCount == 2 && m_graphicsPlugin->SupportsMultiview() &&
+                std::all_of(m_configViews.begin(), m_configViews.end(), [&](const XrViewConfigurationView& vp) {
+                    return vp.recommendedImageRectWidth == firstView.recommendedImageRectWidth &&
+                           vp.recommendedImageRectHeight == firstView.recommendedImageRectHeight &&
+                           vp.recommendedSwapchainSampleCount == firstView.recommendedSwapchainSampleCount;
+                });
+            if (m_options->SinglePassStereo && !m_singlePassStereo) {
+                Log::Write(Log::Level::Warning, "Single-pass stereo is not available, falling back to a swapchain per view");
+            }
+            const uint32_t swapchainCount = m_singlePassStereo ? 1 : viewCount;
+            const uint32_t swapchainArraySize = m_singlePassStereo ? viewCount : 1;
+
+            // Foveate through the runtime where it can take the plugin's swapchains as they are, otherwise vary the shading
+            // rate in the graphics plugin, which must happen before the swapchains are allocated.
+            const char* foveationPath = "off";
+            bool runtimeFoveation = false;
+            if (m_foveationLevel != FoveationLevel::Off) {
+#if defined(XR_FB_foveation) && defined(XR_FB_foveation_configuration) && defined(XR_FB_swapchain_update_state)
+                runtimeFoveation = m_pfnUpdateSwapchainFB != nullptr && m_graphicsPlugin->SupportsSwapchainFoveation();
+#endif
+                if (runtimeFoveation) {
+                    foveationPath = m_eyeTrackedFoveationSupported ? "runtime, eye tracked" : "runtime";
+                } else if (m_graphicsPlugin->EnableFoveatedShading(m_foveationLevel)) {
+                    foveationPath = "variable-rate shading";
+                } else {
+                    Log::Write(Log::Level::Warning, "Foveation is not supported by the runtime or the graphics device");
+                }
+            }
+            Log::Write(Log::Level::Info, Fmt("Foveation: %s (%s)", to_string(m_foveationLevel), foveationPath));
+
+            // Depth is submitted if the runtime takes depth layers in a format the plugin can render depth into.
+            if (m_depthLayerSupported) {
+                m_depthSwapchainFormat = m_graphicsPlugin->SelectDepthSwapchainFormat(swapchainFormats);
             }
 
-            // Create a swapchain for each view.
-            for (uint32_t i = 0; i < viewCount; i++) {
+            // Samples resolved on tile never reach memory, so they are preferred to multisampled swapchains, and the
+            // swapchains are single-sampled with them. Like foveated shading this must happen before they are allocated.
+            const uint32_t onTileSampleCount = m_graphicsPlugin->EnableOnTileMultisampling(
+                OnTileSampleCount(m_swapchainPolicy), m_singlePassStereo, m_depthSwapchainFormat != -1);
+
+            // Create a swapchain for each view, or one array swapchain for all of them. With dynamic resolution they are
+            // allocated larger than recommended so the rendered area can grow as well as shrink.
+            std::vector<XrSwapchainCreateInfo> swapchainCreateInfos;
+            float maxResolutionScale = MaxResolutionScale;
+            for (uint32_t i = 0; i < swapchainCount; i++) {
                 const XrViewConfigurationView& vp = m_configViews[i];
+                uint32_t width = vp.recommendedImageRectWidth;
+                uint32_t height = vp.recommendedImageRectHeight;
+                if (m_options->DynamicResolution) {
+                    width = std::min(vp.maxImageRectWidth, (uint32_t)std::ceil(width * MaxResolutionScale));
+                    height = std::min(vp.maxImageRectHeight, (uint32_t)std::ceil(height * MaxResolutionScale));
+                    maxResolutionScale = std::min({maxResolutionScale, (float)width / vp.recommendedImageRectWidth,
+                                                   (float)height / vp.recommendedImageRectHeight});
+                }
+                const uint32_t sampleCount = onTileSampleCount == 1 && AllowsSwapchainSamples(m_swapchainPolicy)
+                                                 ? m_graphicsPlugin->GetSupportedSwapchainSampleCount(vp)
+                                                 : 1;
                 Log::Write(Log::Level::Info,
-                           Fmt("Creating swapchain for view %d with dimensions Width=%d Height=%d SampleCount=%d", i,
-                               vp.recommendedImageRectWidth, vp.recommendedImageRectHeight, vp.recommendedSwapchainSampleCount));
+                           Fmt("Creating swapchain for view %d with dimensions Width=%d Height=%d SampleCount=%d ArraySize=%d", i,
+                               width, height, sampleCount, swapchainArraySize));
 
                 // Create the swapchain.
                 XrSwapchainCreateInfo swapchainCreateInfo{XR_TYPE_SWAPCHAIN_CREATE_INFO};
-                swapchainCreateInfo.arraySize = 1;
+                swapchainCreateInfo.arraySize = swapchainArraySize;
                 swapchainCreateInfo.format = m_colorSwapchainFormat;
-                swapchainCreateInfo.width = vp.recommendedImageRectWidth;
-                swapchainCreateInfo.height = vp.recommendedImageRectHeight;
+                swapchainCreateInfo.width = width;
+                swapchainCreateInfo.height = height;
                 swapchainCreateInfo.mipCount = 1;
                 swapchainCreateInfo.faceCount = 1;
-                swapchainCreateInfo.sampleCount = m_graphicsPlugin->GetSupportedSwapchainSampleCount(vp);
-                swapchainCreateInfo.usageFlags = XR_SWAPCHAIN_USAGE_SAMPLED_BIT | XR_SWAPCHAIN_USAGE_COLOR_ATTACHMENT_BIT;
-                Swapchain swapchain;
-                swapchain.width = swapchainCreateInfo.width;
-                swapchain.height = swapchainCreateInfo.height;
-                CHECK_XRCMD(xrCreateSwapchain(m_session, &swapchainCreateInfo, &swapchain.handle));
-
-                m_swapchains.push_back(swapchain);
-
-                uint32_t imageCount;
-                CHECK_XRCMD(xrEnumerateSwapchainImages(swapchain.handle, 0, &imageCount, nullptr));
-                // XXX This should really just return XrSwapchainImageBaseHeader*
-                std::vector<XrSwapchainImageBaseHeader*> swapchainImages =
-                    m_graphicsPlugin->AllocateSwapchainImageStructs(imageCount, swapchainCreateInfo);
-                CHECK_XRCMD(xrEnumerateSwapchainImages(swapchain.handle, imageCount, &imageCount, swapchainImages[0]));
-
-                m_swapchainImages.insert(std::make_pair(swapchain.handle, std::move(swapchainImages)));
+                swapchainCreateInfo.sampleCount = sampleCount;
+                swapchainCreateInfo.usageFlags = XR_SWAPCHAIN_USAGE_SAMPLED_BIT | XR_SWAPCHAIN_USAGE_COLOR_ATTACHMENT_BIT |
+                                                 m_graphicsPlugin->GetColorSwapchainUsageFlags();
+                m_swapchains.push_back(CreateSwapchain(swapchainCreateInfo));
+                swapchainCreateInfos.push_back(swapchainCreateInfo);
+                if (runtimeFoveation) {
+                    ApplyFoveationProfile(m_swapchains.back().handle);
+                }
+            }
+
+            // Create a depth swapchain matching each color swapchain. They come after all the color swapchains, so those keep
+            // their numbering in the graphics plugin.
+            if (m_depthLayerSupported) {
+                if (m_depthSwapchainFormat == -1) {
+                    Log::Write(Log::Level::Warning,
+                               "No runtime swapchain format supported for depth swapchain, depth is not submitted");
+                } else {
+                    for (XrSwapchainCreateInfo swapchainCreateInfo : swapchainCreateInfos) {
+                        swapchainCreateInfo.format = m_depthSwapchainFormat;
+                        // The compositor samples the depth when it reprojects.
+                        swapchainCreateInfo.usageFlags =
+                            XR_SWAPCHAIN_USAGE_SAMPLED_BIT | XR_SWAPCHAIN_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+                        m_depthSwapchains.push_back(CreateSwapchain(swapchainCreateInfo));
+                    }
+                }
+            }
+            Log::Write(Log::Level::Info, Fmt("Depth submission: %s", m_depthSwapchains.empty() ? "off" : "on"));
+            LogFramebufferTraffic(colorFormat, swapchainCreateInfos, onTileSampleCount);
+
+#if defined(XR_FB_space_warp)
+            if (m_spaceWarpSupported) {
+                CreateMotionVectorSwapchains(swapchainFormats, spaceWarpProperties);
             }
+            Log::Write(Log::Level::Info, Fmt("Space warp: %s", m_motionVectorSwapchains.empty() ? "off" : "on"));
+#endif
+
+            if (m_options->DynamicResolution) {
+                m_resolutionScaler = std::make_unique<ResolutionScaler>(MinResolutionScale, maxResolutionScale);
+                Log::Write(Log::Level::Info, Fmt("Dynamic resolution: scale %.2f to %.2f of the recommended size",
+                                                 MinResolutionScale, maxResolutionScale));
+            }
+        }
+    }
+
+#if defined(XR_FB_space_warp)
+    // Create a motion vector swapchain and a depth swapchain for it per view, at the size the system recommends for motion
+    // vectors. They come after the color and depth swapchains. The array swapchain of single-pass stereo has no motion
+    // vector counterpart, as the plugins only render motion vectors through RenderViews.
+    void CreateMotionVectorSwapchains(const std::vector<int64_t>& swapchainFormats,
+                                      const XrSystemSpaceWarpPropertiesFB& spaceWarpProperties) {
+        if (m_singlePassStereo) {
+            Log::Write(Log::Level::Warning, "Space warp needs a swapchain per view, motion vectors are not submitted");
+            return;
+        }
+        const int64_t motionVectorFormat = m_graphicsPlugin->SelectMotionVectorSwapchainFormat(swapchainFormats);
+        const int64_t depthFormat =
+            m_depthSwapchainFormat != -1 ? m_depthSwapchainFormat : m_graphicsPlugin->SelectDepthSwapchainFormat(swapchainFormats);
+        if (motionVectorFormat == -1 || depthFormat == -1) {
+            Log::Write(Log::Level::Warning,
+                       "No runtime swapchain format supported for motion vectors or their depth, motion vectors are not submitted");
+            return;
+        }
+
+        XrSwapchainCreateInfo swapchainCreateInfo{XR_TYPE_SWAPCHAIN_CREATE_INFO};
+        swapchainCreateInfo.arraySize = 1;
+        swapchainCreateInfo.width = spaceWarpProperties.recommendedMotionVectorImageRectWidth;
+        swapchainCreateInfo.height = spaceWarpProperties.recommendedMotionVectorImageRectHeight;
+        swapchainCreateInfo.mipCount = 1;
+        swapchainCreateInfo.faceCount = 1;
+        swapchainCreateInfo.sampleCount = 1;
+        Log::Write(Log::Level::Info, Fmt("Creating motion vector swapchains with dimensions Width=%d Height=%d",
+                                         swapchainCreateInfo.width, swapchainCreateInfo.height));
+        m_graphicsPlugin->SetAllocatingMotionVectorSwapchains(true);
+        for (size_t i = 0; i < m_swapchains.size(); i++) {
+            swapchainCreateInfo.format = motionVectorFormat;
+            swapchainCreateInfo.usageFlags = XR_SWAPCHAIN_USAGE_SAMPLED_BIT | XR_SWAPCHAIN_USAGE_COLOR_ATTACHMENT_BIT;
+            m_motionVectorSwapchains.push_back(CreateSwapchain(swapchainCreateInfo));
+            swapchainCreateInfo.format = depthFormat;
+            swapchainCreateInfo.usageFlags = XR_SWAPCHAIN_USAGE_SAMPLED_BIT | XR_SWAPCHAIN_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+            m_motionVectorDepthSwapchains.push_back(CreateSwapchain(swapchainCreateInfo));
+        }
+        m_graphicsPlugin->SetAllocatingMotionVectorSwapchains(false);
+    }
+#endif
+
+    // Log the format and samples the color swapchains were created with and, where the plugin describes the format, the
+    // framebuffer traffic per frame they are estimated to cost at their allocated size.
+    void LogFramebufferTraffic(const ColorFormatInfo* colorFormat, const std::vector<XrSwapchainCreateInfo>& swapchainCreateInfos,
+                               uint32_t onTileSampleCount) const {
+        const uint32_t swapchainSampleCount = swapchainCreateInfos.empty() ? 1 : swapchainCreateInfos[0].sampleCount;
+        const std::string samples = onTileSampleCount > 1      ? Fmt("%ux MSAA resolved on tile", onTileSampleCount)
+                                    : swapchainSampleCount > 1 ? Fmt("%ux MSAA swapchains", swapchainSampleCount)
+                                                               : std::string("no MSAA");
+        if (colorFormat == nullptr) {
+            Log::Write(Log::Level::Info, Fmt("Swapchain policy %s: format %lld, %s", to_string(m_swapchainPolicy),
+                                             (long long)m_colorSwapchainFormat, samples.c_str()));
+            return;
+        }
+
+        uint64_t traffic = 0;
+        for (const XrSwapchainCreateInfo& swapchainCreateInfo : swapchainCreateInfos) {
+            const uint64_t pixels =
+                (uint64_t)swapchainCreateInfo.width * swapchainCreateInfo.height * swapchainCreateInfo.arraySize;
+            traffic +=
+                EstimateFramebufferTraffic(*colorFormat, pixels, swapchainCreateInfo.sampleCount, !m_depthSwapchains.empty());
+        }
+        Log::Write(Log::Level::Info,
+                   Fmt("Swapchain policy %s: %s (%u B/px%s), %s, ~%.1f MB of framebuffer traffic per frame",
+                       to_string(m_swapchainPolicy), colorFormat->Name, colorFormat->BytesPerPixel,
+                       colorFormat->Compressible ? ", compressible" : "", samples.c_str(), traffic / (1024.0 * 1024.0)));
+    }
+
+    Swapchain CreateSwapchain(const XrSwapchainCreateInfo& swapchainCreateInfo) {
+        Swapchain swapchain;
+        swapchain.width = swapchainCreateInfo.width;
+        swapchain.height = swapchainCreateInfo.height;
+        CHECK_XRCMD(xrCreateSwapchain(m_session, &swapchainCreateInfo, &swapchain.handle));
+
+        uint32_t imageCount;
+        CHECK_XRCMD(xrEnumerateSwapchainImages(swapchain.handle, 0, &imageCount, nullptr));
+        // XXX This should really just return XrSwapchainImageBaseHeader*
+        std::vector<XrSwapchainImageBaseHeader*> swapchainImages;
+        swapchain.index = m_graphicsPlugin->AllocateSwapchainImageStructs(imageCount, swapchainCreateInfo, swapchainImages);
+        CHECK_XRCMD(xrEnumerateSwapchainImages(swapchain.handle, imageCount, &imageCount, swapchainImages[0]));
+
+        return swapchain;
+    }
+
+    // Have the runtime foveate a color swapchain at m_foveationLevel. The profile is only needed while it is applied.
+    void ApplyFoveationProfile(XrSwapchain swapchain) {
+#if defined(XR_FB_foveation) && defined(XR_FB_foveation_configuration) && defined(XR_FB_swapchain_update_state)
+        XrFoveationLevelProfileCreateInfoFB levelProfileInfo{XR_TYPE_FOVEATION_LEVEL_PROFILE_CREATE_INFO_FB};
+        levelProfileInfo.level = m_foveationLevel == FoveationLevel::High     ? XR_FOVEATION_LEVEL_HIGH_FB
+                                 : m_foveationLevel == FoveationLevel::Medium ? XR_FOVEATION_LEVEL_MEDIUM_FB
+                                                                              : XR_FOVEATION_LEVEL_LOW_FB;
+        levelProfileInfo.verticalOffset = 0;
+        levelProfileInfo.dynamic = XR_FOVEATION_DYNAMIC_DISABLED_FB;
+
+        XrFoveationProfileCreateInfoFB profileInfo{XR_TYPE_FOVEATION_PROFILE_CREATE_INFO_FB};
+        profileInfo.next = &levelProfileInfo;
+#if defined(XR_META_foveation_eye_tracked)
+        // Center the foveation on the gaze instead of on each view.
+        XrFoveationEyeTrackedProfileCreateInfoMETA eyeTrackedProfileInfo{XR_TYPE_FOVEATION_EYE_TRACKED_PROFILE_CREATE_INFO_META};
+        if (m_eyeTrackedFoveationSupported) {
+            levelProfileInfo.next = &eyeTrackedProfileInfo;
         }
+#endif
+
+        XrFoveationProfileFB profile{XR_NULL_HANDLE};
+        CHECK_XRCMD(m_pfnCreateFoveationProfileFB(m_session, &profileInfo, &profile));
+
+        XrSwapchainStateFoveationFB foveationState{XR_TYPE_SWAPCHAIN_STATE_FOVEATION_FB};
+        foveationState.profile = profile;
+        const XrResult result =
+            m_pfnUpdateSwapchainFB(swapchain, reinterpret_cast<const XrSwapchainStateBaseHeaderFB*>(&foveationState));
+        CHECK_XRCMD(m_pfnDestroyFoveationProfileFB(profile));
+        CHECK_XRRESULT(result, "xrUpdateSwapchainFB");
+#else
+        (void)swapchain;
+#endif
     }
 
     // Return event if one is available, otherwise return null.
@@ -714,22 +1366,30 @@ struct OpenXrProgram : IOpenXrProgram {
         THROW_XR(xr, "xrPollEvent");
     }
 
-    void PollEvents(bool* exitRenderLoop, bool* requestRestart) override {
+    bool PollEvents(bool* exitRenderLoop, bool* requestRestart) override {
         *exitRenderLoop = *requestRestart = false;
 
+        // An event read now may have been queued at any time since the previous poll.
+        const auto pollTime = std::chrono::steady_clock::now();
+        const double queuedMilliseconds = std::chrono::duration<double, std::milli>(pollTime - m_lastEventPoll).count();
+        m_lastEventPoll = pollTime;
+
         // Process all pending messages.
+        bool anyEvents = false;
         while (const XrEventDataBaseHeader* event = TryReadNextEvent()) {
+            anyEvents = true;
             switch (event->type) {
                 case XR_TYPE_EVENT_DATA_INSTANCE_LOSS_PENDING: {
                     const auto& instanceLossPending = *reinterpret_cast<const XrEventDataInstanceLossPending*>(event);
                     Log::Write(Log::Level::Warning, Fmt("XrEventDataInstanceLossPending by %lld", instanceLossPending.lossTime));
                     *exitRenderLoop = true;
                     *requestRestart = true;
-                    return;
+                    return true;
                 }
                 case XR_TYPE_EVENT_DATA_SESSION_STATE_CHANGED: {
                     auto sessionStateChangedEvent = *reinterpret_cast<const XrEventDataSessionStateChanged*>(event);
                     HandleSessionStateChangedEvent(sessionStateChangedEvent, exitRenderLoop, requestRestart);
+                    BeginStateChangeLatency(to_string(sessionStateChangedEvent.state), queuedMilliseconds);
                     break;
                 }
                 case XR_TYPE_EVENT_DATA_INTERACTION_PROFILE_CHANGED:
@@ -740,11 +1400,12 @@ struct OpenXrProgram : IOpenXrProgram {
                     break;
                 case XR_TYPE_EVENT_DATA_REFERENCE_SPACE_CHANGE_PENDING:
                 default: {
-                    Log::Write(Log::Level::Verbose, Fmt("Ignoring event type %d", event->type));
+                    LOG_VERBOSE(Fmt("Ignoring event type %d", event->type));
                     break;
                 }
             }
         }
+        return anyEvents;
     }
 
     void HandleSessionStateChangedEvent(const XrEventDataSessionStateChanged& stateChangedEvent, bool* exitRenderLoop,
@@ -772,6 +1433,8 @@ struct OpenXrProgram : IOpenXrProgram {
             case XR_SESSION_STATE_STOPPING: {
                 CHECK(m_session != XR_NULL_HANDLE);
                 m_sessionRunning = false;
+                // A frame waited on by the frame thread is simply never begun.
+                DrainFramePipeline(true);
                 CHECK_XRCMD(xrEndSession(m_session))
                 break;
             }
@@ -834,110 +1497,250 @@ struct OpenXrProgram : IOpenXrProgram {
     bool IsSessionFocused() const override { return m_sessionState == XR_SESSION_STATE_FOCUSED; }
 
     void PollActions() override {
-        m_input.handActive = {XR_FALSE, XR_FALSE};
+        // In pipelined mode the frame thread samples the actions right after xrWaitFrame instead.
+        if (!m_options->PipelinedFrames) {
+            ScopedFramePhase phase(m_frames[0].timings, FramePhase::Actions);
+            SyncActions(m_frames[0].timings);
+        }
+    }
 
-        // Sync actions
-        const XrActiveActionSet activeActionSet{m_input.actionSet, XR_NULL_PATH};
-        XrActionsSyncInfo syncInfo{XR_TYPE_ACTIONS_SYNC_INFO};
-        syncInfo.countActiveActionSets = 1;
-        syncInfo.activeActionSets = &activeActionSet;
-        CHECK_XRCMD(xrSyncActions(m_session, &syncInfo));
+    // Sample every action once, into the input snapshot the rest of the frame reads.
+    void SyncActions(FrameTimings& timings) {
+        m_inputSampler.Sync(m_session);
+        const InputSnapshot& input = m_inputSampler.Snapshot();
 
-        // Get pose and grab action state and start haptic vibrate when hand is 90% squeezed.
+        // Scale the rendered hand by 1.0f (open) to 0.5f (fully squeezed), and vibrate it while it is 90% squeezed.
         for (auto hand : {Side::LEFT, Side::RIGHT}) {
-            XrActionStateGetInfo getInfo{XR_TYPE_ACTION_STATE_GET_INFO};
-            getInfo.action = m_input.grabAction;
-            getInfo.subactionPath = m_input.handSubactionPath[hand];
-
-            XrActionStateFloat grabValue{XR_TYPE_ACTION_STATE_FLOAT};
-            CHECK_XRCMD(xrGetActionStateFloat(m_session, &getInfo, &grabValue));
-            if (grabValue.isActive == XR_TRUE) {
-                // Scale the rendered hand by 1.0f (open) to 0.5f (fully squeezed).
-                m_input.handScale[hand] = 1.0f - 0.5f * grabValue.currentState;
-                if (grabValue.currentState > 0.9f) {
-                    XrHapticVibration vibration{XR_TYPE_HAPTIC_VIBRATION};
-                    vibration.amplitude = 0.5;
-                    vibration.duration = XR_MIN_HAPTIC_DURATION;
-                    vibration.frequency = XR_FREQUENCY_UNSPECIFIED;
-
-                    XrHapticActionInfo hapticActionInfo{XR_TYPE_HAPTIC_ACTION_INFO};
-                    hapticActionInfo.action = m_input.vibrateAction;
-                    hapticActionInfo.subactionPath = m_input.handSubactionPath[hand];
-                    CHECK_XRCMD(xrApplyHapticFeedback(m_session, &hapticActionInfo, (XrHapticBaseHeader*)&vibration));
-                }
+            if (input.GrabActive[hand]) {
+                m_input.handScale[hand] = 1.0f - 0.5f * input.Grab[hand];
             }
-
-            getInfo.action = m_input.poseAction;
-            XrActionStatePose poseState{XR_TYPE_ACTION_STATE_POSE};
-            CHECK_XRCMD(xrGetActionStatePose(m_session, &getInfo, &poseState));
-            m_input.handActive[hand] = poseState.isActive;
+            m_inputSampler.SetVibration(m_session, hand, input.GrabActive[hand] && input.Grab[hand] > 0.9f, 0.5f);
         }
 
-        // There were no subaction paths specified for the quit action, because we don't care which hand did it.
-        XrActionStateGetInfo getInfo{XR_TYPE_ACTION_STATE_GET_INFO, nullptr, m_input.quitAction, XR_NULL_PATH};
-        XrActionStateBoolean quitValue{XR_TYPE_ACTION_STATE_BOOLEAN};
-        CHECK_XRCMD(xrGetActionStateBoolean(m_session, &getInfo, &quitValue));
-        if ((quitValue.isActive == XR_TRUE) && (quitValue.changedSinceLastSync == XR_TRUE) && (quitValue.currentState == XR_TRUE)) {
+        if (input.QuitPressed) {
             CHECK_XRCMD(xrRequestExitSession(m_session));
         }
+
+        const InputCallCounts callCounts = m_inputSampler.TakeCallCounts();
+        timings.InputCalls += callCounts.RuntimeCalls;
+        timings.SkippedHaptics += callCounts.SkippedHaptics;
     }
 
     void RenderFrame() override {
         CHECK(m_session != XR_NULL_HANDLE);
+        m_benchmark.BeginFrame();
+
+        if (!m_options->PipelinedFrames) {
+            WaitFrame(m_frames[0]);
+            SubmitFrame(m_frames[0]);
+            return;
+        }
+
+        // Pipelined: the frame thread runs xrWaitFrame and the simulation for the next frame while this thread renders the
+        // current one. Its xrWaitFrame blocks until the xrBeginFrame below, as the spec requires.
+        if (!m_frameThreadCreated) {
+            CHECK_MSG(ksThread_Create(&m_frameThread, "xrWaitFrame", FrameThreadFunction, this), "Failed to create frame thread");
+            m_frameThreadCreated = true;
+        }
+        if (!m_framePending) {
+            StartWaitFrame();
+        }
+        PendingFrame& frame = FinishWaitFrame();
+        StartWaitFrame();
+        SubmitFrame(frame);
+    }
 
+    // xrWaitFrame plus the simulation of the frame it returns. Runs on the frame thread in pipelined mode.
+    void WaitFrame(PendingFrame& frame) {
         XrFrameWaitInfo frameWaitInfo{XR_TYPE_FRAME_WAIT_INFO};
-        XrFrameState frameState{XR_TYPE_FRAME_STATE};
-        CHECK_XRCMD(xrWaitFrame(m_session, &frameWaitInfo, &frameState));
+        frame.frameState = {XR_TYPE_FRAME_STATE};
+        {
+            ScopedFramePhase phase(frame.timings, FramePhase::Wait);
+            CHECK_XRCMD(xrWaitFrame(m_session, &frameWaitInfo, &frame.frameState));
+        }
+
+        if (m_options->PipelinedFrames) {
+            ScopedFramePhase phase(frame.timings, FramePhase::Actions);
+            SyncActions(frame.timings);
+        }
 
+        frame.cubes.clear();
+        frame.handCubes.fill(NoHandCube);
+        if (frame.frameState.shouldRender == XR_TRUE) {
+            ScopedFramePhase phase(frame.timings, FramePhase::LocateSpaces);
+            frame.locatedAt = FrameStatsNow();
+            LocateCubes(frame.frameState.predictedDisplayTime, frame.cubes, frame.handCubes);
+        }
+    }
+
+    void SubmitFrame(PendingFrame& frame) {
         XrFrameBeginInfo frameBeginInfo{XR_TYPE_FRAME_BEGIN_INFO};
-        CHECK_XRCMD(xrBeginFrame(m_session, &frameBeginInfo));
+        {
+            ScopedFramePhase phase(frame.timings, FramePhase::Begin);
+            CHECK_XRCMD(xrBeginFrame(m_session, &frameBeginInfo));
+        }
 
-        std::vector<XrCompositionLayerBaseHeader*> layers;
+        std::vector<XrCompositionLayerBaseHeader*>& layers = m_frameScratch.layers;
+        layers.clear();
         XrCompositionLayerProjection layer{XR_TYPE_COMPOSITION_LAYER_PROJECTION};
-        std::vector<XrCompositionLayerProjectionView> projectionLayerViews;
-        if (frameState.shouldRender == XR_TRUE) {
-            if (RenderLayer(frameState.predictedDisplayTime, projectionLayerViews, layer)) {
-                layers.push_back(reinterpret_cast<XrCompositionLayerBaseHeader*>(&layer));
+        std::vector<XrCompositionLayerProjectionView>& projectionLayerViews = m_frameScratch.projectionLayerViews;
+        bool rendered = false;
+        if (frame.frameState.shouldRender == XR_TRUE) {
+            if (RenderLayer(frame, projectionLayerViews, layer)) {
+                // Headless sessions have no swapchains to submit a layer with.
+                if (!m_headless) {
+                    layers.push_back(reinterpret_cast<XrCompositionLayerBaseHeader*>(&layer));
+                }
+                rendered = true;
             }
         }
 
         XrFrameEndInfo frameEndInfo{XR_TYPE_FRAME_END_INFO};
-        frameEndInfo.displayTime = frameState.predictedDisplayTime;
+        frameEndInfo.displayTime = frame.frameState.predictedDisplayTime;
         frameEndInfo.environmentBlendMode = m_environmentBlendMode;
         frameEndInfo.layerCount = (uint32_t)layers.size();
         frameEndInfo.layers = layers.data();
-        CHECK_XRCMD(xrEndFrame(m_session, &frameEndInfo));
+        {
+            ScopedFramePhase phase(frame.timings, FramePhase::End);
+            CHECK_XRCMD(xrEndFrame(m_session, &frameEndInfo));
+        }
+        if (rendered) {
+            ReportFirstFrame();
+        }
+        ReportStateChangeLatency();
+
+        const bool newGpuViewTimes =
+            (m_frameStats || m_resolutionScaler) && m_graphicsPlugin->TakeGpuViewTimes(m_gpuViewTimes);
+        if (m_resolutionScaler && newGpuViewTimes) {
+            uint64_t gpuFrameTime = 0;
+            for (uint64_t viewTime : m_gpuViewTimes) {
+                gpuFrameTime += viewTime;
+            }
+            m_resolutionScaler->Update(gpuFrameTime, frame.frameState.predictedDisplayPeriod);
+        }
+
+        if (m_frameStats) {
+            frame.timings.Allocations = (uint32_t)(AllocationCount() - m_allocationCount);
+            if (newGpuViewTimes) {
+                frame.timings.SetGpuViews(m_gpuViewTimes);
+            }
+            m_frameStats->Commit(frame.timings);
+            // Leave the stats' own reporting out of the next frame's count.
+            m_allocationCount = AllocationCount();
+        }
+        frame.timings.Reset();
+
+        if (rendered && m_benchmark.EndFrame()) {
+            Log::Write(Log::Level::Info, "Benchmark complete, exiting");
+            CHECK_XRCMD(xrRequestExitSession(m_session));
+        }
     }
 
-    bool RenderLayer(XrTime predictedDisplayTime, std::vector<XrCompositionLayerProjectionView>& projectionLayerViews,
-                     XrCompositionLayerProjection& layer) {
-        XrResult res;
+    static void FrameThreadFunction(void* data) {
+        OpenXrProgram* const program = static_cast<OpenXrProgram*>(data);
+        if (!program->m_frameThreadScheduled) {
+            // The frame thread paces the render thread, so it runs where and as urgently as the render thread does.
+            ApplyThreadScheduling("Frame", {program->m_options->RenderCores, program->m_options->RealTimePriority});
+            program->m_frameThreadScheduled = true;
+        }
+        try {
+            program->WaitFrame(program->m_frames[program->m_waitFrameIndex]);
+        } catch (...) {
+            program->m_frameThreadException = std::current_exception();
+        }
+    }
 
-        XrViewState viewState{XR_TYPE_VIEW_STATE};
-        uint32_t viewCapacityInput = (uint32_t)m_views.size();
-        uint32_t viewCountOutput;
+    void StartWaitFrame() {
+        ksThread_Signal(&m_frameThread);
+        m_framePending = true;
+    }
 
-        XrViewLocateInfo viewLocateInfo{XR_TYPE_VIEW_LOCATE_INFO};
-        viewLocateInfo.viewConfigurationType = m_viewConfigType;
-        viewLocateInfo.displayTime = predictedDisplayTime;
-        viewLocateInfo.space = m_appSpace;
+    // Wait for the frame thread and take ownership of the frame it produced. Errors on the frame thread are rethrown here.
+    PendingFrame& FinishWaitFrame() {
+        ksThread_Join(&m_frameThread);
+        m_framePending = false;
+        if (m_frameThreadException) {
+            std::exception_ptr exception = nullptr;
+            std::swap(exception, m_frameThreadException);
+            std::rethrow_exception(exception);
+        }
 
-        res = xrLocateViews(m_session, &viewLocateInfo, &viewState, viewCapacityInput, &viewCountOutput, m_views.data());
-        CHECK_XRRESULT(res, "xrLocateViews");
-        if ((viewState.viewStateFlags & XR_VIEW_STATE_POSITION_VALID_BIT) == 0 ||
-            (viewState.viewStateFlags & XR_VIEW_STATE_ORIENTATION_VALID_BIT) == 0) {
-            return false;  // There is no valid tracking poses for the views.
+        PendingFrame& frame = m_frames[m_waitFrameIndex];
+        m_waitFrameIndex ^= 1;
+        return frame;
+    }
+
+    // Make sure the frame thread is idle, e.g. before the session ends.
+    void DrainFramePipeline(bool rethrow) {
+        if (!m_framePending) {
+            return;
+        }
+        ksThread_Join(&m_frameThread);
+        m_framePending = false;
+        if (m_frameThreadException) {
+            std::exception_ptr exception = nullptr;
+            std::swap(exception, m_frameThreadException);
+            if (rethrow) {
+                std::rethrow_exception(exception);
+            }
         }
+    }
 
-        CHECK(viewCountOutput == viewCapacityInput);
-        CHECK(viewCountOutput == m_configViews.size());
-        CHECK(viewCountOutput == m_swapchains.size());
+    // The cubes to render at the given time, with the index of each hand's cube in handCubes.
+#if defined(XR_KHR_locate_spaces)
+    // Same cubes as LocateCubes, with every space located in a single runtime call.
+    void LocateCubesBatched(XrTime predictedDisplayTime, std::vector<Cube>& cubes, std::array<size_t, Side::COUNT>& handCubes) {
+        XrSpacesLocateInfoKHR locateInfo{XR_TYPE_SPACES_LOCATE_INFO_KHR};
+        locateInfo.baseSpace = m_appSpace;
+        locateInfo.time = predictedDisplayTime;
+        locateInfo.spaceCount = (uint32_t)m_locateSpaces.size();
+        locateInfo.spaces = m_locateSpaces.data();
+
+        XrSpaceLocationsKHR locations{XR_TYPE_SPACE_LOCATIONS_KHR};
+        locations.locationCount = (uint32_t)m_spaceLocations.size();
+        locations.locations = m_spaceLocations.data();
+
+        const XrResult res = m_pfnLocateSpacesKHR(m_session, &locateInfo, &locations);
+        CHECK_XRRESULT(res, "xrLocateSpacesKHR");
+        if (!XR_UNQUALIFIED_SUCCESS(res)) {
+            LOG_VERBOSE(Fmt("Unable to locate spaces in app space: %d", res));
+            return;
+        }
 
-        projectionLayerViews.resize(viewCountOutput);
+        const auto isLocated = [](const XrSpaceLocationDataKHR& location) {
+            return (location.locationFlags & XR_SPACE_LOCATION_POSITION_VALID_BIT) != 0 &&
+                   (location.locationFlags & XR_SPACE_LOCATION_ORIENTATION_VALID_BIT) != 0;
+        };
 
-        // For each locatable space that we want to visualize, render a 25cm cube.
-        std::vector<Cube> cubes;
+        const size_t visualizedSpaceCount = m_visualizedSpaces.size();
+        for (size_t i = 0; i < visualizedSpaceCount; ++i) {
+            if (isLocated(m_spaceLocations[i])) {
+                cubes.push_back(Cube{m_spaceLocations[i].pose, {0.25f, 0.25f, 0.25f}});
+            }
+        }
 
+        for (auto hand : {Side::LEFT, Side::RIGHT}) {
+            const XrSpaceLocationDataKHR& location = m_spaceLocations[visualizedSpaceCount + hand];
+            if (isLocated(location)) {
+                float scale = 0.1f * m_input.handScale[hand];
+                handCubes[hand] = cubes.size();
+                cubes.push_back(Cube{location.pose, {scale, scale, scale}});
+            }
+        }
+    }
+#endif
+
+    void LocateCubes(XrTime predictedDisplayTime, std::vector<Cube>& cubes, std::array<size_t, Side::COUNT>& handCubes) {
+#if defined(XR_KHR_locate_spaces)
+        if (m_pfnLocateSpacesKHR != nullptr) {
+            LocateCubesBatched(predictedDisplayTime, cubes, handCubes);
+            return;
+        }
+#endif
+
+        XrResult res;
+
+        // For each locatable space that we want to visualize, render a 25cm cube.
         for (XrSpace visualizedSpace : m_visualizedSpaces) {
             XrSpaceLocation spaceLocation{XR_TYPE_SPACE_LOCATION};
             res = xrLocateSpace(visualizedSpace, m_appSpace, predictedDisplayTime, &spaceLocation);
@@ -948,7 +1751,7 @@ struct OpenXrProgram : IOpenXrProgram {
                     cubes.push_back(Cube{spaceLocation.pose, {0.25f, 0.25f, 0.25f}});
                 }
             } else {
-                Log::Write(Log::Level::Verbose, Fmt("Unable to locate a visualized reference space in app space: %d", res));
+                LOG_VERBOSE(Fmt("Unable to locate a visualized reference space in app space: %d", res));
             }
         }
 
@@ -962,45 +1765,266 @@ struct OpenXrProgram : IOpenXrProgram {
                 if ((spaceLocation.locationFlags & XR_SPACE_LOCATION_POSITION_VALID_BIT) != 0 &&
                     (spaceLocation.locationFlags & XR_SPACE_LOCATION_ORIENTATION_VALID_BIT) != 0) {
                     float scale = 0.1f * m_input.handScale[hand];
+                    handCubes[hand] = cubes.size();
                     cubes.push_back(Cube{spaceLocation.pose, {scale, scale, scale}});
                 }
             } else {
                 // Tracking loss is expected when the hand is not active so only log a message
                 // if the hand is active.
-                if (m_input.handActive[hand] == XR_TRUE) {
+                if (m_inputSampler.Snapshot().PoseActive[hand]) {
                     const char* handName[] = {"left", "right"};
-                    Log::Write(Log::Level::Verbose,
-                               Fmt("Unable to locate %s hand action space in app space: %d", handName[hand], res));
+                    LOG_VERBOSE(Fmt("Unable to locate %s hand action space in app space: %d", handName[hand], res));
                 }
             }
         }
+    }
 
-        // Render view to the appropriate part of the swapchain image.
-        for (uint32_t i = 0; i < viewCountOutput; i++) {
-            // Each view has a separate swapchain which is acquired, rendered to, and released.
-            const Swapchain viewSwapchain = m_swapchains[i];
+    // Bring the scene up to date with the cubes located for this frame. The extra and benchmark cube grids stay at the front
+    // of the scene from frame to frame, so their model matrices are only computed when the grids change.
+    void UpdateScene(const std::vector<Cube>& locatedCubes) {
+        const uint32_t benchmarkCubes = m_benchmark.CubeCount();
+        if (benchmarkCubes != m_sceneBenchmarkCubes) {
+            std::vector<Cube> grid;
+            AddCubeGrid(grid, benchmarkCubes, m_gridMesh);
+            m_scene.Truncate(m_options->ExtraCubes);
+            m_scene.Append(grid);
+            m_sceneBenchmarkCubes = benchmarkCubes;
+        }
+
+        const size_t gridCubes = m_options->ExtraCubes + m_sceneBenchmarkCubes;
+        m_scene.Truncate(gridCubes + locatedCubes.size());
+        for (size_t i = 0; i < locatedCubes.size(); ++i) {
+            if (gridCubes + i < m_scene.Size()) {
+                m_scene.Set(gridCubes + i, locatedCubes[i]);
+            } else {
+                m_scene.Append(locatedCubes[i]);
+            }
+        }
+        m_scene.UpdateModels();
+    }
+
+    // Cast a ray from each hand cube along the hand's -Z through the scene's BVH and log the cube it points at when that
+    // changes.
+    void UpdatePointing(const PendingFrame& frame) {
+        const size_t firstLocatedCube = m_scene.Size() - frame.cubes.size();
+        for (auto hand : {Side::LEFT, Side::RIGHT}) {
+            size_t pointedCube = SceneBvh::NoCube;
+            const size_t cubeIndex = frame.handCubes[hand];
+            if (cubeIndex != NoHandCube) {
+                const XrPosef& pose = frame.cubes[cubeIndex].Pose;
+                XrMatrix4x4f rotation;
+                XrMatrix4x4f_CreateFromQuaternion(&rotation, &pose.orientation);
+                const XrVector3f direction{-rotation.m[8], -rotation.m[9], -rotation.m[10]};
+                pointedCube = m_scene.Bvh().Raycast(pose.position, direction, PointingDistance);
+            }
+            if (pointedCube != m_pointedCubes[hand]) {
+                m_pointedCubes[hand] = pointedCube;
+                const char* handName[] = {"left", "right"};
+                if (pointedCube == SceneBvh::NoCube) {
+                    LOG_VERBOSE(Fmt("The %s hand points at no cube", handName[hand]));
+                } else if (pointedCube >= firstLocatedCube) {
+                    LOG_VERBOSE(Fmt("The %s hand points at located cube %zu", handName[hand], pointedCube - firstLocatedCube));
+                } else {
+                    LOG_VERBOSE(Fmt("The %s hand points at grid cube %zu", handName[hand], pointedCube));
+                }
+            }
+        }
+    }
+
+    bool RenderLayer(PendingFrame& frame, std::vector<XrCompositionLayerProjectionView>& projectionLayerViews,
+                     XrCompositionLayerProjection& layer) {
+        const XrTime predictedDisplayTime = frame.frameState.predictedDisplayTime;
+        FrameTimings& timings = frame.timings;
+        XrResult res;
+
+        XrViewState viewState{XR_TYPE_VIEW_STATE};
+        uint32_t viewCapacityInput = (uint32_t)m_views.size();
+        uint32_t viewCountOutput;
+
+        XrViewLocateInfo viewLocateInfo{XR_TYPE_VIEW_LOCATE_INFO};
+        viewLocateInfo.viewConfigurationType = m_viewConfigType;
+        viewLocateInfo.displayTime = predictedDisplayTime;
+        viewLocateInfo.space = m_appSpace;
+
+        const uint64_t viewsLocatedAt = FrameStatsNow();
+        {
+            ScopedFramePhase phase(timings, FramePhase::LocateViews);
+            res = xrLocateViews(m_session, &viewLocateInfo, &viewState, viewCapacityInput, &viewCountOutput, m_views.data());
+            CHECK_XRRESULT(res, "xrLocateViews");
+        }
+        if ((viewState.viewStateFlags & XR_VIEW_STATE_POSITION_VALID_BIT) == 0 ||
+            (viewState.viewStateFlags & XR_VIEW_STATE_ORIENTATION_VALID_BIT) == 0) {
+            return false;  // There is no valid tracking poses for the views.
+        }
+
+        CHECK(viewCountOutput == viewCapacityInput);
+        CHECK(viewCountOutput == m_configViews.size());
+        CHECK(m_headless || m_swapchains.size() == (m_singlePassStereo ? 1 : viewCountOutput));
 
-            XrSwapchainImageAcquireInfo acquireInfo{XR_TYPE_SWAPCHAIN_IMAGE_ACQUIRE_INFO};
+        projectionLayerViews.resize(viewCountOutput);
+        if (!m_depthSwapchains.empty()) {
+            m_frameScratch.depthInfos.resize(viewCountOutput);
+        }
+#if defined(XR_FB_space_warp)
+        if (!m_motionVectorSwapchains.empty()) {
+            m_frameScratch.spaceWarpInfos.resize(viewCountOutput);
+        }
+#endif
 
-            uint32_t swapchainImageIndex;
-            CHECK_XRCMD(xrAcquireSwapchainImage(viewSwapchain.handle, &acquireInfo, &swapchainImageIndex));
+        UpdateScene(frame.cubes);
+        UpdatePointing(frame);
+
+        const std::vector<XrMatrix4x4f>* cubeModels = &m_scene.Models();
+        const std::vector<MeshDraw>* meshDraws = &m_scene.Draws();
+        size_t culledCubes = 0;
+        if (m_options->FrustumCulling) {
+            ScopedFramePhase phase(timings, FramePhase::Cull);
+            m_frustumCuller.SetViews(m_views, NearZ, FarZ);
+            const bool needsVisibleCubes = !m_motionVectorSwapchains.empty() || m_lateLatching;
+            culledCubes = m_frustumCuller.Cull(m_scene, m_visibleCubeModels, m_visibleMeshDraws,
+                                               needsVisibleCubes ? &m_visibleCubes : nullptr);
+            cubeModels = &m_visibleCubeModels;
+            meshDraws = &m_visibleMeshDraws;
+        }
+        timings.VisibleCubes = (uint32_t)cubeModels->size();
+        timings.CulledCubes = (uint32_t)culledCubes;
+
+        // For LateLatchPoses, which the graphics plugin calls from the render call below.
+        m_lateLatchFrame = {&frame, &projectionLayerViews, cubeModels == &m_visibleCubeModels, viewsLocatedAt};
+
+        const auto submitStart = std::chrono::steady_clock::now();
+
+        if (m_headless) {
+            // Nothing is displayed, the views only go to the graphics plugin for its per-view work.
+            std::vector<SwapchainImage>& swapchainImages = m_frameScratch.swapchainImages;
+            swapchainImages.resize(viewCountOutput);
+            for (uint32_t i = 0; i < viewCountOutput; i++) {
+                swapchainImages[i] = {i, 0};
+                projectionLayerViews[i] = {XR_TYPE_COMPOSITION_LAYER_PROJECTION_VIEW};
+                projectionLayerViews[i].pose = m_views[i].pose;
+                projectionLayerViews[i].fov = m_views[i].fov;
+                projectionLayerViews[i].subImage.imageRect.extent = {(int32_t)m_configViews[i].recommendedImageRectWidth,
+                                                                     (int32_t)m_configViews[i].recommendedImageRectHeight};
+            }
+            {
+                ScopedFramePhase phase(timings, FramePhase::Render);
+                m_graphicsPlugin->RenderViews(projectionLayerViews, swapchainImages, m_colorSwapchainFormat, *cubeModels,
+                                              *meshDraws);
+            }
+            RecordSubmitTime(std::chrono::steady_clock::now() - submitStart, m_graphicsPlugin->TakeCpuWaitTime());
+            return true;
+        }
 
-            XrSwapchainImageWaitInfo waitInfo{XR_TYPE_SWAPCHAIN_IMAGE_WAIT_INFO};
-            waitInfo.timeout = XR_INFINITE_DURATION;
-            CHECK_XRCMD(xrWaitSwapchainImage(viewSwapchain.handle, &waitInfo));
+        if (m_singlePassStereo) {
+            // All views live in the layers of one array swapchain and are rendered in a single pass.
+            const Swapchain arraySwapchain = m_swapchains[0];
+
+            SwapchainImage swapchainImage{arraySwapchain.index, 0};
+            {
+                ScopedFramePhase phase(timings, FramePhase::AcquireImages);
+                swapchainImage.imageIndex = AcquireSwapchainImage(arraySwapchain.handle);
+                if (!m_depthSwapchains.empty()) {
+                    swapchainImage.depthSwapchainIndex = m_depthSwapchains[0].index;
+                    swapchainImage.depthImageIndex = AcquireSwapchainImage(m_depthSwapchains[0].handle);
+                }
+            }
+
+            for (uint32_t i = 0; i < viewCountOutput; i++) {
+                projectionLayerViews[i] = {XR_TYPE_COMPOSITION_LAYER_PROJECTION_VIEW};
+                projectionLayerViews[i].pose = m_views[i].pose;
+                projectionLayerViews[i].fov = m_views[i].fov;
+                projectionLayerViews[i].subImage.swapchain = arraySwapchain.handle;
+                projectionLayerViews[i].subImage.imageRect.offset = {0, 0};
+                projectionLayerViews[i].subImage.imageRect.extent = RenderedExtent(0, arraySwapchain);
+                projectionLayerViews[i].subImage.imageArrayIndex = i;
+                if (!m_depthSwapchains.empty()) {
+                    ChainDepthInfo(projectionLayerViews[i], m_frameScratch.depthInfos[i], m_depthSwapchains[0].handle);
+                }
+            }
+
+            {
+                ScopedFramePhase phase(timings, FramePhase::Render);
+                m_graphicsPlugin->RenderMultiview(projectionLayerViews, swapchainImage, m_colorSwapchainFormat, *cubeModels,
+                                                  *meshDraws);
+            }
+            RecordSubmitTime(std::chrono::steady_clock::now() - submitStart, m_graphicsPlugin->TakeCpuWaitTime());
+
+            XrSwapchainImageReleaseInfo releaseInfo{XR_TYPE_SWAPCHAIN_IMAGE_RELEASE_INFO};
+            CHECK_XRCMD(xrReleaseSwapchainImage(arraySwapchain.handle, &releaseInfo));
+            if (!m_depthSwapchains.empty()) {
+                CHECK_XRCMD(xrReleaseSwapchainImage(m_depthSwapchains[0].handle, &releaseInfo));
+            }
+
+            layer.space = m_appSpace;
+            layer.viewCount = (uint32_t)projectionLayerViews.size();
+            layer.views = projectionLayerViews.data();
+            return true;
+        }
+
+        // Each view has a separate swapchain. Acquire them all first so every view is rendered in one plugin call.
+        std::vector<SwapchainImage>& swapchainImages = m_frameScratch.swapchainImages;
+        swapchainImages.resize(viewCountOutput);
+        const uint64_t acquireStart = FrameStatsNow();
+        for (uint32_t i = 0; i < viewCountOutput; i++) {
+            const Swapchain viewSwapchain = m_swapchains[i];
+            swapchainImages[i] = {viewSwapchain.index, AcquireSwapchainImage(viewSwapchain.handle)};
 
             projectionLayerViews[i] = {XR_TYPE_COMPOSITION_LAYER_PROJECTION_VIEW};
             projectionLayerViews[i].pose = m_views[i].pose;
             projectionLayerViews[i].fov = m_views[i].fov;
             projectionLayerViews[i].subImage.swapchain = viewSwapchain.handle;
             projectionLayerViews[i].subImage.imageRect.offset = {0, 0};
-            projectionLayerViews[i].subImage.imageRect.extent = {viewSwapchain.width, viewSwapchain.height};
+            projectionLayerViews[i].subImage.imageRect.extent = RenderedExtent(i, viewSwapchain);
+
+            if (!m_depthSwapchains.empty()) {
+                const Swapchain depthSwapchain = m_depthSwapchains[i];
+                swapchainImages[i].depthSwapchainIndex = depthSwapchain.index;
+                swapchainImages[i].depthImageIndex = AcquireSwapchainImage(depthSwapchain.handle);
+                ChainDepthInfo(projectionLayerViews[i], m_frameScratch.depthInfos[i], depthSwapchain.handle);
+            }
+
+#if defined(XR_FB_space_warp)
+            if (!m_motionVectorSwapchains.empty()) {
+                const Swapchain motionVectorSwapchain = m_motionVectorSwapchains[i];
+                const Swapchain motionVectorDepthSwapchain = m_motionVectorDepthSwapchains[i];
+                swapchainImages[i].motionVectorSwapchainIndex = motionVectorSwapchain.index;
+                swapchainImages[i].motionVectorImageIndex = AcquireSwapchainImage(motionVectorSwapchain.handle);
+                swapchainImages[i].motionVectorDepthSwapchainIndex = motionVectorDepthSwapchain.index;
+                swapchainImages[i].motionVectorDepthImageIndex = AcquireSwapchainImage(motionVectorDepthSwapchain.handle);
+                ChainSpaceWarpInfo(projectionLayerViews[i], m_frameScratch.spaceWarpInfos[i], motionVectorSwapchain,
+                                   motionVectorDepthSwapchain);
+            }
+#endif
+        }
+        timings.Add(FramePhase::AcquireImages, FrameStatsNow() - acquireStart);
+
+        if (!m_motionVectorSwapchains.empty()) {
+            GatherPreviousCubeModels(*cubeModels, cubeModels == &m_visibleCubeModels);
+            m_graphicsPlugin->SetPreviousCubeModels(m_previousCubeModels);
+        }
 
-            const XrSwapchainImageBaseHeader* const swapchainImage = m_swapchainImages[viewSwapchain.handle][swapchainImageIndex];
-            m_graphicsPlugin->RenderView(projectionLayerViews[i], swapchainImage, m_colorSwapchainFormat, cubes);
+        {
+            ScopedFramePhase phase(timings, FramePhase::Render);
+            m_graphicsPlugin->RenderViews(projectionLayerViews, swapchainImages, m_colorSwapchainFormat, *cubeModels,
+                                          *meshDraws);
+        }
+        RecordSubmitTime(std::chrono::steady_clock::now() - submitStart, m_graphicsPlugin->TakeCpuWaitTime());
 
+        for (uint32_t i = 0; i < viewCountOutput; i++) {
             XrSwapchainImageReleaseInfo releaseInfo{XR_TYPE_SWAPCHAIN_IMAGE_RELEASE_INFO};
-            CHECK_XRCMD(xrReleaseSwapchainImage(viewSwapchain.handle, &releaseInfo));
+            CHECK_XRCMD(xrReleaseSwapchainImage(m_swapchains[i].handle, &releaseInfo));
+            if (!m_depthSwapchains.empty()) {
+                CHECK_XRCMD(xrReleaseSwapchainImage(m_depthSwapchains[i].handle, &releaseInfo));
+            }
+            if (!m_motionVectorSwapchains.empty()) {
+                CHECK_XRCMD(xrReleaseSwapchainImage(m_motionVectorSwapchains[i].handle, &releaseInfo));
+                CHECK_XRCMD(xrReleaseSwapchainImage(m_motionVectorDepthSwapchains[i].handle, &releaseInfo));
+            }
+        }
+
+        // The models the frame went out with, late latched hand cubes included, are where the next frame's motion starts.
+        if (!m_motionVectorSwapchains.empty()) {
+            m_previousSceneModels = m_scene.Models();
         }
 
         layer.space = m_appSpace;
@@ -1009,10 +2033,172 @@ struct OpenXrProgram : IOpenXrProgram {
         return true;
     }
 
+    // Called by the graphics plugin right before it submits the frame that RenderLayer is rendering: locate the views and the
+    // hands again for the same display time, now that the runtime has newer tracking data to predict from, and update the
+    // layer views and the models of the hand cubes in place. Returns the index of the first cube model that changed.
+    size_t LateLatchPoses() {
+        const LateLatchFrame& latch = m_lateLatchFrame;
+        CHECK(latch.Frame != nullptr);
+        PendingFrame& frame = *latch.Frame;
+        const XrTime displayTime = frame.frameState.predictedDisplayTime;
+        const uint64_t now = FrameStatsNow();
+
+        XrViewLocateInfo viewLocateInfo{XR_TYPE_VIEW_LOCATE_INFO};
+        viewLocateInfo.viewConfigurationType = m_viewConfigType;
+        viewLocateInfo.displayTime = displayTime;
+        viewLocateInfo.space = m_appSpace;
+        XrViewState viewState{XR_TYPE_VIEW_STATE};
+        uint32_t viewCountOutput;
+        XrResult res = xrLocateViews(m_session, &viewLocateInfo, &viewState, (uint32_t)m_views.size(), &viewCountOutput,
+                                     m_views.data());
+        CHECK_XRRESULT(res, "xrLocateViews");
+        if ((viewState.viewStateFlags & XR_VIEW_STATE_POSITION_VALID_BIT) != 0 &&
+            (viewState.viewStateFlags & XR_VIEW_STATE_ORIENTATION_VALID_BIT) != 0) {
+            std::vector<XrCompositionLayerProjectionView>& layerViews = *latch.LayerViews;
+            CHECK(viewCountOutput == layerViews.size());
+            for (size_t i = 0; i < layerViews.size(); ++i) {
+                layerViews[i].pose = m_views[i].pose;
+                layerViews[i].fov = m_views[i].fov;
+            }
+            frame.timings.LateLatchViews = now - latch.ViewsLocatedAt;
+        }
+        // Otherwise the frame goes out with the views it was recorded with, which are still in the layer views.
+
+        // The located cubes are at the end of the scene. Culling keeps the scene order, so the scene indices of the visible
+        // cubes are sorted and a visible hand cube's model is found through them.
+        const size_t firstLocatedCube = m_scene.Size() - frame.cubes.size();
+        const std::vector<XrMatrix4x4f>& models = latch.Culled ? m_visibleCubeModels : m_scene.Models();
+        if (latch.Culled) {
+            CHECK(m_visibleCubes.size() == models.size());
+        }
+        std::array<size_t, Side::COUNT> handModels;
+        handModels.fill(NoHandCube);
+        for (auto hand : {Side::LEFT, Side::RIGHT}) {
+            const size_t cubeIndex = frame.handCubes[hand];
+            if (cubeIndex == NoHandCube) {
+                continue;
+            }
+            XrSpaceLocation spaceLocation{XR_TYPE_SPACE_LOCATION};
+            res = xrLocateSpace(m_input.handSpace[hand], m_appSpace, displayTime, &spaceLocation);
+            CHECK_XRRESULT(res, "xrLocateSpace");
+            if (!XR_UNQUALIFIED_SUCCESS(res) || (spaceLocation.locationFlags & XR_SPACE_LOCATION_POSITION_VALID_BIT) == 0 ||
+                (spaceLocation.locationFlags & XR_SPACE_LOCATION_ORIENTATION_VALID_BIT) == 0) {
+                continue;
+            }
+
+            const size_t sceneIndex = firstLocatedCube + cubeIndex;
+            size_t modelIndex = sceneIndex;
+            if (latch.Culled) {
+                const auto found = std::lower_bound(m_visibleCubes.begin(), m_visibleCubes.end(), (uint32_t)sceneIndex);
+                if (found == m_visibleCubes.end() || *found != sceneIndex) {
+                    continue;  // Culled
+                }
+                modelIndex = (size_t)(found - m_visibleCubes.begin());
+            }
+            m_scene.Set(sceneIndex, Cube{spaceLocation.pose, frame.cubes[cubeIndex].Scale});
+            handModels[hand] = modelIndex;
+        }
+
+        size_t firstChangedModel = models.size();
+        m_scene.UpdateModels();
+        for (auto hand : {Side::LEFT, Side::RIGHT}) {
+            if (handModels[hand] == NoHandCube) {
+                continue;
+            }
+            if (latch.Culled) {
+                m_visibleCubeModels[handModels[hand]] = m_scene.Models()[firstLocatedCube + frame.handCubes[hand]];
+            }
+            firstChangedModel = std::min(firstChangedModel, handModels[hand]);
+            frame.timings.LateLatchHands = now - frame.locatedAt;
+        }
+        return firstChangedModel;
+    }
+
+    // The area of a view's swapchain to render into: all of it, or the current dynamic resolution.
+    XrExtent2Di RenderedExtent(uint32_t view, const Swapchain& swapchain) const {
+        if (!m_resolutionScaler) {
+            return {swapchain.width, swapchain.height};
+        }
+        const XrViewConfigurationView& configView = m_configViews[view];
+        return m_resolutionScaler->Extent(configView.recommendedImageRectWidth, configView.recommendedImageRectHeight,
+                                          (uint32_t)swapchain.width, (uint32_t)swapchain.height);
+    }
+
+    // Acquire the next image of a swapchain and wait until it can be rendered to.
+    static uint32_t AcquireSwapchainImage(XrSwapchain swapchain) {
+        XrSwapchainImageAcquireInfo acquireInfo{XR_TYPE_SWAPCHAIN_IMAGE_ACQUIRE_INFO};
+        uint32_t swapchainImageIndex;
+        CHECK_XRCMD(xrAcquireSwapchainImage(swapchain, &acquireInfo, &swapchainImageIndex));
+
+        XrSwapchainImageWaitInfo waitInfo{XR_TYPE_SWAPCHAIN_IMAGE_WAIT_INFO};
+        waitInfo.timeout = XR_INFINITE_DURATION;
+        CHECK_XRCMD(xrWaitSwapchainImage(swapchain, &waitInfo));
+        return swapchainImageIndex;
+    }
+
+    // Fill m_previousCubeModels with the model of each of cubeModels as of the previous frame. Cubes added or removed since
+    // shift the located cubes along the scene, so a frame that changes the cube count has no motion at all.
+    void GatherPreviousCubeModels(const std::vector<XrMatrix4x4f>& cubeModels, bool culled) {
+        const std::vector<XrMatrix4x4f>& sceneModels = m_scene.Models();
+        if (m_previousSceneModels.size() != sceneModels.size()) {
+            m_previousCubeModels = cubeModels;
+            return;
+        }
+        if (!culled) {
+            m_previousCubeModels = m_previousSceneModels;
+            return;
+        }
+        CHECK(m_visibleCubes.size() == cubeModels.size());
+        m_previousCubeModels.resize(cubeModels.size());
+        for (size_t i = 0; i < cubeModels.size(); ++i) {
+            m_previousCubeModels[i] = m_previousSceneModels[m_visibleCubes[i]];
+        }
+    }
+
+#if defined(XR_FB_space_warp)
+    // Submit the motion vectors and depth rendered with a projection view, on top of whatever is chained onto it already.
+    // The app space does not move, and the depth maps NearZ..FarZ to 0..1 like the depth layer's.
+    static void ChainSpaceWarpInfo(XrCompositionLayerProjectionView& layerView, XrCompositionLayerSpaceWarpInfoFB& spaceWarpInfo,
+                                   const Swapchain& motionVectorSwapchain, const Swapchain& motionVectorDepthSwapchain) {
+        spaceWarpInfo = {XR_TYPE_COMPOSITION_LAYER_SPACE_WARP_INFO_FB};
+        spaceWarpInfo.motionVectorSubImage.swapchain = motionVectorSwapchain.handle;
+        spaceWarpInfo.motionVectorSubImage.imageRect = {{0, 0}, {motionVectorSwapchain.width, motionVectorSwapchain.height}};
+        spaceWarpInfo.appSpaceDeltaPose = Math::Pose::Identity();
+        spaceWarpInfo.depthSubImage.swapchain = motionVectorDepthSwapchain.handle;
+        spaceWarpInfo.depthSubImage.imageRect = spaceWarpInfo.motionVectorSubImage.imageRect;
+        spaceWarpInfo.minDepth = 0.0f;
+        spaceWarpInfo.maxDepth = 1.0f;
+        spaceWarpInfo.nearZ = NearZ;
+        spaceWarpInfo.farZ = FarZ;
+        spaceWarpInfo.next = layerView.next;
+        layerView.next = &spaceWarpInfo;
+    }
+#endif
+
+    // Submit the depth rendered with a projection view. The depth swapchain has the same layout as the color one, and the
+    // graphics plugins map NearZ..FarZ to depth 0..1.
+    static void ChainDepthInfo(XrCompositionLayerProjectionView& layerView, XrCompositionLayerDepthInfoKHR& depthInfo,
+                               XrSwapchain depthSwapchain) {
+        depthInfo = {XR_TYPE_COMPOSITION_LAYER_DEPTH_INFO_KHR};
+        depthInfo.subImage = layerView.subImage;
+        depthInfo.subImage.swapchain = depthSwapchain;
+        depthInfo.minDepth = 0.0f;
+        depthInfo.maxDepth = 1.0f;
+        depthInfo.nearZ = NearZ;
+        depthInfo.farZ = FarZ;
+        layerView.next = &depthInfo;
+    }
+
+    void RecordSubmitTime(std::chrono::steady_clock::duration submitTime, std::chrono::nanoseconds cpuWaitTime) {
+        m_benchmark.AddSubmitTime(std::chrono::duration_cast<std::chrono::nanoseconds>(submitTime), cpuWaitTime);
+    }
+
    private:
     const std::shared_ptr<Options> m_options;
     std::shared_ptr<IPlatformPlugin> m_platformPlugin;
     std::shared_ptr<IGraphicsPlugin> m_graphicsPlugin;
+    const bool m_reuseGraphicsDevice;
+    JobGraph m_startupJobs;  // Destroyed before the graphics plugin its jobs use
     XrInstance m_instance{XR_NULL_HANDLE};
     XrSession m_session{XR_NULL_HANDLE};
     XrSpace m_appSpace{XR_NULL_HANDLE};
@@ -1023,23 +2209,83 @@ struct OpenXrProgram : IOpenXrProgram {
 
     std::vector<XrViewConfigurationView> m_configViews;
     std::vector<Swapchain> m_swapchains;
-    std::map<XrSwapchain, std::vector<XrSwapchainImageBaseHeader*>> m_swapchainImages;
+    std::vector<Swapchain> m_depthSwapchains;  // One per color swapchain when depth is submitted, otherwise empty
+    std::vector<Swapchain> m_motionVectorSwapchains;       // One per view with space warp, otherwise empty
+    std::vector<Swapchain> m_motionVectorDepthSwapchains;  // Same
     std::vector<XrView> m_views;
     int64_t m_colorSwapchainFormat{-1};
+    int64_t m_depthSwapchainFormat{-1};
+    bool m_headless{false};
+    bool m_depthLayerSupported{false};
+    bool m_spaceWarpSupported{false};
+    bool m_singlePassStereo{false};
+    FoveationLevel m_foveationLevel{FoveationLevel::Off};
+    SwapchainPolicy m_swapchainPolicy{SwapchainPolicy::Default};
+    bool m_eyeTrackedFoveationSupported{false};
+#if defined(XR_FB_foveation) && defined(XR_FB_foveation_configuration) && defined(XR_FB_swapchain_update_state)
+    PFN_xrCreateFoveationProfileFB m_pfnCreateFoveationProfileFB{nullptr};
+    PFN_xrDestroyFoveationProfileFB m_pfnDestroyFoveationProfileFB{nullptr};
+    PFN_xrUpdateSwapchainFB m_pfnUpdateSwapchainFB{nullptr};  // Set when the runtime can foveate swapchains
+#endif
+
+    // Frames produced by WaitFrame. Pipelined mode alternates between the two, otherwise only the first is used.
+    std::array<PendingFrame, 2> m_frames;
+    uint32_t m_waitFrameIndex{0};
+    ksThread m_frameThread{};
+    bool m_frameThreadCreated{false};
+    bool m_frameThreadScheduled{false};  // Only used on the frame thread
+    bool m_framePending{false};
+    std::exception_ptr m_frameThreadException;
+    FrameBenchmark m_benchmark;
+    CubeScene m_scene;
+    uint32_t m_sceneBenchmarkCubes{0};
+    uint32_t m_gridMesh{CubeMesh};  // Mesh of the extra and benchmark cube grids
+    FrustumCuller m_frustumCuller;
+    std::vector<XrMatrix4x4f> m_visibleCubeModels;
+    std::vector<MeshDraw> m_visibleMeshDraws;
+    // The scene index of each visible cube, for motion vectors and late latching. For motion vectors also the scene's
+    // models as the last frame submitted them, and the previous models of the cubes being rendered.
+    std::vector<uint32_t> m_visibleCubes;
+    std::vector<XrMatrix4x4f> m_previousSceneModels;
+    std::vector<XrMatrix4x4f> m_previousCubeModels;
+    // Scene index of the cube each hand points at, or SceneBvh::NoCube.
+    std::array<size_t, Side::COUNT> m_pointedCubes{{SceneBvh::NoCube, SceneBvh::NoCube}};
+    // The frame RenderLayer renders most recently, for LateLatchPoses.
+    struct LateLatchFrame {
+        PendingFrame* Frame{nullptr};
+        std::vector<XrCompositionLayerProjectionView>* LayerViews{nullptr};
+        bool Culled{false};  // The plugin renders m_visibleCubeModels rather than the scene's models
+        uint64_t ViewsLocatedAt{0};
+    };
+    LateLatchFrame m_lateLatchFrame;
+    bool m_lateLatching{false};  // The graphics plugin calls LateLatchPoses before submitting
+    std::unique_ptr<FrameStats> m_frameStats;
+    std::unique_ptr<ResolutionScaler> m_resolutionScaler;  // Only with dynamic resolution
+    std::vector<uint64_t> m_gpuViewTimes;
+    uint64_t m_allocationCount{0};
+    FrameScratch m_frameScratch;
 
     std::vector<XrSpace> m_visualizedSpaces;
+#if defined(XR_KHR_locate_spaces)
+    PFN_xrLocateSpacesKHR m_pfnLocateSpacesKHR{nullptr};
+    std::vector<XrSpace> m_locateSpaces;
+    std::vector<XrSpaceLocationDataKHR> m_spaceLocations;
+#endif
 
     // Application's current lifecycle state according to the runtime
     XrSessionState m_sessionState{XR_SESSION_STATE_UNKNOWN};
     bool m_sessionRunning{false};
+    std::chrono::steady_clock::time_point m_lastEventPoll{std::chrono::steady_clock::now()};
 
     XrEventDataBuffer m_eventDataBuffer;
     InputState m_input;
+    InputSampler m_inputSampler;
 };
 }  // namespace
 
 std::shared_ptr<IOpenXrProgram> CreateOpenXrProgram(const std::shared_ptr<Options>& options,
                                                     const std::shared_ptr<IPlatformPlugin>& platformPlugin,
-                                                    const std::shared_ptr<IGraphicsPlugin>& graphicsPlugin) {
-    return std::make_shared<OpenXrProgram>(options, platformPlugin, graphicsPlugin);
+                                                    const std::shared_ptr<IGraphicsPlugin>& graphicsPlugin,
+                                                    bool reuseGraphicsDevice) {
+    return std::make_shared<OpenXrProgram>(options, platformPlugin, graphicsPlugin, reuseGraphicsDevice);
 }
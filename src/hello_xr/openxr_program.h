@@ -11,8 +11,9 @@ struct IOpenXrProgram {
     virtual void CreateInstance() = 0;
 
     // Select a System for the view configuration specified in the Options and initialize the graphics device for the selected
-    // system.
-    virtual void InitializeSystem() = 0;
+    // system. A program created to reuse the graphics device asks the graphics plugin to keep its device instead, and returns
+    // false if the plugin cannot, after which the program and the graphics plugin have to be replaced.
+    virtual bool InitializeSystem() = 0;
 
     // Create a Session and other basic session-level initialization.
     virtual void InitializeSession() = 0;
@@ -21,8 +22,8 @@ struct IOpenXrProgram {
     // properties, getting the view configuration and grabbing the resulting swapchain images.
     virtual void CreateSwapchains() = 0;
 
-    // Process any events in the event queue.
-    virtual void PollEvents(bool* exitRenderLoop, bool* requestRestart) = 0;
+    // Process any events in the event queue. Returns whether there were any.
+    virtual bool PollEvents(bool* exitRenderLoop, bool* requestRestart) = 0;
 
     // Manage session lifecycle to track if RenderFrame should be called.
     virtual bool IsSessionRunning() const = 0;
@@ -41,8 +42,10 @@ struct Swapchain {
     XrSwapchain handle;
     int32_t width;
     int32_t height;
+    uint32_t index;  // Identifies the swapchain's images to the graphics plugin.
 };
 
 std::shared_ptr<IOpenXrProgram> CreateOpenXrProgram(const std::shared_ptr<Options>& options,
                                                     const std::shared_ptr<IPlatformPlugin>& platformPlugin,
-                                                    const std::shared_ptr<IGraphicsPlugin>& graphicsPlugin);
+                                                    const std::shared_ptr<IGraphicsPlugin>& graphicsPlugin,
+                                                    bool reuseGraphicsDevice = false);
@@ -5,7 +5,12 @@
 #pragma once
 
 struct Options {
+    // Builds with a single graphics plugin default to it.
+#if defined(HELLO_XR_DEFAULT_GRAPHICS_PLUGIN)
+    std::string GraphicsPlugin{HELLO_XR_DEFAULT_GRAPHICS_PLUGIN};
+#else
     std::string GraphicsPlugin;
+#endif
 
     std::string FormFactor{"Hmd"};
 
@@ -14,4 +19,60 @@ struct Options {
     std::string EnvironmentBlendMode{"Opaque"};
 
     std::string AppSpace{"Local"};
+
+    bool SinglePassStereo{false};
+
+    bool DepthLayer{false};
+
+    bool SpaceWarp{false};
+
+    std::string Foveation{"Off"};
+
+    std::string SwapchainPolicy{"Default"};
+
+    bool DynamicResolution{false};
+
+    bool Instancing{true};
+
+    bool CubeBenchmark{false};
+
+    bool PipelinedFrames{false};
+
+    bool FrameStats{false};
+
+    std::string FrameStatsCsv;
+
+    uint32_t ExtraCubes{0};
+
+    std::string Mesh;
+
+    uint32_t BenchmarkFrames{0};
+
+    uint32_t WarmupFrames{0};
+
+    bool FrustumCulling{true};
+
+    bool FastRestart{false};
+
+    bool ParallelViews{false};
+
+    bool LateLatching{false};
+
+    std::string CacheDirectory;
+
+    // Cores the render and frame threads and the job system's workers run on, AnyCores, BigCores or a mask as in
+    // threadscheduling.h.
+    int RenderCores{0};
+
+    int WorkerCores{0};
+
+    // SCHED_FIFO priority of the render and frame threads, 0 to keep them at normal priority.
+    uint32_t RealTimePriority{0};
+
+    // Frames per update of the desktop mirror window, for the graphics plugins that have one. 0 to not open it.
+    uint32_t MirrorInterval{1};
+
+    // Chrome trace JSON file to record the API calls and frame phases into, in builds with HELLO_XR_TRACING. Empty to not
+    // trace.
+    std::string TraceFile;
 };
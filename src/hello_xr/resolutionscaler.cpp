@@ -0,0 +1,70 @@
+// Copyright (c) 2017-2020 The Khronos Group Inc.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include "pch.h"
+#include "common.h"
+#include "resolutionscaler.h"
+
+namespace {
+// GPU time as a fraction of the display period. Above ShrinkLoad the scale drops, below GrowLoad it rises, and in between it
+// is left alone. Changes aim for TargetLoad.
+constexpr float ShrinkLoad = 0.9f;
+constexpr float GrowLoad = 0.7f;
+constexpr float TargetLoad = 0.8f;
+
+// Consecutive measurements needed before changing the scale.
+constexpr uint32_t ShrinkAfterFrames = 3;
+constexpr uint32_t GrowAfterFrames = 60;
+
+// GPU timings lag a few frames behind, so measurements right after a change still describe the old size.
+constexpr uint32_t SettleFrames = 8;
+
+// Largest change of the scale at once.
+constexpr float MaxShrinkStep = 0.75f;
+constexpr float MaxGrowStep = 1.1f;
+}  // namespace
+
+ResolutionScaler::ResolutionScaler(float minScale, float maxScale)
+    : m_minScale(minScale), m_maxScale(std::max(minScale, maxScale)) {
+    m_scale = std::min(std::max(1.0f, m_minScale), m_maxScale);
+}
+
+bool ResolutionScaler::Update(uint64_t gpuNanoseconds, XrDuration displayPeriod) {
+    if (displayPeriod <= 0 || gpuNanoseconds == 0) {
+        return false;
+    }
+    if (m_settleFrames > 0) {
+        --m_settleFrames;
+        return false;
+    }
+
+    const float load = (float)gpuNanoseconds / (float)displayPeriod;
+    m_overBudgetFrames = load > ShrinkLoad ? m_overBudgetFrames + 1 : 0;
+    m_underBudgetFrames = load < GrowLoad ? m_underBudgetFrames + 1 : 0;
+    if (m_overBudgetFrames < ShrinkAfterFrames && m_underBudgetFrames < GrowAfterFrames) {
+        return false;
+    }
+
+    // GPU time is roughly proportional to the pixel count, the square of the scale.
+    const float step = std::min(std::max(std::sqrt(TargetLoad / load), MaxShrinkStep), MaxGrowStep);
+    const float scale = std::min(std::max(m_scale * step, m_minScale), m_maxScale);
+    m_overBudgetFrames = 0;
+    m_underBudgetFrames = 0;
+    if (scale == m_scale) {
+        return false;
+    }
+
+    LOG_VERBOSE(Fmt("Resolution scale %.2f -> %.2f, GPU %.2f ms of %.2f ms", m_scale, scale, gpuNanoseconds / 1e6,
+                    displayPeriod / 1e6));
+    m_scale = scale;
+    m_settleFrames = SettleFrames;
+    return true;
+}
+
+XrExtent2Di ResolutionScaler::Extent(uint32_t recommendedWidth, uint32_t recommendedHeight, uint32_t maxWidth,
+                                     uint32_t maxHeight) const {
+    const uint32_t width = (uint32_t)std::lround(recommendedWidth * m_scale);
+    const uint32_t height = (uint32_t)std::lround(recommendedHeight * m_scale);
+    return {(int32_t)std::min(std::max(width, 1u), maxWidth), (int32_t)std::min(std::max(height, 1u), maxHeight)};
+}
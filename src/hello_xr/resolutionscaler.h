@@ -0,0 +1,30 @@
+// Copyright (c) 2017-2020 The Khronos Group Inc
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+// Scales the rendered area of each view so the GPU time of a frame fits in the display period, trading sharpness for frame
+// rate under load. The scale multiplies both sides of the recommended image rect. It drops quickly once frames run over
+// budget but only climbs back after a long run of frames with headroom, and every change waits for the GPU timings of
+// frames rendered at the new size, so it does not oscillate.
+class ResolutionScaler {
+   public:
+    ResolutionScaler(float minScale, float maxScale);
+
+    // Feed the GPU time of the newest measured frame. Returns true if the scale changed.
+    bool Update(uint64_t gpuNanoseconds, XrDuration displayPeriod);
+
+    float Scale() const { return m_scale; }
+
+    // The scaled size of a recommended image rect, at least one pixel and at most maxWidth x maxHeight.
+    XrExtent2Di Extent(uint32_t recommendedWidth, uint32_t recommendedHeight, uint32_t maxWidth, uint32_t maxHeight) const;
+
+   private:
+    const float m_minScale;
+    const float m_maxScale;
+    float m_scale{1.0f};
+    uint32_t m_overBudgetFrames{0};
+    uint32_t m_underBudgetFrames{0};
+    uint32_t m_settleFrames{0};  // Measurements still to ignore, they may come from frames rendered before the last change
+};
@@ -0,0 +1,119 @@
+// Copyright (c) 2017-2020 The Khronos Group Inc.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include "pch.h"
+#include "common.h"
+#include <common/xr_linear.h>
+#include "scene.h"
+
+void CubeScene::Truncate(size_t count) {
+    if (count >= Size()) {
+        return;
+    }
+
+    m_poses.resize(count);
+    m_scales.resize(count);
+    m_meshes.resize(count);
+    m_models.resize(count);
+    m_spheres.resize(count);
+    m_drawsDirty = true;
+    m_bvhStale = true;
+    m_dirtyEnd = std::min(m_dirtyEnd, count);
+    m_dirtyBegin = std::min(m_dirtyBegin, m_dirtyEnd);
+}
+
+void CubeScene::Append(const Cube& cube) {
+    m_poses.push_back(cube.Pose);
+    m_scales.push_back(cube.Scale);
+    m_meshes.push_back(cube.Mesh);
+    m_models.emplace_back();
+    m_spheres.emplace_back();
+    m_drawsDirty = true;
+    m_bvhStale = true;
+    MarkDirty(Size() - 1);
+}
+
+void CubeScene::Append(const std::vector<Cube>& cubes) {
+    m_poses.reserve(Size() + cubes.size());
+    m_scales.reserve(Size() + cubes.size());
+    m_meshes.reserve(Size() + cubes.size());
+    m_models.reserve(Size() + cubes.size());
+    m_spheres.reserve(Size() + cubes.size());
+    for (const Cube& cube : cubes) {
+        Append(cube);
+    }
+}
+
+void CubeScene::Set(size_t index, const Cube& cube) {
+    CHECK(index < Size());
+    if (m_meshes[index] != cube.Mesh) {
+        m_meshes[index] = cube.Mesh;
+        m_drawsDirty = true;
+        MarkDirty(index);  // For the bounds of the new mesh
+    }
+    if (memcmp(&m_poses[index], &cube.Pose, sizeof(cube.Pose)) == 0 &&
+        memcmp(&m_scales[index], &cube.Scale, sizeof(cube.Scale)) == 0) {
+        return;
+    }
+
+    m_poses[index] = cube.Pose;
+    m_scales[index] = cube.Scale;
+    MarkDirty(index);
+}
+
+void CubeScene::SetMeshExtent(uint32_t mesh, const XrVector3f& extent) {
+    if (mesh >= m_meshExtents.size()) {
+        m_meshExtents.resize(mesh + 1, m_meshExtents[CubeMesh]);
+    }
+    m_meshExtents[mesh] = extent;
+    m_bvhStale = true;
+}
+
+void CubeScene::UpdateModels() {
+    if (m_drawsDirty) {
+        m_draws.clear();
+        for (uint32_t mesh : m_meshes) {
+            AppendMeshDraw(m_draws, mesh);
+        }
+        m_drawsDirty = false;
+    }
+
+    if (m_bvhStale) {
+        // Every sphere is needed for the build, not only the dirty ones.
+        UpdateSpheres(0, Size());
+        m_bvh.Build(m_spheres);
+    } else if (m_dirtyBegin != m_dirtyEnd) {
+        UpdateSpheres(m_dirtyBegin, m_dirtyEnd);
+        m_bvh.Refit(m_spheres, m_dirtyBegin, m_dirtyEnd);
+    }
+    m_bvhStale = false;
+
+    if (m_dirtyBegin == m_dirtyEnd) {
+        return;
+    }
+
+    XrMatrix4x4f_CreateTranslationRotationScaleArray(&m_models[m_dirtyBegin], &m_poses[m_dirtyBegin], sizeof(XrPosef),
+                                                     &m_scales[m_dirtyBegin], sizeof(XrVector3f), m_dirtyEnd - m_dirtyBegin);
+    m_dirtyBegin = m_dirtyEnd = 0;
+}
+
+void CubeScene::UpdateSpheres(size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i) {
+        // Half the diagonal of the scaled extent box bounds the mesh in any orientation.
+        const XrVector3f& extent = m_meshExtents[m_meshes[i]];
+        const XrVector3f& scale = m_scales[i];
+        const XrVector3f scaledExtent{extent.x * scale.x, extent.y * scale.y, extent.z * scale.z};
+        m_spheres[i] = {m_poses[i].position, XrVector3f_Length(&scaledExtent)};
+    }
+}
+
+void CubeScene::MarkDirty(size_t index) {
+    if (m_dirtyBegin == m_dirtyEnd) {
+        m_dirtyBegin = index;
+        m_dirtyEnd = index + 1;
+    } else {
+        m_dirtyBegin = std::min(m_dirtyBegin, index);
+        m_dirtyEnd = std::max(m_dirtyEnd, index + 1);
+    }
+}
@@ -0,0 +1,73 @@
+// Copyright (c) 2017-2020 The Khronos Group Inc
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include "bvh.h"
+#include "mesh.h"
+
+// One instance of a mesh, the cube unless it says otherwise.
+struct Cube {
+    XrPosef Pose;
+    XrVector3f Scale;
+    uint32_t Mesh{CubeMesh};
+};
+
+// Cubes that persist from frame to frame, kept as separate contiguous arrays of poses, scales, meshes and model matrices.
+// The model matrices are cached: UpdateModels only rebuilds the range of cubes that changed since the previous call. The
+// scene also keeps a BVH over the cubes' bounding spheres for culling and ray queries. Moving cubes refits it, adding or
+// removing cubes rebuilds it.
+class CubeScene {
+   public:
+    size_t Size() const { return m_poses.size(); }
+
+    // Drop the cubes from index count on.
+    void Truncate(size_t count);
+
+    void Append(const Cube& cube);
+    void Append(const std::vector<Cube>& cubes);
+
+    // Replace one cube. Its model matrix is only marked dirty if the pose or scale actually changed.
+    void Set(size_t index, const Cube& cube);
+
+    // Half-size of the box around the origin that holds a mesh, for the bounds of the cubes drawn with it. The cube's is
+    // known up front.
+    void SetMeshExtent(uint32_t mesh, const XrVector3f& extent);
+
+    // Rebuild the dirty model matrices in one batch, the mesh draws if any mesh changed, and refit or rebuild the BVH.
+    void UpdateModels();
+
+    const std::vector<XrPosef>& Poses() const { return m_poses; }
+    const std::vector<XrVector3f>& Scales() const { return m_scales; }
+    const std::vector<uint32_t>& Meshes() const { return m_meshes; }
+
+    // Model matrix of every cube, current as of the last UpdateModels.
+    const std::vector<XrMatrix4x4f>& Models() const { return m_models; }
+
+    // The meshes to draw Models with, current as of the last UpdateModels.
+    const std::vector<MeshDraw>& Draws() const { return m_draws; }
+
+    // The bounding spheres of the cubes, current as of the last UpdateModels. Its cube numbers are scene indices.
+    const SceneBvh& Bvh() const { return m_bvh; }
+
+   private:
+    void MarkDirty(size_t index);
+    void UpdateSpheres(size_t begin, size_t end);
+
+    std::vector<XrPosef> m_poses;
+    std::vector<XrVector3f> m_scales;
+    std::vector<uint32_t> m_meshes;
+    std::vector<XrMatrix4x4f> m_models;
+    std::vector<MeshDraw> m_draws;
+    bool m_drawsDirty{false};
+
+    std::vector<XrVector3f> m_meshExtents{{0.5f, 0.5f, 0.5f}};  // Indexed by mesh ID
+    std::vector<SceneBvh::Sphere> m_spheres;
+    SceneBvh m_bvh;
+    bool m_bvhStale{false};  // Cubes were added or removed, or a mesh extent changed
+
+    // Cubes [m_dirtyBegin, m_dirtyEnd) need their model matrix and bounding sphere rebuilt.
+    size_t m_dirtyBegin{0};
+    size_t m_dirtyEnd{0};
+};
@@ -0,0 +1,82 @@
+// Copyright (c) 2017-2020 The Khronos Group Inc.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include "pch.h"
+#include "common.h"
+#include "startup.h"
+
+#include <atomic>
+
+namespace {
+std::chrono::steady_clock::time_point g_startupBegin = std::chrono::steady_clock::now();
+std::atomic<bool> g_firstFrameReported{false};
+bool g_restarting{false};
+
+std::atomic<bool> g_stateChangePending{false};
+std::mutex g_stateChangeLock;
+const char* g_stateChangeName{nullptr};
+std::chrono::steady_clock::time_point g_stateChangeTime;
+double g_stateChangeQueuedMilliseconds{0};
+}  // namespace
+
+void BeginStartup() {
+    g_startupBegin = std::chrono::steady_clock::now();
+    g_firstFrameReported = false;
+    g_restarting = false;
+}
+
+void BeginRestart() {
+    BeginStartup();
+    g_restarting = true;
+}
+
+double StartupElapsedMilliseconds() {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - g_startupBegin).count();
+}
+
+void ReportFirstFrame() {
+    if (!g_firstFrameReported.exchange(true)) {
+        Log::Write(Log::Level::Info,
+                   Fmt("Time to first frame%s: %.1f ms", g_restarting ? " after restart" : "", StartupElapsedMilliseconds()));
+    }
+}
+
+void BeginStateChangeLatency(const char* stateName, double queuedMilliseconds) {
+    std::lock_guard<std::mutex> lock(g_stateChangeLock);
+    g_stateChangeName = stateName;
+    g_stateChangeTime = std::chrono::steady_clock::now();
+    g_stateChangeQueuedMilliseconds = queuedMilliseconds;
+    g_stateChangePending = true;
+}
+
+void ReportStateChangeLatency() {
+    if (!g_stateChangePending.load(std::memory_order_relaxed)) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(g_stateChangeLock);
+    if (g_stateChangePending.exchange(false)) {
+        const double latency =
+            std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - g_stateChangeTime).count();
+        Log::Write(Log::Level::Info, Fmt("Session state %s read to first xrEndFrame: %.1f ms (event queued up to %.1f ms)",
+                                         g_stateChangeName, latency, g_stateChangeQueuedMilliseconds));
+    }
+}
+
+ScopedStartupStage::ScopedStartupStage(const char* name) : m_name(name), m_start(StartupElapsedMilliseconds()) {}
+
+ScopedStartupStage::~ScopedStartupStage() {
+    const double end = StartupElapsedMilliseconds();
+    Log::Write(Log::Level::Info, Fmt("Startup stage '%s': %.1f ms (ended at %.1f ms)", m_name, end - m_start, end));
+}
+
+JobGraph::JobId AddStartupStage(JobGraph& graph, const char* name, std::function<void()> work,
+                                const std::vector<JobGraph::JobId>& dependencies, JobGraph::Thread thread) {
+    return graph.Add(
+        [name, work]() {
+            ScopedStartupStage stage(name);
+            work();
+        },
+        dependencies, thread);
+}
@@ -0,0 +1,65 @@
+// Copyright (c) 2017-2020 The Khronos Group Inc
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include "jobsystem.h"
+
+// Startup is timed from BeginStartup, called once per program instance, to the first frame submitted by that instance.
+void BeginStartup();
+// As BeginStartup, for a restart after instance or session loss. Called before the old program instance is torn down, so
+// the reported time covers the whole blackout.
+void BeginRestart();
+double StartupElapsedMilliseconds();
+// Log the time to first frame. Only the first call after BeginStartup logs anything.
+void ReportFirstFrame();
+
+// Time from reading a session state change event to the first xrEndFrame after it. queuedMilliseconds is how long the
+// event may have waited in the runtime's queue, the time since the previous xrPollEvent loop. A newer change replaces one
+// that has not been reported yet.
+void BeginStateChangeLatency(const char* stateName, double queuedMilliseconds);
+// Log the latency of the pending state change, if any. Cheap enough to call after every xrEndFrame.
+void ReportStateChangeLatency();
+
+// Waits between event polls while the session is not running, when xrWaitFrame does not throttle the loop. They start
+// short, because a state change tends to be followed by another soon after (IDLE, READY, then SYNCHRONIZED and so on), and
+// double while nothing happens, up to the old fixed interval.
+class IdleBackoff {
+   public:
+    static constexpr int64_t MinWaitMilliseconds = 1;
+    static constexpr int64_t MaxWaitMilliseconds = 250;
+
+    // Something happened, so make the next wait short again.
+    void Reset() { m_waitMilliseconds = MinWaitMilliseconds; }
+
+    // Length of the next wait.
+    std::chrono::milliseconds Next() {
+        const std::chrono::milliseconds wait(m_waitMilliseconds);
+        m_waitMilliseconds = m_waitMilliseconds * 2 < MaxWaitMilliseconds ? m_waitMilliseconds * 2 : MaxWaitMilliseconds;
+        return wait;
+    }
+
+   private:
+    int64_t m_waitMilliseconds{MinWaitMilliseconds};
+};
+
+// Logs how long a startup stage took, from construction to destruction.
+class ScopedStartupStage {
+   public:
+    explicit ScopedStartupStage(const char* name);
+    ~ScopedStartupStage();
+
+    ScopedStartupStage(const ScopedStartupStage&) = delete;
+    ScopedStartupStage& operator=(const ScopedStartupStage&) = delete;
+
+   private:
+    const char* const m_name;
+    const double m_start;
+};
+
+// Add a startup stage to a job graph, so it overlaps the stages that do not depend on it. It is timed like a
+// ScopedStartupStage, on whichever thread runs it.
+JobGraph::JobId AddStartupStage(JobGraph& graph, const char* name, std::function<void()> work,
+                                const std::vector<JobGraph::JobId>& dependencies = {},
+                                JobGraph::Thread thread = JobGraph::Thread::Any);
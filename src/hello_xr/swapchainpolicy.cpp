@@ -0,0 +1,123 @@
+// Copyright (c) 2017-2020 The Khronos Group Inc.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include "pch.h"
+#include "common.h"
+#include "swapchainpolicy.h"
+
+namespace {
+// Bytes per pixel once framebuffer compression is counted, in half bytes so they stay whole.
+uint32_t CompressedHalfBytes(const ColorFormatInfo& format) {
+    return format.Compressible ? format.BytesPerPixel : format.BytesPerPixel * 2;
+}
+
+bool Bands(const ColorFormatInfo& format) { return !format.Srgb && format.ColorBits < 10; }
+
+// Whether the policy ranks a before b.
+bool RanksBefore(SwapchainPolicy policy, const ColorFormatInfo& a, const ColorFormatInfo& b) {
+    switch (policy) {
+        case SwapchainPolicy::Quality:
+            if (a.ColorBits != b.ColorBits) {
+                return a.ColorBits > b.ColorBits;
+            }
+            if (a.Srgb != b.Srgb) {
+                return a.Srgb;
+            }
+            return CompressedHalfBytes(a) < CompressedHalfBytes(b);
+        case SwapchainPolicy::Balanced:
+            if (Bands(a) != Bands(b)) {
+                return !Bands(a);
+            }
+            if (CompressedHalfBytes(a) != CompressedHalfBytes(b)) {
+                return CompressedHalfBytes(a) < CompressedHalfBytes(b);
+            }
+            // 8-bit sRGB is the format framebuffer compression handles best.
+            if (a.Srgb != b.Srgb) {
+                return a.Srgb;
+            }
+            return a.ColorBits > b.ColorBits;
+        case SwapchainPolicy::Bandwidth:
+            if (CompressedHalfBytes(a) != CompressedHalfBytes(b)) {
+                return CompressedHalfBytes(a) < CompressedHalfBytes(b);
+            }
+            return Bands(a) != Bands(b) ? !Bands(a) : a.Srgb && !b.Srgb;
+        case SwapchainPolicy::Default:
+            break;
+    }
+    return false;
+}
+}  // namespace
+
+SwapchainPolicy GetSwapchainPolicy(const std::string& swapchainPolicyStr) {
+    if (EqualsIgnoreCase(swapchainPolicyStr, "Default")) {
+        return SwapchainPolicy::Default;
+    }
+    if (EqualsIgnoreCase(swapchainPolicyStr, "Quality")) {
+        return SwapchainPolicy::Quality;
+    }
+    if (EqualsIgnoreCase(swapchainPolicyStr, "Balanced")) {
+        return SwapchainPolicy::Balanced;
+    }
+    if (EqualsIgnoreCase(swapchainPolicyStr, "Bandwidth")) {
+        return SwapchainPolicy::Bandwidth;
+    }
+    throw std::invalid_argument(Fmt("Unknown swapchain policy '%s'", swapchainPolicyStr.c_str()));
+}
+
+const char* to_string(SwapchainPolicy policy) {
+    switch (policy) {
+        case SwapchainPolicy::Default:
+            return "Default";
+        case SwapchainPolicy::Quality:
+            return "Quality";
+        case SwapchainPolicy::Balanced:
+            return "Balanced";
+        case SwapchainPolicy::Bandwidth:
+            return "Bandwidth";
+    }
+    return "Unknown";
+}
+
+const ColorFormatInfo* SelectColorFormat(SwapchainPolicy policy, const std::vector<ColorFormatInfo>& candidates,
+                                         const std::vector<int64_t>& runtimeFormats, bool needsAlpha) {
+    if (policy == SwapchainPolicy::Default) {
+        return nullptr;
+    }
+
+    // Ties go to the earlier candidate.
+    const ColorFormatInfo* selected = nullptr;
+    for (const ColorFormatInfo& candidate : candidates) {
+        if ((needsAlpha && candidate.AlphaBits < 8) ||
+            std::find(runtimeFormats.begin(), runtimeFormats.end(), candidate.Format) == runtimeFormats.end()) {
+            continue;
+        }
+        if (selected == nullptr || RanksBefore(policy, candidate, *selected)) {
+            selected = &candidate;
+        }
+    }
+    return selected;
+}
+
+const ColorFormatInfo* FindColorFormat(const std::vector<ColorFormatInfo>& candidates, int64_t format) {
+    const auto it = std::find_if(candidates.begin(), candidates.end(),
+                                 [format](const ColorFormatInfo& candidate) { return candidate.Format == format; });
+    return it != candidates.end() ? &*it : nullptr;
+}
+
+uint32_t OnTileSampleCount(SwapchainPolicy policy) {
+    return policy == SwapchainPolicy::Quality || policy == SwapchainPolicy::Balanced ? 4 : 1;
+}
+
+bool AllowsSwapchainSamples(SwapchainPolicy policy) {
+    return policy == SwapchainPolicy::Default || policy == SwapchainPolicy::Quality;
+}
+
+uint64_t EstimateFramebufferTraffic(const ColorFormatInfo& color, uint64_t pixels, uint32_t swapchainSampleCount,
+                                    bool depthSubmitted) {
+    const uint64_t samples = std::max<uint32_t>(swapchainSampleCount, 1);
+    // Written samples, plus reading them back to resolve into a single-sampled image, which is then read by the compositor.
+    const uint64_t colorHalfBytes = CompressedHalfBytes(color) * (samples > 1 ? 2 * samples + 2 : 2);
+    const uint64_t depthHalfBytes = depthSubmitted ? 2 * 4 * samples * 2 : 0;
+    return pixels * (colorHalfBytes + depthHalfBytes) / 2;
+}
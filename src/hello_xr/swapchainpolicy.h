@@ -0,0 +1,52 @@
+// Copyright (c) 2017-2020 The Khronos Group Inc
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+// What to trade framebuffer bandwidth for when choosing the color swapchain format and the samples per pixel. Default keeps
+// the graphics plugin's own choice and the runtime's recommended sample count. Quality takes the most precise format and
+// multisamples, Balanced the cheapest format that does not band, multisampled only where the samples are resolved on tile,
+// and Bandwidth the cheapest format with a single sample.
+enum class SwapchainPolicy { Default, Quality, Balanced, Bandwidth };
+
+SwapchainPolicy GetSwapchainPolicy(const std::string& swapchainPolicyStr);
+
+const char* to_string(SwapchainPolicy policy);
+
+// A color swapchain format a graphics plugin can render into, and what storing it costs.
+struct ColorFormatInfo {
+    int64_t Format;
+    const char* Name;
+    uint32_t BytesPerPixel;
+    // Bits of the least precise color channel, or of its mantissa and exponent for floating-point formats.
+    uint32_t ColorBits;
+    uint32_t AlphaBits;
+    // 8-bit sRGB spends its precision where banding would show and does not band like 8-bit linear formats do.
+    bool Srgb;
+    // Whether mobile GPUs commonly keep render targets of the format framebuffer compressed (AFBC, UBWC), which is taken to
+    // halve their traffic. Snorm and 64-bit formats are not counted on to be.
+    bool Compressible;
+};
+
+// The candidate the policy ranks first among those the runtime supports, or nullptr for the Default policy or if the
+// runtime supports none. With needsAlpha, formats without an 8-bit alpha channel are passed over.
+const ColorFormatInfo* SelectColorFormat(SwapchainPolicy policy, const std::vector<ColorFormatInfo>& candidates,
+                                         const std::vector<int64_t>& runtimeFormats, bool needsAlpha);
+
+// The candidate describing format, or nullptr if there is none.
+const ColorFormatInfo* FindColorFormat(const std::vector<ColorFormatInfo>& candidates, int64_t format);
+
+// Samples per pixel to render with where the graphics plugin resolves them on tile, which costs no framebuffer bandwidth.
+uint32_t OnTileSampleCount(SwapchainPolicy policy);
+
+// Whether swapchains may be allocated multisampled as the runtime recommends. Every sample of those is written to memory and
+// read back to resolve them.
+bool AllowsSwapchainSamples(SwapchainPolicy policy);
+
+// Estimated framebuffer traffic to memory, in bytes per frame, of color swapchains of the format with pixels in all, each
+// written once by the renderer and read once by the compositor. Swapchains with more than one sample have every sample
+// written and read back to be resolved. Submitted depth is counted at 4 bytes per sample, written and read; samples resolved
+// on tile and depth that is never stored cost nothing.
+uint64_t EstimateFramebufferTraffic(const ColorFormatInfo& color, uint64_t pixels, uint32_t swapchainSampleCount,
+                                    bool depthSubmitted);
@@ -0,0 +1,103 @@
+// Copyright (c) 2017-2020 The Khronos Group Inc.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include "pch.h"
+#include "common.h"
+#include "threadscheduling.h"
+
+// The threading helpers are header-only C, most of their static functions are unused here.
+#if defined(_MSC_VER)
+#pragma warning(push)
+#pragma warning(disable : 4505)  // unreferenced local function has been removed
+#elif defined(__GNUC__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-function"
+#endif
+#include <utils/threading.h>
+#if defined(_MSC_VER)
+#pragma warning(pop)
+#elif defined(__GNUC__)
+#pragma GCC diagnostic pop
+#endif
+
+#if !defined(_WIN32)
+#include <sched.h>
+#endif
+
+static_assert(BigCores == THREAD_AFFINITY_BIG_CORES, "BigCores must match the threading helpers");
+
+namespace {
+void SetCurrentThreadCores(int cores) {
+#if defined(OS_LINUX)
+    // The Linux branch of ksThread_SetAffinity packs the mask into the wrong cpu_set_t bits, so set it here.
+    if (cores == BigCores) {
+        return;  // Only the Android branch finds the big cores
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int core = 0; core < 32; ++core) {
+        if (((unsigned)cores & (1u << core)) != 0) {
+            CPU_SET(core, &set);
+        }
+    }
+    const int result = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (result != 0) {
+        Log::Write(Log::Level::Warning, Fmt("Failed to set thread core mask 0x%x: error %d", (unsigned)cores, result));
+    }
+#else
+    ksThread_SetAffinity(cores);
+#endif
+}
+
+// What the calling thread is actually allowed, which may differ from what was asked for.
+std::string DescribeCurrentThread() {
+#if defined(_WIN32)
+    const DWORD priorityClass = GetPriorityClass(GetCurrentProcess());
+    const int priority = GetThreadPriority(GetCurrentThread());
+    DWORD_PTR processCores = 0;
+    DWORD_PTR systemCores = 0;
+    GetProcessAffinityMask(GetCurrentProcess(), &processCores, &systemCores);
+    // Windows has no call that reads a thread's affinity back, only the process's.
+    return Fmt("process cores 0x%llx, priority class 0x%lx, thread priority %d", (unsigned long long)processCores,
+               (unsigned long)priorityClass, priority);
+#else
+    std::string cores;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for (int core = 0; core < CPU_SETSIZE; ++core) {
+            if (CPU_ISSET(core, &set)) {
+                cores += cores.empty() ? Fmt("%d", core) : Fmt(",%d", core);
+            }
+        }
+    } else {
+        cores = "unknown";
+    }
+    const int policy = sched_getscheduler(0);
+    sched_param param{};
+    (void)sched_getparam(0, &param);
+    const char* policyName = policy == SCHED_FIFO ? "SCHED_FIFO" : (policy == SCHED_RR ? "SCHED_RR" : "normal");
+    return Fmt("cores %s and %s scheduling at priority %d", cores.c_str(), policyName, param.sched_priority);
+#endif
+}
+}  // namespace
+
+void ApplyThreadScheduling(const char* name, const ThreadScheduling& scheduling) {
+    if (scheduling.Cores != AnyCores) {
+        SetCurrentThreadCores(scheduling.Cores);
+    }
+    if (scheduling.RealTimePriority > 0) {
+        ksThread_SetRealTimePriority((int)scheduling.RealTimePriority);
+    }
+
+    std::string requestedCores = "any cores";
+    if (scheduling.Cores == BigCores) {
+        requestedCores = "big cores";
+    } else if (scheduling.Cores != AnyCores) {
+        requestedCores = Fmt("core mask 0x%x", (unsigned)scheduling.Cores);
+    }
+    Log::Write(Log::Level::Info, Fmt("%s thread: requested %s and real-time priority %u, running with %s", name,
+                                     requestedCores.c_str(), scheduling.RealTimePriority, DescribeCurrentThread().c_str()));
+    Trace::SetThreadName(name);
+}
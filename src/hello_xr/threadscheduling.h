@@ -0,0 +1,24 @@
+// Copyright (c) 2017-2020 The Khronos Group Inc
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+// Cores of ThreadScheduling::Cores: bit i allows core i. AnyCores leaves the placement to the OS.
+constexpr int AnyCores = 0;
+// The cores with the highest maximum frequency, the big cores of a big.LITTLE CPU. Only Android tells them apart, elsewhere
+// this is the same as AnyCores.
+constexpr int BigCores = -1;
+
+// Where and how urgently a thread runs.
+struct ThreadScheduling {
+    int Cores{AnyCores};
+    // SCHED_FIFO priority from 1 to 99, or 0 for normal scheduling. On Windows any non-zero value raises the process to
+    // the real-time priority class and the thread to time critical.
+    uint32_t RealTimePriority{0};
+};
+
+// Give the calling thread scheduling, through the threading helpers, and log the affinity and policy the thread ends up
+// with under name, which also names the thread in traces. Failures are logged, not thrown: the thread keeps running with
+// whatever the OS allowed.
+void ApplyThreadScheduling(const char* name, const ThreadScheduling& scheduling);
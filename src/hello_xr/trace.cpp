@@ -0,0 +1,186 @@
+// Copyright (c) 2017-2020 The Khronos Group Inc.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include "pch.h"
+#include "common.h"
+#include "trace.h"
+#include "framestats.h"
+
+#include <csignal>
+#include <mutex>
+
+#if defined(HELLO_XR_TRACING)
+
+namespace Trace {
+std::atomic<bool> g_enabled{false};
+}  // namespace Trace
+
+namespace {
+// Spans kept per thread, the newest ones. Each takes 24 bytes.
+constexpr uint64_t ThreadCapacity = 1 << 16;
+
+struct Event {
+    const char* Name;
+    uint64_t Begin;
+    uint64_t End;
+};
+
+// The ring of one thread. Span i goes into slot i % ThreadCapacity and is published by storing Count = i + 1.
+struct ThreadEvents {
+    std::string Name;  // Guarded by g_threadsMutex
+    uint32_t Id{0};
+    std::unique_ptr<Event[]> Events{new Event[ThreadCapacity]};
+    std::atomic<uint64_t> Count{0};
+};
+
+std::mutex g_threadsMutex;
+std::vector<std::unique_ptr<ThreadEvents>> g_threads;  // Never shrinks, the spans of a thread outlive it
+std::string g_path;
+uint64_t g_startTime{0};
+std::atomic<bool> g_writeRequested{false};
+static_assert(ATOMIC_BOOL_LOCK_FREE == 2, "Signal handlers may only touch lock-free atomics");
+
+thread_local std::string t_threadName;
+thread_local ThreadEvents* t_events{nullptr};
+
+ThreadEvents& LocalEvents() {
+    if (t_events == nullptr) {
+        std::lock_guard<std::mutex> lock(g_threadsMutex);
+        g_threads.push_back(std::make_unique<ThreadEvents>());
+        t_events = g_threads.back().get();
+        t_events->Id = (uint32_t)g_threads.size();
+        t_events->Name = t_threadName.empty() ? Fmt("Thread %u", t_events->Id) : t_threadName;
+    }
+    return *t_events;
+}
+
+#if !defined(_WIN32)
+void OnWriteSignal(int) { g_writeRequested.store(true, std::memory_order_relaxed); }
+#endif
+
+// Write name up to its first '(' as the body of a JSON string.
+void WriteName(FILE* file, const char* name) {
+    for (const char* c = name; *c != '\0' && *c != '('; ++c) {
+        if (*c == '"' || *c == '\\') {
+            fputc('\\', file);
+        }
+        if ((unsigned char)*c >= ' ') {
+            fputc(*c, file);
+        }
+    }
+}
+}  // namespace
+
+namespace Trace {
+void Start(const std::string& path) {
+    CHECK(!g_enabled.load());
+    g_path = path;
+    g_startTime = Now();
+#if !defined(_WIN32)
+    signal(SIGUSR1, OnWriteSignal);
+#endif
+#if !defined(ANDROID)
+    std::atexit([] { Write(); });
+#endif
+    g_enabled.store(true);
+    Log::Write(Log::Level::Info, Fmt("Tracing to '%s'", path.c_str()));
+}
+
+void Write() {
+    if (!g_enabled.load()) {
+        return;
+    }
+
+#if defined(_MSC_VER)
+    FILE* file = nullptr;
+    if (fopen_s(&file, g_path.c_str(), "w") != 0) {
+        file = nullptr;
+    }
+#else
+    FILE* file = fopen(g_path.c_str(), "w");
+#endif
+    if (file == nullptr) {
+        Log::Write(Log::Level::Warning, Fmt("Unable to open trace file '%s'", g_path.c_str()));
+        return;
+    }
+
+    fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    std::vector<Event> spans;
+    size_t spanCount = 0;
+    bool first = true;
+    std::lock_guard<std::mutex> lock(g_threadsMutex);
+    for (const std::unique_ptr<ThreadEvents>& thread : g_threads) {
+        // The thread may go on recording meanwhile. Copy its ring, then drop the spans it could have overwritten.
+        const uint64_t end = thread->Count.load(std::memory_order_acquire);
+        const uint64_t begin = end > ThreadCapacity ? end - ThreadCapacity : 0;
+        spans.clear();
+        for (uint64_t i = begin; i < end; ++i) {
+            spans.push_back(thread->Events[i % ThreadCapacity]);
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        const uint64_t recorded = thread->Count.load(std::memory_order_relaxed);
+        const uint64_t firstIntact = recorded + 1 > ThreadCapacity ? recorded + 1 - ThreadCapacity : 0;
+        const size_t torn = (size_t)std::min<uint64_t>(firstIntact > begin ? firstIntact - begin : 0, spans.size());
+
+        fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"", first ? "" : ",\n",
+                thread->Id);
+        WriteName(file, thread->Name.c_str());
+        fprintf(file, "\"}}");
+        first = false;
+        for (size_t i = torn; i < spans.size(); ++i) {
+            const Event& span = spans[i];
+            fprintf(file, ",\n{\"name\":\"");
+            WriteName(file, span.Name);
+            fprintf(file, "\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}", thread->Id,
+                    (span.Begin - g_startTime) / 1e3, (span.End - span.Begin) / 1e3);
+        }
+        spanCount += spans.size() - torn;
+    }
+    fprintf(file, "\n]}\n");
+    const bool written = fclose(file) == 0;
+
+    if (written) {
+        Log::Write(Log::Level::Info, Fmt("Wrote %zu spans of %zu threads to trace file '%s'", spanCount, g_threads.size(),
+                                         g_path.c_str()));
+    } else {
+        Log::Write(Log::Level::Warning, Fmt("Unable to write trace file '%s'", g_path.c_str()));
+    }
+}
+
+void WriteIfRequested() {
+    if (g_writeRequested.load(std::memory_order_relaxed) && g_writeRequested.exchange(false)) {
+        Write();
+    }
+}
+
+void SetThreadName(const char* name) {
+    t_threadName = name;
+    if (t_events != nullptr) {
+        std::lock_guard<std::mutex> lock(g_threadsMutex);
+        t_events->Name = name;
+    }
+}
+
+uint64_t Now() { return FrameStatsNow(); }
+
+void Record(const char* name, uint64_t begin, uint64_t end) {
+    ThreadEvents& events = LocalEvents();
+    const uint64_t index = events.Count.load(std::memory_order_relaxed);
+    events.Events[index % ThreadCapacity] = {name, begin, end};
+    events.Count.store(index + 1, std::memory_order_release);
+}
+}  // namespace Trace
+
+#else
+
+namespace Trace {
+void Start(const std::string& /*path*/) {
+    Log::Write(Log::Level::Warning, "Built without HELLO_XR_TRACING, no trace is recorded");
+}
+void Write() {}
+void WriteIfRequested() {}
+void SetThreadName(const char* /*name*/) {}
+}  // namespace Trace
+
+#endif
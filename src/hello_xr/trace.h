@@ -0,0 +1,73 @@
+// Copyright (c) 2017-2020 The Khronos Group Inc
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include <atomic>
+#include <string>
+
+// Timeline of the OpenXR and graphics API calls, the frame phases and the graphics plugins' submit and wait points, for
+// finding the bubbles in the frame pipeline that the aggregate frame stats hide. Builds with HELLO_XR_TRACING record a
+// span per traced scope, once Start was called, into a ring per thread that only that thread writes, and save the newest
+// spans of every thread as Chrome trace JSON, which chrome://tracing and ui.perfetto.dev open. A traced scope costs one
+// relaxed atomic load while tracing is not started; without HELLO_XR_TRACING the macros compile to the bare call.
+namespace Trace {
+// Record spans from now on, and write them to path when the program exits or, on POSIX systems, receives SIGUSR1. Android
+// apps may be killed without running exit handlers, so there the main loop writes them once it ends instead.
+void Start(const std::string& path);
+// Write the spans recorded so far to the path given to Start. Recording goes on.
+void Write();
+// Write the spans if a signal asked for it since the last call. Called once per frame.
+void WriteIfRequested();
+// Name the calling thread in the trace.
+void SetThreadName(const char* name);
+
+#if defined(HELLO_XR_TRACING)
+extern std::atomic<bool> g_enabled;
+
+inline bool IsEnabled() { return g_enabled.load(std::memory_order_relaxed); }
+
+uint64_t Now();
+
+// Record a span of the calling thread. name is kept as a pointer, so it has to outlive the trace, as string literals do.
+// Anything from the first '(' on is left out of the trace, so the text of a call can name the span of the call.
+void Record(const char* name, uint64_t begin, uint64_t end);
+
+// Records a span from construction to destruction, if tracing had started at construction.
+class Span {
+   public:
+    explicit Span(const char* name) : m_name(IsEnabled() ? name : nullptr), m_begin(m_name != nullptr ? Now() : 0) {}
+    ~Span() {
+        if (m_name != nullptr) {
+            Record(m_name, m_begin, Now());
+        }
+    }
+
+    Span(const Span&) = delete;
+    Span& operator=(const Span&) = delete;
+
+   private:
+    const char* const m_name;
+    const uint64_t m_begin;
+};
+#endif
+}  // namespace Trace
+
+#if defined(HELLO_XR_TRACING)
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+// Trace the rest of the enclosing scope under name.
+#define TRACE_SCOPE(name) ::Trace::Span TRACE_CONCAT(traceSpan, __LINE__)(name)
+// Evaluate call in a span that ends with the call, before its result is used.
+#define TRACE_CALL(call, name)               \
+    [&]() -> decltype(auto) {                \
+        const ::Trace::Span traceSpan(name); \
+        return call;                         \
+    }()
+#else
+#define TRACE_SCOPE(name) \
+    do {                  \
+    } while (false)
+#define TRACE_CALL(call, name) (call)
+#endif
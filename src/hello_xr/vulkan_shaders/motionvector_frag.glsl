@@ -0,0 +1,19 @@
+// Copyright (c) 2017-2020 The Khronos Group Inc.
+//
+// SPDX-License-Identifier: Apache-2.0
+#version 400
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_ARB_shading_language_420pack : enable
+
+#pragma fragment
+
+layout (location = 0) in vec4 oCurrent;
+layout (location = 1) in vec4 oPrevious;
+
+layout (location = 0) out vec4 MotionVector;
+
+void main()
+{
+    // How far the surface moved in normalized device coordinates since the previous frame
+    MotionVector = vec4(oCurrent.xyz / oCurrent.w - oPrevious.xyz / oPrevious.w, 0);
+}
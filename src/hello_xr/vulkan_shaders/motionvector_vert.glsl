@@ -0,0 +1,33 @@
+// Copyright (c) 2017-2020 The Khronos Group Inc.
+//
+// SPDX-License-Identifier: Apache-2.0
+#version 400
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_ARB_shading_language_420pack : enable
+
+#pragma vertex
+
+layout (std140, set = 0, binding = 0) uniform buf
+{
+    mat4 vp;
+} ubuf;
+
+layout (location = 0) in vec3 Position;
+// Per-instance model transforms of this frame and the previous one, occupy locations 2-5 and 6-9.
+layout (location = 2) in mat4 Model;
+layout (location = 6) in mat4 PreviousModel;
+
+layout (location = 0) out vec4 oCurrent;
+layout (location = 1) out vec4 oPrevious;
+out gl_PerVertex
+{
+    vec4 gl_Position;
+};
+
+void main()
+{
+    vec4 position = vec4(Position, 1);
+    oCurrent = ubuf.vp * (Model * position);
+    oPrevious = ubuf.vp * (PreviousModel * position);
+    gl_Position = oCurrent;
+}
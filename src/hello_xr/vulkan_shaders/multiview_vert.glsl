@@ -0,0 +1,32 @@
+// Copyright (c) 2017-2020 The Khronos Group Inc.
+//
+// SPDX-License-Identifier: Apache-2.0
+#version 400
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_ARB_shading_language_420pack : enable
+#extension GL_EXT_multiview : require
+
+#pragma vertex
+
+layout (std140, set = 0, binding = 0) uniform buf
+{
+    mat4 vp[2];
+} ubuf;
+
+layout (location = 0) in vec3 Position;
+layout (location = 1) in vec3 Color;
+// Per-instance model transform, occupies locations 2-5.
+layout (location = 2) in mat4 Model;
+
+layout (location = 0) out vec4 oColor;
+out gl_PerVertex
+{
+    vec4 gl_Position;
+};
+
+void main()
+{
+    oColor.rgb  = Color.rgb;
+    oColor.a  = 1.0;
+    gl_Position = ubuf.vp[gl_ViewIndex] * Model * vec4(Position, 1);
+}